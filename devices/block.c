@@ -4,7 +4,36 @@
 
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Latency histogram buckets.  Bucket I counts requests taking
+ * fewer than 2**(I + HIST_SHIFT + 1) cycles, and the last bucket
+ * everything slower. */
+#define HIST_BUCKETS 16
+#define HIST_SHIFT 11
+
+/* Statistics for one kind of operation on a block device.  A
+ * request is one call into the block layer, however many
+ * sectors it covers. */
+struct block_stats {
+    unsigned long long req_cnt;            /* Requests. */
+    unsigned long long seq_cnt;            /* Requests starting where the
+                                            * device's previous one ended. */
+    unsigned long long sector_cnt;         /* Sectors transferred. */
+    uint64_t           cycles;             /* Total latency. */
+    unsigned long long hist[HIST_BUCKETS]; /* Latency histogram. */
+};
+
+/* Operations, for indexing block_stats. */
+enum block_op {
+    BLOCK_OP_READ,
+    BLOCK_OP_WRITE,
+    BLOCK_OP_CNT
+};
 
 /* A block device. */
 struct block {
@@ -17,8 +46,8 @@ struct block {
     const struct block_operations *ops;       /* Driver operations. */
     void                          *aux;       /* Extra data owned by driver. */
 
-    unsigned long long             read_cnt;  /* Number of sectors read. */
-    unsigned long long             write_cnt; /* Number of sectors written. */
+    struct block_stats             stats[BLOCK_OP_CNT]; /* Statistics. */
+    block_sector_t                 next;      /* Sector after the last request. */
 };
 
 /* List of all block devices. */
@@ -28,6 +57,8 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block(struct list_elem *);
+static void record(struct block *, enum block_op, block_sector_t,
+                   block_sector_t cnt, uint64_t start);
 
 /* Returns a human-readable name for the given block device
  * TYPE. */
@@ -119,9 +150,12 @@ check_sector(struct block *block, block_sector_t sector)
 void
 block_read(struct block *block, block_sector_t sector, void *buffer)
 {
+    uint64_t start = timer_cycles();
+
     check_sector(block, sector);
     block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
+    record(block, BLOCK_OP_READ, sector, 1, start);
+    trace(TRACE_BLOCK_READ, sector, timer_cycles() - start);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -132,10 +166,97 @@ block_read(struct block *block, block_sector_t sector, void *buffer)
 void
 block_write(struct block *block, block_sector_t sector, const void *buffer)
 {
+    uint64_t start = timer_cycles();
+
     check_sector(block, sector);
     ASSERT(block->type != BLOCK_FOREIGN);
     block->ops->write(block->aux, sector, buffer);
-    block->write_cnt++;
+    record(block, BLOCK_OP_WRITE, sector, 1, start);
+    trace(TRACE_BLOCK_WRITE, sector, timer_cycles() - start);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR lie within
+ * BLOCK.  Panics if not. */
+static void
+check_range(struct block *block, block_sector_t sector, block_sector_t cnt)
+{
+    if (cnt > 0) {
+        check_sector(block, sector);
+        if (cnt > block->size - sector) {
+            check_sector(block, block->size);
+        }
+    }
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+ * BLOCK into BUFFER, which must have room for CNT *
+ * BLOCK_SECTOR_SIZE bytes.  The sectors are requested from the
+ * device in as few commands as it allows, rather than one at a
+ * time. */
+void
+block_read_multiple(struct block *block, block_sector_t sector,
+                    block_sector_t cnt, void *buffer_)
+{
+    uint8_t *buffer = buffer_;
+    block_sector_t first = sector, total = cnt;
+    uint64_t start = timer_cycles();
+
+    check_range(block, sector, cnt);
+    while (cnt > 0) {
+        block_sector_t n = cnt < BLOCK_MAX_MULTIPLE ? cnt : BLOCK_MAX_MULTIPLE;
+
+        if (block->ops->read_multiple != NULL) {
+            block->ops->read_multiple(block->aux, sector, n, buffer);
+        } else {
+            block_sector_t i;
+
+            for (i = 0; i < n; i++) {
+                block->ops->read(block->aux, sector + i,
+                                 buffer + i * BLOCK_SECTOR_SIZE);
+            }
+        }
+        sector += n;
+        buffer += n * BLOCK_SECTOR_SIZE;
+        cnt -= n;
+    }
+    if (total > 0) {
+        record(block, BLOCK_OP_READ, first, total, start);
+    }
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+ * from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes,
+ * in as few commands as the device allows. */
+void
+block_write_multiple(struct block *block, block_sector_t sector,
+                     block_sector_t cnt, const void *buffer_)
+{
+    const uint8_t *buffer = buffer_;
+    block_sector_t first = sector, total = cnt;
+    uint64_t start = timer_cycles();
+
+    check_range(block, sector, cnt);
+    ASSERT(block->type != BLOCK_FOREIGN);
+    while (cnt > 0) {
+        block_sector_t n = cnt < BLOCK_MAX_MULTIPLE ? cnt : BLOCK_MAX_MULTIPLE;
+
+        if (block->ops->write_multiple != NULL) {
+            block->ops->write_multiple(block->aux, sector, n, buffer);
+        } else {
+            block_sector_t i;
+
+            for (i = 0; i < n; i++) {
+                block->ops->write(block->aux, sector + i,
+                                  buffer + i * BLOCK_SECTOR_SIZE);
+            }
+        }
+        sector += n;
+        buffer += n * BLOCK_SECTOR_SIZE;
+        cnt -= n;
+    }
+    if (total > 0) {
+        record(block, BLOCK_OP_WRITE, first, total, start);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -159,7 +280,101 @@ block_type(struct block *block)
     return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Records a request of type OP for the CNT sectors starting at
+ * SECTOR of BLOCK, begun at cycle START and just completed. */
+static void
+record(struct block *block, enum block_op op, block_sector_t sector,
+       block_sector_t cnt, uint64_t start)
+{
+    struct block_stats *s = &block->stats[op];
+    uint64_t cycles = timer_cycles() - start;
+    enum intr_level old_level;
+    int bucket = 0;
+
+    while (bucket < HIST_BUCKETS - 1
+           && cycles >= (uint64_t) 1 << (bucket + HIST_SHIFT + 1)) {
+        bucket++;
+    }
+
+    /* Requests from different threads may complete together. */
+    old_level = intr_disable();
+    s->req_cnt++;
+    s->seq_cnt += sector == block->next;
+    s->sector_cnt += cnt;
+    s->cycles += cycles;
+    s->hist[bucket]++;
+    block->next = sector + cnt;
+    intr_set_level(old_level);
+}
+
+/* Stores the transfers BLOCK has done so far in *COUNTS. */
+void
+block_get_counts(struct block *block, struct block_counts *counts)
+{
+    enum intr_level old_level = intr_disable();
+
+    counts->read_sectors = block->stats[BLOCK_OP_READ].sector_cnt;
+    counts->write_sectors = block->stats[BLOCK_OP_WRITE].sector_cnt;
+    counts->read_reqs = block->stats[BLOCK_OP_READ].req_cnt;
+    counts->write_reqs = block->stats[BLOCK_OP_WRITE].req_cnt;
+    intr_set_level(old_level);
+}
+
+/* Prints BLOCK's statistics for OP, named NAME. */
+static void
+print_op_stats(const struct block *block, enum block_op op, const char *name)
+{
+    const struct block_stats *s = &block->stats[op];
+    int i;
+
+    if (s->req_cnt == 0) {
+        return;
+    }
+    printf("  %s: %llu requests, %llu bytes, %llu%% sequential, "
+           "%llu cycles (%llu ns) avg\n",
+           name, s->req_cnt, s->sector_cnt * BLOCK_SECTOR_SIZE,
+           s->seq_cnt * 100 / s->req_cnt, s->cycles / s->req_cnt,
+           timer_cycles_to_ns(s->cycles) / s->req_cnt);
+    printf("  %s latency:", name);
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        if (s->hist[i] > 0) {
+            printf(" %s2^%d: %llu",
+                   i < HIST_BUCKETS - 1 ? "<" : ">=",
+                   i < HIST_BUCKETS - 1 ? i + HIST_SHIFT + 1 : i + HIST_SHIFT,
+                   s->hist[i]);
+        }
+    }
+    printf("\n");
+}
+
+/* Makes the running thread's I/O idle class if IDLE, or gives it
+ * the thread's priority again if not.  Meant for threads that
+ * write back or read ahead on behalf of others, whose requests
+ * should wait for everyone else's. */
+void
+block_set_idle(bool idle)
+{
+    thread_current()->io_idle = idle;
+}
+
+/* Returns the I/O priority of thread T's requests.  An idle class
+ * thread that has received a priority donation, because another
+ * thread waits for a lock it holds, uses the donated priority.
+ * The MLFQS does not donate, and computes priorities of its own. */
+int
+block_io_priority(const struct thread *t)
+{
+    if (t->io_idle && (thread_mlfqs || t->priority <= t->base_priority)) {
+        return BLOCK_PRI_IDLE;
+    }
+    return t->priority;
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+ * followed by those of the IDE channels.  A request is one call
+ * into the block layer; many small ones at a low sequential
+ * percentage point at the caller, high latency per request at
+ * the device. */
 void
 block_print_stats(void)
 {
@@ -170,9 +385,13 @@ block_print_stats(void)
         if (block != NULL) {
             printf("%s (%s): %llu reads, %llu writes\n",
                    block->name, block_type_name(block->type),
-                   block->read_cnt, block->write_cnt);
+                   block->stats[BLOCK_OP_READ].sector_cnt,
+                   block->stats[BLOCK_OP_WRITE].sector_cnt);
+            print_op_stats(block, BLOCK_OP_READ, "read");
+            print_op_stats(block, BLOCK_OP_WRITE, "write");
         }
     }
+    ide_print_stats();
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -197,8 +416,8 @@ block_register(const char *name, enum block_type type,
     block->size = size;
     block->ops = ops;
     block->aux = aux;
-    block->read_cnt = 0;
-    block->write_cnt = 0;
+    memset(block->stats, 0, sizeof block->stats);
+    block->next = 0;
 
     printf("%s: %'"PRDSNu " sectors (", block->name, block->size);
     print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -2,6 +2,7 @@
 #define DEVICES_BLOCK_H
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Size of a block device sector in bytes.
@@ -51,19 +52,57 @@ struct block *block_next(struct block *);
 block_sector_t block_size(struct block *);
 void block_read(struct block *, block_sector_t, void *);
 void block_write(struct block *, block_sector_t, const void *);
+void block_read_multiple(struct block *, block_sector_t, block_sector_t cnt,
+                         void *);
+void block_write_multiple(struct block *, block_sector_t, block_sector_t cnt,
+                          const void *);
 const char *block_name(struct block *);
 enum block_type block_type(struct block *);
 
+/* I/O priority.  A driver that queues requests serves them by the
+ * I/O priority of the threads waiting for them: a thread's
+ * effective priority, donations included, or BLOCK_PRI_IDLE, below
+ * every other, for a thread doing background I/O. */
+#define BLOCK_PRI_IDLE (-1)
+
+struct thread;
+void block_set_idle(bool idle);
+int block_io_priority(const struct thread *);
+
 /* Statistics. */
+
+/* Transfers a block device has done.  A request is one call into
+ * the block layer, however many sectors it covers. */
+struct block_counts {
+    unsigned long long read_sectors;  /* Sectors read. */
+    unsigned long long write_sectors; /* Sectors written. */
+    unsigned long long read_reqs;     /* Read requests. */
+    unsigned long long write_reqs;    /* Write requests. */
+};
+
+void block_get_counts(struct block *, struct block_counts *);
 void block_print_stats(void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Driver operations.  READ_MULTIPLE and WRITE_MULTIPLE transfer
+ * CNT consecutive sectors, from 1 to BLOCK_MAX_MULTIPLE, with one
+ * request to the device.  A driver that cannot do better than a
+ * sector at a time leaves them null, and the block layer calls
+ * READ or WRITE once per sector instead. */
 struct block_operations {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
 };
 
+/* Most sectors passed to one READ_MULTIPLE or WRITE_MULTIPLE
+ * call. */
+#define BLOCK_MAX_MULTIPLE 256
+
 struct block *block_register(const char *name, enum block_type,
                              const char *extra_info, block_sector_t size,
                              const struct block_operations *, void *aux);
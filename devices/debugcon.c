@@ -0,0 +1,28 @@
+#include "devices/debugcon.h"
+#include "threads/io.h"
+
+/* The debug console: I/O port 0xe9, which QEMU (with -debugcon)
+ * and Bochs (with port_e9_hack) pass straight through to the
+ * host, a byte per OUT instruction, without emulating a UART's
+ * line rate or interrupts.  There is no input. */
+
+/* Debug port. */
+#define DEBUGCON_PORT 0xe9
+
+/* If true, console output goes to the debug port instead of the
+ * serial port.  Set by the -debugcon kernel option. */
+bool debugcon_enabled;
+
+/* Sends BYTE to the debug port. */
+void
+debugcon_putc(uint8_t byte)
+{
+    outb(DEBUGCON_PORT, byte);
+}
+
+/* Sends the N bytes in BUFFER to the debug port. */
+void
+debugcon_putbuf(const uint8_t *buffer, size_t n)
+{
+    outsb(DEBUGCON_PORT, buffer, n);
+}
@@ -0,0 +1,15 @@
+#ifndef DEVICES_DEBUGCON_H
+#define DEVICES_DEBUGCON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* If true, console output goes to the debug port instead of the
+ * serial port. */
+extern bool debugcon_enabled;
+
+void debugcon_putc(uint8_t);
+void debugcon_putbuf(const uint8_t *, size_t);
+
+#endif /* devices/debugcon.h */
@@ -0,0 +1,83 @@
+#include "devices/fwcfg.h"
+#include <stdint.h>
+#include <string.h>
+#include "threads/io.h"
+
+/* QEMU's firmware configuration device, fw_cfg: a directory of
+ * named files, which the host supplies on QEMU's command line
+ * with -fw_cfg, read through a pair of I/O ports by selecting an
+ * item and then reading its bytes in order.  Unlike the rest of
+ * the machine's state, the files come from the command line of
+ * the QEMU that is running, not from a saved snapshot.  Bochs
+ * and real hardware have no such device.
+ *
+ * See docs/specs/fw_cfg.rst in the QEMU sources. */
+
+/* I/O ports. */
+#define FWCFG_PORT_SEL 0x510    /* Item selector, 16 bits. */
+#define FWCFG_PORT_DATA 0x511   /* Next byte of the selected item. */
+
+/* Items. */
+#define FWCFG_SIGNATURE 0x0000  /* "QEMU". */
+#define FWCFG_FILE_DIR 0x0019   /* Directory of named files. */
+
+/* An entry in the file directory, which follows a 32-bit count
+ * of entries.  Numbers are big-endian. */
+struct fwcfg_file {
+    uint32_t size;              /* Size of the file in bytes. */
+    uint16_t select;            /* Item that holds it. */
+    uint16_t reserved;
+    char name[56];              /* Null-terminated name. */
+};
+
+static uint32_t be32_to_cpu(uint32_t);
+
+/* Returns true if the machine has a fw_cfg device. */
+bool
+fwcfg_present(void)
+{
+    char signature[4];
+
+    outw(FWCFG_PORT_SEL, FWCFG_SIGNATURE);
+    insb(FWCFG_PORT_DATA, signature, sizeof signature);
+    return !memcmp(signature, "QEMU", sizeof signature);
+}
+
+/* Reads the fw_cfg file called NAME into BUFFER, as much of it
+ * as fits in SIZE bytes.  Returns the file's size, which may be
+ * more than SIZE, or -1 if there is no such file or no fw_cfg
+ * device. */
+int
+fwcfg_read_file(const char *name, void *buffer, size_t size)
+{
+    uint32_t cnt, i;
+
+    if (!fwcfg_present()) {
+        return -1;
+    }
+    outw(FWCFG_PORT_SEL, FWCFG_FILE_DIR);
+    insb(FWCFG_PORT_DATA, &cnt, sizeof cnt);
+    cnt = be32_to_cpu(cnt);
+    for (i = 0; i < cnt; i++) {
+        struct fwcfg_file f;
+
+        insb(FWCFG_PORT_DATA, &f, sizeof f);
+        f.name[sizeof f.name - 1] = '\0';
+        if (!strcmp(f.name, name)) {
+            uint32_t file_size = be32_to_cpu(f.size);
+
+            outw(FWCFG_PORT_SEL, f.select >> 8 | (f.select & 0xff) << 8);
+            insb(FWCFG_PORT_DATA, buffer,
+                 size < file_size ? size : file_size);
+            return file_size;
+        }
+    }
+    return -1;
+}
+
+/* Converts X from big-endian to the CPU's byte order. */
+static uint32_t
+be32_to_cpu(uint32_t x)
+{
+    return (x >> 24 | (x >> 8 & 0xff00) | (x << 8 & 0xff0000) | x << 24);
+}
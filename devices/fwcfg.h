@@ -0,0 +1,10 @@
+#ifndef DEVICES_FWCFG_H
+#define DEVICES_FWCFG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool fwcfg_present(void);
+int fwcfg_read_file(const char *name, void *, size_t size);
+
+#endif /* devices/fwcfg.h */
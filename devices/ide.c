@@ -6,10 +6,15 @@
 #include "devices/block.h"
 #include "devices/ide.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* The code in this file is an interface to an ATA (IDE)
  * controller.  It attempts to comply to [ATA-3]. */
@@ -35,6 +40,41 @@
 #define STA_BSY  0x80 /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ  0x08 /* Data Request. */
+#define STA_ERR  0x01 /* Error. */
+
+/* Bus master IDE port addresses, for a channel whose controller
+ * supports PCI bus mastering.  See [BMIDE]. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL)  ((CHANNEL)->bm_base + 2) /* Status. */
+#define reg_bm_prdt(CHANNEL)    ((CHANNEL)->bm_base + 4) /* PRD table address. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ  0x08 /* Transfer from the disk to memory. */
+
+/* Bus master Status Register bits.  ERROR and INTR are cleared
+ * by writing 1 to them; the DMA capable bits are kept as is. */
+#define BM_STA_ACTIVE  0x01 /* Transfer in progress. */
+#define BM_STA_ERROR   0x02 /* Transfer failed. */
+#define BM_STA_INTR    0x04 /* Disk raised its interrupt. */
+#define BM_STA_CAPABLE 0x60 /* Drives 0 and 1 are DMA capable. */
+
+/* Entry in a Physical Region Descriptor table, which tells the
+ * bus master where in memory a transfer goes.  A region must not
+ * cross a 64 kB boundary; a SIZE of 0 means 64 kB. */
+struct prd {
+    uint32_t addr;  /* Physical address, even. */
+    uint16_t size;  /* Bytes, even. */
+    uint16_t flags; /* PRD_EOT in the table's last entry. */
+};
+#define PRD_EOT 0x8000
+
+/* PCI class and subclass of an IDE controller. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE  0x01
+
+/* Bus master registers are in BAR4, I/O space. */
+#define PCI_REG_BMIDE (PCI_REG_BAR0 + 4 * 4)
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -48,8 +88,27 @@
  * Many more are defined but this is the small subset that we
  * use. */
 #define CMD_IDENTIFY_DEVICE    0xec /* IDENTIFY DEVICE. */
-#define CMD_READ_SECTOR_RETRY  0x20 /* READ SECTOR with retries. */
-#define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_SECTOR_RETRY  0x20 /* READ SECTOR(S) with retries. */
+#define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR(S) with retries. */
+#define CMD_READ_DMA           0xc8 /* READ DMA. */
+#define CMD_WRITE_DMA          0xca /* WRITE DMA. */
+#define CMD_READ_SECTOR_EXT    0x24 /* READ SECTOR(S) EXT. */
+#define CMD_WRITE_SECTOR_EXT   0x34 /* WRITE SECTOR(S) EXT. */
+#define CMD_READ_DMA_EXT       0x25 /* READ DMA EXT. */
+#define CMD_WRITE_DMA_EXT      0x35 /* WRITE DMA EXT. */
+
+/* Sectors reachable by the 28-bit commands.  A disk that supports
+ * the 48-bit feature set is addressed with the EXT commands past
+ * this point. */
+#define LBA28_SECTORS (1UL << 28)
+
+/* Largest disk, in bytes, that we are willing to touch.  See
+ * identify_ata_device().  Building with, say,
+ * -DIDE_MAX_BYTES=0x20000000000ULL in a project's DEFINES lifts
+ * the limit. */
+#ifndef IDE_MAX_BYTES
+#define IDE_MAX_BYTES (1024ULL * 1024 * 1024)
+#endif
 
 /* An ATA device. */
 struct ata_disk {
@@ -57,6 +116,12 @@ struct ata_disk {
     struct channel *channel; /* Channel that disk is attached to. */
     int             dev_no;  /* Device 0 or 1 for master or slave. */
     bool            is_ata;  /* Is device an ATA disk? */
+    bool            dma;     /* Transfer by bus master DMA? */
+    bool            lba48;   /* Supports 48-bit LBA commands? */
+
+    /* Found by identify_ata_device(), for ide_register(). */
+    block_sector_t  capacity;        /* Size in sectors. */
+    char            extra_info[128]; /* Model and serial number. */
 };
 
 /* An ATA channel (aka controller).
@@ -66,25 +131,112 @@ struct channel {
     uint16_t         reg_base;            /* Base I/O port. */
     uint8_t          irq;                 /* Interrupt in use. */
 
-    struct lock      lock;                /* Must acquire to access the controller. */
     bool             expecting_interrupt; /* True if an interrupt is expected, false if
                                            * any interrupt would be spurious. */
     struct semaphore completion_wait;     /* Up'd by interrupt handler. */
 
+    /* Request queue.  Only touched with interrupts off. */
+    struct list      queue;               /* Waiting requests, in position order. */
+    struct list      active;              /* Requests in the command in progress. */
+    uint64_t         head;                /* Position just past the last command. */
+
+    /* Command in progress, made of the requests in ACTIVE. */
+    bool             xfer_dma;            /* Bus master DMA, instead of PIO? */
+    bool             xfer_write;          /* Write, instead of read? */
+    block_sector_t   xfer_cnt;            /* Sectors in the command. */
+    block_sector_t   xfer_done;           /* Sectors completed so far. */
+    struct block_request *xfer_req;       /* Request of the next PIO sector. */
+    block_sector_t   xfer_ofs;            /* Its sector offset in XFER_REQ. */
+
+    /* Statistics. */
+    unsigned         depth;               /* Requests queued or active now. */
+    unsigned         max_depth;           /* Most requests queued or active. */
+    unsigned long long depth_sum;         /* Sum of DEPTH seen by each request. */
+    unsigned long long req_cnt;           /* Requests submitted. */
+    unsigned long long cmd_cnt;           /* Commands issued. */
+    unsigned long long sector_cnt;        /* Sectors transferred. */
+    int64_t          busy_start;          /* When DEPTH last became nonzero. */
+    int64_t          busy_ticks;          /* Ticks with DEPTH nonzero. */
+    uint64_t         cmd_start;           /* When the current command started. */
+    uint64_t         queue_cycles;        /* Cycles requests spent queued. */
+    uint64_t         service_cycles;      /* Cycles commands spent on the disk. */
+    unsigned long long idle_cnt;          /* Idle class requests submitted. */
+    unsigned long long aged_cnt;          /* Commands started for aging. */
+
+    uint16_t         bm_base;             /* Bus master ports, or 0 for PIO only. */
+    struct prd      *prdt;                /* PRD table, in a page of its own. */
+
     struct ata_disk  devices[2];          /* The devices on this channel. */
 };
 
+/* A request to transfer CNT consecutive sectors between a disk
+ * and a buffer.  The requesting thread queues it on the disk's
+ * channel and sleeps on DONE until the interrupt handler has
+ * finished the command that carried it. */
+struct block_request {
+    struct list_elem elem;     /* Element in channel's queue or active list. */
+    struct ata_disk *disk;     /* Disk. */
+    block_sector_t   sec_no;   /* First sector. */
+    block_sector_t   cnt;      /* Number of sectors. */
+    uint8_t         *buffer;   /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool             write;    /* Write BUFFER to disk, instead of read? */
+    struct semaphore done;     /* Up'd once the transfer is complete. */
+    uint64_t         queued;   /* When it was queued, in CPU cycles. */
+    struct thread   *thread;   /* Requester, for its I/O priority. */
+};
+
+/* I/O classes.  A request's class is the I/O priority of its
+ * requester, IO_CLASS_PRIS priority levels to a class, with the
+ * idle priority in a class of its own below the rest.  It rises by
+ * one for each IO_AGE_MS the request has waited, up to
+ * IO_CLASS_MAX. */
+#define IO_CLASS_PRIS 16
+#define IO_CLASS_MAX (PRI_MAX / IO_CLASS_PRIS + 1)
+#define IO_AGE_MS 50
+
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* The channels are probed at the same time, each by a thread of
+ * its own, but register their disks in order: channel N's thread
+ * ups PROBED[N] once its disks and their partitions are
+ * registered, and channel N + 1's waits for it first.  Disk names
+ * and the order of the block device list so stay the same from
+ * boot to boot, while one channel's partitions are scanned as the
+ * next is still being reset. */
+static struct semaphore probed[CHANNEL_CNT];
+
 static struct block_operations ide_operations;
 
-static void reset_channel(struct channel *);
+static uint16_t find_bus_master(void);
+
+static void submit_request(struct ata_disk *, block_sector_t, block_sector_t,
+                           void *, bool write);
+
+static inline bool request_before(const struct block_request *,
+                                  const struct block_request *);
+LIST_DEFINE_ORDERED(request_queue, struct block_request, elem,
+                    request_before)
+
+static void start_command(struct channel *);
+static bool dma_setup(struct channel *);
+static uint8_t *next_pio_sector(struct channel *);
+static void command_interrupt(struct channel *);
+static void finish_command(struct channel *);
+
+static void ide_read_multiple(void *, block_sector_t, block_sector_t, void *);
+static void ide_write_multiple(void *, block_sector_t, block_sector_t,
+                               const void *);
+
+static void probe_channel(void *channel);
+static bool reset_channel(struct channel *);
 static bool check_device_type(struct ata_disk *);
 static void identify_ata_device(struct ata_disk *);
+static void register_ata_device(struct ata_disk *);
 
-static void select_sector(struct ata_disk *, block_sector_t);
+static bool select_sector(struct ata_disk *, block_sector_t,
+                          block_sector_t cnt);
 
 static void issue_pio_command(struct channel *, uint8_t command);
 
@@ -94,6 +246,7 @@ static void output_sector(struct channel *, const void *);
 
 static void wait_until_idle(const struct ata_disk *);
 static bool wait_while_busy(const struct ata_disk *);
+static bool wait_for_drq(const struct ata_disk *);
 static void select_device(const struct ata_disk *);
 static void select_device_wait(const struct ata_disk *);
 
@@ -103,6 +256,7 @@ static void interrupt_handler(struct intr_frame *);
 void
 ide_init(void)
 {
+    uint16_t bm_base = find_bus_master();
     size_t chan_no;
 
     for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -123,9 +277,26 @@ ide_init(void)
         default:
             NOT_REACHED();
         }
-        lock_init(&c->lock);
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
+        list_init(&c->queue);
+        list_init(&c->active);
+        c->head = 0;
+        c->depth = c->max_depth = 0;
+        c->depth_sum = c->req_cnt = c->cmd_cnt = c->sector_cnt = 0;
+        c->busy_start = c->busy_ticks = 0;
+        c->queue_cycles = c->service_cycles = 0;
+
+        /* Each channel has 8 bus master ports of its own.  Without
+         * a PRD table it falls back to PIO. */
+        c->bm_base = 0;
+        c->prdt = NULL;
+        if (bm_base != 0) {
+            c->prdt = palloc_get_page(0);
+            if (c->prdt != NULL) {
+                c->bm_base = bm_base + chan_no * 8;
+            }
+        }
 
         /* Initialize devices. */
         for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -135,40 +306,135 @@ ide_init(void)
             d->channel = c;
             d->dev_no = dev_no;
             d->is_ata = false;
+            d->dma = false;
         }
 
         /* Register interrupt handler. */
         intr_register_ext(c->irq, interrupt_handler, c->name);
+    }
 
-        /* Reset hardware. */
-        reset_channel(c);
+    /* Probe the channels in parallel, or one after another if we
+     * cannot start a thread, and wait for the last to finish. */
+    for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+        sema_init(&probed[chan_no], 0);
+    }
+    for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+        struct channel *c = &channels[chan_no];
 
-        /* Distinguish ATA hard disks from other devices. */
-        if (check_device_type(&c->devices[0])) {
-            check_device_type(&c->devices[1]);
+        if (thread_create(c->name, PRI_DEFAULT, probe_channel, c)
+            == TID_ERROR) {
+            probe_channel(c);
         }
+    }
+    sema_down(&probed[CHANNEL_CNT - 1]);
+}
 
-        /* Read hard disk identity information. */
-        for (dev_no = 0; dev_no < 2; dev_no++) {
-            if (c->devices[dev_no].is_ata) {
-                identify_ata_device(&c->devices[dev_no]);
-            }
+/* Prints statistics for each channel that has seen requests.
+ * The two channels work independently, so with disks on both
+ * their busy times may overlap. */
+void
+ide_print_stats(void)
+{
+    struct channel *c;
+
+    for (c = channels; c < channels + CHANNEL_CNT; c++) {
+        unsigned long long avg10;
+
+        if (c->req_cnt == 0) {
+            continue;
         }
+        avg10 = c->depth_sum * 10 / c->req_cnt;
+        printf("%s: %llu requests in %llu commands (%llu sectors), "
+               "queue depth %llu.%llu avg, %u max, busy %"PRId64" ticks\n",
+               c->name, c->req_cnt, c->cmd_cnt, c->sector_cnt,
+               avg10 / 10, avg10 % 10, c->max_depth, c->busy_ticks);
+        printf("%s: %llu ns queued per request, "
+               "%llu ns on disk per command\n", c->name,
+               timer_cycles_to_ns(c->queue_cycles) / c->req_cnt,
+               c->cmd_cnt > 0
+               ? timer_cycles_to_ns(c->service_cycles) / c->cmd_cnt : 0);
+        printf("%s: %llu idle class requests, %llu commands started "
+               "by aging\n", c->name, c->idle_cnt, c->aged_cnt);
     }
 }
 
+/* Looks for a PCI IDE controller that can act as bus master and
+ * enables bus mastering on it.  Returns the base of its bus
+ * master ports, or 0 if there is none. */
+static uint16_t
+find_bus_master(void)
+{
+    struct pci_addr a;
+    uint32_t bar, cmd;
+
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &a)) {
+        return 0;
+    }
+    bar = pci_read_config(&a, PCI_REG_BMIDE);
+    if ((bar & 1) == 0 || (bar & 0xfffc) == 0) {
+        /* Not an I/O space BAR, or not assigned. */
+        return 0;
+    }
+    cmd = pci_read_config(&a, PCI_REG_COMMAND);
+    pci_write_config(&a, PCI_REG_COMMAND,
+                     cmd | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+    return bar & 0xfffc;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string(char *, int size);
 
-/* Resets an ATA channel and waits for any devices present on it
- * to finish the reset. */
+/* Resets channel C, finds out what devices are attached to it,
+ * and then, in channel order, registers its ATA disks.  Runs in a
+ * thread of its own; see PROBED. */
 static void
+probe_channel(void *c_)
+{
+    struct channel *c = c_;
+    size_t chan_no = c - channels;
+    int dev_no;
+
+    /* Reset hardware and distinguish ATA hard disks from other
+     * devices. */
+    if (reset_channel(c) && check_device_type(&c->devices[0])) {
+        check_device_type(&c->devices[1]);
+    }
+
+    /* Read hard disk identity information. */
+    for (dev_no = 0; dev_no < 2; dev_no++) {
+        if (c->devices[dev_no].is_ata) {
+            identify_ata_device(&c->devices[dev_no]);
+        }
+    }
+
+    /* Register the disks after those of the previous channel. */
+    if (chan_no > 0) {
+        sema_down(&probed[chan_no - 1]);
+    }
+    for (dev_no = 0; dev_no < 2; dev_no++) {
+        if (c->devices[dev_no].is_ata) {
+            register_ata_device(&c->devices[dev_no]);
+        }
+    }
+    sema_up(&probed[chan_no]);
+}
+
+/* Resets an ATA channel and waits for any devices present on it
+ * to finish the reset.  Returns false, without resetting, if
+ * there are none: a channel with nothing attached floats its
+ * status register to 0xff, and a missing device does not keep
+ * the values written to its registers. */
+static bool
 reset_channel(struct channel *c)
 {
     bool present[2];
     int dev_no;
 
+    if (inb(reg_status(c)) == 0xff) {
+        return false;
+    }
+
     /* The ATA reset sequence depends on which devices are present,
      * so we start by detecting device presence. */
     for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -188,6 +454,9 @@ reset_channel(struct channel *c)
         present[dev_no] = (inb(reg_nsect(c)) == 0x55
                            && inb(reg_lbal(c)) == 0xaa);
     }
+    if (!present[0] && !present[1]) {
+        return false;
+    }
 
     /* Issue soft reset sequence, which selects device 0 as a side effect.
      * Also enable interrupts. */
@@ -218,6 +487,7 @@ reset_channel(struct channel *c)
         }
         wait_while_busy(&c->devices[1]);
     }
+    return true;
 }
 
 /* Checks whether device D is an ATA disk and sets D's is_ata
@@ -250,8 +520,8 @@ check_device_type(struct ata_disk *d)
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
- * response.  Registers the disk with the block device
- * layer. */
+ * response.  Clears D's is_ata member if D is not a disk that we
+ * can use. */
 static void
 identify_ata_device(struct ata_disk *d)
 {
@@ -259,8 +529,6 @@ identify_ata_device(struct ata_disk *d)
     char id[BLOCK_SECTOR_SIZE];
     block_sector_t capacity;
     char *model, *serial;
-    char extra_info[128];
-    struct block *block;
 
     ASSERT(d->is_ata);
 
@@ -276,29 +544,48 @@ identify_ata_device(struct ata_disk *d)
     }
     input_sector(c, id);
 
-    /* Calculate capacity.
-     * Read model name and serial number. */
+    /* Calculate capacity: words 60-61 count the sectors that the
+     * 28-bit commands reach, words 100-103 all of them on a disk
+     * with the 48-bit feature set, which word 83 bit 10 announces.
+     * We cannot name more sectors than fit in block_sector_t.
+     * Read model name and serial number.
+     * Word 49 bit 8 says whether DMA is supported. */
     capacity = *(uint32_t *)&id[60 * 2];
+    d->lba48 = (*(uint16_t *)&id[83 * 2] & 0x400) != 0;
+    if (d->lba48) {
+        uint64_t capacity48 = *(uint64_t *)&id[100 * 2];
+
+        capacity = capacity48 < UINT32_MAX ? capacity48 : UINT32_MAX;
+    }
+    d->dma = c->bm_base != 0 && (*(uint16_t *)&id[49 * 2] & 0x100) != 0;
     model = descramble_ata_string(&id[10 * 2], 20);
     serial = descramble_ata_string(&id[27 * 2], 40);
-    snprintf(extra_info, sizeof extra_info,
+    snprintf(d->extra_info, sizeof d->extra_info,
              "model \"%s\", serial \"%s\"", model, serial);
 
-    /* Disable access to IDE disks over 1 GB, which are likely
-     * physical IDE disks rather than virtual ones.  If we don't
-     * allow access to those, we're less likely to scribble on
-     * someone's important data.  You can disable this check by
-     * hand if you really want to do so. */
-    if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE) {
+    /* Disable access to IDE disks of IDE_MAX_BYTES (1 GB) or
+     * more, which are likely physical IDE disks rather than
+     * virtual ones.  If we don't allow access to those, we're less
+     * likely to scribble on someone's important data.  You can
+     * raise IDE_MAX_BYTES if you really want to do so. */
+    if (capacity >= IDE_MAX_BYTES / BLOCK_SECTOR_SIZE) {
         printf("%s: ignoring ", d->name);
-        print_human_readable_size(capacity * 512);
+        print_human_readable_size((uint64_t) capacity * BLOCK_SECTOR_SIZE);
         printf("disk for safety\n");
         d->is_ata = false;
         return;
     }
+    d->capacity = capacity;
+}
 
-    /* Register. */
-    block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
+/* Registers disk D, identified by identify_ata_device(), with the
+ * block device layer, and scans it for partitions. */
+static void
+register_ata_device(struct ata_disk *d)
+{
+    struct block *block;
+
+    block = block_register(d->name, BLOCK_RAW, d->extra_info, d->capacity,
                            &ide_operations, d);
     partition_scan(block);
 }
@@ -335,20 +622,9 @@ descramble_ata_string(char *string, int size)
  * Internally synchronizes accesses to disks, so external
  * per-disk locking is unneeded. */
 static void
-ide_read(void *d_, block_sector_t sec_no, void *buffer)
+ide_read(void *d, block_sector_t sec_no, void *buffer)
 {
-    struct ata_disk *d = d_;
-    struct channel *c = d->channel;
-
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d)) {
-        PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-    }
-    input_sector(c, buffer);
-    lock_release(&c->lock);
+    ide_read_multiple(d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -357,45 +633,434 @@ ide_read(void *d_, block_sector_t sec_no, void *buffer)
  * Internally synchronizes accesses to disks, so external
  * per-disk locking is unneeded. */
 static void
-ide_write(void *d_, block_sector_t sec_no, const void *buffer)
+ide_write(void *d, block_sector_t sec_no, const void *buffer)
+{
+    ide_write_multiple(d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+ * BUFFER.  The read is queued behind any other requests for the
+ * channel and may be merged with neighboring ones into a single
+ * command. */
+static void
+ide_read_multiple(void *d, block_sector_t sec_no, block_sector_t cnt,
+                  void *buffer)
+{
+    submit_request(d, sec_no, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+ * BUFFER, as ide_read_multiple().  Returns after the disk has
+ * acknowledged receiving all of the data. */
+static void
+ide_write_multiple(void *d, block_sector_t sec_no, block_sector_t cnt,
+                   const void *buffer)
+{
+    submit_request(d, sec_no, cnt, (void *)buffer, true);
+}
+
+/* Request queue.
+ *
+ * Each channel keeps the requests it has not started yet in a
+ * list sorted by position, meaning disk and then sector.  It
+ * serves the highest I/O class waiting first, so that a
+ * background scan, or the flusher, does not hold up interactive
+ * reads, and serves the requests of that class in C-LOOK order:
+ * it sweeps upward from the end of the previous command and wraps
+ * around to the lowest position when nothing is left above.
+ * Classes follow the requesters' priorities, read afresh each time
+ * a command is chosen, so that a donation to a thread waiting for
+ * the disk speeds up its request too, and waiting raises them, so
+ * that no request starves.  A request that starts where the
+ * chosen one ends, on the same disk and in the same direction,
+ * goes into the same command, up to 256 sectors in all, whatever
+ * its class.
+ *
+ * Commands run entirely off the interrupt handler: it moves the
+ * data for PIO, wakes the requesters when the command finishes,
+ * and starts the next command right away. */
+
+/* Queues a transfer of the CNT sectors starting at SEC_NO between
+ * disk D and BUFFER and waits for it to complete. */
+static void
+submit_request(struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+               void *buffer, bool write)
 {
-    struct ata_disk *d = d_;
     struct channel *c = d->channel;
+    struct block_request r;
+    enum intr_level old_level;
+
+    ASSERT(!intr_context());
+    ASSERT(cnt >= 1 && cnt <= BLOCK_MAX_MULTIPLE);
+
+    r.disk = d;
+    r.sec_no = sec_no;
+    r.cnt = cnt;
+    r.buffer = buffer;
+    r.write = write;
+    sema_init(&r.done, 0);
+    r.queued = timer_cycles();
+    r.thread = thread_current();
+
+    old_level = intr_disable();
+    if (c->depth++ == 0) {
+        c->busy_start = timer_ticks();
+    }
+    if (c->depth > c->max_depth) {
+        c->max_depth = c->depth;
+    }
+    c->depth_sum += c->depth;
+    c->req_cnt++;
+    if (block_io_priority(r.thread) == BLOCK_PRI_IDLE) {
+        c->idle_cnt++;
+    }
+    request_queue_insert_ordered(&c->queue, &r);
+    if (list_empty(&c->active)) {
+        start_command(c);
+    }
+    intr_set_level(old_level);
 
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d)) {
-        PANIC("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+    sema_down(&r.done);
+}
+
+/* Returns the position of request R, for ordering the queue. */
+static uint64_t
+request_pos(const struct block_request *r)
+{
+    return ((uint64_t)r->disk->dev_no << 32) | r->sec_no;
+}
+
+/* Returns true if request A comes before request B in position
+ * order. */
+static inline bool
+request_before(const struct block_request *a, const struct block_request *b)
+{
+    return request_pos(a) < request_pos(b);
+}
+
+/* Returns request R's I/O class before aging. */
+static int
+request_base_class(const struct block_request *r)
+{
+    int priority = block_io_priority(r->thread);
+
+    return priority == BLOCK_PRI_IDLE ? 0 : priority / IO_CLASS_PRIS + 1;
+}
+
+/* Returns request R's I/O class at time NOW, in CPU cycles. */
+static int
+request_class(const struct block_request *r, uint64_t now)
+{
+    uint64_t age_cycles = timer_cycles_per_sec() / 1000 * IO_AGE_MS;
+    uint64_t age = age_cycles > 0 ? (now - r->queued) / age_cycles : 0;
+    int class = request_base_class(r);
+
+    return age < (uint64_t)(IO_CLASS_MAX - class) ? class + (int)age
+                                                  : IO_CLASS_MAX;
+}
+
+/* Picks the next requests from channel C's queue, if there are
+ * any, and issues them to the disk as one command.  Interrupts
+ * must be off and no command may be in progress. */
+static void
+start_command(struct channel *c)
+{
+    struct block_request *first, *last, *lowest;
+    struct list_elem *e;
+    struct ata_disk *d;
+    uint64_t now;
+    int class;
+    bool ext;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(list_empty(&c->active));
+
+    if (list_empty(&c->queue)) {
+        return;
+    }
+
+    /* The highest class waiting, and in it, C-LOOK: the first
+     * request at or above the head, or else the lowest one. */
+    now = timer_cycles();
+    class = -1;
+    first = lowest = NULL;
+    for (e = list_begin(&c->queue); e != list_end(&c->queue);
+         e = list_next(e)) {
+        struct block_request *r = list_entry(e, struct block_request, elem);
+        int r_class = request_class(r, now);
+
+        if (r_class > class) {
+            class = r_class;
+            first = NULL;
+            lowest = r;
+        }
+        if (r_class == class && first == NULL && request_pos(r) >= c->head) {
+            first = r;
+        }
+    }
+    if (first == NULL) {
+        first = lowest;
+    }
+    if (class > request_base_class(first)) {
+        c->aged_cnt++;
+    }
+    last = first;
+    e = &first->elem;
+    d = first->disk;
+    c->xfer_cnt = first->cnt;
+
+    /* Merge the requests that continue where it leaves off. */
+    e = list_next(e);
+    while (e != list_end(&c->queue)) {
+        struct block_request *r = list_entry(e, struct block_request, elem);
+
+        if (r->disk != d || r->write != first->write
+            || r->sec_no != last->sec_no + last->cnt
+            || c->xfer_cnt + r->cnt > BLOCK_MAX_MULTIPLE) {
+            break;
+        }
+        last = r;
+        c->xfer_cnt += r->cnt;
+        e = list_next(e);
+    }
+    c->cmd_start = timer_cycles();
+    for (e = &first->elem; e != list_next(&last->elem);) {
+        struct list_elem *next = list_next(e);
+
+        c->queue_cycles += (c->cmd_start
+                            - list_entry(e, struct block_request, elem)->queued);
+        list_remove(e);
+        list_push_back(&c->active, e);
+        e = next;
+    }
+    c->head = request_pos(last) + last->cnt;
+    c->cmd_cnt++;
+    c->sector_cnt += c->xfer_cnt;
+
+    c->xfer_write = first->write;
+    c->xfer_done = 0;
+    c->xfer_req = first;
+    c->xfer_ofs = 0;
+    c->xfer_dma = d->dma && dma_setup(c);
+
+    ext = select_sector(d, first->sec_no, c->xfer_cnt);
+    c->expecting_interrupt = true;
+    if (c->xfer_dma) {
+        if (ext) {
+            outb(reg_command(c), (c->xfer_write
+                                  ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT));
+        } else {
+            outb(reg_command(c), (c->xfer_write
+                                  ? CMD_WRITE_DMA : CMD_READ_DMA));
+        }
+        outb(reg_bm_command(c), inb(reg_bm_command(c)) | BM_CMD_START);
+    } else {
+        if (ext) {
+            outb(reg_command(c), (c->xfer_write
+                                  ? CMD_WRITE_SECTOR_EXT
+                                  : CMD_READ_SECTOR_EXT));
+        } else {
+            outb(reg_command(c), (c->xfer_write
+                                  ? CMD_WRITE_SECTOR_RETRY
+                                  : CMD_READ_SECTOR_RETRY));
+        }
+        if (c->xfer_write) {
+            /* The disk interrupts once it has taken each sector,
+             * so the first one has to be handed over here. */
+            if (!wait_for_drq(d)) {
+                PANIC("%s: disk write failed, sector=%"PRDSNu,
+                      d->name, first->sec_no);
+            }
+            output_sector(c, next_pio_sector(c));
+        }
+    }
+}
+
+/* Fills in channel C's PRD table for the requests in its active
+ * list and programs the bus master with it.  Returns false,
+ * without touching the bus master, if a buffer is not suitably
+ * aligned for DMA, or comes from vmalloc() and so is not
+ * physically contiguous, in which case the command should use
+ * PIO. */
+static bool
+dma_setup(struct channel *c)
+{
+    struct list_elem *e;
+    size_t n = 0;
+
+    for (e = list_begin(&c->active); e != list_end(&c->active);
+         e = list_next(e)) {
+        void *buffer = list_entry(e, struct block_request, elem)->buffer;
+
+        if (is_vmalloc_vaddr(buffer) || (vtop(buffer) & 1) != 0) {
+            return false;
+        }
+    }
+
+    /* Each buffer is physically contiguous, like all direct-mapped
+     * kernel memory, so it needs one region per 64 kB boundary crossed.  At most
+     * 256 sectors make for at most 512 regions, which fit in the
+     * page. */
+    for (e = list_begin(&c->active); e != list_end(&c->active);
+         e = list_next(e)) {
+        struct block_request *r = list_entry(e, struct block_request, elem);
+        uintptr_t phys = vtop(r->buffer);
+        size_t bytes = r->cnt * BLOCK_SECTOR_SIZE;
+
+        while (bytes > 0) {
+            size_t chunk = 0x10000 - (phys & 0xffff);
+
+            if (chunk > bytes) {
+                chunk = bytes;
+            }
+            c->prdt[n].addr = phys;
+            c->prdt[n].size = chunk & 0xffff;
+            c->prdt[n].flags = 0;
+            n++;
+            phys += chunk;
+            bytes -= chunk;
+        }
+    }
+    ASSERT(n <= PGSIZE / sizeof *c->prdt);
+    c->prdt[n - 1].flags = PRD_EOT;
+
+    outl(reg_bm_prdt(c), vtop(c->prdt));
+    outb(reg_bm_command(c), c->xfer_write ? 0 : BM_CMD_READ);
+    outb(reg_bm_status(c), ((inb(reg_bm_status(c)) & BM_STA_CAPABLE)
+                            | BM_STA_ERROR | BM_STA_INTR));
+    return true;
+}
+
+/* Returns the buffer for the next sector of channel C's PIO
+ * command and advances past it. */
+static uint8_t *
+next_pio_sector(struct channel *c)
+{
+    struct block_request *r = c->xfer_req;
+    uint8_t *sector = r->buffer + c->xfer_ofs * BLOCK_SECTOR_SIZE;
+
+    if (++c->xfer_ofs == r->cnt) {
+        c->xfer_req = list_entry(list_next(&r->elem), struct block_request, elem);
+        c->xfer_ofs = 0;
+    }
+    return sector;
+}
+
+/* Handles an interrupt for channel C's command in progress. */
+static void
+command_interrupt(struct channel *c)
+{
+    struct block_request *first = list_entry(list_front(&c->active),
+                                             struct block_request, elem);
+    struct ata_disk *d = first->disk;
+    uint8_t status = inb(reg_status(c)); /* Acknowledge interrupt. */
+
+    if (c->xfer_dma) {
+        uint8_t bm_status;
+
+        outb(reg_bm_command(c), inb(reg_bm_command(c)) & ~BM_CMD_START);
+        bm_status = inb(reg_bm_status(c));
+        outb(reg_bm_status(c), (bm_status & BM_STA_CAPABLE) | BM_STA_INTR);
+        if ((bm_status & BM_STA_ERROR) != 0 || (status & STA_ERR) != 0) {
+            PANIC("%s: disk %s failed, sector=%"PRDSNu,
+                  d->name, c->xfer_write ? "write" : "read", first->sec_no);
+        }
+        finish_command(c);
+    } else if (!c->xfer_write) {
+        /* A sector is ready to be read. */
+        if ((status & (STA_BSY | STA_DRQ | STA_ERR)) != STA_DRQ) {
+            PANIC("%s: disk read failed, sector=%"PRDSNu,
+                  d->name, first->sec_no + c->xfer_done);
+        }
+        input_sector(c, next_pio_sector(c));
+        if (++c->xfer_done == c->xfer_cnt) {
+            finish_command(c);
+        }
+    } else {
+        /* A sector has been written. */
+        if ((status & STA_ERR) != 0) {
+            PANIC("%s: disk write failed, sector=%"PRDSNu,
+                  d->name, first->sec_no + c->xfer_done);
+        }
+        if (++c->xfer_done == c->xfer_cnt) {
+            finish_command(c);
+        } else {
+            if (!wait_for_drq(d)) {
+                PANIC("%s: disk write failed, sector=%"PRDSNu,
+                      d->name, first->sec_no + c->xfer_done);
+            }
+            output_sector(c, next_pio_sector(c));
+        }
     }
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
-    lock_release(&c->lock);
+}
+
+/* Wakes up the requesters of channel C's completed command and
+ * starts the next one. */
+static void
+finish_command(struct channel *c)
+{
+    c->expecting_interrupt = false;
+    c->service_cycles += timer_cycles() - c->cmd_start;
+    while (!list_empty(&c->active)) {
+        struct block_request *r = list_entry(list_pop_front(&c->active),
+                                             struct block_request, elem);
+        sema_up(&r->done);
+        if (--c->depth == 0) {
+            c->busy_ticks += timer_ticks() - c->busy_start;
+        }
+    }
+    start_command(c);
 }
 
 static struct block_operations ide_operations =
 {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
 };
 
 /* Selects device D, waiting for it to become ready, and then
- * writes SEC_NO to the disk's sector selection registers.  (We
- * use LBA mode.) */
-static void
-select_sector(struct ata_disk *d, block_sector_t sec_no)
+ * writes SEC_NO and the sector count CNT, from 1 to 256, to the
+ * disk's sector selection registers.  (We use LBA mode.)
+ * Returns true if the transfer reaches past the 28-bit sectors,
+ * in which case the registers are loaded for, and the caller
+ * must issue, a 48-bit EXT command. */
+static bool
+select_sector(struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
     struct channel *c = d->channel;
+    bool ext = sec_no >= LBA28_SECTORS || cnt > LBA28_SECTORS - sec_no;
 
-    ASSERT(sec_no < (1UL << 28));
+    ASSERT(cnt >= 1 && cnt <= 256);
+    ASSERT(!ext || d->lba48);
 
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
-    outb(reg_lbal(c), sec_no);
-    outb(reg_lbam(c), sec_no >> 8);
-    outb(reg_lbah(c), (sec_no >> 16));
-    outb(reg_device(c),
-         DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+    if (ext) {
+        /* Each register is a two-byte FIFO: the high-order byte
+         * goes in first.  Bits 32-47 are 0, since block_sector_t
+         * has only 32. */
+        outb(reg_nsect(c), cnt >> 8);
+        outb(reg_lbal(c), sec_no >> 24);
+        outb(reg_lbam(c), 0);
+        outb(reg_lbah(c), 0);
+        outb(reg_nsect(c), cnt);
+        outb(reg_lbal(c), sec_no);
+        outb(reg_lbam(c), sec_no >> 8);
+        outb(reg_lbah(c), sec_no >> 16);
+        outb(reg_device(c),
+             DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0));
+    } else {
+        /* A count of 0 asks for 256 sectors. */
+        outb(reg_nsect(c), cnt == 256 ? 0 : cnt);
+        outb(reg_lbal(c), sec_no);
+        outb(reg_lbam(c), sec_no >> 8);
+        outb(reg_lbah(c), (sec_no >> 16));
+        outb(reg_device(c),
+             DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0)
+             | (sec_no >> 24));
+    }
+    return ext;
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -443,7 +1108,7 @@ wait_until_idle(const struct ata_disk *d)
         if ((inb(reg_status(d->channel)) & (STA_BSY | STA_DRQ)) == 0) {
             return;
         }
-        timer_usleep(10);
+        timer_udelay(10);
     }
 
     printf("%s: idle timeout\n", d->name);
@@ -476,6 +1141,31 @@ wait_while_busy(const struct ata_disk *d)
     return false;
 }
 
+/* Busy-waits up to 10 ms for disk D to clear BSY and set DRQ, as
+ * it does shortly after a write command and after taking each
+ * sector of it.  Returns false on error or timeout.  Unlike
+ * wait_while_busy(), never sleeps, so it may be called from the
+ * interrupt handler. */
+static bool
+wait_for_drq(const struct ata_disk *d)
+{
+    struct channel *c = d->channel;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        uint8_t status = inb(reg_alt_status(c));
+
+        if ((status & STA_ERR) != 0) {
+            return false;
+        }
+        if ((status & (STA_BSY | STA_DRQ)) == STA_DRQ) {
+            return true;
+        }
+        timer_udelay(10);
+    }
+    return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device(const struct ata_disk *d)
@@ -488,7 +1178,7 @@ select_device(const struct ata_disk *d)
     }
     outb(reg_device(c), dev);
     inb(reg_alt_status(c));
-    timer_nsleep(400);
+    timer_ndelay(400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -509,7 +1199,9 @@ interrupt_handler(struct intr_frame *f)
 
     for (c = channels; c < channels + CHANNEL_CNT; c++) {
         if (f->vec_no == c->irq) {
-            if (c->expecting_interrupt) {
+            if (!list_empty(&c->active)) {
+                command_interrupt(c);
+            } else if (c->expecting_interrupt) {
                 inb(reg_status(c));           /* Acknowledge interrupt. */
                 sema_up(&c->completion_wait); /* Wake up waiter. */
             } else {
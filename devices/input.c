@@ -1,17 +1,37 @@
 #include <debug.h>
 
 #include "devices/input.h"
-#include "devices/intq.h"
+#include "devices/ring.h"
 #include "devices/serial.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
 
-/* Stores keys from the keyboard and serial port. */
-static struct intq buffer;
+/* Stores keys from the keyboard and serial port.  The keyboard
+ * and serial interrupt handlers add keys, and since external
+ * interrupts don't nest they never do so at once, so they act as
+ * a single producer.  Threads reading keys take turns with
+ * GETC_LOCK, making a single consumer, so that they get keys out
+ * without turning interrupts off. */
+static struct ring buffer;
+static uint8_t buffer_buf[64];
+static struct lock getc_lock;
+
+/* Upped for each key added, for a reader waiting on an empty
+ * buffer. */
+static struct semaphore key_added;
+
+/* Threads in poll() waiting for a key.  Only used with
+ * interrupts off, since input_putc() wakes it. */
+static struct waitq pollers;
 
 /* Initializes the input buffer. */
 void
 input_init(void)
 {
-    intq_init(&buffer);
+    ring_init(&buffer, buffer_buf, sizeof buffer_buf);
+    lock_init(&getc_lock);
+    sema_init(&key_added, 0);
+    waitq_init(&pollers);
 }
 
 /* Adds a key to the input buffer.
@@ -19,10 +39,14 @@ input_init(void)
 void
 input_putc(uint8_t key)
 {
+    bool added;
+
     ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(!intq_full(&buffer));
 
-    intq_putc(&buffer, key);
+    added = ring_putc(&buffer, key);
+    ASSERT(added);
+    sema_up(&key_added);
+    waitq_wake(&pollers);
     serial_notify();
 }
 
@@ -31,23 +55,55 @@ input_putc(uint8_t key)
 uint8_t
 input_getc(void)
 {
-    enum intr_level old_level;
     uint8_t key;
 
-    old_level = intr_disable();
-    key = intq_getc(&buffer);
-    serial_notify();
-    intr_set_level(old_level);
+    lock_acquire(&getc_lock);
+    while (!ring_getc(&buffer, &key)) {
+        sema_down(&key_added);
+    }
+
+    /* If the buffer was full, the serial port may have stopped
+     * receiving. */
+    if (ring_space(&buffer) <= 1) {
+        enum intr_level old_level = intr_disable();
+        serial_notify();
+        intr_set_level(old_level);
+    }
+    lock_release(&getc_lock);
 
     return key;
 }
 
+/* Returns true if a key is waiting in the input buffer, and if
+ * E is non-null, adds E to the threads to wake when a key is
+ * added, until input_unpoll(). */
+bool
+input_poll(struct waitq_entry *e)
+{
+    enum intr_level old_level = intr_disable();
+    bool ready = !ring_empty(&buffer);
+
+    if (e != NULL) {
+        waitq_add(&pollers, e);
+    }
+    intr_set_level(old_level);
+    return ready;
+}
+
+/* Takes E, added by input_poll(), off the threads to wake. */
+void
+input_unpoll(struct waitq_entry *e)
+{
+    enum intr_level old_level = intr_disable();
+
+    waitq_remove(e);
+    intr_set_level(old_level);
+}
+
 /* Returns true if the input buffer is full,
- * false otherwise.
- * Interrupts must be off. */
+ * false otherwise. */
 bool
 input_full(void)
 {
-    ASSERT(intr_get_level() == INTR_OFF);
-    return intq_full(&buffer);
+    return ring_full(&buffer);
 }
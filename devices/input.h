@@ -4,9 +4,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+struct waitq_entry;
+
 void input_init(void);
 void input_putc(uint8_t);
 uint8_t input_getc(void);
+bool input_poll(struct waitq_entry *);
+void input_unpoll(struct waitq_entry *);
 bool input_full(void);
 
 #endif /* devices/input.h */
@@ -1,19 +1,33 @@
 #include <debug.h>
+#include <string.h>
 
 #include "devices/intq.h"
 #include "threads/thread.h"
 
-static int next(int pos);
+static int next(const struct intq *q, int pos);
 
 static void wait(struct intq *q, struct thread **waiter);
 static void signal(struct intq *q, struct thread **waiter);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q with a buffer of INTQ_BUFSIZE
+ * bytes. */
 void
 intq_init(struct intq *q)
 {
+    intq_init_buf(q, q->small, sizeof q->small);
+}
+
+/* Initializes interrupt queue Q to use the SIZE-byte BUF as its
+ * buffer.  The queue holds at most SIZE - 1 bytes. */
+void
+intq_init_buf(struct intq *q, uint8_t *buf, size_t size)
+{
+    ASSERT(size >= 2);
+
     lock_init(&q->lock);
     q->not_full = q->not_empty = NULL;
+    q->buf = buf;
+    q->size = size;
     q->head = q->tail = 0;
 }
 
@@ -30,7 +44,7 @@ bool
 intq_full(const struct intq *q)
 {
     ASSERT(intr_get_level() == INTR_OFF);
-    return next(q->head) == q->tail;
+    return next(q, q->head) == q->tail;
 }
 
 /* Removes a byte from Q and returns it.
@@ -50,7 +64,7 @@ intq_getc(struct intq *q)
     }
 
     byte = q->buf[q->tail];
-    q->tail = next(q->tail);
+    q->tail = next(q, q->tail);
     signal(q, &q->not_full);
     return byte;
 }
@@ -70,15 +84,46 @@ intq_putc(struct intq *q, uint8_t byte)
     }
 
     q->buf[q->head] = byte;
-    q->head = next(q->head);
+    q->head = next(q, q->head);
     signal(q, &q->not_empty);
 }
 
-/* Returns the position after POS within an intq. */
+/* Adds as many of the N bytes in BUFFER to the end of Q as fit
+ * without waiting, copying them in at most two blocks, and
+ * returns the number added. */
+size_t
+intq_putbuf(struct intq *q, const uint8_t *buffer, size_t n)
+{
+    size_t added = 0;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    while (added < n && !intq_full(q)) {
+        /* Free space runs from HEAD up to the byte before TAIL,
+         * possibly wrapping around the end of the buffer. */
+        int end = q->tail > q->head ? q->tail - 1 : q->size;
+        size_t room = end - q->head;
+
+        if (q->tail == 0 && end == q->size) {
+            room--;
+        }
+        if (room > n - added) {
+            room = n - added;
+        }
+        memcpy(q->buf + q->head, buffer + added, room);
+        q->head = (q->head + room) % q->size;
+        added += room;
+    }
+    if (added > 0) {
+        signal(q, &q->not_empty);
+    }
+    return added;
+}
+
+/* Returns the position after POS within Q. */
 static int
-next(int pos)
+next(const struct intq *q, int pos)
 {
-    return (pos + 1) % INTQ_BUFSIZE;
+    return (pos + 1) % q->size;
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
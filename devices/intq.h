@@ -17,7 +17,7 @@
  * protect kernel threads from one another, not from interrupt
  * handlers. */
 
-/* Queue buffer size, in bytes. */
+/* Default queue buffer size, in bytes. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -28,15 +28,19 @@ struct intq {
     struct thread *not_empty; /* Thread waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE]; /* Buffer. */
-    int     head;              /* New data is written here. */
-    int     tail;              /* Old data is read here. */
+    uint8_t *buf;                 /* Buffer. */
+    int      size;                /* Size of BUF in bytes. */
+    int      head;                /* New data is written here. */
+    int      tail;                /* Old data is read here. */
+    uint8_t  small[INTQ_BUFSIZE]; /* Buffer used by intq_init(). */
 };
 
 void intq_init(struct intq *);
+void intq_init_buf(struct intq *, uint8_t *buf, size_t size);
 bool intq_empty(const struct intq *);
 bool intq_full(const struct intq *);
 uint8_t intq_getc(struct intq *);
 void intq_putc(struct intq *, uint8_t);
+size_t intq_putbuf(struct intq *, const uint8_t *, size_t);
 
 #endif /* devices/intq.h */
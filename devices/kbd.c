@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <debug.h>
+#include <kstat.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -41,6 +42,13 @@ kbd_print_stats(void)
     printf("Keyboard: %lld keys pressed\n", key_cnt);
 }
 
+/* Stores the number of keys pressed in *ST. */
+void
+kbd_kstat(struct kstat *st)
+{
+    st->keys = key_cnt;
+}
+
 /* Maps a set of contiguous scancodes into characters. */
 struct keymap {
     uint8_t     first_scancode; /* First scancode. */
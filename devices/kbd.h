@@ -3,7 +3,10 @@
 
 #include <stdint.h>
 
+struct kstat;
+
 void kbd_init(void);
 void kbd_print_stats(void);
+void kbd_kstat(struct kstat *);
 
 #endif /* devices/kbd.h */
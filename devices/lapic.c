@@ -0,0 +1,193 @@
+#include <debug.h>
+#include <stdint.h>
+
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* Interface to the local APICs, just enough to use the bootstrap
+ * processor's timer and to start the application processors.
+ * Refer to [IA32-v3a] chapter 10 "Advanced Programmable Interrupt
+ * Controller (APIC)".  Every processor sees its own local APIC at
+ * the same address, so the functions here act on the running
+ * processor's.
+ *
+ * Only the timer's interrupt comes from the local APIC.  Device
+ * interrupts still arrive through the 8259A PICs, which the local
+ * APIC passes through in virtual wire mode, as the BIOS left it. */
+
+/* Registers, as byte offsets from the base address. */
+#define LAPIC_ID         0x020 /* Local APIC ID, in bits 24-31. */
+#define LAPIC_EOI        0x0b0 /* End of interrupt. */
+#define LAPIC_SVR        0x0f0 /* Spurious interrupt vector. */
+#define LAPIC_ICR_LO     0x300 /* Interrupt command, low half. */
+#define LAPIC_ICR_HI     0x310 /* Interrupt command, destination. */
+#define LAPIC_LVT_TIMER  0x320 /* Timer local vector table entry. */
+#define LAPIC_TIMER_INIT 0x380 /* Timer initial count. */
+#define LAPIC_TIMER_CUR  0x390 /* Timer current count. */
+#define LAPIC_TIMER_DIV  0x3e0 /* Timer divide configuration. */
+
+#define SVR_ENABLE   0x100   /* APIC software enable. */
+#define LVT_MASKED   0x10000 /* Interrupt masked. */
+#define LVT_PERIODIC 0x20000 /* Timer reloads itself. */
+#define DIV_16       0x3     /* Timer counts at bus clock / 16. */
+
+#define ICR_INIT     0x500   /* Delivery mode INIT. */
+#define ICR_STARTUP  0x600   /* Delivery mode STARTUP. */
+#define ICR_PENDING  0x1000  /* Not yet accepted. */
+#define ICR_ASSERT   0x4000  /* Level asserted. */
+#define ICR_LEVEL    0x8000  /* Level triggered. */
+
+/* Registers, mapped uncached, or null if there is no local
+ * APIC. */
+static volatile uint32_t *regs;
+
+static uint32_t read_reg(int reg);
+static void write_reg(int reg, uint32_t value);
+static void send_ipi(uint8_t apic_id, uint32_t command);
+
+/* Maps and enables the local APIC, with its timer stopped.
+ * Returns false if the machine has none, in which case no other
+ * lapic_*() function may be called.  Once it has succeeded, later
+ * calls just return true. */
+bool
+lapic_init(void)
+{
+    if (regs != NULL) {
+        return true;
+    }
+    if (!(cpuid_features() & CPUID_APIC) || lapic_paddr == 0) {
+        return false;
+    }
+    regs = vmalloc_map_io(lapic_paddr, 1);
+    if (regs == NULL) {
+        return false;
+    }
+
+    write_reg(LAPIC_SVR, SVR_ENABLE | INTR_LAPIC_SPURIOUS);
+    write_reg(LAPIC_TIMER_DIV, DIV_16);
+    lapic_timer_stop();
+    return true;
+}
+
+/* Enables an application processor's local APIC, which
+ * lapic_init() has already mapped on the bootstrap processor. */
+void
+lapic_init_ap(void)
+{
+    write_reg(LAPIC_SVR, SVR_ENABLE | INTR_LAPIC_SPURIOUS);
+}
+
+/* Returns true if lapic_init() succeeded. */
+bool
+lapic_present(void)
+{
+    return regs != NULL;
+}
+
+/* Returns the running processor's local APIC ID. */
+uint8_t
+lapic_id(void)
+{
+    return read_reg(LAPIC_ID) >> 24;
+}
+
+/* Starts the application processor whose local APIC ID is
+ * APIC_ID running real-mode code at PADDR, which must be
+ * page-aligned and below 1 MB.  This is the INIT, STARTUP,
+ * STARTUP sequence of [MP] B.4, with its delays. */
+void
+lapic_start_ap(uint8_t apic_id, uintptr_t paddr)
+{
+    int i;
+
+    ASSERT(pg_ofs((void *) paddr) == 0 && paddr < 0x100000);
+
+    send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    timer_udelay(10000);
+    for (i = 0; i < 2; i++) {
+        send_ipi(apic_id, ICR_STARTUP | (paddr >> PGBITS));
+        timer_udelay(200);
+    }
+}
+
+/* Acknowledges the interrupt being handled. */
+void
+lapic_eoi(void)
+{
+    write_reg(LAPIC_EOI, 0);
+}
+
+/* Starts the timer raising interrupt VEC_NO every COUNT counts,
+ * where a count is 16 bus clock cycles. */
+void
+lapic_timer_periodic(uint8_t vec_no, uint32_t count)
+{
+    ASSERT(count > 0);
+
+    write_reg(LAPIC_LVT_TIMER, LVT_PERIODIC | vec_no);
+    write_reg(LAPIC_TIMER_INIT, count);
+}
+
+/* Starts the timer counting down once from COUNT, then raising
+ * interrupt VEC_NO. */
+void
+lapic_timer_oneshot(uint8_t vec_no, uint32_t count)
+{
+    ASSERT(count > 0);
+
+    write_reg(LAPIC_LVT_TIMER, vec_no);
+    write_reg(LAPIC_TIMER_INIT, count);
+}
+
+/* Starts the timer counting down once from COUNT without raising
+ * an interrupt, so that its rate can be measured. */
+void
+lapic_timer_count_down(uint32_t count)
+{
+    write_reg(LAPIC_LVT_TIMER, LVT_MASKED);
+    write_reg(LAPIC_TIMER_INIT, count);
+}
+
+/* Stops the timer. */
+void
+lapic_timer_stop(void)
+{
+    write_reg(LAPIC_LVT_TIMER, LVT_MASKED);
+    write_reg(LAPIC_TIMER_INIT, 0);
+}
+
+/* Returns the timer's current count, which is 0 once a one-shot
+ * countdown has expired. */
+uint32_t
+lapic_timer_count(void)
+{
+    return read_reg(LAPIC_TIMER_CUR);
+}
+
+static uint32_t
+read_reg(int reg)
+{
+    return regs[reg / 4];
+}
+
+static void
+write_reg(int reg, uint32_t value)
+{
+    regs[reg / 4] = value;
+}
+
+/* Sends COMMAND to the local APIC whose ID is APIC_ID and waits
+ * for it to be accepted. */
+static void
+send_ipi(uint8_t apic_id, uint32_t command)
+{
+    write_reg(LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+    write_reg(LAPIC_ICR_LO, command);
+    while (read_reg(LAPIC_ICR_LO) & ICR_PENDING) {
+        continue;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool lapic_init(void);
+void lapic_init_ap(void);
+bool lapic_present(void);
+void lapic_eoi(void);
+
+uint8_t lapic_id(void);
+void lapic_start_ap(uint8_t apic_id, uintptr_t paddr);
+
+void lapic_timer_periodic(uint8_t vec_no, uint32_t count);
+void lapic_timer_oneshot(uint8_t vec_no, uint32_t count);
+void lapic_timer_count_down(uint32_t count);
+void lapic_timer_stop(void);
+uint32_t lapic_timer_count(void);
+
+#endif /* devices/lapic.h */
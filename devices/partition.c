@@ -312,8 +312,32 @@ partition_write(void *p_, block_sector_t sector, const void *buffer)
     block_write(p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+ * BUFFER. */
+static void
+partition_read_multiple(void *p_, block_sector_t sector, block_sector_t cnt,
+                        void *buffer)
+{
+    struct partition *p = p_;
+
+    block_read_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+ * BUFFER. */
+static void
+partition_write_multiple(void *p_, block_sector_t sector, block_sector_t cnt,
+                         const void *buffer)
+{
+    struct partition *p = p_;
+
+    block_write_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
 static struct block_operations partition_operations =
 {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple
 };
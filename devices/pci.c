@@ -0,0 +1,110 @@
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Minimal access to PCI configuration space through
+ * configuration mechanism #1, just enough to find a device and
+ * read or program its registers.  See [PCI] section 3.2.2.3.2. */
+
+/* I/O ports. */
+#define PCI_CONFIG_ADDR 0xcf8 /* Selects a configuration register. */
+#define PCI_CONFIG_DATA 0xcfc /* Contains the selected register. */
+
+#define PCI_CONFIG_ENABLE 0x80000000 /* Enable bit in PCI_CONFIG_ADDR. */
+
+/* Returns the PCI_CONFIG_ADDR value selecting dword REG of
+ * function A. */
+static uint32_t
+config_addr(const struct pci_addr *a, uint8_t reg)
+{
+    return (PCI_CONFIG_ENABLE | (uint32_t)a->bus << 16 | (uint32_t)a->dev << 11
+            | (uint32_t)a->func << 8 | (reg & ~3));
+}
+
+/* Returns the 32-bit configuration register REG, which must be
+ * dword-aligned, of function A. */
+uint32_t
+pci_read_config(const struct pci_addr *a, uint8_t reg)
+{
+    enum intr_level old_level = intr_disable();
+    uint32_t value;
+
+    outl(PCI_CONFIG_ADDR, config_addr(a, reg));
+    value = inl(PCI_CONFIG_DATA);
+    intr_set_level(old_level);
+    return value;
+}
+
+/* Sets the 32-bit configuration register REG, which must be
+ * dword-aligned, of function A to VALUE. */
+void
+pci_write_config(const struct pci_addr *a, uint8_t reg, uint32_t value)
+{
+    enum intr_level old_level = intr_disable();
+
+    outl(PCI_CONFIG_ADDR, config_addr(a, reg));
+    outl(PCI_CONFIG_DATA, value);
+    intr_set_level(old_level);
+}
+
+/* Searches for the first function with the given CLASS and
+ * SUBCLASS.  If one is found, stores its location in *A and
+ * returns true; otherwise returns false.  Only bus 0 is
+ * searched, which is where the devices we care about live on a
+ * PC. */
+bool
+pci_find_class(uint8_t class, uint8_t subclass, struct pci_addr *a)
+{
+    a->bus = 0;
+    for (a->dev = 0; a->dev < 32; a->dev++) {
+        for (a->func = 0; a->func < 8; a->func++) {
+            uint32_t id = pci_read_config(a, 0);
+            uint32_t cls;
+
+            if ((id & 0xffff) == 0xffff) {
+                /* No such function.  If function 0 is missing,
+                 * the device is absent altogether. */
+                if (a->func == 0) {
+                    break;
+                }
+                continue;
+            }
+            cls = pci_read_config(a, PCI_REG_CLASS);
+            if ((cls >> 24) == class && ((cls >> 16) & 0xff) == subclass) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Finds up to MAX functions with the given VENDOR and DEVICE IDs,
+ * in bus order, and stores their locations in ADDRS.  Returns
+ * the number found.  Only bus 0 is searched, as by
+ * pci_find_class(). */
+size_t
+pci_find_devices(uint16_t vendor, uint16_t device, struct pci_addr addrs[],
+                 size_t max)
+{
+    struct pci_addr a;
+    size_t cnt = 0;
+
+    a.bus = 0;
+    for (a.dev = 0; a.dev < 32; a.dev++) {
+        for (a.func = 0; a.func < 8; a.func++) {
+            uint32_t id = pci_read_config(&a, 0);
+
+            if ((id & 0xffff) == 0xffff) {
+                if (a.func == 0) {
+                    break;
+                }
+                continue;
+            }
+            if ((id & 0xffff) == vendor && (id >> 16) == device
+                && cnt < max) {
+                addrs[cnt++] = a;
+            }
+        }
+    }
+    return cnt;
+}
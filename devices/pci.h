@@ -0,0 +1,31 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_addr {
+    uint8_t bus;  /* Bus number. */
+    uint8_t dev;  /* Device number, 0...31. */
+    uint8_t func; /* Function number, 0...7. */
+};
+
+/* Offsets of configuration space registers. */
+#define PCI_REG_COMMAND 0x04 /* Command register, 16 bits. */
+#define PCI_REG_CLASS   0x08 /* Revision, interface, subclass, class. */
+#define PCI_REG_BAR0    0x10 /* First base address register. */
+#define PCI_REG_IRQ     0x3c /* Interrupt line in the low 8 bits. */
+
+/* Command register bits. */
+#define PCI_CMD_IO         0x0001 /* Respond to I/O space accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* May act as bus master. */
+
+uint32_t pci_read_config(const struct pci_addr *, uint8_t reg);
+void pci_write_config(const struct pci_addr *, uint8_t reg, uint32_t);
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_addr *);
+size_t pci_find_devices(uint16_t vendor, uint16_t device,
+                        struct pci_addr[], size_t max);
+
+#endif /* devices/pci.h */
@@ -12,9 +12,6 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
  * three output channels are hooked up like this:
  *
@@ -79,3 +76,45 @@ pit_configure_channel(int channel, int mode, int frequency)
     outb(PIT_PORT_COUNTER(channel), count >> 8);
     intr_set_level(old_level);
 }
+
+/* Starts CHANNEL counting down once from COUNT PIT cycles, in
+ * mode 0 ("interrupt on terminal count").  The channel's output
+ * goes high when the count reaches zero, which for channel 0
+ * raises a single timer interrupt, and stays high until the
+ * channel is reprogrammed.  COUNT must be nonzero. */
+void
+pit_start_countdown(int channel, uint16_t count)
+{
+    enum intr_level old_level;
+
+    ASSERT(channel == 0 || channel == 2);
+    ASSERT(count > 0);
+
+    old_level = intr_disable();
+    outb(PIT_PORT_CONTROL, (channel << 6) | 0x30);
+    outb(PIT_PORT_COUNTER(channel), count);
+    outb(PIT_PORT_COUNTER(channel), count >> 8);
+    intr_set_level(old_level);
+}
+
+/* Latches CHANNEL's status and current count with the 8254
+ * read-back command, stores the count into *COUNT, and returns
+ * the state of the channel's output pin.  In mode 0, a true
+ * return value means the countdown has expired. */
+bool
+pit_read_channel(int channel, uint16_t *count)
+{
+    enum intr_level old_level;
+    uint8_t status;
+
+    ASSERT(channel == 0 || channel == 2);
+
+    old_level = intr_disable();
+    outb(PIT_PORT_CONTROL, 0xc0 | (1 << (channel + 1)));
+    status = inb(PIT_PORT_COUNTER(channel));
+    *count = inb(PIT_PORT_COUNTER(channel));
+    *count |= inb(PIT_PORT_COUNTER(channel)) << 8;
+    intr_set_level(old_level);
+
+    return (status & 0x80) != 0;
+}
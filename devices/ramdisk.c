@@ -0,0 +1,107 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in memory.
+ *
+ * The disk is made of whole pages, allocated up front so that
+ * running out of memory shows up at boot rather than in the
+ * middle of a write.  Pages come from the user pool when it has
+ * room, since the kernel pool is the scarcer of the two, and
+ * otherwise from the kernel pool.  Its contents start out zeroed
+ * and are lost at shutdown.
+ *
+ * It registers as a raw device named "ram0", so it takes on a
+ * role only when asked, e.g. "-filesys=ram0 -f" or
+ * "-scratch=ram0". */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk {
+    uint8_t **pages;    /* Backing pages. */
+    size_t    page_cnt; /* Number of pages. */
+};
+
+static struct ramdisk ramdisk;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of KB kilobytes, rounded up to whole pages,
+ * and registers it with the block layer.  If memory runs out,
+ * the disk is made as large as the pages obtained so far. */
+void
+ramdisk_init(size_t kb)
+{
+    struct ramdisk *r = &ramdisk;
+    size_t page_cnt = DIV_ROUND_UP(kb * 1024, PGSIZE);
+    char extra_info[64];
+
+    ASSERT(r->pages == NULL);
+
+    r->pages = malloc(page_cnt * sizeof *r->pages);
+    if (r->pages == NULL) {
+        printf("ram0: out of memory\n");
+        return;
+    }
+    for (r->page_cnt = 0; r->page_cnt < page_cnt; r->page_cnt++) {
+        uint8_t *page = palloc_get_page(PAL_USER | PAL_ZERO);
+
+        if (page == NULL) {
+            page = palloc_get_page(PAL_ZERO);
+        }
+        if (page == NULL) {
+            printf("ram0: out of memory after %zu of %zu pages\n",
+                   r->page_cnt, page_cnt);
+            break;
+        }
+        r->pages[r->page_cnt] = page;
+    }
+    if (r->page_cnt == 0) {
+        return;
+    }
+
+    snprintf(extra_info, sizeof extra_info, "%zu pages of RAM", r->page_cnt);
+    block_register("ram0", BLOCK_RAW, extra_info,
+                   r->page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, r);
+}
+
+/* Returns the address of sector SEC_NO in RAM disk R. */
+static uint8_t *
+sector_addr(struct ramdisk *r, block_sector_t sec_no)
+{
+    ASSERT(sec_no / SECTORS_PER_PAGE < r->page_cnt);
+    return (r->pages[sec_no / SECTORS_PER_PAGE]
+            + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SEC_NO from RAM disk R into BUFFER. */
+static void
+ramdisk_read(void *r, block_sector_t sec_no, void *buffer)
+{
+    memcpy(buffer, sector_addr(r, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SEC_NO of RAM disk R from BUFFER. */
+static void
+ramdisk_write(void *r, block_sector_t sec_no, const void *buffer)
+{
+    memcpy(sector_addr(r, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Sectors are only ever copied one at a time, so the block layer
+ * can loop over them itself. */
+static struct block_operations ramdisk_operations =
+{
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL
+};
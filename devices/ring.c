@@ -0,0 +1,145 @@
+#include <debug.h>
+#include <string.h>
+
+#include "devices/ring.h"
+#include "threads/synch.h"
+
+/* The indexes run freely, wrapping around modulo SIZE_MAX + 1,
+ * which is a multiple of any power-of-2 buffer size, so
+ * HEAD - TAIL is always the number of bytes in the ring and an
+ * index masked with MASK is its position in the buffer.  Unlike
+ * a ring that keeps one slot empty to tell full from empty, all
+ * of the buffer is usable.
+ *
+ * Each side copies the data before it moves its own index, with
+ * a compiler barrier in between, so the other side never sees an
+ * index that covers bytes not yet written or still being read.
+ * The kernel runs on a single CPU, so that is all the ordering
+ * needed. */
+
+static void copy_in(struct ring *, size_t pos, const uint8_t *, size_t);
+static void copy_out(const struct ring *, size_t pos, uint8_t *, size_t);
+
+/* Initializes RING to use the SIZE-byte BUF, where SIZE is a
+ * power of 2. */
+void
+ring_init(struct ring *ring, uint8_t *buf, size_t size)
+{
+    ASSERT(size > 0 && (size & (size - 1)) == 0);
+
+    ring->buf = buf;
+    ring->mask = size - 1;
+    ring->head = ring->tail = 0;
+}
+
+/* Returns the number of bytes in RING.  The answer is only a
+ * lower bound for the consumer and an upper bound for the
+ * producer while the other side is active. */
+size_t
+ring_count(const struct ring *ring)
+{
+    return ring->head - ring->tail;
+}
+
+/* Returns the number of bytes that can be added to RING. */
+size_t
+ring_space(const struct ring *ring)
+{
+    return ring->mask + 1 - ring_count(ring);
+}
+
+/* Returns true if RING is empty, false otherwise. */
+bool
+ring_empty(const struct ring *ring)
+{
+    return ring_count(ring) == 0;
+}
+
+/* Returns true if RING is full, false otherwise. */
+bool
+ring_full(const struct ring *ring)
+{
+    return ring_space(ring) == 0;
+}
+
+/* Adds as many of the N bytes in BUFFER to RING as fit, and
+ * returns the number added.  Only the producer may call this. */
+size_t
+ring_put(struct ring *ring, const void *buffer, size_t n)
+{
+    size_t head = ring->head;
+    size_t space = ring->mask + 1 - (head - ring->tail);
+
+    if (n > space) {
+        n = space;
+    }
+    copy_in(ring, head, buffer, n);
+    barrier();
+    ring->head = head + n;
+    return n;
+}
+
+/* Removes up to N bytes from RING into BUFFER, and returns the
+ * number removed.  Only the consumer may call this. */
+size_t
+ring_get(struct ring *ring, void *buffer, size_t n)
+{
+    size_t tail = ring->tail;
+    size_t count = ring->head - tail;
+
+    if (n > count) {
+        n = count;
+    }
+    barrier();
+    copy_out(ring, tail, buffer, n);
+    barrier();
+    ring->tail = tail + n;
+    return n;
+}
+
+/* Adds BYTE to RING.  Returns true if successful, false if RING
+ * is full.  Only the producer may call this. */
+bool
+ring_putc(struct ring *ring, uint8_t byte)
+{
+    return ring_put(ring, &byte, 1) == 1;
+}
+
+/* Removes a byte from RING into *BYTE.  Returns true if
+ * successful, false if RING is empty.  Only the consumer may
+ * call this. */
+bool
+ring_getc(struct ring *ring, uint8_t *byte)
+{
+    return ring_get(ring, byte, 1) == 1;
+}
+
+/* Copies the N bytes in BUFFER into RING's buffer, starting at
+ * index POS, in at most two pieces. */
+static void
+copy_in(struct ring *ring, size_t pos, const uint8_t *buffer, size_t n)
+{
+    size_t ofs = pos & ring->mask;
+    size_t first = ring->mask + 1 - ofs;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(ring->buf + ofs, buffer, first);
+    memcpy(ring->buf, buffer + first, n - first);
+}
+
+/* Copies N bytes from RING's buffer, starting at index POS, into
+ * BUFFER, in at most two pieces. */
+static void
+copy_out(const struct ring *ring, size_t pos, uint8_t *buffer, size_t n)
+{
+    size_t ofs = pos & ring->mask;
+    size_t first = ring->mask + 1 - ofs;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(buffer, ring->buf + ofs, first);
+    memcpy(buffer + first, ring->buf, n - first);
+}
@@ -0,0 +1,36 @@
+#ifndef DEVICES_RING_H
+#define DEVICES_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A single-producer, single-consumer ring buffer of bytes.
+ *
+ * One side, say an external interrupt handler, only ever adds
+ * bytes, and the other, say a kernel thread, only ever removes
+ * them.  Then neither side needs to disable interrupts or take a
+ * lock: each owns one of the two indexes and only reads the
+ * other.  If several threads may be on the same side, they must
+ * take turns among themselves, with a lock for instance.
+ *
+ * The ring never blocks.  A consumer that wants to wait for data
+ * can use a semaphore that the producer ups after adding. */
+struct ring {
+    uint8_t *buf;             /* Buffer. */
+    size_t mask;              /* Size of BUF minus 1. */
+    volatile size_t head;     /* Bytes ever added; producer's. */
+    volatile size_t tail;     /* Bytes ever removed; consumer's. */
+};
+
+void ring_init(struct ring *, uint8_t *buf, size_t size);
+size_t ring_count(const struct ring *);
+size_t ring_space(const struct ring *);
+bool ring_empty(const struct ring *);
+bool ring_full(const struct ring *);
+size_t ring_put(struct ring *, const void *, size_t);
+size_t ring_get(struct ring *, void *, size_t);
+bool ring_putc(struct ring *, uint8_t);
+bool ring_getc(struct ring *, uint8_t *);
+
+#endif /* devices/ring.h */
@@ -38,6 +38,22 @@
 #define IER_RECV 0x01 /* Interrupt when data received. */
 #define IER_XMIT 0x02 /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE   0x01 /* Enable the receive and transmit FIFOs. */
+#define FCR_CLEAR_RX 0x02 /* Discard the contents of the receive FIFO. */
+#define FCR_CLEAR_TX 0x04 /* Discard the contents of the transmit FIFO. */
+
+/* Bytes the 16550A transmit FIFO holds. */
+#define TX_FIFO_DEPTH 16
+
+/* Size of the transmit queue, in bytes.  Output beyond what the
+ * queue holds makes the writer wait for the UART, so a larger
+ * queue lets bursts of console output go out in the
+ * background. */
+#ifndef SERIAL_TXQ_SIZE
+#define SERIAL_TXQ_SIZE 4096
+#endif
+
 /* Line Control Register bits. */
 #define LCR_N81  0x03 /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80 /* Divisor Latch Access Bit (DLAB). */
@@ -54,6 +70,7 @@ static enum { UNINIT, POLL, QUEUE } mode;
 
 /* Data to be transmitted. */
 static struct intq txq;
+static uint8_t txq_buf[SERIAL_TXQ_SIZE];
 
 static void set_serial(int bps);
 
@@ -73,15 +90,17 @@ init_poll(void)
     ASSERT(mode == UNINIT);
     outb(IER_REG, 0);        /* Turn off all interrupts. */
     outb(FCR_REG, 0);        /* Disable FIFO. */
-    set_serial(9600);        /* 9.6 kbps, N-8-1. */
+    set_serial(115200);      /* 115.2 kbps, N-8-1. */
     outb(MCR_REG, MCR_OUT2); /* Required to enable interrupts. */
-    intq_init(&txq);
+    intq_init_buf(&txq, txq_buf, sizeof txq_buf);
     mode = POLL;
 }
 
 /* Initializes the serial port device for queued interrupt-driven
  * I/O.  With interrupt-driven I/O we don't waste CPU time
- * waiting for the serial device to become ready. */
+ * waiting for the serial device to become ready.  The FIFOs are
+ * turned on so that each transmit interrupt can hand the UART up
+ * to TX_FIFO_DEPTH bytes instead of one. */
 void
 serial_init_queue(void)
 {
@@ -93,6 +112,7 @@ serial_init_queue(void)
     ASSERT(mode == POLL);
 
     intr_register_ext(0x20 + 4, serial_interrupt, "serial");
+    outb(FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
     mode = QUEUE;
     old_level = intr_disable();
     write_ier();
@@ -131,6 +151,47 @@ serial_putc(uint8_t byte)
     intr_set_level(old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port.  In queued
+ * mode, bytes are copied into the transmit queue in blocks, as
+ * many as fit at a time, rather than queued one by one. */
+void
+serial_putbuf(const uint8_t *buffer, size_t n)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (mode != QUEUE) {
+        if (mode == UNINIT) {
+            init_poll();
+        }
+        while (n-- > 0) {
+            putc_poll(*buffer++);
+        }
+    } else {
+        while (n > 0) {
+            size_t cnt = intq_putbuf(&txq, buffer, n);
+
+            buffer += cnt;
+            n -= cnt;
+            write_ier();
+            if (n > 0) {
+                /* The queue is full.  Make room the same way
+                 * serial_putc() does: by polling one byte out if
+                 * interrupts were off, otherwise by sleeping until
+                 * the interrupt handler drains some. */
+                if (old_level == INTR_OFF) {
+                    putc_poll(intq_getc(&txq));
+                } else {
+                    intq_putc(&txq, *buffer++);
+                    n--;
+                    write_ier();
+                }
+            }
+        }
+    }
+
+    intr_set_level(old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
  * mode. */
 void
@@ -144,6 +205,31 @@ serial_flush(void)
     intr_set_level(old_level);
 }
 
+/* Changes the serial port's speed to BPS bits per second, after
+ * sending everything already written at the old speed.  Returns
+ * false if the UART cannot run at BPS. */
+bool
+serial_set_speed(int bps)
+{
+    enum intr_level old_level;
+
+    if (bps < 300 || bps > 115200 || 115200 % bps != 0) {
+        return false;
+    }
+
+    serial_flush();
+    old_level = intr_disable();
+    if (mode == UNINIT) {
+        init_poll();
+    }
+    while ((inb(LSR_REG) & LSR_THRE) == 0) {
+        continue;
+    }
+    set_serial(bps);
+    intr_set_level(old_level);
+    return true;
+}
+
 /* The fullness of the input buffer may have changed.  Reassess
  * whether we should block receive interrupts.
  * Called by the input buffer routines when characters are added
@@ -227,10 +313,15 @@ serial_interrupt(struct intr_frame *f UNUSED)
         input_putc(inb(RBR_REG));
     }
 
-    /* As long as we have a byte to transmit, and the hardware is
-     * ready to accept a byte for transmission, transmit a byte. */
-    while (!intq_empty(&txq) && (inb(LSR_REG) & LSR_THRE) != 0) {
-        outb(THR_REG, intq_getc(&txq));
+    /* With the FIFOs on, THRE means the whole transmit FIFO is
+     * empty, so once it is set we can refill the FIFO without
+     * checking again between bytes. */
+    if ((inb(LSR_REG) & LSR_THRE) != 0) {
+        int i;
+
+        for (i = 0; i < TX_FIFO_DEPTH && !intq_empty(&txq); i++) {
+            outb(THR_REG, intq_getc(&txq));
+        }
     }
 
     /* Update interrupt enable register based on queue status. */
@@ -1,18 +1,39 @@
 #include <console.h>
+#include <log.h>
 #include <stdio.h>
 
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
+#include "userprog/elfcache.h"
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/fault.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 #endif
 
 /* Keyboard control register port. */
@@ -92,6 +113,9 @@ shutdown_power_off(void)
 #ifdef FILESYS
     filesys_done();
 #endif
+    log_flush();
+    trace_dump();
+    profile_dump();
 
     print_stats();
 
@@ -128,13 +152,34 @@ static void
 print_stats(void)
 {
     timer_print_stats();
+    intr_print_stats();
     thread_print_stats();
+    lock_print_stats();
+    rcu_print_stats();
+    palloc_print_stats();
+    malloc_print_stats();
+    kmem_print_stats();
 #ifdef FILESYS
     block_print_stats();
+    cache_print_stats();
+    dcache_print_stats();
+    journal_print_stats();
 #endif
     console_print_stats();
+    log_print_stats();
+    trace_print_stats();
+    profile_print_stats();
     kbd_print_stats();
 #ifdef USERPROG
     exception_print_stats();
+    process_print_stats();
+    pagedir_print_stats();
+    elfcache_print_stats();
+#endif
+#ifdef VM
+    fault_print_stats();
+    frame_print_stats();
+    page_print_stats();
+    swap_print_stats();
 #endif
 }
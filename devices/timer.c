@@ -3,47 +3,197 @@
 #include <round.h>
 #include <stdio.h>
 
+#include "devices/lapic.h"
 #include "devices/pit.h"
 #include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-
-/* See [8254] for hardware details of the 8254 timer chip. */
-
-#if TIMER_FREQ < 19
-#error 8254 timer requires TIMER_FREQ >= 19
-#endif
-#if TIMER_FREQ > 1000
-#error TIMER_FREQ <= 1000 recommended
+#ifdef USERPROG
+#include "userprog/vdso.h"
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* See [8254] for hardware details of the 8254 timer chip.
+ *
+ * The 8254 is the tick source until timer_calibrate().  After
+ * that, with the "-lapic" option, the local APIC timer takes over
+ * if there is one: it is calibrated against the 8254 and the 8254
+ * is masked.  The local APIC timer is programmed through memory
+ * rather than slow port I/O, is acknowledged on the local APIC
+ * rather than the PIC, and counts down from 32 bits, so a tickless
+ * idle period can last far longer. */
+
+/* Number of timer interrupts per second. */
+int timer_freq = TIMER_FREQ_DEFAULT;
+
+/* Number of timer ticks since OS booted.  Written only by the
+ * timer interrupt, with interrupts off, under TICKS_SEQ, so that
+ * timer_ticks() can read it without turning interrupts off. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
 /* Number of loops per timer tick.
  * Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time-stamp counter cycles per timer tick, and nanoseconds per
+ * cycle in fixed point with NS_SHIFT fraction bits, so that
+ * converting cycles to nanoseconds takes two multiplications
+ * instead of a 64-bit division.  Both are 0 until
+ * timer_calibrate() measures them against the PIT. */
+#define NS_SHIFT 24
+static uint64_t cycles_per_tick;
+static uint32_t ns_mult;
+
+/* Time-stamp counter at timer_init(). */
+static uint64_t boot_cycles;
+
+/* Timer ticks over which to measure the time-stamp counter. */
+#define TSC_CALIBRATE_TICKS 4
+
+/* If true, stop the periodic tick while the CPU is idle.
+ * Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* If true, tick with the local APIC timer if there is one.
+ * Controlled by kernel command-line option "-lapic". */
+bool timer_lapic;
+
+/* Loops and time-stamp counter cycles per millisecond given by
+ * kernel command-line option "-calibration", which timer_calibrate()
+ * then uses instead of measuring them, or 0. */
+static unsigned preset_loops_per_ms;
+static unsigned preset_cycles_per_ms;
+
+/* Local APIC timer counts in one timer tick, or 0 if the 8254 is
+ * the tick source. */
+static uint32_t lapic_counts_per_tick;
+
+/* PIT cycles in one timer tick. */
+#define PIT_CYCLES_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest tickless interval, in ticks, that fits in the PIT's
+ * 16-bit counter: about 54 ms, or 5 ticks at 100 Hz.  The local
+ * APIC timer's 32-bit counter allows much longer ones. */
+#define TICKLESS_MAX_TICKS (UINT16_MAX / PIT_CYCLES_PER_TICK)
+#define LAPIC_TICKLESS_MAX_TICKS ((int64_t) (UINT32_MAX / lapic_counts_per_tick))
+
+/* Number of ticks covered by the one-shot countdown that
+ * replaced the periodic tick, or 0 if the periodic tick is
+ * running. */
+static int64_t tickless_ticks;
+
+/* Threads blocked in timer_sleep(), ordered by `wakeup_tick', so
+ * that going to sleep and waking take O(log n) time in the number
+ * of sleepers.  Threads with equal deadlines wake in the order in
+ * which they went to sleep.  Accessed only with interrupts off. */
+static struct heap sleep_queue;
+
+/* Wakeup tick of the first thread in sleep_queue, or INT64_MAX if
+ * it is empty.  Lets timer_interrupt() skip the queue entirely on
+ * ticks where nobody is due. */
+static int64_t next_wakeup;
+
+/* Timeouts added by timer_add(), in a hierarchical timer wheel.
+ *
+ * Level 0 has a slot for each of the next WHEEL_SLOTS ticks.
+ * Each slot of level 1 covers WHEEL_SLOTS ticks, each slot of
+ * level 2 WHEEL_SLOTS times that, and so on.  A timeout goes into
+ * the finest level whose range reaches its expiry, in the slot
+ * that its expiry indexes, so adding and cancelling one is a list
+ * insertion or removal.  Whenever level 0 wraps around, the next
+ * slot of level 1 is emptied and its timeouts are redistributed
+ * into level 0, and likewise up the levels.  On each tick, the
+ * timer interrupt therefore looks at a single slot of level 0,
+ * which holds exactly the timeouts due then, however many are
+ * pending; each timeout is moved at most once per level.
+ * Timeouts beyond the top level's range wait in its farthest
+ * slot and are redistributed until they come within range.
+ *
+ * Due timeouts move to expired_list, and run_expired() calls
+ * them as deferred interrupt work.  Accessed only with
+ * interrupts off. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static size_t wheel_cnt;      /* Timeouts in the wheel. */
+static int64_t wheel_ticks;   /* Next tick to process. */
+static struct list expired_list;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops(unsigned loops);
 
+static heap_less_func wakeup_less;
+static int64_t first_wakeup(void);
+
+static intr_work_func wake_sleepers;
+static struct intr_work wake_work;
+
+static void add_ticks(int64_t);
+static void advance_idle_ticks(int64_t);
+
+static void wheel_insert(struct timeout *);
+static void wheel_advance(void);
+static int64_t wheel_next_expiry(void);
+static intr_work_func run_expired;
+static struct intr_work expire_work;
+
 static void busy_wait(int64_t loops);
 
 static void real_time_sleep(int64_t num, int32_t denom);
 
 static void real_time_delay(int64_t num, int32_t denom);
 
+static void calibrate_cycles(void);
+static void set_ns_mult(void);
+static void calibrate_lapic(void);
+static void start_periodic_tick(void);
+
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
  * and registers the corresponding interrupt. */
 void
 timer_init(void)
 {
+    int level, slot;
+
+    ASSERT(TIMER_FREQ_MIN <= TIMER_FREQ && TIMER_FREQ <= TIMER_FREQ_MAX);
+
+    heap_init(&sleep_queue, wakeup_less, NULL);
+    next_wakeup = INT64_MAX;
+    intr_work_init(&wake_work, wake_sleepers, NULL);
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            list_init(&wheel[level][slot]);
+        }
+    }
+    list_init(&expired_list);
+    intr_work_init(&expire_work, run_expired, NULL);
+    boot_cycles = timer_cycles();
+
     pit_configure_channel(0, 2, TIMER_FREQ);
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Makes timer_calibrate() take LOOPS_PER_MS busy-wait loops and
+ * CYCLES_PER_MS time-stamp counter cycles per millisecond, as it
+ * printed on an earlier boot, instead of spending several ticks
+ * measuring them.  Returns false if either is 0. */
+bool
+timer_set_calibration(unsigned loops_per_ms, unsigned cycles_per_ms)
+{
+    if (loops_per_ms == 0 || cycles_per_ms == 0) {
+        return false;
+    }
+    preset_loops_per_ms = loops_per_ms;
+    preset_cycles_per_ms = cycles_per_ms;
+    return true;
+}
+
+/* Calibrates loops_per_tick, used to implement brief delays, and
+ * the rate of the time-stamp counter, used by timer_ns(). */
 void
 timer_calibrate(void)
 {
@@ -52,6 +202,14 @@ timer_calibrate(void)
     ASSERT(intr_get_level() == INTR_ON);
     printf("Calibrating timer...  ");
 
+    if (preset_loops_per_ms != 0) {
+        loops_per_tick = (uint64_t) preset_loops_per_ms * 1000 / TIMER_FREQ;
+        cycles_per_tick = (uint64_t) preset_cycles_per_ms * 1000
+                          / TIMER_FREQ;
+        set_ns_mult();
+        goto done;
+    }
+
     /* Approximate loops_per_tick as the largest power-of-two
      * still less than one timer tick. */
     loops_per_tick = 1u << 10;
@@ -68,17 +226,67 @@ timer_calibrate(void)
         }
     }
 
-    printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+    calibrate_cycles();
+
+done:
+    printf("%'" PRIu64 " loops/s, %'" PRIu64 " cycles/s "
+           "(-calibration=%" PRIu64 ",%" PRIu64 ").\n",
+           (uint64_t)loops_per_tick * TIMER_FREQ, timer_cycles_per_sec(),
+           (uint64_t)loops_per_tick * TIMER_FREQ / 1000,
+           timer_cycles_per_sec() / 1000);
+
+    if (timer_lapic) {
+        calibrate_lapic();
+    }
+}
+
+/* Returns the number of nanoseconds in CYCLES time-stamp counter
+ * cycles, or 0 before timer_calibrate(). */
+uint64_t
+timer_cycles_to_ns(uint64_t cycles)
+{
+    uint32_t hi = cycles >> 32;
+    uint32_t lo = cycles;
+
+    return ((uint64_t) hi * ns_mult << (32 - NS_SHIFT))
+           + ((uint64_t) lo * ns_mult >> NS_SHIFT);
+}
+
+/* Returns the number of nanoseconds since timer_init(), with the
+ * resolution of the time-stamp counter rather than the tick.
+ * Returns 0 before timer_calibrate(). */
+uint64_t
+timer_ns(void)
+{
+    return timer_cycles_to_ns(timer_cycles() - boot_cycles);
+}
+
+/* Returns the time-stamp counter's reading at timer_init(). */
+uint64_t
+timer_boot_cycles(void)
+{
+    return boot_cycles;
+}
+
+/* Returns the rate of the time-stamp counter, in cycles per
+ * second, or 0 before timer_calibrate(). */
+uint64_t
+timer_cycles_per_sec(void)
+{
+    return cycles_per_tick * TIMER_FREQ;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks(void)
 {
-    enum intr_level old_level = intr_disable();
-    int64_t t = ticks;
+    unsigned seq;
+    int64_t t;
 
-    intr_set_level(old_level);
+    do {
+        seq = seq_read_begin(&ticks_seq);
+        t = ticks;
+    } while (seq_read_retry(&ticks_seq, seq));
     return t;
 }
 
@@ -91,16 +299,107 @@ timer_elapsed(int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
- * be turned on. */
+ * be turned on.
+ *
+ * The calling thread is blocked on sleep_queue rather than
+ * yielding in a loop, so it consumes no CPU time and stays off
+ * the run queue until wake_sleepers() wakes it. */
 void
 timer_sleep(int64_t ticks)
 {
-    int64_t start = timer_ticks();
+    struct thread *cur;
+    enum intr_level old_level;
 
     ASSERT(intr_get_level() == INTR_ON);
-    while (timer_elapsed(start) < ticks) {
-        thread_yield();
+    if (ticks <= 0) {
+        return;
     }
+
+    old_level = intr_disable();
+    cur = thread_current();
+    cur->wakeup_tick = timer_ticks() + ticks;
+    heap_insert(&sleep_queue, &cur->sleep_elem);
+    if (cur->wakeup_tick < next_wakeup) {
+        next_wakeup = cur->wakeup_tick;
+    }
+    thread_block();
+    intr_set_level(old_level);
+}
+
+/* Wakes thread T early if it is sleeping in timer_sleep(), and
+ * does nothing otherwise.  May be called from an interrupt
+ * handler. */
+void
+timer_wake(struct thread *t)
+{
+    enum intr_level old_level;
+
+    ASSERT(t != NULL);
+
+    old_level = intr_disable();
+    if (t->status == THREAD_BLOCKED && t->wakeup_tick != 0) {
+        heap_remove(&sleep_queue, &t->sleep_elem);
+        t->wakeup_tick = 0;
+        next_wakeup = first_wakeup();
+        thread_unblock(t);
+    }
+    intr_set_level(old_level);
+}
+
+/* Initializes T to call FUNC with AUX when it expires. */
+void
+timeout_init(struct timeout *t, timer_func *func, void *aux)
+{
+    ASSERT(t != NULL);
+    ASSERT(func != NULL);
+
+    t->func = func;
+    t->aux = aux;
+    t->pending = false;
+}
+
+/* Arranges for T's function to be called TICKS timer ticks from
+ * now, or on the next tick if TICKS is less than 1.  If T is
+ * already pending, it is moved to the new time.  The function
+ * runs as deferred interrupt work: with interrupts on, but it
+ * may not sleep.  May be called from an interrupt handler. */
+void
+timer_add(struct timeout *t, int64_t ticks)
+{
+    enum intr_level old_level;
+
+    ASSERT(t != NULL);
+
+    old_level = intr_disable();
+    timer_cancel(t);
+    t->expires = timer_ticks() + (ticks > 0 ? ticks : 1);
+    t->pending = true;
+    wheel_insert(t);
+    intr_set_level(old_level);
+}
+
+/* Cancels T if it is pending.  Returns true if it was pending,
+ * false if it had already run, or was never added. */
+bool
+timer_cancel(struct timeout *t)
+{
+    enum intr_level old_level;
+    bool was_pending;
+
+    ASSERT(t != NULL);
+
+    old_level = intr_disable();
+    was_pending = t->pending;
+    if (was_pending) {
+        list_remove(&t->elem);
+        if (t->expires >= wheel_ticks) {
+            /* Still in the wheel, not in expired_list. */
+            wheel_cnt--;
+        }
+        t->pending = false;
+    }
+    intr_set_level(old_level);
+    return was_pending;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -173,14 +472,305 @@ timer_print_stats(void)
     printf("Timer: %" PRId64 " ticks\n", timer_ticks());
 }
 
+/* Called by the idle thread, with interrupts off and nothing
+ * ready to run, just before it halts.  If tickless idle is
+ * enabled and no timer work is due within the next tick,
+ * replaces the periodic tick by a single countdown that expires
+ * at the next deadline, so that the halted CPU is not woken
+ * TIMER_FREQ times a second for nothing.  Returns true if the
+ * periodic tick was stopped.
+ *
+ * The deadline is the earliest sleeper's wakeup tick or timeout
+ * in the timer wheel, capped by
+ * what the tick source can count and, under the MLFQS, by the next
+ * once-per-second update, so that every tick with work to do
+ * still arrives as a real interrupt. */
+bool
+timer_idle_enter(void)
+{
+    int64_t deadline, max_ticks;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!timer_tickless || tickless_ticks != 0) {
+        return false;
+    }
+
+    deadline = next_wakeup;
+    if (deadline > wheel_next_expiry()) {
+        deadline = wheel_next_expiry();
+    }
+    max_ticks = (lapic_counts_per_tick != 0
+                 ? LAPIC_TICKLESS_MAX_TICKS : TICKLESS_MAX_TICKS);
+    if (deadline > ticks + max_ticks) {
+        deadline = ticks + max_ticks;
+    }
+    if (thread_mlfqs && deadline > ROUND_UP(ticks + 1, TIMER_FREQ)) {
+        deadline = ROUND_UP(ticks + 1, TIMER_FREQ);
+    }
+    if (deadline - ticks <= 1) {
+        return false;
+    }
+
+    tickless_ticks = deadline - ticks;
+    if (lapic_counts_per_tick != 0) {
+        lapic_timer_oneshot(INTR_LAPIC_TIMER,
+                            tickless_ticks * lapic_counts_per_tick);
+    } else {
+        pit_start_countdown(0, tickless_ticks * PIT_CYCLES_PER_TICK);
+    }
+    return true;
+}
+
+/* Called at the start of every external interrupt other than
+ * the timer's own.  If that interrupt ended a tickless idle
+ * period early, credits the whole ticks that have elapsed and
+ * restarts the periodic tick.  The partial tick in progress is
+ * dropped, so time may lag by up to one tick per early wakeup.
+ *
+ * If the countdown has already expired, its interrupt is
+ * pending and timer_interrupt() will do the accounting. */
+void
+timer_idle_exit(void)
+{
+    int64_t elapsed;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (tickless_ticks == 0) {
+        return;
+    }
+    if (lapic_counts_per_tick != 0) {
+        uint32_t count = lapic_timer_count();
+
+        if (count == 0) {
+            return;
+        }
+        elapsed = (tickless_ticks * lapic_counts_per_tick - count)
+                  / lapic_counts_per_tick;
+    } else {
+        uint16_t count;
+
+        if (pit_read_channel(0, &count)) {
+            return;
+        }
+        elapsed = (tickless_ticks * PIT_CYCLES_PER_TICK - count)
+                  / PIT_CYCLES_PER_TICK;
+    }
+
+    tickless_ticks = 0;
+    start_periodic_tick();
+    advance_idle_ticks(elapsed);
+}
+
+/* Credits N ticks that passed while the idle thread was halted
+ * without a periodic tick.  N must not reach the next deadline:
+ * those ticks had no timer work to do by construction. */
+static void
+advance_idle_ticks(int64_t n)
+{
+    add_ticks(n);
+    thread_account_idle(n);
+}
+
+/* Adds N to the tick count, and publishes the new count to user
+ * programs. */
+static void
+add_ticks(int64_t n)
+{
+    seq_write_begin(&ticks_seq);
+    ticks += n;
+    seq_write_end(&ticks_seq);
+#ifdef USERPROG
+    vdso_set_ticks(ticks);
+#endif
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt(struct intr_frame *args UNUSED)
+timer_interrupt(struct intr_frame *args)
 {
-    ticks++;
+    /* The end of a tickless countdown stands for all of the ticks
+     * it covered.  Credit all but the last, which is processed
+     * below like any other tick. */
+    if (tickless_ticks != 0) {
+        int64_t skipped = tickless_ticks - 1;
+
+        tickless_ticks = 0;
+        start_periodic_tick();
+        advance_idle_ticks(skipped);
+    }
+
+    add_ticks(1);
+    profile_sample(args);
+    if (ticks >= next_wakeup) {
+        intr_defer(&wake_work);
+    }
+    wheel_advance();
     thread_tick();
 }
 
+/* Unblocks every thread on sleep_queue whose wakeup tick has
+ * arrived and updates next_wakeup.  Deferred by the timer
+ * interrupt, so interrupts are on except while each sleeper is
+ * taken off the queue. */
+static void
+wake_sleepers(void *aux UNUSED)
+{
+    for (;;) {
+        enum intr_level old_level = intr_disable();
+        struct thread *t;
+
+        next_wakeup = first_wakeup();
+        if (next_wakeup > ticks) {
+            intr_set_level(old_level);
+            return;
+        }
+        t = heap_entry(heap_pop_min(&sleep_queue), struct thread,
+                       sleep_elem);
+        t->wakeup_tick = 0;
+        thread_unblock(t);
+        intr_set_level(old_level);
+    }
+}
+
+/* Adds T, which must not be in the wheel or expired_list, to the
+ * wheel slot that covers its expiry. */
+static void
+wheel_insert(struct timeout *t)
+{
+    int64_t expires = t->expires;
+    int64_t delta;
+    int level;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (expires < wheel_ticks) {
+        expires = wheel_ticks;
+    }
+    delta = expires - wheel_ticks;
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1))) {
+            break;
+        }
+    }
+    if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) {
+        /* Too far out: wait in the top level's farthest slot. */
+        expires = wheel_ticks + ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+    list_push_back(&wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK],
+                   &t->elem);
+    wheel_cnt++;
+}
+
+/* Processes the ticks up to and including the current one:
+ * redistributes the timeouts of higher levels as level 0 wraps
+ * around, and moves the timeouts that are due to expired_list,
+ * deferring run_expired() to call them. */
+static void
+wheel_advance(void)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (; wheel_ticks <= ticks; wheel_ticks++) {
+        int slot = wheel_ticks & WHEEL_MASK;
+        int level;
+
+        if (wheel_cnt == 0) {
+            continue;
+        }
+
+        /* Cascade: on wrapping around, each level refills the one
+         * below it from its next slot. */
+        for (level = 1; slot == 0 && level < WHEEL_LEVELS; level++) {
+            struct list *list;
+
+            slot = (wheel_ticks >> (WHEEL_BITS * level)) & WHEEL_MASK;
+            list = &wheel[level][slot];
+            while (!list_empty(list)) {
+                struct timeout *t = list_entry(list_pop_front(list),
+                                               struct timeout, elem);
+                wheel_cnt--;
+                wheel_insert(t);
+            }
+        }
+
+        slot = wheel_ticks & WHEEL_MASK;
+        while (!list_empty(&wheel[0][slot])) {
+            list_push_back(&expired_list, list_pop_front(&wheel[0][slot]));
+            wheel_cnt--;
+        }
+    }
+    if (!list_empty(&expired_list)) {
+        intr_defer(&expire_work);
+    }
+}
+
+/* Returns a tick no later than the first timeout in the wheel
+ * expires, or INT64_MAX if there are none.  This is the next
+ * occupied slot of level 0, or the next time level 0 wraps around
+ * and takes in timeouts from above, whichever comes first,
+ * counting a wraparound due on the next tick to process. */
+static int64_t
+wheel_next_expiry(void)
+{
+    int64_t t;
+
+    if (wheel_cnt == 0) {
+        return INT64_MAX;
+    }
+    for (t = wheel_ticks; t & WHEEL_MASK; t++) {
+        if (!list_empty(&wheel[0][t & WHEEL_MASK])) {
+            return t;
+        }
+    }
+    return t;
+}
+
+/* Calls the timeouts on expired_list.  Deferred by the timer
+ * interrupt, so interrupts are on except while each timeout is
+ * taken off the list. */
+static void
+run_expired(void *aux UNUSED)
+{
+    for (;;) {
+        enum intr_level old_level = intr_disable();
+        struct timeout *t;
+
+        if (list_empty(&expired_list)) {
+            intr_set_level(old_level);
+            return;
+        }
+        t = list_entry(list_pop_front(&expired_list), struct timeout, elem);
+        t->pending = false;
+        intr_set_level(old_level);
+
+        t->func(t->aux);
+    }
+}
+
+/* Returns the wakeup tick of the first thread in sleep_queue, or
+ * INT64_MAX if it is empty. */
+static int64_t
+first_wakeup(void)
+{
+    return (heap_empty(&sleep_queue)
+            ? INT64_MAX
+            : heap_entry(heap_min(&sleep_queue),
+                         struct thread, sleep_elem)->wakeup_tick);
+}
+
+/* Orders threads in sleep_queue by ascending wakeup tick. */
+static bool
+wakeup_less(const struct heap_elem *a, const struct heap_elem *b,
+            void *aux UNUSED)
+{
+    const struct thread *ta = heap_entry(a, struct thread, sleep_elem);
+    const struct thread *tb = heap_entry(b, struct thread, sleep_elem);
+
+    return ta->wakeup_tick < tb->wakeup_tick;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
  * tick, otherwise false. */
 static bool
@@ -202,6 +792,89 @@ too_many_loops(unsigned loops)
     return start != ticks;
 }
 
+/* Measures the time-stamp counter between two timer interrupts
+ * TSC_CALIBRATE_TICKS apart, and sets cycles_per_tick and ns_mult
+ * from it. */
+static void
+calibrate_cycles(void)
+{
+    int64_t start = ticks;
+    uint64_t begin;
+
+    /* Start on a tick boundary. */
+    while (ticks == start) {
+        barrier();
+    }
+    begin = timer_cycles();
+    start = ticks;
+    while (ticks < start + TSC_CALIBRATE_TICKS) {
+        barrier();
+    }
+    cycles_per_tick = (timer_cycles() - begin) / TSC_CALIBRATE_TICKS;
+    set_ns_mult();
+}
+
+/* Sets ns_mult from cycles_per_tick. */
+static void
+set_ns_mult(void)
+{
+    ns_mult = ((uint64_t) (1000000000 / TIMER_FREQ) << NS_SHIFT)
+              / cycles_per_tick;
+}
+
+/* Measures the local APIC timer's rate against the 8254 over
+ * TSC_CALIBRATE_TICKS ticks and, if there is a local APIC timer,
+ * makes it the tick source in place of the 8254. */
+static void
+calibrate_lapic(void)
+{
+    enum intr_level old_level;
+    int64_t start = ticks;
+    uint32_t counted;
+
+    if (!lapic_init()) {
+        printf("No local APIC, ticking with the 8254.\n");
+        return;
+    }
+
+    while (ticks == start) {
+        barrier();
+    }
+    lapic_timer_count_down(UINT32_MAX);
+    start = ticks;
+    while (ticks < start + TSC_CALIBRATE_TICKS) {
+        barrier();
+    }
+    counted = UINT32_MAX - lapic_timer_count();
+    lapic_timer_stop();
+    if (counted / TSC_CALIBRATE_TICKS == 0) {
+        printf("Local APIC timer is not counting, ticking with the 8254.\n");
+        return;
+    }
+
+    /* Switch over between two ticks. */
+    intr_register_ext(INTR_LAPIC_TIMER, timer_interrupt, "Local APIC Timer");
+    old_level = intr_disable();
+    intr_mask_ext(0x20, true);
+    lapic_counts_per_tick = counted / TSC_CALIBRATE_TICKS;
+    start_periodic_tick();
+    intr_set_level(old_level);
+    printf("Ticking with the local APIC timer, %'" PRIu32 " counts/tick.\n",
+           lapic_counts_per_tick);
+}
+
+/* Starts the periodic tick on the current tick source, replacing
+ * any countdown in progress. */
+static void
+start_periodic_tick(void)
+{
+    if (lapic_counts_per_tick != 0) {
+        lapic_timer_periodic(INTR_LAPIC_TIMER, lapic_counts_per_tick);
+    } else {
+        pit_configure_channel(0, 2, TIMER_FREQ);
+    }
+}
+
 /* Iterates through a simple loop LOOPS times, for implementing
  * brief delays.
  *
@@ -1,13 +1,37 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-/* Number of timer interrupts per second. */
-#define TIMER_FREQ 100
+struct thread;
+
+/* Bounds on and default for the number of timer interrupts per
+ * second.  The 8254 cannot count out ticks slower than 19 Hz, and
+ * much beyond 1000 Hz the tick itself eats the CPU. */
+#define TIMER_FREQ_MIN 19
+#define TIMER_FREQ_MAX 1000
+#define TIMER_FREQ_DEFAULT 100
+
+/* Number of timer interrupts per second.
+ * Controlled by kernel command-line option "-hz", and fixed once
+ * timer_init() has programmed the PIT. */
+extern int timer_freq;
+#define TIMER_FREQ timer_freq
+
+/* If true, stop the periodic tick while the CPU is idle.
+ * Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+/* If true, tick with the local APIC timer instead of the 8254
+ * once timer_calibrate() has measured it, if there is one.
+ * Controlled by kernel command-line option "-lapic". */
+extern bool timer_lapic;
 
 void timer_init(void);
+bool timer_set_calibration(unsigned loops_per_ms, unsigned cycles_per_ms);
 void timer_calibrate(void);
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
@@ -17,6 +41,25 @@ void timer_sleep(int64_t ticks);
 void timer_msleep(int64_t milliseconds);
 void timer_usleep(int64_t microseconds);
 void timer_nsleep(int64_t nanoseconds);
+void timer_wake(struct thread *);
+
+/* A function that timer_add() runs after a delay. */
+typedef void timer_func (void *aux);
+
+/* A pending call of a timer_func, embedded in the structure it
+ * is about. */
+struct timeout {
+    struct list_elem elem; /* Element in a timer wheel slot. */
+    int64_t expires;       /* Tick at which to run. */
+    timer_func *func;      /* Function to run. */
+    void *aux;             /* Argument to FUNC. */
+    bool pending;          /* Added and not yet run or cancelled? */
+};
+
+/* Callback timeouts. */
+void timeout_init(struct timeout *, timer_func *, void *aux);
+void timer_add(struct timeout *, int64_t ticks);
+bool timer_cancel(struct timeout *);
 
 /* Busy waits. */
 void timer_mdelay(int64_t milliseconds);
@@ -24,4 +67,25 @@ void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 void timer_print_stats(void);
 
+/* High-resolution time. */
+uint64_t timer_cycles_to_ns(uint64_t cycles);
+uint64_t timer_ns(void);
+uint64_t timer_boot_cycles(void);
+uint64_t timer_cycles_per_sec(void);
+
+/* Returns the CPU's time-stamp counter, for timing intervals too
+ * short to measure in ticks.  timer_cycles_to_ns() converts a
+ * difference between two readings to nanoseconds. */
+static inline uint64_t
+timer_cycles(void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+/* Tickless idle. */
+bool timer_idle_enter(void);
+void timer_idle_exit(void);
+
 #endif /* devices/timer.h */
@@ -1,3 +1,4 @@
+#include <debug.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -18,14 +19,30 @@
  * the display. */
 static size_t cx, cy;
 
+/* Rows of text that fit in the 32 kB of VGA memory at 0xb8000. */
+#define FB_ROWS (0x8000 / (COL_CNT * 2))
+
+/* The display shows ROW_CNT rows of the framebuffer starting at
+ * row TOP, which goes up by one to scroll, so that scrolling
+ * costs a write to the CRTC start address register instead of a
+ * copy of the whole screen.  Only once the display reaches the
+ * end of VGA memory are its rows copied back to the start.
+ * SHOWN_TOP is the row that the CRTC was last told. */
+static size_t top, shown_top;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
- * The character at (x,y) is fb[y][x][0].
- * The attribute at (x,y) is fb[y][x][1]. */
+ * The character at (x,y) on the display is fb[top + y][x][0].
+ * The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t(*fb)[COL_CNT][2];
 
+/* Most characters vga_putbuf() writes with interrupts off. */
+#define VGA_BATCH 256
+
+static void putc_raw(int c, enum intr_level);
+
 static void clear_row(size_t y);
 
 static void cls(void);
@@ -36,7 +53,8 @@ static void move_cursor(void);
 
 static void find_cursor(size_t *x, size_t *y);
 
-/* Initializes the VGA text display. */
+/* Initializes the VGA text display.  The BIOS leaves the display
+ * at the start of VGA memory, so that TOP starts out as 0. */
 static void
 init(void)
 {
@@ -60,6 +78,47 @@ vga_putc(int c)
     enum intr_level old_level = intr_disable();
 
     init();
+    putc_raw(c, old_level);
+
+    /* Update cursor position. */
+    move_cursor();
+
+    intr_set_level(old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+ * vga_putc() would one at a time.  Characters go straight into
+ * the framebuffer and the hardware cursor, which takes two slow
+ * port writes, is moved only once at the end.  Interrupts are
+ * turned back on between batches of characters so that a long
+ * buffer, with its scrolling, does not hold them off for long. */
+void
+vga_putbuf(const char *buffer, size_t n)
+{
+    while (n > 0) {
+        size_t batch = n < VGA_BATCH ? n : VGA_BATCH;
+        enum intr_level old_level = intr_disable();
+
+        init();
+        n -= batch;
+        while (batch-- > 0) {
+            putc_raw(*buffer++, old_level);
+        }
+        if (n == 0) {
+            move_cursor();
+        }
+        intr_set_level(old_level);
+    }
+}
+
+/* Writes C to the framebuffer at the cursor, interpreting
+ * control characters, without moving the hardware cursor.
+ * Interrupts must be off; OLD_LEVEL is the level to restore
+ * while beeping. */
+static void
+putc_raw(int c, enum intr_level old_level)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
 
     switch (c) {
     case '\n':
@@ -94,18 +153,13 @@ vga_putc(int c)
         break;
 
     default:
-        fb[cy][cx][0] = c;
-        fb[cy][cx][1] = GRAY_ON_BLACK;
+        fb[top + cy][cx][0] = c;
+        fb[top + cy][cx][1] = GRAY_ON_BLACK;
         if (++cx >= COL_CNT) {
             newline();
         }
         break;
     }
-
-    /* Update cursor position. */
-    move_cursor();
-
-    intr_set_level(old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -122,21 +176,22 @@ cls(void)
     move_cursor();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of the display to spaces. */
 static void
 clear_row(size_t y)
 {
     size_t x;
 
     for (x = 0; x < COL_CNT; x++) {
-        fb[y][x][0] = ' ';
-        fb[y][x][1] = GRAY_ON_BLACK;
+        fb[top + y][x][0] = ' ';
+        fb[top + y][x][1] = GRAY_ON_BLACK;
     }
 }
 
 /* Advances the cursor to the first column in the next line on
  * the screen.  If the cursor is already on the last line on the
- * screen, scrolls the screen upward one line. */
+ * screen, scrolls the screen upward one line.  The display
+ * itself follows at the next move_cursor(). */
 static void
 newline(void)
 {
@@ -144,18 +199,32 @@ newline(void)
     cy++;
     if (cy >= ROW_CNT) {
         cy = ROW_CNT - 1;
-        memmove(&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+        if (top + ROW_CNT < FB_ROWS) {
+            top++;
+        } else {
+            memmove(&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+            top = 0;
+        }
         clear_row(ROW_CNT - 1);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Moves the hardware cursor to (cx,cy), and the start of the
+ * display to row TOP if it has moved. */
 static void
 move_cursor(void)
 {
-    /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-    uint16_t cp = cx + COL_CNT * cy;
+    /* See [FREEVGA] under "Manipulating the Text-mode Cursor" and
+     * "CRT Controller Registers". */
+    uint16_t cp = cx + COL_CNT * (top + cy);
+
+    if (top != shown_top) {
+        uint16_t start = COL_CNT * top;
 
+        outw(0x3d4, 0x0c | (start & 0xff00));
+        outw(0x3d4, 0x0d | (start << 8));
+        shown_top = top;
+    }
     outw(0x3d4, 0x0e | (cp & 0xff00));
     outw(0x3d4, 0x0f | (cp << 8));
 }
@@ -0,0 +1,480 @@
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "devices/virtblk.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* The code in this file drives virtio block devices, as QEMU
+ * offers with "-drive if=virtio", through the legacy PCI
+ * interface of [VIRTIO] 4.1.4.8: a handful of I/O ports in BAR0
+ * and one virtqueue that we lay out in memory for the device to
+ * read requests from and post completions to.
+ *
+ * Unlike an IDE disk, the device takes any number of requests at
+ * once, each of any length, and a request costs a single port
+ * write however much it transfers.  Every requester puts its
+ * request in the queue as soon as there are descriptors for it
+ * and sleeps; the interrupt handler wakes the requesters of
+ * whatever the device has completed, in whatever order. */
+
+/* PCI IDs of a virtio block device with the legacy interface. */
+#define VIRTIO_VENDOR     0x1af4
+#define VIRTIO_DEVICE_BLK 0x1001
+
+/* Legacy interface registers. */
+#define reg_host_features(D)  ((D)->io_base + 0x00) /* 32 bits. */
+#define reg_guest_features(D) ((D)->io_base + 0x04) /* 32 bits. */
+#define reg_queue_pfn(D)      ((D)->io_base + 0x08) /* 32 bits. */
+#define reg_queue_size(D)     ((D)->io_base + 0x0c) /* 16 bits. */
+#define reg_queue_select(D)   ((D)->io_base + 0x0e) /* 16 bits. */
+#define reg_queue_notify(D)   ((D)->io_base + 0x10) /* 16 bits. */
+#define reg_status(D)         ((D)->io_base + 0x12) /* 8 bits. */
+#define reg_isr(D)            ((D)->io_base + 0x13) /* 8 bits. */
+#define reg_capacity(D)       ((D)->io_base + 0x14) /* 64 bits. */
+
+/* Device Status Register bits. */
+#define STA_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STA_DRIVER      0x02 /* Guest has a driver for it. */
+#define STA_DRIVER_OK   0x04 /* Driver is ready. */
+#define STA_FAILED      0x80 /* Driver gave up. */
+
+/* Virtqueue descriptor flags. */
+#define DESC_NEXT  0x1 /* Chained to NEXT. */
+#define DESC_WRITE 0x2 /* Written by the device, not read. */
+
+/* Used ring flag: the device does not need to be notified. */
+#define USED_NO_NOTIFY 0x1
+
+/* Request types and the status that the device reports. */
+#define REQ_IN  0 /* Read. */
+#define REQ_OUT 1 /* Write. */
+#define REQ_OK  0
+
+/* Most devices that we drive. */
+#define VIRTBLK_MAX 4
+
+/* Most physically contiguous pieces of a request's buffer: one
+ * per page that BLOCK_MAX_MULTIPLE sectors can touch.  With the
+ * header and the status byte, a request needs up to two
+ * descriptors more. */
+#define SEG_MAX (BLOCK_MAX_MULTIPLE * BLOCK_SECTOR_SIZE / PGSIZE + 1)
+#define REQ_DESC_MAX (SEG_MAX + 2)
+
+/* Virtqueue, as laid out in memory ([VIRTIO] 2.4). */
+struct vring_desc {
+    uint64_t addr;  /* Physical address. */
+    uint32_t len;   /* Length in bytes. */
+    uint16_t flags; /* DESC_* flags. */
+    uint16_t next;  /* Next descriptor, with DESC_NEXT. */
+};
+
+struct vring_avail {
+    uint16_t flags;  /* Unused. */
+    uint16_t idx;    /* Where the driver puts the next entry. */
+    uint16_t ring[]; /* Heads of descriptor chains. */
+};
+
+struct vring_used_elem {
+    uint32_t id;  /* Head of a completed chain. */
+    uint32_t len; /* Bytes written into it. */
+};
+
+struct vring_used {
+    uint16_t flags;                 /* USED_NO_NOTIFY. */
+    uint16_t idx;                   /* Where the device puts the next. */
+    struct vring_used_elem ring[];  /* Completed chains. */
+};
+
+/* Request header, read by the device. */
+struct req_header {
+    uint32_t type;     /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;
+    uint64_t sector;   /* First sector. */
+};
+
+/* A request in the queue.  It lives on the requester's stack,
+ * which is direct-mapped kernel memory, so that the device can
+ * read HEADER and write STATUS there. */
+struct request {
+    struct req_header header;  /* Read by the device. */
+    uint8_t status;            /* Written by the device. */
+    struct semaphore done;     /* Up'd once the device is done. */
+};
+
+/* A virtio block device. */
+struct virtblk {
+    char name[8];              /* Name, e.g. "vda". */
+    uint16_t io_base;          /* Base I/O port. */
+    uint8_t irq;               /* Interrupt in use. */
+
+    /* Virtqueue.  Only touched with interrupts off. */
+    uint16_t queue_size;       /* Number of descriptors. */
+    struct vring_desc *desc;   /* Descriptor table. */
+    struct vring_avail *avail; /* Available ring. */
+    volatile struct vring_used *used; /* Used ring. */
+    struct request **reqs;     /* Request by head descriptor. */
+    uint16_t free_head;        /* First free descriptor. */
+    uint16_t free_cnt;         /* Number of free descriptors. */
+    uint16_t last_used;        /* Used ring entries seen so far. */
+    unsigned waiters;          /* Requesters waiting for descriptors. */
+    struct semaphore desc_wait; /* Up'd for each as they are freed. */
+};
+
+static struct virtblk disks[VIRTBLK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtblk_operations;
+
+static bool init_device(struct virtblk *, const struct pci_addr *);
+static bool init_queue(struct virtblk *);
+static void submit_request(struct virtblk *, block_sector_t,
+                           block_sector_t cnt, void *, bool write);
+static size_t split_buffer(const uint8_t *, size_t size,
+                           uintptr_t addrs[], uint32_t lens[]);
+static uint16_t add_desc(struct virtblk *, uintptr_t addr, uint32_t len,
+                         uint16_t flags);
+static void complete_requests(struct virtblk *);
+static void interrupt_handler(struct intr_frame *);
+
+/* Finds the virtio block devices on the PCI bus, sets up each,
+ * and registers it and its partitions with the block layer. */
+void
+virtblk_init(void)
+{
+    struct pci_addr addrs[VIRTBLK_MAX];
+    size_t cnt, i;
+
+    cnt = pci_find_devices(VIRTIO_VENDOR, VIRTIO_DEVICE_BLK, addrs,
+                           VIRTBLK_MAX);
+    for (i = 0; i < cnt; i++) {
+        struct virtblk *d = &disks[disk_cnt];
+        uint64_t capacity;
+        char extra_info[64];
+        struct block *block;
+        size_t j;
+
+        snprintf(d->name, sizeof d->name, "vd%c", (char)('a' + disk_cnt));
+        if (!init_device(d, &addrs[i])) {
+            continue;
+        }
+
+        /* Disks that share an interrupt share its handler. */
+        for (j = 0; j < disk_cnt; j++) {
+            if (disks[j].irq == d->irq) {
+                break;
+            }
+        }
+        if (j == disk_cnt) {
+            intr_register_ext(d->irq, interrupt_handler, "virtio-blk");
+        }
+        disk_cnt++;
+        outb(reg_status(d), inb(reg_status(d)) | STA_DRIVER_OK);
+
+        /* We cannot name more sectors than fit in block_sector_t. */
+        capacity = (inl(reg_capacity(d))
+                    | (uint64_t) inl(reg_capacity(d) + 4) << 32);
+        if (capacity > UINT32_MAX) {
+            capacity = UINT32_MAX;
+        }
+        snprintf(extra_info, sizeof extra_info,
+                 "virtio, port %#"PRIx16", IRQ %d, %"PRIu16" descriptors",
+                 d->io_base, d->irq - 0x20, d->queue_size);
+        block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
+                               &virtblk_operations, d);
+        partition_scan(block);
+    }
+}
+
+/* Sets up D for the virtio block device at A: resets it,
+ * negotiates no optional features, and gives it a virtqueue.
+ * Returns false, with the device marked failed, if it cannot be
+ * used. */
+static bool
+init_device(struct virtblk *d, const struct pci_addr *a)
+{
+    uint32_t bar, cmd;
+
+    bar = pci_read_config(a, PCI_REG_BAR0);
+    if ((bar & 1) == 0 || (bar & 0xfffc) == 0) {
+        printf("%s: no I/O ports, ignoring\n", d->name);
+        return false;
+    }
+    cmd = pci_read_config(a, PCI_REG_COMMAND);
+    pci_write_config(a, PCI_REG_COMMAND,
+                     cmd | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+    d->io_base = bar & 0xfffc;
+    d->irq = (pci_read_config(a, PCI_REG_IRQ) & 0xff) + 0x20;
+
+    /* Device initialization, [VIRTIO] 3.1.1. */
+    outb(reg_status(d), 0);
+    outb(reg_status(d), STA_ACKNOWLEDGE);
+    outb(reg_status(d), STA_ACKNOWLEDGE | STA_DRIVER);
+    inl(reg_host_features(d));
+    outl(reg_guest_features(d), 0);
+    if (d->irq < 0x20 || d->irq > 0x2f || !init_queue(d)) {
+        printf("%s: cannot set up device, ignoring\n", d->name);
+        outb(reg_status(d), inb(reg_status(d)) | STA_FAILED);
+        return false;
+    }
+    return true;
+}
+
+/* Allocates and lays out D's virtqueue, of the size that the
+ * device asks for, and tells the device where it is.  The legacy
+ * interface wants the descriptor table and available ring
+ * together, followed by the used ring on the next page boundary,
+ * all physically contiguous. */
+static bool
+init_queue(struct virtblk *d)
+{
+    size_t used_ofs, page_cnt;
+    uint8_t *queue;
+    uint16_t i;
+
+    outw(reg_queue_select(d), 0);
+    d->queue_size = inw(reg_queue_size(d));
+    if (d->queue_size < REQ_DESC_MAX) {
+        return false;
+    }
+    used_ofs = ROUND_UP(d->queue_size * sizeof *d->desc
+                        + sizeof *d->avail
+                        + (d->queue_size + 1) * sizeof d->avail->ring[0],
+                        PGSIZE);
+    page_cnt = DIV_ROUND_UP(used_ofs + sizeof *d->used + sizeof(uint16_t)
+                            + d->queue_size * sizeof d->used->ring[0],
+                            PGSIZE);
+    queue = palloc_get_multiple(PAL_ZERO, page_cnt);
+    d->reqs = calloc(d->queue_size, sizeof *d->reqs);
+    if (queue == NULL || d->reqs == NULL) {
+        palloc_free_multiple(queue, page_cnt);
+        free(d->reqs);
+        return false;
+    }
+    d->desc = (struct vring_desc *) queue;
+    d->avail = (struct vring_avail *) (queue + d->queue_size
+                                       * sizeof *d->desc);
+    d->used = (struct vring_used *) (queue + used_ofs);
+
+    for (i = 0; i < d->queue_size; i++) {
+        d->desc[i].next = i + 1;
+    }
+    d->free_head = 0;
+    d->free_cnt = d->queue_size;
+    d->last_used = 0;
+    d->waiters = 0;
+    sema_init(&d->desc_wait, 0);
+
+    outl(reg_queue_pfn(d), vtop(queue) >> PGBITS);
+    return true;
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+ * room for BLOCK_SECTOR_SIZE bytes. */
+static void
+virtblk_read(void *d, block_sector_t sec_no, void *buffer)
+{
+    submit_request(d, sec_no, 1, buffer, false);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER, which must contain
+ * BLOCK_SECTOR_SIZE bytes.  Returns after the device has
+ * completed the write. */
+static void
+virtblk_write(void *d, block_sector_t sec_no, const void *buffer)
+{
+    submit_request(d, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+ * BUFFER, in a single request. */
+static void
+virtblk_read_multiple(void *d, block_sector_t sec_no, block_sector_t cnt,
+                      void *buffer)
+{
+    submit_request(d, sec_no, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+ * BUFFER, in a single request. */
+static void
+virtblk_write_multiple(void *d, block_sector_t sec_no, block_sector_t cnt,
+                       const void *buffer)
+{
+    submit_request(d, sec_no, cnt, (void *) buffer, true);
+}
+
+static struct block_operations virtblk_operations = {
+    virtblk_read,
+    virtblk_write,
+    virtblk_read_multiple,
+    virtblk_write_multiple,
+};
+
+/* Queues a transfer of the CNT sectors starting at SEC_NO between
+ * disk D and BUFFER, which may come from vmalloc(), and waits for
+ * it to complete.  If too few descriptors are free, waits for
+ * other requests to complete first. */
+static void
+submit_request(struct virtblk *d, block_sector_t sec_no, block_sector_t cnt,
+               void *buffer, bool write)
+{
+    uintptr_t seg_addrs[SEG_MAX];
+    uint32_t seg_lens[SEG_MAX];
+    size_t seg_cnt, i;
+    uint16_t data_flags = DESC_NEXT | (write ? 0 : DESC_WRITE);
+    struct request r;
+    enum intr_level old_level;
+    uint16_t head;
+
+    ASSERT(!intr_context());
+    ASSERT(cnt >= 1 && cnt <= BLOCK_MAX_MULTIPLE);
+
+    seg_cnt = split_buffer(buffer, cnt * BLOCK_SECTOR_SIZE,
+                           seg_addrs, seg_lens);
+    r.header.type = write ? REQ_OUT : REQ_IN;
+    r.header.reserved = 0;
+    r.header.sector = sec_no;
+    r.status = 0xff;
+    sema_init(&r.done, 0);
+
+    old_level = intr_disable();
+    while (d->free_cnt < seg_cnt + 2) {
+        d->waiters++;
+        sema_down(&d->desc_wait);
+    }
+
+    /* Chain the header, the data and the status byte, and make
+     * the chain available to the device. */
+    head = add_desc(d, vtop(&r.header), sizeof r.header, DESC_NEXT);
+    for (i = 0; i < seg_cnt; i++) {
+        add_desc(d, seg_addrs[i], seg_lens[i], data_flags);
+    }
+    add_desc(d, vtop(&r.status), 1, DESC_WRITE);
+    d->reqs[head] = &r;
+    d->avail->ring[d->avail->idx % d->queue_size] = head;
+    barrier();
+    d->avail->idx++;
+    barrier();
+    if ((d->used->flags & USED_NO_NOTIFY) == 0) {
+        outw(reg_queue_notify(d), 0);
+    }
+    intr_set_level(old_level);
+
+    sema_down(&r.done);
+    if (r.status != REQ_OK) {
+        PANIC("%s: disk %s failed, sector=%"PRDSNu,
+              d->name, write ? "write" : "read", sec_no);
+    }
+}
+
+/* Breaks the SIZE bytes at BUFFER into physically contiguous
+ * pieces, stores their addresses and lengths in ADDRS and LENS,
+ * and returns how many there are, at most SEG_MAX. */
+static size_t
+split_buffer(const uint8_t *buffer, size_t size,
+             uintptr_t addrs[], uint32_t lens[])
+{
+    size_t n = 0;
+
+    while (size > 0) {
+        size_t chunk = PGSIZE - pg_ofs(buffer);
+        uintptr_t phys = (is_vmalloc_vaddr(buffer)
+                          ? vmalloc_vtop(buffer) : vtop(buffer));
+
+        if (chunk > size) {
+            chunk = size;
+        }
+        if (n > 0 && addrs[n - 1] + lens[n - 1] == phys) {
+            lens[n - 1] += chunk;
+        } else {
+            ASSERT(n < SEG_MAX);
+            addrs[n] = phys;
+            lens[n] = chunk;
+            n++;
+        }
+        buffer += chunk;
+        size -= chunk;
+    }
+    return n;
+}
+
+/* Takes a free descriptor from disk D, points it at the LEN bytes
+ * at physical address ADDR with the given FLAGS, and returns its
+ * index.  With DESC_NEXT in FLAGS, it is chained to the
+ * descriptor that the next call takes.  Interrupts must be off. */
+static uint16_t
+add_desc(struct virtblk *d, uintptr_t addr, uint32_t len, uint16_t flags)
+{
+    uint16_t idx = d->free_head;
+    struct vring_desc *desc = &d->desc[idx];
+
+    ASSERT(d->free_cnt > 0);
+    d->free_head = desc->next;
+    d->free_cnt--;
+    desc->addr = addr;
+    desc->len = len;
+    desc->flags = flags;
+    desc->next = d->free_head;
+    return idx;
+}
+
+/* Wakes the requester of each request that disk D has completed
+ * since the last call, frees their descriptors, and then wakes
+ * anyone waiting for descriptors to retry. */
+static void
+complete_requests(struct virtblk *d)
+{
+    while (d->last_used != d->used->idx) {
+        uint16_t idx = d->used->ring[d->last_used % d->queue_size].id;
+        struct request *r = d->reqs[idx];
+
+        d->reqs[idx] = NULL;
+        for (;;) {
+            struct vring_desc *desc = &d->desc[idx];
+            uint16_t next = desc->next;
+            bool more = (desc->flags & DESC_NEXT) != 0;
+
+            desc->next = d->free_head;
+            d->free_head = idx;
+            d->free_cnt++;
+            if (!more) {
+                break;
+            }
+            idx = next;
+        }
+        d->last_used++;
+        sema_up(&r->done);
+    }
+    while (d->waiters > 0) {
+        d->waiters--;
+        sema_up(&d->desc_wait);
+    }
+}
+
+/* virtio block device interrupt handler.  Reading a device's ISR
+ * register acknowledges its interrupt. */
+static void
+interrupt_handler(struct intr_frame *f)
+{
+    size_t i;
+
+    for (i = 0; i < disk_cnt; i++) {
+        struct virtblk *d = &disks[i];
+
+        if (d->irq == f->vec_no) {
+            inb(reg_isr(d));
+            complete_requests(d);
+        }
+    }
+}
@@ -0,0 +1,6 @@
+#ifndef DEVICES_VIRTBLK_H
+#define DEVICES_VIRTBLK_H
+
+void virtblk_init(void);
+
+#endif /* devices/virtblk.h */
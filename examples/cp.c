@@ -9,6 +9,7 @@ int
 main (int argc, char *argv[])
 {
   int in_fd, out_fd;
+  int size;
 
   if (argc != 3)
     {
@@ -24,8 +25,9 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Create and open output file. */
-  if (!create (argv[2], filesize (in_fd)))
+  /* Create and open output file, empty so that it can be a
+     clone. */
+  if (!create (argv[2], 0))
     {
       printf ("%s: create failed\n", argv[2]);
       return EXIT_FAILURE;
@@ -37,18 +39,16 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Copy data. */
-  for (;;)
+  /* Share the data with the input file, which copies nothing
+     until one of them is written, or failing that copy it, inside
+     the kernel. */
+  if (clone_file (out_fd, in_fd))
+    return EXIT_SUCCESS;
+  size = filesize (in_fd);
+  if (copy_file (out_fd, in_fd, size) != size)
     {
-      char buffer[1024];
-      int bytes_read = read (in_fd, buffer, sizeof buffer);
-      if (bytes_read == 0)
-        break;
-      if (write (out_fd, buffer, bytes_read) != bytes_read)
-        {
-          printf ("%s: write failed\n", argv[2]);
-          return EXIT_FAILURE;
-        }
+      printf ("%s: write failed\n", argv[2]);
+      return EXIT_FAILURE;
     }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,382 @@
+/* fsbench.c
+
+   Measures file system throughput.  Usage:
+
+     fsbench [TEST]...
+
+   where each TEST is one of
+
+     seq    writes and then reads a large file sequentially, in
+            several block sizes;
+     rand   reads 512-byte blocks at random offsets in a file;
+     small  creates and then deletes many small files;
+     dirs   creates a deep chain of directories and looks up
+            paths through it;
+     mixed  runs reader and writer processes at the same time;
+
+   or all of them if no TEST is given.  For each phase it prints
+   bytes/s and operations/s, and the sectors the file system
+   device transferred meanwhile. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the file written and read by "seq". */
+#define SEQ_SIZE (512 * 1024)
+
+/* Size of the file read by "rand", and number of reads. */
+#define RAND_SIZE (256 * 1024)
+#define RAND_CNT 1000
+
+/* Number of files created and deleted by "small", and their
+   size. */
+#define SMALL_CNT 100
+#define SMALL_SIZE 100
+
+/* Depth of the directory chain built by "dirs", and number of
+   lookups through it. */
+#define DIR_DEPTH 16
+#define LOOKUP_CNT 200
+
+/* Processes of each kind run by "mixed", the size of the files
+   they use, and the number of times each reader reads its file. */
+#define MIX_PROCS 2
+#define MIX_SIZE (64 * 1024)
+#define MIX_PASSES 4
+
+static char buf[16 * 1024];
+
+/* A timed phase of a benchmark. */
+struct phase
+  {
+    const char *name;           /* Phase name. */
+    unsigned long long start;   /* uptime() at start. */
+    struct iostat io;           /* iostat() at start. */
+  };
+
+static void bench_seq (void);
+static void bench_rand (void);
+static void bench_small (void);
+static void bench_dirs (void);
+static void bench_mixed (void);
+static int mixed_reader (void);
+static int mixed_writer (int id);
+
+static void begin (struct phase *, const char *name);
+static void end (const struct phase *, unsigned long long bytes,
+                 unsigned ops);
+static void make_file (const char *name, int size);
+static void die (const char *what, const char *name) NO_RETURN;
+
+/* Benchmarks, by name. */
+struct bench
+  {
+    const char *name;
+    void (*function) (void);
+  };
+
+static const struct bench benches[] =
+  {
+    {"seq", bench_seq},
+    {"rand", bench_rand},
+    {"small", bench_small},
+    {"dirs", bench_dirs},
+    {"mixed", bench_mixed},
+  };
+
+#define BENCH_CNT (sizeof benches / sizeof *benches)
+
+int
+main (int argc, char *argv[])
+{
+  size_t i;
+  int j;
+
+  /* Children of "mixed". */
+  if (argc == 2 && !strcmp (argv[1], "reader"))
+    return mixed_reader ();
+  if (argc == 3 && !strcmp (argv[1], "writer"))
+    return mixed_writer (atoi (argv[2]));
+
+  if (argc == 1)
+    {
+      for (i = 0; i < BENCH_CNT; i++)
+        benches[i].function ();
+      return EXIT_SUCCESS;
+    }
+
+  for (j = 1; j < argc; j++)
+    {
+      for (i = 0; i < BENCH_CNT; i++)
+        if (!strcmp (argv[j], benches[i].name))
+          break;
+      if (i >= BENCH_CNT)
+        {
+          printf ("usage: fsbench [seq|rand|small|dirs|mixed]...\n");
+          return EXIT_FAILURE;
+        }
+      benches[i].function ();
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Writes and reads back a SEQ_SIZE file in each block size. */
+static void
+bench_seq (void)
+{
+  static const int sizes[] = {512, 4096, 16384};
+  size_t i;
+
+  memset (buf, 0x5a, sizeof buf);
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      int bs = sizes[i];
+      char name[32];
+      struct phase p;
+      int fd, ofs;
+
+      if (!create ("bench.seq", 0))
+        die ("create", "bench.seq");
+      fd = open ("bench.seq");
+      if (fd < 0)
+        die ("open", "bench.seq");
+
+      snprintf (name, sizeof name, "seq-write-%d", bs);
+      begin (&p, name);
+      for (ofs = 0; ofs < SEQ_SIZE; ofs += bs)
+        if (write (fd, buf, bs) != bs)
+          die ("write", "bench.seq");
+      end (&p, SEQ_SIZE, SEQ_SIZE / bs);
+
+      seek (fd, 0);
+      snprintf (name, sizeof name, "seq-read-%d", bs);
+      begin (&p, name);
+      for (ofs = 0; ofs < SEQ_SIZE; ofs += bs)
+        if (read (fd, buf, bs) != bs)
+          die ("read", "bench.seq");
+      end (&p, SEQ_SIZE, SEQ_SIZE / bs);
+
+      close (fd);
+      if (!remove ("bench.seq"))
+        die ("remove", "bench.seq");
+    }
+}
+
+/* Reads RAND_CNT 512-byte blocks at random in a RAND_SIZE file. */
+static void
+bench_rand (void)
+{
+  struct phase p;
+  int fd, i;
+
+  make_file ("bench.rand", RAND_SIZE);
+  fd = open ("bench.rand");
+  if (fd < 0)
+    die ("open", "bench.rand");
+
+  random_init (0);
+  begin (&p, "rand-read-512");
+  for (i = 0; i < RAND_CNT; i++)
+    {
+      unsigned ofs = random_ulong () % (RAND_SIZE / 512) * 512;
+      if (pread (fd, buf, 512, ofs) != 512)
+        die ("pread", "bench.rand");
+    }
+  end (&p, RAND_CNT * 512ULL, RAND_CNT);
+
+  close (fd);
+  remove ("bench.rand");
+}
+
+/* Creates SMALL_CNT small files, then deletes them. */
+static void
+bench_small (void)
+{
+  char name[16];
+  struct phase p;
+  int i;
+
+  memset (buf, 's', SMALL_SIZE);
+  begin (&p, "small-create");
+  for (i = 0; i < SMALL_CNT; i++)
+    {
+      snprintf (name, sizeof name, "small%d", i);
+      make_file (name, SMALL_SIZE);
+    }
+  end (&p, SMALL_CNT * SMALL_SIZE, SMALL_CNT);
+
+  begin (&p, "small-delete");
+  for (i = 0; i < SMALL_CNT; i++)
+    {
+      snprintf (name, sizeof name, "small%d", i);
+      if (!remove (name))
+        die ("remove", name);
+    }
+  end (&p, 0, SMALL_CNT);
+}
+
+/* Builds a chain of DIR_DEPTH directories, looks up the deepest
+   one LOOKUP_CNT times by its full path, and removes the chain. */
+static void
+bench_dirs (void)
+{
+  char path[DIR_DEPTH * 3 + 1];
+  struct phase p;
+  int i;
+
+  path[0] = '\0';
+  begin (&p, "dir-create");
+  for (i = 0; i < DIR_DEPTH; i++)
+    {
+      strlcat (path, i == 0 ? "d0" : "/d0", sizeof path);
+      if (!mkdir (path))
+        die ("mkdir", path);
+    }
+  end (&p, 0, DIR_DEPTH);
+
+  begin (&p, "dir-lookup");
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd = open (path);
+      if (fd < 0)
+        die ("open", path);
+      close (fd);
+    }
+  end (&p, 0, LOOKUP_CNT);
+
+  for (i = DIR_DEPTH; i > 0; i--)
+    {
+      if (!remove (path))
+        die ("remove", path);
+      path[i == 1 ? 0 : (i - 1) * 3 - 1] = '\0';
+    }
+}
+
+/* Runs MIX_PROCS writer processes, each writing a file of its
+   own, at the same time as MIX_PROCS readers of a shared file. */
+static void
+bench_mixed (void)
+{
+  pid_t pids[2 * MIX_PROCS];
+  struct phase p;
+  int i;
+
+  make_file ("bench.mix", MIX_SIZE);
+
+  begin (&p, "mixed");
+  for (i = 0; i < MIX_PROCS; i++)
+    {
+      char cmd[32];
+
+      snprintf (cmd, sizeof cmd, "fsbench writer %d", i);
+      pids[2 * i] = exec (cmd);
+      pids[2 * i + 1] = exec ("fsbench reader");
+      if (pids[2 * i] == PID_ERROR || pids[2 * i + 1] == PID_ERROR)
+        die ("exec", "fsbench");
+    }
+  for (i = 0; i < 2 * MIX_PROCS; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      die ("child", "fsbench");
+  end (&p, MIX_PROCS * (MIX_SIZE + MIX_PASSES * (unsigned long long) MIX_SIZE),
+       MIX_PROCS * (1 + MIX_PASSES) * (MIX_SIZE / sizeof buf));
+
+  remove ("bench.mix");
+}
+
+/* Child of "mixed": reads the shared file MIX_PASSES times. */
+static int
+mixed_reader (void)
+{
+  int fd = open ("bench.mix");
+  int pass;
+
+  if (fd < 0)
+    return EXIT_FAILURE;
+  for (pass = 0; pass < MIX_PASSES; pass++)
+    {
+      int ofs;
+
+      seek (fd, 0);
+      for (ofs = 0; ofs < MIX_SIZE; ofs += sizeof buf)
+        if (read (fd, buf, sizeof buf) != sizeof buf)
+          return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Child of "mixed": writes a MIX_SIZE file of its own, numbered
+   ID, and deletes it. */
+static int
+mixed_writer (int id)
+{
+  char name[16];
+
+  snprintf (name, sizeof name, "bench.w%d", id);
+  make_file (name, MIX_SIZE);
+  return remove (name) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Starts timing phase P, called NAME. */
+static void
+begin (struct phase *p, const char *name)
+{
+  p->name = name;
+  iostat (&p->io);
+  uptime (&p->start);
+}
+
+/* Ends phase P, which moved BYTES bytes in OPS operations, and
+   prints its results. */
+static void
+end (const struct phase *p, unsigned long long bytes, unsigned ops)
+{
+  unsigned long long now, us;
+  struct iostat io;
+
+  uptime (&now);
+  iostat (&io);
+  us = (now - p->start) / 1000;
+  if (us == 0)
+    us = 1;
+
+  printf ("%s: %llu bytes/s, %llu ops/s (%llu bytes, %u ops in %llu us); "
+          "disk %llu sectors read in %llu requests, "
+          "%llu written in %llu\n",
+          p->name, bytes * 1000000 / us, ops * 1000000ULL / us,
+          bytes, ops, us,
+          io.read_sectors - p->io.read_sectors,
+          io.read_reqs - p->io.read_reqs,
+          io.write_sectors - p->io.write_sectors,
+          io.write_reqs - p->io.write_reqs);
+}
+
+/* Creates file NAME and writes SIZE bytes from buf into it. */
+static void
+make_file (const char *name, int size)
+{
+  int fd, ofs;
+
+  if (!create (name, 0))
+    die ("create", name);
+  fd = open (name);
+  if (fd < 0)
+    die ("open", name);
+  for (ofs = 0; ofs < size; ofs += sizeof buf)
+    {
+      int cnt = size - ofs < (int) sizeof buf ? size - ofs : (int) sizeof buf;
+      if (write (fd, buf, cnt) != cnt)
+        die ("write", name);
+    }
+  close (fd);
+}
+
+/* Reports that WHAT failed on NAME and exits. */
+static void
+die (const char *what, const char *name)
+{
+  printf ("fsbench: %s: %s failed\n", name, what);
+  exit (EXIT_FAILURE);
+}
@@ -0,0 +1,129 @@
+/* latency.c
+
+   Measures memory latency by chasing pointers.  Usage:
+
+     latency [MAX-KB [LOADS]]
+
+   Links one word in each 64-byte line of a working set into a
+   single cycle, in random order, so that every load depends on
+   the one before and no prefetcher can guess the next.  Follows
+   LOADS pointers (default 1000000) around it and prints the CPU
+   cycles and nanoseconds per load and the bytes loaded per
+   second.  The working set starts at 4 kB and doubles up to
+   MAX-KB, which defaults to twice the memory that the user pool
+   has free, as kstat() reports it, up to 8 MB.  The latency steps
+   up as the working set outgrows each cache and, under the VM
+   kernel, once it outgrows the user pool and pages to swap. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <tsc.h>
+
+#define LINE_SIZE 64
+#define PAGE_SIZE 4096
+
+/* Largest working set: 8 MB. */
+#define MAX_KB 8192
+#define MAX_LINES (MAX_KB * 1024 / LINE_SIZE)
+
+/* A cache line, whose first word is the next link of the cycle. */
+struct line
+  {
+    union
+      {
+        struct line *next;
+        size_t idx;
+      };
+    char pad[LINE_SIZE - sizeof (struct line *)];
+  };
+
+static struct line lines[MAX_LINES];
+
+static struct line *link (size_t cnt);
+static struct line *chase (struct line *, int loads);
+
+int
+main (int argc, char *argv[])
+{
+  int max_kb = 0, loads = 1000000;
+  struct kstat st;
+  int kb;
+
+  if (argc > 1)
+    max_kb = atoi (argv[1]);
+  if (argc > 2)
+    loads = atoi (argv[2]);
+  if (argc > 3 || max_kb < 0 || loads < 1)
+    {
+      printf ("usage: latency [MAX-KB [LOADS]]\n");
+      return EXIT_FAILURE;
+    }
+  if (max_kb == 0)
+    {
+      kstat (&st);
+      max_kb = st.free_user_pages * (PAGE_SIZE / 1024) * 2;
+    }
+  if (max_kb == 0 || max_kb > MAX_KB)
+    max_kb = MAX_KB;
+
+  random_init (0);
+  for (kb = 4; kb <= max_kb; kb *= 2)
+    {
+      unsigned long long start, now, ns;
+      struct line *p = link (kb * 1024 / LINE_SIZE);
+      uint64_t cycles;
+
+      /* Once around brings the working set in. */
+      p = chase (p, kb * 1024 / LINE_SIZE);
+
+      uptime (&start);
+      cycles = tsc_read ();
+      p = chase (p, loads);
+      cycles = tsc_read () - cycles;
+      uptime (&now);
+
+      ns = now - start > 0 ? now - start : 1;
+      printf ("latency: kb=%d loads=%d cycles_per_load=%llu "
+              "ns_per_load=%llu bytes_per_sec=%llu\n",
+              kb, loads, cycles / loads, ns / loads,
+              (unsigned long long) loads * sizeof p->next
+              * 1000000000ULL / ns);
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Links the first CNT lines into one cycle in random order and
+   returns the first.  Sattolo's algorithm shuffles the line
+   numbers into a permutation with a single cycle, kept in the
+   lines themselves; then each line's number becomes a pointer. */
+static struct line *
+link (size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    lines[i].idx = i;
+  for (i = cnt - 1; i > 0; i--)
+    {
+      size_t j = random_ulong () % i;
+      size_t tmp = lines[i].idx;
+      lines[i].idx = lines[j].idx;
+      lines[j].idx = tmp;
+    }
+  for (i = 0; i < cnt; i++)
+    lines[i].next = &lines[lines[i].idx];
+  return &lines[0];
+}
+
+/* Follows LOADS links from P and returns where it ends up, so
+   that the compiler cannot drop the loads. */
+static struct line *
+chase (struct line *p, int loads)
+{
+  while (loads-- > 0)
+    p = p->next;
+  return p;
+}
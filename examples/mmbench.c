@@ -0,0 +1,113 @@
+/* mmbench.c
+
+   Measures the CPU and the caches with matrix multiplication.
+   Usage:
+
+     mmbench [N [BLOCK]]
+
+   Multiplies two N x N matrices of ints (default 128) a BLOCK x
+   BLOCK tile at a time (default 32), so that the tiles in use
+   stay in the cache, or with the plain triple loop if BLOCK is 0.
+   Checks the product, then prints the time taken in CPU cycles
+   and the operand bytes read per second, counting the two ints
+   that each of the N**3 multiply-adds reads.  Comparing BLOCK 0
+   with a few tile sizes shows what the cache is worth. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <tsc.h>
+
+/* Largest N: three matrices of 1 MB each. */
+#define MAX_DIM 512
+
+static int a[MAX_DIM * MAX_DIM];
+static int b[MAX_DIM * MAX_DIM];
+static int c[MAX_DIM * MAX_DIM];
+
+static void multiply (int n, int block);
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long long start, now, ns, bytes;
+  uint64_t cycles;
+  int n = 128, block = 32;
+  int i, j;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+  if (argc > 2)
+    block = atoi (argv[2]);
+  if (argc > 3 || n < 1 || n > MAX_DIM || block < 0)
+    {
+      printf ("usage: mmbench [N [BLOCK]], with N from 1 to %d\n",
+              MAX_DIM);
+      return EXIT_FAILURE;
+    }
+  if (block == 0 || block > n)
+    block = n;
+
+  /* With A[i][k] = i and B[k][j] = j, C[i][j] = n * i * j. */
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      {
+        a[i * n + j] = i;
+        b[i * n + j] = j;
+        c[i * n + j] = 0;
+      }
+
+  uptime (&start);
+  cycles = tsc_read ();
+  multiply (n, block);
+  cycles = tsc_read () - cycles;
+  uptime (&now);
+
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      if (c[i * n + j] != n * i * j)
+        {
+          printf ("mmbench: wrong product at [%d][%d]\n", i, j);
+          return EXIT_FAILURE;
+        }
+
+  ns = now - start;
+  if (ns == 0)
+    ns = 1;
+  bytes = 2ULL * sizeof *a * n * n * n;
+  printf ("mmbench: n=%d block=%d cycles=%llu us=%llu "
+          "bytes_per_sec=%llu\n",
+          n, block, cycles, ns / 1000, bytes * 1000000000ULL / ns);
+  return EXIT_SUCCESS;
+}
+
+/* Adds A times B to C, for N x N matrices, working through tiles
+   of BLOCK rows and columns.  The innermost loop runs along a row
+   of B and of C, which are consecutive in memory. */
+static void
+multiply (int n, int block)
+{
+  int ii, jj, kk;
+
+  for (ii = 0; ii < n; ii += block)
+    for (kk = 0; kk < n; kk += block)
+      for (jj = 0; jj < n; jj += block)
+        {
+          int i_end = ii + block < n ? ii + block : n;
+          int k_end = kk + block < n ? kk + block : n;
+          int j_end = jj + block < n ? jj + block : n;
+          int i, j, k;
+
+          for (i = ii; i < i_end; i++)
+            for (k = kk; k < k_end; k++)
+              {
+                int x = a[i * n + k];
+                const int *brow = &b[k * n];
+                int *crow = &c[i * n];
+
+                for (j = jj; j < j_end; j++)
+                  crow[j] += x * brow[j];
+              }
+        }
+}
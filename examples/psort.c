@@ -0,0 +1,201 @@
+/* psort.c
+
+   Sorts in parallel processes.  Usage:
+
+     psort [CHUNKS [KB]]
+
+   Fills CHUNKS chunks of KB kilobytes each (defaults 8 and 128)
+   with random bytes and writes each to a file of its own.  Then
+   starts one child process per chunk, all at once, each sorting
+   its file in place by counting sort, waits for them, reads the
+   sorted chunks back and merges them.  Checks that the result is
+   sorted and holds the same bytes, and prints the time from the
+   first child's start to the end of the merge in CPU cycles and
+   the bytes sorted per second.  This is tests/vm/parallel-merge
+   as a benchmark. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <tsc.h>
+
+#define MAX_CHUNKS 16
+
+/* Largest amount of data: 2 MB. */
+#define MAX_KB 2048
+#define MAX_DATA (MAX_KB * 1024)
+
+static unsigned char data[MAX_DATA], sorted[MAX_DATA];
+static size_t histogram[256];
+
+static int sort_file (const char *file);
+static bool write_chunk (const char *file, const void *, size_t);
+static void merge (int chunk_cnt, size_t chunk_size);
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long long start, now, ns;
+  pid_t children[MAX_CHUNKS];
+  int chunk_cnt = 8, kb = 128;
+  size_t chunk_size, size, i;
+  uint64_t cycles;
+  int c;
+
+  /* A child, run as "psort child FILE". */
+  if (argc == 3 && !strcmp (argv[1], "child"))
+    return sort_file (argv[2]);
+
+  if (argc > 1)
+    chunk_cnt = atoi (argv[1]);
+  if (argc > 2)
+    kb = atoi (argv[2]);
+  if (argc > 3 || chunk_cnt < 1 || chunk_cnt > MAX_CHUNKS || kb < 1
+      || chunk_cnt * kb > MAX_KB)
+    {
+      printf ("usage: psort [CHUNKS [KB]], with up to %d chunks "
+              "and %d kB in all\n", MAX_CHUNKS, MAX_KB);
+      return EXIT_FAILURE;
+    }
+  chunk_size = kb * 1024;
+  size = chunk_cnt * chunk_size;
+
+  random_init (0);
+  random_bytes (data, size);
+  for (i = 0; i < size; i++)
+    histogram[data[i]]++;
+  for (c = 0; c < chunk_cnt; c++)
+    {
+      char file[16];
+
+      snprintf (file, sizeof file, "psort%d", c);
+      if (!write_chunk (file, data + c * chunk_size, chunk_size))
+        {
+          printf ("psort: %s: write failed\n", file);
+          return EXIT_FAILURE;
+        }
+    }
+
+  uptime (&start);
+  cycles = tsc_read ();
+  for (c = 0; c < chunk_cnt; c++)
+    {
+      char cmd[32];
+
+      snprintf (cmd, sizeof cmd, "psort child psort%d", c);
+      children[c] = exec (cmd);
+    }
+  for (c = 0; c < chunk_cnt; c++)
+    {
+      char file[16];
+      int fd;
+
+      snprintf (file, sizeof file, "psort%d", c);
+      if (children[c] == PID_ERROR || wait (children[c]) != 0
+          || (fd = open (file)) < 0)
+        {
+          printf ("psort: sorting %s failed\n", file);
+          return EXIT_FAILURE;
+        }
+      read (fd, data + c * chunk_size, chunk_size);
+      close (fd);
+      remove (file);
+    }
+  merge (chunk_cnt, chunk_size);
+  cycles = tsc_read () - cycles;
+  uptime (&now);
+
+  /* Verify against the histogram of the unsorted data. */
+  for (c = i = 0; c < 256; c++)
+    while (histogram[c]-- > 0)
+      if (sorted[i++] != c)
+        {
+          printf ("psort: byte %zu is out of order\n", i - 1);
+          return EXIT_FAILURE;
+        }
+
+  ns = now - start > 0 ? now - start : 1;
+  printf ("psort: chunks=%d kb=%d cycles=%llu us=%llu "
+          "bytes_per_sec=%llu\n",
+          chunk_cnt, kb, cycles, ns / 1000,
+          (unsigned long long) size * 1000000000ULL / ns);
+  return EXIT_SUCCESS;
+}
+
+/* Sorts the bytes of FILE in place, by counting sort, for a
+   child process.  Returns its exit status. */
+static int
+sort_file (const char *file)
+{
+  static size_t counts[256];
+  unsigned char *p;
+  int fd, size;
+  size_t i;
+
+  fd = open (file);
+  if (fd < 0)
+    return EXIT_FAILURE;
+  size = read (fd, data, MAX_DATA);
+  for (i = 0; i < (size_t) size; i++)
+    counts[data[i]]++;
+  for (p = data, i = 0; i < 256; i++)
+    {
+      memset (p, i, counts[i]);
+      p += counts[i];
+    }
+  seek (fd, 0);
+  write (fd, data, size);
+  close (fd);
+  return EXIT_SUCCESS;
+}
+
+/* Creates FILE holding the SIZE bytes at DATA.  Returns true if
+   successful. */
+static bool
+write_chunk (const char *file, const void *data, size_t size)
+{
+  bool ok;
+  int fd;
+
+  if (!create (file, 0) || (fd = open (file)) < 0)
+    return false;
+  ok = write (fd, data, size) == (int) size;
+  close (fd);
+  return ok;
+}
+
+/* Merges the CHUNK_CNT sorted chunks of CHUNK_SIZE bytes in DATA
+   into SORTED. */
+static void
+merge (int chunk_cnt, size_t chunk_size)
+{
+  unsigned char *mp[MAX_CHUNKS], *end[MAX_CHUNKS];
+  unsigned char *op = sorted;
+  int left = chunk_cnt;
+  int c;
+
+  for (c = 0; c < chunk_cnt; c++)
+    {
+      mp[c] = data + c * chunk_size;
+      end[c] = mp[c] + chunk_size;
+    }
+  while (left > 0)
+    {
+      /* Take the smallest byte; drop a chunk once it is used up. */
+      int min = 0;
+
+      for (c = 1; c < left; c++)
+        if (*mp[c] < *mp[min])
+          min = c;
+      *op++ = *mp[min]++;
+      if (mp[min] == end[min])
+        {
+          left--;
+          mp[min] = mp[left];
+          end[min] = end[left];
+        }
+    }
+}
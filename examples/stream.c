@@ -0,0 +1,134 @@
+/* stream.c
+
+   Measures memory bandwidth with the four kernels of McCalpin's
+   STREAM benchmark.  Usage:
+
+     stream [KB [PASSES]]
+
+   Runs copy (c = a), scale (b = 3c), add (c = a + b) and triad
+   (a = b + 3c) over three arrays of KB kilobytes each (default
+   1024), PASSES times each (default 10), and prints for each
+   kernel its best pass in CPU cycles and in bytes moved per
+   second.  Bytes are counted as STREAM counts them: two arrays'
+   worth for copy and scale, three for add and triad.  The arrays
+   hold 32-bit integers rather than doubles, since user programs
+   are built with -msoft-float.  Arrays much bigger than the CPU
+   caches give the bandwidth of main memory. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <tsc.h>
+
+/* Largest array: 2 MB, so 6 MB in all. */
+#define MAX_KB 2048
+#define MAX_ELEMS (MAX_KB * 1024 / sizeof (int32_t))
+
+static int32_t a[MAX_ELEMS], b[MAX_ELEMS], c[MAX_ELEMS];
+
+/* The kernels. */
+enum kernel
+  {
+    COPY, SCALE, ADD, TRIAD,
+    KERNEL_CNT
+  };
+
+static const char *names[KERNEL_CNT] = {"copy", "scale", "add", "triad"};
+static const int arrays[KERNEL_CNT] = {2, 2, 3, 3};
+
+static void run (enum kernel, size_t n);
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long long best_ns[KERNEL_CNT];
+  uint64_t best_cycles[KERNEL_CNT];
+  int kb = 1024, pass_cnt = 10;
+  size_t n, i;
+  int k, pass;
+
+  if (argc > 1)
+    kb = atoi (argv[1]);
+  if (argc > 2)
+    pass_cnt = atoi (argv[2]);
+  if (argc > 3 || kb < 1 || kb > MAX_KB || pass_cnt < 1)
+    {
+      printf ("usage: stream [KB [PASSES]], with KB from 1 to %d\n",
+              MAX_KB);
+      return EXIT_FAILURE;
+    }
+  n = kb * 1024 / sizeof (int32_t);
+
+  /* Touch every page before timing anything. */
+  for (i = 0; i < n; i++)
+    {
+      a[i] = 1;
+      b[i] = 2;
+      c[i] = 0;
+    }
+
+  for (k = 0; k < KERNEL_CNT; k++)
+    {
+      best_ns[k] = ~0ULL;
+      best_cycles[k] = ~0ULL;
+    }
+  for (pass = 0; pass < pass_cnt; pass++)
+    for (k = 0; k < KERNEL_CNT; k++)
+      {
+        unsigned long long start, now;
+        uint64_t cycles;
+
+        uptime (&start);
+        cycles = tsc_read ();
+        run (k, n);
+        cycles = tsc_read () - cycles;
+        uptime (&now);
+        if (now - start < best_ns[k])
+          best_ns[k] = now - start;
+        if (cycles < best_cycles[k])
+          best_cycles[k] = cycles;
+      }
+
+  for (k = 0; k < KERNEL_CNT; k++)
+    {
+      unsigned long long bytes = (unsigned long long) arrays[k] * kb * 1024;
+      unsigned long long ns = best_ns[k] > 0 ? best_ns[k] : 1;
+
+      printf ("stream: %s kb=%d passes=%d cycles=%llu us=%llu "
+              "bytes_per_sec=%llu\n",
+              names[k], kb, pass_cnt, best_cycles[k], ns / 1000,
+              bytes * 1000000000ULL / ns);
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Runs KERNEL once over the first N elements of each array. */
+static void
+run (enum kernel kernel, size_t n)
+{
+  const int32_t scalar = 3;
+  size_t i;
+
+  switch (kernel)
+    {
+    case COPY:
+      for (i = 0; i < n; i++)
+        c[i] = a[i];
+      break;
+    case SCALE:
+      for (i = 0; i < n; i++)
+        b[i] = scalar * c[i];
+      break;
+    case ADD:
+      for (i = 0; i < n; i++)
+        c[i] = a[i] + b[i];
+      break;
+    case TRIAD:
+      for (i = 0; i < n; i++)
+        a[i] = b[i] + scalar * c[i];
+      break;
+    default:
+      break;
+    }
+}
@@ -0,0 +1,128 @@
+/* sysbench.c
+
+   Measures system call round trips.  Usage:
+
+     sysbench [ITERATIONS]
+
+   Times ITERATIONS (default 1000) calls each of tell(), a 1-byte
+   write to the console, a 4 kB read of a cached file, open() and
+   close() of a file, and, a tenth as often, exec() and wait() of
+   a child that exits at once.  For each it prints the minimum,
+   median and 99th percentile in CPU cycles, read with rdtsc. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <tsc.h>
+
+#define MAX_ITERATIONS 10000
+
+static uint64_t samples[MAX_ITERATIONS];
+static char buf[4096];
+
+static void report (const char *what, int cnt);
+static int compare_samples (const void *, const void *);
+
+int
+main (int argc, char *argv[])
+{
+  int cnt = 1000;
+  int fd, i;
+
+  /* The child for exec(). */
+  if (argc == 2 && !strcmp (argv[1], "child"))
+    return EXIT_SUCCESS;
+
+  if (argc > 1)
+    cnt = atoi (argv[1]);
+  if (cnt < 10 || cnt > MAX_ITERATIONS)
+    {
+      printf ("usage: sysbench [ITERATIONS], with 10 to %d iterations\n",
+              MAX_ITERATIONS);
+      return EXIT_FAILURE;
+    }
+
+  /* A file to read, which the first read brings into the cache. */
+  if (!create ("sysbench.dat", sizeof buf))
+    {
+      printf ("sysbench.dat: create failed\n");
+      return EXIT_FAILURE;
+    }
+  fd = open ("sysbench.dat");
+  if (fd < 0)
+    {
+      printf ("sysbench.dat: open failed\n");
+      return EXIT_FAILURE;
+    }
+  pread (fd, buf, sizeof buf, 0);
+
+  /* About the cheapest call there is.  (tell() on a bad fd would
+     kill the process here.) */
+  for (i = 0; i < cnt; i++)
+    {
+      uint64_t start = tsc_read ();
+      tell (fd);
+      samples[i] = tsc_read () - start;
+    }
+  report ("tell", cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      uint64_t start = tsc_read ();
+      write (STDOUT_FILENO, ".", 1);
+      samples[i] = tsc_read () - start;
+    }
+  printf ("\n");
+  report ("write-console-1", cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      uint64_t start = tsc_read ();
+      pread (fd, buf, sizeof buf, 0);
+      samples[i] = tsc_read () - start;
+    }
+  report ("read-cached-4096", cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      uint64_t start = tsc_read ();
+      close (open ("sysbench.dat"));
+      samples[i] = tsc_read () - start;
+    }
+  report ("open-close", cnt);
+
+  for (i = 0; i < cnt / 10; i++)
+    {
+      uint64_t start = tsc_read ();
+      wait (exec ("sysbench child"));
+      samples[i] = tsc_read () - start;
+    }
+  report ("exec-wait", cnt / 10);
+
+  close (fd);
+  remove ("sysbench.dat");
+  return EXIT_SUCCESS;
+}
+
+/* Prints the minimum, median and 99th percentile of the first
+   CNT samples, which time calls of WHAT. */
+static void
+report (const char *what, int cnt)
+{
+  qsort (samples, cnt, sizeof *samples, compare_samples);
+  printf ("sysbench: %s n=%d min=%llu median=%llu p99=%llu cycles\n",
+          what, cnt, samples[0], samples[cnt / 2],
+          samples[cnt - 1 - cnt / 100]);
+}
+
+/* Orders uint64_t samples A and B. */
+static int
+compare_samples (const void *a_, const void *b_)
+{
+  const uint64_t *a = a_;
+  const uint64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
@@ -0,0 +1,115 @@
+/* top.c
+
+   Watches the system while it runs.  Usage:
+
+     top [INTERVAL-MS [COUNT]]
+
+   Samples the kernel's statistics with kstat() every INTERVAL-MS
+   milliseconds (default 1000), COUNT times (default 10), and
+   prints one line per interval: where the CPU time went, context
+   switches and contended lock acquisitions per second, page
+   faults and file system sectors moved per second, the buffer
+   cache hit rate, and the user pages still free.  Run it in the
+   background with the shell's `&' to watch another job. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Lines between repeated headers. */
+#define HEADER_EVERY 20
+
+static void print_header (void);
+static void print_sample (const struct kstat *old, const struct kstat *new);
+static unsigned long long per_sec (unsigned long long delta,
+                                   unsigned long long ns);
+static unsigned percent (unsigned long long part, unsigned long long whole);
+
+int
+main (int argc, char *argv[])
+{
+  struct kstat samples[2];
+  int interval = 1000;
+  int count = 10;
+  int i;
+
+  if (argc > 1)
+    interval = atoi (argv[1]);
+  if (argc > 2)
+    count = atoi (argv[2]);
+  if (argc > 3 || interval <= 0 || count <= 0)
+    {
+      printf ("usage: top [INTERVAL-MS [COUNT]]\n");
+      return EXIT_FAILURE;
+    }
+
+  kstat (&samples[0]);
+  if (samples[0].version != KSTAT_VERSION)
+    printf ("top: kernel statistics are version %u, expected %d\n",
+            samples[0].version, KSTAT_VERSION);
+
+  for (i = 0; i < count; i++)
+    {
+      struct kstat *old = &samples[i % 2];
+      struct kstat *new = &samples[(i + 1) % 2];
+
+      /* Sleep by waiting on no descriptors. */
+      poll (NULL, 0, interval);
+      kstat (new);
+      if (i % HEADER_EVERY == 0)
+        print_header ();
+      print_sample (old, new);
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Prints the column headings. */
+static void
+print_header (void)
+{
+  printf ("idle kern user  csw/s lock/s  flt/s  rd/s  wr/s hit%% "
+          "dirty  free\n");
+}
+
+/* Prints the changes from OLD to NEW as one line. */
+static void
+print_sample (const struct kstat *old, const struct kstat *new)
+{
+  unsigned long long ns = new->uptime_ns - old->uptime_ns;
+  unsigned long long idle = new->idle_ticks - old->idle_ticks;
+  unsigned long long kernel = new->kernel_ticks - old->kernel_ticks;
+  unsigned long long user = new->user_ticks - old->user_ticks;
+  unsigned long long ticks = idle + kernel + user;
+  unsigned long long switches
+    = (new->voluntary_switches + new->involuntary_switches
+       - old->voluntary_switches - old->involuntary_switches);
+  unsigned long long hits = new->cache_hits - old->cache_hits;
+  unsigned long long misses = new->cache_misses - old->cache_misses;
+
+  printf ("%3u%% %3u%% %3u%% %6llu %6llu %6llu %5llu %5llu %3u%% "
+          "%5u %5u\n",
+          percent (idle, ticks), percent (kernel, ticks),
+          percent (user, ticks),
+          per_sec (switches, ns),
+          per_sec (new->lock_contentions - old->lock_contentions, ns),
+          per_sec (new->page_faults - old->page_faults, ns),
+          per_sec (new->disk_read_sectors - old->disk_read_sectors, ns),
+          per_sec (new->disk_write_sectors - old->disk_write_sectors, ns),
+          percent (hits, hits + misses),
+          new->cache_dirty, new->free_user_pages);
+}
+
+/* Returns DELTA events over NS nanoseconds as a rate per
+   second. */
+static unsigned long long
+per_sec (unsigned long long delta, unsigned long long ns)
+{
+  return ns > 0 ? delta * 1000000000ULL / ns : 0;
+}
+
+/* Returns PART as a percentage of WHOLE, or 0 if WHOLE is 0. */
+static unsigned
+percent (unsigned long long part, unsigned long long whole)
+{
+  return whole > 0 ? part * 100 / whole : 0;
+}
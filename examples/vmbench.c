@@ -0,0 +1,83 @@
+/* vmbench.c
+
+   Measures paging.  Usage:
+
+     vmbench PAGES [PASSES] [seq|rand]
+
+   Writes to every page of a PAGES-page working set once, then
+   reads and writes pages of it PASSES more times (default 4),
+   in order or at random, and prints the page faults, evictions
+   and swap traffic this process caused, and its estimated
+   working set at the end, along with the time it took.  Run it under the VM kernel with -ul set below PAGES to
+   watch the working set stop fitting in memory;
+   utils/vm-sweep does that over a range of sizes. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define PAGE_SIZE 4096
+
+/* Largest working set, in pages: 8 MB. */
+#define MAX_PAGES 2048
+
+static char pages[MAX_PAGES][PAGE_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long long start, now, us;
+  struct vmstat st;
+  unsigned faults, ops;
+  bool rand = false;
+  int page_cnt, pass_cnt = 4;
+  int pass, i;
+
+  if (argc < 2 || argc > 4)
+    {
+      printf ("usage: vmbench PAGES [PASSES] [seq|rand]\n");
+      return EXIT_FAILURE;
+    }
+  page_cnt = atoi (argv[1]);
+  if (argc > 2)
+    pass_cnt = atoi (argv[2]);
+  if (argc > 3)
+    rand = !strcmp (argv[3], "rand");
+  if (page_cnt < 1 || page_cnt > MAX_PAGES || pass_cnt < 0)
+    {
+      printf ("vmbench: PAGES must be between 1 and %d\n", MAX_PAGES);
+      return EXIT_FAILURE;
+    }
+
+  uptime (&start);
+  for (i = 0; i < page_cnt; i++)
+    pages[i][0] = i;
+  random_init (0);
+  for (pass = 0; pass < pass_cnt; pass++)
+    for (i = 0; i < page_cnt; i++)
+      {
+        int p = rand ? (int) (random_ulong () % page_cnt) : i;
+        pages[p][PAGE_SIZE / 2] = pages[p][0] + pass;
+      }
+  uptime (&now);
+  vmstat (&st);
+
+  us = (now - start) / 1000;
+  if (us == 0)
+    us = 1;
+  ops = page_cnt * (pass_cnt + 1);
+  for (faults = 0, i = 0; i < VMSTAT_CLASS_CNT; i++)
+    faults += st.faults[i];
+
+  printf ("vmbench: pages=%d passes=%d order=%s touches=%u us=%llu "
+          "faults=%u swap_faults=%u evictions=%u "
+          "swap_in_sectors=%u swap_out_sectors=%u working_set=%u "
+          "faults_per_sec=%llu\n",
+          page_cnt, pass_cnt, rand ? "rand" : "seq", ops, us,
+          faults, st.faults[VMSTAT_SWAP], st.evictions,
+          st.swap_in_sectors, st.swap_out_sectors, st.working_set,
+          faults * 1000000ULL / us);
+  return EXIT_SUCCESS;
+}
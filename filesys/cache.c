@@ -0,0 +1,856 @@
+#include <debug.h>
+#include <kstat.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The write-behind flusher wakes up this often, in timer ticks,
+ * and also as soon as CACHE_DIRTY_MAX entries are dirty. */
+#define FLUSH_PERIOD TIMER_FREQ
+#define CACHE_DIRTY_MAX (CACHE_SIZE / 2)
+
+/* Maximum number of sectors waiting for the read-ahead thread.
+ * Requests beyond this are dropped. */
+#define RA_QUEUE_SIZE 32
+
+/* Most consecutive sectors that cache_flush_range() writes back
+ * in one request. */
+#define FLUSH_RUN_MAX (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Replacement is 2Q.  A sector enters the cache cold, on a FIFO
+ * queue, and becomes hot only if it is used again before it
+ * reaches the front, so that a scan that touches each sector
+ * once cycles through the cold queue without disturbing the hot
+ * entries.  Hot entries are kept by the clock: the hand demotes
+ * one that has gone unused since it last passed to the back of
+ * the cold queue, whenever fewer than COLD_MIN entries are cold.
+ * Metadata skips the cold queue and enters hot; data read by a
+ * streaming file enters at the front of the cold queue, first to
+ * go, and is never promoted. */
+#define COLD_MIN (CACHE_SIZE / 4)
+
+/* Marks a cache entry that holds no sector. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* A cached sector.
+ *
+ * SECTOR, FLUSHING, USERS and HOT, the cold queue, and the
+ * position of the clock hand, are protected by cache_lock.
+ * DATA, VALID and DIRTY, and the right to do I/O on the entry,
+ * are protected by LOCK.  ACCESSED is only a hint to replacement
+ * and is set without cache_lock.  HELD is changed only under LOCK while the entry
+ * is pinned; a held entry belongs to the journal's running
+ * transaction and is neither written back nor evicted until the
+ * journal commits it.  An entry whose
+ * USERS count is nonzero is pinned and is never chosen for
+ * eviction, so a thread that holds LOCK may rely on SECTOR not
+ * changing underneath it. */
+struct cache_entry
+{
+    block_sector_t sector;          /* Cached sector, or NO_SECTOR. */
+    block_sector_t flushing;        /* Old sector being written back. */
+    bool valid;                     /* DATA holds SECTOR's contents? */
+    bool dirty;                     /* DATA newer than disk? */
+    bool accessed;                  /* Used since the hand last passed? */
+    bool held;                      /* Logged, awaiting journal commit? */
+    bool hot;                       /* Hot, or on the cold queue? */
+    struct list_elem cold_elem;     /* Element in cold queue if cold. */
+    unsigned users;                 /* Threads using or waiting for us. */
+    struct lock lock;               /* Protects DATA. */
+    uint8_t data[BLOCK_SECTOR_SIZE]; /* Sector contents. */
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;      /* Protects mapping and metadata. */
+static struct condition cache_unpinned; /* Signaled when USERS hits 0. */
+static size_t clock_hand;           /* Next hot entry to consider. */
+static struct list cold_queue;      /* Cold entries, oldest first. */
+static size_t cold_cnt;             /* Number of cold entries. */
+static size_t dirty_cnt;            /* Number of dirty entries. */
+static struct thread *flusher;      /* Write-behind thread. */
+
+/* Sectors queued for read-ahead, as a ring buffer.  Protected by
+ * ra_lock. */
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_nonempty;
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, writeback_cnt;
+static unsigned long long readahead_cnt, uncached_cnt;
+static unsigned long long promote_cnt, demote_cnt;
+static unsigned long long direct_read_cnt, direct_write_cnt;
+static unsigned long long range_flush_cnt;
+
+static struct cache_entry *cache_get(block_sector_t, bool need_data,
+                                     enum cache_hint);
+
+static void cache_put(struct cache_entry *);
+
+static void write_at(block_sector_t, const void *, size_t ofs, size_t size,
+                     bool journal, enum cache_hint);
+
+static struct cache_entry *choose_victim(void);
+
+static bool demote(void);
+
+static void make_hot(struct cache_entry *);
+
+static void make_cold(struct cache_entry *, bool front);
+
+static void write_behind(void);
+
+static void write_run(struct cache_entry **, size_t cnt, uint8_t *buf);
+
+static bool any_cached(block_sector_t, block_sector_t cnt);
+
+static thread_func flusher_thread;
+
+static thread_func read_ahead_thread;
+
+static int sector_less(const void *, const void *, void *);
+
+/* Initializes the buffer cache. */
+void
+cache_init(void)
+{
+    size_t i;
+
+    lock_init(&cache_lock);
+    cond_init(&cache_unpinned);
+    list_init(&cold_queue);
+    cold_cnt = 0;
+    for (i = 0; i < CACHE_SIZE; i++) {
+        struct cache_entry *e = &cache[i];
+        e->sector = NO_SECTOR;
+        e->flushing = NO_SECTOR;
+        e->valid = false;
+        e->dirty = false;
+        e->accessed = false;
+        e->held = false;
+        e->hot = false;
+        e->users = 0;
+        lock_init(&e->lock);
+        make_cold(e, false);
+    }
+    clock_hand = 0;
+    dirty_cnt = 0;
+    flusher = NULL;
+
+    lock_init(&ra_lock);
+    cond_init(&ra_nonempty);
+    ra_head = ra_cnt = 0;
+
+    thread_create("flusher", PRI_DEFAULT, flusher_thread, NULL);
+    thread_create("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+ * BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read(block_sector_t sector, void *buffer)
+{
+    cache_read_at(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within sector
+ * SECTOR into BUFFER.  The sector holds metadata. */
+void
+cache_read_at(block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+    cache_read_hint(sector, buffer, ofs, size, CACHE_META);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within sector
+ * SECTOR into BUFFER, with HINT saying what the sector holds. */
+void
+cache_read_hint(block_sector_t sector, void *buffer, size_t ofs,
+                size_t size, enum cache_hint hint)
+{
+    struct cache_entry *e;
+
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+    e = cache_get(sector, true, hint);
+    memcpy(buffer, e->data + ofs, size);
+    cache_put(e);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR. */
+void
+cache_write(block_sector_t sector, const void *buffer)
+{
+    cache_write_at(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within sector
+ * SECTOR.  Returns as soon as the data is in the cache; the
+ * flusher thread, or eviction, writes it to disk later.  Inside
+ * a journaled operation, the sector is logged.  The sector holds
+ * metadata. */
+void
+cache_write_at(block_sector_t sector, const void *buffer,
+               size_t ofs, size_t size)
+{
+    write_at(sector, buffer, ofs, size, true, CACHE_META);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within sector
+ * SECTOR, like cache_write_at(), with HINT saying what the
+ * sector holds. */
+void
+cache_write_hint(block_sector_t sector, const void *buffer,
+                 size_t ofs, size_t size, enum cache_hint hint)
+{
+    write_at(sector, buffer, ofs, size, true, hint);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR.
+ * Unlike cache_write(), never logs the sector, because it is
+ * meant for newly allocated file data, which the journal does
+ * not cover. */
+void
+cache_write_data(block_sector_t sector, const void *buffer)
+{
+    write_at(sector, buffer, 0, BLOCK_SECTOR_SIZE, false, CACHE_DATA);
+}
+
+/* Fills SECTOR with zeros, without reading it first.  Like
+ * cache_write_data(), never logs the sector. */
+void
+cache_zero(block_sector_t sector)
+{
+    static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+    cache_write_data(sector, zeros);
+}
+
+/* Writes SECTOR in place if it is dirty and releases the hold
+ * that the journal has had on it since it was logged.  Called by
+ * the journal once the sector's logged copy is committed. */
+void
+cache_checkpoint(block_sector_t sector)
+{
+    struct cache_entry *e = cache_get(sector, true, CACHE_META);
+
+    ASSERT(e->held);
+    if (e->dirty) {
+        block_write(fs_device, sector, e->data);
+        e->dirty = false;
+        lock_acquire(&cache_lock);
+        dirty_cnt--;
+        writeback_cnt++;
+        lock_release(&cache_lock);
+    }
+    e->held = false;
+    cache_put(e);
+}
+
+/* Writes SIZE bytes from BUFFER to byte offset OFS within sector
+ * SECTOR, logging the sector if JOURNAL is true and the running
+ * thread is inside a journaled operation.  HINT says what the
+ * sector holds. */
+static void
+write_at(block_sector_t sector, const void *buffer, size_t ofs, size_t size,
+         bool journal, enum cache_hint hint)
+{
+    struct cache_entry *e;
+
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+    /* A whole-sector write need not read the old contents. */
+    e = cache_get(sector, size < BLOCK_SECTOR_SIZE, hint);
+    memcpy(e->data + ofs, buffer, size);
+    e->valid = true;
+    if (journal && !e->held && journal_active()) {
+        e->held = journal_add(sector);
+    }
+    if (!e->dirty) {
+        e->dirty = true;
+        lock_acquire(&cache_lock);
+        if (++dirty_cnt >= CACHE_DIRTY_MAX && flusher != NULL) {
+            timer_wake(flusher);
+        }
+        lock_release(&cache_lock);
+    }
+    cache_put(e);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+ * BLOCK_SECTOR_SIZE bytes, like cache_read(), except that a
+ * sector not in the cache is read straight from disk without
+ * taking an entry for it.  For data that the caller keeps in
+ * memory itself, such as a file page in a frame, so that it is
+ * not held twice and does not push metadata out of the cache. */
+void
+cache_read_uncached(block_sector_t sector, void *buffer)
+{
+    bool cached = false;
+    size_t i;
+
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].sector == sector || cache[i].flushing == sector) {
+            cached = true;
+            break;
+        }
+    }
+    if (!cached) {
+        uncached_cnt++;
+    }
+    lock_release(&cache_lock);
+
+    if (cached) {
+        cache_read_hint(sector, buffer, 0, BLOCK_SECTOR_SIZE, CACHE_DATA);
+    } else {
+        block_read(fs_device, sector, buffer);
+    }
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER straight
+ * from disk, in one request and without a copy through the
+ * cache, for a large sequential read whose data the cache need
+ * not keep.  Returns false, having read nothing, if any of the
+ * sectors is cached, since the cache may then hold newer data
+ * than the disk. */
+bool
+cache_read_direct(block_sector_t sector, block_sector_t cnt, void *buffer)
+{
+    if (any_cached(sector, cnt)) {
+        return false;
+    }
+    block_read_multiple(fs_device, sector, cnt, buffer);
+    direct_read_cnt += cnt;
+    return true;
+}
+
+/* Writes the CNT sectors starting at SECTOR from BUFFER straight
+ * to disk, in one request, for a large write whose data the
+ * cache need not keep.  A sector that is cached, or that a reader
+ * loads while the write is in progress, is then written into the
+ * cache as well, so that the cache never holds older data than
+ * the disk and a dirty entry never overwrites the new data when
+ * it is written back.  Like cache_write_data(), never logs. */
+void
+cache_write_direct(block_sector_t sector, block_sector_t cnt,
+                   const void *buffer_)
+{
+    const uint8_t *buffer = buffer_;
+    block_sector_t i;
+
+    block_write_multiple(fs_device, sector, cnt, buffer);
+    direct_write_cnt += cnt;
+    for (i = 0; i < cnt; i++) {
+        if (any_cached(sector + i, 1)) {
+            write_at(sector + i, buffer + i * BLOCK_SECTOR_SIZE, 0,
+                     BLOCK_SECTOR_SIZE, false, CACHE_STREAM);
+        }
+    }
+}
+
+/* Queues SECTOR to be read into the cache in the background, if
+ * it is not there already.  Never blocks on I/O. */
+void
+cache_read_ahead(block_sector_t sector)
+{
+    if (cache_contains(sector)) {
+        return;
+    }
+
+    lock_acquire(&ra_lock);
+    if (ra_cnt < RA_QUEUE_SIZE) {
+        ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+        cond_signal(&ra_nonempty, &ra_lock);
+    }
+    lock_release(&ra_lock);
+}
+
+/* Writes every dirty entry back to disk, except those held for
+ * the journal. */
+void
+cache_flush(void)
+{
+    write_behind();
+}
+
+/* Writes back the dirty entries for the CNT sectors starting at
+ * SECTOR, except those held for the journal, leaving the rest of
+ * the cache alone.  Runs of consecutive dirty sectors go to disk
+ * in one request each. */
+void
+cache_flush_range(block_sector_t sector, block_sector_t cnt)
+{
+    struct cache_entry *batch[CACHE_SIZE];
+    size_t batch_cnt = 0;
+    uint8_t *buf;
+    size_t i, j;
+
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        struct cache_entry *e = &cache[i];
+        if (e->dirty && !e->held && e->sector != NO_SECTOR
+            && e->sector - sector < cnt) {
+            e->users++;
+            batch[batch_cnt++] = e;
+        }
+    }
+    lock_release(&cache_lock);
+    if (batch_cnt == 0) {
+        return;
+    }
+
+    sort(batch, batch_cnt, sizeof *batch, sector_less, NULL);
+    buf = malloc(FLUSH_RUN_MAX * BLOCK_SECTOR_SIZE);
+    for (i = 0; i < batch_cnt; i = j) {
+        for (j = i + 1; (j < batch_cnt && j - i < FLUSH_RUN_MAX
+                         && batch[j]->sector == batch[j - 1]->sector + 1);
+             j++) {
+            continue;
+        }
+        write_run(batch + i, j - i, buf);
+    }
+    free(buf);
+    range_flush_cnt++;
+}
+
+/* Returns true if SECTOR is cached and held for the journal's
+ * running transaction, that is, if it has changed in a journaled
+ * operation that is not yet committed. */
+bool
+cache_is_held(block_sector_t sector)
+{
+    bool held = false;
+    size_t i;
+
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].sector == sector) {
+            held = cache[i].held;
+            break;
+        }
+    }
+    lock_release(&cache_lock);
+    return held;
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats(void)
+{
+    printf("Buffer cache: %llu hits, %llu misses, %llu write-backs, "
+           "%llu read-aheads, %llu uncached reads\n",
+           hit_cnt, miss_cnt, writeback_cnt, readahead_cnt, uncached_cnt);
+    printf("Buffer cache: %llu promoted to hot, %llu demoted to cold\n",
+           promote_cnt, demote_cnt);
+    printf("Buffer cache: %llu sectors read and %llu written directly\n",
+           direct_read_cnt, direct_write_cnt);
+    printf("Buffer cache: %llu ranges flushed\n", range_flush_cnt);
+}
+
+/* Stores the buffer cache's counters, and its number of dirty
+ * entries, in *ST. */
+void
+cache_kstat(struct kstat *st)
+{
+    lock_acquire(&cache_lock);
+    st->cache_hits = hit_cnt;
+    st->cache_misses = miss_cnt;
+    st->cache_writebacks = writeback_cnt;
+    st->cache_readaheads = readahead_cnt;
+    st->cache_dirty = dirty_cnt;
+    lock_release(&cache_lock);
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held,
+ * loading it into the cache if necessary.  If NEED_DATA is true,
+ * the entry's data is read from disk if not already present;
+ * otherwise the caller is about to overwrite all of it.  HINT
+ * says what the sector holds, for replacement.  Must be paired
+ * with cache_put(). */
+static struct cache_entry *
+cache_get(block_sector_t sector, bool need_data, enum cache_hint hint)
+{
+    struct cache_entry *e;
+    block_sector_t old_sector;
+    bool write_back;
+    size_t i;
+
+    ASSERT(sector != NO_SECTOR);
+
+    lock_acquire(&cache_lock);
+    for (;;) {
+        /* Look for SECTOR, either cached or still being written
+         * back from an entry that was just evicted.  In the latter
+         * case, wait for the write-back and then look again, so
+         * that we never read a stale copy from disk. */
+        for (i = 0; i < CACHE_SIZE; i++) {
+            e = &cache[i];
+            if (e->sector == sector || e->flushing == sector) {
+                break;
+            }
+        }
+        if (i == CACHE_SIZE) {
+            break;
+        }
+
+        e->users++;
+        if (hint == CACHE_META && e->sector == sector && !e->hot) {
+            make_hot(e);
+        }
+        lock_release(&cache_lock);
+        lock_acquire(&e->lock);
+        if (e->sector == sector) {
+            if (!e->valid && need_data) {
+                block_read(fs_device, sector, e->data);
+                e->valid = true;
+            }
+            /* A streaming read is not a reason to keep data. */
+            if (hint != CACHE_STREAM) {
+                e->accessed = true;
+            }
+            hit_cnt++;
+            return e;
+        }
+        cache_put(e);
+        lock_acquire(&cache_lock);
+    }
+
+    /* Miss.  Claim a victim while still holding cache_lock.  Its
+     * lock is free, because a holder would have pinned it. */
+    e = choose_victim();
+    e->users = 1;
+    lock_acquire(&e->lock);
+    old_sector = e->sector;
+    write_back = e->valid && e->dirty;
+    e->flushing = write_back ? old_sector : NO_SECTOR;
+    if (write_back) {
+        dirty_cnt--;
+    }
+    e->sector = sector;
+    e->valid = false;
+    e->dirty = false;
+    e->accessed = false;
+    if (hint == CACHE_META) {
+        e->hot = true;
+    } else {
+        make_cold(e, hint == CACHE_STREAM);
+    }
+    miss_cnt++;
+    lock_release(&cache_lock);
+
+    if (write_back) {
+        block_write(fs_device, old_sector, e->data);
+        lock_acquire(&cache_lock);
+        e->flushing = NO_SECTOR;
+        writeback_cnt++;
+        lock_release(&cache_lock);
+    }
+    if (need_data) {
+        block_read(fs_device, sector, e->data);
+        e->valid = true;
+    }
+    return e;
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put(struct cache_entry *e)
+{
+    lock_release(&e->lock);
+
+    lock_acquire(&cache_lock);
+    ASSERT(e->users > 0);
+    if (--e->users == 0) {
+        cond_broadcast(&cache_unpinned, &cache_lock);
+    }
+    lock_release(&cache_lock);
+}
+
+/* Picks an unpinned entry to evict, waiting for one to become
+ * unpinned if necessary, and takes it off the cold queue; the
+ * caller decides where it goes next.  Cache_lock must be held.
+ *
+ * The victim is the oldest cold entry that was not used again
+ * while cold.  One that was is promoted instead.  Hot entries
+ * are demoted first to keep COLD_MIN entries cold, and then as
+ * needed should every cold entry be in use. */
+static struct cache_entry *
+choose_victim(void)
+{
+    ASSERT(lock_held_by_current_thread(&cache_lock));
+
+    while (cold_cnt < COLD_MIN && demote()) {
+        continue;
+    }
+    for (;;) {
+        struct list_elem *el = list_begin(&cold_queue);
+
+        while (el != list_end(&cold_queue)) {
+            struct cache_entry *e = list_entry(el, struct cache_entry,
+                                               cold_elem);
+
+            el = list_next(el);
+            if (e->users > 0 || e->held) {
+                continue;
+            }
+            if (e->accessed && e->sector != NO_SECTOR) {
+                e->accessed = false;
+                make_hot(e);
+                promote_cnt++;
+                continue;
+            }
+            list_remove(&e->cold_elem);
+            cold_cnt--;
+            return e;
+        }
+        if (!demote()) {
+            cond_wait(&cache_unpinned, &cache_lock);
+        }
+    }
+}
+
+/* Advances the clock hand over the hot entries until one that
+ * is not in use has gone unused since the hand last passed it,
+ * and moves it to the back of the cold queue.  Two sweeps are
+ * enough: the first clears every accessed bit in the way.
+ * Returns true if an entry was demoted. */
+static bool
+demote(void)
+{
+    size_t scanned;
+
+    for (scanned = 0; scanned < 2 * CACHE_SIZE; scanned++) {
+        struct cache_entry *e = &cache[clock_hand];
+        clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+        if (!e->hot || e->users > 0 || e->held) {
+            continue;
+        }
+        if (e->accessed) {
+            e->accessed = false;
+            continue;
+        }
+        make_cold(e, false);
+        demote_cnt++;
+        return true;
+    }
+    return false;
+}
+
+/* Takes cold entry E off the cold queue and makes it hot. */
+static void
+make_hot(struct cache_entry *e)
+{
+    ASSERT(!e->hot);
+    list_remove(&e->cold_elem);
+    cold_cnt--;
+    e->hot = true;
+}
+
+/* Makes E cold, putting it at the front of the cold queue if
+ * FRONT is true, to be evicted first, otherwise at the back.  E
+ * must be hot or on no queue at all, as is a victim. */
+static void
+make_cold(struct cache_entry *e, bool front)
+{
+    e->hot = false;
+    if (front) {
+        list_push_front(&cold_queue, &e->cold_elem);
+    } else {
+        list_push_back(&cold_queue, &e->cold_elem);
+    }
+    cold_cnt++;
+}
+
+/* Writes all dirty entries that the journal does not hold back
+ * to disk in ascending sector order, so that the disk sees one
+ * sweep instead of scattered seeks. */
+static void
+write_behind(void)
+{
+    struct cache_entry *batch[CACHE_SIZE];
+    size_t batch_cnt = 0;
+    size_t i;
+
+    /* Pin every dirty entry so none can be evicted before we get
+     * to it. */
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        struct cache_entry *e = &cache[i];
+        if (e->dirty && !e->held) {
+            e->users++;
+            batch[batch_cnt++] = e;
+        }
+    }
+    lock_release(&cache_lock);
+
+    sort(batch, batch_cnt, sizeof *batch, sector_less, NULL);
+
+    for (i = 0; i < batch_cnt; i++) {
+        struct cache_entry *e = batch[i];
+
+        lock_acquire(&e->lock);
+        if (e->dirty && !e->held) {
+            block_write(fs_device, e->sector, e->data);
+            e->dirty = false;
+            lock_acquire(&cache_lock);
+            dirty_cnt--;
+            writeback_cnt++;
+            lock_release(&cache_lock);
+        }
+        cache_put(e);
+    }
+}
+
+/* Writes back the CNT entries in RUN, which cache_flush_range()
+ * pinned and which hold consecutive sectors, and unpins them.
+ * Copies them into BUF, which has room for FLUSH_RUN_MAX sectors,
+ * to write them in one request, unless BUF is null or an entry
+ * has since been held for the journal, in which case each is
+ * written by itself. */
+static void
+write_run(struct cache_entry **run, size_t cnt, uint8_t *buf)
+{
+    bool together = buf != NULL && cnt > 1;
+    size_t written = 0;
+    size_t i;
+
+    for (i = 0; i < cnt; i++) {
+        lock_acquire(&run[i]->lock);
+        if (run[i]->held) {
+            together = false;
+        }
+    }
+
+    if (together) {
+        for (i = 0; i < cnt; i++) {
+            memcpy(buf + i * BLOCK_SECTOR_SIZE, run[i]->data,
+                   BLOCK_SECTOR_SIZE);
+        }
+        block_write_multiple(fs_device, run[0]->sector, cnt, buf);
+    }
+    for (i = 0; i < cnt; i++) {
+        struct cache_entry *e = run[i];
+
+        if (e->dirty && !e->held) {
+            if (!together) {
+                block_write(fs_device, e->sector, e->data);
+            }
+            e->dirty = false;
+            written++;
+        }
+    }
+
+    lock_acquire(&cache_lock);
+    dirty_cnt -= written;
+    writeback_cnt += written;
+    lock_release(&cache_lock);
+    for (i = 0; i < cnt; i++) {
+        cache_put(run[i]);
+    }
+}
+
+/* Write-behind thread.  Wakes up every FLUSH_PERIOD ticks, or
+ * early when cache_write_at() finds too many dirty entries,
+ * allocates sectors for delayed file data, commits the journal
+ * and writes the dirty entries back, all as idle class I/O. */
+static void
+flusher_thread(void *aux UNUSED)
+{
+    flusher = thread_current();
+    block_set_idle(true);
+    for (;;) {
+        timer_sleep(FLUSH_PERIOD);
+        inode_allocate_delayed();
+        journal_commit();
+        write_behind();
+    }
+}
+
+/* Read-ahead thread.  Loads the sectors queued by
+ * cache_read_ahead() into the cache, one at a time, as idle class
+ * I/O. */
+static void
+read_ahead_thread(void *aux UNUSED)
+{
+    block_set_idle(true);
+    for (;;) {
+        block_sector_t sector;
+
+        lock_acquire(&ra_lock);
+        while (ra_cnt == 0) {
+            cond_wait(&ra_nonempty, &ra_lock);
+        }
+        sector = ra_queue[ra_head];
+        ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+        ra_cnt--;
+        lock_release(&ra_lock);
+
+        if (!cache_contains(sector)) {
+            cache_put(cache_get(sector, true, CACHE_DATA));
+            readahead_cnt++;
+        }
+    }
+}
+
+/* Returns true if SECTOR is cached or being loaded. */
+bool
+cache_contains(block_sector_t sector)
+{
+    bool found = false;
+    size_t i;
+
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].sector == sector) {
+            found = true;
+            break;
+        }
+    }
+    lock_release(&cache_lock);
+    return found;
+}
+
+/* Returns true if any of the CNT sectors starting at SECTOR is
+ * cached, being loaded, or being written back by eviction. */
+static bool
+any_cached(block_sector_t sector, block_sector_t cnt)
+{
+    bool found = false;
+    size_t i;
+
+    lock_acquire(&cache_lock);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if ((cache[i].sector != NO_SECTOR
+             && cache[i].sector - sector < cnt)
+            || (cache[i].flushing != NO_SECTOR
+                && cache[i].flushing - sector < cnt)) {
+            found = true;
+            break;
+        }
+    }
+    lock_release(&cache_lock);
+    return found;
+}
+
+/* Orders pointers to cache entries by ascending sector. */
+static int
+sector_less(const void *a_, const void *b_, void *aux UNUSED)
+{
+    const struct cache_entry *a = *(struct cache_entry *const *) a_;
+    const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+    return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
@@ -0,0 +1,45 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "devices/block.h"
+
+struct kstat;
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+/* What a sector holds, which decides how long the cache keeps
+ * it. */
+enum cache_hint {
+    CACHE_META,    /* Metadata or directory contents: kept longest. */
+    CACHE_DATA,    /* File data: kept if used twice. */
+    CACHE_STREAM   /* File data read by a sequential scan: first to go. */
+};
+
+void cache_init(void);
+void cache_read(block_sector_t, void *);
+void cache_read_at(block_sector_t, void *, size_t ofs, size_t size);
+void cache_read_hint(block_sector_t, void *, size_t ofs, size_t size,
+                     enum cache_hint);
+void cache_read_uncached(block_sector_t, void *);
+bool cache_read_direct(block_sector_t, block_sector_t cnt, void *);
+void cache_write_direct(block_sector_t, block_sector_t cnt, const void *);
+void cache_write(block_sector_t, const void *);
+void cache_write_at(block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_hint(block_sector_t, const void *, size_t ofs, size_t size,
+                      enum cache_hint);
+void cache_write_data(block_sector_t, const void *);
+void cache_zero(block_sector_t);
+void cache_checkpoint(block_sector_t);
+void cache_read_ahead(block_sector_t);
+bool cache_contains(block_sector_t);
+void cache_flush(void);
+void cache_flush_range(block_sector_t, block_sector_t cnt);
+bool cache_is_held(block_sector_t);
+void cache_print_stats(void);
+void cache_kstat(struct kstat *);
+
+#endif /* filesys/cache.h */
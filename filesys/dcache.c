@@ -0,0 +1,180 @@
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filesys/dcache.h"
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of cached names. */
+#define DCACHE_SIZE 256
+
+/* A cached directory entry: the result of looking up NAME in the
+ * directory whose inode is in sector DIR. */
+struct dentry
+{
+    block_sector_t dir;            /* Directory's inode sector. */
+    char name[NAME_MAX + 1];       /* Name within DIR. */
+    block_sector_t inode_sector;   /* Inode, or DCACHE_NEGATIVE. */
+    struct hash_elem hash_elem;    /* Element in dentries. */
+    struct list_elem lru_elem;     /* Element in lru_list. */
+};
+
+static struct hash dentries;       /* All cached entries. */
+static struct list lru_list;       /* Most recently used at front. */
+static struct lock dcache_lock;    /* Protects everything above. */
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt;
+
+static struct dentry *dentry_find(block_sector_t dir, const char *name);
+
+static hash_hash_func dentry_hash;
+
+static hash_less_func dentry_less;
+
+/* Initializes the dentry cache. */
+void
+dcache_init(void)
+{
+    hash_init(&dentries, dentry_hash, dentry_less, NULL);
+    list_init(&lru_list);
+    lock_init(&dcache_lock);
+}
+
+/* Looks up NAME in directory DIR in the cache.  Returns false if
+ * the cache knows nothing about it.  Otherwise returns true and
+ * sets *INODE_SECTOR to the file's inode sector, or to
+ * DCACHE_NEGATIVE if the cache knows that there is no such
+ * file. */
+bool
+dcache_lookup(block_sector_t dir, const char *name,
+              block_sector_t *inode_sector)
+{
+    struct dentry *d;
+
+    lock_acquire(&dcache_lock);
+    d = dentry_find(dir, name);
+    if (d != NULL) {
+        list_remove(&d->lru_elem);
+        list_push_front(&lru_list, &d->lru_elem);
+        *inode_sector = d->inode_sector;
+        hit_cnt++;
+    } else {
+        miss_cnt++;
+    }
+    lock_release(&dcache_lock);
+
+    return d != NULL;
+}
+
+/* Records that NAME in directory DIR refers to the inode in
+ * INODE_SECTOR, or that it does not exist if INODE_SECTOR is
+ * DCACHE_NEGATIVE, replacing anything cached about it before.
+ * Names too long to be valid are not cached. */
+void
+dcache_insert(block_sector_t dir, const char *name,
+              block_sector_t inode_sector)
+{
+    struct dentry *d;
+
+    if (strlen(name) > NAME_MAX) {
+        return;
+    }
+
+    lock_acquire(&dcache_lock);
+    d = dentry_find(dir, name);
+    if (d == NULL) {
+        if (hash_size(&dentries) >= DCACHE_SIZE) {
+            /* Reuse the least recently used entry. */
+            d = list_entry(list_pop_back(&lru_list), struct dentry, lru_elem);
+            hash_delete(&dentries, &d->hash_elem);
+        } else {
+            d = malloc(sizeof *d);
+            if (d == NULL) {
+                lock_release(&dcache_lock);
+                return;
+            }
+        }
+        d->dir = dir;
+        strlcpy(d->name, name, sizeof d->name);
+        hash_insert(&dentries, &d->hash_elem);
+    } else {
+        list_remove(&d->lru_elem);
+    }
+    d->inode_sector = inode_sector;
+    list_push_front(&lru_list, &d->lru_elem);
+    lock_release(&dcache_lock);
+}
+
+/* Drops every cached name within the directory whose inode is in
+ * sector DIR.  Must be called when that inode is removed, since
+ * its sector may later be reused for a different directory. */
+void
+dcache_forget_dir(block_sector_t dir)
+{
+    struct list_elem *e;
+
+    lock_acquire(&dcache_lock);
+    for (e = list_begin(&lru_list); e != list_end(&lru_list);) {
+        struct dentry *d = list_entry(e, struct dentry, lru_elem);
+
+        e = list_next(e);
+        if (d->dir == dir) {
+            list_remove(&d->lru_elem);
+            hash_delete(&dentries, &d->hash_elem);
+            free(d);
+        }
+    }
+    lock_release(&dcache_lock);
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats(void)
+{
+    printf("Dentry cache: %llu hits, %llu misses\n", hit_cnt, miss_cnt);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer if
+ * there is none.  Dcache_lock must be held. */
+static struct dentry *
+dentry_find(block_sector_t dir, const char *name)
+{
+    struct dentry key;
+    struct hash_elem *e;
+
+    if (strlen(name) > NAME_MAX) {
+        return NULL;
+    }
+    key.dir = dir;
+    strlcpy(key.name, name, sizeof key.name);
+    e = hash_find(&dentries, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Hashes a dentry by directory and name. */
+static unsigned
+dentry_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    const struct dentry *d = hash_entry(e, struct dentry, hash_elem);
+
+    return hash_string(d->name) ^ hash_int(d->dir);
+}
+
+/* Orders dentries by directory, then by name. */
+static bool
+dentry_less(const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+    const struct dentry *a = hash_entry(a_, struct dentry, hash_elem);
+    const struct dentry *b = hash_entry(b_, struct dentry, hash_elem);
+
+    if (a->dir != b->dir) {
+        return a->dir < b->dir;
+    }
+    return strcmp(a->name, b->name) < 0;
+}
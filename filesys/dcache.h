@@ -0,0 +1,18 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+
+#include "devices/block.h"
+
+/* Inode sector recorded for a name known not to exist.  Sector 0
+ * holds the free map inode, so no directory entry refers to it. */
+#define DCACHE_NEGATIVE 0
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t dir, const char *name, block_sector_t *);
+void dcache_insert(block_sector_t dir, const char *name, block_sector_t);
+void dcache_forget_dir(block_sector_t dir);
+void dcache_print_stats(void);
+
+#endif /* filesys/dcache.h */
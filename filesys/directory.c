@@ -1,18 +1,92 @@
+#include <hash.h>
 #include <list.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Byte offset of block BLOCK, and of slot SLOT within it, in a
+ * hashed directory. */
+#define BLOCK_OFS(BLOCK) ((off_t) (BLOCK) * BLOCK_SECTOR_SIZE)
+#define SLOT_OFS(BLOCK, SLOT) \
+    (BLOCK_OFS(BLOCK) + (off_t) (SLOT) * sizeof(struct dir_entry))
+
+/* Byte offsets of header fields in a hashed directory. */
+#define BUCKET_CNT_OFS offsetof(struct dir_header, bucket_cnt)
+#define ENTRY_CNT_OFS offsetof(struct dir_header, entry_cnt)
+#define BLOCK_CNT_OFS offsetof(struct dir_header, block_cnt)
+#define BUCKET_OFS(BUCKET) \
+    (offsetof(struct dir_header, buckets) + (BUCKET) * sizeof(uint16_t))
+
+/* Byte offset of the NEXT field of block BLOCK. */
+#define NEXT_OFS(BLOCK) (BLOCK_OFS(BLOCK) + offsetof(struct dir_block, next))
+
+/* Memory for open directories. */
+static struct kmem_cache *dir_cache;
+
+static bool read_word(const struct dir *, off_t ofs, void *, size_t);
+
+static bool write_word(struct dir *, off_t ofs, const void *, size_t);
+
+static bool bucket_insert(struct dir *, uint32_t bucket,
+                          const struct dir_entry *);
+
+static bool split_buckets(struct dir *);
+
+static void prefetch_block(struct dir *);
+static void prefetch_entry(const struct dir_entry *);
+
+/* Initializes the directory module. */
+void
+dir_init(void)
+{
+    dir_cache = kmem_cache_create("dir", sizeof(struct dir), 0, NULL);
+}
 
 /* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+ * given SECTOR.  Returns true if successful, false on failure.
+ *
+ * The directory is created in the hashed format, with enough
+ * buckets that ENTRY_CNT entries fit without overflow blocks.
+ * Its blocks are allocated as entries are added. */
 bool
 dir_create(block_sector_t sector, size_t entry_cnt)
 {
-    return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+    struct dir_header *h;
+    struct inode *inode;
+    bool success = false;
+
+    ASSERT(sizeof(struct dir_header) == BLOCK_SECTOR_SIZE);
+    ASSERT(sizeof(struct dir_block) == BLOCK_SECTOR_SIZE);
+
+    h = calloc(1, sizeof *h);
+    if (h == NULL) {
+        return false;
+    }
+    h->magic = DIR_MAGIC;
+    h->bucket_cnt = 1;
+    while (h->bucket_cnt < DIR_MAX_BUCKETS
+           && h->bucket_cnt * DIR_BLOCK_SLOTS < entry_cnt) {
+        h->bucket_cnt *= 2;
+    }
+    h->entry_cnt = 0;
+    h->block_cnt = 1;
+
+    if (inode_create(sector, 0)) {
+        inode = inode_open(sector);
+        if (inode != NULL) {
+            success = inode_write_at(inode, h, sizeof *h, 0) == sizeof *h;
+            inode_close(inode);
+        }
+    }
+    free(h);
+    return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -20,15 +94,21 @@ dir_create(block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open(struct inode *inode)
 {
-    struct dir *dir = calloc(1, sizeof *dir);
+    struct dir *dir = kmem_cache_zalloc(dir_cache);
 
     if (inode != NULL && dir != NULL) {
+        unsigned magic;
+
         dir->inode = inode;
         dir->pos = 0;
+        dir->prefetched = 0;
+        dir->hashed = (inode_read_at(inode, &magic, sizeof magic, 0)
+                       == sizeof magic
+                       && magic == DIR_MAGIC);
         return dir;
     } else {
         inode_close(inode);
-        free(dir);
+        kmem_cache_free(dir_cache, dir);
         return NULL;
     }
 }
@@ -55,7 +135,7 @@ dir_close(struct dir *dir)
 {
     if (dir != NULL) {
         inode_close(dir->inode);
-        free(dir);
+        kmem_cache_free(dir_cache, dir);
     }
 }
 
@@ -70,7 +150,10 @@ dir_get_inode(struct dir *dir)
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ *
+ * In a hashed directory this reads only the header and the
+ * blocks in NAME's bucket, which is usually a single block. */
 static bool
 lookup(const struct dir *dir, const char *name,
        struct dir_entry *ep, off_t *ofsp)
@@ -81,19 +164,47 @@ lookup(const struct dir *dir, const char *name,
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
+    if (dir->hashed) {
+        uint32_t bucket_cnt;
+        uint16_t block;
+        size_t slot;
+
+        if (!read_word(dir, BUCKET_CNT_OFS, &bucket_cnt, sizeof bucket_cnt)
+            || !read_word(dir, BUCKET_OFS(hash_string(name) % bucket_cnt),
+                          &block, sizeof block)) {
+            return false;
+        }
+        while (block != 0) {
+            for (slot = 0; slot < DIR_BLOCK_SLOTS; slot++) {
+                ofs = SLOT_OFS(block, slot);
+                if (read_word(dir, ofs, &e, sizeof e)
+                    && e.in_use && !strcmp(name, e.name)) {
+                    goto found;
+                }
+            }
+            if (!read_word(dir, NEXT_OFS(block), &block, sizeof block)) {
+                return false;
+            }
+        }
+        return false;
+    }
+
     for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
          ofs += sizeof e) {
         if (e.in_use && !strcmp(name, e.name)) {
-            if (ep != NULL) {
-                *ep = e;
-            }
-            if (ofsp != NULL) {
-                *ofsp = ofs;
-            }
-            return true;
+            goto found;
         }
     }
     return false;
+
+found:
+    if (ep != NULL) {
+        *ep = e;
+    }
+    if (ofsp != NULL) {
+        *ofsp = ofs;
+    }
+    return true;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -104,17 +215,31 @@ bool
 dir_lookup(const struct dir *dir, const char *name,
            struct inode **inode)
 {
+    block_sector_t dir_sector, inode_sector;
     struct dir_entry e;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    if (lookup(dir, name, &e, NULL)) {
-        *inode = inode_open(e.inode_sector);
-    } else {
-        *inode = NULL;
+    dir_sector = inode_get_inumber(dir->inode);
+
+    /* Consult the dentry cache first, and remember what we find
+     * on disk, including that NAME does not exist.  The cache is
+     * updated under the directory lock so that a concurrent
+     * dir_add() or dir_remove() can't be overwritten with a stale
+     * result. */
+    if (!dcache_lookup(dir_sector, name, &inode_sector)) {
+        rw_read_acquire(&dir->inode->dir_lock);
+        inode_sector = (lookup(dir, name, &e, NULL)
+                        ? e.inode_sector
+                        : DCACHE_NEGATIVE);
+        dcache_insert(dir_sector, name, inode_sector);
+        rw_read_release(&dir->inode->dir_lock);
     }
 
+    *inode = (inode_sector != DCACHE_NEGATIVE
+              ? inode_open(inode_sector)
+              : NULL);
     return *inode != NULL;
 }
 
@@ -127,7 +252,7 @@ dir_lookup(const struct dir *dir, const char *name,
 bool
 dir_add(struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-    struct dir_entry e;
+    struct dir_entry e, f;
     off_t ofs;
     bool success = false;
 
@@ -140,31 +265,70 @@ dir_add(struct dir *dir, const char *name, block_sector_t inode_sector)
     }
 
     /* Check that NAME is not in use. */
+    rw_write_acquire(&dir->inode->dir_lock);
     if (lookup(dir, name, NULL, NULL)) {
         goto done;
     }
 
+    /* Fill in the new entry. */
+    e.in_use = true;
+    strlcpy(e.name, name, sizeof e.name);
+    e.inode_sector = inode_sector;
+
+    if (dir->hashed) {
+        uint32_t bucket_cnt, entry_cnt;
+
+        /* Double the bucket count once the average bucket is
+         * three-quarters full, so that chains stay one block
+         * long. */
+        if (!read_word(dir, BUCKET_CNT_OFS, &bucket_cnt, sizeof bucket_cnt)
+            || !read_word(dir, ENTRY_CNT_OFS, &entry_cnt, sizeof entry_cnt)) {
+            goto done;
+        }
+        if (bucket_cnt < DIR_MAX_BUCKETS
+            && entry_cnt >= bucket_cnt * DIR_BLOCK_SLOTS * 3 / 4) {
+            if (!split_buckets(dir)) {
+                goto done;
+            }
+            bucket_cnt *= 2;
+        }
+
+        entry_cnt++;
+        success = (bucket_insert(dir, hash_string(name) % bucket_cnt, &e)
+                   && write_word(dir, ENTRY_CNT_OFS,
+                                 &entry_cnt, sizeof entry_cnt));
+        goto cache;
+    }
+
     /* Set OFS to offset of free slot.
      * If there are no free slots, then it will be set to the
-     * current end-of-file.
+     * current end-of-file.  The inode remembers the lowest offset
+     * that may be free, so that repeated adds don't rescan the
+     * slots that are known to be in use.
      *
      * inode_read_at() will only return a short read at end of file.
      * Otherwise, we'd need to verify that we didn't get a short
      * read due to something intermittent such as low memory. */
-    for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-         ofs += sizeof e) {
-        if (!e.in_use) {
+    for (ofs = dir->inode->free_hint;
+         inode_read_at(dir->inode, &f, sizeof f, ofs) == sizeof f;
+         ofs += sizeof f) {
+        if (!f.in_use) {
             break;
         }
     }
 
     /* Write slot. */
-    e.in_use = true;
-    strlcpy(e.name, name, sizeof e.name);
-    e.inode_sector = inode_sector;
     success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+    if (success) {
+        dir->inode->free_hint = ofs + sizeof e;
+    }
 
+cache:
+    if (success) {
+        dcache_insert(inode_get_inumber(dir->inode), name, inode_sector);
+    }
 done:
+    rw_write_release(&dir->inode->dir_lock);
     return success;
 }
 
@@ -183,6 +347,7 @@ dir_remove(struct dir *dir, const char *name)
     ASSERT(name != NULL);
 
     /* Find directory entry. */
+    rw_write_acquire(&dir->inode->dir_lock);
     if (!lookup(dir, name, &e, &ofs)) {
         goto done;
     }
@@ -198,12 +363,26 @@ dir_remove(struct dir *dir, const char *name)
     if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e) {
         goto done;
     }
+    if (dir->hashed) {
+        uint32_t entry_cnt;
 
-    /* Remove inode. */
+        if (read_word(dir, ENTRY_CNT_OFS, &entry_cnt, sizeof entry_cnt)) {
+            entry_cnt--;
+            write_word(dir, ENTRY_CNT_OFS, &entry_cnt, sizeof entry_cnt);
+        }
+    } else if (ofs < dir->inode->free_hint) {
+        dir->inode->free_hint = ofs;
+    }
+
+    /* Remove inode, and forget it in the dentry cache, both as
+     * NAME and as a directory whose sector may be reused. */
+    dcache_insert(inode_get_inumber(dir->inode), name, DCACHE_NEGATIVE);
+    dcache_forget_dir(e.inode_sector);
     inode_remove(inode);
     success = true;
 
 done:
+    rw_write_release(&dir->inode->dir_lock);
     inode_close(inode);
     return success;
 }
@@ -215,13 +394,244 @@ bool
 dir_readdir(struct dir *dir, char name[NAME_MAX + 1])
 {
     struct dir_entry e;
+    bool success = false;
 
-    while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+    rw_read_acquire(&dir->inode->dir_lock);
+    for (;;) {
+        if (dir->hashed) {
+            /* Skip the header and the padding at the end of each
+             * block. */
+            off_t slot = dir->pos % BLOCK_SECTOR_SIZE / sizeof e;
+            if (dir->pos < BLOCK_SECTOR_SIZE || slot >= DIR_BLOCK_SLOTS) {
+                dir->pos = ROUND_UP(dir->pos + 1, BLOCK_SECTOR_SIZE);
+            }
+        }
+        if (dir->pos >= dir->prefetched) {
+            prefetch_block(dir);
+        }
+        if (inode_read_at(dir->inode, &e, sizeof e, dir->pos) != sizeof e) {
+            break;
+        }
         dir->pos += sizeof e;
         if (e.in_use) {
             strlcpy(name, e.name, NAME_MAX + 1);
-            return true;
+            success = true;
+            break;
         }
     }
-    return false;
+    rw_read_release(&dir->inode->dir_lock);
+    return success;
+}
+
+/* Reads up to CNT of the next entries in DIR into ENTRIES and
+ * returns the number read, which is 0 at the end of the
+ * directory.  Unlike dir_readdir(), reads the slots of a whole
+ * directory block at a time.
+ *
+ * This file system has no subdirectories, so no entry is a
+ * directory. */
+size_t
+dir_getdents(struct dir *dir, struct dirent *entries, size_t cnt)
+{
+    struct dir_entry *slots;
+    size_t n = 0;
+
+    slots = malloc(DIR_BLOCK_SLOTS * sizeof *slots);
+    if (slots == NULL) {
+        return 0;
+    }
+
+    rw_read_acquire(&dir->inode->dir_lock);
+    while (n < cnt) {
+        size_t slot_cnt = DIR_BLOCK_SLOTS;
+        off_t size;
+        size_t i;
+
+        if (dir->hashed) {
+            /* Skip the header and the padding at the end of each
+             * block, and read only up to the padding. */
+            size_t slot = dir->pos % BLOCK_SECTOR_SIZE / sizeof *slots;
+            if (dir->pos < BLOCK_SECTOR_SIZE || slot >= DIR_BLOCK_SLOTS) {
+                dir->pos = ROUND_UP(dir->pos + 1, BLOCK_SECTOR_SIZE);
+                slot = 0;
+            }
+            slot_cnt -= slot;
+        }
+        size = inode_read_at(dir->inode, slots, slot_cnt * sizeof *slots,
+                             dir->pos);
+        slot_cnt = size / sizeof *slots;
+        if (slot_cnt == 0) {
+            break;
+        }
+        if (dir->pos >= dir->prefetched) {
+            for (i = 0; i < slot_cnt; i++) {
+                prefetch_entry(&slots[i]);
+            }
+            dir->prefetched = dir->pos + slot_cnt * sizeof *slots;
+        }
+        for (i = 0; i < slot_cnt && n < cnt; i++) {
+            dir->pos += sizeof *slots;
+            if (slots[i].in_use) {
+                struct dirent *d = &entries[n++];
+                d->inumber = slots[i].inode_sector;
+                d->isdir = false;
+                strlcpy(d->name, slots[i].name, sizeof d->name);
+            }
+        }
+    }
+    rw_read_release(&dir->inode->dir_lock);
+    free(slots);
+    return n;
+}
+
+/* Inode prefetch.
+ *
+ * A program that lists a directory usually goes on to open each
+ * entry, for its size or type, and each open reads an inode
+ * sector from somewhere else on disk.  So when a scan with
+ * dir_readdir() or dir_getdents() reaches a directory block it
+ * has not been through yet, it queues the inode sectors of every
+ * entry in that block for read-ahead, and by the time the program
+ * opens them they are mostly in the buffer cache. */
+
+/* Queues the inodes of the entries in DIR from its position to
+ * the end of the sector there for prefetch.  An entry of an old
+ * style directory that spans two sectors is skipped. */
+static void
+prefetch_block(struct dir *dir)
+{
+    off_t end = ROUND_UP(dir->pos + 1, BLOCK_SECTOR_SIZE);
+    off_t ofs;
+
+    for (ofs = dir->pos; ofs + (off_t) sizeof(struct dir_entry) <= end;
+         ofs += sizeof(struct dir_entry)) {
+        struct dir_entry e;
+
+        if (inode_read_at(dir->inode, &e, sizeof e, ofs) != sizeof e) {
+            break;
+        }
+        prefetch_entry(&e);
+    }
+    dir->prefetched = ofs > dir->pos ? ofs : dir->pos + 1;
+}
+
+/* Queues the inode of entry E for prefetch, if E is in use. */
+static void
+prefetch_entry(const struct dir_entry *e)
+{
+    if (e->in_use) {
+        inode_prefetch(e->inode_sector);
+    }
+}
+
+/* Reads SIZE bytes at OFS in DIR into BUFFER.
+ * Returns true if successful, false on a short read. */
+static bool
+read_word(const struct dir *dir, off_t ofs, void *buffer, size_t size)
+{
+    return inode_read_at(dir->inode, buffer, size, ofs) == (off_t) size;
+}
+
+/* Writes SIZE bytes from BUFFER to OFS in DIR.
+ * Returns true if successful, false on a short write. */
+static bool
+write_word(struct dir *dir, off_t ofs, const void *buffer, size_t size)
+{
+    return inode_write_at(dir->inode, buffer, size, ofs) == (off_t) size;
+}
+
+/* Stores E in a free slot in the chain for BUCKET of hashed
+ * directory DIR, appending a block to the chain if it is full.
+ * Does not update the header's entry count.
+ * Returns true if successful, false on a disk or memory error. */
+static bool
+bucket_insert(struct dir *dir, uint32_t bucket, const struct dir_entry *e)
+{
+    struct dir_entry slot_entry;
+    off_t link_ofs = BUCKET_OFS(bucket);
+    uint32_t block_cnt;
+    uint16_t block;
+    size_t slot;
+    uint8_t zero = 0;
+
+    /* Look for a free slot in the existing chain. */
+    if (!read_word(dir, link_ofs, &block, sizeof block)) {
+        return false;
+    }
+    while (block != 0) {
+        for (slot = 0; slot < DIR_BLOCK_SLOTS; slot++) {
+            off_t ofs = SLOT_OFS(block, slot);
+            if (!read_word(dir, ofs, &slot_entry, sizeof slot_entry)) {
+                return false;
+            }
+            if (!slot_entry.in_use) {
+                return write_word(dir, ofs, e, sizeof *e);
+            }
+        }
+        link_ofs = NEXT_OFS(block);
+        if (!read_word(dir, link_ofs, &block, sizeof block)) {
+            return false;
+        }
+    }
+
+    /* Append a new, zeroed block, by writing its last byte, and
+     * link it to the end of the chain. */
+    if (!read_word(dir, BLOCK_CNT_OFS, &block_cnt, sizeof block_cnt)
+        || block_cnt > UINT16_MAX) {
+        return false;
+    }
+    block = block_cnt++;
+    return (write_word(dir, BLOCK_OFS(block + 1) - 1, &zero, sizeof zero)
+            && write_word(dir, SLOT_OFS(block, 0), e, sizeof *e)
+            && write_word(dir, BLOCK_CNT_OFS, &block_cnt, sizeof block_cnt)
+            && write_word(dir, link_ofs, &block, sizeof block));
+}
+
+/* Doubles the number of buckets in hashed directory DIR.  Bucket
+ * B's entries either stay in B or move to B plus the old bucket
+ * count, so each chain is split without touching the others.
+ * Returns true if successful, false on a disk or memory error. */
+static bool
+split_buckets(struct dir *dir)
+{
+    uint32_t old_cnt, new_cnt, bucket;
+
+    if (!read_word(dir, BUCKET_CNT_OFS, &old_cnt, sizeof old_cnt)) {
+        return false;
+    }
+    new_cnt = old_cnt * 2;
+    ASSERT(new_cnt <= DIR_MAX_BUCKETS);
+
+    for (bucket = 0; bucket < old_cnt; bucket++) {
+        uint16_t block;
+
+        if (!read_word(dir, BUCKET_OFS(bucket), &block, sizeof block)) {
+            return false;
+        }
+        while (block != 0) {
+            size_t slot;
+
+            for (slot = 0; slot < DIR_BLOCK_SLOTS; slot++) {
+                struct dir_entry e;
+                off_t ofs = SLOT_OFS(block, slot);
+
+                if (!read_word(dir, ofs, &e, sizeof e)) {
+                    return false;
+                }
+                if (e.in_use && hash_string(e.name) % new_cnt != bucket) {
+                    if (!bucket_insert(dir, bucket + old_cnt, &e)) {
+                        return false;
+                    }
+                    e.in_use = false;
+                    if (!write_word(dir, ofs, &e, sizeof e)) {
+                        return false;
+                    }
+                }
+            }
+            if (!read_word(dir, NEXT_OFS(block), &block, sizeof block)) {
+                return false;
+            }
+        }
+    }
+    return write_word(dir, BUCKET_CNT_OFS, &new_cnt, sizeof new_cnt);
 }
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "devices/block.h"
 #include "filesys/inode.h"
@@ -15,8 +16,10 @@
 
 /* A directory. */
 struct dir {
-    struct inode *inode; /* Backing store. */
-    off_t         pos;   /* Current position. */
+    struct inode *inode;  /* Backing store. */
+    off_t         pos;        /* Current position. */
+    bool          hashed;     /* Hashed format, or old linear array? */
+    off_t         prefetched; /* Inodes of entries before this fetched. */
 };
 
 /* A single directory entry. */
@@ -26,6 +29,49 @@ struct dir_entry {
     bool           in_use;             /* In use or free? */
 };
 
+/* A directory entry as returned by dir_getdents().  Must match
+ * struct dirent in lib/user/syscall.h. */
+struct dirent {
+    uint32_t inumber;            /* Sector number of the inode. */
+    bool     isdir;              /* Is it a directory? */
+    char     name[NAME_MAX + 1]; /* Null terminated file name. */
+};
+
+/* Hashed directories.
+ *
+ * Block 0 of a hashed directory is a struct dir_header.  Every
+ * other block is a struct dir_block holding up to DIR_BLOCK_SLOTS
+ * entries.  An entry whose name hashes to bucket B lives in the
+ * chain of blocks that starts at BUCKETS[B] and continues through
+ * each block's NEXT.  Block numbers are indexes into the
+ * directory file, and block number 0 ends a chain.
+ *
+ * Directories in the original format are a plain array of
+ * struct dir_entry.  They are still read and updated, but new
+ * directories are always created hashed. */
+#define DIR_MAGIC 0x48524944        /* Identifies a hashed directory. */
+#define DIR_BLOCK_SLOTS 25          /* Entries per directory block. */
+#define DIR_HEADER_BUCKETS 248      /* Bucket pointers in the header. */
+#define DIR_MAX_BUCKETS 128         /* Buckets in use, at most. */
+
+/* Block 0 of a hashed directory. */
+struct dir_header {
+    unsigned magic;                       /* DIR_MAGIC. */
+    uint32_t bucket_cnt;                  /* Buckets in use, power of 2. */
+    uint32_t entry_cnt;                   /* Entries in use. */
+    uint32_t block_cnt;                   /* Blocks, including this one. */
+    uint16_t buckets[DIR_HEADER_BUCKETS]; /* First block of each chain. */
+};
+
+/* A block of entries in a hashed directory. */
+struct dir_block {
+    struct dir_entry entries[DIR_BLOCK_SLOTS]; /* Entries. */
+    uint16_t next;                             /* Next block in chain. */
+    uint8_t unused[10];                        /* Not used. */
+};
+
+void dir_init(void);
+
 /* Opening and closing directories. */
 bool dir_create(block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open(struct inode *);
@@ -39,5 +85,6 @@ bool dir_lookup(const struct dir *, const char *name, struct inode **);
 bool dir_add(struct dir *, const char *name, block_sector_t);
 bool dir_remove(struct dir *, const char *name);
 bool dir_readdir(struct dir *, char name[NAME_MAX + 1]);
+size_t dir_getdents(struct dir *, struct dirent *, size_t cnt);
 
 #endif /* filesys/directory.h */
@@ -2,7 +2,23 @@
 
 #include "filesys/file.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+
+/* Bounds on a file's read-ahead window, in sectors. */
+#define RA_WINDOW_MIN 1
+#define RA_WINDOW_MAX 16
+
+/* Memory for open files. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init(void)
+{
+    file_cache = kmem_cache_create("file", sizeof(struct file), 0, NULL);
+}
 
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
@@ -10,16 +26,19 @@
 struct file *
 file_open(struct inode *inode)
 {
-    struct file *file = calloc(1, sizeof *file);
+    struct file *file = kmem_cache_zalloc(file_cache);
 
     if (inode != NULL && file != NULL) {
         file->inode = inode;
         file->pos = 0;
         file->deny_write = false;
+        file->ra_next = 0;
+        file->ra_window = 0;
+        file->streaming = false;
         return file;
     } else {
         inode_close(inode);
-        free(file);
+        kmem_cache_free(file_cache, file);
         return NULL;
     }
 }
@@ -39,7 +58,7 @@ file_close(struct file *file)
     if (file != NULL) {
         file_allow_write(file);
         inode_close(file->inode);
-        free(file);
+        kmem_cache_free(file_cache, file);
     }
 }
 
@@ -58,9 +77,39 @@ file_get_inode(struct file *file)
 off_t
 file_read(struct file *file, void *buffer, off_t size)
 {
-    off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+    off_t bytes_read;
+
+    /* A read that starts where the last one ended is sequential
+     * and doubles the read-ahead window; anything else halves
+     * it. */
+    if (file->pos == file->ra_next) {
+        file->ra_window = (file->ra_window < RA_WINDOW_MIN
+                           ? RA_WINDOW_MIN
+                           : file->ra_window * 2);
+        if (file->ra_window > RA_WINDOW_MAX) {
+            file->ra_window = RA_WINDOW_MAX;
+        }
+    } else {
+        file->ra_window /= 2;
+    }
+
+    /* A file read sequentially long enough to open the window
+     * all the way is being scanned, and the buffer cache need not
+     * keep what it reads. */
+    file->streaming = file->ra_window == RA_WINDOW_MAX;
 
+    bytes_read = inode_read_data(file->inode, buffer, size, file->pos,
+                                 file->streaming);
     file->pos += bytes_read;
+    file->ra_next = file->pos;
+
+    /* A streaming read big enough to go straight to disk needs no
+     * read-ahead, which would only put sectors in the cache for
+     * the next read to find there instead. */
+    if (file->ra_window > 0 && bytes_read > 0
+        && !(file->streaming && size >= INODE_DIRECT_MIN)) {
+        inode_read_ahead(file->inode, file->pos, file->ra_window);
+    }
     return bytes_read;
 }
 
@@ -72,20 +121,20 @@ file_read(struct file *file, void *buffer, off_t size)
 off_t
 file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
 {
-    return inode_read_at(file->inode, buffer, size, file_ofs);
+    return inode_read_data(file->inode, buffer, size, file_ofs, false);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file extends the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write(struct file *file, const void *buffer, off_t size)
 {
-    off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+    off_t bytes_written = inode_write_data(file->inode, buffer, size,
+                                           file->pos);
 
     file->pos += bytes_written;
     return bytes_written;
@@ -94,15 +143,65 @@ file_write(struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file extends the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at(struct file *file, const void *buffer, off_t size,
               off_t file_ofs)
 {
-    return inode_write_at(file->inode, buffer, size, file_ofs);
+    return inode_write_data(file->inode, buffer, size, file_ofs);
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+ * position, to DST at its current position, without the data
+ * leaving the kernel.  The sectors DST needs are allocated up
+ * front, as one extent if the free map allows, so that a copy
+ * into a new or sparse file comes out contiguous; the data then
+ * moves a page at a time from SRC's cached sectors to DST's,
+ * with SRC read ahead as for a sequential read.
+ * Returns the number of bytes copied, which may be less than
+ * SIZE at end of SRC or if the disk fills up.  Advances both
+ * positions by that much. */
+off_t
+file_copy(struct file *dst, struct file *src, off_t size)
+{
+    off_t left = inode_length(src->inode) - src->pos;
+    off_t copied = 0;
+    uint8_t *buffer;
+
+    if (size > left) {
+        size = left;
+    }
+    if (size <= 0) {
+        return 0;
+    }
+    buffer = palloc_get_page(0);
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    /* If this fails, the writes below allocate what they can. */
+    inode_preallocate(dst->inode, dst->pos, size);
+
+    while (copied < size) {
+        off_t chunk = size - copied < PGSIZE ? size - copied : PGSIZE;
+        off_t bytes_read = file_read(src, buffer, chunk);
+        off_t bytes_written;
+
+        if (bytes_read == 0) {
+            break;
+        }
+        bytes_written = file_write(dst, buffer, bytes_read);
+        copied += bytes_written;
+        if (bytes_written < bytes_read) {
+            /* Leave SRC just past what was copied. */
+            src->pos -= bytes_read - bytes_written;
+            break;
+        }
+    }
+    palloc_free_page(buffer);
+    return copied;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -130,6 +229,37 @@ file_allow_write(struct file *file)
     }
 }
 
+/* Makes DST, which must be empty, a copy of SRC, not by copying
+ * SRC's data but by sharing its sectors until either file writes
+ * to them; see inode_clone().  Leaves both positions alone.
+ * Returns true if successful, false if DST has data or the clone
+ * is not possible, in which case the caller may copy instead. */
+bool
+file_clone(struct file *dst, struct file *src)
+{
+    ASSERT(dst != NULL && src != NULL);
+    return inode_clone(dst->inode, src->inode);
+}
+
+/* Writes what has been written to FILE, through any opener, to
+ * disk.  If DATA_ONLY is true, the file's size and block map are
+ * written only if they changed; see inode_sync(). */
+void
+file_sync(struct file *file, bool data_only)
+{
+    ASSERT(file != NULL);
+    inode_sync(file->inode, data_only);
+}
+
+/* Makes FILE, which must be empty, store its data compressed.
+ * Returns true if successful, false if FILE has data. */
+bool
+file_set_compressed(struct file *file)
+{
+    ASSERT(file != NULL);
+    return inode_set_compressed(file->inode);
+}
+
 /* Returns the size of FILE in bytes. */
 off_t
 file_length(struct file *file)
@@ -9,8 +9,13 @@ struct file {
     struct inode *inode;      /* File's inode. */
     off_t         pos;        /* Current position. */
     bool          deny_write; /* Has file_deny_write() been called? */
+    off_t         ra_next;    /* Offset a sequential read would use. */
+    int           ra_window;  /* Read-ahead window, in sectors. */
+    bool          streaming;  /* Reading sequentially at full window? */
 };
 
+void file_init(void);
+
 /* Opening and closing files. */
 struct file *file_open(struct inode *);
 struct file *file_reopen(struct file *);
@@ -22,11 +27,19 @@ off_t file_read(struct file *, void *, off_t);
 off_t file_read_at(struct file *, void *, off_t size, off_t start);
 off_t file_write(struct file *, const void *, off_t);
 off_t file_write_at(struct file *, const void *, off_t size, off_t start);
+off_t file_copy(struct file *dst, struct file *src, off_t size);
+bool file_clone(struct file *dst, struct file *src);
 
 /* Preventing writes. */
 void file_deny_write(struct file *);
 void file_allow_write(struct file *);
 
+/* Making writes durable. */
+void file_sync(struct file *, bool data_only);
+
+/* Compression. */
+bool file_set_compressed(struct file *);
+
 /* File position. */
 void file_seek(struct file *, off_t);
 off_t file_tell(struct file *);
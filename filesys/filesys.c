@@ -2,17 +2,25 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format(void);
 
+static struct dir *get_dir(void);
+
+static void put_dir(struct dir *);
+
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
 void
@@ -23,11 +31,18 @@ filesys_init(bool format)
         PANIC("No file system device found, can't initialize file system.");
     }
 
+    cache_init();
+    dcache_init();
     inode_init();
+    file_init();
+    dir_init();
     free_map_init();
+    journal_init();
 
     if (format) {
         do_format();
+    } else {
+        journal_recover();
     }
 
     free_map_open();
@@ -38,7 +53,11 @@ filesys_init(bool format)
 void
 filesys_done(void)
 {
+    inode_allocate_delayed();
+    inode_reclaim_wait();
     free_map_close();
+    journal_commit();
+    cache_flush();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -49,16 +68,20 @@ bool
 filesys_create(const char *name, off_t initial_size)
 {
     block_sector_t inode_sector = 0;
-    struct dir *dir = dir_open_root();
-    bool success = (dir != NULL
-                    && free_map_allocate(1, &inode_sector)
-                    && inode_create(inode_sector, initial_size)
-                    && dir_add(dir, name, inode_sector));
-
+    struct dir *dir;
+    bool success;
+
+    journal_begin();
+    dir = get_dir();
+    success = (dir != NULL
+               && free_map_allocate_inode(ROOT_DIR_SECTOR, &inode_sector)
+               && inode_create(inode_sector, initial_size)
+               && dir_add(dir, name, inode_sector));
     if (!success && inode_sector != 0) {
         free_map_release(inode_sector, 1);
     }
-    dir_close(dir);
+    put_dir(dir);
+    journal_end();
 
     return success;
 }
@@ -71,17 +94,35 @@ filesys_create(const char *name, off_t initial_size)
 struct file *
 filesys_open(const char *name)
 {
-    struct dir *dir = dir_open_root();
+    struct dir *dir = get_dir();
     struct inode *inode = NULL;
 
     if (dir != NULL) {
         dir_lookup(dir, name, &inode);
     }
-    dir_close(dir);
+    put_dir(dir);
 
     return file_open(inode);
 }
 
+/* Opens the directory with the given NAME, which must be "/" for
+ * the root directory, the only one, or "." for the working
+ * directory.  Returns the new directory if successful or a null
+ * pointer otherwise. */
+struct dir *
+filesys_open_dir(const char *name)
+{
+    struct dir *cwd = thread_current()->leader->cwd;
+
+    if (!strcmp(name, ".") && cwd != NULL) {
+        return dir_reopen(cwd);
+    } else if (!strcmp(name, "/") || !strcmp(name, ".")) {
+        return dir_open_root();
+    } else {
+        return NULL;
+    }
+}
+
 /* Deletes the file named NAME.
  * Returns true if successful, false on failure.
  * Fails if no file named NAME exists,
@@ -89,10 +130,14 @@ filesys_open(const char *name)
 bool
 filesys_remove(const char *name)
 {
-    struct dir *dir = dir_open_root();
-    bool success = dir != NULL && dir_remove(dir, name);
+    struct dir *dir;
+    bool success;
 
-    dir_close(dir);
+    journal_begin();
+    dir = get_dir();
+    success = dir != NULL && dir_remove(dir, name);
+    put_dir(dir);
+    journal_end();
 
     return success;
 }
@@ -103,9 +148,33 @@ do_format(void)
 {
     printf("Formatting file system...");
     free_map_create();
+    journal_create();
     if (!dir_create(ROOT_DIR_SECTOR, 16)) {
         PANIC("root directory creation failed");
     }
     free_map_close();
     printf("done.\n");
 }
+
+/* Returns the directory in which to look up a name: the working
+ * directory of the running process, kept open for as long as the
+ * process lives, so that successive operations in it do not each
+ * open and close it, or the root directory for a kernel thread,
+ * which has none.  Returns a null pointer if the root directory
+ * cannot be opened.  Release the directory with put_dir(). */
+static struct dir *
+get_dir(void)
+{
+    struct dir *cwd = thread_current()->leader->cwd;
+
+    return cwd != NULL ? cwd : dir_open_root();
+}
+
+/* Releases DIR, obtained from get_dir(). */
+static void
+put_dir(struct dir *dir)
+{
+    if (dir != thread_current()->leader->cwd) {
+        dir_close(dir);
+    }
+}
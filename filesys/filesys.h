@@ -8,6 +8,8 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2  /* First of JOURNAL_SECTORS log sectors. */
+#define SHARE_MAP_SECTOR 35 /* Share map file inode sector, past the log. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
@@ -16,6 +18,7 @@ void filesys_init(bool format);
 void filesys_done(void);
 bool filesys_create(const char *name, off_t initial_size);
 struct file *filesys_open(const char *name);
+struct dir *filesys_open_dir(const char *name);
 bool filesys_remove(const char *name);
 
 #endif /* filesys/filesys.h */
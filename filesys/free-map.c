@@ -1,24 +1,169 @@
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file; /* Free map file. */
 static struct bitmap *free_map;    /* Free map, one bit per sector. */
+static struct lock free_map_lock;  /* Protects the map and its index. */
+
+/* The share map file holds one byte per sector of the disk: the
+ * number of files, besides the first, whose data includes the
+ * sector, since inode_clone() lets files share data sectors.  A
+ * sector that one file owns, as nearly every sector is, counts 0,
+ * so the file stays sparse except where clones are.  Its own
+ * lock, not free_map_lock, covers it, because writing it may
+ * allocate. */
+static struct file *share_map_file;
+static struct lock share_lock;
+
+/* Number of extent size classes.  Class C holds extents of
+ * 2**C to 2**(C+1) - 1 sectors. */
+#define SIZE_CLASS_CNT 32
+
+/* The disk is divided into block groups of GROUP_SECTORS sectors,
+ * so that each group's part of the bitmap is exactly one sector
+ * of the free map file.  The first GROUP_INODE_SECTORS sectors of
+ * each group are its inode region, where inodes are allocated,
+ * so that the inodes of files in one directory sit together
+ * instead of among their data.  The rest of the group holds
+ * data, and data allocation stays within the group of its hint
+ * while the group has room.  Inodes spill into data areas, and
+ * single data sectors into inode regions, only when there is no
+ * other space. */
+#define GROUP_SECTORS (BLOCK_SECTOR_SIZE * 8)
+#define GROUP_INODE_SECTORS 128
+
+/* A maximal run of free sectors within one group's data area.
+ *
+ * Free extents are indexed three ways: by first sector, by the
+ * sector just past the end (to merge neighbors on release in
+ * constant time), and in a list per group and size class (to
+ * find a big enough run without scanning the bitmap).  Free
+ * sectors in inode regions are not indexed.  The bitmap remains
+ * the authority and the on-disk format. */
+struct free_extent
+{
+    block_sector_t start;         /* First free sector. */
+    size_t length;                /* Number of free sectors. */
+    struct hash_elem start_elem;  /* Element in extents_by_start. */
+    struct hash_elem end_elem;    /* Element in extents_by_end. */
+    struct list_elem size_elem;   /* Element in size_classes[][]. */
+};
+
+static struct hash extents_by_start;
+static struct hash extents_by_end;
+static struct list (*size_classes)[SIZE_CLASS_CNT];
+static size_t group_cnt;
+
+/* False if an extent could not be allocated, in which case the
+ * index is incomplete and allocation falls back to scanning the
+ * bitmap until the index is rebuilt. */
+static bool index_valid;
+
+/* Next-fit cursor: where the previous allocation ended. */
+static block_sector_t next_fit;
+
+/* Groups whose part of the bitmap has been read from the free map
+ * file and indexed.  A group is loaded the first time allocation
+ * or release touches it, so that mounting reads no more of the
+ * map than the file system goes on to use.  Before the free map
+ * file exists, the bitmap in memory is the authority and loading
+ * a group only indexes it. */
+static struct bitmap *loaded_groups;
+
+/* Number of free sectors in loaded groups, and how many of those
+ * are promised to free_map_reserve() callers.  Ordinary
+ * allocations may not dip into the reserved ones. */
+static size_t free_cnt;
+static size_t reserved_cnt;
+
+static bool allocate(size_t cnt, block_sector_t hint, bool reserved,
+                     bool inode, block_sector_t *);
+
+static block_sector_t inode_region_scan(size_t group);
+
+static void index_reset(void);
+
+static void group_load(size_t group);
+
+static void load_range(block_sector_t, size_t cnt);
+
+static bool enough_free(size_t cnt, size_t group);
+
+static void index_clear(void);
+
+static size_t size_class(size_t length);
+
+static void extent_insert(block_sector_t, size_t);
+
+static void extent_remove(struct free_extent *);
+
+static void extent_carve(struct free_extent *, size_t);
+
+static struct free_extent *extent_find(struct hash *, block_sector_t);
+
+static struct free_extent *extent_fit(size_t, size_t group);
+
+static void index_release(block_sector_t, size_t);
+
+static hash_hash_func extent_start_hash;
+
+static hash_less_func extent_start_less;
+
+static block_sector_t extent_end(const struct hash_elem *);
+
+static hash_hash_func extent_end_hash;
+
+static hash_less_func extent_end_less;
+
+static int sector_less(const void *, const void *, void *);
+
+static uint8_t share_cnt(block_sector_t);
+
+static bool share_set(block_sector_t, uint8_t cnt);
 
 /* Initializes the free map. */
 void
 free_map_init(void)
 {
-    free_map = bitmap_create(block_size(fs_device));
-    if (free_map == NULL) {
+    size_t g, i;
+
+    free_map = bitmap_create_summarized(block_size(fs_device));
+    group_cnt = DIV_ROUND_UP(block_size(fs_device), GROUP_SECTORS);
+    size_classes = malloc(group_cnt * sizeof *size_classes);
+    loaded_groups = bitmap_create(group_cnt);
+    if (free_map == NULL || size_classes == NULL || loaded_groups == NULL) {
         PANIC("bitmap creation failed--file system device is too large");
     }
     bitmap_mark(free_map, FREE_MAP_SECTOR);
     bitmap_mark(free_map, ROOT_DIR_SECTOR);
+    bitmap_set_multiple(free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+    ASSERT(SHARE_MAP_SECTOR >= JOURNAL_SECTOR + JOURNAL_SECTORS);
+    bitmap_mark(free_map, SHARE_MAP_SECTOR);
+    lock_init(&free_map_lock);
+    lock_init(&share_lock);
+
+    hash_init(&extents_by_start, extent_start_hash, extent_start_less, NULL);
+    hash_init(&extents_by_end, extent_end_hash, extent_end_less, NULL);
+    for (g = 0; g < group_cnt; g++) {
+        for (i = 0; i < SIZE_CLASS_CNT; i++) {
+            list_init(&size_classes[g][i]);
+        }
+    }
+    next_fit = 0;
+    index_reset();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -29,30 +174,184 @@ free_map_init(void)
 bool
 free_map_allocate(size_t cnt, block_sector_t *sectorp)
 {
-    block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
+    return free_map_allocate_near(cnt, next_fit, sectorp);
+}
 
-    if (sector != BITMAP_ERROR
-        && free_map_file != NULL
-        && !bitmap_write(free_map, free_map_file)) {
-        bitmap_set_multiple(free_map, sector, cnt, false);
-        sector = BITMAP_ERROR;
-    }
-    if (sector != BITMAP_ERROR) {
-        *sectorp = sector;
+/* Like free_map_allocate(), but prefers the run that starts at
+ * sector HINT, so that a caller that passes the sector just past
+ * its previous allocation gets physically contiguous sectors.
+ * Otherwise uses a free extent of a suitable size class, found
+ * without scanning the bitmap. */
+bool
+free_map_allocate_near(size_t cnt, block_sector_t hint,
+                       block_sector_t *sectorp)
+{
+    return allocate(cnt, hint, false, false, sectorp);
+}
+
+/* Allocates a sector for an inode and stores it into *SECTORP,
+ * preferably in the inode region of the group that holds sector
+ * NEAR, typically the inode of the directory that will contain
+ * the new one.  Otherwise uses the inode region of a following
+ * group, or any free sector.
+ * Returns true if successful, false if the disk is full or the
+ * free map file could not be written. */
+bool
+free_map_allocate_inode(block_sector_t near, block_sector_t *sectorp)
+{
+    return allocate(1, near, false, true, sectorp);
+}
+
+/* Sets aside CNT free sectors for a later
+ * free_map_allocate_reserved(), without choosing which ones.
+ * Returns true if successful, false if fewer than CNT sectors
+ * are free and unreserved. */
+bool
+free_map_reserve(size_t cnt)
+{
+    bool success;
+
+    lock_acquire(&free_map_lock);
+    success = enough_free(cnt, next_fit / GROUP_SECTORS % group_cnt);
+    if (success) {
+        reserved_cnt += cnt;
     }
-    return sector != BITMAP_ERROR;
+    lock_release(&free_map_lock);
+    return success;
+}
+
+/* Cancels the reservation of CNT sectors made by
+ * free_map_reserve(). */
+void
+free_map_unreserve(size_t cnt)
+{
+    lock_acquire(&free_map_lock);
+    ASSERT(reserved_cnt >= cnt);
+    reserved_cnt -= cnt;
+    lock_release(&free_map_lock);
+}
+
+/* Like free_map_allocate_near(), but takes the CNT sectors out of
+ * those set aside by free_map_reserve().  Fails only if they
+ * cannot be found consecutively, in which case the reservation
+ * is left in place. */
+bool
+free_map_allocate_reserved(size_t cnt, block_sector_t hint,
+                           block_sector_t *sectorp)
+{
+    return allocate(cnt, hint, true, false, sectorp);
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release(block_sector_t sector, size_t cnt)
 {
+    lock_acquire(&free_map_lock);
+    load_range(sector, cnt);
     ASSERT(bitmap_all(free_map, sector, cnt));
     bitmap_set_multiple(free_map, sector, cnt, false);
-    bitmap_write(free_map, free_map_file);
+    index_release(sector, cnt);
+    free_cnt += cnt;
+    bitmap_write_range(free_map, free_map_file, sector, cnt);
+    lock_release(&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Makes the CNT sectors in SECTORS, in any order, available for
+ * use, as free_map_release() would one run at a time, but writes
+ * each changed part of the free map file only once.  Sorts
+ * SECTORS. */
+void
+free_map_release_batch(block_sector_t *sectors, size_t cnt)
+{
+    block_sector_t lo = 0, hi = 0;  /* Changed and not yet written. */
+    size_t i, j;
+
+    sort(sectors, cnt, sizeof *sectors, sector_less, NULL);
+    lock_acquire(&free_map_lock);
+    for (i = 0; i < cnt; i = j) {
+        block_sector_t start = sectors[i];
+        size_t run;
+
+        for (j = i + 1; j < cnt && sectors[j] == start + (j - i); j++) {
+            continue;
+        }
+        run = j - i;
+        load_range(start, run);
+        ASSERT(bitmap_all(free_map, start, run));
+        bitmap_set_multiple(free_map, start, run, false);
+        index_release(start, run);
+        free_cnt += run;
+
+        /* Write the previous range once this run leaves its
+         * group, which is one sector of the file. */
+        if (hi > lo && start / GROUP_SECTORS != lo / GROUP_SECTORS) {
+            bitmap_write_range(free_map, free_map_file, lo, hi - lo);
+            lo = hi;
+        }
+        if (hi == lo) {
+            lo = start;
+        }
+        hi = start + run;
+    }
+    if (hi > lo) {
+        bitmap_write_range(free_map, free_map_file, lo, hi - lo);
+    }
+    lock_release(&free_map_lock);
+}
+
+/* Records that one more file's data includes SECTOR, which some
+ * file already owns.  Must be called inside a journaled
+ * operation.  Returns false if SECTOR has as many owners as the
+ * share map can count, or if the share map could not be
+ * written, in which case the caller must copy the sector
+ * instead. */
+bool
+free_map_share(block_sector_t sector)
+{
+    uint8_t cnt;
+    bool success;
+
+    lock_acquire(&share_lock);
+    cnt = share_cnt(sector);
+    success = cnt < UINT8_MAX && share_set(sector, cnt + 1);
+    lock_release(&share_lock);
+    return success;
+}
+
+/* Records that one of the files whose data includes SECTOR no
+ * longer uses it.  Must be called inside a journaled operation.
+ * Returns true if other files still do, false if the caller was
+ * the last owner, in which case it should release SECTOR. */
+bool
+free_map_unshare(block_sector_t sector)
+{
+    uint8_t cnt;
+
+    lock_acquire(&share_lock);
+    cnt = share_cnt(sector);
+    if (cnt > 0) {
+        /* If this fails, the sector stays counted as shared and
+         * leaks, rather than being freed under another owner. */
+        share_set(sector, cnt - 1);
+    }
+    lock_release(&share_lock);
+    return cnt > 0;
+}
+
+/* Returns true if more than one file's data includes SECTOR. */
+bool
+free_map_is_shared(block_sector_t sector)
+{
+    bool shared;
+
+    lock_acquire(&share_lock);
+    shared = share_cnt(sector) > 0;
+    lock_release(&share_lock);
+    return shared;
+}
+
+/* Opens the free map and share map files.  Each group's part of
+ * the free map is read from its file when first needed. */
 void
 free_map_open(void)
 {
@@ -60,34 +359,470 @@ free_map_open(void)
     if (free_map_file == NULL) {
         PANIC("can't open free map");
     }
-    if (!bitmap_read(free_map, free_map_file)) {
-        PANIC("can't read free map");
+    share_map_file = file_open(inode_open(SHARE_MAP_SECTOR));
+    if (share_map_file == NULL) {
+        PANIC("can't open share map");
     }
+    index_reset();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map and share map files.  Every allocation,
+ * release and change of sharing has already written the bytes of
+ * the maps that it changed, through the buffer cache, so there is
+ * nothing left to write. */
 void
 free_map_close(void)
 {
     file_close(free_map_file);
+    file_close(share_map_file);
+    share_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
- * it. */
+ * it.  Also creates the share map file, all zeros, which is to
+ * say no data at all yet. */
 void
 free_map_create(void)
 {
-    /* Create inode. */
+    struct file *file;
+
+    /* Create inodes. */
     if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map))) {
         PANIC("free map creation failed");
     }
+    if (!inode_create(SHARE_MAP_SECTOR, bitmap_size(free_map))) {
+        PANIC("share map creation failed");
+    }
 
-    /* Write bitmap to file. */
-    free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
-    if (free_map_file == NULL) {
+    /* Write bitmap to file.  The file starts out sparse, so the
+     * first write allocates its sectors and thereby changes the
+     * bitmap; the second write records those changes.  Leaving
+     * free_map_file null until then keeps free_map_allocate()
+     * from writing the bitmap recursively. */
+    file = file_open(inode_open(FREE_MAP_SECTOR));
+    if (file == NULL) {
         PANIC("can't open free map");
     }
-    if (!bitmap_write(free_map, free_map_file)) {
+    if (!bitmap_write(free_map, file) || !bitmap_write(free_map, file)) {
         PANIC("can't write free map");
     }
+    free_map_file = file;
+}
+
+/* Allocates CNT consecutive sectors, preferably starting at
+ * HINT, for free_map_allocate_near() or, if RESERVED is true,
+ * free_map_allocate_reserved(), or, if INODE is true, one sector
+ * for free_map_allocate_inode(). */
+static bool
+allocate(size_t cnt, block_sector_t hint, bool reserved, bool inode,
+         block_sector_t *sectorp)
+{
+    block_sector_t sector = BITMAP_ERROR;
+    size_t group = hint / GROUP_SECTORS % group_cnt;
+
+    ASSERT(cnt > 0);
+
+    lock_acquire(&free_map_lock);
+    if (reserved) {
+        ASSERT(reserved_cnt >= cnt);
+    } else if (!enough_free(cnt, group)) {
+        lock_release(&free_map_lock);
+        return false;
+    }
+    if (inode) {
+        ASSERT(cnt == 1);
+        sector = inode_region_scan(group);
+    }
+    if (sector != BITMAP_ERROR) {
+        /* Found an inode slot. */
+    } else if (index_valid) {
+        struct free_extent *e;
+
+        /* Data goes after the inode region. */
+        group_load(group);
+        if (hint % GROUP_SECTORS < GROUP_INODE_SECTORS) {
+            hint = hint - hint % GROUP_SECTORS + GROUP_INODE_SECTORS;
+        }
+        e = extent_find(&extents_by_start, hint);
+        if (e == NULL || e->length < cnt) {
+            e = extent_fit(cnt, group);
+        }
+        if (e != NULL) {
+            sector = e->start;
+            ASSERT(bitmap_none(free_map, sector, cnt));
+            extent_carve(e, cnt);
+            bitmap_set_multiple(free_map, sector, cnt, true);
+        } else if (cnt == 1) {
+            sector = inode_region_scan(group);
+        }
+    } else {
+        load_range(0, bitmap_size(free_map));
+        sector = bitmap_scan_and_flip(free_map, next_fit, cnt, false);
+        if (sector == BITMAP_ERROR) {
+            sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
+        }
+    }
+
+    if (sector != BITMAP_ERROR
+        && free_map_file != NULL
+        && !bitmap_write_range(free_map, free_map_file, sector, cnt)) {
+        bitmap_set_multiple(free_map, sector, cnt, false);
+        index_release(sector, cnt);
+        sector = BITMAP_ERROR;
+    }
+    if (sector != BITMAP_ERROR) {
+        *sectorp = sector;
+        next_fit = sector + cnt;
+        free_cnt -= cnt;
+        if (reserved) {
+            reserved_cnt -= cnt;
+        }
+    }
+    lock_release(&free_map_lock);
+    return sector != BITMAP_ERROR;
+}
+
+/* Marks a free sector in the inode region of GROUP, or failing
+ * that of the following groups in turn, as used and returns it.
+ * Returns BITMAP_ERROR if every inode region is full. */
+static block_sector_t
+inode_region_scan(size_t group)
+{
+    size_t size = bitmap_size(free_map);
+    size_t i;
+
+    for (i = 0; i < group_cnt; i++) {
+        size_t start = (group + i) % group_cnt * GROUP_SECTORS;
+        size_t end = start + GROUP_INODE_SECTORS;
+        size_t sector;
+
+        group_load((group + i) % group_cnt);
+        for (sector = start; sector < end && sector < size; sector++) {
+            if (!bitmap_test(free_map, sector)) {
+                bitmap_mark(free_map, sector);
+                return sector;
+            }
+        }
+    }
+    return BITMAP_ERROR;
+}
+
+/* Empties the extent index and marks every group not loaded. */
+static void
+index_reset(void)
+{
+    index_clear();
+    index_valid = true;
+    free_cnt = 0;
+    bitmap_set_all(loaded_groups, false);
+}
+
+/* Loads GROUP if it is not loaded yet: reads its part of the
+ * bitmap from the free map file, if there is one, and adds its
+ * free sectors to the count and its free runs to the index.  The
+ * caller must hold free_map_lock. */
+static void
+group_load(size_t group)
+{
+    size_t size = bitmap_size(free_map);
+    size_t start = group * GROUP_SECTORS;
+    size_t end = start + GROUP_SECTORS < size ? start + GROUP_SECTORS : size;
+
+    if (bitmap_test(loaded_groups, group)) {
+        return;
+    }
+    bitmap_mark(loaded_groups, group);
+    if (free_map_file != NULL
+        && !bitmap_read_range(free_map, free_map_file, start, end - start)) {
+        PANIC("can't read free map");
+    }
+    free_cnt += bitmap_count(free_map, start, end - start, false);
+    while (start < end) {
+        size_t stop;
+
+        start = bitmap_scan(free_map, start, 1, false);
+        if (start == BITMAP_ERROR || start >= end) {
+            break;
+        }
+        stop = bitmap_scan(free_map, start, 1, true);
+        if (stop == BITMAP_ERROR || stop > end) {
+            stop = end;
+        }
+        index_release(start, stop - start);
+        start = stop;
+    }
+}
+
+/* Loads every group that holds one of the CNT sectors starting at
+ * SECTOR. */
+static void
+load_range(block_sector_t sector, size_t cnt)
+{
+    size_t group;
+
+    if (cnt == 0) {
+        return;
+    }
+    for (group = sector / GROUP_SECTORS;
+         group <= (sector + cnt - 1) / GROUP_SECTORS; group++) {
+        group_load(group);
+    }
+}
+
+/* Returns true if at least CNT sectors are free and unreserved.
+ * Until they are, loads the groups not yet loaded, starting with
+ * GROUP, so that only a nearly full disk has to be read in
+ * whole. */
+static bool
+enough_free(size_t cnt, size_t group)
+{
+    size_t i;
+
+    for (i = 0; i < group_cnt && free_cnt - reserved_cnt < cnt; i++) {
+        group_load((group + i) % group_cnt);
+    }
+    return free_cnt - reserved_cnt >= cnt;
+}
+
+/* Frees every extent in the index. */
+static void
+index_clear(void)
+{
+    size_t g, i;
+
+    hash_clear(&extents_by_start, NULL);
+    hash_clear(&extents_by_end, NULL);
+    for (g = 0; g < group_cnt; g++) {
+        for (i = 0; i < SIZE_CLASS_CNT; i++) {
+            struct list *list = &size_classes[g][i];
+            while (!list_empty(list)) {
+                struct list_elem *e = list_pop_front(list);
+                free(list_entry(e, struct free_extent, size_elem));
+            }
+        }
+    }
+}
+
+/* Returns the size class for an extent of LENGTH sectors. */
+static size_t
+size_class(size_t length)
+{
+    size_t class = 0;
+
+    ASSERT(length > 0);
+    while (length > 1 && class < SIZE_CLASS_CNT - 1) {
+        length >>= 1;
+        class++;
+    }
+    return class;
+}
+
+/* Adds the extent of LENGTH sectors at START, which must lie
+ * within one group's data area, to the index, which must not
+ * already contain any of them.  If memory runs out, marks the
+ * index invalid instead. */
+static void
+extent_insert(block_sector_t start, size_t length)
+{
+    struct free_extent *e;
+
+    if (!index_valid) {
+        return;
+    }
+    e = malloc(sizeof *e);
+    if (e == NULL) {
+        index_valid = false;
+        return;
+    }
+    e->start = start;
+    e->length = length;
+    hash_insert(&extents_by_start, &e->start_elem);
+    hash_insert(&extents_by_end, &e->end_elem);
+    list_push_back(&size_classes[start / GROUP_SECTORS][size_class(length)],
+                   &e->size_elem);
+}
+
+/* Removes E from the index and frees it. */
+static void
+extent_remove(struct free_extent *e)
+{
+    hash_delete(&extents_by_start, &e->start_elem);
+    hash_delete(&extents_by_end, &e->end_elem);
+    list_remove(&e->size_elem);
+    free(e);
+}
+
+/* Removes the first CNT sectors of extent E from the index. */
+static void
+extent_carve(struct free_extent *e, size_t cnt)
+{
+    ASSERT(cnt <= e->length);
+
+    if (cnt == e->length) {
+        extent_remove(e);
+        return;
+    }
+
+    hash_delete(&extents_by_start, &e->start_elem);
+    list_remove(&e->size_elem);
+    e->start += cnt;
+    e->length -= cnt;
+    hash_insert(&extents_by_start, &e->start_elem);
+    list_push_back(&size_classes[e->start / GROUP_SECTORS]
+                                [size_class(e->length)],
+                   &e->size_elem);
+}
+
+/* Returns the extent in HASH, which is either extents_by_start or
+ * extents_by_end, whose key is SECTOR, or a null pointer if there
+ * is none. */
+static struct free_extent *
+extent_find(struct hash *hash, block_sector_t sector)
+{
+    struct free_extent key;
+    struct hash_elem *e;
+
+    key.start = sector;
+    key.length = 0;
+    if (hash == &extents_by_start) {
+        e = hash_find(hash, &key.start_elem);
+        return e != NULL ? hash_entry(e, struct free_extent, start_elem) : NULL;
+    } else {
+        e = hash_find(hash, &key.end_elem);
+        return e != NULL ? hash_entry(e, struct free_extent, end_elem) : NULL;
+    }
+}
+
+/* Returns an extent of at least CNT sectors, preferably in
+ * GROUP, otherwise in the first following group that has one, or
+ * a null pointer if there is none.  Only the smallest class that
+ * might hold CNT sectors needs a scan; every extent in a larger
+ * class fits. */
+static struct free_extent *
+extent_fit(size_t cnt, size_t group)
+{
+    size_t i, class;
+
+    for (i = 0; i < group_cnt; i++) {
+        struct list *classes = size_classes[(group + i) % group_cnt];
+
+        group_load((group + i) % group_cnt);
+        for (class = size_class(cnt); class < SIZE_CLASS_CNT; class++) {
+            struct list_elem *e;
+
+            for (e = list_begin(&classes[class]);
+                 e != list_end(&classes[class]); e = list_next(e)) {
+                struct free_extent *x = list_entry(e, struct free_extent,
+                                                   size_elem);
+                if (x->length >= cnt) {
+                    return x;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Adds the CNT newly freed sectors at SECTOR to the index,
+ * merging them with the free extents on either side.  The part
+ * in each group's data area becomes or joins a separate extent;
+ * sectors in inode regions are left out. */
+static void
+index_release(block_sector_t sector, size_t cnt)
+{
+    block_sector_t end = sector + cnt;
+
+    while (sector < end && index_valid) {
+        block_sector_t group_start = sector - sector % GROUP_SECTORS;
+        block_sector_t data_start = group_start + GROUP_INODE_SECTORS;
+        block_sector_t group_end = group_start + GROUP_SECTORS;
+        block_sector_t start = sector > data_start ? sector : data_start;
+        block_sector_t stop = end < group_end ? end : group_end;
+
+        if (start < stop) {
+            struct free_extent *left, *right;
+
+            left = extent_find(&extents_by_end, start);
+            right = extent_find(&extents_by_start, stop);
+            if (left != NULL) {
+                start = left->start;
+                extent_remove(left);
+            }
+            if (right != NULL) {
+                stop += right->length;
+                extent_remove(right);
+            }
+            extent_insert(start, stop - start);
+        }
+        sector = group_end;
+    }
+}
+
+/* Hashes an extent by its first sector. */
+static unsigned
+extent_start_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    return hash_int(hash_entry(e, struct free_extent, start_elem)->start);
+}
+
+/* Orders extents by first sector. */
+static bool
+extent_start_less(const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+    return (hash_entry(a, struct free_extent, start_elem)->start
+            < hash_entry(b, struct free_extent, start_elem)->start);
+}
+
+/* Returns the sector just past the end of E. */
+static block_sector_t
+extent_end(const struct hash_elem *e)
+{
+    const struct free_extent *x = hash_entry(e, struct free_extent, end_elem);
+    return x->start + x->length;
+}
+
+/* Hashes an extent by the sector just past its end. */
+static unsigned
+extent_end_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    return hash_int(extent_end(e));
+}
+
+/* Orders extents by the sector just past their ends. */
+static bool
+extent_end_less(const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+    return extent_end(a) < extent_end(b);
+}
+
+/* Returns the number of files besides the first that share
+ * SECTOR.  The caller must hold share_lock. */
+static uint8_t
+share_cnt(block_sector_t sector)
+{
+    uint8_t cnt = 0;
+
+    file_read_at(share_map_file, &cnt, 1, sector);
+    return cnt;
+}
+
+/* Sets the number of files besides the first that share SECTOR
+ * to CNT.  The caller must hold share_lock.  Returns false if the
+ * share map could not be written. */
+static bool
+share_set(block_sector_t sector, uint8_t cnt)
+{
+    return file_write_at(share_map_file, &cnt, 1, sector) == 1;
+}
+
+/* Orders sector numbers ascending. */
+static int
+sector_less(const void *a_, const void *b_, void *aux UNUSED)
+{
+    block_sector_t a = *(const block_sector_t *) a_;
+    block_sector_t b = *(const block_sector_t *) b_;
+
+    return a < b ? -1 : a > b;
 }
@@ -12,6 +12,16 @@ void free_map_create(void);
 void free_map_open(void);
 void free_map_close(void);
 bool free_map_allocate(size_t, block_sector_t *);
+bool free_map_allocate_near(size_t, block_sector_t hint, block_sector_t *);
+bool free_map_allocate_inode(block_sector_t near, block_sector_t *);
+bool free_map_reserve(size_t);
+void free_map_unreserve(size_t);
+bool free_map_allocate_reserved(size_t, block_sector_t hint,
+                                block_sector_t *);
 void free_map_release(block_sector_t, size_t);
+void free_map_release_batch(block_sector_t *, size_t cnt);
+bool free_map_share(block_sector_t);
+bool free_map_unshare(block_sector_t);
+bool free_map_is_shared(block_sector_t);
 
 #endif /* filesys/free-map.h */
@@ -1,4 +1,5 @@
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,10 +9,14 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors that fsutil_extract() copies at a time. */
+#define EXTRACT_CHUNK 32
+
 /* List files in the root directory. */
 void
 fsutil_ls(char **argv UNUSED)
@@ -72,6 +77,47 @@ fsutil_rm(char **argv)
     }
 }
 
+/* Moves the data of each file in the root directory that is in
+ * more than one extent into a single one, where there is room,
+ * and reports what it did. */
+void
+fsutil_defrag(char **argv UNUSED)
+{
+    struct dir *dir;
+    char name[NAME_MAX + 1];
+    size_t file_cnt = 0, moved_cnt = 0;
+
+    printf("Defragmenting files in the root directory...\n");
+    dir = dir_open_root();
+    if (dir == NULL) {
+        PANIC("root dir open failed");
+    }
+    while (dir_readdir(dir, name)) {
+        struct file *file = filesys_open(name);
+        struct inode *inode;
+        size_t before;
+
+        if (file == NULL) {
+            PANIC("%s: open failed", name);
+        }
+        inode = file_get_inode(file);
+        before = inode_extent_cnt(inode);
+        file_cnt++;
+        if (before > 1) {
+            bool ok = inode_defrag(inode);
+
+            printf("%s: %zu extents, now %zu%s\n", name, before,
+                   inode_extent_cnt(inode), ok ? "" : " (no room)");
+            if (ok) {
+                moved_cnt++;
+            }
+        }
+        file_close(file);
+    }
+    dir_close(dir);
+    printf("Defragmented %zu of %zu files.\n", moved_cnt, file_cnt);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
  * device into the Pintos file system. */
 void
@@ -84,7 +130,7 @@ fsutil_extract(char **argv UNUSED)
 
     /* Allocate buffers. */
     header = malloc(BLOCK_SECTOR_SIZE);
-    data = malloc(BLOCK_SECTOR_SIZE);
+    data = malloc(EXTRACT_CHUNK * BLOCK_SECTOR_SIZE);
     if (header == NULL || data == NULL) {
         PANIC("couldn't allocate buffers");
     }
@@ -130,13 +176,21 @@ fsutil_extract(char **argv UNUSED)
                 PANIC("%s: open failed", file_name);
             }
 
-            /* Do copy. */
+            /* Do copy, EXTRACT_CHUNK sectors at a time.  Each
+             * chunk's sectors are allocated in one extent before it
+             * is written, instead of one at a time by the write. */
             while (size > 0) {
-                int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-                block_read(src, sector++, data);
-                if (file_write(dst, data, chunk_size) != chunk_size) {
+                int chunk_size = (size > EXTRACT_CHUNK * BLOCK_SECTOR_SIZE
+                                  ? EXTRACT_CHUNK * BLOCK_SECTOR_SIZE
+                                  : size);
+                block_sector_t chunk_sectors = DIV_ROUND_UP(chunk_size,
+                                                            BLOCK_SECTOR_SIZE);
+
+                block_read_multiple(src, sector, chunk_sectors, data);
+                sector += chunk_sectors;
+                if (!inode_preallocate(file_get_inode(dst), file_tell(dst),
+                                       chunk_size)
+                    || file_write(dst, data, chunk_size) != chunk_size) {
                     PANIC("%s: write failed with %d bytes unwritten",
                           file_name, size);
                 }
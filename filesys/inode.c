@@ -1,11 +1,23 @@
 #include <debug.h>
+#include <lz.h>
 #include <round.h>
 #include <string.h>
 
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/atomic.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -18,6 +30,113 @@ bytes_to_sectors(off_t size)
     return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE);
 }
 
+/* Sector number stored in a block pointer that points nowhere. */
+#define UNALLOCATED 0
+
+/* Marks an inode's CHUNK_BUF as holding no chunk. */
+#define CHUNK_NONE SIZE_MAX
+
+/* Most data sectors that inode_preallocate() allocates in one
+ * journaled operation.  They need at most two indirect blocks,
+ * so the operation stays well within JOURNAL_OP_MAX sectors. */
+#define PREALLOCATE_MAX INODE_PTRS_PER_SECTOR
+
+/* Most sectors that the reclaimer frees in one journaled
+ * operation.  A file allocated in extents spans few block groups
+ * per batch, so the free map sectors it changes stay well within
+ * JOURNAL_OP_MAX. */
+#define RECLAIM_BATCH INODE_PTRS_PER_SECTOR
+
+/* Most sectors that inode_defrag() moves in one journaled
+ * operation.  Their old sectors may lie in as many block groups,
+ * whose free map sectors, with the index blocks, the inode and
+ * the free map sector of the new ones, stay within
+ * JOURNAL_OP_MAX. */
+#define DEFRAG_BATCH 8
+
+/* Most data sectors that inode_clone() shares in one journaled
+ * operation.  Each may change a different sector of the share
+ * map, which with the share map's own index, the clone's index
+ * blocks, its inode and the free map stays within
+ * JOURNAL_OP_MAX. */
+#define CLONE_BATCH 4
+
+static block_sector_t index_lookup(const struct inode_disk *, size_t idx);
+
+static block_sector_t *index_root(struct inode_disk *, size_t *idx,
+                                  size_t *span);
+
+static bool allocate_zeroed(block_sector_t *, block_sector_t *hint,
+                            bool is_data);
+
+static bool allocate_slot(block_sector_t table, size_t slot,
+                          block_sector_t *hint, bool is_data,
+                          block_sector_t *);
+
+static bool index_allocate(struct inode_disk *, size_t idx,
+                           block_sector_t hint, block_sector_t data);
+
+static bool install_data(block_sector_t *, block_sector_t *hint,
+                         block_sector_t data);
+
+static bool install_slot(block_sector_t table, size_t slot,
+                         block_sector_t *hint, block_sector_t data);
+
+static bool delay_write(struct inode *, size_t idx, const void *,
+                        int ofs, int size);
+
+static void delay_read(struct inode *, size_t idx, void *, int ofs,
+                       int size);
+
+static void delay_flush(struct inode *);
+
+static block_sector_t unshare(struct inode *, size_t idx,
+                              block_sector_t sector, bool whole);
+
+static void drop_sector(block_sector_t);
+
+static off_t read_at(struct inode *, void *, off_t size, off_t offset,
+                     enum cache_hint, bool page);
+
+static off_t write_at(struct inode *, const void *, off_t size,
+                      off_t offset, enum cache_hint);
+
+static off_t direct_run(struct inode *, off_t offset, off_t size,
+                        block_sector_t first);
+
+static off_t inline_read(struct inode *, void *, off_t size, off_t offset);
+
+static off_t inline_write(struct inode *, const void *, off_t size,
+                          off_t offset);
+
+static bool inline_convert(struct inode *);
+
+static off_t chunk_read(struct inode *, void *, off_t size, off_t offset);
+
+static off_t chunk_write(struct inode *, const void *, off_t size,
+                         off_t offset);
+
+static bool chunk_load(struct inode *, size_t chunk);
+
+static bool chunk_store(struct inode *);
+
+static size_t chunk_sectors(const struct inode_disk *, size_t chunk,
+                            block_sector_t sectors[]);
+
+static void index_clear(struct inode_disk *, size_t idx);
+
+static thread_func reclaim_thread;
+
+static void reclaim_blocks(struct inode *);
+
+static void reclaim_table(block_sector_t table, int level, bool shared);
+
+static void reclaim_data(block_sector_t, bool shared);
+
+static void reclaim_add(block_sector_t);
+
+static void reclaim_flush(void);
+
 /* Returns the block device sector that contains byte offset POS
  * within INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
@@ -27,28 +146,99 @@ byte_to_sector(const struct inode *inode, off_t pos)
 {
     ASSERT(inode != NULL);
     if (pos < inode->data.length) {
-        return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+        return index_lookup(&inode->data, pos / BLOCK_SECTOR_SIZE);
     } else {
         return -1;
     }
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, keyed by sector, so that opening a
+ * single inode twice returns the same `struct inode'.  The lock
+ * protects the table against other writers.  OPEN_CNT changes
+ * atomically, but only with the lock held can it drop to 0, so
+ * that the last close and the removal from the table are one
+ * step.
+ *
+ * inode_open() first looks an inode up in an RCU read section,
+ * without the lock.  The read section cannot be preempted, so if
+ * no thread holds the lock when it starts, none is partway
+ * through changing the table or closing an inode, and none can
+ * start until the section ends.  A closed inode is freed through
+ * call_rcu(). */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Open inodes whose delayed allocation window is not empty, and
+ * the lock that protects the list. */
+static struct list delayed_inodes;
+static struct lock delayed_lock;
+
+/* Removed inodes, closed for the last time, whose blocks the
+ * reclaimer thread has yet to free, linked through DELAY_ELEM,
+ * which closing frees for this use.  RECLAIM_LOCK protects the
+ * queue and RECLAIMING, which is true while the reclaimer works
+ * on an inode it has taken off the queue.  RECLAIM_CHANGED is
+ * signaled when either changes. */
+static struct list reclaim_queue;
+static struct lock reclaim_lock;
+static struct condition reclaim_changed;
+static bool reclaiming;
+
+/* Sectors the reclaimer has found but not yet freed.  Used only
+ * by the reclaimer thread. */
+static block_sector_t reclaim_batch[RECLAIM_BATCH];
+static size_t reclaim_cnt;
+
+/* Memory for in-memory inodes. */
+static struct kmem_cache *inode_cache;
+
+/* Scratch space for compressing and decompressing the chunks of
+ * compressed files, and the lock that protects it. */
+static struct lock chunk_lock;
+static lz_table chunk_table;
+static uint8_t chunk_zbuf[INODE_CHUNK_SIZE];
+
+static struct inode *open_inode_find(block_sector_t);
+
+static rcu_func inode_free;
+
+static hash_hash_func inode_hash;
+
+static hash_less_func inode_less;
+
+static inline unsigned inode_key_hash(const struct inode *);
+
+static inline bool inode_key_equal(const struct inode *,
+                                   const struct inode *);
+
+HASH_DEFINE(inode_table, struct inode, elem, inode_key_hash, inode_key_equal)
 
 /* Initializes the inode module. */
 void
 inode_init(void)
 {
-    list_init(&open_inodes);
+    hash_init(&open_inodes, inode_hash, inode_less, NULL);
+    lock_init(&open_inodes_lock);
+    list_init(&delayed_inodes);
+    lock_init(&delayed_lock);
+    list_init(&reclaim_queue);
+    lock_init(&reclaim_lock);
+    cond_init(&reclaim_changed);
+    reclaiming = false;
+    lock_init(&chunk_lock);
+    inode_cache = kmem_cache_create("inode", sizeof(struct inode), 0, NULL);
+    thread_create("reclaim", PRI_DEFAULT, reclaim_thread, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * device.
+ * device.  The data starts out as one big hole: no data sectors
+ * are allocated until they are first written, so this takes
+ * constant time regardless of LENGTH.  A small enough file
+ * starts out with its data inline.
  * Returns true if successful.
- * Returns false if memory or disk allocation fails. */
+ * Returns false if memory allocation fails or LENGTH is more
+ * than INODE_LENGTH_MAX. */
 bool
 inode_create(block_sector_t sector, off_t length)
 {
@@ -56,6 +246,9 @@ inode_create(block_sector_t sector, off_t length)
     bool success = false;
 
     ASSERT(length >= 0);
+    if (length > INODE_LENGTH_MAX) {
+        return false;
+    }
 
     /* If this assertion fails, the inode structure is not exactly
      * one sector in size, and you should fix that. */
@@ -63,21 +256,13 @@ inode_create(block_sector_t sector, off_t length)
 
     disk_inode = calloc(1, sizeof *disk_inode);
     if (disk_inode != NULL) {
-        size_t sectors = bytes_to_sectors(length);
         disk_inode->length = length;
         disk_inode->magic = INODE_MAGIC;
-        if (free_map_allocate(sectors, &disk_inode->start)) {
-            block_write(fs_device, sector, disk_inode);
-            if (sectors > 0) {
-                static char zeros[BLOCK_SECTOR_SIZE];
-                size_t i;
-
-                for (i = 0; i < sectors; i++) {
-                    block_write(fs_device, disk_inode->start + i, zeros);
-                }
-            }
-            success = true;
+        if (length <= (off_t) INODE_INLINE_MAX) {
+            disk_inode->flags = INODE_INLINE;
         }
+        cache_write(sector, disk_inode);
+        success = true;
         free(disk_inode);
     }
     return success;
@@ -89,41 +274,83 @@ inode_create(block_sector_t sector, off_t length)
 struct inode *
 inode_open(block_sector_t sector)
 {
-    struct list_elem *e;
-    struct inode *inode;
+    struct inode *inode, *other;
 
-    /* Check whether this inode is already open. */
-    for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
-         e = list_next(e)) {
-        inode = list_entry(e, struct inode, elem);
-        if (inode->sector == sector) {
-            inode_reopen(inode);
-            return inode;
+    /* Check whether this inode is already open, without the lock
+     * if no other thread holds it. */
+    rcu_read_lock();
+    inode = NULL;
+    if (open_inodes_lock.holder == NULL) {
+        inode = open_inode_find(sector);
+        if (inode != NULL) {
+            atomic_inc(&inode->open_cnt);
         }
     }
+    rcu_read_unlock();
+    if (inode != NULL) {
+        return inode;
+    }
+
+    /* Check again with the lock. */
+    lock_acquire(&open_inodes_lock);
+    inode = open_inode_find(sector);
+    if (inode != NULL) {
+        atomic_inc(&inode->open_cnt);
+    }
+    lock_release(&open_inodes_lock);
+    if (inode != NULL) {
+        return inode;
+    }
 
     /* Allocate memory. */
-    inode = malloc(sizeof *inode);
+    inode = kmem_cache_alloc(inode_cache);
     if (inode == NULL) {
         return NULL;
     }
 
-    /* Initialize. */
-    list_push_front(&open_inodes, &inode->elem);
+    /* Initialize.  Reading the disk inode may sleep, so it is done
+     * without the lock. */
     inode->sector = sector;
     inode->open_cnt = 1;
     inode->deny_write_cnt = 0;
     inode->removed = false;
-    block_read(fs_device, inode->sector, &inode->data);
+    inode->free_hint = 0;
+    inode->write_cnt = 0;
+    inode->frame_cnt = 0;
+    inode->delay_buf = NULL;
+    inode->delay_start = 0;
+    inode->delay_cnt = 0;
+    inode->sync_start = inode->sync_end = 0;
+    inode->chunk_buf = NULL;
+    inode->chunk_idx = CHUNK_NONE;
+    lock_init(&inode->lock);
+    rwlock_init(&inode->dir_lock);
+    cache_read(inode->sector, &inode->data);
+
+    /* Add it to the table, unless another thread opened the same
+     * inode in the meantime. */
+    lock_acquire(&open_inodes_lock);
+    other = open_inode_find(sector);
+    if (other != NULL) {
+        atomic_inc(&other->open_cnt);
+    } else {
+        inode_table_insert(&open_inodes, inode);
+    }
+    lock_release(&open_inodes_lock);
+    if (other != NULL) {
+        kmem_cache_free(inode_cache, inode);
+        inode = other;
+    }
     return inode;
 }
 
-/* Reopens and returns INODE. */
+/* Reopens and returns INODE.  The caller's own reference keeps
+ * OPEN_CNT above 0, so this needs no lock. */
 struct inode *
 inode_reopen(struct inode *inode)
 {
     if (inode != NULL) {
-        inode->open_cnt++;
+        atomic_inc(&inode->open_cnt);
     }
     return inode;
 }
@@ -137,29 +364,69 @@ inode_get_inumber(const struct inode *inode)
 
 /* Closes INODE and writes it to disk.
  * If this was the last reference to INODE, frees its memory.
- * If INODE was also a removed inode, frees its blocks. */
+ * If INODE was also a removed inode, queues it for the reclaimer
+ * thread, which frees its blocks and then its memory, so that
+ * closing takes constant time however big the file was. */
 void
 inode_close(struct inode *inode)
 {
+    bool last;
+
     /* Ignore null pointer. */
     if (inode == NULL) {
         return;
     }
 
+    /* Allocate delayed data while the inode is certainly still
+     * open, so that inode_allocate_delayed() never finds a freed
+     * inode on its list.  Only another opener can add more. */
+    if (inode->delay_cnt > 0) {
+        delay_flush(inode);
+    }
+
     /* Release resources if this was the last opener. */
-    if (--inode->open_cnt == 0) {
-        /* Remove from inode list and release lock. */
-        list_remove(&inode->elem);
+    lock_acquire(&open_inodes_lock);
+    last = atomic_dec_and_test(&inode->open_cnt);
+    if (last) {
+        inode_table_delete(&open_inodes, inode);
+    }
+    lock_release(&open_inodes_lock);
+
+    if (last) {
+        if (inode->chunk_buf != NULL) {
+            palloc_free_page(inode->chunk_buf);
+        }
 
         /* Deallocate blocks if removed. */
         if (inode->removed) {
-            free_map_release(inode->sector, 1);
-            free_map_release(inode->data.start,
-                             bytes_to_sectors(inode->data.length));
+            lock_acquire(&reclaim_lock);
+            list_push_back(&reclaim_queue, &inode->delay_elem);
+            cond_broadcast(&reclaim_changed, &reclaim_lock);
+            lock_release(&reclaim_lock);
+        } else {
+            call_rcu(&inode->rcu, inode_free);
         }
+    }
+}
 
-        free(inode);
+/* Waits until the reclaimer has freed the blocks of every removed
+ * inode closed so far. */
+void
+inode_reclaim_wait(void)
+{
+    lock_acquire(&reclaim_lock);
+    while (!list_empty(&reclaim_queue) || reclaiming) {
+        cond_wait(&reclaim_changed, &reclaim_lock);
     }
+    lock_release(&reclaim_lock);
+}
+
+/* Frees the inode that contains HEAD, after any inode_open() that
+ * might have found it in the table has finished looking. */
+static void
+inode_free(struct rcu_head *head)
+{
+    kmem_cache_free(inode_cache, rcu_entry(head, struct inode, rcu));
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -168,22 +435,73 @@ void
 inode_remove(struct inode *inode)
 {
     ASSERT(inode != NULL);
+    lock_acquire(&inode->lock);
     inode->removed = true;
+    lock_release(&inode->lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
+ * than SIZE if an error occurs or end of file is reached.
+ *
+ * Pages of the file that are mapped into some process are read
+ * from the frames that hold them, which have the data as the
+ * mappings see it, rather than from the buffer cache.  The
+ * buffer cache treats the data as metadata, as for a directory;
+ * see inode_read_data() for file contents. */
+off_t
+inode_read_at(struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+    return read_at(inode, buffer, size, offset, CACHE_META, false);
+}
+
+/* Reads SIZE bytes of file contents from INODE into BUFFER,
+ * starting at position OFFSET, as inode_read_at() does.  If
+ * STREAM is true, the read is part of a sequential scan, and the
+ * buffer cache lets its sectors go first. */
 off_t
-inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
+inode_read_data(struct inode *inode, void *buffer, off_t size, off_t offset,
+                bool stream)
+{
+    return read_at(inode, buffer, size, offset,
+                   stream ? CACHE_STREAM : CACHE_DATA, false);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+ * OFFSET, as inode_read_at() does, to fill a frame that will
+ * hold the data.  Whole sectors in neither the buffer cache nor
+ * a shared frame are read straight from disk, so that the data
+ * is not kept twice. */
+off_t
+inode_read_page(struct inode *inode, void *buffer, off_t size,
+                off_t offset)
+{
+    return read_at(inode, buffer, size, offset, CACHE_DATA, true);
+}
+
+/* Does the work of the inode_read_*() functions, with HINT for
+ * the buffer cache.  If PAGE is true, whole sectors bypass it. */
+static off_t
+read_at(struct inode *inode, void *buffer_, off_t size, off_t offset,
+        enum cache_hint hint, bool page)
 {
     uint8_t *buffer = buffer_;
     off_t bytes_read = 0;
-    uint8_t *bounce = NULL;
+
+    if (inode->data.flags & INODE_COMPRESSED) {
+        return chunk_read(inode, buffer, size, offset);
+    }
+    if (inode->data.flags & INODE_INLINE) {
+        bytes_read = inline_read(inode, buffer, size, offset);
+        if (bytes_read >= 0) {
+            return bytes_read;
+        }
+        bytes_read = 0;
+    }
 
     while (size > 0) {
         /* Disk sector to read, starting byte offset within sector. */
-        block_sector_t sector_idx = byte_to_sector(inode, offset);
+        block_sector_t sector_idx;
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -197,20 +515,51 @@ inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
             break;
         }
 
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Read full sector directly into caller's buffer. */
-            block_read(fs_device, sector_idx, buffer + bytes_read);
-        } else {
-            /* Read sector into bounce buffer, then partially copy
-             * into caller's buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(BLOCK_SECTOR_SIZE);
-                if (bounce == NULL) {
-                    break;
-                }
+#ifdef VM
+        /* Copy out of a mapped page, up to the end of the page. */
+        if (inode->frame_cnt > 0) {
+            off_t cnt = frame_cache_read(inode, buffer + bytes_read,
+                                         size < inode_left ? size : inode_left,
+                                         offset);
+            if (cnt > 0) {
+                size -= cnt;
+                offset += cnt;
+                bytes_read += cnt;
+                continue;
+            }
+        }
+#endif
+
+        sector_idx = byte_to_sector(inode, offset);
+
+        /* A streaming read of whole sectors, consecutive on disk,
+         * goes straight into BUFFER, without a copy through the
+         * cache or pushing anything out of it. */
+        if (sector_idx != UNALLOCATED && hint == CACHE_STREAM) {
+            off_t run = direct_run(inode, offset,
+                                   size < inode_left ? size : inode_left,
+                                   sector_idx);
+            if (run > 0
+                && cache_read_direct(sector_idx, run / BLOCK_SECTOR_SIZE,
+                                     buffer + bytes_read)) {
+                size -= run;
+                offset += run;
+                bytes_read += run;
+                continue;
             }
-            block_read(fs_device, sector_idx, bounce);
-            memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
+        }
+
+        if (sector_idx == UNALLOCATED) {
+            /* A hole reads as zeros, without any I/O, unless it
+             * is appended data still awaiting allocation. */
+            delay_read(inode, offset / BLOCK_SECTOR_SIZE,
+                       buffer + bytes_read, sector_ofs, chunk_size);
+        } else if (page && chunk_size == BLOCK_SECTOR_SIZE) {
+            cache_read_uncached(sector_idx, buffer + bytes_read);
+        } else {
+            /* Copy out of the buffer cache. */
+            cache_read_hint(sector_idx, buffer + bytes_read, sector_ofs,
+                            chunk_size, hint);
         }
 
         /* Advance. */
@@ -218,85 +567,391 @@ inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
         offset += chunk_size;
         bytes_read += chunk_size;
     }
-    free(bounce);
 
     return bytes_read;
 }
 
+/* Asks the buffer cache to fetch, in the background, the
+ * SECTORS sectors of INODE's data that follow byte OFFSET,
+ * stopping at end of file and skipping holes. */
+void
+inode_read_ahead(struct inode *inode, off_t offset, int sectors)
+{
+    off_t pos = ROUND_UP(offset, BLOCK_SECTOR_SIZE);
+
+    for (; sectors > 0 && pos < inode_length(inode); sectors--) {
+        block_sector_t sector = byte_to_sector(inode, pos);
+        if (sector != UNALLOCATED) {
+            cache_read_ahead(sector);
+        }
+        pos += BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Asks the buffer cache to fetch the disk inode at SECTOR in the
+ * background, unless that inode is open already, so that opening
+ * it later finds the sector there.  For directory scans, which
+ * are usually followed by opening the entries they list. */
+void
+inode_prefetch(block_sector_t sector)
+{
+    bool open;
+
+    lock_acquire(&open_inodes_lock);
+    open = open_inode_find(sector) != NULL;
+    lock_release(&open_inodes_lock);
+    if (!open) {
+        cache_read_ahead(sector);
+    }
+}
+
+/* Returns true if reading the SIZE bytes of INODE's data at
+ * OFFSET would need no disk I/O: every sector they cover is in
+ * the buffer cache, is a hole, or is still waiting for delayed
+ * allocation.  Data kept inline in the inode is always at hand. */
+bool
+inode_is_cached(struct inode *inode, off_t offset, off_t size)
+{
+    off_t pos = ROUND_DOWN(offset, BLOCK_SECTOR_SIZE);
+
+    if (inode->data.flags & INODE_INLINE) {
+        return true;
+    }
+    for (; pos < offset + size && pos < inode_length(inode);
+         pos += BLOCK_SECTOR_SIZE) {
+        block_sector_t sector = byte_to_sector(inode, pos);
+        if (sector != UNALLOCATED && !cache_contains(sector)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * A write past end of file extends the inode.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up, the file would grow past
+ * INODE_LENGTH_MAX, or an error occurs.
+ *
+ * Data appended to a regular file does not get sectors right
+ * away.  It is buffered in the inode's delayed allocation window
+ * and allocated all at once, as one contiguous extent, when the
+ * flusher thread calls inode_allocate_delayed(), when the window
+ * fills up, or when the file is closed.
+ *
+ * As with inode_read_at(), the buffer cache treats the data as
+ * metadata; see inode_write_data() for file contents. */
 off_t
-inode_write_at(struct inode *inode, const void *buffer_, off_t size,
+inode_write_at(struct inode *inode, const void *buffer, off_t size,
                off_t offset)
+{
+    return write_at(inode, buffer, size, offset, CACHE_META);
+}
+
+/* Writes SIZE bytes of file contents from BUFFER into INODE,
+ * starting at OFFSET, as inode_write_at() does. */
+off_t
+inode_write_data(struct inode *inode, const void *buffer, off_t size,
+                 off_t offset)
+{
+    return write_at(inode, buffer, size, offset, CACHE_DATA);
+}
+
+/* Does the work of inode_write_at() and inode_write_data(), with
+ * HINT for the buffer cache. */
+static off_t
+write_at(struct inode *inode, const void *buffer_, off_t size, off_t offset,
+         enum cache_hint hint)
 {
     const uint8_t *buffer = buffer_;
     off_t bytes_written = 0;
-    uint8_t *bounce = NULL;
 
+    lock_acquire(&inode->lock);
     if (inode->deny_write_cnt) {
+        lock_release(&inode->lock);
+        return 0;
+    }
+    lock_release(&inode->lock);
+
+    /* Nothing is written past the largest file. */
+    if (offset >= INODE_LENGTH_MAX) {
         return 0;
+    } else if (size > INODE_LENGTH_MAX - offset) {
+        size = INODE_LENGTH_MAX - offset;
+    }
+
+    if (inode->data.flags & INODE_INLINE) {
+        bytes_written = inline_write(inode, buffer, size, offset);
+        if (bytes_written >= 0) {
+            return bytes_written;
+        }
+        bytes_written = 0;
+    }
+    if (inode->data.flags & INODE_COMPRESSED) {
+        bytes_written = chunk_write(inode, buffer, size, offset);
+        offset += bytes_written;
+        size = 0;
     }
 
     while (size > 0) {
         /* Sector to write, starting byte offset within sector. */
-        block_sector_t sector_idx = byte_to_sector(inode, offset);
+        size_t idx = offset / BLOCK_SECTOR_SIZE;
+        block_sector_t sector_idx = index_lookup(&inode->data, idx);
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-        /* Bytes left in inode, bytes left in sector, lesser of the two. */
-        off_t inode_left = inode_length(inode) - offset;
+        /* Number of bytes to actually write into this sector. */
         int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-        int min_left = inode_left < sector_left ? inode_left : sector_left;
+        int chunk_size = size < sector_left ? size : sector_left;
 
-        /* Number of bytes to actually write into this sector. */
-        int chunk_size = size < min_left ? size : min_left;
-        if (chunk_size <= 0) {
-            break;
+        /* A large write of whole sectors that are already
+         * allocated, consecutively, goes straight to disk. */
+        if (sector_idx != UNALLOCATED && hint != CACHE_META) {
+            off_t run = direct_run(inode, offset, size, sector_idx);
+            if (run > 0) {
+                cache_write_direct(sector_idx, run / BLOCK_SECTOR_SIZE,
+                                   buffer + bytes_written);
+                size -= run;
+                offset += run;
+                bytes_written += run;
+                continue;
+            }
         }
 
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            block_write(fs_device, sector_idx, buffer + bytes_written);
-        } else {
-            /* We need a bounce buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(BLOCK_SECTOR_SIZE);
-                if (bounce == NULL) {
-                    break;
+        /* Appended data waits for allocation, if it can. */
+        if (sector_idx == UNALLOCATED
+            && delay_write(inode, idx, buffer + bytes_written, sector_ofs,
+                           chunk_size)) {
+            size -= chunk_size;
+            offset += chunk_size;
+            bytes_written += chunk_size;
+            continue;
+        }
+
+        /* Fill in a hole, or extend the file, on first write.
+         * Place the new sector just after the previous one, or
+         * after the inode itself, to keep the file contiguous.
+         * Another writer may have beaten us to it, so look again
+         * once we hold the lock.  Each allocation, together with
+         * the inode and index blocks that record it, is one
+         * journaled operation. */
+        if (sector_idx == UNALLOCATED) {
+            journal_begin();
+            lock_acquire(&inode->lock);
+            sector_idx = index_lookup(&inode->data, idx);
+            if (sector_idx == UNALLOCATED) {
+                block_sector_t prev = (idx > 0
+                                       ? index_lookup(&inode->data, idx - 1)
+                                       : UNALLOCATED);
+                block_sector_t hint = (prev != UNALLOCATED
+                                       ? prev
+                                       : inode->sector) + 1;
+
+                if (index_allocate(&inode->data, idx, hint, UNALLOCATED)) {
+                    sector_idx = index_lookup(&inode->data, idx);
                 }
+                cache_write(inode->sector, &inode->data);
             }
+            lock_release(&inode->lock);
+            journal_end();
+            if (sector_idx == UNALLOCATED) {
+                break;
+            }
+        }
 
-            /* If the sector contains data before or after the chunk
-             * we're writing, then we need to read in the sector
-             * first.  Otherwise we start with a sector of all zeros. */
-            if (sector_ofs > 0 || chunk_size < sector_left) {
-                block_read(fs_device, sector_idx, bounce);
-            } else {
-                memset(bounce, 0, BLOCK_SECTOR_SIZE);
+        /* A sector shared with a clone gets copied first, so that
+         * the write changes only this file. */
+        if (inode->data.flags & INODE_SHARED) {
+            sector_idx = unshare(inode, idx, sector_idx,
+                                 chunk_size == BLOCK_SECTOR_SIZE);
+            if (sector_idx == UNALLOCATED) {
+                break;
             }
-            memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-            block_write(fs_device, sector_idx, bounce);
         }
 
+        /* Copy into the buffer cache, which writes the sector back
+         * later. */
+        cache_write_hint(sector_idx, buffer + bytes_written, sector_ofs,
+                         chunk_size, hint);
+
         /* Advance. */
         size -= chunk_size;
         offset += chunk_size;
         bytes_written += chunk_size;
     }
-    free(bounce);
 
+#ifdef VM
+    /* Bring the mapped pages the write covers up to date, as
+     * they are what later reads see. */
+    if (inode->frame_cnt > 0) {
+        frame_cache_write(inode, buffer, bytes_written,
+                          offset - bytes_written);
+    }
+#endif
+
+    /* The new length is published only after the data is in
+     * place, so that readers never see unwritten bytes. */
+    if (bytes_written == 0) {
+        return 0;
+    }
+    journal_begin();
+    lock_acquire(&inode->lock);
+    if (offset > inode->data.length) {
+        inode->data.length = offset;
+        cache_write(inode->sector, &inode->data);
+    }
+    if (inode->sync_end == 0 || offset - bytes_written < inode->sync_start) {
+        inode->sync_start = offset - bytes_written;
+    }
+    if (offset > inode->sync_end) {
+        inode->sync_end = offset;
+    }
+    inode->write_cnt++;
+    lock_release(&inode->lock);
+    journal_end();
     return bytes_written;
 }
 
+/* Returns the number of bytes, a multiple of BLOCK_SECTOR_SIZE,
+ * of INODE's data at OFFSET, at most SIZE of them, that lie in
+ * consecutive sectors on disk starting at FIRST, the sector that
+ * holds OFFSET.  Returns 0 if OFFSET is not at a sector boundary,
+ * if the run is shorter than INODE_DIRECT_MIN, or if pages of the
+ * file are mapped, since their frames may hold newer data.  The
+ * run ends before any sector that INODE shares with a clone,
+ * which a write must not change in place. */
+static off_t
+direct_run(struct inode *inode, off_t offset, off_t size,
+           block_sector_t first)
+{
+    size_t idx = offset / BLOCK_SECTOR_SIZE;
+    size_t max = size / BLOCK_SECTOR_SIZE;
+    size_t cnt;
+
+#ifdef VM
+    if (inode->frame_cnt > 0) {
+        return 0;
+    }
+#endif
+    if (offset % BLOCK_SECTOR_SIZE != 0 || size < INODE_DIRECT_MIN) {
+        return 0;
+    }
+    for (cnt = 0; cnt < max; cnt++) {
+        if ((cnt > 0 && index_lookup(&inode->data, idx + cnt) != first + cnt)
+            || (inode->data.flags & INODE_SHARED
+                && free_map_is_shared(first + cnt))) {
+            break;
+        }
+    }
+    size = cnt * BLOCK_SECTOR_SIZE;
+    return size >= INODE_DIRECT_MIN ? size : 0;
+}
+
+/* Allocates the data sectors that hold bytes OFFSET through
+ * OFFSET + SIZE - 1 of INODE and fills them with zeros, so that
+ * writing that range later allocates nothing.  Sectors that are
+ * already allocated, or that wait in the delayed allocation
+ * window, are left alone.  Each run of missing sectors becomes
+ * one extent following the file's previous sector if the free
+ * map has room, or a few smaller ones if not, all in one
+ * journaled operation rather than one per sector.  Does not
+ * change INODE's length, and does nothing if its data is
+ * inline or compressed.
+ * Returns false if the disk fills up or the range reaches past
+ * INODE_LENGTH_MAX. */
+bool
+inode_preallocate(struct inode *inode, off_t offset, off_t size)
+{
+    size_t idx = offset / BLOCK_SECTOR_SIZE;
+    size_t end = bytes_to_sectors(offset + size);
+    bool success = true;
+
+    ASSERT(offset >= 0 && size >= 0);
+    if (offset + size > INODE_LENGTH_MAX) {
+        return false;
+    }
+
+    while (success && idx < end) {
+        size_t cnt = 0;
+        bool changed;
+
+        journal_begin();
+        lock_acquire(&inode->lock);
+        if (inode->data.flags & (INODE_INLINE | INODE_COMPRESSED)) {
+            idx = end;
+        }
+
+        /* Find the next run of missing sectors. */
+        for (; idx < end; idx++) {
+            size_t delay_end = inode->delay_start + inode->delay_cnt;
+            if (index_lookup(&inode->data, idx) == UNALLOCATED
+                && (inode->delay_cnt == 0 || idx < inode->delay_start
+                    || idx >= delay_end)) {
+                break;
+            }
+        }
+        while (idx + cnt < end && cnt < PREALLOCATE_MAX
+               && index_lookup(&inode->data, idx + cnt) == UNALLOCATED
+               && (inode->delay_cnt == 0
+                   || idx + cnt != inode->delay_start)) {
+            cnt++;
+        }
+
+        /* Allocate it, in as few extents as the free map allows. */
+        changed = cnt > 0;
+        while (cnt > 0) {
+            block_sector_t prev = (idx > 0
+                                   ? index_lookup(&inode->data, idx - 1)
+                                   : UNALLOCATED);
+            block_sector_t hint = (prev != UNALLOCATED
+                                   ? prev
+                                   : inode->sector) + 1;
+            size_t extent = cnt;
+            block_sector_t first;
+            bool found;
+            size_t i;
+
+            while (!(found = free_map_allocate_near(extent, hint, &first))
+                   && extent > 1) {
+                extent /= 2;
+            }
+            if (!found) {
+                success = false;
+                break;
+            }
+
+            for (i = 0; i < extent; i++) {
+                if (!index_allocate(&inode->data, idx + i, first + extent,
+                                    first + i)) {
+                    free_map_release(first + i, extent - i);
+                    success = false;
+                    break;
+                }
+                cache_zero(first + i);
+            }
+            if (!success) {
+                break;
+            }
+            idx += extent;
+            cnt -= extent;
+        }
+        if (changed) {
+            cache_write(inode->sector, &inode->data);
+        }
+        lock_release(&inode->lock);
+        journal_end();
+    }
+    return success;
+}
+
 /* Disables writes to INODE.
  * May be called at most once per inode opener. */
 void
 inode_deny_write(struct inode *inode)
 {
+    lock_acquire(&inode->lock);
     inode->deny_write_cnt++;
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+    lock_release(&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -305,9 +960,37 @@ inode_deny_write(struct inode *inode)
 void
 inode_allow_write(struct inode *inode)
 {
+    lock_acquire(&inode->lock);
     ASSERT(inode->deny_write_cnt > 0);
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
     inode->deny_write_cnt--;
+    lock_release(&inode->lock);
+}
+
+/* Returns a count that changes whenever INODE is written, so that
+ * a cache of data derived from its contents can tell whether it
+ * is still current.  The count changes only after a write
+ * completes, so it must be sampled before reading the data. */
+unsigned
+inode_write_cnt(const struct inode *inode)
+{
+    return inode->write_cnt;
+}
+
+/* Adds DELTA to the number of INODE's pages cached in shared
+ * frames.  Called by the frame table, under its lock. */
+void
+inode_count_frames(struct inode *inode, int delta)
+{
+    inode->frame_cnt += delta;
+}
+
+/* Returns true if INODE has been removed and will be deleted
+ * when its last opener closes it. */
+bool
+inode_is_removed(const struct inode *inode)
+{
+    return inode->removed;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -316,3 +999,1268 @@ inode_length(const struct inode *inode)
 {
     return inode->data.length;
 }
+
+/* Returns the sector that holds data sector IDX of the file
+ * described by DISK, or UNALLOCATED if there is none.  Never
+ * reads more than three index blocks. */
+static block_sector_t
+index_lookup(const struct inode_disk *disk, size_t idx)
+{
+    const block_sector_t *root;
+    block_sector_t sector;
+    size_t span;
+
+    if (disk->flags & INODE_INLINE) {
+        return UNALLOCATED;
+    }
+    if (idx < INODE_DIRECT_CNT) {
+        return disk->direct[idx];
+    }
+    idx -= INODE_DIRECT_CNT;
+    root = index_root((struct inode_disk *) disk, &idx, &span);
+    if (root == NULL) {
+        return UNALLOCATED;
+    }
+    sector = *root;
+
+    /* Walk down the tree, one index block per level. */
+    while (sector != UNALLOCATED && span > 0) {
+        cache_read_at(sector, &sector, idx / span * sizeof sector,
+                      sizeof sector);
+        idx %= span;
+        span /= INODE_PTRS_PER_SECTOR;
+    }
+    return sector;
+}
+
+/* Finds the index tree that holds data sector INODE_DIRECT_CNT +
+ * *IDX of the file described by DISK and returns the pointer to
+ * its root block, or a null pointer if *IDX is past the largest
+ * file.  Makes *IDX relative to the tree and stores in *SPAN the
+ * number of data sectors that each slot of the root covers: 1
+ * for the indirect block, INODE_PTRS_PER_SECTOR for the doubly
+ * indirect block, and its square for the triply indirect block. */
+static block_sector_t *
+index_root(struct inode_disk *disk, size_t *idx, size_t *span)
+{
+    const size_t per = INODE_PTRS_PER_SECTOR;
+
+    if (*idx < per) {
+        *span = 1;
+        return &disk->indirect;
+    }
+    *idx -= per;
+    if (*idx < per * per) {
+        *span = per;
+        return &disk->doubly_indirect;
+    }
+    *idx -= per * per;
+    if (*idx < per * per * per) {
+        *span = per * per;
+        return &disk->triply_indirect;
+    }
+    return NULL;
+}
+
+/* If *SECTORP is UNALLOCATED, allocates a sector, preferably
+ * *HINT, fills it with zeros, and stores its number in *SECTORP.
+ * Advances *HINT past the new sector, so that a series of calls
+ * lays sectors out contiguously.  IS_DATA says whether the
+ * sector will hold file data, which is not journaled, rather
+ * than an index block, which is.
+ * Returns false if the disk is full. */
+static bool
+allocate_zeroed(block_sector_t *sectorp, block_sector_t *hint, bool is_data)
+{
+    static char zeros[BLOCK_SECTOR_SIZE];
+
+    if (*sectorp != UNALLOCATED) {
+        return true;
+    }
+    if (!free_map_allocate_near(1, *hint, sectorp)) {
+        return false;
+    }
+    if (is_data) {
+        cache_zero(*sectorp);
+    } else {
+        cache_write(*sectorp, zeros);
+    }
+    *hint = *sectorp + 1;
+    return true;
+}
+
+/* Makes sure that slot SLOT of index block TABLE points to an
+ * allocated, zeroed sector, and stores that sector in *SECTORP.
+ * HINT and IS_DATA are as for allocate_zeroed().
+ * Returns false if the disk is full. */
+static bool
+allocate_slot(block_sector_t table, size_t slot, block_sector_t *hint,
+              bool is_data, block_sector_t *sectorp)
+{
+    block_sector_t sector;
+
+    cache_read_at(table, &sector, slot * sizeof sector, sizeof sector);
+    if (sector == UNALLOCATED) {
+        if (!allocate_zeroed(&sector, hint, is_data)) {
+            return false;
+        }
+        cache_write_at(table, &sector, slot * sizeof sector, sizeof sector);
+    }
+    *sectorp = sector;
+    return true;
+}
+
+/* Allocates data sector IDX of the file described by DISK, along
+ * with any index blocks needed to reach it, as close to sector
+ * HINT as possible.  Sectors that are already allocated are left
+ * alone.  If DATA is not UNALLOCATED, it is an already allocated
+ * sector to use for the data, and only index blocks are
+ * allocated.
+ * Returns false if the disk is full or IDX is too large. */
+static bool
+index_allocate(struct inode_disk *disk, size_t idx, block_sector_t hint,
+               block_sector_t data)
+{
+    block_sector_t *rootp;
+    block_sector_t table;
+    size_t span;
+
+    if (idx < INODE_DIRECT_CNT) {
+        return install_data(&disk->direct[idx], &hint, data);
+    }
+    idx -= INODE_DIRECT_CNT;
+    rootp = index_root(disk, &idx, &span);
+    if (rootp == NULL || !allocate_zeroed(rootp, &hint, false)) {
+        return false;
+    }
+
+    /* Walk down the tree, allocating index blocks as needed. */
+    for (table = *rootp; span > 1; span /= INODE_PTRS_PER_SECTOR) {
+        if (!allocate_slot(table, idx / span, &hint, false, &table)) {
+            return false;
+        }
+        idx %= span;
+    }
+    return install_slot(table, idx, &hint, data);
+}
+
+/* Stores DATA in *SECTORP, or allocates a zeroed data sector as
+ * allocate_zeroed() does if DATA is UNALLOCATED. */
+static bool
+install_data(block_sector_t *sectorp, block_sector_t *hint,
+             block_sector_t data)
+{
+    if (data == UNALLOCATED) {
+        return allocate_zeroed(sectorp, hint, true);
+    }
+    ASSERT(*sectorp == UNALLOCATED);
+    *sectorp = data;
+    return true;
+}
+
+/* Stores DATA in slot SLOT of index block TABLE, or allocates a
+ * zeroed data sector for the slot as allocate_slot() does if
+ * DATA is UNALLOCATED. */
+static bool
+install_slot(block_sector_t table, size_t slot, block_sector_t *hint,
+             block_sector_t data)
+{
+    if (data == UNALLOCATED) {
+        return allocate_slot(table, slot, hint, true, &data);
+    }
+    cache_write_at(table, &data, slot * sizeof data, sizeof data);
+    return true;
+}
+
+/* Allocates sectors for the delayed data of every inode that has
+ * some.  Called periodically by the buffer cache's flusher. */
+void
+inode_allocate_delayed(void)
+{
+    size_t cnt;
+
+    /* Visit each inode on the list at most once, even if writers
+     * keep putting inodes back on it. */
+    lock_acquire(&delayed_lock);
+    cnt = list_size(&delayed_inodes);
+    lock_release(&delayed_lock);
+
+    while (cnt-- > 0) {
+        struct inode *inode = NULL;
+
+        lock_acquire(&delayed_lock);
+        if (!list_empty(&delayed_inodes)) {
+            struct list_elem *e = list_front(&delayed_inodes);
+            inode = inode_reopen(list_entry(e, struct inode, delay_elem));
+        }
+        lock_release(&delayed_lock);
+        if (inode == NULL) {
+            break;
+        }
+        delay_flush(inode);
+        inode_close(inode);
+    }
+}
+
+/* Makes the data written to INODE so far durable.  Allocates its
+ * delayed data, then writes back the dirty cache sectors that it
+ * has written since the last sync, in runs of consecutive
+ * sectors, leaving other files' sectors in the cache; if that is
+ * more sectors than the cache holds, it simply flushes the whole
+ * cache.  Finally commits the journal, which carries the inode
+ * and its index blocks, unless DATA_ONLY is true and the inode
+ * has not changed since the last commit, as it has if the file
+ * grew or had sectors allocated: then the data just written is
+ * all that is needed to read it back. */
+void
+inode_sync(struct inode *inode, bool data_only)
+{
+    size_t idx, end;
+
+    delay_flush(inode);
+
+    lock_acquire(&inode->lock);
+    idx = inode->sync_start / BLOCK_SECTOR_SIZE;
+    end = bytes_to_sectors(inode->sync_end);
+    inode->sync_start = inode->sync_end = 0;
+    lock_release(&inode->lock);
+
+    if (end - idx > CACHE_SIZE) {
+        cache_flush();
+        idx = end;
+    }
+    while (idx < end) {
+        block_sector_t first = index_lookup(&inode->data, idx);
+        size_t cnt = 1;
+
+        if (first != UNALLOCATED) {
+            while (idx + cnt < end
+                   && index_lookup(&inode->data, idx + cnt) == first + cnt) {
+                cnt++;
+            }
+            cache_flush_range(first, cnt);
+        }
+        idx += cnt;
+    }
+
+    if (!data_only || cache_is_held(inode->sector)) {
+        journal_commit();
+
+        /* In case the log had no room for it. */
+        cache_flush_range(inode->sector, 1);
+    }
+}
+
+/* Returns the number of extents, runs of consecutive sectors,
+ * that INODE's data occupies on disk, not counting holes. */
+size_t
+inode_extent_cnt(struct inode *inode)
+{
+    size_t end = bytes_to_sectors(inode_length(inode));
+    block_sector_t prev = UNALLOCATED;
+    size_t cnt = 0;
+    size_t idx;
+
+    for (idx = 0; idx < end; idx++) {
+        block_sector_t sector = index_lookup(&inode->data, idx);
+
+        if (sector != UNALLOCATED) {
+            if (sector != prev + 1) {
+                cnt++;
+            }
+            prev = sector;
+        }
+    }
+    return cnt;
+}
+
+/* Moves INODE's data into one extent, if it occupies more than
+ * one and the free map has a run of sectors big enough for all
+ * of it.  Each sector is copied through the buffer cache to its
+ * new place, then DEFRAG_BATCH at a time the index is switched to
+ * the new sectors and the old ones freed, as one journaled
+ * operation, so that the file reads the same throughout and
+ * after a crash.  Holes stay holes.
+ *
+ * Writers are held off with inode_deny_write() meanwhile.  INODE
+ * must not be open anywhere but in the caller, nor mapped, nor
+ * have its data inline, compressed or shared with a clone; if it
+ * does, nothing happens.  Returns true if the data is in one
+ * extent now. */
+bool
+inode_defrag(struct inode *inode)
+{
+    size_t end, idx, data_cnt;
+    block_sector_t target;
+    uint8_t buf[BLOCK_SECTOR_SIZE];
+    bool success;
+
+    if (inode->open_cnt > 1 || inode->frame_cnt > 0
+        || inode->data.flags & (INODE_INLINE | INODE_COMPRESSED
+                                | INODE_SHARED)) {
+        return false;
+    }
+    delay_flush(inode);
+    if (inode_extent_cnt(inode) <= 1) {
+        return true;
+    }
+
+    /* Find a run of free sectors for all the data.  The sectors
+     * are taken back one by one below, each allocation preferring
+     * the sector just after the previous one. */
+    end = bytes_to_sectors(inode_length(inode));
+    for (data_cnt = idx = 0; idx < end; idx++) {
+        if (index_lookup(&inode->data, idx) != UNALLOCATED) {
+            data_cnt++;
+        }
+    }
+    journal_begin();
+    success = free_map_allocate_near(data_cnt, inode->sector + 1, &target);
+    if (success) {
+        free_map_release(target, data_cnt);
+    }
+    journal_end();
+    if (!success) {
+        return false;
+    }
+
+    inode_deny_write(inode);
+    idx = 0;
+    while (success && idx < end) {
+        size_t moved = 0;
+
+        journal_begin();
+        lock_acquire(&inode->lock);
+        for (; idx < end && moved < DEFRAG_BATCH; idx++) {
+            block_sector_t old = index_lookup(&inode->data, idx);
+            block_sector_t new;
+
+            if (old == UNALLOCATED) {
+                continue;
+            }
+            if (!free_map_allocate_near(1, target, &new)) {
+                success = false;
+                break;
+            }
+            target = new + 1;
+            cache_read_hint(old, buf, 0, sizeof buf, CACHE_STREAM);
+            cache_write_data(new, buf);
+
+            /* The slot's index blocks exist, so this cannot fail. */
+            index_clear(&inode->data, idx);
+            index_allocate(&inode->data, idx, target, new);
+            free_map_release(old, 1);
+            moved++;
+        }
+        cache_write(inode->sector, &inode->data);
+        lock_release(&inode->lock);
+        journal_end();
+    }
+    inode_allow_write(inode);
+    return success && inode_extent_cnt(inode) == 1;
+}
+
+/* Tries to write SIZE bytes from BUFFER at byte offset OFS into
+ * data sector IDX of INODE without allocating it, by putting it
+ * in INODE's delayed allocation window.  Returns true if
+ * successful, false if the caller must allocate the sector now.
+ *
+ * Only appended data is delayed: sector IDX must lie past end of
+ * file, or already be in the window.  Writes made by journaled
+ * operations are directory metadata and are never delayed, nor
+ * are writes to the free map, which allocation itself updates,
+ * or to the share map.
+ * Each delayed sector reserves a free sector, so that the writer
+ * finds out now, not at allocation time, if the disk is full. */
+static bool
+delay_write(struct inode *inode, size_t idx, const void *buffer, int ofs,
+            int size)
+{
+    bool delay = (!journal_active() && inode->sector != FREE_MAP_SECTOR
+                  && inode->sector != SHARE_MAP_SECTOR);
+
+    for (;;) {
+        size_t end;
+
+        lock_acquire(&inode->lock);
+        end = inode->delay_start + inode->delay_cnt;
+        if (index_lookup(&inode->data, idx) != UNALLOCATED) {
+            /* Allocated by another writer in the meantime. */
+            break;
+        } else if (inode->delay_cnt > 0 && idx >= inode->delay_start
+                   && idx < end) {
+            /* Already in the window. */
+        } else if (!delay
+                   || idx < bytes_to_sectors(inode->data.length)) {
+            /* A hole inside the file. */
+            break;
+        } else if (inode->delay_cnt > 0
+                   && (idx != end || inode->delay_cnt >= INODE_DELAY_CNT)) {
+            /* Not contiguous with the window, or the window is
+             * full.  Start over with a fresh window. */
+            lock_release(&inode->lock);
+            delay_flush(inode);
+            continue;
+        } else if (!free_map_reserve(1)) {
+            break;
+        } else {
+            /* Extend the window, or start a new one. */
+            if (inode->delay_cnt == 0) {
+                inode->delay_buf = palloc_get_page(0);
+                if (inode->delay_buf == NULL) {
+                    free_map_unreserve(1);
+                    break;
+                }
+                inode->delay_start = idx;
+                lock_acquire(&delayed_lock);
+                list_push_back(&delayed_inodes, &inode->delay_elem);
+                lock_release(&delayed_lock);
+            }
+            memset(inode->delay_buf
+                   + inode->delay_cnt * BLOCK_SECTOR_SIZE, 0,
+                   BLOCK_SECTOR_SIZE);
+            inode->delay_cnt++;
+        }
+
+        memcpy(inode->delay_buf
+               + (idx - inode->delay_start) * BLOCK_SECTOR_SIZE + ofs,
+               buffer, size);
+        lock_release(&inode->lock);
+        return true;
+    }
+    lock_release(&inode->lock);
+    return false;
+}
+
+/* Reads SIZE bytes at byte offset OFS within data sector IDX of
+ * INODE into BUFFER, where IDX was found to be unallocated: from
+ * the delayed allocation window if the sector is there, or as
+ * zeros if it is a hole. */
+static void
+delay_read(struct inode *inode, size_t idx, void *buffer, int ofs,
+           int size)
+{
+    block_sector_t sector;
+
+    lock_acquire(&inode->lock);
+    sector = index_lookup(&inode->data, idx);
+    if (sector == UNALLOCATED) {
+        if (inode->delay_cnt > 0 && idx >= inode->delay_start
+            && idx < inode->delay_start + inode->delay_cnt) {
+            memcpy(buffer,
+                   inode->delay_buf
+                   + (idx - inode->delay_start) * BLOCK_SECTOR_SIZE + ofs,
+                   size);
+        } else {
+            memset(buffer, 0, size);
+        }
+    }
+    lock_release(&inode->lock);
+
+    /* Allocated by a writer in the meantime. */
+    if (sector != UNALLOCATED) {
+        cache_read_at(sector, buffer, ofs, size);
+    }
+}
+
+/* Allocates sectors for INODE's delayed allocation window, which
+ * it then empties.  The window's sectors go into one extent
+ * following the file's previous sector if possible, since they
+ * were reserved, but they can always be allocated one by one. */
+static void
+delay_flush(struct inode *inode)
+{
+    journal_begin();
+    lock_acquire(&inode->lock);
+    if (inode->delay_cnt > 0) {
+        size_t idx = inode->delay_start;
+        block_sector_t prev = (idx > 0
+                               ? index_lookup(&inode->data, idx - 1)
+                               : UNALLOCATED);
+        block_sector_t hint = (prev != UNALLOCATED
+                               ? prev
+                               : inode->sector) + 1;
+        block_sector_t first;
+        bool extent = free_map_allocate_reserved(inode->delay_cnt, hint,
+                                                 &first);
+        size_t i;
+
+        for (i = 0; i < inode->delay_cnt; i++) {
+            block_sector_t data = first + i;
+
+            if (!extent && !free_map_allocate_reserved(1, hint, &data)) {
+                PANIC("reserved sector unavailable");
+            }
+            hint = data + 1;
+
+            /* Indexing the sector can still fail if the disk is
+             * full, since index blocks are not reserved.  The data
+             * is lost and the sector reads back as a hole. */
+            if (!index_allocate(&inode->data, idx + i, hint, data)) {
+                free_map_release(data, 1);
+                continue;
+            }
+            cache_write_data(data,
+                             inode->delay_buf + i * BLOCK_SECTOR_SIZE);
+        }
+        cache_write(inode->sector, &inode->data);
+
+        lock_acquire(&delayed_lock);
+        list_remove(&inode->delay_elem);
+        lock_release(&delayed_lock);
+        inode->delay_cnt = 0;
+        palloc_free_page(inode->delay_buf);
+        inode->delay_buf = NULL;
+    }
+    lock_release(&inode->lock);
+    journal_end();
+}
+
+/* Returns the sector to write for data sector IDX of INODE,
+ * which was found to be SECTOR, a sector that INODE may share
+ * with a clone.  If it does, gives INODE a private copy first: a
+ * new sector, holding the old contents unless WHOLE says that the
+ * caller overwrites all of it, takes the old one's place in the
+ * index, as one journaled operation, and the old sector is left
+ * to the clone.  Returns UNALLOCATED if the disk is full. */
+static block_sector_t
+unshare(struct inode *inode, size_t idx, block_sector_t sector,
+        bool whole)
+{
+    uint8_t buf[BLOCK_SECTOR_SIZE];
+    block_sector_t old;
+
+    if (!free_map_is_shared(sector)) {
+        return sector;
+    }
+
+    /* Look again with the lock held, in case another writer has
+     * copied the sector in the meantime. */
+    journal_begin();
+    lock_acquire(&inode->lock);
+    old = sector = index_lookup(&inode->data, idx);
+    if (old != UNALLOCATED && free_map_is_shared(old)) {
+        block_sector_t prev = (idx > 0
+                               ? index_lookup(&inode->data, idx - 1)
+                               : UNALLOCATED);
+        block_sector_t hint = (prev != UNALLOCATED
+                               ? prev
+                               : inode->sector) + 1;
+
+        if (free_map_allocate_near(1, hint, &sector)) {
+            if (!whole) {
+                cache_read(old, buf);
+                cache_write_data(sector, buf);
+            }
+
+            /* The slot's index blocks exist, so this cannot fail. */
+            index_clear(&inode->data, idx);
+            index_allocate(&inode->data, idx, sector + 1, sector);
+            cache_write(inode->sector, &inode->data);
+            drop_sector(old);
+        } else {
+            sector = UNALLOCATED;
+        }
+    }
+    lock_release(&inode->lock);
+    journal_end();
+    return sector;
+}
+
+/* Gives up a reference to data sector SECTOR, which a file with
+ * the INODE_SHARED flag no longer points to, and frees it if no
+ * other file does either.  Must be called inside a journaled
+ * operation. */
+static void
+drop_sector(block_sector_t sector)
+{
+    if (!free_map_unshare(sector)) {
+        free_map_release(sector, 1);
+    }
+}
+
+/* Reclaimer thread.  Takes removed inodes off the queue one at
+ * a time, frees their blocks in batches and then frees them. */
+static void
+reclaim_thread(void *aux UNUSED)
+{
+    for (;;) {
+        struct inode *inode;
+
+        lock_acquire(&reclaim_lock);
+        reclaiming = false;
+        cond_broadcast(&reclaim_changed, &reclaim_lock);
+        while (list_empty(&reclaim_queue)) {
+            cond_wait(&reclaim_changed, &reclaim_lock);
+        }
+        inode = list_entry(list_pop_front(&reclaim_queue), struct inode,
+                           delay_elem);
+        reclaiming = true;
+        lock_release(&reclaim_lock);
+
+        reclaim_blocks(inode);
+        call_rcu(&inode->rcu, inode_free);
+    }
+}
+
+/* Frees INODE's sector and every data and index block it points
+ * to, except data sectors that a clone still shares. */
+static void
+reclaim_blocks(struct inode *inode)
+{
+    struct inode_disk *disk = &inode->data;
+    bool shared = disk->flags & INODE_SHARED;
+    size_t i;
+
+    if (!(disk->flags & INODE_INLINE)) {
+        for (i = 0; i < INODE_DIRECT_CNT; i++) {
+            if (disk->direct[i] != UNALLOCATED) {
+                reclaim_data(disk->direct[i], shared);
+            }
+        }
+        if (disk->indirect != UNALLOCATED) {
+            reclaim_table(disk->indirect, 1, shared);
+        }
+        if (disk->doubly_indirect != UNALLOCATED) {
+            reclaim_table(disk->doubly_indirect, 2, shared);
+        }
+        if (disk->triply_indirect != UNALLOCATED) {
+            reclaim_table(disk->triply_indirect, 3, shared);
+        }
+    }
+    reclaim_add(inode->sector);
+    reclaim_flush();
+}
+
+/* Frees index block TABLE and everything it points to, as
+ * reclaim_data() does for data sectors with SHARED.  LEVEL is 1
+ * for an indirect block, 2 for a doubly indirect block and 3 for
+ * a triply indirect block.
+ * TABLE itself is freed last, once it has been read in full, so
+ * that a batch never gives away a table that is still needed. */
+static void
+reclaim_table(block_sector_t table, int level, bool shared)
+{
+    size_t slot;
+
+    for (slot = 0; slot < INODE_PTRS_PER_SECTOR; slot++) {
+        block_sector_t sector;
+
+        cache_read_at(table, &sector, slot * sizeof sector, sizeof sector);
+        if (sector != UNALLOCATED) {
+            if (level > 1) {
+                reclaim_table(sector, level - 1, shared);
+            } else {
+                reclaim_data(sector, shared);
+            }
+        }
+    }
+    reclaim_add(table);
+}
+
+/* Adds data sector SECTOR to the reclaimer's batch, unless its
+ * file has the INODE_SHARED flag, as SHARED says, and a clone
+ * still uses the sector, in which case the clone keeps it. */
+static void
+reclaim_data(block_sector_t sector, bool shared)
+{
+    bool kept = false;
+
+    if (shared) {
+        journal_begin();
+        kept = free_map_unshare(sector);
+        journal_end();
+    }
+    if (!kept) {
+        reclaim_add(sector);
+    }
+}
+
+/* Adds SECTOR to the reclaimer's batch, freeing the batch first
+ * if it is full. */
+static void
+reclaim_add(block_sector_t sector)
+{
+    if (reclaim_cnt == RECLAIM_BATCH) {
+        reclaim_flush();
+    }
+    reclaim_batch[reclaim_cnt++] = sector;
+}
+
+/* Frees the sectors in the reclaimer's batch in one journaled
+ * operation, which writes each changed free map sector once. */
+static void
+reclaim_flush(void)
+{
+    if (reclaim_cnt > 0) {
+        journal_begin();
+        free_map_release_batch(reclaim_batch, reclaim_cnt);
+        journal_end();
+        reclaim_cnt = 0;
+    }
+}
+
+/* Reads SIZE bytes from INODE's inline data into BUFFER, starting
+ * at position OFFSET, and returns the number of bytes read.
+ * Returns -1 if INODE turns out to have been converted to
+ * block-mapped storage, in which case nothing is read. */
+static off_t
+inline_read(struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+    off_t bytes_read = -1;
+
+    lock_acquire(&inode->lock);
+    if (inode->data.flags & INODE_INLINE) {
+        off_t left = inode->data.length - offset;
+
+        bytes_read = size < left ? size : left;
+        if (bytes_read > 0) {
+            memcpy(buffer, inode->data.inline_data + offset, bytes_read);
+        } else {
+            bytes_read = 0;
+        }
+    }
+    lock_release(&inode->lock);
+    return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE's inline data,
+ * starting at OFFSET, and returns the number of bytes written.
+ * The data and the new length go to disk together, as one
+ * journaled update of the inode sector.
+ *
+ * If the write would take INODE past INODE_INLINE_MAX bytes,
+ * converts INODE to block-mapped storage instead and returns -1,
+ * so that the caller writes the usual way; or returns 0 if the
+ * disk is too full to convert.  Also returns -1 if INODE was
+ * already converted. */
+static off_t
+inline_write(struct inode *inode, const void *buffer, off_t size,
+             off_t offset)
+{
+    off_t bytes_written = -1;
+
+    journal_begin();
+    lock_acquire(&inode->lock);
+    if (!(inode->data.flags & INODE_INLINE)) {
+        /* Converted by another writer. */
+    } else if (offset + size > (off_t) INODE_INLINE_MAX) {
+        if (!inline_convert(inode)) {
+            bytes_written = 0;
+        }
+        cache_write(inode->sector, &inode->data);
+    } else {
+        memcpy(inode->data.inline_data + offset, buffer, size);
+        if (offset + size > inode->data.length) {
+            inode->data.length = offset + size;
+        }
+        cache_write(inode->sector, &inode->data);
+        inode->write_cnt++;
+        bytes_written = size;
+    }
+    lock_release(&inode->lock);
+    journal_end();
+    return bytes_written;
+}
+
+/* Moves INODE's inline data into a data sector of its own, just
+ * after the inode, and clears the INODE_INLINE flag.  The caller
+ * must hold INODE's lock and write the inode back.
+ * Returns false if the disk is full, in which case INODE is left
+ * inline. */
+static bool
+inline_convert(struct inode *inode)
+{
+    uint8_t data[BLOCK_SECTOR_SIZE];
+    block_sector_t sector = UNALLOCATED;
+
+    if (inode->data.length > 0
+        && !free_map_allocate_near(1, inode->sector + 1, &sector)) {
+        return false;
+    }
+
+    memset(data, 0, sizeof data);
+    memcpy(data, inode->data.inline_data, inode->data.length);
+    memset(inode->data.inline_data, 0, INODE_INLINE_MAX);
+    inode->data.flags &= ~INODE_INLINE;
+    if (sector != UNALLOCATED) {
+        inode->data.direct[0] = sector;
+        cache_write_data(sector, data);
+    }
+    return true;
+}
+
+/* Makes INODE, an empty file whose data is still inline, store
+ * its data in compressed chunks from now on.  Returns false if
+ * INODE has data, or has ever had, unless it is compressed
+ * already. */
+bool
+inode_set_compressed(struct inode *inode)
+{
+    bool success;
+
+    journal_begin();
+    lock_acquire(&inode->lock);
+    success = (inode->data.flags & INODE_COMPRESSED
+               || (inode->data.flags & INODE_INLINE
+                   && inode->data.length == 0));
+    if (success && !(inode->data.flags & INODE_COMPRESSED)) {
+        inode->data.flags = INODE_COMPRESSED;
+        cache_write(inode->sector, &inode->data);
+    }
+    lock_release(&inode->lock);
+    journal_end();
+    return success;
+}
+
+/* Does the work of read_at() for a compressed file, copying the
+ * data out of each chunk in turn as chunk_load() finds it. */
+static off_t
+chunk_read(struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+    uint8_t *buffer = buffer_;
+    off_t bytes_read = 0;
+
+    while (size > 0) {
+        size_t chunk = offset / INODE_CHUNK_SIZE;
+        int chunk_ofs = offset % INODE_CHUNK_SIZE;
+        off_t inode_left = inode_length(inode) - offset;
+        int chunk_left = INODE_CHUNK_SIZE - chunk_ofs;
+        int min_left = inode_left < chunk_left ? inode_left : chunk_left;
+        int chunk_size = size < min_left ? size : min_left;
+        bool loaded;
+
+        if (chunk_size <= 0) {
+            break;
+        }
+
+#ifdef VM
+        /* Copy out of a mapped page, as read_at() does. */
+        if (inode->frame_cnt > 0) {
+            off_t cnt = frame_cache_read(inode, buffer + bytes_read,
+                                         size < inode_left ? size : inode_left,
+                                         offset);
+            if (cnt > 0) {
+                size -= cnt;
+                offset += cnt;
+                bytes_read += cnt;
+                continue;
+            }
+        }
+#endif
+
+        lock_acquire(&inode->lock);
+        loaded = chunk_load(inode, chunk);
+        if (loaded) {
+            memcpy(buffer + bytes_read, inode->chunk_buf + chunk_ofs,
+                   chunk_size);
+        }
+        lock_release(&inode->lock);
+        if (!loaded) {
+            break;
+        }
+
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_read += chunk_size;
+    }
+    return bytes_read;
+}
+
+/* Does the work of write_at() for a compressed file: copies the
+ * data into each chunk in turn and writes the chunk back, with
+ * the inode, as one journaled operation.  Returns the number of
+ * bytes written, which is less than SIZE if the disk fills up or
+ * memory runs out. */
+static off_t
+chunk_write(struct inode *inode, const void *buffer_, off_t size,
+            off_t offset)
+{
+    const uint8_t *buffer = buffer_;
+    off_t bytes_written = 0;
+
+    while (size > 0) {
+        size_t chunk = offset / INODE_CHUNK_SIZE;
+        int chunk_ofs = offset % INODE_CHUNK_SIZE;
+        int chunk_left = INODE_CHUNK_SIZE - chunk_ofs;
+        int chunk_size = size < chunk_left ? size : chunk_left;
+        bool stored = false;
+
+        journal_begin();
+        lock_acquire(&inode->lock);
+        if (chunk_load(inode, chunk)) {
+            memcpy(inode->chunk_buf + chunk_ofs, buffer + bytes_written,
+                   chunk_size);
+            stored = chunk_store(inode);
+            cache_write(inode->sector, &inode->data);
+        }
+        lock_release(&inode->lock);
+        journal_end();
+        if (!stored) {
+            break;
+        }
+
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_written += chunk_size;
+    }
+    return bytes_written;
+}
+
+/* Makes INODE's CHUNK_BUF hold chunk CHUNK of its data, reading
+ * and decompressing the chunk unless it is there already.  The
+ * caller must hold INODE's lock.  Returns false if memory runs
+ * out. */
+static bool
+chunk_load(struct inode *inode, size_t chunk)
+{
+    block_sector_t sectors[INODE_CHUNK_SECTORS];
+    size_t cnt, i;
+
+    if (inode->chunk_buf != NULL && inode->chunk_idx == chunk) {
+        return true;
+    }
+    if (inode->chunk_buf == NULL) {
+        inode->chunk_buf = palloc_get_page(0);
+        if (inode->chunk_buf == NULL) {
+            return false;
+        }
+    }
+
+    cnt = chunk_sectors(&inode->data, chunk, sectors);
+    if (cnt == 0) {
+        memset(inode->chunk_buf, 0, INODE_CHUNK_SIZE);
+    } else if (cnt == INODE_CHUNK_SECTORS) {
+        for (i = 0; i < cnt; i++) {
+            cache_read_hint(sectors[i],
+                            inode->chunk_buf + i * BLOCK_SECTOR_SIZE, 0,
+                            BLOCK_SECTOR_SIZE, CACHE_DATA);
+        }
+    } else {
+        uint16_t size;
+
+        lock_acquire(&chunk_lock);
+        for (i = 0; i < cnt; i++) {
+            cache_read_hint(sectors[i], chunk_zbuf + i * BLOCK_SECTOR_SIZE,
+                            0, BLOCK_SECTOR_SIZE, CACHE_DATA);
+        }
+        memcpy(&size, chunk_zbuf, sizeof size);
+        if (size > cnt * BLOCK_SECTOR_SIZE - sizeof size
+            || (lz_decompress(chunk_zbuf + sizeof size, size,
+                              inode->chunk_buf, INODE_CHUNK_SIZE)
+                != INODE_CHUNK_SIZE)) {
+            PANIC("inode %"PRDSNu": chunk %zu is corrupt",
+                  inode->sector, chunk);
+        }
+        lock_release(&chunk_lock);
+    }
+    inode->chunk_idx = chunk;
+    return true;
+}
+
+/* Writes INODE's CHUNK_BUF back as its chunk: as a hole if it is
+ * all zeros, compressed if that saves a sector, and as is
+ * otherwise.  The chunk goes into newly allocated sectors, and
+ * its old ones are freed once the index points to the new, so
+ * that the journaled index never names a half-written chunk.
+ * The caller must hold INODE's lock, inside a journaled
+ * operation, and write the inode back.  Returns false, leaving
+ * the chunk on disk as it was and CHUNK_BUF holding no chunk, if
+ * the disk is full. */
+static bool
+chunk_store(struct inode *inode)
+{
+    struct inode_disk *disk = &inode->data;
+    size_t first = inode->chunk_idx * INODE_CHUNK_SECTORS;
+    block_sector_t old[INODE_CHUNK_SECTORS], new[INODE_CHUNK_SECTORS];
+    block_sector_t hint = inode->sector + 1;
+    const uint8_t *data;
+    size_t old_cnt, cnt, i, j;
+    uint16_t size;
+    bool success = false;
+
+    lock_acquire(&chunk_lock);
+    for (i = 0; i < INODE_CHUNK_SIZE && inode->chunk_buf[i] == 0; i++) {
+        continue;
+    }
+    if (i == INODE_CHUNK_SIZE) {
+        cnt = 0;
+        data = NULL;
+    } else if ((size = lz_compress(inode->chunk_buf, INODE_CHUNK_SIZE,
+                                   chunk_zbuf + sizeof size,
+                                   (INODE_CHUNK_SIZE - BLOCK_SECTOR_SIZE
+                                    - sizeof size),
+                                   chunk_table)) > 0) {
+        cnt = DIV_ROUND_UP(sizeof size + size, BLOCK_SECTOR_SIZE);
+        memcpy(chunk_zbuf, &size, sizeof size);
+        memset(chunk_zbuf + sizeof size + size, 0,
+               cnt * BLOCK_SECTOR_SIZE - sizeof size - size);
+        data = chunk_zbuf;
+    } else {
+        cnt = INODE_CHUNK_SECTORS;
+        data = inode->chunk_buf;
+    }
+
+    /* Allocate the new sectors, near the chunk's old ones or the
+     * previous chunk's, and fill them. */
+    old_cnt = chunk_sectors(disk, inode->chunk_idx, old);
+    if (old_cnt > 0) {
+        hint = old[0];
+    } else if (first > 0 && index_lookup(disk, first - 1) != UNALLOCATED) {
+        hint = index_lookup(disk, first - 1) + 1;
+    }
+    for (i = 0; i < cnt; i++) {
+        if (!free_map_allocate_near(1, hint, &new[i])) {
+            goto done;
+        }
+        hint = new[i] + 1;
+    }
+    for (i = 0; i < cnt; i++) {
+        cache_write_data(new[i], data + i * BLOCK_SECTOR_SIZE);
+    }
+
+    /* Point the index at them.  The index blocks for the old
+     * sectors' slots exist, so only slots beyond them can fail,
+     * in which case the old sectors go back. */
+    for (j = 0; j < old_cnt; j++) {
+        index_clear(disk, first + j);
+    }
+    for (j = 0; j < cnt; j++) {
+        if (!index_allocate(disk, first + j, hint, new[j])) {
+            while (j-- > 0) {
+                index_clear(disk, first + j);
+            }
+            for (j = 0; j < old_cnt; j++) {
+                index_allocate(disk, first + j, hint, old[j]);
+            }
+            goto done;
+        }
+    }
+    for (j = 0; j < old_cnt; j++) {
+        free_map_release(old[j], 1);
+    }
+    success = true;
+
+done:
+    if (!success) {
+        while (i-- > 0) {
+            free_map_release(new[i], 1);
+        }
+        inode->chunk_idx = CHUNK_NONE;
+    }
+    lock_release(&chunk_lock);
+    return success;
+}
+
+/* Makes DST, an empty file whose data is still inline, a copy of
+ * SRC that shares SRC's data sectors instead of copying them, so
+ * that the time taken depends on the size of SRC's index, not of
+ * its data.  Both files get the INODE_SHARED flag, and each
+ * shared sector gets one more owner in the share map; a write to
+ * either file then copies just the sector it changes, and
+ * removing either file frees only the sectors that the other
+ * does not share.  A small file, whose data is inline, is simply
+ * copied.
+ *
+ * CLONE_BATCH sectors at a time are shared under SRC's lock and
+ * then entered into DST's index under DST's, as one journaled
+ * operation; a sector that already has as many owners as the
+ * share map counts is copied instead.  Writes that SRC receives
+ * meanwhile may or may not show up in DST, as with a copy.
+ *
+ * Returns false if DST is not empty, if either file is
+ * compressed or mapped, or if the disk fills up, in which case
+ * DST may be left with some of the data but stays empty. */
+bool
+inode_clone(struct inode *dst, struct inode *src)
+{
+    block_sector_t hint = dst->sector + 1;
+    uint8_t buf[BLOCK_SECTOR_SIZE];
+    bool success = true;
+    size_t end, idx;
+    off_t length;
+
+    if (dst == src || dst->frame_cnt > 0 || src->frame_cnt > 0
+        || src->data.flags & INODE_COMPRESSED) {
+        return false;
+    }
+    lock_acquire(&dst->lock);
+    success = (dst->data.flags == INODE_INLINE && dst->data.length == 0
+               && dst->deny_write_cnt == 0);
+    lock_release(&dst->lock);
+    if (!success) {
+        return false;
+    }
+
+    /* Data written before the call, even if not yet allocated, is
+     * part of the clone. */
+    length = inode_length(src);
+    delay_flush(src);
+
+    journal_begin();
+    lock_acquire(&src->lock);
+    if (src->data.flags & INODE_INLINE) {
+        memcpy(buf, src->data.inline_data, length);
+        lock_release(&src->lock);
+
+        lock_acquire(&dst->lock);
+        memcpy(dst->data.inline_data, buf, length);
+        dst->data.length = length;
+        cache_write(dst->sector, &dst->data);
+        dst->write_cnt++;
+        lock_release(&dst->lock);
+        journal_end();
+        return true;
+    }
+    if (!(src->data.flags & INODE_SHARED)) {
+        src->data.flags |= INODE_SHARED;
+        cache_write(src->sector, &src->data);
+    }
+    lock_release(&src->lock);
+    journal_end();
+
+    end = bytes_to_sectors(length);
+    for (idx = 0; success && idx < end; idx += CLONE_BATCH) {
+        block_sector_t sectors[CLONE_BATCH];
+        size_t cnt = end - idx < CLONE_BATCH ? end - idx : CLONE_BATCH;
+        size_t i;
+
+        journal_begin();
+        lock_acquire(&src->lock);
+        for (i = 0; i < cnt; i++) {
+            block_sector_t sector = index_lookup(&src->data, idx + i);
+
+            sectors[i] = sector;
+            if (sector == UNALLOCATED || free_map_share(sector)) {
+                continue;
+            }
+            if (free_map_allocate_near(1, hint, &sectors[i])) {
+                cache_read(sector, buf);
+                cache_write_data(sectors[i], buf);
+                hint = sectors[i] + 1;
+            } else {
+                sectors[i] = UNALLOCATED;
+                success = false;
+            }
+        }
+        lock_release(&src->lock);
+
+        lock_acquire(&dst->lock);
+        dst->data.flags = INODE_SHARED;
+        for (i = 0; i < cnt; i++) {
+            if (sectors[i] == UNALLOCATED) {
+                continue;
+            }
+            if (!index_allocate(&dst->data, idx + i, hint, sectors[i])) {
+                drop_sector(sectors[i]);
+                success = false;
+            }
+        }
+        cache_write(dst->sector, &dst->data);
+        lock_release(&dst->lock);
+        journal_end();
+    }
+
+    if (success) {
+        journal_begin();
+        lock_acquire(&dst->lock);
+        dst->data.length = length;
+        cache_write(dst->sector, &dst->data);
+        dst->sync_start = 0;
+        dst->sync_end = length;
+        dst->write_cnt++;
+        lock_release(&dst->lock);
+        journal_end();
+    }
+    return success;
+}
+
+/* Stores in SECTORS the sectors of chunk CHUNK of the compressed
+ * file described by DISK, which are those of its leading
+ * allocated slots, and returns how many there are. */
+static size_t
+chunk_sectors(const struct inode_disk *disk, size_t chunk,
+              block_sector_t sectors[])
+{
+    size_t cnt;
+
+    for (cnt = 0; cnt < INODE_CHUNK_SECTORS; cnt++) {
+        sectors[cnt] = index_lookup(disk, chunk * INODE_CHUNK_SECTORS + cnt);
+        if (sectors[cnt] == UNALLOCATED) {
+            break;
+        }
+    }
+    return cnt;
+}
+
+/* Sets the pointer to data sector IDX of the file described by
+ * DISK to UNALLOCATED, leaving the index blocks in place.  The
+ * sector itself is not freed. */
+static void
+index_clear(struct inode_disk *disk, size_t idx)
+{
+    block_sector_t *rootp;
+    block_sector_t table, none;
+    size_t span;
+
+    if (idx < INODE_DIRECT_CNT) {
+        disk->direct[idx] = UNALLOCATED;
+        return;
+    }
+    idx -= INODE_DIRECT_CNT;
+    rootp = index_root(disk, &idx, &span);
+    if (rootp == NULL || *rootp == UNALLOCATED) {
+        return;
+    }
+    for (table = *rootp; span > 1; span /= INODE_PTRS_PER_SECTOR) {
+        cache_read_at(table, &table, idx / span * sizeof table,
+                      sizeof table);
+        if (table == UNALLOCATED) {
+            return;
+        }
+        idx %= span;
+    }
+    none = UNALLOCATED;
+    cache_write_at(table, &none, idx * sizeof none, sizeof none);
+}
+
+/* Returns the open inode for SECTOR, or a null pointer if it is
+ * not open.  Open_inodes_lock must be held. */
+static struct inode *
+open_inode_find(block_sector_t sector)
+{
+    struct inode key;
+
+    key.sector = sector;
+    return inode_table_find(&open_inodes, &key);
+}
+
+/* Hashes inode I by sector. */
+static inline unsigned
+inode_key_hash(const struct inode *i)
+{
+    return hash_int(i->sector);
+}
+
+/* Returns true if inodes A and B have the same sector. */
+static inline bool
+inode_key_equal(const struct inode *a, const struct inode *b)
+{
+    return a->sector == b->sector;
+}
+
+/* Hashes an inode by sector. */
+static unsigned
+inode_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    return inode_key_hash(hash_entry(e, struct inode, elem));
+}
+
+/* Orders inodes by sector. */
+static bool
+inode_less(const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+    return (hash_entry(a, struct inode, elem)->sector
+            < hash_entry(b, struct inode, elem)->sector);
+}
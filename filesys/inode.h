@@ -1,31 +1,141 @@
 #ifndef FILESYS_INODE_H
 #define FILESYS_INODE_H
 
+#include <hash.h>
 #include <list.h>
 #include <stdbool.h>
 
 #include "devices/block.h"
 #include "filesys/off_t.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 struct bitmap;
 
+/* Number of direct block pointers in an on-disk inode. */
+#define INODE_DIRECT_CNT 121
+
+/* Largest file whose data is stored inside its inode. */
+#define INODE_INLINE_MAX (INODE_DIRECT_CNT * sizeof(block_sector_t))
+
+/* Inode flags. */
+#define INODE_INLINE 0x1        /* Data is in INLINE_DATA. */
+#define INODE_COMPRESSED 0x2    /* Data is in compressed chunks. */
+#define INODE_SHARED 0x4        /* Data sectors may be shared. */
+
+/* Size of a compressed file's chunks, and the number of data
+ * sectors, or index slots, that each has. */
+#define INODE_CHUNK_SIZE PGSIZE
+#define INODE_CHUNK_SECTORS (INODE_CHUNK_SIZE / BLOCK_SECTOR_SIZE)
+
+/* Most sectors of appended data held back from allocation, per
+ * inode: one page. */
+#define INODE_DELAY_CNT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Fewest bytes that a streaming read, or a write, moves straight
+ * between the disk and the caller's buffer, bypassing the buffer
+ * cache, provided they are whole sectors, consecutive on disk. */
+#define INODE_DIRECT_MIN PGSIZE
+
+/* Number of block pointers in an indirect block. */
+#define INODE_PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+/* Most data sectors in a file, and its largest length: a little
+ * over 1 GB. */
+#define INODE_SECTORS_MAX (INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR      \
+                           + INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR \
+                           + INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR \
+                             * INODE_PTRS_PER_SECTOR)
+#define INODE_LENGTH_MAX ((off_t) INODE_SECTORS_MAX * BLOCK_SECTOR_SIZE)
+
 /* On-disk inode.
- * Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+ * Must be exactly BLOCK_SECTOR_SIZE bytes long.
+ *
+ * Data sector I of the file is DIRECT[I] for the first
+ * INODE_DIRECT_CNT sectors, then a slot in the INDIRECT block,
+ * then a slot in one of the indirect blocks listed by the
+ * DOUBLY_INDIRECT block, then a slot in one of the indirect
+ * blocks listed by one of the doubly indirect blocks that the
+ * TRIPLY_INDIRECT block lists.  A pointer of 0 means "not allocated";
+ * sector 0 holds the free map inode, so it is never file data.
+ *
+ * A file of at most INODE_INLINE_MAX bytes may instead have the
+ * INODE_INLINE flag, in which case its data is stored in the
+ * space of the direct pointers and it has no data sectors at
+ * all.  It is converted to block-mapped storage when it grows
+ * past INODE_INLINE_MAX.
+ *
+ * A file with the INODE_COMPRESSED flag is stored in chunks of
+ * INODE_CHUNK_SIZE bytes, chunk C in the sectors of data slots
+ * C * INODE_CHUNK_SECTORS onward, so that the index blocks are
+ * also the chunk map.  If all INODE_CHUNK_SECTORS slots are
+ * allocated, the chunk is stored as is; if none, it is all
+ * zeros; if only the first few, they hold the chunk compressed
+ * by lz_compress(), preceded by the compressed size as a 16-bit
+ * integer.
+ *
+ * A file with the INODE_SHARED flag has been cloned, or is a
+ * clone, and some of its data sectors may belong to other files
+ * as well, as the share map counts; see inode_clone(). */
 struct inode_disk {
-    block_sector_t start;       /* First data sector. */
-    off_t          length;      /* File size in bytes. */
-    unsigned       magic;       /* Magic number. */
-    uint32_t       unused[125]; /* Not used. */
+    off_t          length;                    /* File size in bytes. */
+    unsigned       magic;                     /* Magic number. */
+    uint32_t       flags;                     /* INODE_* flags. */
+    union {
+        block_sector_t direct[INODE_DIRECT_CNT];  /* Direct blocks. */
+        uint8_t inline_data[INODE_INLINE_MAX];    /* Inline data. */
+    };
+    block_sector_t indirect;                  /* Indirect block. */
+    block_sector_t doubly_indirect;           /* Doubly indirect block. */
+    block_sector_t triply_indirect;           /* Triply indirect block. */
 };
 
-/* In-memory inode. */
+/* In-memory inode.
+ *
+ * LOCK protects DATA's length and block pointers, DENY_WRITE_CNT,
+ * REMOVED and the delayed allocation window.  It is held while
+ * sectors are allocated and while inline data is accessed, not
+ * while already allocated data is read or written; the buffer
+ * cache serializes access to individual sectors.  WRITE_CNT is
+ * bumped under LOCK after each write.  DIR_LOCK, used only
+ * for directories, is held by directory.c while it searches or
+ * changes entries.  OPEN_CNT is protected by the open inode
+ * table's lock.  FRAME_CNT belongs to the VM frame table, which
+ * counts the file pages it caches for mappings; while it is
+ * nonzero, reads and writes look for their pages there too.
+ *
+ * Data appended to a regular file waits in DELAY_BUF, a page
+ * that holds data sectors DELAY_START through DELAY_START +
+ * DELAY_CNT - 1, until sectors are allocated for all of it at
+ * once; see inode_write_at().  Bytes SYNC_START through SYNC_END
+ * - 1, also under LOCK, cover everything written since the last
+ * inode_sync(), which writes back only those; SYNC_END is 0 if
+ * nothing has been.
+ *
+ * A compressed file keeps its most recently used chunk, as read
+ * or written, decompressed in CHUNK_BUF, a page, under LOCK. */
 struct inode {
-    struct list_elem  elem;           /* Element in inode list. */
+    struct hash_elem  elem;           /* Element in open inode table. */
     block_sector_t    sector;         /* Sector number of disk location. */
     int               open_cnt;       /* Number of openers. */
     bool              removed;        /* True if deleted, false otherwise. */
     int               deny_write_cnt; /* 0: writes ok, >0: deny writes. */
+    off_t             free_hint;      /* Directories: no free slot below. */
+    unsigned          write_cnt;      /* Number of writes completed. */
+    uint8_t          *delay_buf;      /* Appended data not yet allocated. */
+    size_t            delay_start;    /* First data sector in DELAY_BUF. */
+    size_t            delay_cnt;      /* Number of sectors in DELAY_BUF. */
+    struct list_elem  delay_elem;     /* In delayed list or reclaim queue. */
+    off_t             sync_start;     /* First byte written since sync. */
+    off_t             sync_end;       /* End of bytes written since sync. */
+    uint8_t          *chunk_buf;      /* Compressed files: a chunk. */
+    size_t            chunk_idx;      /* Chunk in CHUNK_BUF. */
+    struct lock       lock;           /* Protects block map and length. */
+    struct rwlock     dir_lock;       /* Directories: protects entries. */
+    unsigned          frame_cnt;      /* Pages cached in shared frames. */
     struct inode_disk data;           /* Inode content. */
+    struct rcu_head   rcu;            /* Frees the inode once closed. */
 };
 
 void inode_init(void);
@@ -35,10 +145,29 @@ struct inode *inode_reopen(struct inode *);
 block_sector_t inode_get_inumber(const struct inode *);
 void inode_close(struct inode *);
 void inode_remove(struct inode *);
+void inode_reclaim_wait(void);
 off_t inode_read_at(struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_data(struct inode *, void *, off_t size, off_t offset,
+                      bool stream);
+off_t inode_read_page(struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at(struct inode *, const void *, off_t size, off_t offset);
+off_t inode_write_data(struct inode *, const void *, off_t size,
+                       off_t offset);
+bool inode_preallocate(struct inode *, off_t offset, off_t size);
+void inode_read_ahead(struct inode *, off_t offset, int sectors);
+void inode_prefetch(block_sector_t);
+bool inode_is_cached(struct inode *, off_t offset, off_t size);
+void inode_allocate_delayed(void);
+void inode_sync(struct inode *, bool data_only);
+bool inode_set_compressed(struct inode *);
+bool inode_clone(struct inode *dst, struct inode *src);
+size_t inode_extent_cnt(struct inode *);
+bool inode_defrag(struct inode *);
 void inode_deny_write(struct inode *);
 void inode_allow_write(struct inode *);
+unsigned inode_write_cnt(const struct inode *);
+void inode_count_frames(struct inode *, int delta);
+bool inode_is_removed(const struct inode *);
 off_t inode_length(const struct inode *);
 
 #endif /* filesys/inode.h */
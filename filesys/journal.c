@@ -0,0 +1,288 @@
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata write-ahead log.
+ *
+ * Metadata sectors written inside an operation are held in the
+ * buffer cache, neither written back nor evicted, and their
+ * numbers are added to the running transaction.  The running
+ * transaction gathers the changes of every operation since the
+ * last commit.  A commit waits until no operation is in
+ * progress, then:
+ *
+ *   1. writes back ordinary dirty data, so that the metadata
+ *      about to be committed never points to unwritten sectors;
+ *   2. copies the held sectors into the log with one
+ *      sequential write;
+ *   3. writes the header, listing where each copy belongs -- this
+ *      single-sector write is the commit point;
+ *   4. writes the held sectors in place and releases them;
+ *   5. clears the header.
+ *
+ * A crash before step 3 loses the transaction and leaves the old
+ * metadata intact; a crash after it is repaired at the next
+ * mount by copying the logged sectors into place again.  The
+ * flusher thread commits periodically, so the operations
+ * themselves never wait for the disk. */
+
+/* Identifies the log header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Log header, at JOURNAL_SECTOR.
+ * Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header {
+    uint32_t       magic;                       /* JOURNAL_MAGIC. */
+    uint32_t       cnt;                         /* Committed sectors, or 0. */
+    block_sector_t sectors[JOURNAL_CAPACITY];   /* Home of each copy. */
+    uint8_t        unused[BLOCK_SECTOR_SIZE - 8
+                          - JOURNAL_CAPACITY * sizeof(block_sector_t)];
+};
+
+static struct lock journal_lock;    /* Protects everything below. */
+static struct condition journal_changed; /* OUTSTANDING or COMMITTING changed. */
+static int outstanding;             /* Operations in progress. */
+static bool committing;             /* Commit waiting or under way? */
+
+/* Running transaction: sectors held in the cache. */
+static block_sector_t logged[JOURNAL_CAPACITY];
+static size_t logged_cnt;
+
+static struct journal_header header; /* Header being written. */
+static uint8_t *log_buf;            /* Copies of the logged sectors. */
+
+/* Statistics. */
+static unsigned long long op_cnt, commit_cnt, logged_total, overflow_cnt;
+
+static void commit(void);
+static int sector_cmp(const void *, const void *, void *);
+
+/* Initializes the journal. */
+void
+journal_init(void)
+{
+    ASSERT(sizeof header == BLOCK_SECTOR_SIZE);
+
+    lock_init(&journal_lock);
+    cond_init(&journal_changed);
+    outstanding = 0;
+    committing = false;
+    logged_cnt = 0;
+    if (log_buf == NULL) {
+        log_buf = malloc(JOURNAL_CAPACITY * BLOCK_SECTOR_SIZE);
+        if (log_buf == NULL) {
+            PANIC("can't allocate journal buffer");
+        }
+    }
+}
+
+/* Writes an empty log to a newly formatted file system. */
+void
+journal_create(void)
+{
+    memset(&header, 0, sizeof header);
+    header.magic = JOURNAL_MAGIC;
+    block_write(fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Completes the transaction, if any, that was committed but not
+ * yet written in place when the system went down.  Must be
+ * called before anything else reads the file system. */
+void
+journal_recover(void)
+{
+    size_t i;
+
+    block_read(fs_device, JOURNAL_SECTOR, &header);
+    if (header.magic != JOURNAL_MAGIC) {
+        PANIC("file system has no journal (reformat it with -f)");
+    }
+    if (header.cnt == 0) {
+        return;
+    }
+    if (header.cnt > JOURNAL_CAPACITY) {
+        PANIC("corrupt journal header");
+    }
+
+    printf("filesys: replaying %"PRIu32" sectors from journal\n", header.cnt);
+    block_read_multiple(fs_device, JOURNAL_SECTOR + 1, header.cnt, log_buf);
+    for (i = 0; i < header.cnt; i++) {
+        block_write(fs_device, header.sectors[i],
+                    log_buf + i * BLOCK_SECTOR_SIZE);
+    }
+    header.cnt = 0;
+    block_write(fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Starts an operation, or a nested part of one.  The outermost
+ * call waits while a commit is under way or while the log lacks
+ * room for JOURNAL_OP_MAX more sectors for each operation in
+ * progress; if none is in progress, it commits the log itself. */
+void
+journal_begin(void)
+{
+    if (thread_current()->journal_depth++ > 0) {
+        return;
+    }
+
+    lock_acquire(&journal_lock);
+    for (;;) {
+        if (committing) {
+            cond_wait(&journal_changed, &journal_lock);
+        } else if (logged_cnt + (outstanding + 1) * JOURNAL_OP_MAX
+                   <= JOURNAL_CAPACITY) {
+            break;
+        } else if (outstanding == 0) {
+            committing = true;
+            commit();
+            committing = false;
+            cond_broadcast(&journal_changed, &journal_lock);
+        } else {
+            cond_wait(&journal_changed, &journal_lock);
+        }
+    }
+    outstanding++;
+    op_cnt++;
+    lock_release(&journal_lock);
+}
+
+/* Ends an operation, or a nested part of one, started with
+ * journal_begin().  Its changes become durable at the next
+ * commit. */
+void
+journal_end(void)
+{
+    struct thread *t = thread_current();
+
+    ASSERT(t->journal_depth > 0);
+    if (--t->journal_depth > 0) {
+        return;
+    }
+
+    lock_acquire(&journal_lock);
+    if (--outstanding == 0) {
+        cond_broadcast(&journal_changed, &journal_lock);
+    }
+    lock_release(&journal_lock);
+}
+
+/* Returns true if the running thread is inside an operation, so
+ * that its cache writes must be logged. */
+bool
+journal_active(void)
+{
+    return thread_current()->journal_depth > 0;
+}
+
+/* Adds SECTOR, which the running thread's operation has just
+ * written, to the running transaction.  Returns true if
+ * successful, in which case the buffer cache must hold the
+ * sector until it is committed.
+ *
+ * Returns false if the log is full, which happens only when a
+ * single operation changes more than JOURNAL_OP_MAX sectors, in
+ * practice when a large directory doubles its bucket count.  The
+ * rest of such an operation goes to disk unlogged, as it would
+ * without a journal. */
+bool
+journal_add(block_sector_t sector)
+{
+    bool success;
+
+    lock_acquire(&journal_lock);
+    success = logged_cnt < JOURNAL_CAPACITY;
+    if (success) {
+        logged[logged_cnt++] = sector;
+    } else {
+        overflow_cnt++;
+    }
+    lock_release(&journal_lock);
+    return success;
+}
+
+/* Commits the running transaction once the operations now in
+ * progress have ended. */
+void
+journal_commit(void)
+{
+    lock_acquire(&journal_lock);
+    while (committing) {
+        cond_wait(&journal_changed, &journal_lock);
+    }
+    committing = true;
+    while (outstanding > 0) {
+        cond_wait(&journal_changed, &journal_lock);
+    }
+    commit();
+    committing = false;
+    cond_broadcast(&journal_changed, &journal_lock);
+    lock_release(&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats(void)
+{
+    printf("Journal: %llu operations, %llu commits, %llu sectors logged, "
+           "%llu unlogged for lack of room\n",
+           op_cnt, commit_cnt, logged_total, overflow_cnt);
+}
+
+/* Writes the running transaction to the log and then in place,
+ * as described at the top of this file.  Journal_lock must be
+ * held, COMMITTING set and no operation in progress. */
+static void
+commit(void)
+{
+    size_t i;
+
+    ASSERT(lock_held_by_current_thread(&journal_lock));
+    ASSERT(committing && outstanding == 0);
+
+    if (logged_cnt == 0) {
+        return;
+    }
+
+    cache_flush();
+
+    /* Sorted, the in-place writes make one sweep. */
+    sort(logged, logged_cnt, sizeof *logged, sector_cmp, NULL);
+    for (i = 0; i < logged_cnt; i++) {
+        cache_read(logged[i], log_buf + i * BLOCK_SECTOR_SIZE);
+    }
+    block_write_multiple(fs_device, JOURNAL_SECTOR + 1, logged_cnt, log_buf);
+
+    memset(&header, 0, sizeof header);
+    header.magic = JOURNAL_MAGIC;
+    header.cnt = logged_cnt;
+    memcpy(header.sectors, logged, logged_cnt * sizeof *logged);
+    block_write(fs_device, JOURNAL_SECTOR, &header);
+
+    for (i = 0; i < logged_cnt; i++) {
+        cache_checkpoint(logged[i]);
+    }
+    header.cnt = 0;
+    block_write(fs_device, JOURNAL_SECTOR, &header);
+
+    commit_cnt++;
+    logged_total += logged_cnt;
+    logged_cnt = 0;
+}
+
+/* Orders sector numbers. */
+static int
+sector_cmp(const void *a_, const void *b_, void *aux UNUSED)
+{
+    block_sector_t a = *(const block_sector_t *)a_;
+    block_sector_t b = *(const block_sector_t *)b_;
+
+    return a < b ? -1 : a > b;
+}
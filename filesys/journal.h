@@ -0,0 +1,36 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+
+#include "devices/block.h"
+
+/* Most metadata sectors the log holds at once, and most that
+ * one operation, including the operations nested in it, is
+ * expected to change.  See journal_add(). */
+#define JOURNAL_CAPACITY 32
+#define JOURNAL_OP_MAX 16
+
+/* Sectors reserved for the log, starting at JOURNAL_SECTOR: a
+ * header, then a copy of each logged sector. */
+#define JOURNAL_SECTORS (1 + JOURNAL_CAPACITY)
+
+void journal_init(void);
+void journal_create(void);
+void journal_recover(void);
+
+/* An operation that changes metadata brackets the changes with
+ * journal_begin() and journal_end(); every cache write made in
+ * between is logged, and all of it reaches the disk or none of
+ * it does.  Operations nest.  The outermost journal_begin() may
+ * wait for the log to be committed, so it must be called before
+ * acquiring any file system lock. */
+void journal_begin(void);
+void journal_end(void);
+bool journal_active(void);
+bool journal_add(block_sector_t);
+
+void journal_commit(void);
+void journal_print_stats(void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,15 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+/* A buffer for the readv() and writev() system calls, which take
+ * an array of them.  The kernel and user programs share this
+ * definition. */
+struct iovec {
+    void *iov_base;   /* Start of buffer. */
+    unsigned iov_len; /* Length of buffer in bytes. */
+};
+
+/* Maximum number of buffers passed to readv() or writev(). */
+#define IOV_MAX 32
+
+#endif /* lib/iovec.h */
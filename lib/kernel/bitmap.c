@@ -28,6 +28,13 @@ typedef unsigned long elem_type;
 struct bitmap {
     size_t     bit_cnt; /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+
+    /* Summary, for bitmaps from bitmap_create_summarized() only:
+     * bit I of SUMMARY is set if and only if every bit of element
+     * I is set, and HINT is the first element with a bit unset
+     * (or the number of elements, if none). */
+    struct bitmap *summary;
+    size_t     hint;
 };
 
 /* Returns the index of the element that contains the bit
@@ -70,6 +77,54 @@ last_mask(const struct bitmap *b)
     return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type) - 1;
 }
 
+static void update_summary(struct bitmap *, size_t idx);
+#ifdef FILESYS
+static void rebuild_summary(struct bitmap *);
+#endif
+
+/* Returns the index of the first bit in B between START and END,
+ * exclusive, that is set to VALUE, or END if there is none.
+ * Whole elements that hold no such bit are skipped with a single
+ * test each, and the bit within an element is found with a
+ * count-trailing-zeros instruction, so the cost is proportional
+ * to the number of elements rather than the number of bits. */
+static size_t
+find_bit(const struct bitmap *b, size_t start, size_t end, bool value)
+{
+    elem_type flip = value ? 0 : (elem_type) -1;
+    bool use_summary = !value && b->summary != NULL;
+    size_t idx;
+    elem_type word;
+
+    /* No unset bit lies below the hint. */
+    if (use_summary && start < b->hint * ELEM_BITS) {
+        start = b->hint * ELEM_BITS;
+    }
+    if (start >= end) {
+        return end;
+    }
+
+    /* Ignore the bits below START in its element. */
+    idx = elem_idx(start);
+    word = (b->bits[idx] ^ flip) & ~(bit_mask(start) - 1);
+    while (word == 0) {
+        /* Go on to the next element, skipping full ones if the
+         * summary can tell which they are. */
+        if (use_summary) {
+            idx = find_bit(b->summary, idx + 1, elem_cnt(end), false);
+        } else {
+            idx++;
+        }
+        if (idx >= elem_cnt(end)) {
+            return end;
+        }
+        word = b->bits[idx] ^ flip;
+    }
+
+    start = idx * ELEM_BITS + __builtin_ctzl(word);
+    return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -84,6 +139,8 @@ bitmap_create(size_t bit_cnt)
     if (b != NULL) {
         b->bit_cnt = bit_cnt;
         b->bits = malloc(byte_cnt(bit_cnt));
+        b->summary = NULL;
+        b->hint = 0;
         if (b->bits != NULL || bit_cnt == 0) {
             bitmap_set_all(b, false);
             return b;
@@ -93,6 +150,30 @@ bitmap_create(size_t bit_cnt)
     return NULL;
 }
 
+/* Creates and returns a bitmap like bitmap_create(), except that
+ * it also keeps a summary bit for each element, set when the
+ * element is full, and the index of the first element that is
+ * not.  Searches for unset bits then start at that element and
+ * skip over full elements a summary word at a time, so they stay
+ * fast in a big, nearly full bitmap such as a free map.  Changing
+ * bits costs a little more, and unlike the bits themselves, the
+ * summary is not updated atomically, so changes to such a bitmap
+ * must be serialized, by a lock for instance. */
+struct bitmap *
+bitmap_create_summarized(size_t bit_cnt)
+{
+    struct bitmap *b = bitmap_create(bit_cnt);
+
+    if (b != NULL) {
+        b->summary = bitmap_create(elem_cnt(bit_cnt));
+        if (b->summary == NULL) {
+            bitmap_destroy(b);
+            return NULL;
+        }
+    }
+    return b;
+}
+
 /* Creates and returns a bitmap with BIT_CNT bits in the
  * BLOCK_SIZE bytes of storage preallocated at BLOCK.
  * BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT). */
@@ -105,6 +186,8 @@ bitmap_create_in_buf(size_t bit_cnt, void *block, size_t block_size UNUSED)
 
     b->bit_cnt = bit_cnt;
     b->bits = (elem_type *)(b + 1);
+    b->summary = NULL;
+    b->hint = 0;
     bitmap_set_all(b, false);
     return b;
 }
@@ -123,6 +206,7 @@ void
 bitmap_destroy(struct bitmap *b)
 {
     if (b != NULL) {
+        bitmap_destroy(b->summary);
         free(b->bits);
         free(b);
     }
@@ -162,7 +246,8 @@ bitmap_mark(struct bitmap *b, size_t bit_idx)
     /* This is equivalent to `b->bits[idx] |= mask' except that it
      * is guaranteed to be atomic on a uniprocessor machine.  See
      * the description of the OR instruction in [IA32-v2b]. */
-    asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    asm ("or %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    update_summary(b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -175,7 +260,8 @@ bitmap_reset(struct bitmap *b, size_t bit_idx)
     /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      * is guaranteed to be atomic on a uniprocessor machine.  See
      * the description of the AND instruction in [IA32-v2a]. */
-    asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+    asm ("and %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+    update_summary(b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -190,7 +276,8 @@ bitmap_flip(struct bitmap *b, size_t bit_idx)
     /* This is equivalent to `b->bits[idx] ^= mask' except that it
      * is guaranteed to be atomic on a uniprocessor machine.  See
      * the description of the XOR instruction in [IA32-v2b]. */
-    asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    asm ("xor %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    update_summary(b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -253,18 +340,11 @@ bitmap_count(const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i;
-
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    for (i = 0; i < cnt; i++) {
-        if (bitmap_test(b, start + i) == value) {
-            return true;
-        }
-    }
-    return false;
+    return find_bit(b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -296,21 +376,33 @@ bitmap_all(const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
  * consecutive bits in B at or after START that are all set to
  * VALUE.
- * If there is no such group, returns BITMAP_ERROR. */
+ * If there is no such group, returns BITMAP_ERROR.
+ *
+ * Rather than testing each candidate start in turn, this jumps to
+ * the next bit set to VALUE, measures the run that begins there,
+ * and if the run is too short resumes after the bit that ended
+ * it, so each element of B is examined about once. */
 size_t
 bitmap_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
 
-    if (cnt <= b->bit_cnt) {
-        size_t last = b->bit_cnt - cnt;
-        size_t i;
-        for (i = start; i <= last; i++) {
-            if (!bitmap_contains(b, i, cnt, !value)) {
-                return i;
-            }
+    if (cnt == 0) {
+        return start;
+    }
+    while (cnt <= b->bit_cnt - start) {
+        size_t run_end;
+
+        start = find_bit(b, start, b->bit_cnt - cnt + 1, value);
+        if (start > b->bit_cnt - cnt) {
+            break;
         }
+        run_end = find_bit(b, start, start + cnt, !value);
+        if (run_end == start + cnt) {
+            return start;
+        }
+        start = run_end + 1;
     }
     return BITMAP_ERROR;
 }
@@ -354,6 +446,40 @@ bitmap_read(struct bitmap *b, struct file *file)
         off_t size = byte_cnt(b->bit_cnt);
         success = file_read_at(file, b->bits, size, 0) == size;
         b->bits[elem_cnt(b->bit_cnt) - 1] &= last_mask(b);
+        rebuild_summary(b);
+    }
+    return success;
+}
+
+/* Reads from FILE only the part of B that holds the CNT bits
+ * starting at START, leaving the rest of B alone.  START must
+ * begin an element, and START + CNT must end one or be the size
+ * of B.  Returns true if successful, false otherwise. */
+bool
+bitmap_read_range(struct bitmap *b, struct file *file,
+                  size_t start, size_t cnt)
+{
+    size_t first, last, i;
+    off_t size;
+    bool success;
+
+    ASSERT(start <= b->bit_cnt);
+    ASSERT(cnt <= b->bit_cnt - start);
+    ASSERT(start % ELEM_BITS == 0);
+    ASSERT((start + cnt) % ELEM_BITS == 0 || start + cnt == b->bit_cnt);
+    if (cnt == 0) {
+        return true;
+    }
+    first = elem_idx(start);
+    last = elem_idx(start + cnt - 1);
+    size = (last - first + 1) * sizeof(elem_type);
+    success = file_read_at(file, b->bits + first, size,
+                           first * sizeof(elem_type)) == size;
+    if (last == elem_cnt(b->bit_cnt) - 1) {
+        b->bits[last] &= last_mask(b);
+    }
+    for (i = first; i <= last; i++) {
+        update_summary(b, i);
     }
     return success;
 }
@@ -367,8 +493,80 @@ bitmap_write(const struct bitmap *b, struct file *file)
 
     return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE only the part of B that holds the CNT bits
+ * starting at START, which is cheaper than bitmap_write() when
+ * few bits changed.  Return true if successful, false
+ * otherwise. */
+bool
+bitmap_write_range(const struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt)
+{
+    off_t first, last;
+
+    ASSERT(start <= b->bit_cnt);
+    ASSERT(cnt <= b->bit_cnt - start);
+    if (cnt == 0) {
+        return true;
+    }
+    first = start / CHAR_BIT;
+    last = (start + cnt - 1) / CHAR_BIT;
+    return (file_write_at(file, (const uint8_t *)b->bits + first,
+                          last - first + 1, first)
+            == last - first + 1);
+}
 #endif /* FILESYS */
 
+/* Summaries. */
+
+/* Returns true if every bit of B's element IDX is set. */
+static bool
+elem_full(const struct bitmap *b, size_t idx)
+{
+    elem_type used = (idx == elem_cnt(b->bit_cnt) - 1
+                      ? last_mask(b) : (elem_type) -1);
+
+    return (b->bits[idx] & used) == used;
+}
+
+/* Brings B's summary up to date after a change to element IDX. */
+static void
+update_summary(struct bitmap *b, size_t idx)
+{
+    bool full;
+
+    if (b->summary == NULL) {
+        return;
+    }
+
+    full = elem_full(b, idx);
+    if (full != bitmap_test(b->summary, idx)) {
+        bitmap_set(b->summary, idx, full);
+    }
+    if (!full && idx < b->hint) {
+        b->hint = idx;
+    } else if (full && idx == b->hint) {
+        b->hint = find_bit(b->summary, idx, bitmap_size(b->summary), false);
+    }
+}
+
+#ifdef FILESYS
+/* Recomputes B's summary from scratch. */
+static void
+rebuild_summary(struct bitmap *b)
+{
+    size_t i;
+
+    if (b->summary == NULL) {
+        return;
+    }
+    for (i = 0; i < elem_cnt(b->bit_cnt); i++) {
+        bitmap_set(b->summary, i, elem_full(b, i));
+    }
+    b->hint = find_bit(b->summary, 0, bitmap_size(b->summary), false);
+}
+#endif
+
 /* Debugging. */
 
 /* Dumps the contents of B to the console as hexadecimal. */
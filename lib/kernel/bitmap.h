@@ -9,6 +9,7 @@
 
 /* Creation and destruction. */
 struct bitmap *bitmap_create(size_t bit_cnt);
+struct bitmap *bitmap_create_summarized(size_t bit_cnt);
 struct bitmap *bitmap_create_in_buf(size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size(size_t bit_cnt);
 void bitmap_destroy(struct bitmap *);
@@ -42,7 +43,11 @@ size_t bitmap_scan_and_flip(struct bitmap *, size_t start, size_t cnt, bool);
 struct file;
 size_t bitmap_file_size(const struct bitmap *);
 bool bitmap_read(struct bitmap *, struct file *);
+bool bitmap_read_range(struct bitmap *, struct file *,
+                       size_t start, size_t cnt);
 bool bitmap_write(const struct bitmap *, struct file *);
+bool bitmap_write_range(const struct bitmap *, struct file *,
+                        size_t start, size_t cnt);
 #endif
 
 /* Debugging. */
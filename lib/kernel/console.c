@@ -1,17 +1,29 @@
 #include <console.h>
+#include <kstat.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "devices/debugcon.h"
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
+/* Auxiliary data for vprintf_helper(). */
+struct vprintf_aux {
+    char   buf[128]; /* Characters not yet written. */
+    size_t len;      /* Number of characters in BUF. */
+    int    char_cnt; /* Total characters formatted so far. */
+};
+
 static void vprintf_helper(char, void *);
 
 static void putchar_have_lock(uint8_t c);
 
+static void putbuf_have_lock(const char *, size_t);
+
 /* The console lock.
  * Both the vga and serial layers do their own locking, so it's
  * safe to call them at any time.
@@ -85,6 +97,13 @@ console_print_stats(void)
     printf("Console: %lld characters output\n", write_cnt);
 }
 
+/* Stores the number of characters output in *ST. */
+void
+console_kstat(struct kstat *st)
+{
+    st->console_chars = write_cnt;
+}
+
 /* Acquires the console lock. */
 static void
 acquire_console(void)
@@ -123,17 +142,24 @@ console_locked_by_current_thread(void)
 
 /* The standard vprintf() function,
  * which is like printf() but uses a va_list.
- * Writes its output to both vga display and serial port. */
+ * Writes its output to both vga display and serial port.
+ *
+ * The output is collected in a buffer on the stack and handed to
+ * the devices a buffer at a time, since each device call disables
+ * interrupts and does its own bookkeeping. */
 int
 vprintf(const char *format, va_list args)
 {
-    int char_cnt = 0;
+    struct vprintf_aux aux;
 
+    aux.len = 0;
+    aux.char_cnt = 0;
     acquire_console();
-    __vprintf(format, args, vprintf_helper, &char_cnt);
+    __vprintf(format, args, vprintf_helper, &aux);
+    putbuf_have_lock(aux.buf, aux.len);
     release_console();
 
-    return char_cnt;
+    return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -142,23 +168,21 @@ int
 puts(const char *s)
 {
     acquire_console();
-    while (*s != '\0') {
-        putchar_have_lock(*s++);
-    }
+    putbuf_have_lock(s, strlen(s));
     putchar_have_lock('\n');
     release_console();
 
     return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.  The whole
+ * buffer is handed to each device at once, instead of a
+ * character at a time as printf() does. */
 void
 putbuf(const char *buffer, size_t n)
 {
     acquire_console();
-    while (n-- > 0) {
-        putchar_have_lock(*buffer++);
-    }
+    putbuf_have_lock(buffer, n);
     release_console();
 }
 
@@ -175,15 +199,20 @@ putchar(int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper(char c, void *char_cnt_)
+vprintf_helper(char c, void *aux_)
 {
-    int *char_cnt = char_cnt_;
+    struct vprintf_aux *aux = aux_;
 
-    (*char_cnt)++;
-    putchar_have_lock(c);
+    aux->buf[aux->len++] = c;
+    aux->char_cnt++;
+    if (aux->len >= sizeof aux->buf) {
+        putbuf_have_lock(aux->buf, aux->len);
+        aux->len = 0;
+    }
 }
 
-/* Writes C to the vga display and serial port.
+/* Writes C to the vga display and serial port, or the debug
+ * port instead of the serial port if that is enabled.
  * The caller has already acquired the console lock if
  * appropriate. */
 static void
@@ -191,6 +220,29 @@ putchar_have_lock(uint8_t c)
 {
     ASSERT(console_locked_by_current_thread());
     write_cnt++;
-    serial_putc(c);
+    if (debugcon_enabled) {
+        debugcon_putc(c);
+    } else {
+        serial_putc(c);
+    }
     vga_putc(c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and
+ * serial port, or the debug port instead of the serial port if
+ * that is enabled.  The caller has already acquired the console
+ * lock if appropriate. */
+static void
+putbuf_have_lock(const char *buffer, size_t n)
+{
+    ASSERT(console_locked_by_current_thread());
+    if (n > 0) {
+        write_cnt += n;
+        if (debugcon_enabled) {
+            debugcon_putbuf((const uint8_t *)buffer, n);
+        } else {
+            serial_putbuf((const uint8_t *)buffer, n);
+        }
+        vga_putbuf(buffer, n);
+    }
+}
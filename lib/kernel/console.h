@@ -1,8 +1,11 @@
 #ifndef __LIB_KERNEL_CONSOLE_H
 #define __LIB_KERNEL_CONSOLE_H
 
+struct kstat;
+
 void console_init(void);
 void console_panic(void);
 void console_print_stats(void);
+void console_kstat(struct kstat *);
 
 #endif /* lib/kernel/console.h */
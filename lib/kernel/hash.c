@@ -6,6 +6,7 @@
  * See hash.h for basic information. */
 
 #include "../debug.h"
+#include "../string.h"
 #include "hash.h"
 #include "threads/malloc.h"
 
@@ -17,6 +18,7 @@ static struct hash_elem *find_elem(struct hash *, struct list *, struct hash_ele
 static void insert_elem(struct hash *, struct list *, struct hash_elem *);
 static void remove_elem(struct hash *, struct hash_elem *);
 static void rehash(struct hash *);
+static void move_buckets(struct hash *, size_t cnt);
 
 /* Initializes hash table H to compute hash values using HASH and
  * compare hash elements using LESS, given auxiliary data AUX. */
@@ -27,6 +29,9 @@ hash_init(struct hash *h,
     h->elem_cnt = 0;
     h->bucket_cnt = 4;
     h->buckets = malloc(sizeof *h->buckets * h->bucket_cnt);
+    h->old_bucket_cnt = 0;
+    h->old_buckets = NULL;
+    h->old_pos = 0;
     h->hash = hash;
     h->less = less;
     h->aux = aux;
@@ -53,6 +58,9 @@ hash_clear(struct hash *h, hash_action_func *destructor)
 {
     size_t i;
 
+    /* Finish moving, so that all the elements are in one array. */
+    move_buckets(h, SIZE_MAX);
+
     for (i = 0; i < h->bucket_cnt; i++) {
         struct list *bucket = &h->buckets[i];
 
@@ -86,6 +94,7 @@ hash_destroy(struct hash *h, hash_action_func *destructor)
     if (destructor != NULL) {
         hash_clear(h, destructor);
     }
+    free(h->old_buckets);
     free(h->buckets);
 }
 
@@ -153,6 +162,24 @@ hash_delete(struct hash *h, struct hash_elem *e)
     return found;
 }
 
+/* Inserts E into BUCKET, its bucket in hash table H, which must
+ * hold no equal element.  For HASH_DEFINE. */
+void
+hash_insert_bucket(struct hash *h, struct list *bucket,
+                   struct hash_elem *e)
+{
+    insert_elem(h, bucket, e);
+    rehash(h);
+}
+
+/* Removes E, which must be in hash table H, from H. */
+void
+hash_remove(struct hash *h, struct hash_elem *e)
+{
+    remove_elem(h, e);
+    rehash(h);
+}
+
 /* Calls ACTION for each element in hash table H in arbitrary
  * order.
  * Modifying hash table H while hash_apply() is running, using
@@ -166,8 +193,10 @@ hash_apply(struct hash *h, hash_action_func *action)
 
     ASSERT(action != NULL);
 
-    for (i = 0; i < h->bucket_cnt; i++) {
-        struct list *bucket = &h->buckets[i];
+    for (i = 0; i < h->old_bucket_cnt + h->bucket_cnt; i++) {
+        struct list *bucket = (i < h->old_bucket_cnt
+                               ? &h->old_buckets[i]
+                               : &h->buckets[i - h->old_bucket_cnt]);
         struct list_elem *elem, *next;
 
         for (elem = list_begin(bucket); elem != list_end(bucket); elem = next) {
@@ -201,7 +230,7 @@ hash_first(struct hash_iterator *i, struct hash *h)
     ASSERT(h != NULL);
 
     i->hash = h;
-    i->bucket = i->hash->buckets;
+    i->bucket = h->old_buckets != NULL ? h->old_buckets : h->buckets;
     i->elem = list_elem_to_hash_elem(list_head(i->bucket));
 }
 
@@ -220,7 +249,13 @@ hash_next(struct hash_iterator *i)
 
     i->elem = list_elem_to_hash_elem(list_next(&i->elem->list_elem));
     while (i->elem == list_elem_to_hash_elem(list_end(i->bucket))) {
-        if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
+        struct hash *h = i->hash;
+
+        if (++i->bucket == h->old_buckets + h->old_bucket_cnt
+            && h->old_buckets != NULL) {
+            /* Done with the old buckets; go on to the new ones. */
+            i->bucket = h->buckets;
+        } else if (i->bucket == h->buckets + h->bucket_cnt) {
             i->elem = NULL;
             break;
         }
@@ -253,15 +288,62 @@ hash_empty(struct hash *h)
     return h->elem_cnt == 0;
 }
 
+/* MurmurHash3 constants, for 32-bit word sizes. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* Returns a hash of the SIZE bytes in BUF.  The value is not
+ * stable across releases, so it must not be stored on disk; see
+ * hash_bytes_fnv(). */
+unsigned
+hash_bytes(const void *buf_, size_t size)
+{
+    /* MurmurHash3, 32-bit, a word at a time.  memcpy() reads
+     * each word whatever its alignment and the type of the data,
+     * and compiles to a single load on x86. */
+    const uint8_t *buf = buf_;
+    unsigned hash = 0;
+    unsigned k;
+    size_t i;
+
+    ASSERT(buf != NULL);
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        memcpy(&k, buf + i, sizeof k);
+        k *= MURMUR_C1;
+        k = (k << 15 | k >> 17) * MURMUR_C2;
+        hash ^= k;
+        hash = (hash << 13 | hash >> 19) * 5 + 0xe6546b64u;
+    }
+
+    /* The last 1 to 3 bytes. */
+    k = 0;
+    switch (size & 3) {
+    case 3:
+        k ^= buf[i + 2] << 16;
+        /* Fall through. */
+    case 2:
+        k ^= buf[i + 1] << 8;
+        /* Fall through. */
+    case 1:
+        k ^= buf[i];
+        k *= MURMUR_C1;
+        hash ^= (k << 15 | k >> 17) * MURMUR_C2;
+    }
+
+    return hash_mix(hash ^ size);
+}
+
 /* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
 #define FNV_32_PRIME 16777619u
 #define FNV_32_BASIS 2166136261u
 
-/* Returns a hash of the SIZE bytes in BUF. */
+/* Returns a hash of the SIZE bytes in BUF, by the Fowler-Noll-Vo
+ * 32-bit hash, a byte at a time.  Unlike hash_bytes(), this
+ * value never changes, so it may be stored. */
 unsigned
-hash_bytes(const void *buf_, size_t size)
+hash_bytes_fnv(const void *buf_, size_t size)
 {
-    /* Fowler-Noll-Vo 32-bit hash, for bytes. */
     const unsigned char *buf = buf_;
     unsigned hash;
 
@@ -275,7 +357,9 @@ hash_bytes(const void *buf_, size_t size)
     return hash;
 }
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S.  This is the Fowler-Noll-Vo 32-bit
+ * hash, as hash_bytes_fnv(), because directories store it to
+ * index their entries on disk, so it must not change. */
 unsigned
 hash_string(const char *s_)
 {
@@ -292,20 +376,12 @@ hash_string(const char *s_)
     return hash;
 }
 
-/* Returns a hash of integer I. */
-unsigned
-hash_int(int i)
-{
-    return hash_bytes(&i, sizeof i);
-}
-
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in.  While H is being
+ * resized, that is the old bucket if it has not been moved yet. */
 static struct list *
 find_bucket(struct hash *h, struct hash_elem *e)
 {
-    size_t bucket_idx = h->hash(e, h->aux) & (h->bucket_cnt - 1);
-
-    return &h->buckets[bucket_idx];
+    return hash_bucket(h, h->hash(e, h->aux));
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -343,22 +419,34 @@ is_power_of_2(size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Number of old buckets moved by each insertion or deletion
+ * while a resize is in progress. */
+#define MOVE_BUCKETS 4
+
 /* Changes the number of buckets in hash table H to match the
  * ideal.  This function can fail because of an out-of-memory
  * condition, but that'll just make hash accesses less efficient;
- * we can still continue. */
+ * we can still continue.
+ *
+ * Rather than moving every element at once, which would make a
+ * single insertion into a big table take time proportional to
+ * its size, the old buckets are kept alongside the new ones and
+ * MOVE_BUCKETS of them are moved on each call.  Until a bucket
+ * has been moved, find_bucket() keeps using it.  No new resize
+ * starts until the last one has finished. */
 static void
 rehash(struct hash *h)
 {
-    size_t old_bucket_cnt, new_bucket_cnt;
-    struct list *new_buckets, *old_buckets;
+    size_t new_bucket_cnt;
+    struct list *new_buckets;
     size_t i;
 
     ASSERT(h != NULL);
 
-    /* Save old bucket info for later use. */
-    old_buckets = h->buckets;
-    old_bucket_cnt = h->bucket_cnt;
+    if (h->old_buckets != NULL) {
+        move_buckets(h, MOVE_BUCKETS);
+        return;
+    }
 
     /* Calculate the number of buckets to use now.
      * We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -373,7 +461,7 @@ rehash(struct hash *h)
     }
 
     /* Don't do anything if the bucket count wouldn't change. */
-    if (new_bucket_cnt == old_bucket_cnt) {
+    if (new_bucket_cnt == h->bucket_cnt) {
         return;
     }
 
@@ -389,27 +477,45 @@ rehash(struct hash *h)
         list_init(&new_buckets[i]);
     }
 
-    /* Install new bucket info. */
+    /* Install new bucket info, keeping the old buckets to be
+     * moved a few at a time. */
+    h->old_buckets = h->buckets;
+    h->old_bucket_cnt = h->bucket_cnt;
+    h->old_pos = 0;
     h->buckets = new_buckets;
     h->bucket_cnt = new_bucket_cnt;
 
-    /* Move each old element into the appropriate new bucket. */
-    for (i = 0; i < old_bucket_cnt; i++) {
-        struct list *old_bucket;
-        struct list_elem *elem, *next;
+    move_buckets(h, MOVE_BUCKETS);
+}
 
-        old_bucket = &old_buckets[i];
-        for (elem = list_begin(old_bucket);
-             elem != list_end(old_bucket); elem = next) {
-            struct list *new_bucket
-                = find_bucket(h, list_elem_to_hash_elem(elem));
-            next = list_next(elem);
-            list_remove(elem);
-            list_push_front(new_bucket, elem);
+/* Moves the elements in up to CNT of H's old buckets, if any,
+ * into the new buckets, and frees the old buckets once they are
+ * all empty. */
+static void
+move_buckets(struct hash *h, size_t cnt)
+{
+    if (h->old_buckets == NULL) {
+        return;
+    }
+
+    while (cnt-- > 0 && h->old_pos < h->old_bucket_cnt) {
+        struct list *old_bucket = &h->old_buckets[h->old_pos++];
+
+        while (!list_empty(old_bucket)) {
+            struct list_elem *elem = list_pop_front(old_bucket);
+            struct hash_elem *e = list_elem_to_hash_elem(elem);
+            size_t idx = h->hash(e, h->aux) & (h->bucket_cnt - 1);
+
+            list_push_front(&h->buckets[idx], elem);
         }
     }
 
-    free(old_buckets);
+    if (h->old_pos >= h->old_bucket_cnt) {
+        free(h->old_buckets);
+        h->old_buckets = NULL;
+        h->old_bucket_cnt = 0;
+        h->old_pos = 0;
+    }
 }
 
 /* Inserts E into BUCKET (in hash table H). */
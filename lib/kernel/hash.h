@@ -60,6 +60,9 @@ struct hash {
     size_t          elem_cnt;   /* Number of elements in table. */
     size_t          bucket_cnt; /* Number of buckets, a power of 2. */
     struct list    *buckets;    /* Array of `bucket_cnt' lists. */
+    size_t          old_bucket_cnt; /* Number of old buckets. */
+    struct list    *old_buckets; /* Buckets being moved, or null. */
+    size_t          old_pos;    /* Index of next old bucket to move. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void           *aux;        /* Auxiliary data for `hash' and `less'. */
@@ -82,6 +85,82 @@ struct hash_elem *hash_insert(struct hash *, struct hash_elem *);
 struct hash_elem *hash_replace(struct hash *, struct hash_elem *);
 struct hash_elem *hash_find(struct hash *, struct hash_elem *);
 struct hash_elem *hash_delete(struct hash *, struct hash_elem *);
+void hash_insert_bucket(struct hash *, struct list *bucket,
+                        struct hash_elem *);
+void hash_remove(struct hash *, struct hash_elem *);
+
+/* Returns the bucket in H for elements whose hash value is
+ * HASH.  While H is being resized, that is the old bucket if it
+ * has not been moved yet. */
+static inline struct list *
+hash_bucket(struct hash *h, unsigned hash)
+{
+    if (h->old_buckets != NULL) {
+        size_t old_idx = hash & (h->old_bucket_cnt - 1);
+        if (old_idx >= h->old_pos) {
+            return &h->old_buckets[old_idx];
+        }
+    }
+    return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Defines NAME_find(), NAME_insert() and NAME_delete(), versions
+ * of hash_find(), hash_insert() and hash_delete() for a table of
+ * STRUCTs whose hash_elem is MEMBER.  They call HASH and EQUAL
+ * directly, so that these may be inlined, instead of the
+ * table's functions through pointers:
+ *
+ *    unsigned HASH (const STRUCT *);
+ *    bool EQUAL (const STRUCT *, const STRUCT *);
+ *
+ * HASH must return the same value as the table's hash function,
+ * which hash_init() still takes for resizing and for the
+ * generic functions, and EQUAL must be true just when neither
+ * element is less than the other by its less function. */
+#define HASH_DEFINE(NAME, STRUCT, MEMBER, HASH, EQUAL)                   \
+    static inline STRUCT *                                              \
+    NAME##_find_bucket(struct list *bucket, const STRUCT *key)          \
+    {                                                                   \
+        struct list_elem *e;                                            \
+                                                                        \
+        for (e = list_begin(bucket); e != list_end(bucket);             \
+             e = list_next(e)) {                                        \
+            STRUCT *s = list_entry(e, STRUCT, MEMBER.list_elem);        \
+            if (EQUAL(s, key)) {                                        \
+                return s;                                               \
+            }                                                           \
+        }                                                               \
+        return NULL;                                                    \
+    }                                                                   \
+                                                                        \
+    static inline STRUCT *                                              \
+    NAME##_find(struct hash *h, const STRUCT *key)                      \
+    {                                                                   \
+        return NAME##_find_bucket(hash_bucket(h, HASH(key)), key);      \
+    }                                                                   \
+                                                                        \
+    static inline STRUCT *                                              \
+    NAME##_insert(struct hash *h, STRUCT *new)                          \
+    {                                                                   \
+        struct list *bucket = hash_bucket(h, HASH(new));                \
+        STRUCT *old = NAME##_find_bucket(bucket, new);                  \
+                                                                        \
+        if (old == NULL) {                                              \
+            hash_insert_bucket(h, bucket, &new->MEMBER);                \
+        }                                                               \
+        return old;                                                     \
+    }                                                                   \
+                                                                        \
+    static inline STRUCT *                                              \
+    NAME##_delete(struct hash *h, const STRUCT *key)                    \
+    {                                                                   \
+        STRUCT *found = NAME##_find(h, key);                            \
+                                                                        \
+        if (found != NULL) {                                            \
+            hash_remove(h, &found->MEMBER);                             \
+        }                                                               \
+        return found;                                                   \
+    }
 
 /* Iteration. */
 void hash_apply(struct hash *, hash_action_func *);
@@ -96,6 +175,35 @@ bool hash_empty(struct hash *);
 /* Sample hash functions. */
 unsigned hash_bytes(const void *, size_t);
 unsigned hash_string(const char *);
-unsigned hash_int(int);
+unsigned hash_bytes_fnv(const void *, size_t);
+
+/* Returns X with its bits mixed so that each affects all of the
+ * result's: the 32-bit finalizer of MurmurHash3.  The table
+ * indexes buckets by the low bits of a hash, so these must vary
+ * even when only the high bits of X do. */
+static inline unsigned
+hash_mix(unsigned x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Returns a hash of integer I. */
+static inline unsigned
+hash_int(int i)
+{
+    return hash_mix(i);
+}
+
+/* Returns a hash of pointer P. */
+static inline unsigned
+hash_ptr(const void *p)
+{
+    return hash_mix((uintptr_t)p);
+}
 
 #endif /* lib/kernel/hash.h */
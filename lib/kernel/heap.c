@@ -0,0 +1,228 @@
+#include "../debug.h"
+#include "heap.h"
+
+/* Pairing heap.
+ *
+ * The root is the least element.  Each element's children form a
+ * doubly linked list through `next' and `prev', except that the
+ * first child's `prev' points to the parent, so that any element
+ * can be cut out of the tree in constant time:
+ *
+ *              +---+
+ *              | 1 |
+ *              +---+
+ *             child ^
+ *               v   | prev
+ *              +---+  next  +---+  next  +---+
+ *              | 3 |------->| 2 |------->| 5 |
+ *              |   |<-------|   |<-------|   |
+ *              +---+  prev  +---+  prev  +---+
+ *
+ * Two trees are merged by making the root with the greater key
+ * the first child of the other.  Deleting the root leaves a list
+ * of subtrees, which are merged in two passes: first in pairs
+ * from left to right, then the pairs from right to left into a
+ * single tree.  That second step is what gives the heap its
+ * O(log n) amortized bound. */
+
+static bool before(const struct heap *, const struct heap_elem *,
+                   const struct heap_elem *);
+static struct heap_elem *merge(const struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs(const struct heap *,
+                                     struct heap_elem *first);
+static void cut(struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given auxiliary
+ * data AUX. */
+void
+heap_init(struct heap *h, heap_less_func *less, void *aux)
+{
+    ASSERT(h != NULL);
+    ASSERT(less != NULL);
+
+    h->root = NULL;
+    h->size = 0;
+    h->next_seq = 0;
+    h->less = less;
+    h->aux = aux;
+}
+
+/* Inserts ELEM into H. */
+void
+heap_insert(struct heap *h, struct heap_elem *elem)
+{
+    ASSERT(h != NULL);
+    ASSERT(elem != NULL);
+
+    elem->child = elem->next = elem->prev = NULL;
+    elem->seq = h->next_seq++;
+    h->root = merge(h, h->root, elem);
+    h->size++;
+}
+
+/* Removes the least element from H and returns it.  Of elements
+ * that compare equal, the earliest inserted is removed first.
+ * Undefined behavior if H is empty. */
+struct heap_elem *
+heap_pop_min(struct heap *h)
+{
+    struct heap_elem *min = h->root;
+
+    ASSERT(min != NULL);
+
+    h->root = merge_pairs(h, min->child);
+    h->size--;
+    return min;
+}
+
+/* Removes ELEM, which must be in H, from H. */
+void
+heap_remove(struct heap *h, struct heap_elem *elem)
+{
+    ASSERT(h->size > 0);
+
+    if (elem == h->root) {
+        heap_pop_min(h);
+    } else {
+        cut(elem);
+        h->root = merge(h, h->root, merge_pairs(h, elem->child));
+        h->size--;
+    }
+}
+
+/* Restores H's order after the key of ELEM, which must be in H,
+ * was decreased.  For a key that may have increased, remove the
+ * element with heap_remove() before changing the key and insert
+ * it again afterward. */
+void
+heap_decrease(struct heap *h, struct heap_elem *elem)
+{
+    ASSERT(h->size > 0);
+
+    if (elem != h->root) {
+        cut(elem);
+        h->root = merge(h, h->root, elem);
+    }
+}
+
+/* Returns the least element in H, without removing it, or a null
+ * pointer if H is empty. */
+struct heap_elem *
+heap_min(const struct heap *h)
+{
+    return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size(const struct heap *h)
+{
+    return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty(const struct heap *h)
+{
+    return h->root == NULL;
+}
+
+/* Returns true if A should come out of H before B: if A is less
+ * than B, or equal to it and inserted earlier. */
+static bool
+before(const struct heap *h, const struct heap_elem *a,
+       const struct heap_elem *b)
+{
+    if (h->less(a, b, h->aux)) {
+        return true;
+    } else if (h->less(b, a, h->aux)) {
+        return false;
+    } else {
+        return (int) (a->seq - b->seq) < 0;
+    }
+}
+
+/* Merges the trees rooted at A and B, either of which may be
+ * null, and returns the root of the result.  A and B must have
+ * no siblings. */
+static struct heap_elem *
+merge(const struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+    if (a == NULL) {
+        return b;
+    } else if (b == NULL) {
+        return a;
+    }
+
+    if (before(h, b, a)) {
+        struct heap_elem *t = a;
+        a = b;
+        b = t;
+    }
+
+    /* Make B the first child of A. */
+    b->next = a->child;
+    b->prev = a;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    a->child = b;
+    a->next = a->prev = NULL;
+    return a;
+}
+
+/* Merges the list of sibling trees starting at FIRST, which may
+ * be null, into one tree and returns its root. */
+static struct heap_elem *
+merge_pairs(const struct heap *h, struct heap_elem *first)
+{
+    struct heap_elem *pairs = NULL;
+    struct heap_elem *root;
+
+    /* Left to right, merge the trees in pairs, pushing each pair
+     * onto a stack threaded through `next'. */
+    while (first != NULL) {
+        struct heap_elem *a = first;
+        struct heap_elem *b = a->next;
+        struct heap_elem *pair;
+
+        first = b != NULL ? b->next : NULL;
+        a->next = a->prev = NULL;
+        if (b != NULL) {
+            b->next = b->prev = NULL;
+        }
+        pair = merge(h, a, b);
+        pair->next = pairs;
+        pairs = pair;
+    }
+
+    /* Right to left, merge the pairs into one tree. */
+    root = NULL;
+    while (pairs != NULL) {
+        struct heap_elem *pair = pairs;
+
+        pairs = pair->next;
+        pair->next = NULL;
+        root = merge(h, root, pair);
+    }
+    return root;
+}
+
+/* Detaches the subtree rooted at ELEM, which must not be the
+ * root, from its parent and siblings. */
+static void
+cut(struct heap_elem *elem)
+{
+    ASSERT(elem->prev != NULL);
+
+    if (elem->prev->child == elem) {
+        elem->prev->child = elem->next;
+    } else {
+        elem->prev->next = elem->next;
+    }
+    if (elem->next != NULL) {
+        elem->next->prev = elem->prev;
+    }
+    elem->next = elem->prev = NULL;
+}
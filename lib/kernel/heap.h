@@ -0,0 +1,92 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+ *
+ * This is a pairing heap: a tree in which no element is less than
+ * its parent, with each element's children kept in a linked
+ * list.  Finding the least element takes constant time, and
+ * insertion, deletion of any element and decreasing an element's
+ * key take O(log n) amortized time, instead of the linear walks
+ * that list_insert_ordered() and list_min() need.
+ *
+ * Like a struct list, a heap needs no dynamically allocated
+ * memory.  Each structure that may be in a heap embeds a struct
+ * heap_elem, and heap_entry() converts a heap_elem back to the
+ * structure that contains it, the same way list_entry() does:
+ *
+ *    struct foo
+ *      {
+ *        struct heap_elem elem;
+ *        int key;
+ *        ...other members...
+ *      };
+ *
+ *    static bool
+ *    foo_less (const struct heap_elem *a, const struct heap_elem *b,
+ *              void *aux UNUSED)
+ *    {
+ *      return heap_entry (a, struct foo, elem)->key
+ *             < heap_entry (b, struct foo, elem)->key;
+ *    }
+ *
+ *    struct heap foo_heap;
+ *
+ *    heap_init (&foo_heap, foo_less, NULL);
+ *
+ * Elements that compare equal come out of heap_pop_min() in the
+ * order in which they were inserted, so a heap can replace a list
+ * kept in order with list_insert_ordered() without changing the
+ * order of ties. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+    struct heap_elem *child; /* First child. */
+    struct heap_elem *next;  /* Next sibling. */
+    struct heap_elem *prev;  /* Previous sibling, or parent if first
+                                child, or null if root. */
+    unsigned seq;            /* Insertion order, to break ties. */
+};
+
+/* Compares the keys of heap elements A and B, given auxiliary
+ * data AUX.  Returns true if A is less than B, or false if A is
+ * greater than or equal to B. */
+typedef bool heap_less_func(const struct heap_elem *a,
+                            const struct heap_elem *b, void *aux);
+
+/* Heap. */
+struct heap {
+    struct heap_elem *root;  /* Least element, or null if empty. */
+    size_t size;             /* Number of elements. */
+    unsigned next_seq;       /* Next insertion's sequence number. */
+    heap_less_func *less;    /* Comparison function. */
+    void *aux;               /* Auxiliary data for LESS. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+ * the structure that HEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element.  See the big comment at the top of the
+ * file for an example. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER) \
+    ((STRUCT *)((uint8_t *)&(HEAP_ELEM)->child \
+                - offsetof(STRUCT, MEMBER.child)))
+
+void heap_init(struct heap *, heap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void heap_insert(struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min(struct heap *);
+void heap_remove(struct heap *, struct heap_elem *);
+void heap_decrease(struct heap *, struct heap_elem *);
+
+/* Properties. */
+struct heap_elem *heap_min(const struct heap *);
+size_t heap_size(const struct heap *);
+bool heap_empty(const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -174,4 +174,27 @@ void list_unique(struct list *, struct list *duplicates,
 struct list_elem *list_max(struct list *, list_less_func *, void *aux);
 struct list_elem *list_min(struct list *, list_less_func *, void *aux);
 
+/* Defines NAME_insert_ordered(), a version of
+ * list_insert_ordered() for lists of STRUCTs whose list_elem is
+ * MEMBER, which calls LESS directly, so that it may be inlined,
+ * instead of through a pointer:
+ *
+ *    bool LESS (const STRUCT *a, const STRUCT *b);
+ *
+ * LESS returns true if A is less than B. */
+#define LIST_DEFINE_ORDERED(NAME, STRUCT, MEMBER, LESS)                  \
+    static inline void                                                  \
+    NAME##_insert_ordered(struct list *list, STRUCT *new)               \
+    {                                                                   \
+        struct list_elem *e;                                            \
+                                                                        \
+        for (e = list_begin(list); e != list_end(list);                 \
+             e = list_next(e)) {                                        \
+            if (LESS(new, list_entry(e, STRUCT, MEMBER))) {             \
+                break;                                                  \
+            }                                                           \
+        }                                                               \
+        list_insert(e, &new->MEMBER);                                   \
+    }
+
 #endif /* lib/kernel/list.h */
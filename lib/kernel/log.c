@@ -0,0 +1,174 @@
+#include <log.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "devices/ring.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Log sink.
+ *
+ * Any thread or interrupt handler may add a message, so adding
+ * is done with interrupts off, which on a single CPU makes the
+ * producers take turns without a lock.  Only the logger thread
+ * and log_flush() remove messages, and they take turns with
+ * DRAIN_LOCK. */
+
+/* Bytes of queued messages, a power of 2. */
+#define LOG_RING_SIZE 16384
+
+static uint8_t log_ring_buf[LOG_RING_SIZE];
+static struct ring log_ring;
+static struct semaphore log_ready;  /* Upped after each message. */
+static struct lock drain_lock;      /* Serializes consumers. */
+static bool started;                /* True after log_start(). */
+
+/* Statistics. */
+static long long msg_cnt;           /* Messages queued. */
+static long long drop_cnt;          /* Messages dropped, ring full. */
+
+static thread_func logger_thread;
+static void drain(void);
+static const char *log_level_name(LoggingLevel);
+static const char *log_level_color(LoggingLevel);
+
+/* Starts the thread that writes queued messages to the console.
+ * Must be called after thread_start(). */
+void
+log_start(void)
+{
+    ring_init(&log_ring, log_ring_buf, sizeof log_ring_buf);
+    sema_init(&log_ready, 0);
+    lock_init(&drain_lock);
+    thread_create("logger", PRI_MIN, logger_thread, NULL);
+    started = true;
+}
+
+/* Writes any queued messages to the console now, for instance
+ * before powering off. */
+void
+log_flush(void)
+{
+    if (started) {
+        drain();
+    }
+}
+
+/* Prints logging statistics. */
+void
+log_print_stats(void)
+{
+    printf("Log: %lld messages, %lld dropped\n", msg_cnt, drop_cnt);
+}
+
+/* Formats a message at LEVEL from FILE, LINE and FUNC, followed
+ * by FORMAT, and queues it for the console.  Use log() rather
+ * than calling this directly. */
+void
+log_write(LoggingLevel level, const char *file, int line, const char *func,
+          const char *format, ...)
+{
+    char buf[LOG_MAX_BEFORE_SIZE + LOG_MAX_LOG_SIZE + 16];
+    enum intr_level old_level;
+    va_list args;
+    size_t len;
+
+    /* Header, padded to a fixed width. */
+    len = snprintf(buf, LOG_MAX_BEFORE_SIZE, "%s%-5s | %s:%d:%s() ",
+                   log_level_color(level), log_level_name(level),
+                   file, line, func);
+    if (len > LOG_MAX_BEFORE_SIZE - 1) {
+        len = LOG_MAX_BEFORE_SIZE - 1;
+    }
+    memset(buf + len, ' ', LOG_MAX_BEFORE_SIZE - len);
+    len = LOG_MAX_BEFORE_SIZE;
+    memcpy(buf + len, " | ", 3);
+    len += 3;
+
+    /* Message, truncated to LOG_MAX_LOG_SIZE - 1 bytes. */
+    va_start(args, format);
+    len += vsnprintf(buf + len, LOG_MAX_LOG_SIZE, format, args);
+    va_end(args);
+    if (len > LOG_MAX_BEFORE_SIZE + 3 + LOG_MAX_LOG_SIZE - 1) {
+        len = LOG_MAX_BEFORE_SIZE + 3 + LOG_MAX_LOG_SIZE - 1;
+    }
+    len += snprintf(buf + len, sizeof buf - len, "%s\n",
+                    log_level_color(L_NONE));
+
+    if (!started) {
+        printf("%s", buf);
+        return;
+    }
+
+    /* Queue the whole message or none of it. */
+    old_level = intr_disable();
+    if (ring_space(&log_ring) >= len) {
+        ring_put(&log_ring, buf, len);
+        msg_cnt++;
+    } else {
+        drop_cnt++;
+    }
+    intr_set_level(old_level);
+    sema_up(&log_ready);
+}
+
+/* Writes queued messages to the console as they arrive. */
+static void
+logger_thread(void *aux UNUSED)
+{
+    for (;;) {
+        sema_down(&log_ready);
+        drain();
+    }
+}
+
+/* Writes all the queued messages to the console. */
+static void
+drain(void)
+{
+    char chunk[128];
+    size_t n;
+
+    lock_acquire(&drain_lock);
+    while ((n = ring_get(&log_ring, chunk, sizeof chunk)) > 0) {
+        putbuf(chunk, n);
+    }
+    lock_release(&drain_lock);
+}
+
+/* Returns the name of LEVEL. */
+static const char *
+log_level_name(LoggingLevel level)
+{
+    switch (level) {
+    case L_TRACE: return "TRACE";
+    case L_DEBUG: return "DEBUG";
+    case L_INFO:  return "INFO";
+    case L_WARN:  return "WARN";
+    case L_ERROR: return "ERROR";
+    case L_FATAL: return "FATAL";
+    case L_NONE:  return "NONE";
+    }
+    /* Should be unreachable */
+    return NULL;
+}
+
+/* Returns the terminal escape sequence that colors LEVEL. */
+static const char *
+log_level_color(LoggingLevel level)
+{
+    switch (level) {
+    case L_TRACE: return "\x1b[00;34m";
+    case L_DEBUG: return "\x1b[00;35m";
+    case L_INFO:  return "\x1b[00;36m";
+    case L_WARN:  return "\x1b[00;33m";
+    case L_ERROR: return "\x1b[00;31m";
+    case L_FATAL: return "\x1b[37;41m";
+    case L_NONE:  return "\x1b[0m";
+    }
+    /* Should be unreachable */
+    return NULL;
+}
@@ -0,0 +1,199 @@
+#include "lz.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../debug.h"
+
+static uint32_t read32(const uint8_t *);
+static unsigned hash(uint32_t);
+static uint8_t *put_length(uint8_t *op, const uint8_t *end, size_t);
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *end,
+                             const uint8_t *lit, size_t lit_cnt,
+                             size_t distance, size_t match_len);
+static bool get_length(const uint8_t **ip, const uint8_t *end, size_t *);
+
+/* Compresses the SRC_SIZE bytes at SRC, at most LZ_MAX_INPUT,
+ * into the DST_SIZE bytes at DST, using TABLE as scratch space.
+ * Returns the size of the compressed data, or 0 if it does not
+ * fit in DST_SIZE bytes. */
+size_t
+lz_compress(const void *src_, size_t src_size, void *dst_, size_t dst_size,
+            lz_table table)
+{
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    uint8_t *op = dst;
+    const uint8_t *end = dst + dst_size;
+    size_t anchor = 0;          /* First byte not yet output. */
+    size_t ip = 0;
+
+    ASSERT(src_size <= LZ_MAX_INPUT);
+
+    /* Positions are stored plus one, so that 0 means none. */
+    memset(table, 0, sizeof(lz_table));
+    while (ip + LZ_MIN_MATCH <= src_size) {
+        uint32_t v = read32(src + ip);
+        unsigned h = hash(v);
+        size_t ref = table[h];
+        size_t len;
+
+        table[h] = ip + 1;
+        if (ref == 0 || read32(src + --ref) != v) {
+            ip++;
+            continue;
+        }
+        len = LZ_MIN_MATCH;
+        while (ip + len < src_size && src[ref + len] == src[ip + len]) {
+            len++;
+        }
+        op = put_sequence(op, end, src + anchor, ip - anchor, ip - ref, len);
+        if (op == NULL) {
+            return 0;
+        }
+        ip += len;
+        anchor = ip;
+    }
+    op = put_sequence(op, end, src + anchor, src_size - anchor, 0, 0);
+    return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Decompresses the SRC_SIZE bytes of compressed data at SRC into
+ * the DST_SIZE bytes at DST.  Returns the size of the
+ * decompressed data, or SIZE_MAX if SRC is not valid compressed
+ * data or does not fit in DST_SIZE bytes. */
+size_t
+lz_decompress(const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+    const uint8_t *ip = src_;
+    const uint8_t *end = ip + src_size;
+    uint8_t *dst = dst_;
+    size_t op = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit_cnt = token >> 4;
+        size_t len = token & 15;
+        size_t distance;
+
+        if (lit_cnt == 15 && !get_length(&ip, end, &lit_cnt)) {
+            return SIZE_MAX;
+        }
+        if (lit_cnt > (size_t) (end - ip) || lit_cnt > dst_size - op) {
+            return SIZE_MAX;
+        }
+        memcpy(dst + op, ip, lit_cnt);
+        ip += lit_cnt;
+        op += lit_cnt;
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return SIZE_MAX;
+        }
+        distance = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (len == 15 && !get_length(&ip, end, &len)) {
+            return SIZE_MAX;
+        }
+        len += LZ_MIN_MATCH;
+        if (distance == 0 || distance > op || len > dst_size - op) {
+            return SIZE_MAX;
+        }
+
+        /* The match may overlap its own output, as for a run. */
+        for (; len > 0; len--, op++) {
+            dst[op] = dst[op - distance];
+        }
+    }
+    return op;
+}
+
+/* Returns the 4 bytes at P, in host order. */
+static uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+/* Hashes the 4 bytes V into a table index. */
+static unsigned
+hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the extra bytes of a length of at least 15, less the 15
+ * in the token, at OP.  Returns the byte after them, or a null
+ * pointer if they would pass END. */
+static uint8_t *
+put_length(uint8_t *op, const uint8_t *end, size_t n)
+{
+    for (;;) {
+        if (op >= end) {
+            return NULL;
+        }
+        if (n < 255) {
+            *op++ = n;
+            return op;
+        }
+        *op++ = 255;
+        n -= 255;
+    }
+}
+
+/* Writes a sequence at OP: LIT_CNT literal bytes from LIT, then,
+ * unless MATCH_LEN is 0, a match of MATCH_LEN bytes DISTANCE
+ * back.  Returns the byte after it, or a null pointer if it
+ * would pass END. */
+static uint8_t *
+put_sequence(uint8_t *op, const uint8_t *end, const uint8_t *lit,
+             size_t lit_cnt, size_t distance, size_t match_len)
+{
+    size_t len = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+    if (op >= end) {
+        return NULL;
+    }
+    *op++ = ((lit_cnt < 15 ? lit_cnt : 15) << 4) | (len < 15 ? len : 15);
+    if (lit_cnt >= 15 && (op = put_length(op, end, lit_cnt - 15)) == NULL) {
+        return NULL;
+    }
+    if (lit_cnt > (size_t) (end - op)) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_cnt);
+    op += lit_cnt;
+    if (match_len == 0) {
+        return op;
+    }
+
+    if (end - op < 2) {
+        return NULL;
+    }
+    *op++ = distance & 0xff;
+    *op++ = distance >> 8;
+    if (len >= 15) {
+        op = put_length(op, end, len - 15);
+    }
+    return op;
+}
+
+/* Adds the extra bytes of a length at *IP to *N and advances *IP
+ * past them.  Returns false if they run past END. */
+static bool
+get_length(const uint8_t **ip, const uint8_t *end, size_t *n)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= end) {
+            return false;
+        }
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return true;
+}
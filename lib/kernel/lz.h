@@ -0,0 +1,42 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression.
+ *
+ * A small, fast member of the LZ family, in the manner of LZ4:
+ * the compressor finds earlier occurrences of the next four bytes
+ * through a hash table of recent positions and never searches
+ * further, so it runs in one pass over its input, and the
+ * decompressor does little more than copy bytes.  It does best on
+ * data with repeated runs, such as zero-filled or sparsely used
+ * memory, and gives up quickly on data that does not compress.
+ *
+ * The compressed data is a series of sequences, each a token
+ * byte, some literal bytes, and a match: a copy of earlier
+ * output.  The token's high nibble is the number of literals and
+ * its low nibble the length of the match less LZ_MIN_MATCH; a
+ * nibble of 15 is followed by bytes to add to it, up to and
+ * including the first that is not 255.  The literals follow,
+ * then the match's distance back, in two bytes, least
+ * significant first, then any extra bytes of its length.  The
+ * last sequence has literals only, and ends the data. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shortest match, and most input bytes. */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_INPUT 65535
+
+/* The compressor's hash table of positions, which the caller
+ * provides, so that the stack need not hold it. */
+#define LZ_HASH_BITS 12
+#define LZ_TABLE_SIZE (1u << LZ_HASH_BITS)
+typedef uint16_t lz_table[LZ_TABLE_SIZE];
+
+size_t lz_compress(const void *src, size_t src_size,
+                   void *dst, size_t dst_size, lz_table);
+size_t lz_decompress(const void *src, size_t src_size,
+                     void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
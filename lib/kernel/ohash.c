@@ -0,0 +1,331 @@
+/* Open-addressing hash table.
+ *
+ * See ohash.h for basic information. */
+
+#include "../debug.h"
+#include "ohash.h"
+#include "threads/malloc.h"
+
+/* Initial number of slots, as a power of 2. */
+#define MIN_BITS 4
+
+/* Number of slots of the old array moved by each insertion or
+ * deletion while the table is growing.  Moving more than one per
+ * operation guarantees that the old array is drained well before
+ * the new one fills up. */
+#define MOVE_SLOTS 4
+
+/* Marks a slot of the old array whose entry has been moved or
+ * deleted.  Unlike an empty slot, it does not end a probe, since
+ * entries further along may have collided with the one that was
+ * there.  The new array never holds tombstones: deletion there
+ * shifts later entries back instead. */
+static char tombstone;
+#define TOMBSTONE ((void *) &tombstone)
+
+static struct ohash_slot *alloc_slots(unsigned bits);
+static size_t home(uintptr_t key, unsigned bits);
+static struct ohash_slot *find_slot(struct ohash_slot *, unsigned bits,
+                                    uintptr_t key);
+static void place(struct ohash *, uintptr_t key, void *value);
+static void unplace(struct ohash *, struct ohash_slot *);
+static bool grow(struct ohash *);
+static void move_some(struct ohash *, size_t slot_cnt);
+static void destroy_slots(struct ohash_slot *, unsigned bits,
+                          ohash_action_func *, void *aux);
+
+/* Initializes hash table H.  Returns true if successful, false
+ * if memory allocation failed. */
+bool
+ohash_init(struct ohash *h)
+{
+    h->cnt = 0;
+    h->bits = MIN_BITS;
+    h->slots = alloc_slots(h->bits);
+    h->old = NULL;
+    h->old_bits = 0;
+    h->old_pos = 0;
+    return h->slots != NULL;
+}
+
+/* Destroys hash table H.
+ *
+ * If DESTRUCTOR is non-null, then it is first called for each
+ * entry in the hash, given auxiliary data AUX.  DESTRUCTOR may
+ * free the value, but must not modify H. */
+void
+ohash_destroy(struct ohash *h, ohash_action_func *destructor, void *aux)
+{
+    if (destructor != NULL) {
+        if (h->old != NULL) {
+            destroy_slots(h->old, h->old_bits, destructor, aux);
+        }
+        destroy_slots(h->slots, h->bits, destructor, aux);
+    }
+    free(h->old);
+    free(h->slots);
+}
+
+/* Returns the value mapped to KEY in H, or a null pointer if
+ * KEY is not in H. */
+void *
+ohash_find(const struct ohash *h, uintptr_t key)
+{
+    struct ohash_slot *s = find_slot(h->slots, h->bits, key);
+
+    if (s == NULL && h->old != NULL) {
+        s = find_slot(h->old, h->old_bits, key);
+    }
+    return s != NULL ? s->value : NULL;
+}
+
+/* Maps KEY to VALUE, which must not be null, in H.  Returns true
+ * if successful, false if KEY is already in H or memory
+ * allocation failed. */
+bool
+ohash_insert(struct ohash *h, uintptr_t key, void *value)
+{
+    ASSERT(value != NULL && value != TOMBSTONE);
+
+    if (ohash_find(h, key) != NULL || !grow(h)) {
+        return false;
+    }
+    move_some(h, MOVE_SLOTS);
+    place(h, key, value);
+    h->cnt++;
+    return true;
+}
+
+/* Removes KEY from H and returns the value it was mapped to, or
+ * returns a null pointer if KEY is not in H. */
+void *
+ohash_delete(struct ohash *h, uintptr_t key)
+{
+    struct ohash_slot *s = find_slot(h->slots, h->bits, key);
+    void *value;
+
+    if (s != NULL) {
+        value = s->value;
+        unplace(h, s);
+    } else if (h->old != NULL
+               && (s = find_slot(h->old, h->old_bits, key)) != NULL) {
+        value = s->value;
+        s->value = TOMBSTONE;
+    } else {
+        return NULL;
+    }
+    h->cnt--;
+    move_some(h, MOVE_SLOTS);
+    return value;
+}
+
+/* Initializes I for iterating hash table H.
+ *
+ * Iteration idiom:
+ *
+ *     struct ohash_iterator i;
+ *     void *value;
+ *
+ *     ohash_first(&i, h);
+ *     while ((value = ohash_next(&i)) != NULL) {
+ *         ...do something with value...
+ *     }
+ *
+ * Modifying hash table H during iteration, using any of the
+ * functions ohash_destroy(), ohash_insert(), or ohash_delete(),
+ * invalidates all iterators. */
+void
+ohash_first(struct ohash_iterator *i, const struct ohash *h)
+{
+    ASSERT(i != NULL);
+    ASSERT(h != NULL);
+
+    i->ohash = h;
+    i->pos = 0;
+}
+
+/* Advances I to the next entry in the hash table and returns its
+ * value.  Returns a null pointer when no entries are left.
+ * Entries are returned in no particular order. */
+void *
+ohash_next(struct ohash_iterator *i)
+{
+    const struct ohash *h = i->ohash;
+    size_t old_cnt = h->old != NULL ? (size_t) 1 << h->old_bits : 0;
+    size_t slot_cnt = (size_t) 1 << h->bits;
+
+    while (i->pos < old_cnt + slot_cnt) {
+        size_t pos = i->pos++;
+        const struct ohash_slot *s = pos < old_cnt
+                                     ? &h->old[pos]
+                                     : &h->slots[pos - old_cnt];
+
+        if (s->value != NULL && s->value != TOMBSTONE) {
+            return s->value;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the number of entries in H. */
+size_t
+ohash_size(const struct ohash *h)
+{
+    return h->cnt;
+}
+
+/* Returns a new array of 2**BITS empty slots, or a null pointer
+ * if memory allocation fails. */
+static struct ohash_slot *
+alloc_slots(unsigned bits)
+{
+    return calloc((size_t) 1 << bits, sizeof(struct ohash_slot));
+}
+
+/* Returns the slot where a probe for KEY starts in an array of
+ * 2**BITS slots.  Multiplying by 2**32 divided by the golden
+ * ratio and keeping the top bits spreads out keys that differ
+ * only in their high bits, such as page addresses, as well as
+ * keys that are consecutive. */
+static size_t
+home(uintptr_t key, unsigned bits)
+{
+    return (uint32_t) ((uint32_t) key * 0x9e3779b9u) >> (32 - bits);
+}
+
+/* Returns the slot holding KEY in the array of 2**BITS SLOTS, or
+ * a null pointer if there is none. */
+static struct ohash_slot *
+find_slot(struct ohash_slot *slots, unsigned bits, uintptr_t key)
+{
+    size_t mask = ((size_t) 1 << bits) - 1;
+    size_t i;
+
+    for (i = home(key, bits); slots[i].value != NULL; i = (i + 1) & mask) {
+        if (slots[i].key == key && slots[i].value != TOMBSTONE) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/* Stores KEY and VALUE in the first empty slot of H's current
+ * array, which must have one, along KEY's probe sequence. */
+static void
+place(struct ohash *h, uintptr_t key, void *value)
+{
+    size_t mask = ((size_t) 1 << h->bits) - 1;
+    size_t i;
+
+    for (i = home(key, h->bits); h->slots[i].value != NULL;
+         i = (i + 1) & mask) {
+        continue;
+    }
+    h->slots[i].key = key;
+    h->slots[i].value = value;
+}
+
+/* Empties slot S of H's current array, shifting back any later
+ * entries in the same run whose probe sequences pass through S,
+ * so that no lookup stops short of them. */
+static void
+unplace(struct ohash *h, struct ohash_slot *s)
+{
+    size_t mask = ((size_t) 1 << h->bits) - 1;
+    size_t i = s - h->slots;
+    size_t j = i;
+
+    for (;;) {
+        size_t k;
+
+        j = (j + 1) & mask;
+        if (h->slots[j].value == NULL) {
+            break;
+        }
+
+        /* Move the entry in slot J back to I unless its home K
+         * lies cyclically in (I, J]. */
+        k = home(h->slots[j].key, h->bits);
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            h->slots[i] = h->slots[j];
+            i = j;
+        }
+    }
+    h->slots[i].value = NULL;
+}
+
+/* Makes sure that H has room for one more entry, doubling its
+ * array if it would otherwise be more than 3/4 full.  The old
+ * array is kept for move_some() to drain.  Returns false only if
+ * H is out of room and a bigger array cannot be allocated. */
+static bool
+grow(struct ohash *h)
+{
+    size_t slot_cnt = (size_t) 1 << h->bits;
+    struct ohash_slot *slots;
+
+    if (h->cnt + 1 <= slot_cnt / 4 * 3) {
+        return true;
+    }
+
+    /* Finish any earlier move, to have only one old array. */
+    move_some(h, SIZE_MAX);
+
+    slots = alloc_slots(h->bits + 1);
+    if (slots == NULL) {
+        /* Carry on more crowded, but always keep one slot empty to
+         * end probes. */
+        return h->cnt + 1 < slot_cnt;
+    }
+    h->old = h->slots;
+    h->old_bits = h->bits;
+    h->old_pos = 0;
+    h->slots = slots;
+    h->bits++;
+    return true;
+}
+
+/* Moves the entries in up to SLOT_CNT slots of H's old array, if
+ * any, into its current array, and frees the old array once it is
+ * drained. */
+static void
+move_some(struct ohash *h, size_t slot_cnt)
+{
+    size_t old_cnt;
+
+    if (h->old == NULL) {
+        return;
+    }
+
+    old_cnt = (size_t) 1 << h->old_bits;
+    while (slot_cnt-- > 0 && h->old_pos < old_cnt) {
+        struct ohash_slot *s = &h->old[h->old_pos++];
+
+        if (s->value != NULL && s->value != TOMBSTONE) {
+            place(h, s->key, s->value);
+            s->value = TOMBSTONE;
+        }
+    }
+
+    if (h->old_pos >= old_cnt) {
+        free(h->old);
+        h->old = NULL;
+        h->old_bits = 0;
+        h->old_pos = 0;
+    }
+}
+
+/* Calls DESTRUCTOR for each entry in the array of 2**BITS SLOTS,
+ * given auxiliary data AUX. */
+static void
+destroy_slots(struct ohash_slot *slots, unsigned bits,
+              ohash_action_func *destructor, void *aux)
+{
+    size_t i;
+
+    for (i = 0; i < (size_t) 1 << bits; i++) {
+        if (slots[i].value != NULL && slots[i].value != TOMBSTONE) {
+            destructor(slots[i].key, slots[i].value, aux);
+        }
+    }
+}
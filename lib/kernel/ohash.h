@@ -0,0 +1,65 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+ *
+ * Maps integer keys, such as addresses or sector numbers, to
+ * non-null pointers.  Unlike struct hash, which chains
+ * `struct hash_elem's in a list per bucket, this table keeps each
+ * key and value in a slot of one array and resolves collisions by
+ * linear probing, so a lookup usually touches a single cache line
+ * and never follows a pointer until it has found its key.
+ *
+ * The table grows by doubling, at most 3/4 full.  Rather than
+ * moving every entry at once, the old array is kept alongside the
+ * new one and drained a few slots at a time by each insertion or
+ * deletion, so that no single operation pays for the whole move.
+ * Lookups check both arrays while this goes on. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A slot. */
+struct ohash_slot {
+    uintptr_t key;              /* Key. */
+    void     *value;            /* Value, or null if the slot is empty. */
+};
+
+/* Open-addressing hash table. */
+struct ohash {
+    size_t             cnt;     /* Number of entries. */
+    struct ohash_slot *slots;   /* Array of 2**BITS slots. */
+    unsigned           bits;
+    struct ohash_slot *old;     /* Array being drained, or null. */
+    unsigned           old_bits;
+    size_t             old_pos; /* Next slot of OLD to move. */
+};
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator {
+    const struct ohash *ohash;  /* The hash table. */
+    size_t              pos;    /* Next slot, counting OLD's first. */
+};
+
+/* Performs some operation on the entry mapping KEY to VALUE,
+ * given auxiliary data AUX. */
+typedef void ohash_action_func (uintptr_t key, void *value, void *aux);
+
+/* Basic life cycle. */
+bool ohash_init(struct ohash *);
+void ohash_destroy(struct ohash *, ohash_action_func *, void *aux);
+
+/* Search, insertion, deletion. */
+void *ohash_find(const struct ohash *, uintptr_t key);
+bool ohash_insert(struct ohash *, uintptr_t key, void *value);
+void *ohash_delete(struct ohash *, uintptr_t key);
+
+/* Iteration. */
+void ohash_first(struct ohash_iterator *, const struct ohash *);
+void *ohash_next(struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size(const struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
@@ -0,0 +1,455 @@
+#include "../debug.h"
+#include "rbtree.h"
+
+/* Red-black tree.
+ *
+ * A binary search tree whose elements are colored so that no red
+ * element has a red child and every path from an element down to
+ * a missing child passes the same number of black elements.  The
+ * longest such path is thus at most twice the shortest, which
+ * keeps the height within 2 lg (n + 1).  Insertion and deletion
+ * restore the coloring with at most three rotations and a walk up
+ * the tree.  See [CLRS] chapter 13, which this follows, except
+ * that missing children are null pointers rather than a shared
+ * black sentinel. */
+
+static void rotate_left(struct rbtree *, struct rb_elem *);
+static void rotate_right(struct rbtree *, struct rb_elem *);
+static void replace_child(struct rbtree *, struct rb_elem *parent,
+                          struct rb_elem *old, struct rb_elem *new);
+static void insert_fixup(struct rbtree *, struct rb_elem *);
+static void remove_fixup(struct rbtree *, struct rb_elem *,
+                         struct rb_elem *parent);
+static bool is_red(const struct rb_elem *);
+static struct rb_elem *leftmost(struct rb_elem *);
+static struct rb_elem *rightmost(struct rb_elem *);
+
+/* Initializes T as an empty tree ordered by LESS, given auxiliary
+ * data AUX. */
+void
+rb_init(struct rbtree *t, rb_less_func *less, void *aux)
+{
+    ASSERT(t != NULL);
+    ASSERT(less != NULL);
+
+    t->root = NULL;
+    t->size = 0;
+    t->less = less;
+    t->aux = aux;
+}
+
+/* Removes all the elements from T.
+ *
+ * If DESTRUCTOR is non-null, then it is called for each element
+ * in T, children before parents, given auxiliary data AUX.
+ * DESTRUCTOR may free the element, but must not touch T. */
+void
+rb_clear(struct rbtree *t, rb_action_func *destructor, void *aux)
+{
+    struct rb_elem *e = t->root;
+
+    /* Walk down to a leaf, destroy it, and resume at its parent,
+     * which then has one child fewer. */
+    while (e != NULL) {
+        if (e->left != NULL) {
+            e = e->left;
+        } else if (e->right != NULL) {
+            e = e->right;
+        } else {
+            struct rb_elem *parent = e->parent;
+
+            if (parent != NULL) {
+                if (parent->left == e) {
+                    parent->left = NULL;
+                } else {
+                    parent->right = NULL;
+                }
+            }
+            if (destructor != NULL) {
+                destructor(e, aux);
+            }
+            e = parent;
+        }
+    }
+    t->root = NULL;
+    t->size = 0;
+}
+
+/* Inserts NEW into T, if no equal element is already present, and
+ * returns a null pointer.  If an equal element is already in T,
+ * returns it without inserting NEW. */
+struct rb_elem *
+rb_insert(struct rbtree *t, struct rb_elem *new)
+{
+    struct rb_elem *parent = NULL;
+    struct rb_elem **link = &t->root;
+
+    while (*link != NULL) {
+        parent = *link;
+        if (t->less(new, parent, t->aux)) {
+            link = &parent->left;
+        } else if (t->less(parent, new, t->aux)) {
+            link = &parent->right;
+        } else {
+            return parent;
+        }
+    }
+
+    new->parent = parent;
+    new->left = new->right = NULL;
+    new->red = true;
+    *link = new;
+    t->size++;
+    insert_fixup(t, new);
+    return NULL;
+}
+
+/* Returns the element in T equal to KEY, or a null pointer if
+ * there is none. */
+struct rb_elem *
+rb_find(const struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = rb_lower_bound(t, key);
+
+    return e != NULL && !t->less(key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element in T that is not less than KEY, or a
+ * null pointer if every element is less. */
+struct rb_elem *
+rb_lower_bound(const struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = t->root;
+    struct rb_elem *bound = NULL;
+
+    while (e != NULL) {
+        if (t->less(e, key, t->aux)) {
+            e = e->right;
+        } else {
+            bound = e;
+            e = e->left;
+        }
+    }
+    return bound;
+}
+
+/* Returns the first element in T that is greater than KEY, or a
+ * null pointer if no element is. */
+struct rb_elem *
+rb_upper_bound(const struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = t->root;
+    struct rb_elem *bound = NULL;
+
+    while (e != NULL) {
+        if (t->less(key, e, t->aux)) {
+            bound = e;
+            e = e->left;
+        } else {
+            e = e->right;
+        }
+    }
+    return bound;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *child, *parent;
+    bool removed_red;
+
+    ASSERT(t->size > 0);
+
+    if (e->left != NULL && e->right != NULL) {
+        /* Put E's successor S, which has no left child, in E's
+         * place and color, and remove S from its old place
+         * instead. */
+        struct rb_elem *s = leftmost(e->right);
+
+        removed_red = s->red;
+        child = s->right;
+        if (s->parent == e) {
+            parent = s;
+        } else {
+            parent = s->parent;
+            parent->left = child;
+            if (child != NULL) {
+                child->parent = parent;
+            }
+            s->right = e->right;
+            s->right->parent = s;
+        }
+        s->left = e->left;
+        s->left->parent = s;
+        s->red = e->red;
+        replace_child(t, e->parent, e, s);
+    } else {
+        removed_red = e->red;
+        child = e->left != NULL ? e->left : e->right;
+        parent = e->parent;
+        if (child != NULL) {
+            child->parent = parent;
+        }
+        replace_child(t, parent, e, child);
+    }
+
+    t->size--;
+    if (!removed_red) {
+        remove_fixup(t, child, parent);
+    }
+}
+
+/* Returns the least element in T, or a null pointer if T is
+ * empty. */
+struct rb_elem *
+rb_first(const struct rbtree *t)
+{
+    return t->root != NULL ? leftmost(t->root) : NULL;
+}
+
+/* Returns the greatest element in T, or a null pointer if T is
+ * empty. */
+struct rb_elem *
+rb_last(const struct rbtree *t)
+{
+    return t->root != NULL ? rightmost(t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if E
+ * is the last. */
+struct rb_elem *
+rb_next(const struct rb_elem *e)
+{
+    if (e->right != NULL) {
+        return leftmost(e->right);
+    }
+    while (e->parent != NULL && e->parent->right == e) {
+        e = e->parent;
+    }
+    return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+ * E is the first. */
+struct rb_elem *
+rb_prev(const struct rb_elem *e)
+{
+    if (e->left != NULL) {
+        return rightmost(e->left);
+    }
+    while (e->parent != NULL && e->parent->left == e) {
+        e = e->parent;
+    }
+    return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size(const struct rbtree *t)
+{
+    return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty(const struct rbtree *t)
+{
+    return t->root == NULL;
+}
+
+/* Rotates E's right child into E's place, making E its left
+ * child. */
+static void
+rotate_left(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *r = e->right;
+
+    e->right = r->left;
+    if (r->left != NULL) {
+        r->left->parent = e;
+    }
+    replace_child(t, e->parent, e, r);
+    r->parent = e->parent;
+    r->left = e;
+    e->parent = r;
+}
+
+/* Rotates E's left child into E's place, making E its right
+ * child. */
+static void
+rotate_right(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *l = e->left;
+
+    e->left = l->right;
+    if (l->right != NULL) {
+        l->right->parent = e;
+    }
+    replace_child(t, e->parent, e, l);
+    l->parent = e->parent;
+    l->right = e;
+    e->parent = l;
+}
+
+/* Makes NEW, which may be null, the child of PARENT in place of
+ * OLD, or the root of T if PARENT is null.  Does not set NEW's
+ * parent. */
+static void
+replace_child(struct rbtree *t, struct rb_elem *parent,
+              struct rb_elem *old, struct rb_elem *new)
+{
+    if (parent == NULL) {
+        t->root = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+    if (new != NULL) {
+        new->parent = parent;
+    }
+}
+
+/* Restores the coloring of T after red element E was added as a
+ * leaf, where it may have a red parent. */
+static void
+insert_fixup(struct rbtree *t, struct rb_elem *e)
+{
+    while (is_red(e->parent)) {
+        struct rb_elem *parent = e->parent;
+        struct rb_elem *grandparent = parent->parent;
+        struct rb_elem *uncle;
+
+        /* The root is black, so a red parent is not the root. */
+        if (parent == grandparent->left) {
+            uncle = grandparent->right;
+            if (is_red(uncle)) {
+                parent->red = uncle->red = false;
+                grandparent->red = true;
+                e = grandparent;
+                continue;
+            }
+            if (e == parent->right) {
+                rotate_left(t, parent);
+                e = parent;
+                parent = e->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_right(t, grandparent);
+        } else {
+            uncle = grandparent->left;
+            if (is_red(uncle)) {
+                parent->red = uncle->red = false;
+                grandparent->red = true;
+                e = grandparent;
+                continue;
+            }
+            if (e == parent->left) {
+                rotate_right(t, parent);
+                e = parent;
+                parent = e->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_left(t, grandparent);
+        }
+    }
+    t->root->red = false;
+}
+
+/* Restores the coloring of T after a black element was removed
+ * from below PARENT, leaving E, which may be null, in its place,
+ * one black short on every path through it. */
+static void
+remove_fixup(struct rbtree *t, struct rb_elem *e, struct rb_elem *parent)
+{
+    while (e != t->root && !is_red(e)) {
+        struct rb_elem *sibling;
+
+        /* Paths through E's sibling have at least one black
+         * element more than those through E, so it exists. */
+        if (e == parent->left) {
+            sibling = parent->right;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_left(t, parent);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                e = parent;
+                parent = e->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rotate_right(t, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rotate_left(t, parent);
+        } else {
+            sibling = parent->left;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_right(t, parent);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                e = parent;
+                parent = e->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rotate_left(t, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rotate_right(t, parent);
+        }
+        e = t->root;
+    }
+    if (e != NULL) {
+        e->red = false;
+    }
+}
+
+/* Returns true if E is a red element, false if it is black or
+ * null. */
+static bool
+is_red(const struct rb_elem *e)
+{
+    return e != NULL && e->red;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static struct rb_elem *
+leftmost(struct rb_elem *e)
+{
+    while (e->left != NULL) {
+        e = e->left;
+    }
+    return e;
+}
+
+/* Returns the greatest element of the subtree rooted at E. */
+static struct rb_elem *
+rightmost(struct rb_elem *e)
+{
+    while (e->right != NULL) {
+        e = e->right;
+    }
+    return e;
+}
@@ -0,0 +1,115 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree, for indexes that must be
+ * searched in order: finding the first element at or after a key,
+ * or walking a range of keys.  Lookup, insertion and deletion
+ * take O(log n) time, and stepping to the next or previous
+ * element takes O(1) amortized time.
+ *
+ * Like struct list and struct hash, a tree needs no dynamically
+ * allocated memory.  Each structure that may be in a tree embeds
+ * a struct rb_elem, and rb_entry() converts an rb_elem back to
+ * the structure that contains it:
+ *
+ *    struct extent
+ *      {
+ *        struct rb_elem elem;
+ *        block_sector_t start;
+ *        ...other members...
+ *      };
+ *
+ *    static bool
+ *    extent_less (const struct rb_elem *a, const struct rb_elem *b,
+ *                 void *aux UNUSED)
+ *    {
+ *      return rb_entry (a, struct extent, elem)->start
+ *             < rb_entry (b, struct extent, elem)->start;
+ *    }
+ *
+ * As with hash_find(), searching takes an element whose key
+ * fields are set to the key sought; nothing else in it is used:
+ *
+ *    struct extent key;
+ *    struct rb_elem *e;
+ *
+ *    key.start = sector;
+ *    e = rb_upper_bound (&extents, &key.elem);
+ *    e = e != NULL ? rb_prev (e) : rb_last (&extents);
+ *    ...E is the last extent starting at or before SECTOR...
+ *
+ * In-order iteration:
+ *
+ *    for (e = rb_first (&extents); e != NULL; e = rb_next (e))
+ *      {
+ *        struct extent *x = rb_entry (e, struct extent, elem);
+ *        ...do something with x...
+ *      }
+ *
+ * Keys are unique: rb_insert() refuses an element equal to one
+ * already in the tree.  To keep equal keys, break ties in the
+ * comparison function, for instance by address. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem {
+    struct rb_elem *parent;  /* Parent, or null if root. */
+    struct rb_elem *left;    /* Less elements. */
+    struct rb_elem *right;   /* Greater elements. */
+    bool red;                /* Red or black? */
+};
+
+/* Compares the keys of tree elements A and B, given auxiliary
+ * data AUX.  Returns true if A is less than B, or false if A is
+ * greater than or equal to B. */
+typedef bool rb_less_func(const struct rb_elem *a,
+                          const struct rb_elem *b, void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+ * data AUX. */
+typedef void rb_action_func(struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+    struct rb_elem *root;    /* Root, or null if empty. */
+    size_t size;             /* Number of elements. */
+    rb_less_func *less;      /* Comparison function. */
+    void *aux;               /* Auxiliary data for LESS. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+ * structure that RB_ELEM is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree element.  See the big comment at the top of the file for
+ * an example. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER) \
+    ((STRUCT *)((uint8_t *)&(RB_ELEM)->parent \
+                - offsetof(STRUCT, MEMBER.parent)))
+
+/* Basic life cycle. */
+void rb_init(struct rbtree *, rb_less_func *, void *aux);
+void rb_clear(struct rbtree *, rb_action_func *, void *aux);
+
+/* Search, insertion, deletion. */
+struct rb_elem *rb_insert(struct rbtree *, struct rb_elem *);
+struct rb_elem *rb_find(const struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_lower_bound(const struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_upper_bound(const struct rbtree *, const struct rb_elem *);
+void rb_remove(struct rbtree *, struct rb_elem *);
+
+/* In-order traversal. */
+struct rb_elem *rb_first(const struct rbtree *);
+struct rb_elem *rb_last(const struct rbtree *);
+struct rb_elem *rb_next(const struct rb_elem *);
+struct rb_elem *rb_prev(const struct rb_elem *);
+
+/* Information. */
+size_t rb_size(const struct rbtree *);
+bool rb_empty(const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,62 @@
+#ifndef __LIB_KSTAT_H
+#define __LIB_KSTAT_H
+
+/* System-wide statistics, as reported by the kstat() system call
+ * while the system runs.  Counters run from boot, so a monitor
+ * samples twice and divides the difference by the time between.
+ *
+ * Fields are only ever added at the end, each addition bumping
+ * KSTAT_VERSION.  The kernel copies no more of the structure than
+ * the caller's buffer holds and stores the number of bytes it
+ * filled in SIZE, so that a program built against an older layout
+ * keeps working with a newer kernel and the other way around.
+ * Counters of a subsystem that the kernel was built without read
+ * as zero. */
+#define KSTAT_VERSION 1
+
+struct kstat {
+    unsigned version;                        /* Kernel's KSTAT_VERSION. */
+    unsigned size;                           /* Bytes filled in. */
+    unsigned long long uptime_ns;            /* Time since boot. */
+
+    /* Scheduling. */
+    unsigned long long ticks;                /* Timer ticks. */
+    unsigned long long idle_ticks;           /* ...spent idle. */
+    unsigned long long kernel_ticks;         /* ...in kernel threads. */
+    unsigned long long user_ticks;           /* ...in user programs. */
+    unsigned long long voluntary_switches;   /* By blocking or yielding. */
+    unsigned long long involuntary_switches; /* By preemption. */
+    unsigned ready_threads;                  /* Ready to run now. */
+
+    /* Locks. */
+    unsigned long long lock_acquires;        /* Locks acquired. */
+    unsigned long long lock_contentions;     /* ...after waiting. */
+
+    /* Devices and exceptions. */
+    unsigned long long console_chars;        /* Characters output. */
+    unsigned long long keys;                 /* Keys pressed. */
+    unsigned long long page_faults;          /* Page faults taken. */
+
+    /* File system device. */
+    unsigned long long disk_read_sectors;    /* Sectors read. */
+    unsigned long long disk_write_sectors;   /* Sectors written. */
+    unsigned long long disk_read_reqs;       /* Read requests. */
+    unsigned long long disk_write_reqs;      /* Write requests. */
+
+    /* Buffer cache. */
+    unsigned long long cache_hits;           /* Sectors found cached. */
+    unsigned long long cache_misses;         /* Sectors read in. */
+    unsigned long long cache_writebacks;     /* Dirty sectors written. */
+    unsigned long long cache_readaheads;     /* Sectors read ahead. */
+    unsigned cache_dirty;                    /* Dirty entries now. */
+
+    /* Memory. */
+    unsigned free_user_pages;                /* User pages available. */
+    unsigned long long vm_faults;            /* User page faults resolved. */
+    unsigned long long frame_allocs;         /* Frames handed out. */
+    unsigned long long evictions;            /* Frames evicted. */
+    unsigned long long swap_outs;            /* Pages written to swap. */
+    unsigned long long swap_ins;             /* Pages read from swap. */
+};
+
+#endif /* lib/kstat.h */
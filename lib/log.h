@@ -1,23 +1,25 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
+#include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
 
-#define LOGGING_ENABLE 0
-
-#ifndef LOGGING_LEVEL
-#define LOGGING_LEVEL 6
-#endif
-
-#define LOG_MAX_BEFORE_SIZE 67 // 50 + 17 to account for colors
-#define LOG_MAX_LOG_SIZE    256
-
-#define CONVERT_TO_STRING(arg) #arg
-#define AS_STRING(arg)         CONVERT_TO_STRING(arg)
-
-static char log_buf[LOG_MAX_LOG_SIZE];
-static char log_before_buf[LOG_MAX_BEFORE_SIZE];
+/* Kernel tracing.
+ *
+ * log(LEVEL, FORMAT, ...) records a message if LEVEL is at most
+ * LOGGING_LEVEL, which a file may define before including this
+ * header, normally as the level of its subsystem below.  Both are
+ * constants, so a message above the level compiles to nothing,
+ * format string and arguments included, while still being
+ * type-checked.
+ *
+ * Messages are formatted on the caller's stack and queued in a
+ * ring buffer that a low-priority thread drains to the console,
+ * so logging takes no lock and never waits for the serial port.
+ * It is safe in interrupt context.  If the ring is full, the
+ * message is dropped and counted.  Before log_start(), messages
+ * are printed directly. */
 
 typedef enum {
     L_NONE  = 0,
@@ -29,60 +31,45 @@ typedef enum {
     L_TRACE = 6,
 } LoggingLevel;
 
-static inline const char *
-log_level_name(LoggingLevel level)
-{
-    switch (level) {
-    case L_TRACE: return "TRACE";
-    case L_DEBUG: return "DEBUG";
-    case L_INFO:  return "INFO";
-    case L_WARN:  return "WARN";
-    case L_ERROR: return "ERROR";
-    case L_FATAL: return "FATAL";
-    case L_NONE:  return "NONE";
-    }
-    /* Should be unreachable */
-    return NULL;
-}
+/* Level of each subsystem.  All are off unless overridden, for
+ * instance by adding -DLOG_LEVEL_USERPROG=L_TRACE to DEFINES in a
+ * project's Make.vars. */
+#ifndef LOG_LEVEL_THREADS
+#define LOG_LEVEL_THREADS L_NONE
+#endif
+#ifndef LOG_LEVEL_DEVICES
+#define LOG_LEVEL_DEVICES L_NONE
+#endif
+#ifndef LOG_LEVEL_USERPROG
+#define LOG_LEVEL_USERPROG L_NONE
+#endif
+#ifndef LOG_LEVEL_FILESYS
+#define LOG_LEVEL_FILESYS L_NONE
+#endif
+#ifndef LOG_LEVEL_VM
+#define LOG_LEVEL_VM L_NONE
+#endif
 
-static inline const char *
-log_level_color(LoggingLevel level)
-{
-    switch (level) {
-    case L_TRACE: return "\x1b[00;34m";
-    case L_DEBUG: return "\x1b[00;35m";
-    case L_INFO:  return "\x1b[00;36m";
-    case L_WARN:  return "\x1b[00;33m";
-    case L_ERROR: return "\x1b[00;31m";
-    case L_FATAL: return "\x1b[37;41m";
-    case L_NONE:  return "\x1b[0m";
-    }
-    /* Should be unreachable */
-    return NULL;
-}
+/* Level of the including file. */
+#ifndef LOGGING_LEVEL
+#define LOGGING_LEVEL L_NONE
+#endif
 
-static inline void
-log_printf(void)
-{
-    printf("%-" AS_STRING(LOG_MAX_BEFORE_SIZE) "s | %s%s\n",
-           (char *)&log_before_buf, (char *)&log_buf, log_level_color(L_NONE));
-}
+#define LOG_MAX_BEFORE_SIZE 67 // 50 + 17 to account for colors
+#define LOG_MAX_LOG_SIZE    256
 
-#if LOGGING_ENABLE == 0 || LOGGING_LEVEL == 0
-#define log(LEVEL, fmt ...)
-#else
-#define log(LEVEL, fmt ...)                                         \
-    do {                                                            \
-        LoggingLevel level = LEVEL;                                 \
-        if (LOGGING_LEVEL >= level) {                               \
-            snprintf((char *)&log_before_buf, LOG_MAX_BEFORE_SIZE,  \
-                     "%s%-5s | %s:%d:%s() ",                        \
-                     log_level_color(level), log_level_name(level), \
-                     __FILE__, __LINE__, __func__);                 \
-            snprintf((char *)&log_buf, LOG_MAX_LOG_SIZE, fmt);      \
-            log_printf();                                           \
-        }                                                           \
+void log_start(void);
+void log_flush(void);
+void log_print_stats(void);
+void log_write(LoggingLevel, const char *file, int line, const char *func,
+               const char *format, ...) PRINTF_FORMAT(5, 6);
+
+#define log(LEVEL, ...)                                              \
+    do {                                                             \
+        if ((LEVEL) <= (LOGGING_LEVEL)) {                            \
+            log_write(LEVEL, __FILE__, __LINE__, __func__,           \
+                      __VA_ARGS__);                                  \
+        }                                                            \
     } while (0)
-#endif
 
 #endif /* end __LOG_H__ */
@@ -2,9 +2,21 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 void random_init(unsigned seed);
 void random_bytes(void *, size_t);
 unsigned long random_ulong(void);
+void random_fill(void *, size_t);
+
+/* State of a fast, non-cryptographic generator.  Each owner, for
+ * instance each thread, may keep its own. */
+struct prng {
+    uint32_t s[4];
+};
+
+void prng_init(struct prng *, unsigned seed);
+uint32_t prng_next(struct prng *);
+void prng_fill(struct prng *, void *, size_t);
 
 #endif /* lib/random.h */
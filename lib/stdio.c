@@ -142,6 +142,10 @@ static const char *parse_conversion(const char *format, struct printf_conversion
 
 static void format_integer(uintmax_t value, bool is_signed, bool negative, const struct integer_base *, const struct printf_conversion *, void (*output)(char, void *), void *aux);
 
+static void format_plain_integer(unsigned value, bool negative, const struct integer_base *, void (*output)(char, void *), void *aux);
+
+static bool is_plain(const struct printf_conversion *);
+
 static void output_dup(char ch, size_t cnt, void (*output)(char, void *), void *aux);
 
 static void format_string(const char *string, int length, struct printf_conversion *, void (*output)(char, void *), void *aux);
@@ -209,6 +213,11 @@ __vprintf(const char *format, va_list args,
                 NOT_REACHED();
             }
 
+            if (is_plain(&c)) {
+                format_plain_integer(value < 0 ? -(unsigned)value : value,
+                                     value < 0, &base_d, output, aux);
+                break;
+            }
             format_integer(value < 0 ? -value : value,
                            true, value < 0, &base_d, &c, output, aux);
         }
@@ -263,6 +272,10 @@ __vprintf(const char *format, va_list args,
             default: NOT_REACHED();
             }
 
+            if (is_plain(&c)) {
+                format_plain_integer(value, false, b, output, aux);
+                break;
+            }
             format_integer(value, false, false, b, &c, output, aux);
         }
         break;
@@ -283,6 +296,14 @@ __vprintf(const char *format, va_list args,
                 s = "(null)";
             }
 
+            /* With no width or precision, just copy it. */
+            if (c.width == 0 && c.precision < 0) {
+                while (*s != '\0') {
+                    output(*s++, aux);
+                }
+                break;
+            }
+
             /* Limit string length according to precision.
              * Note: if c.precision == -1 then strnlen() will get
              * SIZE_MAX for MAXLEN, which is just what we want. */
@@ -534,6 +555,41 @@ format_integer(uintmax_t value, bool is_signed, bool negative,
     }
 }
 
+/* Returns true if C is a conversion of an int with no flags,
+ * field width or precision, like a bare `%d', which
+ * format_plain_integer() can do. */
+static bool
+is_plain(const struct printf_conversion *c)
+{
+    return c->flags == 0 && c->width == 0 && c->precision < 0
+           && c->type == INT;
+}
+
+/* Like format_integer(), but for conversions for which
+ * is_plain() is true.  Dividing an unsigned int instead of a
+ * uintmax_t avoids a call to the 64-bit division helpers for
+ * every digit. */
+static void
+format_plain_integer(unsigned value, bool negative,
+                     const struct integer_base *b,
+                     void (*output)(char, void *), void *aux)
+{
+    char buf[16], *cp = buf;
+    unsigned base = b->base;
+
+    do {
+        *cp++ = b->digits[value % base];
+        value /= base;
+    } while (value > 0);
+
+    if (negative) {
+        output('-', aux);
+    }
+    while (cp > buf) {
+        output(*--cp, aux);
+    }
+}
+
 /* Writes CH to OUTPUT with auxiliary data AUX, CNT times. */
 static void
 output_dup(char ch, size_t cnt, void (*output)(char, void *), void *aux)
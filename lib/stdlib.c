@@ -2,7 +2,9 @@
 #include <debug.h>
 #include <random.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Converts a string representation of a signed decimal integer
  * in S into an `int', which is returned. */
@@ -54,7 +56,7 @@ compare_thunk(const void *a, const void *b, void *aux)
  * using COMPARE.  When COMPARE is passed a pair of elements A
  * and B, respectively, it must return a strcmp()-type result,
  * i.e. less than zero if A < B, zero if A == B, greater than
- * zero if A > B.  Runs in O(n lg n) time and O(1) space in
+ * zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
  * CNT. */
 void
 qsort(void *array, size_t cnt, size_t size,
@@ -63,20 +65,55 @@ qsort(void *array, size_t cnt, size_t size,
     sort(array, cnt, size, compare_thunk, &compare);
 }
 
+/* Sorting.
+ *
+ * sort() is an introsort: a quicksort with median-of-3 pivots
+ * that leaves ranges of up to INSERTION_MAX elements to a final
+ * insertion sort, and switches to heapsort for any range that
+ * takes more than about 2 lg n levels of partitioning, so it runs
+ * in O(n lg n) time even on inputs that defeat the pivot choice.
+ * merge_sort() is stable, at the cost of a scratch buffer.
+ *
+ * Elements whose size and addresses are multiples of 4 are moved
+ * a word at a time rather than a byte at a time. */
+
+/* Largest range left to insertion sort. */
+#define INSERTION_MAX 16
+
+/* A 32-bit word that may alias any object. */
+typedef uint32_t word __attribute__((__may_alias__));
+
+/* Swaps the SIZE-byte elements at A and B. */
+static void
+swap(unsigned char *a, unsigned char *b, size_t size)
+{
+    if ((((uintptr_t) a | (uintptr_t) b | size) & 3) == 0) {
+        word *wa = (word *) a;
+        word *wb = (word *) b;
+        size_t i;
+
+        for (i = 0; i < size / 4; i++) {
+            word t = wa[i];
+            wa[i] = wb[i];
+            wb[i] = t;
+        }
+    } else {
+        size_t i;
+
+        for (i = 0; i < size; i++) {
+            unsigned char t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+    }
+}
+
 /* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
  * with elements of SIZE bytes each. */
 static void
 do_swap(unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
 {
-    unsigned char *a = array + (a_idx - 1) * size;
-    unsigned char *b = array + (b_idx - 1) * size;
-    size_t i;
-
-    for (i = 0; i < size; i++) {
-        unsigned char t = a[i];
-        a[i] = b[i];
-        b[i] = t;
-    }
+    swap(array + (a_idx - 1) * size, array + (b_idx - 1) * size, size);
 }
 
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
@@ -125,32 +162,231 @@ heapify(unsigned char *array, size_t i, size_t cnt, size_t size,
     }
 }
 
+/* Heapsorts ARRAY, which contains CNT elements of SIZE bytes
+ * each, using COMPARE, passing AUX as auxiliary data. */
+static void
+heap_sort(unsigned char *array, size_t cnt, size_t size,
+          int (*compare)(const void *, const void *, void *aux),
+          void *aux)
+{
+    size_t i;
+
+    /* Build a heap. */
+    for (i = cnt / 2; i > 0; i--) {
+        heapify(array, i, cnt, size, compare, aux);
+    }
+
+    /* Sort the heap. */
+    for (i = cnt; i > 1; i--) {
+        do_swap(array, 1, i, size);
+        heapify(array, 1, i - 1, size, compare, aux);
+    }
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+ * by insertion, using COMPARE, passing AUX as auxiliary data.
+ * Stable, and fast for short or nearly sorted arrays. */
+static void
+insertion_sort(unsigned char *array, size_t cnt, size_t size,
+               int (*compare)(const void *, const void *, void *aux),
+               void *aux)
+{
+    size_t i;
+
+    for (i = 1; i < cnt; i++) {
+        unsigned char *p;
+
+        for (p = array + i * size;
+             p > array && compare(p - size, p, aux) > 0; p -= size) {
+            swap(p - size, p, size);
+        }
+    }
+}
+
+/* Partitions ARRAY, which contains CNT elements of SIZE bytes
+ * each, around the median of its first, middle and last
+ * elements, using COMPARE, passing AUX as auxiliary data.
+ * Returns the index the pivot ends up at: no element before it
+ * is greater and no element after it is less.  CNT must be at
+ * least 3. */
+static size_t
+partition(unsigned char *array, size_t cnt, size_t size,
+          int (*compare)(const void *, const void *, void *aux),
+          void *aux)
+{
+    unsigned char *first = array;
+    unsigned char *middle = array + cnt / 2 * size;
+    unsigned char *last = array + (cnt - 1) * size;
+    size_t i, j;
+
+    /* Order the three samples, then put the median at the
+     * front, where it stays while the rest is partitioned. */
+    if (compare(middle, first, aux) < 0) {
+        swap(middle, first, size);
+    }
+    if (compare(last, middle, aux) < 0) {
+        swap(last, middle, size);
+        if (compare(middle, first, aux) < 0) {
+            swap(middle, first, size);
+        }
+    }
+    swap(first, middle, size);
+
+    /* Both scans stop at elements equal to the pivot, so that
+     * runs of equal elements are split evenly. */
+    i = 0;
+    j = cnt;
+    for (;;) {
+        while (compare(array + ++i * size, first, aux) < 0) {
+            if (i == cnt - 1) {
+                break;
+            }
+        }
+        while (compare(first, array + --j * size, aux) < 0) {
+            continue;
+        }
+        if (i >= j) {
+            break;
+        }
+        swap(array + i * size, array + j * size, size);
+    }
+    swap(first, array + j * size, size);
+    return j;
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+ * using COMPARE, passing AUX as auxiliary data, except that
+ * ranges of up to INSERTION_MAX elements are only put in the
+ * right place relative to each other, not sorted internally.
+ * Falls back to heapsort after DEPTH levels of partitioning. */
+static void
+quick_sort(unsigned char *array, size_t cnt, size_t size,
+           int (*compare)(const void *, const void *, void *aux),
+           void *aux, unsigned depth)
+{
+    while (cnt > INSERTION_MAX) {
+        size_t pivot;
+
+        if (depth-- == 0) {
+            heap_sort(array, cnt, size, compare, aux);
+            return;
+        }
+
+        /* Recurse into the smaller side and loop on the larger, to
+         * keep the stack depth logarithmic. */
+        pivot = partition(array, cnt, size, compare, aux);
+        if (pivot < cnt - pivot - 1) {
+            quick_sort(array, pivot, size, compare, aux, depth);
+            array += (pivot + 1) * size;
+            cnt -= pivot + 1;
+        } else {
+            quick_sort(array + (pivot + 1) * size, cnt - pivot - 1, size,
+                       compare, aux, depth);
+            cnt = pivot;
+        }
+    }
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
  * using COMPARE to compare elements, passing AUX as auxiliary
  * data.  When COMPARE is passed a pair of elements A and B,
  * respectively, it must return a strcmp()-type result, i.e. less
  * than zero if A < B, zero if A == B, greater than zero if A >
- * B.  Runs in O(n lg n) time and O(1) space in CNT. */
+ * B.  Runs in O(n lg n) time and O(lg n) space in CNT.  Not
+ * stable: see merge_sort() for that. */
 void
 sort(void *array, size_t cnt, size_t size,
      int (*compare)(const void *, const void *, void *aux),
      void *aux)
 {
-    size_t i;
+    unsigned depth = 0;
+    size_t n;
 
     ASSERT(array != NULL || cnt == 0);
     ASSERT(compare != NULL);
     ASSERT(size > 0);
 
-    /* Build a heap. */
-    for (i = cnt / 2; i > 0; i--) {
-        heapify(array, i, cnt, size, compare, aux);
+    for (n = cnt; n > 1; n /= 2) {
+        depth += 2;
     }
+    quick_sort(array, cnt, size, compare, aux, depth);
 
-    /* Sort the heap. */
-    for (i = cnt; i > 1; i--) {
-        do_swap(array, 1, i, size);
-        heapify(array, 1, i - 1, size, compare, aux);
+    /* Every element is now within INSERTION_MAX places of where
+     * it belongs, so this pass is linear. */
+    insertion_sort(array, cnt, size, compare, aux);
+}
+
+/* Merges the sorted runs of SIZE-byte elements at SRC, the first
+ * of LEFT_CNT elements and the second of RIGHT_CNT elements
+ * right after it, into DST, using COMPARE, passing AUX as
+ * auxiliary data.  Of equal elements, those from the first run
+ * come first. */
+static void
+merge(unsigned char *dst, const unsigned char *src,
+      size_t left_cnt, size_t right_cnt, size_t size,
+      int (*compare)(const void *, const void *, void *aux),
+      void *aux)
+{
+    const unsigned char *left = src;
+    const unsigned char *left_end = src + left_cnt * size;
+    const unsigned char *right = left_end;
+    const unsigned char *right_end = right + right_cnt * size;
+
+    while (left < left_end && right < right_end) {
+        if (compare(right, left, aux) < 0) {
+            memcpy(dst, right, size);
+            right += size;
+        } else {
+            memcpy(dst, left, size);
+            left += size;
+        }
+        dst += size;
+    }
+    memcpy(dst, left, left_end - left);
+    memcpy(dst + (left_end - left), right, right_end - right);
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+ * like sort(), except that elements that compare equal keep
+ * their relative order.  SCRATCH must point to CNT * SIZE bytes
+ * that it may use for temporary storage.  Runs in O(n lg n) time
+ * in CNT. */
+void
+merge_sort(void *array_, size_t cnt, size_t size, void *scratch,
+           int (*compare)(const void *, const void *, void *aux),
+           void *aux)
+{
+    unsigned char *array = array_;
+    unsigned char *src = array;
+    unsigned char *dst = scratch;
+    size_t width, i;
+
+    ASSERT(array != NULL || cnt == 0);
+    ASSERT(scratch != NULL || cnt == 0);
+    ASSERT(compare != NULL);
+    ASSERT(size > 0);
+
+    /* Sort short runs in place, then merge runs of doubling
+     * width back and forth between ARRAY and SCRATCH. */
+    for (i = 0; i < cnt; i += INSERTION_MAX) {
+        size_t run = cnt - i < INSERTION_MAX ? cnt - i : INSERTION_MAX;
+        insertion_sort(array + i * size, run, size, compare, aux);
+    }
+    for (width = INSERTION_MAX; width < cnt; width *= 2) {
+        unsigned char *t;
+
+        for (i = 0; i < cnt; i += 2 * width) {
+            size_t left = cnt - i < width ? cnt - i : width;
+            size_t right = cnt - i - left < width ? cnt - i - left : width;
+            merge(dst + i * size, src + i * size, left, right, size,
+                  compare, aux);
+        }
+        t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != array) {
+        memcpy(array, src, cnt * size);
     }
 }
 
@@ -3,6 +3,10 @@
 
 #include <stddef.h>
 
+/* Include lib/user/stdlib.h or lib/kernel/stdlib.h, as
+ * appropriate. */
+#include_next <stdlib.h>
+
 /* Standard functions. */
 int atoi(const char *);
 
@@ -16,6 +20,9 @@ void *bsearch(const void *key, const void *array, size_t cnt,
 void sort(void *array, size_t cnt, size_t size,
           int (*compare) (const void *, const void *, void *aux),
           void *aux);
+void merge_sort(void *array, size_t cnt, size_t size, void *scratch,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux);
 
 void *binary_search(const void *key, const void *array, size_t cnt,
                     size_t size,
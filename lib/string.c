@@ -1,6 +1,26 @@
 #include <debug.h>
+#include <stdint.h>
 #include <string.h>
 
+/* memcpy(), memmove() and memset() move blocks of at least this
+ * many bytes a 32-bit word at a time with the string
+ * instructions, after moving single bytes to align the
+ * destination, and memcmp() compares them a word at a time.
+ * Shorter ones are not worth the setup. */
+#define WORD_MIN 16
+
+/* strlen(), strcmp() and memchr() examine strings a 32-bit word
+ * at a time once they reach a 4-byte boundary.  An aligned word
+ * never straddles a page, so reading all of the word that holds
+ * a string's terminator cannot fault even though it may take in
+ * bytes past the end.  WORD may alias any object. */
+typedef uint32_t word __attribute__((__may_alias__));
+
+/* Nonzero if some byte of word W is zero: subtracting 1 from
+ * each byte sets the top bit of every byte that was zero, and
+ * masking with ~W discards bytes whose top bit was already set. */
+#define HAS_ZERO(W) (((W) - 0x01010101u) & ~(W) & 0x80808080u)
+
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
  * Returns DST. */
 void *
@@ -12,9 +32,20 @@ memcpy(void *dst_, const void *src_, size_t size)
     ASSERT(dst != NULL || size == 0);
     ASSERT(src != NULL || size == 0);
 
-    while (size-- > 0) {
-        *dst++ = *src++;
+    if (size >= WORD_MIN) {
+        size_t head = -(uintptr_t) dst & 3;
+        size_t words;
+
+        size -= head;
+        words = size / 4;
+        size %= 4;
+        asm volatile ("rep movsb"
+                      : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+        asm volatile ("rep movsl"
+                      : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
     }
+    asm volatile ("rep movsb"
+                  : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
 
     return dst_;
 }
@@ -31,18 +62,37 @@ memmove(void *dst_, const void *src_, size_t size)
     ASSERT(src != NULL || size == 0);
 
     if (dst < src) {
-        while (size-- > 0) {
-            *dst++ = *src++;
-        }
-    } else {
-        dst += size;
-        src += size;
-        while (size-- > 0) {
+        /* Copying upward never overwrites bytes not yet read. */
+        return memcpy(dst_, src_, size);
+    }
+
+    /* Copy downward, from the end.  The direction flag is set
+     * only for the word copy and cleared again right after, since
+     * the rest of the code assumes it is clear. */
+    dst += size;
+    src += size;
+    if (size >= WORD_MIN) {
+        size_t head = (uintptr_t) dst & 3;
+        size_t words;
+
+        size -= head;
+        while (head-- > 0) {
             *--dst = *--src;
         }
+        words = size / 4;
+        size %= 4;
+        dst -= 4;
+        src -= 4;
+        asm volatile ("std; rep movsl; cld"
+                      : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+        dst += 4;
+        src += 4;
+    }
+    while (size-- > 0) {
+        *--dst = *--src;
     }
 
-    return dst;
+    return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +108,26 @@ memcmp(const void *a_, const void *b_, size_t size)
     ASSERT(a != NULL || size == 0);
     ASSERT(b != NULL || size == 0);
 
+    /* If both blocks are equally aligned, skip equal words once
+     * they are.  The bytes that differ are then found below. */
+    if (size >= WORD_MIN && ((uintptr_t) a & 3) == ((uintptr_t) b & 3)) {
+        const word *wa, *wb;
+
+        for (; (uintptr_t) a & 3; size--, a++, b++) {
+            if (*a != *b) {
+                return *a > *b ? +1 : -1;
+            }
+        }
+        wa = (const word *) a;
+        wb = (const word *) b;
+        for (; size >= 4 && *wa == *wb; size -= 4) {
+            wa++;
+            wb++;
+        }
+        a = (const unsigned char *) wa;
+        b = (const unsigned char *) wb;
+    }
+
     for (; size-- > 0; a++, b++) {
         if (*a != *b) {
             return *a > *b ? +1 : -1;
@@ -80,6 +150,26 @@ strcmp(const char *a_, const char *b_)
     ASSERT(a != NULL);
     ASSERT(b != NULL);
 
+    /* If both strings are equally aligned, skip equal words that
+     * hold no terminator once they are. */
+    if (((uintptr_t) a & 3) == ((uintptr_t) b & 3)) {
+        const word *wa, *wb;
+
+        for (; (uintptr_t) a & 3; a++, b++) {
+            if (*a == '\0' || *a != *b) {
+                return *a < *b ? -1 : *a > *b;
+            }
+        }
+        wa = (const word *) a;
+        wb = (const word *) b;
+        while (*wa == *wb && !HAS_ZERO(*wa)) {
+            wa++;
+            wb++;
+        }
+        a = (const unsigned char *) wa;
+        b = (const unsigned char *) wb;
+    }
+
     while (*a != '\0' && *a == *b) {
         a++;
         b++;
@@ -99,6 +189,24 @@ memchr(const void *block_, int ch_, size_t size)
 
     ASSERT(block != NULL || size == 0);
 
+    for (; size > 0 && (uintptr_t) block & 3; size--, block++) {
+        if (*block == ch) {
+            return (void *)block;
+        }
+    }
+
+    /* Skip whole words that lack CH, found as a zero byte of the
+     * word XORed with CH in every byte. */
+    if (size >= 4) {
+        uint32_t pattern = ch * 0x01010101u;
+        const word *w = (const word *) block;
+
+        for (; size >= 4 && !HAS_ZERO(*w ^ pattern); size -= 4) {
+            w++;
+        }
+        block = (const unsigned char *) w;
+    }
+
     for (; size-- > 0; block++) {
         if (*block == ch) {
             return (void *)block;
@@ -295,9 +403,21 @@ memset(void *dst_, int value, size_t size)
 
     ASSERT(dst != NULL || size == 0);
 
-    while (size-- > 0) {
-        *dst++ = value;
+    if (size >= WORD_MIN) {
+        size_t head = -(uintptr_t) dst & 3;
+        uint32_t word = (unsigned char) value * 0x01010101u;
+        size_t words;
+
+        size -= head;
+        words = size / 4;
+        size %= 4;
+        asm volatile ("rep stosb"
+                      : "+D" (dst), "+c" (head) : "a" (value) : "memory");
+        asm volatile ("rep stosl"
+                      : "+D" (dst), "+c" (words) : "a" (word) : "memory");
     }
+    asm volatile ("rep stosb"
+                  : "+D" (dst), "+c" (size) : "a" (value) : "memory");
 
     return dst_;
 }
@@ -308,9 +428,19 @@ strlen(const char *string)
 {
     const char *p;
 
+    const word *w;
+
     ASSERT(string != NULL);
 
-    for (p = string; *p != '\0'; p++) {
+    for (p = string; (uintptr_t) p & 3; p++) {
+        if (*p == '\0') {
+            return p - string;
+        }
+    }
+    for (w = (const word *) p; !HAS_ZERO(*w); w++) {
+        continue;
+    }
+    for (p = (const char *) w; *p != '\0'; p++) {
         continue;
     }
     return p - string;
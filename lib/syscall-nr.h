@@ -27,7 +27,80 @@ enum {
     SYS_MKDIR,   /* Create a directory. */
     SYS_READDIR, /* Reads a directory entry. */
     SYS_ISDIR,   /* Tests if a fd represents a directory. */
-    SYS_INUMBER  /* Returns the inode number for a fd. */
+    SYS_INUMBER, /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,    /* Copy this process, copy-on-write. */
+    SYS_READV,   /* Read from a file into several buffers. */
+    SYS_WRITEV,  /* Write to a file from several buffers. */
+    SYS_PREAD,   /* Read from a file at a given offset. */
+    SYS_PWRITE,  /* Write to a file at a given offset. */
+    SYS_BLOCKSTATS, /* Print block device statistics. */
+    SYS_UPTIME,     /* Report the time since boot. */
+    SYS_IOSTAT,     /* Report file system device transfers. */
+    SYS_VMSTAT,     /* Report this process's paging activity. */
+    SYS_SBRK,       /* Move the program break. */
+    SYS_THREAD_CREATE, /* Start a thread in this process. */
+    SYS_THREAD_JOIN,   /* Wait for a thread of this process to exit. */
+    SYS_THREAD_EXIT,   /* Terminate this thread. */
+    SYS_FUTEX,         /* Wait on or wake a user address. */
+    SYS_PIPE,          /* Create a pipe. */
+    SYS_COPY_FILE,     /* Copy between files inside the kernel. */
+    SYS_AIO_SETUP,     /* Register asynchronous I/O rings. */
+    SYS_AIO_ENTER,     /* Submit and complete asynchronous I/O. */
+    SYS_BATCH,         /* Make several system calls at once. */
+    SYS_SHM_CREATE,    /* Create a shared memory segment. */
+    SYS_SHM_ATTACH,    /* Map a shared memory segment. */
+    SYS_SHM_DETACH,    /* Unmap a shared memory segment. */
+    SYS_POLL,          /* Wait for descriptors to become ready. */
+    SYS_MADVISE,       /* Advise how memory will be used. */
+    SYS_RSS_LIMIT,     /* Cap the process's resident pages. */
+    SYS_GETDENTS,      /* Read many directory entries at once. */
+    SYS_SEEK64,        /* Change position in a file, 64-bit. */
+    SYS_TELL64,        /* Report current position in a file, 64-bit. */
+    SYS_FSYNC,         /* Write a file's data and size to disk. */
+    SYS_FDATASYNC,     /* Write a file's data to disk. */
+    SYS_COMPRESS,      /* Store an empty file compressed. */
+    SYS_KSTAT,         /* Report system-wide statistics. */
+    SYS_CLONE_FILE     /* Copy a file by sharing its data. */
+};
+
+/* Operations for SYS_FUTEX. */
+enum {
+    FUTEX_WAIT, /* Sleep if the word still holds a value. */
+    FUTEX_WAKE  /* Wake sleepers on the word. */
+};
+
+/* Opcodes for asynchronous I/O requests. */
+enum {
+    AIO_READ,   /* Read at the file position. */
+    AIO_WRITE,  /* Write at the file position. */
+    AIO_PREAD,  /* Read at a given offset. */
+    AIO_PWRITE, /* Write at a given offset. */
+    AIO_FSYNC   /* Write cached data to disk. */
+};
+
+/* Events for SYS_POLL. */
+enum {
+    POLLIN = 0x01,  /* Readable without blocking, maybe at EOF. */
+    POLLOUT = 0x04, /* Writable without blocking. */
+    POLLERR = 0x08, /* Pipe write end with no reader left. */
+    POLLHUP = 0x10, /* Pipe read end with no writer left. */
+    POLLNVAL = 0x20 /* Not an open descriptor. */
+};
+
+/* Flags for SYS_MMAP. */
+enum {
+    MAP_POPULATE = 0x01 /* Bring in every page before returning. */
+};
+
+/* Advice for SYS_MADVISE. */
+enum {
+    MADV_NORMAL,     /* No advice: the default read-ahead. */
+    MADV_SEQUENTIAL, /* Read well ahead; evict what is behind first. */
+    MADV_RANDOM,     /* No read-ahead. */
+    MADV_WILLNEED,   /* Start reading the pages in now. */
+    MADV_DONTNEED    /* Drop the pages; they refill on next touch. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -3,6 +3,9 @@
 #include <syscall-nr.h>
 #include <syscall.h>
 
+/* Flushes buffered streams; see lib/user/stream.c. */
+int (*__stdio_flush)(int fd);
+
 /* The standard vprintf() function,
  * which is like printf() but uses a va_list. */
 int
@@ -30,6 +33,9 @@ hprintf(int handle, const char *format, ...)
 int
 puts(const char *s)
 {
+    if (__stdio_flush != NULL) {
+        __stdio_flush(STDOUT_FILENO);
+    }
     write(STDOUT_FILENO, s, strlen(s));
     putchar('\n');
 
@@ -42,6 +48,9 @@ putchar(int c)
 {
     char c2 = c;
 
+    if (__stdio_flush != NULL) {
+        __stdio_flush(STDOUT_FILENO);
+    }
     write(STDOUT_FILENO, &c2, 1);
     return c;
 }
@@ -65,6 +74,9 @@ vhprintf(int handle, const char *format, va_list args)
 {
     struct vhprintf_aux aux;
 
+    if (__stdio_flush != NULL) {
+        __stdio_flush(handle);
+    }
     aux.p = aux.buf;
     aux.char_cnt = 0;
     aux.handle = handle;
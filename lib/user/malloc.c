@@ -0,0 +1,399 @@
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A simple implementation of malloc() for user programs, along
+ * the lines of the kernel's in threads/malloc.c.
+ *
+ * The size of each request, in bytes, is rounded up to a power
+ * of 2 and assigned to the "descriptor" that manages blocks of
+ * that size.  The descriptor keeps a list of free blocks.  If
+ * the free list is nonempty, one of its blocks is used to
+ * satisfy the request.  Otherwise a new page, called an "arena",
+ * is divided into blocks, all of which are added to the
+ * descriptor's free list.  When an arena has no blocks in use
+ * any more, its blocks are taken off the free list and its page
+ * is freed.
+ *
+ * Requests too big for any descriptor get pages of their own,
+ * with the number of pages in their arena header.
+ *
+ * Pages come from the heap, which sbrk() grows and shrinks.  The
+ * kernel only gives a heap page a frame when it is first
+ * touched.  Freed pages are kept in a list of runs, sorted by
+ * address and merged with their neighbors, and reused first
+ * fit; a run that reaches the break is given back to the kernel
+ * by moving the break down.
+ *
+ * There is no locking: threads of a process that share the heap
+ * must serialize their calls, e.g. with a mutex. */
+
+#define PAGE_SIZE 4096
+
+/* Free block. */
+struct block {
+    struct block *prev; /* Previous free block. */
+    struct block *next; /* Next free block. */
+};
+
+/* Descriptor. */
+struct desc {
+    size_t block_size;       /* Size of each element in bytes. */
+    size_t blocks_per_arena; /* Number of blocks in an arena. */
+    struct block *free_list; /* First free block. */
+};
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena {
+    unsigned     magic;    /* Always set to ARENA_MAGIC. */
+    struct desc *desc;     /* Owning descriptor, null for big block. */
+    size_t       free_cnt; /* Free blocks; pages in big block. */
+};
+
+/* A run of free pages. */
+struct run {
+    size_t page_cnt;  /* Pages in the run. */
+    struct run *next; /* Next run, at a higher address. */
+};
+
+/* Our set of descriptors, for blocks of 16 to 1,024 bytes. */
+static struct desc descs[7];
+static size_t desc_cnt;
+
+/* Free pages. */
+static struct run *free_runs;
+
+static void init(void);
+static struct arena *block_to_arena(struct block *);
+static struct block *arena_to_block(struct arena *, size_t idx);
+static void push_block(struct desc *, struct block *);
+static void pop_block(struct desc *, struct block *);
+static void *get_pages(size_t page_cnt);
+static void free_pages(void *, size_t page_cnt);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+ * Returns a null pointer if memory is not available. */
+void *
+malloc(size_t size)
+{
+    struct desc *d;
+    struct block *b;
+    struct arena *a;
+
+    /* A null pointer satisfies a request for 0 bytes. */
+    if (size == 0) {
+        return NULL;
+    }
+    if (desc_cnt == 0) {
+        init();
+    }
+
+    /* Find the smallest descriptor that satisfies a SIZE-byte
+     * request. */
+    for (d = descs; d < descs + desc_cnt; d++) {
+        if (d->block_size >= size) {
+            break;
+        }
+    }
+    if (d == descs + desc_cnt) {
+        /* SIZE is too big for any descriptor.
+         * Allocate enough pages to hold SIZE plus an arena. */
+        size_t page_cnt;
+
+        if (size > SIZE_MAX - sizeof *a - PAGE_SIZE) {
+            return NULL;
+        }
+        page_cnt = DIV_ROUND_UP(size + sizeof *a, PAGE_SIZE);
+        a = get_pages(page_cnt);
+        if (a == NULL) {
+            return NULL;
+        }
+        a->magic = ARENA_MAGIC;
+        a->desc = NULL;
+        a->free_cnt = page_cnt;
+        return a + 1;
+    }
+
+    /* If the free list is empty, create a new arena. */
+    if (d->free_list == NULL) {
+        size_t i;
+
+        a = get_pages(1);
+        if (a == NULL) {
+            return NULL;
+        }
+        a->magic = ARENA_MAGIC;
+        a->desc = d;
+        a->free_cnt = d->blocks_per_arena;
+        for (i = 0; i < d->blocks_per_arena; i++) {
+            push_block(d, arena_to_block(a, i));
+        }
+    }
+
+    /* Get a block from the free list and return it. */
+    b = d->free_list;
+    pop_block(d, b);
+    block_to_arena(b)->free_cnt--;
+    return b;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+ * Returns a null pointer if memory is not available. */
+void *
+calloc(size_t a, size_t b)
+{
+    void *p;
+    size_t size;
+
+    /* Calculate block size and make sure it fits in size_t. */
+    size = a * b;
+    if (size < a || size < b) {
+        return NULL;
+    }
+
+    /* Allocate and zero memory.  Reused pages are not zero. */
+    p = malloc(size);
+    if (p != NULL) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+usable_size(void *block)
+{
+    struct arena *a = block_to_arena(block);
+
+    return (a->desc != NULL
+            ? a->desc->block_size
+            : a->free_cnt * PAGE_SIZE - sizeof *a);
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+ * moving it in the process.
+ * If successful, returns the new block; on failure, returns a
+ * null pointer.
+ * A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+ * A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc(void *old_block, size_t new_size)
+{
+    void *new_block;
+    size_t old_size;
+
+    if (new_size == 0) {
+        free(old_block);
+        return NULL;
+    }
+    if (old_block == NULL) {
+        return malloc(new_size);
+    }
+
+    /* A block that is already big enough, and not wastefully so,
+     * stays where it is. */
+    old_size = usable_size(old_block);
+    if (new_size <= old_size && new_size > old_size / 2) {
+        return old_block;
+    }
+
+    new_block = malloc(new_size);
+    if (new_block != NULL) {
+        memcpy(new_block, old_block,
+               old_size < new_size ? old_size : new_size);
+        free(old_block);
+    }
+    return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+ * malloc(), calloc(), or realloc(). */
+void
+free(void *p)
+{
+    struct block *b = p;
+    struct arena *a;
+    struct desc *d;
+    size_t i;
+
+    if (p == NULL) {
+        return;
+    }
+    a = block_to_arena(b);
+    d = a->desc;
+    if (d == NULL) {
+        /* It's a big block.  Free its pages. */
+        free_pages(a, a->free_cnt);
+        return;
+    }
+
+#ifndef NDEBUG
+    /* Clear the block to help detect use-after-free bugs. */
+    memset(b, 0xcc, d->block_size);
+#endif
+
+    /* Add block to free list. */
+    push_block(d, b);
+
+    /* If the arena is now entirely unused, free it. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+        ASSERT(a->free_cnt == d->blocks_per_arena);
+        for (i = 0; i < d->blocks_per_arena; i++) {
+            pop_block(d, arena_to_block(a, i));
+        }
+        free_pages(a, 1);
+    }
+}
+
+/* Initializes the descriptors. */
+static void
+init(void)
+{
+    size_t block_size;
+
+    for (block_size = 16; block_size <= 1024; block_size *= 2) {
+        struct desc *d = &descs[desc_cnt++];
+
+        ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
+        d->block_size = block_size;
+        d->blocks_per_arena = (PAGE_SIZE - sizeof(struct arena)) / block_size;
+        d->free_list = NULL;
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena(struct block *b)
+{
+    struct arena *a = (struct arena *)((uintptr_t)b & ~(PAGE_SIZE - 1));
+
+    /* Check that the arena is valid. */
+    ASSERT(a->magic == ARENA_MAGIC);
+
+    /* Check that the block is properly aligned for the arena. */
+    ASSERT(a->desc == NULL
+           || ((uintptr_t)b - (uintptr_t)(a + 1)) % a->desc->block_size == 0);
+    ASSERT(a->desc != NULL || (struct arena *)b == a + 1);
+
+    return a;
+}
+
+/* Returns the IDX'th block within arena A. */
+static struct block *
+arena_to_block(struct arena *a, size_t idx)
+{
+    ASSERT(a->magic == ARENA_MAGIC);
+    ASSERT(idx < a->desc->blocks_per_arena);
+    return (struct block *)((uint8_t *)(a + 1) + idx * a->desc->block_size);
+}
+
+/* Adds B to the front of D's free list. */
+static void
+push_block(struct desc *d, struct block *b)
+{
+    b->prev = NULL;
+    b->next = d->free_list;
+    if (b->next != NULL) {
+        b->next->prev = b;
+    }
+    d->free_list = b;
+}
+
+/* Removes B from D's free list. */
+static void
+pop_block(struct desc *d, struct block *b)
+{
+    if (b->prev != NULL) {
+        b->prev->next = b->next;
+    } else {
+        d->free_list = b->next;
+    }
+    if (b->next != NULL) {
+        b->next->prev = b->prev;
+    }
+}
+
+/* Returns PAGE_CNT contiguous pages, taken from the first free
+ * run big enough or else added to the heap.  Returns a null
+ * pointer if the heap cannot grow. */
+static void *
+get_pages(size_t page_cnt)
+{
+    struct run **rp;
+    uintptr_t ofs;
+    uint8_t *brk;
+
+    for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next) {
+        struct run *r = *rp;
+
+        if (r->page_cnt == page_cnt) {
+            *rp = r->next;
+            return r;
+        } else if (r->page_cnt > page_cnt) {
+            /* Hand out the end of the run, so that the rest of
+             * it stays where it is in the list. */
+            r->page_cnt -= page_cnt;
+            return (uint8_t *)r + r->page_cnt * PAGE_SIZE;
+        }
+    }
+
+    if (page_cnt > INTPTR_MAX / PAGE_SIZE) {
+        return NULL;
+    }
+
+    /* Keep the break on a page boundary, in case something else
+     * moved it. */
+    ofs = (uintptr_t)sbrk(0) % PAGE_SIZE;
+    if (ofs != 0 && sbrk(PAGE_SIZE - ofs) == (void *)-1) {
+        return NULL;
+    }
+    brk = sbrk(page_cnt * PAGE_SIZE);
+    return brk != (void *)-1 ? brk : NULL;
+}
+
+/* Frees the PAGE_CNT pages starting at P, merging them with the
+ * free runs on either side, and gives the highest run back to
+ * the kernel if it reaches the break. */
+static void
+free_pages(void *p, size_t page_cnt)
+{
+    struct run *r = p;
+    struct run **rp;
+    struct run *prev = NULL;
+
+    for (rp = &free_runs; *rp != NULL && *rp < r; rp = &(*rp)->next) {
+        prev = *rp;
+    }
+    r->page_cnt = page_cnt;
+    r->next = *rp;
+    *rp = r;
+
+    /* Merge with the following run, then the preceding one. */
+    if (r->next != NULL
+        && (uint8_t *)r + r->page_cnt * PAGE_SIZE == (uint8_t *)r->next) {
+        r->page_cnt += r->next->page_cnt;
+        r->next = r->next->next;
+    }
+    if (prev != NULL
+        && (uint8_t *)prev + prev->page_cnt * PAGE_SIZE == (uint8_t *)r) {
+        prev->page_cnt += r->page_cnt;
+        prev->next = r->next;
+        r = prev;
+    }
+
+    /* Give the last run back to the kernel if it reaches the
+     * break. */
+    for (rp = &free_runs; (*rp)->next != NULL; rp = &(*rp)->next)
+        continue;
+    r = *rp;
+    if ((uint8_t *)r + r->page_cnt * PAGE_SIZE == sbrk(0)
+        && sbrk(-(intptr_t)(r->page_cnt * PAGE_SIZE)) != (void *)-1) {
+        *rp = NULL;
+    }
+}
@@ -0,0 +1,72 @@
+#include <mutex.h>
+#include <syscall.h>
+
+/* The mutex of "Futexes Are Tricky" by Ulrich Drepper.  STATE
+ * is 0 when free, 1 when held, and 2 when held and some thread
+ * may be asleep waiting for it.  A thread that finds the mutex
+ * held sets STATE to 2 before sleeping, so the holder knows to
+ * call futex_wake() on release; a woken thread takes the mutex
+ * in state 2, since it cannot tell whether others still wait. */
+
+/* Sets *P to NEW if it equals OLD.  Returns the previous value of
+ * *P, which equals OLD if the exchange took place. */
+static inline int
+cmpxchg(int *p, int old, int new)
+{
+    int prev;
+
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*p) : "r" (new), "0" (old)
+                  : "memory");
+    return prev;
+}
+
+/* Sets *P to NEW and returns the previous value of *P. */
+static inline int
+xchg(int *p, int new)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+    return new;
+}
+
+/* Initializes M as free. */
+void
+mutex_init(struct mutex *m)
+{
+    m->state = 0;
+}
+
+/* Acquires M, sleeping until it is free if need be. */
+void
+mutex_lock(struct mutex *m)
+{
+    int c = cmpxchg(&m->state, 0, 1);
+
+    if (c != 0) {
+        if (c != 2) {
+            c = xchg(&m->state, 2);
+        }
+        while (c != 0) {
+            futex_wait(&m->state, 2);
+            c = xchg(&m->state, 2);
+        }
+    }
+}
+
+/* Acquires M and returns true if it is free, or returns false
+ * without waiting. */
+bool
+mutex_trylock(struct mutex *m)
+{
+    return cmpxchg(&m->state, 0, 1) == 0;
+}
+
+/* Releases M, which the calling thread must hold, waking one
+ * waiter if there may be any. */
+void
+mutex_unlock(struct mutex *m)
+{
+    if (xchg(&m->state, 0) == 2) {
+        futex_wake(&m->state, 1);
+    }
+}
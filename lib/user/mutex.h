@@ -0,0 +1,22 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <stdbool.h>
+
+/* A lock for the threads of one process, built on futex_wait()
+ * and futex_wake().  Taking or releasing a mutex that no other
+ * thread wants is a single atomic instruction, with no system
+ * call; only a thread that must wait, or must wake a waiter,
+ * enters the kernel. */
+struct mutex {
+    int state;  /* 0: free; 1: held; 2: held, maybe with waiters. */
+};
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init(struct mutex *);
+void mutex_lock(struct mutex *);
+bool mutex_trylock(struct mutex *);
+void mutex_unlock(struct mutex *);
+
+#endif /* lib/user/mutex.h */
@@ -4,4 +4,54 @@
 int hprintf(int, const char *, ...) PRINTF_FORMAT(2, 3);
 int vhprintf(int, const char *, va_list) PRINTF_FORMAT(2, 0);
 
+/* Buffered streams, in lib/user/stream.c.  A stream collects
+ * small reads and writes into a buffer and passes them to the
+ * kernel BUFSIZ bytes at a time, or a line at a time for a
+ * line-buffered stream such as stdout.  Streams are flushed by
+ * fflush(), fclose() and exit(), and stdout also before any
+ * printf(), so that the two kinds of output stay in order. */
+typedef struct FILE FILE;
+
+#define EOF (-1)
+
+/* Default buffer size, and most streams open at once besides
+ * stdin and stdout. */
+#define BUFSIZ    1024
+#define FOPEN_MAX 8
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0 /* Fully buffered. */
+#define _IOLBF 1 /* Line buffered. */
+#define _IONBF 2 /* Unbuffered. */
+
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fopen(const char *name, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *);
+int fflush(FILE *);
+int setvbuf(FILE *, char *buf, int mode, size_t size);
+
+size_t fread(void *, size_t size, size_t cnt, FILE *);
+size_t fwrite(const void *, size_t size, size_t cnt, FILE *);
+int fgetc(FILE *);
+char *fgets(char *, int size, FILE *);
+int fputc(int, FILE *);
+int fputs(const char *, FILE *);
+int fprintf(FILE *, const char *, ...) PRINTF_FORMAT(2, 3);
+int vfprintf(FILE *, const char *, va_list) PRINTF_FORMAT(2, 0);
+
+int feof(FILE *);
+int ferror(FILE *);
+int fileno(FILE *);
+
+#define getc(STREAM) fgetc(STREAM)
+#define putc(C, STREAM) fputc(C, STREAM)
+
+/* Internal: flushes the streams that write to file descriptor
+ * FD, or every stream if FD is -1.  Null until a stream has
+ * been written. */
+extern int (*__stdio_flush)(int fd);
+
 #endif /* lib/user/stdio.h */
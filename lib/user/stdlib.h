@@ -0,0 +1,11 @@
+#ifndef __LIB_USER_STDLIB_H
+#define __LIB_USER_STDLIB_H
+
+/* Memory allocation, in lib/user/malloc.c.  Memory comes from
+ * the heap above the program's data, which sbrk() grows. */
+void *malloc(size_t) __attribute__ ((malloc));
+void *calloc(size_t, size_t) __attribute__ ((malloc));
+void *realloc(void *, size_t);
+void free(void *);
+
+#endif /* lib/user/stdlib.h */
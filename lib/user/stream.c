@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Stream flags. */
+#define STREAM_READ  0x1 /* Open for reading. */
+#define STREAM_WRITE 0x2 /* Open for writing. */
+#define STREAM_EOF   0x4 /* End of file was reached. */
+#define STREAM_ERROR 0x8 /* A read or write failed. */
+
+/* A buffered stream.
+ *
+ * The buffer holds either input or output, never both.  Input
+ * not yet consumed is POS through END - 1.  Output not yet
+ * written is BUF through POS - 1, and WRITING is set.  A stream
+ * whose FLAGS are 0 is a free slot. */
+struct FILE {
+    int fd;           /* File descriptor. */
+    int flags;        /* STREAM_* flags. */
+    int mode;         /* _IOFBF, _IOLBF or _IONBF. */
+    bool writing;     /* Buffer holds output? */
+    char *buf;        /* Buffer, or null for OWN_BUF. */
+    size_t size;      /* Size of BUF in bytes. */
+    char *pos;        /* Next byte to consume or fill. */
+    char *end;        /* End of input in BUF. */
+    char own_buf[BUFSIZ]; /* Default buffer. */
+};
+
+/* Console input is unbuffered, because the kernel does not
+ * return from a console read until every byte asked for has
+ * been typed.  Console output is line buffered. */
+static FILE std_streams[] = {
+    {.fd = STDIN_FILENO, .flags = STREAM_READ, .mode = _IONBF},
+    {.fd = STDOUT_FILENO, .flags = STREAM_WRITE, .mode = _IOLBF},
+};
+#define STD_STREAM_CNT (sizeof std_streams / sizeof *std_streams)
+
+FILE *stdin = &std_streams[0];
+FILE *stdout = &std_streams[1];
+
+/* Streams opened by fopen() and fdopen(). */
+static FILE streams[FOPEN_MAX];
+
+static FILE *stream_open(int fd, const char *mode);
+static void prepare(FILE *);
+static bool begin_write(FILE *);
+static bool fill(FILE *);
+static int flush(FILE *);
+static int flush_fd(int fd);
+
+/* Opens file NAME as a stream.  MODE is "r" to read an existing
+ * file, "w" to replace NAME with a new, empty file, or "a" to
+ * write at the end of NAME, creating it if it does not exist.
+ * A "+" in MODE opens the stream for both reading and writing,
+ * and a "b" is ignored.
+ * Returns the new stream, or a null pointer if NAME cannot be
+ * opened or FOPEN_MAX streams are already open. */
+FILE *
+fopen(const char *name, const char *mode)
+{
+    FILE *stream;
+    int fd;
+
+    if (mode[0] == 'w') {
+        remove(name);
+        if (!create(name, 0)) {
+            return NULL;
+        }
+    } else if (mode[0] == 'a') {
+        create(name, 0);
+    } else if (mode[0] != 'r') {
+        return NULL;
+    }
+
+    fd = open(name);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (mode[0] == 'a') {
+        seek(fd, filesize(fd));
+    }
+
+    stream = stream_open(fd, mode);
+    if (stream == NULL) {
+        close(fd);
+    }
+    return stream;
+}
+
+/* Opens a stream on file descriptor FD, which is already open.
+ * MODE is as for fopen(), except that the file is neither
+ * created nor emptied.
+ * Returns the new stream, or a null pointer if FOPEN_MAX streams
+ * are already open. */
+FILE *
+fdopen(int fd, const char *mode)
+{
+    return stream_open(fd, mode);
+}
+
+/* Flushes STREAM and closes it, along with its file descriptor.
+ * stdin and stdout are flushed but stay open.
+ * Returns 0 if successful, EOF if output could not be written. */
+int
+fclose(FILE *stream)
+{
+    int retval = flush(stream);
+
+    if (stream >= streams && stream < streams + FOPEN_MAX) {
+        close(stream->fd);
+        stream->flags = 0;
+    }
+    return retval;
+}
+
+/* Writes out STREAM's buffered output, or that of every stream
+ * if STREAM is a null pointer.
+ * Returns 0 if successful, EOF if output could not be written. */
+int
+fflush(FILE *stream)
+{
+    return stream != NULL ? flush(stream) : flush_fd(-1);
+}
+
+/* Makes STREAM use SIZE bytes at BUF as its buffer, or its own
+ * buffer if BUF is null, in which case SIZE may only shrink it.
+ * MODE is _IOFBF to pass data to the kernel when the buffer
+ * fills up, _IOLBF to also write output at each new-line, or
+ * _IONBF to pass every read and write straight through.
+ * Buffered output is flushed and buffered input discarded.
+ * Returns 0 if successful, EOF on error. */
+int
+setvbuf(FILE *stream, char *buf, int mode, size_t size)
+{
+    if ((mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+        || (buf != NULL && size == 0) || flush(stream) == EOF) {
+        return EOF;
+    }
+
+    stream->mode = mode;
+    stream->writing = false;
+    stream->buf = buf != NULL ? buf : stream->own_buf;
+    stream->size = (buf != NULL || (size > 0 && size < BUFSIZ)
+                    ? size : BUFSIZ);
+    stream->pos = stream->end = stream->buf;
+    return 0;
+}
+
+/* Reads up to CNT objects of SIZE bytes each from STREAM into
+ * BUFFER.  Requests of at least a buffer's worth, and all reads
+ * from an unbuffered stream, bypass the buffer.
+ * Returns the number of whole objects read, which is less than
+ * CNT at end of file or on error; see feof() and ferror(). */
+size_t
+fread(void *buffer, size_t size, size_t cnt, FILE *stream)
+{
+    char *dst = buffer;
+    size_t total = size * cnt;
+    size_t done = 0;
+
+    if (total == 0) {
+        return 0;
+    }
+    if (!(stream->flags & STREAM_READ)) {
+        stream->flags |= STREAM_ERROR;
+        return 0;
+    }
+    prepare(stream);
+    if (stream->writing) {
+        if (flush(stream) == EOF) {
+            return 0;
+        }
+        stream->writing = false;
+    }
+
+    /* Make sure that a prompt appears before the program waits
+     * for an answer. */
+    if (stream->fd == STDIN_FILENO && stream->pos == stream->end) {
+        flush_fd(STDOUT_FILENO);
+    }
+
+    while (done < total) {
+        size_t left = total - done;
+        size_t avail = stream->end - stream->pos;
+
+        if (avail > 0) {
+            size_t chunk = left < avail ? left : avail;
+            memcpy(dst + done, stream->pos, chunk);
+            stream->pos += chunk;
+            done += chunk;
+        } else if (left >= stream->size || stream->mode == _IONBF) {
+            int n = read(stream->fd, dst + done, left);
+            if (n <= 0) {
+                stream->flags |= n == 0 ? STREAM_EOF : STREAM_ERROR;
+                break;
+            }
+            done += n;
+        } else if (!fill(stream)) {
+            break;
+        }
+    }
+    return done / size;
+}
+
+/* Writes CNT objects of SIZE bytes each from BUFFER to STREAM.
+ * Requests of at least a buffer's worth bypass the buffer.
+ * Returns the number of whole objects written, which is less
+ * than CNT on error. */
+size_t
+fwrite(const void *buffer, size_t size, size_t cnt, FILE *stream)
+{
+    const char *src = buffer;
+    size_t total = size * cnt;
+    size_t done = 0;
+
+    if (total == 0 || !begin_write(stream)) {
+        return 0;
+    }
+
+    if (total >= stream->size) {
+        int n;
+
+        if (flush(stream) == EOF) {
+            return 0;
+        }
+        n = write(stream->fd, src, total);
+        if (n != (int) total) {
+            stream->flags |= STREAM_ERROR;
+            return n > 0 ? n / size : 0;
+        }
+        return cnt;
+    }
+
+    while (done < total) {
+        size_t room = stream->buf + stream->size - stream->pos;
+        size_t chunk = total - done < room ? total - done : room;
+
+        memcpy(stream->pos, src + done, chunk);
+        stream->pos += chunk;
+        done += chunk;
+        if (stream->pos == stream->buf + stream->size
+            && flush(stream) == EOF) {
+            return 0;
+        }
+    }
+
+    if (stream->mode == _IONBF
+        || (stream->mode == _IOLBF && memchr(src, '\n', total) != NULL)) {
+        if (flush(stream) == EOF) {
+            return 0;
+        }
+    }
+    return cnt;
+}
+
+/* Reads and returns the next byte from STREAM, or EOF at end of
+ * file or on error. */
+int
+fgetc(FILE *stream)
+{
+    unsigned char c;
+
+    if (stream->buf != NULL && stream->pos < stream->end
+        && !stream->writing) {
+        return (unsigned char) *stream->pos++;
+    }
+    return fread(&c, 1, 1, stream) == 1 ? c : EOF;
+}
+
+/* Reads a line from STREAM into S, which has room for SIZE
+ * bytes, stopping after a new-line, after SIZE - 1 bytes, or at
+ * end of file, and null-terminates it.
+ * Returns S, or a null pointer if nothing could be read. */
+char *
+fgets(char *s, int size, FILE *stream)
+{
+    int len = 0;
+
+    if (size <= 0) {
+        return NULL;
+    }
+    while (len < size - 1) {
+        int c = fgetc(stream);
+        if (c == EOF) {
+            break;
+        }
+        s[len++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    if (len == 0) {
+        return NULL;
+    }
+    s[len] = '\0';
+    return s;
+}
+
+/* Writes C, as an unsigned char, to STREAM.
+ * Returns C, or EOF on error. */
+int
+fputc(int c, FILE *stream)
+{
+    unsigned char byte = c;
+
+    return fwrite(&byte, 1, 1, stream) == 1 ? byte : EOF;
+}
+
+/* Writes string S, without a new-line, to STREAM.
+ * Returns 0 if successful, EOF on error. */
+int
+fputs(const char *s, FILE *stream)
+{
+    size_t len = strlen(s);
+
+    return fwrite(s, 1, len, stream) == len ? 0 : EOF;
+}
+
+/* Like printf(), but writes to STREAM. */
+int
+fprintf(FILE *stream, const char *format, ...)
+{
+    va_list args;
+    int retval;
+
+    va_start(args, format);
+    retval = vfprintf(stream, format, args);
+    va_end(args);
+
+    return retval;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux {
+    FILE *stream; /* Output stream. */
+    int char_cnt; /* Characters written so far. */
+};
+
+static void vfprintf_helper(char, void *);
+
+/* Like vprintf(), but writes to STREAM. */
+int
+vfprintf(FILE *stream, const char *format, va_list args)
+{
+    struct vfprintf_aux aux;
+
+    aux.stream = stream;
+    aux.char_cnt = 0;
+    __vprintf(format, args, vfprintf_helper, &aux);
+    return aux.char_cnt;
+}
+
+/* Writes C to the stream in AUX. */
+static void
+vfprintf_helper(char c, void *aux_)
+{
+    struct vfprintf_aux *aux = aux_;
+
+    if (fputc(c, aux->stream) != EOF) {
+        aux->char_cnt++;
+    }
+}
+
+/* Returns nonzero if a read from STREAM reached end of file. */
+int
+feof(FILE *stream)
+{
+    return (stream->flags & STREAM_EOF) != 0;
+}
+
+/* Returns nonzero if a read or write on STREAM failed. */
+int
+ferror(FILE *stream)
+{
+    return (stream->flags & STREAM_ERROR) != 0;
+}
+
+/* Returns STREAM's file descriptor. */
+int
+fileno(FILE *stream)
+{
+    return stream->fd;
+}
+
+/* Sets up a free stream slot for file descriptor FD, opened for
+ * MODE as described for fopen().
+ * Returns the stream, or a null pointer if there is no free
+ * slot. */
+static FILE *
+stream_open(int fd, const char *mode)
+{
+    int flags = mode[0] == 'r' ? STREAM_READ : STREAM_WRITE;
+    FILE *stream;
+
+    if (strchr(mode, '+') != NULL) {
+        flags = STREAM_READ | STREAM_WRITE;
+    }
+    for (stream = streams; stream < streams + FOPEN_MAX; stream++) {
+        if (stream->flags == 0) {
+            stream->fd = fd;
+            stream->flags = flags;
+            stream->mode = _IOFBF;
+            stream->writing = false;
+            stream->buf = NULL;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+/* Gives STREAM its own buffer if it has none yet. */
+static void
+prepare(FILE *stream)
+{
+    if (stream->buf == NULL) {
+        stream->buf = stream->pos = stream->end = stream->own_buf;
+        stream->size = BUFSIZ;
+    }
+}
+
+/* Readies STREAM for output, discarding any buffered input.
+ * Returns false if STREAM is not open for writing. */
+static bool
+begin_write(FILE *stream)
+{
+    if (!(stream->flags & STREAM_WRITE)) {
+        stream->flags |= STREAM_ERROR;
+        return false;
+    }
+    prepare(stream);
+    if (!stream->writing) {
+        /* Back up over input that was read ahead but not
+         * consumed, so that output lands where the caller
+         * expects. */
+        if (stream->pos < stream->end) {
+            seek(stream->fd, tell(stream->fd) - (stream->end - stream->pos));
+        }
+        stream->pos = stream->end = stream->buf;
+        stream->writing = true;
+    }
+    __stdio_flush = flush_fd;
+    return true;
+}
+
+/* Refills STREAM's empty buffer with input.
+ * Returns false at end of file or on error. */
+static bool
+fill(FILE *stream)
+{
+    int n = read(stream->fd, stream->buf, stream->size);
+
+    if (n <= 0) {
+        stream->flags |= n == 0 ? STREAM_EOF : STREAM_ERROR;
+        return false;
+    }
+    stream->pos = stream->buf;
+    stream->end = stream->buf + n;
+    return true;
+}
+
+/* Writes out STREAM's buffered output, if any.
+ * Returns 0 if successful, EOF on error. */
+static int
+flush(FILE *stream)
+{
+    int len;
+
+    if (stream->buf == NULL || !stream->writing) {
+        return 0;
+    }
+    len = stream->pos - stream->buf;
+    stream->pos = stream->buf;
+    if (len > 0 && write(stream->fd, stream->buf, len) != len) {
+        stream->flags |= STREAM_ERROR;
+        return EOF;
+    }
+    return 0;
+}
+
+/* Flushes every stream that writes to FD, or every stream if FD
+ * is -1.
+ * Returns 0 if successful, EOF if any flush failed. */
+static int
+flush_fd(int fd)
+{
+    int retval = 0;
+    size_t i;
+
+    for (i = 0; i < STD_STREAM_CNT + FOPEN_MAX; i++) {
+        FILE *stream = (i < STD_STREAM_CNT
+                        ? &std_streams[i]
+                        : &streams[i - STD_STREAM_CNT]);
+        if ((stream->flags & STREAM_WRITE) && (fd == -1 || stream->fd == fd)
+            && flush(stream) == EOF) {
+            retval = EOF;
+        }
+    }
+    return retval;
+}
@@ -1,66 +1,123 @@
+#include <stdio.h>
 #include <syscall.h>
 #include "../syscall-nr.h"
 
+/* CPUID feature bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+/* Whether to enter the kernel with SYSENTER.  Set by
+ * __syscall_init(), read by __syscall_trap. */
+bool __syscall_sysenter;
+
+/* Enters the kernel for the system call whose number is on the
+ * stack just above the return address, and returns with the
+ * result in %eax, clobbering %ecx and %edx.  The kernel finds
+ * the number and arguments at the stack pointer either way.
+ * SYSEXIT returns to the address in %edx with the stack pointer
+ * in %ecx, which is why the return address comes off first; the
+ * kernel sets up SYSENTER if and only if the CPU has it. */
+asm (".text\n"
+     "__syscall_trap:\n"
+     "    popl %edx\n"
+     "    cmpb $0, __syscall_sysenter\n"
+     "    je 1f\n"
+     "    movl %esp, %ecx\n"
+     "    sysenter\n"
+     "1:  int $0x30\n"
+     "    jmp *%edx\n");
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
  * return value as an `int'. */
-#define syscall0(NUMBER)                              \
-    ({                                                \
-        int retval;                                   \
-        asm volatile                                  \
-        ("pushl %[number]; int $0x30; addl $4, %%esp" \
-         : "=a" (retval)                              \
-         : [number] "i" (NUMBER)                      \
-         : "memory");                                 \
-        retval;                                       \
+#define syscall0(NUMBER)                                        \
+    ({                                                          \
+        int retval;                                             \
+        asm volatile                                            \
+        ("pushl %[number]; call __syscall_trap; addl $4, %%esp" \
+         : "=a" (retval)                                        \
+         : [number] "i" (NUMBER)                                \
+         : "ecx", "edx", "memory");                             \
+        retval;                                                 \
     })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
  * return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                       \
-    ({                                                               \
-        int retval;                                                  \
-        asm volatile                                                 \
-        ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-         : "=a" (retval)                                             \
-         : [number] "i" (NUMBER),                                    \
-         [arg0] "g" (ARG0)                                           \
-         : "memory");                                                \
-        retval;                                                      \
+#define syscall1(NUMBER, ARG0)                                  \
+    ({                                                          \
+        int retval;                                             \
+        asm volatile                                            \
+        ("pushl %[arg0]; pushl %[number]; "                     \
+         "call __syscall_trap; addl $8, %%esp"                  \
+         : "=a" (retval)                                        \
+         : [number] "i" (NUMBER),                               \
+         [arg0] "g" (ARG0)                                      \
+         : "ecx", "edx", "memory");                             \
+        retval;                                                 \
     })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
  * returns the return value as an `int'. */
-#define syscall2(NUMBER, ARG0, ARG1)                   \
-    ({                                                 \
-        int retval;                                    \
-        asm volatile                                   \
-        ("pushl %[arg1]; pushl %[arg0]; "              \
-         "pushl %[number]; int $0x30; addl $12, %%esp" \
-         : "=a" (retval)                               \
-         : [number] "i" (NUMBER),                      \
-         [arg0] "r" (ARG0),                            \
-         [arg1] "r" (ARG1)                             \
-         : "memory");                                  \
-        retval;                                        \
+#define syscall2(NUMBER, ARG0, ARG1)                             \
+    ({                                                           \
+        int retval;                                              \
+        asm volatile                                             \
+        ("pushl %[arg1]; pushl %[arg0]; "                        \
+         "pushl %[number]; call __syscall_trap; addl $12, %%esp" \
+         : "=a" (retval)                                         \
+         : [number] "i" (NUMBER),                                \
+         [arg0] "r" (ARG0),                                      \
+         [arg1] "r" (ARG1)                                       \
+         : "ecx", "edx", "memory");                              \
+        retval;                                                  \
     })
 
 /* Invokes syscall NUMBER, passing arguments ARG0, ARG1, and
  * ARG2, and returns the return value as an `int'. */
-#define syscall3(NUMBER, ARG0, ARG1, ARG2)               \
-    ({                                                   \
-        int retval;                                      \
-        asm volatile                                     \
-        ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; " \
-         "pushl %[number]; int $0x30; addl $16, %%esp"   \
-         : "=a" (retval)                                 \
-         : [number] "i" (NUMBER),                        \
-         [arg0] "r" (ARG0),                              \
-         [arg1] "r" (ARG1),                              \
-         [arg2] "r" (ARG2)                               \
-         : "memory");                                    \
-        retval;                                          \
+#define syscall3(NUMBER, ARG0, ARG1, ARG2)                       \
+    ({                                                           \
+        int retval;                                              \
+        asm volatile                                             \
+        ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "         \
+         "pushl %[number]; call __syscall_trap; addl $16, %%esp" \
+         : "=a" (retval)                                         \
+         : [number] "i" (NUMBER),                                \
+         [arg0] "r" (ARG0),                                      \
+         [arg1] "r" (ARG1),                                      \
+         [arg2] "r" (ARG2)                                       \
+         : "ecx", "edx", "memory");                              \
+        retval;                                                  \
+    })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+ * and ARG3, and returns the return value as an `int'.  ARG3 is
+ * pushed first, so it may be a stack operand. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                 \
+    ({                                                           \
+        int retval;                                              \
+        asm volatile                                             \
+        ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "         \
+         "pushl %[arg0]; pushl %[number]; call __syscall_trap; " \
+         "addl $20, %%esp"                                       \
+         : "=a" (retval)                                         \
+         : [number] "i" (NUMBER),                                \
+         [arg0] "r" (ARG0),                                      \
+         [arg1] "r" (ARG1),                                      \
+         [arg2] "r" (ARG2),                                      \
+         [arg3] "g" (ARG3)                                       \
+         : "ecx", "edx", "memory");                              \
+        retval;                                                  \
     })
 
+/* Chooses SYSENTER for system calls if the CPU has it, by the
+ * same test as syscall_init() in the kernel. */
+void
+__syscall_init(void)
+{
+    uint32_t features;
+
+    asm ("cpuid" : "=d" (features) : "a" (1) : "ebx", "ecx");
+    __syscall_sysenter = (features & CPUID_SEP) != 0;
+}
+
 void
 halt(void)
 {
@@ -71,6 +128,9 @@ halt(void)
 void
 exit(int status)
 {
+    if (__stdio_flush != NULL) {
+        __stdio_flush(-1);
+    }
     syscall1(SYS_EXIT, status);
     NOT_REACHED();
 }
@@ -135,6 +195,39 @@ tell(int fd)
     return syscall1(SYS_TELL, fd);
 }
 
+void
+seek64(int fd, unsigned long long position)
+{
+    syscall3(SYS_SEEK64, fd, (unsigned) position, (unsigned) (position >> 32));
+}
+
+unsigned long long
+tell64(int fd)
+{
+    unsigned long long position;
+
+    syscall2(SYS_TELL64, fd, &position);
+    return position;
+}
+
+void
+fsync(int fd)
+{
+    syscall1(SYS_FSYNC, fd);
+}
+
+void
+fdatasync(int fd)
+{
+    syscall1(SYS_FDATASYNC, fd);
+}
+
+bool
+compress(int fd)
+{
+    return syscall1(SYS_COMPRESS, fd);
+}
+
 void
 close(int fd)
 {
@@ -144,7 +237,13 @@ close(int fd)
 mapid_t
 mmap(int fd, void *addr)
 {
-    return syscall2(SYS_MMAP, fd, addr);
+    return syscall3(SYS_MMAP, fd, addr, 0);
+}
+
+mapid_t
+mmap_flags(int fd, void *addr, unsigned flags)
+{
+    return syscall3(SYS_MMAP, fd, addr, flags);
 }
 
 void
@@ -182,3 +281,197 @@ inumber(int fd)
 {
     return syscall1(SYS_INUMBER, fd);
 }
+
+pid_t
+fork(void)
+{
+    return syscall0(SYS_FORK);
+}
+
+int
+readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread(int fd, void *buffer, unsigned size, unsigned offset)
+{
+    return syscall4(SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite(int fd, const void *buffer, unsigned size, unsigned offset)
+{
+    return syscall4(SYS_PWRITE, fd, buffer, size, offset);
+}
+
+void
+blockstats(void)
+{
+    syscall0(SYS_BLOCKSTATS);
+}
+
+void
+uptime(unsigned long long *ns)
+{
+    syscall1(SYS_UPTIME, ns);
+}
+
+void
+iostat(struct iostat *st)
+{
+    syscall1(SYS_IOSTAT, st);
+}
+
+int
+kstat(struct kstat *st)
+{
+    return syscall2(SYS_KSTAT, st, sizeof *st);
+}
+
+void
+vmstat(struct vmstat *st)
+{
+    syscall1(SYS_VMSTAT, st);
+}
+
+void *
+sbrk(intptr_t increment)
+{
+    return (void *)syscall1(SYS_SBRK, increment);
+}
+
+static void thread_start(void (*)(void *), void *aux) NO_RETURN;
+
+/* Runs FUNC(AUX) in a thread started by thread_create(), then
+ * ends the thread. */
+static void
+thread_start(void (*func)(void *), void *aux)
+{
+    func(aux);
+    thread_exit();
+}
+
+tid_t
+thread_create(void (*func)(void *), void *aux, void *stack, size_t size)
+{
+    uintptr_t *sp = (uintptr_t *)(((uintptr_t)stack + size) & ~15u);
+
+    /* Lay out a call to thread_start(FUNC, AUX), with its
+     * arguments 16-byte aligned, as if made from nowhere. */
+    sp -= 2;
+    *--sp = (uintptr_t)aux;
+    *--sp = (uintptr_t)func;
+    *--sp = 0;
+    return syscall2(SYS_THREAD_CREATE, thread_start, sp);
+}
+
+int
+thread_join(tid_t tid)
+{
+    return syscall1(SYS_THREAD_JOIN, tid);
+}
+
+void
+thread_exit(void)
+{
+    syscall0(SYS_THREAD_EXIT);
+    NOT_REACHED();
+}
+
+int
+futex_wait(int *uaddr, int val)
+{
+    return syscall3(SYS_FUTEX, FUTEX_WAIT, uaddr, val);
+}
+
+int
+futex_wake(int *uaddr, int cnt)
+{
+    return syscall3(SYS_FUTEX, FUTEX_WAKE, uaddr, cnt);
+}
+
+int
+pipe(int fds[2])
+{
+    return syscall1(SYS_PIPE, fds);
+}
+
+int
+copy_file(int dst_fd, int src_fd, unsigned size)
+{
+    return syscall3(SYS_COPY_FILE, dst_fd, src_fd, size);
+}
+
+bool
+clone_file(int dst_fd, int src_fd)
+{
+    return syscall2(SYS_CLONE_FILE, dst_fd, src_fd);
+}
+
+int
+aio_setup(struct aio_ring *ring)
+{
+    return syscall1(SYS_AIO_SETUP, ring);
+}
+
+int
+aio_enter(unsigned min_complete)
+{
+    return syscall1(SYS_AIO_ENTER, min_complete);
+}
+
+int
+batch(struct batch_call *calls, int cnt, unsigned flags)
+{
+    return syscall3(SYS_BATCH, calls, cnt, flags);
+}
+
+int
+poll(struct pollfd *fds, unsigned cnt, int timeout_ms)
+{
+    return syscall3(SYS_POLL, fds, cnt, timeout_ms);
+}
+
+int
+shm_create(unsigned size)
+{
+    return syscall1(SYS_SHM_CREATE, size);
+}
+
+bool
+shm_attach(int id, void *addr)
+{
+    return syscall2(SYS_SHM_ATTACH, id, addr);
+}
+
+bool
+shm_detach(void *addr)
+{
+    return syscall1(SYS_SHM_DETACH, addr);
+}
+
+int
+madvise(void *addr, unsigned length, int advice)
+{
+    return syscall3(SYS_MADVISE, addr, length, advice);
+}
+
+unsigned
+rss_limit(unsigned pages)
+{
+    return syscall1(SYS_RSS_LIMIT, pages);
+}
+
+int
+getdents(int fd, struct dirent *entries, unsigned cnt)
+{
+    return syscall3(SYS_GETDENTS, fd, entries, cnt);
+}
@@ -2,12 +2,20 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <debug.h>
+#include <iovec.h>
+#include <kstat.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t)-1)
 
+/* Thread identifier, for threads within a process. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t)-1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t)-1)
@@ -15,6 +23,113 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry as returned by getdents().  Must match the
+ * definition in filesys/directory.h. */
+struct dirent {
+    unsigned inumber;                 /* Inode number. */
+    bool isdir;                       /* Is it a directory? */
+    char name[READDIR_MAX_LEN + 1];   /* Null terminated file name. */
+};
+
+/* Transfers done by the file system device, as reported by
+ * iostat().  A request is one call into the block layer, however
+ * many sectors it covers. */
+struct iostat {
+    unsigned long long read_sectors;  /* Sectors read. */
+    unsigned long long write_sectors; /* Sectors written. */
+    unsigned long long read_reqs;     /* Read requests. */
+    unsigned long long write_reqs;    /* Write requests. */
+};
+
+/* A system call made by batch().  Bit I of LINKS set means that
+ * ARGS[I] is the index of an earlier record in the same batch,
+ * whose result is passed in its place. */
+struct batch_call {
+    int number;        /* SYS_* number, from <syscall-nr.h>. */
+    unsigned links;    /* Bit I set: ARGS[I] is a record index. */
+    uint32_t args[4];  /* Arguments. */
+    int result;        /* Return value, filled in by the kernel. */
+};
+
+/* Most records passed to batch(), and its flags. */
+#define BATCH_MAX 16
+#define BATCH_STOP 1 /* Stop after the first result of -1. */
+
+/* A descriptor for poll() to watch.  Events are POLLIN, POLLOUT,
+ * etc. from <syscall-nr.h>.  Must match the definition in
+ * userprog/poll.h. */
+struct pollfd {
+    int fd;          /* Descriptor, or negative to skip. */
+    short events;    /* POLLIN and POLLOUT wanted. */
+    short revents;   /* Events seen, set by the kernel. */
+};
+
+/* Most descriptors passed to poll(). */
+#define POLL_MAX 64
+
+/* Kinds of page fault counted by vmstat(), by how they were
+ * resolved. */
+enum vmstat_class {
+    VMSTAT_FILE,    /* Loaded from a file, or mapped a shared frame. */
+    VMSTAT_ZERO,    /* Zero-filled, or mapped the zero page. */
+    VMSTAT_SWAP,    /* Read back from swap. */
+    VMSTAT_STACK,   /* Grew the stack. */
+    VMSTAT_COW,     /* Copied a copy-on-write page. */
+    VMSTAT_INVALID, /* Not resolved; the access was an error. */
+    VMSTAT_CLASS_CNT
+};
+
+/* Paging activity of the calling process, as reported by
+ * vmstat().  Must match struct fault_stats in vm/fault.h. */
+struct vmstat {
+    unsigned faults[VMSTAT_CLASS_CNT];           /* Faults of each class. */
+    unsigned long long cycles[VMSTAT_CLASS_CNT]; /* CPU cycles handling them. */
+    unsigned evictions;                          /* Frames evicted. */
+    unsigned swap_in_sectors;                    /* Sectors read from swap. */
+    unsigned swap_out_sectors;                   /* Sectors written to swap. */
+    unsigned working_set;                        /* Pages in use lately. */
+    unsigned resident;                           /* Pages in memory. */
+    unsigned mapped;                             /* ...of mmap()s. */
+    unsigned swapped;                            /* Pages in swap. */
+    unsigned rss_limit;                          /* Most resident, or 0. */
+    unsigned pt_pages;                           /* Page directory, tables. */
+};
+
+/* Asynchronous I/O, with aio_setup() and aio_enter().  The
+ * program fills submission entries and advances SQ_TAIL; the
+ * kernel takes them, advancing SQ_HEAD, and posts a completion
+ * for each at CQ_TAIL once it is done, in whatever order they
+ * finish.  The program reaps completions and advances CQ_HEAD.
+ * Opcodes are AIO_READ, AIO_WRITE, AIO_PREAD, AIO_PWRITE and
+ * AIO_FSYNC from <syscall-nr.h>.  These must match the
+ * definitions in userprog/aio.h. */
+#define AIO_ENTRIES_MAX 256  /* Most slots in each ring. */
+#define AIO_LEN_MAX 65536    /* Most bytes in one read or write. */
+
+struct aio_sqe {
+    int opcode;         /* AIO_READ, AIO_WRITE, ... */
+    int fd;             /* File descriptor. */
+    void *buf;          /* Buffer. */
+    unsigned len;       /* Bytes to transfer. */
+    unsigned offset;    /* File offset, for AIO_PREAD and AIO_PWRITE. */
+    uint32_t user_data; /* Copied to the completion. */
+};
+
+struct aio_cqe {
+    uint32_t user_data; /* From the submission. */
+    int result;         /* Bytes transferred, or -1 on error. */
+};
+
+struct aio_ring {
+    unsigned sq_head;     /* Next submission to take; kernel writes. */
+    unsigned sq_tail;     /* Next free submission slot; user writes. */
+    unsigned cq_head;     /* Next completion to reap; user writes. */
+    unsigned cq_tail;     /* Next free completion slot; kernel writes. */
+    unsigned entries;     /* Slots in each ring, a power of 2. */
+    struct aio_sqe *sqes; /* Submission ring. */
+    struct aio_cqe *cqes; /* Completion ring. */
+};
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0 /* Successful execution. */
 #define EXIT_FAILURE 1 /* Unsuccessful execution. */
@@ -32,6 +147,11 @@ int read(int fd, void *buffer, unsigned length);
 int write(int fd, const void *buffer, unsigned length);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
+void seek64(int fd, unsigned long long position);
+unsigned long long tell64(int fd);
+void fsync(int fd);
+void fdatasync(int fd);
+bool compress(int fd);
 void close(int fd);
 
 /* Project 3 and optionally project 4. */
@@ -45,4 +165,40 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+pid_t fork(void);
+int readv(int fd, const struct iovec *, int iovcnt);
+int writev(int fd, const struct iovec *, int iovcnt);
+int pread(int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset);
+void blockstats(void);
+void uptime(unsigned long long *ns);
+void iostat(struct iostat *);
+int kstat(struct kstat *);
+void vmstat(struct vmstat *);
+void *sbrk(intptr_t increment);
+tid_t thread_create(void (*)(void *), void *aux, void *stack, size_t size);
+int thread_join(tid_t);
+void thread_exit(void) NO_RETURN;
+int futex_wait(int *uaddr, int val);
+int futex_wake(int *uaddr, int cnt);
+int pipe(int fds[2]);
+int copy_file(int dst_fd, int src_fd, unsigned size);
+bool clone_file(int dst_fd, int src_fd);
+int aio_setup(struct aio_ring *);
+int aio_enter(unsigned min_complete);
+int batch(struct batch_call *, int cnt, unsigned flags);
+int poll(struct pollfd *, unsigned cnt, int timeout_ms);
+int shm_create(unsigned size);
+bool shm_attach(int id, void *addr);
+bool shm_detach(void *addr);
+mapid_t mmap_flags(int fd, void *addr, unsigned flags);
+int madvise(void *addr, unsigned length, int advice);
+unsigned rss_limit(unsigned pages);
+int getdents(int fd, struct dirent *, unsigned cnt);
+
+/* Internal: picks SYSENTER or "int $0x30" for system calls.
+ * Called by _start() before main(). */
+void __syscall_init(void);
+
 #endif /* lib/user/syscall.h */
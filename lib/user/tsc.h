@@ -0,0 +1,18 @@
+#ifndef __LIB_USER_TSC_H
+#define __LIB_USER_TSC_H
+
+#include <stdint.h>
+
+/* Returns the CPU's time-stamp counter.  The kernel leaves the
+ * counter readable in user mode, so timing a short stretch of
+ * code this way costs no system call.  The count is in CPU
+ * cycles, not a fixed unit of time. */
+static inline uint64_t
+tsc_read(void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+#endif /* lib/user/tsc.h */
@@ -0,0 +1,70 @@
+#ifndef __LIB_USER_VDSO_H
+#define __LIB_USER_VDSO_H
+
+#include <stdint.h>
+#include "tsc.h"
+
+/* The kernel data page, mapped read-only at VDSO_ADDR in every
+ * process and kept current by the kernel.  Reading it costs no
+ * system call.  Must match the definition in userprog/vdso.h. */
+#define VDSO_ADDR ((const volatile struct vdso_data *) 0x08000000)
+
+struct vdso_data {
+    uint32_t seq;            /* Odd while TICKS is being updated. */
+    int64_t ticks;           /* Timer ticks since boot. */
+    uint32_t tick_freq;      /* Timer ticks per second. */
+    uint64_t boot_cycles;    /* Time-stamp counter at boot. */
+    uint64_t cycles_per_sec; /* Time-stamp counter rate. */
+    int tid;                 /* Running thread. */
+    int pid;                 /* Its process. */
+};
+
+/* Returns the number of timer ticks since the OS booted. */
+static inline int64_t
+vdso_ticks(void)
+{
+    uint32_t seq;
+    int64_t ticks;
+
+    do {
+        seq = VDSO_ADDR->seq;
+        ticks = VDSO_ADDR->ticks;
+    } while ((seq & 1) != 0 || seq != VDSO_ADDR->seq);
+    return ticks;
+}
+
+/* Returns the number of timer ticks per second. */
+static inline unsigned
+vdso_tick_freq(void)
+{
+    return VDSO_ADDR->tick_freq;
+}
+
+/* Returns the number of nanoseconds since the OS booted, from
+ * the time-stamp counter, as uptime() does. */
+static inline unsigned long long
+vdso_uptime_ns(void)
+{
+    uint64_t cycles = tsc_read() - VDSO_ADDR->boot_cycles;
+    uint64_t rate = VDSO_ADDR->cycles_per_sec;
+
+    return (cycles / rate * 1000000000
+            + cycles % rate * 1000000000 / rate);
+}
+
+/* Returns the id of the calling thread. */
+static inline int
+vdso_tid(void)
+{
+    return VDSO_ADDR->tid;
+}
+
+/* Returns the id of the calling process, the id that exec()
+ * returned to its parent. */
+static inline int
+vdso_pid(void)
+{
+    return VDSO_ADDR->pid;
+}
+
+#endif /* lib/user/vdso.h */
@@ -0,0 +1,63 @@
+/* Measures the throughput of the page and block allocators, as
+   pairs of allocation and free. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "devices/timer.h"
+
+#define OP_CNT 10000
+#define BATCH_CNT 64
+
+static void bench_malloc (size_t size);
+
+void
+test_bench_alloc (void) 
+{
+  void *pages[BATCH_CNT];
+  uint64_t start;
+  int i, j;
+
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT; i++)
+    palloc_free_page (palloc_get_page (PAL_ASSERT));
+  bench_report ("palloc", OP_CNT, timer_cycles () - start);
+
+  /* Allocating many pages before freeing any defeats whatever
+     caching of recently freed pages the allocator does. */
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT / BATCH_CNT; i++) 
+    {
+      for (j = 0; j < BATCH_CNT; j++)
+        pages[j] = palloc_get_page (PAL_ASSERT);
+      for (j = 0; j < BATCH_CNT; j++)
+        palloc_free_page (pages[j]);
+    }
+  bench_report ("palloc-batch", OP_CNT / BATCH_CNT * BATCH_CNT,
+                timer_cycles () - start);
+
+  bench_malloc (16);
+  bench_malloc (256);
+  bench_malloc (2048);
+}
+
+/* Measures malloc() and free() of SIZE bytes. */
+static void
+bench_malloc (size_t size) 
+{
+  char what[32];
+  uint64_t start;
+  int i;
+
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      void *p = malloc (size);
+      ASSERT (p != NULL);
+      free (p);
+    }
+  snprintf (what, sizeof what, "malloc-%zu", size);
+  bench_report (what, OP_CNT, timer_cycles () - start);
+}
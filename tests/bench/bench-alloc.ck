@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench ("palloc", "palloc-batch", "malloc-16", "malloc-256", "malloc-2048");
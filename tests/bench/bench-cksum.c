@@ -0,0 +1,41 @@
+/* Measures the throughput of the checksum that the file system
+   and VM tests use to verify their data, both a byte at a time
+   and eight bytes at a time. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include "tests/cksum.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define PAGE_CNT 16
+#define PASS_CNT 16
+
+void
+test_bench_cksum (void) 
+{
+  unsigned char *buf = palloc_get_multiple (PAL_ASSERT, PAGE_CNT);
+  unsigned long bytewise, sliced;
+  uint64_t start;
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT * PGSIZE; i++)
+    buf[i] = i * 2654435761u >> 24;
+
+  start = timer_cycles ();
+  for (i = 0; i < PASS_CNT; i++)
+    bytewise = cksum_bytewise (buf, PAGE_CNT * PGSIZE);
+  bench_report ("cksum-bytewise-4k", PASS_CNT * PAGE_CNT,
+                timer_cycles () - start);
+
+  start = timer_cycles ();
+  for (i = 0; i < PASS_CNT; i++)
+    sliced = cksum (buf, PAGE_CNT * PGSIZE);
+  bench_report ("cksum-4k", PASS_CNT * PAGE_CNT, timer_cycles () - start);
+
+  if (sliced != bytewise)
+    fail ("cksum %lu differs from byte-wise cksum %lu", sliced, bytewise);
+
+  palloc_free_multiple (buf, PAGE_CNT);
+}
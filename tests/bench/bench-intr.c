@@ -0,0 +1,33 @@
+/* Measures the cost of taking an interrupt, by raising a
+   software interrupt whose handler does nothing. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "devices/timer.h"
+
+#define INTR_CNT 10000
+
+/* An otherwise unused vector. */
+#define BENCH_VEC 0x41
+
+static intr_handler_func null_handler;
+
+void
+test_bench_intr (void) 
+{
+  uint64_t start;
+  int i;
+
+  intr_register_int (BENCH_VEC, 0, INTR_OFF, null_handler, "bench");
+
+  start = timer_cycles ();
+  for (i = 0; i < INTR_CNT; i++)
+    asm volatile ("int %0" : : "i" (BENCH_VEC));
+  bench_report ("intr", INTR_CNT, timer_cycles () - start);
+}
+
+static void
+null_handler (struct intr_frame *f UNUSED) 
+{
+}
@@ -0,0 +1,56 @@
+/* Measures locks: an acquire and release that never block, and
+   several threads contending for one lock, each yielding while
+   it holds the lock so that the others pile up waiting. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define OP_CNT 10000
+#define THREAD_CNT 4
+#define CONTENDED_CNT 1000
+
+static thread_func contend_thread;
+static struct lock lock;
+static struct semaphore done;
+
+void
+test_bench_lock (void) 
+{
+  uint64_t start;
+  int i;
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  bench_report ("lock-uncontended", OP_CNT, timer_cycles () - start);
+
+  start = timer_cycles ();
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("contender", thread_get_priority (), contend_thread, NULL);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  bench_report ("lock-contended", THREAD_CNT * CONTENDED_CNT,
+                timer_cycles () - start);
+}
+
+static void
+contend_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < CONTENDED_CNT; i++) 
+    {
+      lock_acquire (&lock);
+      thread_yield ();
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,55 @@
+/* Measures semaphores: an up and a down that never block, and a
+   ping-pong between two threads in which every down blocks. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define OP_CNT 10000
+
+static thread_func pong_thread;
+static struct semaphore ping, pong, done;
+
+void
+test_bench_sema (void) 
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  sema_init (&done, 0);
+
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      sema_up (&ping);
+      sema_down (&ping);
+    }
+  bench_report ("sema-uncontended", OP_CNT, timer_cycles () - start);
+
+  thread_create ("pong", thread_get_priority (), pong_thread, NULL);
+  start = timer_cycles ();
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  bench_report ("sema-pingpong", OP_CNT, timer_cycles () - start);
+
+  sema_down (&done);
+}
+
+static void
+pong_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,49 @@
+/* Measures how closely timer_sleep() keeps to the time asked
+   for.  Each sleep starts just after a tick, so a sleep of N
+   ticks should take N ticks plus the latency of the wakeup; the
+   "tick" line gives the length of one tick for comparison. */
+
+#include "tests/bench/bench.h"
+#include <stdio.h>
+#include "devices/timer.h"
+
+#define SLEEP_CNT 50
+
+static void bench_sleep (int64_t ticks);
+
+void
+test_bench_sleep (void) 
+{
+  bench_report ("tick", 1, timer_cycles_per_sec () / TIMER_FREQ);
+  bench_sleep (1);
+  bench_sleep (5);
+}
+
+/* Times SLEEP_CNT sleeps of TICKS ticks each, and reports any
+   that woke after their tick had passed. */
+static void
+bench_sleep (int64_t ticks) 
+{
+  char what[32];
+  uint64_t cycles = 0;
+  int late = 0;
+  int i;
+
+  for (i = 0; i < SLEEP_CNT; i++) 
+    {
+      int64_t target;
+      uint64_t start;
+
+      timer_sleep (1);
+      start = timer_cycles ();
+      target = timer_ticks () + ticks;
+      timer_sleep (ticks);
+      cycles += timer_cycles () - start;
+      if (timer_ticks () > target)
+        late++;
+    }
+  snprintf (what, sizeof what, "sleep-%lld", ticks);
+  bench_report (what, SLEEP_CNT, cycles);
+  if (late > 0)
+    msg ("%d of %d sleeps of %lld ticks woke late", late, SLEEP_CNT, ticks);
+}
@@ -0,0 +1,41 @@
+/* Measures the cost of a thread switch, by having two threads of
+   equal priority yield to each other. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SWITCH_CNT 10000
+
+static thread_func yield_thread;
+static struct semaphore done;
+
+void
+test_bench_switch (void) 
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  thread_create ("yielder", thread_get_priority (), yield_thread, NULL);
+
+  /* Each of our yields runs the other thread until it yields
+     back, making two switches. */
+  start = timer_cycles ();
+  for (i = 0; i < SWITCH_CNT; i++)
+    thread_yield ();
+  bench_report ("switch", 2 * SWITCH_CNT, timer_cycles () - start);
+
+  sema_down (&done);
+}
+
+static void
+yield_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < SWITCH_CNT; i++)
+    thread_yield ();
+  sema_up (&done);
+}
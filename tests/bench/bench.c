@@ -0,0 +1,14 @@
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include "devices/timer.h"
+
+/* Reports that OPS operations of kind WHAT took CYCLES
+   time-stamp counter cycles in all. */
+void
+bench_report (const char *what, unsigned ops, uint64_t cycles)
+{
+  ASSERT (ops > 0);
+
+  msg ("BENCH %s ops=%u cycles_per_op=%llu ns_per_op=%llu",
+       what, ops, cycles / ops, timer_cycles_to_ns (cycles) / ops);
+}
@@ -0,0 +1,25 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+#include "tests/threads/tests.h"
+
+/* Micro-benchmarks.  Each one times a kernel primitive with the
+   time-stamp counter and reports the result with bench_report(),
+   which prints a line of the form
+
+     (bench-NAME) BENCH WHAT ops=N cycles_per_op=C ns_per_op=T
+
+   that `make bench' collects from all of the benchmarks. */
+
+extern test_func test_bench_switch;
+extern test_func test_bench_sema;
+extern test_func test_bench_lock;
+extern test_func test_bench_alloc;
+extern test_func test_bench_sleep;
+extern test_func test_bench_intr;
+extern test_func test_bench_cksum;
+
+void bench_report (const char *what, unsigned ops, uint64_t cycles);
+
+#endif /* tests/bench/bench.h */
@@ -0,0 +1,16 @@
+sub check_bench {
+    my (@whats) = @_;
+    our ($test);
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    for my $what (@whats) {
+	fail "No BENCH line for \"$what\".\n"
+	  if !grep (/BENCH \Q$what\E ops=\d+ cycles_per_op=\d+ ns_per_op=\d+$/,
+		    @output);
+    }
+    pass;
+}
+
+1;
@@ -2,7 +2,20 @@
 #define TESTS_CKSUM_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* State of a checksum computed piece by piece. */
+struct cksum
+  {
+    uint32_t crc;               /* CRC register. */
+    size_t length;              /* Bytes added so far. */
+  };
+
+void cksum_init(struct cksum *);
+void cksum_update(struct cksum *, const void *, size_t);
+unsigned long cksum_final(const struct cksum *);
 
 unsigned long cksum(const void *, size_t);
+unsigned long cksum_bytewise(const void *, size_t);
 
 #endif /* tests/cksum.h */
@@ -0,0 +1,66 @@
+/* Checks that timer_add() calls each callback on the tick it is
+   due, whether the delay fits in the first level of the timer
+   wheel or has to be moved down from a higher one, and that
+   timer_cancel() keeps a callback from running. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CALLBACK_CNT 4
+
+static const int64_t delays[CALLBACK_CNT] = {5, 10, 70, 200};
+static struct timeout timeouts[CALLBACK_CNT];
+static int64_t start, ran_at[CALLBACK_CNT];
+static struct semaphore done;
+
+static timer_func callback;
+
+void
+test_alarm_callback (void) 
+{
+  enum intr_level old_level;
+  int i;
+
+  sema_init (&done, 0);
+
+  /* Add every callback in the same tick. */
+  old_level = intr_disable ();
+  start = timer_ticks ();
+  for (i = 0; i < CALLBACK_CNT; i++) 
+    {
+      ran_at[i] = -1;
+      timeout_init (&timeouts[i], callback, &ran_at[i]);
+      timer_add (&timeouts[i], delays[i]);
+    }
+  intr_set_level (old_level);
+
+  if (!timer_cancel (&timeouts[1]))
+    fail ("Callback after 10 ticks was not pending.");
+  msg ("Cancelled callback after 10 ticks.");
+
+  for (i = 0; i < CALLBACK_CNT - 1; i++)
+    sema_down (&done);
+  timer_sleep (20);
+
+  for (i = 0; i < CALLBACK_CNT; i++)
+    if (ran_at[i] < 0)
+      msg ("Callback after %lld ticks did not run.", delays[i]);
+    else
+      msg ("Callback after %lld ticks ran after %lld ticks.",
+           delays[i], ran_at[i] - start);
+  if (timer_cancel (&timeouts[0]))
+    fail ("Callback after 5 ticks still pending after running.");
+}
+
+static void
+callback (void *ran_at_) 
+{
+  int64_t *ran_at_ptr = ran_at_;
+
+  *ran_at_ptr = timer_ticks ();
+  sema_up (&done);
+}
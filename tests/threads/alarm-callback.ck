@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-callback) begin
+(alarm-callback) Cancelled callback after 10 ticks.
+(alarm-callback) Callback after 5 ticks ran after 5 ticks.
+(alarm-callback) Callback after 10 ticks did not run.
+(alarm-callback) Callback after 70 ticks ran after 70 ticks.
+(alarm-callback) Callback after 200 ticks ran after 200 ticks.
+(alarm-callback) end
+EOF
+pass;
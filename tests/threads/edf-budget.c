@@ -0,0 +1,47 @@
+/* Checks that an EDF thread runs ahead of a thread of any
+   priority while it has budget left, but no longer, and that
+   admission control refuses a thread that would overload the
+   CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func high_thread;
+static volatile bool high_ran;
+
+void
+test_edf_budget (void) 
+{
+  int64_t start;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  if (thread_set_deadline (10, 10))
+    fail ("admitted a thread with 100%% utilization");
+  msg ("Admission of 100%% utilization refused.");
+
+  if (!thread_set_deadline (100, 5))
+    fail ("refused a thread with 5%% utilization");
+  thread_create ("high", PRI_MAX, high_thread, NULL);
+  msg ("EDF thread runs ahead of PRI_MAX thread.");
+
+  /* Spin until the 5-tick budget runs out and the high-priority
+     thread gets its turn. */
+  start = timer_ticks ();
+  while (!high_ran && timer_elapsed (start) < 50)
+    continue;
+  thread_set_deadline (0, 0);
+  if (!high_ran)
+    fail ("PRI_MAX thread did not run after the budget was used up");
+}
+
+static void
+high_thread (void *aux UNUSED) 
+{
+  msg ("PRI_MAX thread runs once the budget is used up.");
+  high_ran = true;
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-budget) begin
+(edf-budget) Admission of 100% utilization refused.
+(edf-budget) EDF thread runs ahead of PRI_MAX thread.
+(edf-budget) PRI_MAX thread runs once the budget is used up.
+(edf-budget) end
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Checks readers-writer lock semantics.  Two readers may hold
+   the lock at once.  A writer that is waiting for readers to
+   drain keeps new readers out, and gets the lock before them
+   once the last reader leaves. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func shared_reader_func;
+static thread_func writer_func;
+static thread_func late_reader_func;
+
+static struct rwlock rw;
+
+void
+test_rwlock (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rw_read_acquire (&rw);
+  msg ("Main thread acquired read lock.");
+
+  thread_create ("shared", PRI_DEFAULT + 1, shared_reader_func, NULL);
+  thread_create ("writer", PRI_DEFAULT + 3, writer_func, NULL);
+  thread_create ("late", PRI_DEFAULT + 2, late_reader_func, NULL);
+
+  msg ("Main thread releasing read lock.");
+  rw_read_release (&rw);
+  msg ("Main thread finished.");
+}
+
+static void
+shared_reader_func (void *aux UNUSED) 
+{
+  rw_read_acquire (&rw);
+  msg ("Shared reader acquired read lock alongside main.");
+  rw_read_release (&rw);
+}
+
+static void
+writer_func (void *aux UNUSED) 
+{
+  msg ("Writer waiting for readers to drain.");
+  rw_write_acquire (&rw);
+  msg ("Writer acquired write lock.");
+  rw_write_release (&rw);
+  msg ("Writer finished.");
+}
+
+static void
+late_reader_func (void *aux UNUSED) 
+{
+  if (rw_read_try_acquire (&rw))
+    fail ("Late reader got read lock while writer waited.");
+  msg ("Late reader refused by waiting writer.");
+  rw_read_acquire (&rw);
+  msg ("Late reader acquired read lock.");
+  rw_read_release (&rw);
+}
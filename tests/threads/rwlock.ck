@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock) begin
+(rwlock) Main thread acquired read lock.
+(rwlock) Shared reader acquired read lock alongside main.
+(rwlock) Writer waiting for readers to drain.
+(rwlock) Late reader refused by waiting writer.
+(rwlock) Main thread releasing read lock.
+(rwlock) Writer acquired write lock.
+(rwlock) Writer finished.
+(rwlock) Late reader acquired read lock.
+(rwlock) Main thread finished.
+(rwlock) end
+EOF
+pass;
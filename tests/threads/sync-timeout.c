@@ -0,0 +1,75 @@
+/* Checks that sema_down_timeout(), lock_acquire_timeout() and
+   cond_wait_timeout() give up after the number of ticks they
+   are given, and succeed when woken in time. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+
+static thread_func up_thread;
+static thread_func hold_thread;
+
+void
+test_sync_timeout (void) 
+{
+  int64_t start;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  start = timer_ticks ();
+  if (sema_down_timeout (&sema, 10))
+    fail ("Semaphore nobody upped was downed.");
+  if (timer_elapsed (start) < 10)
+    fail ("Semaphore wait timed out after only %lld ticks.",
+          timer_elapsed (start));
+  msg ("Semaphore wait timed out.");
+
+  thread_create ("up", PRI_DEFAULT, up_thread, NULL);
+  if (!sema_down_timeout (&sema, 100))
+    fail ("Semaphore upped after 5 ticks timed out.");
+  msg ("Semaphore upped in time.");
+
+  thread_create ("hold", PRI_DEFAULT + 1, hold_thread, NULL);
+  if (lock_acquire_timeout (&lock, 10))
+    fail ("Acquired lock held by another thread.");
+  if (thread_get_priority () != PRI_DEFAULT)
+    fail ("Priority is %d after lock timeout.", thread_get_priority ());
+  msg ("Lock wait timed out.");
+  if (!lock_acquire_timeout (&lock, 100))
+    fail ("Lock released after 30 ticks timed out.");
+  msg ("Lock acquired in time.");
+
+  if (cond_wait_timeout (&cond, &lock, 10))
+    fail ("Condition nobody signaled was signaled.");
+  if (!lock_held_by_current_thread (&lock))
+    fail ("Lock not held after condition wait timed out.");
+  msg ("Condition wait timed out.");
+  lock_release (&lock);
+}
+
+static void
+up_thread (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  sema_up (&sema);
+}
+
+static void
+hold_thread (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  timer_sleep (30);
+  lock_release (&lock);
+}
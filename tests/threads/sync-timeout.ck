@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sync-timeout) begin
+(sync-timeout) Semaphore wait timed out.
+(sync-timeout) Semaphore upped in time.
+(sync-timeout) Lock wait timed out.
+(sync-timeout) Lock acquired in time.
+(sync-timeout) Condition wait timed out.
+(sync-timeout) end
+EOF
+pass;
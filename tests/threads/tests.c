@@ -1,4 +1,5 @@
 #include "tests/threads/tests.h"
+#include "tests/bench/bench.h"
 #include <debug.h>
 #include <string.h>
 #include <stdio.h>
@@ -18,6 +19,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-callback", test_alarm_callback},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -30,6 +32,10 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"rwlock", test_rwlock},
+    {"workqueue", test_workqueue},
+    {"sync-timeout", test_sync_timeout},
+    {"edf-budget", test_edf_budget},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -39,6 +45,14 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"cfs-nice", test_cfs_nice},
+    {"bench-switch", test_bench_switch},
+    {"bench-sema", test_bench_sema},
+    {"bench-lock", test_bench_lock},
+    {"bench-alloc", test_bench_alloc},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-intr", test_bench_intr},
+    {"bench-cksum", test_bench_cksum},
   };
 
 static const char *test_name;
@@ -0,0 +1,69 @@
+/* Checks that a work queue runs items embedded in other
+   structures in the order they were queued, that queuing an
+   item already in the queue does nothing, and that a worker
+   takes queued items off in batches rather than one at a time. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+#define ITEM_CNT 20
+
+struct item 
+  {
+    int id;
+    struct work work;
+  };
+
+static work_func item_func;
+
+static struct workqueue wq;
+static struct item items[ITEM_CNT];
+static int order[ITEM_CNT];
+static int run_cnt;
+static struct semaphore done;
+
+void
+test_workqueue (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* The worker runs below our priority, so nothing runs until
+     we block. */
+  workqueue_init (&wq, "test-wq", PRI_DEFAULT - 1, 1);
+  sema_init (&done, 0);
+  for (i = 0; i < ITEM_CNT; i++) 
+    {
+      items[i].id = i;
+      work_init (&items[i].work, item_func);
+      if (!work_queue (&wq, &items[i].work))
+        fail ("Item %d was not queued.", i);
+    }
+  msg ("Queued %d items.", ITEM_CNT);
+  if (work_queue (&wq, &items[0].work))
+    fail ("Item 0 was queued twice.");
+  msg ("Queuing item 0 again did nothing.");
+
+  sema_down (&done);
+  for (i = 0; i < ITEM_CNT; i++)
+    if (order[i] != i)
+      fail ("Item %d ran in position %d.", order[i], i);
+  msg ("Ran %d items in order.", run_cnt);
+  msg ("Took them in %llu batches.", wq.batch_cnt);
+}
+
+static void
+item_func (struct work *w) 
+{
+  struct item *item = work_entry (w, struct item, work);
+
+  order[run_cnt++] = item->id;
+  if (run_cnt == ITEM_CNT)
+    sema_up (&done);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Queued 20 items.
+(workqueue) Queuing item 0 again did nothing.
+(workqueue) Ran 20 items in order.
+(workqueue) Took them in 2 batches.
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,80 @@
+/* Writes sample.txt's contents to a new file in four pieces
+   through the asynchronous I/O rings, reads them back the same
+   way, and checks the data. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIECES 4
+
+static struct aio_sqe sqes[8];
+static struct aio_cqe cqes[8];
+static struct aio_ring ring = {0, 0, 0, 0, 8, sqes, cqes};
+static char buf[sizeof sample];
+
+/* Submits PIECES requests of OPCODE covering sample's bytes on
+   FD, through BUFFER, and checks that each completes in full. */
+static void
+transfer (int opcode, int fd, char *buffer) 
+{
+  int size = sizeof sample - 1;
+  int piece = (size + PIECES - 1) / PIECES;
+  unsigned seen = 0;
+  int i;
+
+  for (i = 0; i < PIECES; i++) 
+    {
+      struct aio_sqe *sqe = &sqes[ring.sq_tail % ring.entries];
+      int ofs = i * piece;
+
+      sqe->opcode = opcode;
+      sqe->fd = fd;
+      sqe->buf = buffer + ofs;
+      sqe->len = ofs + piece <= size ? piece : size - ofs;
+      sqe->offset = ofs;
+      sqe->user_data = i;
+      ring.sq_tail++;
+    }
+  if (aio_enter (PIECES) != PIECES)
+    fail ("aio_enter did not take %d submissions", PIECES);
+  if (ring.cq_tail - ring.cq_head != PIECES)
+    fail ("%u completions, expected %d",
+          ring.cq_tail - ring.cq_head, PIECES);
+  while (ring.cq_head != ring.cq_tail) 
+    {
+      struct aio_cqe *cqe = &cqes[ring.cq_head++ % ring.entries];
+      int ofs = cqe->user_data * piece;
+      int len = ofs + piece <= size ? piece : size - ofs;
+
+      if (cqe->user_data >= PIECES || (seen & (1u << cqe->user_data)))
+        fail ("unexpected completion %u", cqe->user_data);
+      if (cqe->result != len)
+        fail ("piece %u transferred %d bytes, expected %d",
+              cqe->user_data, cqe->result, len);
+      seen |= 1u << cqe->user_data;
+    }
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("aio.txt", 0), "create \"aio.txt\"");
+  CHECK ((fd = open ("aio.txt")) > 1, "open \"aio.txt\"");
+  CHECK (aio_setup (&ring) == 0, "aio_setup");
+  CHECK (aio_setup (&ring) == -1, "second aio_setup fails");
+
+  msg ("write in pieces");
+  transfer (AIO_PWRITE, fd, (char *) sample);
+  msg ("read in pieces");
+  transfer (AIO_PREAD, fd, buf);
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("data read differs from data written");
+  close (fd);
+  check_file ("aio.txt", sample, sizeof sample - 1);
+}
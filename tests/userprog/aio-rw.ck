@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-rw) begin
+(aio-rw) create "aio.txt"
+(aio-rw) open "aio.txt"
+(aio-rw) aio_setup
+(aio-rw) second aio_setup fails
+(aio-rw) write in pieces
+(aio-rw) read in pieces
+(aio-rw) open "aio.txt" for verification
+(aio-rw) verified contents of "aio.txt"
+(aio-rw) close "aio.txt"
+(aio-rw) end
+aio-rw: exit(0)
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Opens, sizes, reads, and closes sample.txt in a single batch(),
+   passing the descriptor along by linking to the open() record,
+   then checks that BATCH_STOP stops at a failing call. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[sizeof sample];
+
+void
+test_main (void) 
+{
+  struct batch_call calls[4];
+  int size = sizeof sample - 1;
+
+  memset (calls, 0, sizeof calls);
+  calls[0].number = SYS_OPEN;
+  calls[0].args[0] = (uint32_t) "sample.txt";
+  calls[1].number = SYS_FILESIZE;
+  calls[1].links = 1;
+  calls[2].number = SYS_READ;
+  calls[2].links = 1;
+  calls[2].args[1] = (uint32_t) buf;
+  calls[2].args[2] = size;
+  calls[3].number = SYS_CLOSE;
+  calls[3].links = 1;
+  CHECK (batch (calls, 4, 0) == 4, "batch open, filesize, read, close");
+  CHECK (calls[0].result > 1, "open returned a descriptor");
+  CHECK (calls[1].result == size, "filesize returned %d", size);
+  CHECK (calls[2].result == size, "read returned %d", size);
+  if (memcmp (buf, sample, size))
+    fail ("data read differs from sample.txt");
+
+  memset (calls, 0, sizeof calls);
+  calls[0].number = SYS_OPEN;
+  calls[0].args[0] = (uint32_t) "no-such-file";
+  calls[1].number = SYS_CLOSE;
+  calls[1].links = 1;
+  CHECK (batch (calls, 2, BATCH_STOP) == 1, "batch stops at failed open");
+  CHECK (calls[0].result == -1, "open returned -1");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(batch) begin
+(batch) batch open, filesize, read, close
+(batch) open returned a descriptor
+(batch) filesize returned 239
+(batch) read returned 239
+(batch) batch stops at failed open
+(batch) open returned -1
+(batch) end
+batch: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Child process run by the fpu test.
+   Loads its own values into the registers that its parent uses,
+   makes some system calls, and exits with 81 if its values
+   survived. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-fpu";
+
+int
+main (void) 
+{
+  int x87_in = 81, x87_out;
+  unsigned sse_in = 0x87654321, sse_out;
+  int i;
+
+  asm volatile ("fildl %0" : : "m" (x87_in));
+  asm volatile ("movd %0, %%xmm1" : : "r" (sse_in));
+  for (i = 0; i < 10; i++)
+    msg ("run");
+  asm volatile ("movd %%xmm1, %0" : "=r" (sse_out));
+  asm volatile ("fistpl %0" : "=m" (x87_out));
+
+  return sse_out == sse_in ? x87_out : -1;
+}
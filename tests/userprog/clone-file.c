@@ -0,0 +1,58 @@
+/* Clones a file, overwrites part of the clone, and checks that
+   the clone reads back as written while the original is
+   unchanged.  Then removes the original and checks that the
+   clone still reads back.  Also checks that a file with data
+   cannot be cloned into. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 10000
+
+static char buf[SIZE];
+static char copy[SIZE];
+static char back[SIZE];
+
+void
+test_main (void)
+{
+  static const char line[] = "the quick brown fox jumps over the lazy dog\n";
+  size_t i;
+  int src, dst;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = line[i % (sizeof line - 1)];
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src, buf, SIZE) == SIZE, "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK (clone_file (dst, src), "clone \"src\" to \"dst\"");
+  CHECK (filesize (dst) == SIZE, "size of \"dst\"");
+
+  memcpy (copy, buf, SIZE);
+  memset (copy + 4000, 'x', 700);
+  seek (dst, 4000);
+  CHECK (write (dst, copy + 4000, 700) == 700, "overwrite \"dst\"");
+
+  seek (dst, 0);
+  CHECK (read (dst, back, SIZE) == SIZE, "read \"dst\"");
+  if (memcmp (back, copy, SIZE))
+    fail ("\"dst\" does not read back as written");
+  seek (src, 0);
+  CHECK (read (src, back, SIZE) == SIZE, "read \"src\"");
+  if (memcmp (back, buf, SIZE))
+    fail ("\"src\" changed");
+  CHECK (!clone_file (dst, src), "clone into non-empty \"dst\" fails");
+  close (src);
+
+  CHECK (remove ("src"), "remove \"src\"");
+  seek (dst, 0);
+  CHECK (read (dst, back, SIZE) == SIZE, "read \"dst\" again");
+  if (memcmp (back, copy, SIZE))
+    fail ("\"dst\" changed");
+  close (dst);
+}
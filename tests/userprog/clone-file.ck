@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clone-file) begin
+(clone-file) create "src"
+(clone-file) open "src"
+(clone-file) write "src"
+(clone-file) create "dst"
+(clone-file) open "dst"
+(clone-file) clone "src" to "dst"
+(clone-file) size of "dst"
+(clone-file) overwrite "dst"
+(clone-file) read "dst"
+(clone-file) read "src"
+(clone-file) clone into non-empty "dst" fails
+(clone-file) remove "src"
+(clone-file) read "dst" again
+(clone-file) end
+clone-file: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Writes text to a compressed file, overwrites part of it across
+   a chunk boundary, and checks that it reads back as written.
+   Also checks that a file with data cannot be made compressed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 10000
+
+static char buf[SIZE];
+static char back[SIZE];
+
+void
+test_main (void)
+{
+  static const char line[] = "the quick brown fox jumps over the lazy dog\n";
+  size_t i;
+  int fd;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = line[i % (sizeof line - 1)];
+
+  CHECK (create ("text", 0), "create \"text\"");
+  CHECK ((fd = open ("text")) > 1, "open \"text\"");
+  CHECK (compress (fd), "compress \"text\"");
+  CHECK (write (fd, buf, SIZE) == SIZE, "write \"text\"");
+
+  memset (buf + 4000, 'x', 200);
+  seek (fd, 4000);
+  CHECK (write (fd, buf + 4000, 200) == 200, "overwrite \"text\"");
+
+  seek (fd, 0);
+  CHECK (read (fd, back, SIZE) == SIZE, "read \"text\"");
+  if (memcmp (back, buf, SIZE))
+    fail ("\"text\" does not read back as written");
+  CHECK (!compress (fd), "compress non-empty \"text\" fails");
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(compress) begin
+(compress) create "text"
+(compress) open "text"
+(compress) compress "text"
+(compress) write "text"
+(compress) overwrite "text"
+(compress) read "text"
+(compress) compress non-empty "text" fails
+(compress) end
+compress: exit(0)
+EOF
+pass;
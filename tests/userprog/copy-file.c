@@ -0,0 +1,25 @@
+/* Copies sample.txt to a new file with copy_file(), in two
+   pieces, and checks the copy. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int size = sizeof sample - 1;
+  int half = size / 2;
+  int in_fd, out_fd;
+
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+  CHECK (copy_file (out_fd, in_fd, half) == half, "copy first half");
+  CHECK (copy_file (out_fd, in_fd, size) == size - half, "copy the rest");
+  CHECK (copy_file (out_fd, in_fd, size) == 0, "copy at end of file");
+  close (out_fd);
+  close (in_fd);
+  check_file ("copy.txt", sample, size);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-file) begin
+(copy-file) open "sample.txt"
+(copy-file) create "copy.txt"
+(copy-file) open "copy.txt"
+(copy-file) copy first half
+(copy-file) copy the rest
+(copy-file) copy at end of file
+(copy-file) open "copy.txt" for verification
+(copy-file) verified contents of "copy.txt"
+(copy-file) close "copy.txt"
+(copy-file) end
+copy-file: exit(0)
+EOF
+pass;
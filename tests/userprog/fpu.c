@@ -0,0 +1,25 @@
+/* Loads values into an x87 and an SSE register, runs a child
+   process that loads different values into the same registers,
+   and checks that ours survived. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int x87_in = 1234, x87_out;
+  unsigned sse_in = 0x12345678, sse_out;
+
+  asm volatile ("fildl %0" : : "m" (x87_in));
+  asm volatile ("movd %0, %%xmm1" : : "r" (sse_in));
+  CHECK (wait (exec ("child-fpu")) == 81, "wait for child-fpu");
+  asm volatile ("movd %%xmm1, %0" : "=r" (sse_out));
+  asm volatile ("fistpl %0" : "=m" (x87_out));
+
+  if (x87_out != x87_in)
+    fail ("x87 register holds %d, expected %d", x87_out, x87_in);
+  if (sse_out != sse_in)
+    fail ("SSE register holds %#x, expected %#x", sse_out, sse_in);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu) begin
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+(child-fpu) run
+child-fpu: exit(81)
+(fpu) wait for child-fpu
+(fpu) end
+fpu: exit(0)
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Writes a file, makes it durable with fsync(), overwrites part
+   of it in place and makes that durable with fdatasync(), then
+   checks that the file reads back as written. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+void
+test_main (void)
+{
+  char back[sizeof buf];
+  int fd;
+
+  memset (buf, 'a', sizeof buf);
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((fd = open ("log")) > 1, "open \"log\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"log\"");
+  fsync (fd);
+  msg ("fsync \"log\"");
+
+  memset (buf + 1000, 'b', 1000);
+  seek (fd, 1000);
+  CHECK (write (fd, buf + 1000, 1000) == 1000, "overwrite \"log\"");
+  fdatasync (fd);
+  msg ("fdatasync \"log\"");
+
+  seek (fd, 0);
+  CHECK (read (fd, back, sizeof back) == sizeof back, "read \"log\"");
+  if (memcmp (back, buf, sizeof buf))
+    fail ("\"log\" does not read back as written");
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync) begin
+(fsync) create "log"
+(fsync) open "log"
+(fsync) write "log"
+(fsync) fsync "log"
+(fsync) overwrite "log"
+(fsync) fdatasync "log"
+(fsync) read "log"
+(fsync) end
+fsync: exit(0)
+EOF
+pass;
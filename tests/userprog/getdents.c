@@ -0,0 +1,53 @@
+/* Creates a few files and reads the root directory with
+   getdents(), two entries at a time, checking that each file
+   appears exactly once. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char *names[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+#define NAME_CNT (sizeof names / sizeof *names)
+
+void
+test_main (void)
+{
+  struct dirent entries[2];
+  int seen[NAME_CNT];
+  int dir_fd, file_fd, cnt, i;
+  size_t j;
+
+  for (j = 0; j < NAME_CNT; j++)
+    {
+      CHECK (create (names[j], 0), "create \"%s\"", names[j]);
+      seen[j] = 0;
+    }
+
+  CHECK ((dir_fd = open ("/")) > 1, "open \"/\"");
+  while ((cnt = getdents (dir_fd, entries, 2)) > 0)
+    {
+      if (cnt > 2)
+        fail ("getdents returned %d entries, asked for 2", cnt);
+      for (i = 0; i < cnt; i++)
+        for (j = 0; j < NAME_CNT; j++)
+          if (!strcmp (entries[i].name, names[j]))
+            {
+              if (entries[i].isdir)
+                fail ("\"%s\" is not a directory", names[j]);
+              seen[j]++;
+            }
+    }
+  if (cnt < 0)
+    fail ("getdents failed");
+  for (j = 0; j < NAME_CNT; j++)
+    if (seen[j] != 1)
+      fail ("\"%s\" seen %d times", names[j], seen[j]);
+  msg ("read every entry once");
+  CHECK (getdents (dir_fd, entries, 2) == 0, "getdents at end");
+  close (dir_fd);
+
+  CHECK ((file_fd = open ("alpha")) > 1, "open \"alpha\"");
+  CHECK (getdents (file_fd, entries, 2) == -1, "getdents on a file fails");
+  close (file_fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents) begin
+(getdents) create "alpha"
+(getdents) create "beta"
+(getdents) create "gamma"
+(getdents) create "delta"
+(getdents) create "epsilon"
+(getdents) open "/"
+(getdents) read every entry once
+(getdents) getdents at end
+(getdents) open "alpha"
+(getdents) getdents on a file fails
+(getdents) end
+getdents: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Reads the kernel statistics twice, writing to the console and
+   reading a file in between, and checks that the counters are
+   sane and moved forward. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[512];
+
+void
+test_main (void)
+{
+  struct kstat before, after;
+  int fd;
+
+  CHECK (kstat (&before) == sizeof before, "kstat");
+  if (before.version != KSTAT_VERSION)
+    fail ("version %u (should be %d)", before.version, KSTAT_VERSION);
+  if (before.size != sizeof before)
+    fail ("size %u (should be %zu)", before.size, sizeof before);
+  if (before.ticks == 0 || before.uptime_ns == 0)
+    fail ("no time has passed since boot");
+
+  msg ("write to the console and read a file");
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  read (fd, buf, sizeof buf);
+  close (fd);
+
+  CHECK (kstat (&after) == sizeof after, "kstat again");
+  if (after.uptime_ns <= before.uptime_ns)
+    fail ("uptime did not advance");
+  if (after.console_chars <= before.console_chars)
+    fail ("console output not counted");
+  if (after.cache_hits + after.cache_misses
+      <= before.cache_hits + before.cache_misses)
+    fail ("file read not counted by the buffer cache");
+  if (after.lock_acquires <= before.lock_acquires)
+    fail ("lock acquisitions not counted");
+}
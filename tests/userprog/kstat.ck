@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(kstat) begin
+(kstat) kstat
+(kstat) write to the console and read a file
+(kstat) open "sample.txt"
+(kstat) kstat again
+(kstat) end
+kstat: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Writes two pages through a pipe from a page-aligned buffer,
+   reads them back in pieces, and checks end of file once the
+   write end is closed and a short write once the read end is. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 8192
+
+static char out[SIZE] __attribute__ ((aligned (4096)));
+static char in[SIZE];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  size_t ofs;
+  int i;
+
+  for (i = 0; i < SIZE; i++)
+    out[i] = i * 7 + 3;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK (write (fds[1], out, SIZE) == SIZE, "write %d bytes", SIZE);
+  for (ofs = 0; ofs < SIZE; ofs += 1000)
+    {
+      int size = SIZE - ofs < 1000 ? SIZE - ofs : 1000;
+      if (read (fds[0], in + ofs, size) != size)
+        fail ("read at offset %zu failed", ofs);
+    }
+  if (memcmp (in, out, SIZE))
+    fail ("data read differs from data written");
+  msg ("read %d bytes", SIZE);
+  close (fds[1]);
+  CHECK (read (fds[0], in, 1) == 0, "read at end of file");
+  close (fds[0]);
+
+  CHECK (pipe (fds) == 0, "pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], out, 1) == 0, "write with no reader");
+  close (fds[1]);
+}
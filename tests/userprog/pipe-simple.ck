@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-simple) begin
+(pipe-simple) pipe
+(pipe-simple) write 8192 bytes
+(pipe-simple) read 8192 bytes
+(pipe-simple) read at end of file
+(pipe-simple) pipe
+(pipe-simple) write with no reader
+(pipe-simple) end
+pipe-simple: exit(0)
+EOF
+pass;
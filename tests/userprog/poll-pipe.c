@@ -0,0 +1,51 @@
+/* Polls the ends of a pipe: an empty pipe's read end times out
+   while its write end is ready, a write by another thread wakes
+   a poll that waits forever, closing the write end shows up as a
+   hangup, and a descriptor that is not open as invalid. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE];
+static int fds[2];
+
+static void
+writer (void *aux UNUSED) 
+{
+  write (fds[1], "x", 1);
+}
+
+void
+test_main (void) 
+{
+  struct pollfd p[2];
+  tid_t tid;
+  char c;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  p[0].fd = fds[0];
+  p[0].events = POLLIN;
+  p[1].fd = fds[1];
+  p[1].events = POLLOUT;
+  CHECK (poll (p, 2, 0) == 1 && p[0].revents == 0
+         && p[1].revents == POLLOUT, "poll empty pipe");
+  CHECK (poll (p, 1, 20) == 0, "poll read end times out");
+
+  CHECK ((tid = thread_create (writer, NULL, stack, STACK_SIZE))
+         != TID_ERROR, "thread_create");
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == POLLIN,
+         "poll wakes on write");
+  CHECK (thread_join (tid) == 0, "thread_join");
+  CHECK (read (fds[0], &c, 1) == 1 && c == 'x', "read");
+
+  close (fds[1]);
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == (POLLIN | POLLHUP),
+         "poll sees hangup");
+  close (fds[0]);
+  CHECK (poll (p, 1, 0) == 1 && p[0].revents == POLLNVAL,
+         "poll closed descriptor");
+}
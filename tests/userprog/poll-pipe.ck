@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) poll empty pipe
+(poll-pipe) poll read end times out
+(poll-pipe) thread_create
+(poll-pipe) poll wakes on write
+(poll-pipe) thread_join
+(poll-pipe) read
+(poll-pipe) poll sees hangup
+(poll-pipe) poll closed descriptor
+(poll-pipe) end
+poll-pipe: exit(0)
+EOF
+pass;
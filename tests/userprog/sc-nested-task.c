@@ -0,0 +1,19 @@
+/* Sets the nested task flag, which SYSENTER does not clear, and
+   makes a system call that blocks, so that the kernel switches
+   to another thread.  The kernel must not carry the flag into
+   that thread, whose return from an interrupt would then try a
+   task switch and fault. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* EFLAGS nested task flag. */
+#define FLAG_NT 0x4000
+
+void
+test_main (void) 
+{
+  asm volatile ("pushfl; orl %0, (%%esp); popfl" : : "i" (FLAG_NT));
+  CHECK (wait (exec ("child-simple")) == 81, "wait for child-simple");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sc-nested-task) begin
+(child-simple) run
+child-simple: exit(81)
+(sc-nested-task) wait for child-simple
+(sc-nested-task) end
+sc-nested-task: exit(0)
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Moves around a file with seek64() and tell64(), including to
+   an offset that does not fit in 32 bits, where nothing can be
+   written. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  unsigned long long far = 5ULL << 30;
+  char c = 'x';
+  int fd;
+
+  CHECK (create ("big", 0), "create \"big\"");
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+
+  seek64 (fd, far);
+  if (tell64 (fd) != far)
+    fail ("tell64 returned %llu, expected %llu", tell64 (fd), far);
+  msg ("seek64 past 4 GB");
+  CHECK (read (fd, &c, 1) == 0, "read past end of file");
+  CHECK (write (fd, &c, 1) == 0, "write past largest file");
+
+  seek64 (fd, 70000);
+  CHECK (write (fd, &c, 1) == 1, "write at 70000");
+  if (tell64 (fd) != 70001)
+    fail ("tell64 returned %llu, expected 70001", tell64 (fd));
+  CHECK (filesize (fd) == 70001, "filesize is 70001");
+  close (fd);
+}
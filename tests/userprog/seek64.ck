@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(seek64) begin
+(seek64) create "big"
+(seek64) open "big"
+(seek64) seek64 past 4 GB
+(seek64) read past end of file
+(seek64) write past largest file
+(seek64) write at 70000
+(seek64) filesize is 70001
+(seek64) end
+seek64: exit(0)
+EOF
+pass;
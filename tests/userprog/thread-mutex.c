@@ -0,0 +1,50 @@
+/* Starts several threads that each increment a shared counter
+   many times under a mutex, joins them, and checks that no
+   increment was lost. */
+
+#include <mutex.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 1000
+#define STACK_SIZE 4096
+
+static char stacks[THREAD_CNT][STACK_SIZE];
+static struct mutex counter_mutex = MUTEX_INITIALIZER;
+static volatile int counter;
+
+static void
+increment (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      int value;
+
+      mutex_lock (&counter_mutex);
+      value = counter;
+      counter = value + 1;
+      mutex_unlock (&counter_mutex);
+    }
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = thread_create (increment, NULL, stacks[i],
+                                     STACK_SIZE)) != TID_ERROR,
+           "thread_create %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (tids[i]) == 0, "thread_join %d", i);
+  CHECK (thread_join (tids[0]) == -1, "thread_join twice fails");
+  if (counter != THREAD_CNT * ITER_CNT)
+    fail ("counter is %d, not %d", counter, THREAD_CNT * ITER_CNT);
+  msg ("counter is %d", counter);
+}
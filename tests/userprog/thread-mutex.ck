@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-mutex) begin
+(thread-mutex) thread_create 0
+(thread-mutex) thread_create 1
+(thread-mutex) thread_create 2
+(thread-mutex) thread_create 3
+(thread-mutex) thread_join 0
+(thread-mutex) thread_join 1
+(thread-mutex) thread_join 2
+(thread-mutex) thread_join 3
+(thread-mutex) thread_join twice fails
+(thread-mutex) counter is 4000
+(thread-mutex) end
+thread-mutex: exit(0)
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Reads the kernel data page: checks that the tick count
+   advances, that its uptime agrees with uptime(), and that the
+   thread and process ids are those of the reader. */
+
+#include <syscall.h>
+#include <vdso.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE];
+static int child_tid;
+static int child_pid;
+
+static void
+record_ids (void *aux UNUSED) 
+{
+  child_tid = vdso_tid ();
+  child_pid = vdso_pid ();
+}
+
+void
+test_main (void) 
+{
+  unsigned long long before, now, after;
+  int64_t start;
+  tid_t tid;
+
+  CHECK (vdso_tick_freq () > 0, "tick frequency is set");
+
+  start = vdso_ticks ();
+  while (vdso_ticks () == start)
+    continue;
+  msg ("tick count advances");
+
+  uptime (&before);
+  now = vdso_uptime_ns ();
+  uptime (&after);
+  CHECK (now + 1000000 >= before && now <= after + 1000000,
+         "uptime agrees with uptime() to within 1 ms");
+
+  CHECK (vdso_tid () == vdso_pid (), "main thread's tid is the pid");
+  tid = thread_create (record_ids, NULL, stack, sizeof stack);
+  CHECK (tid != TID_ERROR, "thread_create");
+  CHECK (thread_join (tid) == 0, "thread_join");
+  CHECK (child_tid == tid, "thread sees its own tid");
+  CHECK (child_pid == vdso_pid (), "thread sees the same pid");
+}
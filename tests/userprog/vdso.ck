@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vdso) begin
+(vdso) tick frequency is set
+(vdso) tick count advances
+(vdso) uptime agrees with uptime() to within 1 ms
+(vdso) main thread's tid is the pid
+(vdso) thread_create
+(vdso) thread_join
+(vdso) thread sees its own tid
+(vdso) thread sees the same pid
+(vdso) end
+vdso: exit(0)
+EOF
+pass;
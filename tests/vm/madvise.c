@@ -0,0 +1,54 @@
+/* Maps a file with MAP_POPULATE and gives advice on it and on
+   ordinary memory.  Dropping a private page with MADV_DONTNEED
+   leaves zeros; dropping a page of the mapping leaves the file's
+   data. */
+
+#include <round.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+
+static char buf[3 * PAGE];
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char *page = (char *) ROUND_UP ((uintptr_t) buf, PAGE);
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap_flags (handle, actual, MAP_POPULATE)) != MAP_FAILED,
+         "mmap \"sample.txt\" with MAP_POPULATE");
+  CHECK (madvise (actual, PAGE, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  CHECK (madvise (actual, PAGE, MADV_DONTNEED) == 0, "madvise dontneed");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("mmap'd file lost its data");
+
+  memset (page, 'x', 2 * PAGE);
+  CHECK (madvise (page, PAGE, MADV_DONTNEED) == 0,
+         "madvise dontneed on private memory");
+  for (i = 0; i < PAGE; i++)
+    if (page[i] != 0)
+      fail ("byte %zu of dropped page has value %02hhx (should be 0)",
+            i, page[i]);
+  if (page[PAGE] != 'x')
+    fail ("page after the dropped one lost its data");
+
+  CHECK (madvise (page + 1, PAGE, MADV_RANDOM) == -1,
+         "madvise on misaligned address (must fail)");
+  CHECK (madvise (page, PAGE, 99) == -1,
+         "madvise with bad advice (must fail)");
+
+  munmap (map);
+  close (handle);
+}
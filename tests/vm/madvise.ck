@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt" with MAP_POPULATE
+(madvise) madvise sequential
+(madvise) madvise dontneed
+(madvise) madvise dontneed on private memory
+(madvise) madvise on misaligned address (must fail)
+(madvise) madvise with bad advice (must fail)
+(madvise) end
+madvise: exit(0)
+EOF
+pass;
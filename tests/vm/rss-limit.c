@@ -0,0 +1,42 @@
+/* Limits the process to a few resident pages, then writes a
+   buffer several times that size.  The process must stay within
+   its limit by swapping out its own pages, and read back what it
+   wrote. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define LIMIT 16
+#define BUF_PAGES (4 * LIMIT)
+
+static char buf[BUF_PAGES * PAGE];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  size_t i;
+
+  CHECK (rss_limit (LIMIT) == 0, "limit to %d resident pages", LIMIT);
+  for (i = 0; i < BUF_PAGES; i++)
+    memset (buf + i * PAGE, i, PAGE);
+
+  vmstat (&st);
+  if (st.rss_limit != LIMIT)
+    fail ("vmstat reports limit %u (should be %d)", st.rss_limit, LIMIT);
+  if (st.resident > LIMIT)
+    fail ("%u pages resident, over the limit", st.resident);
+  if (st.swapped == 0)
+    fail ("nothing swapped out");
+  msg ("stayed within the limit");
+
+  for (i = 0; i < BUF_PAGES; i++)
+    if (buf[i * PAGE] != (char) i || buf[i * PAGE + PAGE - 1] != (char) i)
+      fail ("page %zu has bad data", i);
+  msg ("read back");
+
+  CHECK (rss_limit (0) == LIMIT, "lift the limit");
+}
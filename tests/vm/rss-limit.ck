@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rss-limit) begin
+(rss-limit) limit to 16 resident pages
+(rss-limit) stayed within the limit
+(rss-limit) read back
+(rss-limit) lift the limit
+(rss-limit) end
+rss-limit: exit(0)
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Creates a shared memory segment, attaches it, and forks.  The
+   child's write to the segment is seen by the parent, unlike its
+   write to ordinary memory, and the segment keeps its contents
+   across a detach and attach. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE 4096
+
+static char private[16] = "parent";
+
+void
+test_main (void)
+{
+  pid_t pid;
+  int id;
+
+  CHECK ((id = shm_create (2 * PAGE)) >= 0, "shm_create");
+  CHECK (shm_attach (id, ACTUAL), "shm_attach");
+  if (ACTUAL[0] != 0 || ACTUAL[2 * PAGE - 1] != 0)
+    fail ("new segment is not zeroed");
+  strlcpy (ACTUAL, "parent", PAGE);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (strcmp (ACTUAL, "parent"))
+        exit (1);
+      strlcpy (ACTUAL + PAGE, "child", PAGE);
+      strlcpy (private, "child", sizeof private);
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork");
+  if (wait (pid) != 0)
+    fail ("child did not see the parent's write");
+  if (strcmp (ACTUAL + PAGE, "child"))
+    fail ("child's write to the segment not seen");
+  if (strcmp (private, "parent"))
+    fail ("child's write to private memory seen");
+  msg ("child's write seen");
+
+  CHECK (shm_detach (ACTUAL), "shm_detach");
+  CHECK (!shm_detach (ACTUAL), "shm_detach again");
+  CHECK (shm_attach (id, ACTUAL), "shm_attach again");
+  if (strcmp (ACTUAL, "parent") || strcmp (ACTUAL + PAGE, "child"))
+    fail ("segment contents lost");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-fork) begin
+(shm-fork) shm_create
+(shm-fork) shm_attach
+shm-fork: exit(0)
+(shm-fork) child's write seen
+(shm-fork) shm_detach
+(shm-fork) shm_detach again
+(shm-fork) shm_attach again
+(shm-fork) end
+shm-fork: exit(0)
+EOF
+pass;
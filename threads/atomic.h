@@ -0,0 +1,59 @@
+#ifndef THREADS_ATOMIC_H
+#define THREADS_ATOMIC_H
+
+#include <stdbool.h>
+
+/* Atomic operations on int variables.
+ *
+ * Each is one x86 instruction with a `lock' prefix (implied for
+ * xchg), so it cannot be split by an interrupt on this CPU nor
+ * interleaved with another CPU's access, and it is a full memory
+ * barrier.  Use them for counters and reference counts that
+ * would otherwise need a lock, or interrupts off, only for a
+ * read-modify-write. */
+
+/* Adds DELTA to *P and returns the previous value of *P. */
+static inline int
+atomic_fetch_add(int *p, int delta)
+{
+    asm volatile ("lock xaddl %0, %1"
+                  : "+r" (delta), "+m" (*p) : : "memory");
+    return delta;
+}
+
+/* Sets *P to NEW if it equals OLD.  Returns the previous value of
+ * *P, which equals OLD if the exchange took place. */
+static inline int
+atomic_cmpxchg(int *p, int old, int new)
+{
+    int prev;
+
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*p) : "r" (new), "0" (old)
+                  : "memory");
+    return prev;
+}
+
+/* Sets *P to NEW and returns the previous value of *P. */
+static inline int
+atomic_xchg(int *p, int new)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+    return new;
+}
+
+/* Increments *P. */
+static inline void
+atomic_inc(int *p)
+{
+    atomic_fetch_add(p, 1);
+}
+
+/* Decrements *P and returns true if that made it 0. */
+static inline bool
+atomic_dec_and_test(int *p)
+{
+    return atomic_fetch_add(p, -1) == 1;
+}
+
+#endif /* threads/atomic.h */
@@ -0,0 +1,239 @@
+#include "threads/cfs.h"
+#include <debug.h>
+#include <rbtree.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Fair-share scheduler, selected with -cfs.
+ *
+ * Each thread has a virtual runtime: the CPU time it has used,
+ * in cycles, divided by its weight relative to a thread of nice
+ * 0.  Weights fall by about a fifth per step of nice, so a
+ * thread's share of the CPU is its weight over the total weight
+ * of the runnable threads.  Ready threads are kept in a
+ * red-black tree ordered by virtual runtime, and the one that
+ * has had the least runs next.
+ *
+ * Instead of a fixed time slice, the running thread gets a share
+ * of the target latency in proportion to its weight, but at
+ * least one tick.  Every runnable thread thus gets a turn within
+ * the target latency unless there are more than it has ticks.
+ *
+ * MIN_VRUNTIME follows the least virtual runtime of the ready
+ * and running threads, without ever going back.  New threads
+ * start there, and a thread that wakes up from a long sleep is
+ * brought up to half a target latency behind it, so that it runs
+ * soon but cannot claim the whole CPU for the time it slept.
+ *
+ * Priorities play no part in choosing a thread. */
+
+/* Target latency, in milliseconds. */
+#define CFS_LATENCY_MS 40
+
+/* Weight of a thread of nice 0. */
+#define NICE_0_WEIGHT 1024
+
+/* Weight for each nice value from NICE_MIN to NICE_MAX. */
+static const unsigned nice_weights[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+};
+
+static struct rbtree run_tree;  /* Ready threads, by virtual runtime. */
+static unsigned long run_load;  /* Total weight of threads in run_tree. */
+static uint64_t min_vruntime;   /* Floor for new and waking threads. */
+
+static rb_less_func vruntime_less;
+static unsigned weight(const struct thread *);
+static unsigned latency_ticks(void);
+static uint64_t cycles_per_tick(void);
+static struct thread *leftmost(void);
+static void update_min_vruntime(const struct thread *cur);
+
+/* Initializes the run queue. */
+void
+cfs_init(void)
+{
+    rb_init(&run_tree, vruntime_less, NULL);
+}
+
+/* Initializes new thread T, created by PARENT, or by no thread
+ * if PARENT is null.  T inherits PARENT's nice value and starts
+ * at the current minimum virtual runtime. */
+void
+cfs_fork(struct thread *t, const struct thread *parent)
+{
+    if (parent != NULL) {
+        t->nice = parent->nice;
+    }
+    t->vruntime = min_vruntime;
+    t->exec_start = timer_cycles();
+}
+
+/* Adds T to the run queue.  If T is the running thread, it is
+ * first charged for the time it has run; otherwise it is just
+ * waking up or starting, and its virtual runtime is raised to
+ * no less than half a target latency behind MIN_VRUNTIME. */
+void
+cfs_enqueue(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (t->status == THREAD_RUNNING) {
+        cfs_charge(t);
+    } else {
+        uint64_t credit = latency_ticks() * cycles_per_tick() / 2;
+        uint64_t floor = min_vruntime > credit ? min_vruntime - credit : 0;
+
+        if (t->vruntime < floor) {
+            t->vruntime = floor;
+        }
+    }
+    rb_insert(&run_tree, &t->cfs_elem);
+    run_load += weight(t);
+}
+
+/* Removes T from the run queue. */
+void
+cfs_dequeue(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    rb_remove(&run_tree, &t->cfs_elem);
+    run_load -= weight(t);
+}
+
+/* Removes and returns the ready thread with the least virtual
+ * runtime, or returns a null pointer if no thread is ready. */
+struct thread *
+cfs_pick_next(void)
+{
+    struct thread *t = leftmost();
+
+    if (t != NULL) {
+        cfs_dequeue(t);
+        update_min_vruntime(t);
+    }
+    return t;
+}
+
+/* Adds the time running thread T has run since it was last
+ * charged, weighted by its nice value, to its virtual runtime.
+ * T must not be in the run queue, whose order depends on it. */
+void
+cfs_charge(struct thread *t)
+{
+    uint64_t now = timer_cycles();
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    t->vruntime += (now - t->exec_start) * NICE_0_WEIGHT / weight(t);
+    t->exec_start = now;
+    update_min_vruntime(t);
+}
+
+/* Starts running T and returns the number of ticks it may run
+ * before it is preempted: its share of the target latency,
+ * but at least 1. */
+unsigned
+cfs_start(struct thread *t)
+{
+    unsigned w = weight(t);
+    unsigned slice;
+
+    t->exec_start = timer_cycles();
+    slice = latency_ticks() * w / (run_load + w);
+    return slice > 0 ? slice : 1;
+}
+
+/* Returns true if running thread CUR should give way to the
+ * ready thread with the least virtual runtime, because that
+ * thread is behind CUR by more than a tick's worth of running.
+ * The margin keeps a thread that wakes up often from preempting
+ * one that does not at every turn. */
+bool
+cfs_should_preempt(struct thread *cur)
+{
+    struct thread *t = leftmost();
+
+    if (t == NULL) {
+        return false;
+    }
+    cfs_charge(cur);
+    return t->vruntime + cycles_per_tick() < cur->vruntime;
+}
+
+/* Orders threads by virtual runtime, then by tid, since keys in
+ * the tree must be unique. */
+static bool
+vruntime_less(const struct rb_elem *a_, const struct rb_elem *b_,
+              void *aux UNUSED)
+{
+    const struct thread *a = rb_entry(a_, struct thread, cfs_elem);
+    const struct thread *b = rb_entry(b_, struct thread, cfs_elem);
+
+    if (a->vruntime != b->vruntime) {
+        return a->vruntime < b->vruntime;
+    }
+    return a->tid < b->tid;
+}
+
+/* Returns T's weight. */
+static unsigned
+weight(const struct thread *t)
+{
+    ASSERT(NICE_MIN <= t->nice && t->nice <= NICE_MAX);
+
+    return nice_weights[t->nice - NICE_MIN];
+}
+
+/* Returns the target latency in timer ticks, at least 1. */
+static unsigned
+latency_ticks(void)
+{
+    unsigned ticks = TIMER_FREQ * CFS_LATENCY_MS / 1000;
+
+    return ticks > 0 ? ticks : 1;
+}
+
+/* Returns the number of CPU cycles in a timer tick, or 0 before
+ * the timer is calibrated. */
+static uint64_t
+cycles_per_tick(void)
+{
+    return timer_cycles_per_sec() / TIMER_FREQ;
+}
+
+/* Returns the ready thread with the least virtual runtime, or a
+ * null pointer if no thread is ready. */
+static struct thread *
+leftmost(void)
+{
+    struct rb_elem *e = rb_first(&run_tree);
+
+    return e != NULL ? rb_entry(e, struct thread, cfs_elem) : NULL;
+}
+
+/* Advances MIN_VRUNTIME to the lesser of running thread CUR's
+ * virtual runtime and that of the first ready thread. */
+static void
+update_min_vruntime(const struct thread *cur)
+{
+    struct thread *t = leftmost();
+    uint64_t v = cur->vruntime;
+
+    if (t != NULL && t->vruntime < v) {
+        v = t->vruntime;
+    }
+    if (v > min_vruntime) {
+        min_vruntime = v;
+    }
+}
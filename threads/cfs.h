@@ -0,0 +1,20 @@
+#ifndef THREADS_CFS_H
+#define THREADS_CFS_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Fair-share scheduler, used instead of the priority run queues
+ * when thread_cfs is true.  All of these must be called with
+ * interrupts off, and never for the idle thread. */
+void cfs_init(void);
+void cfs_fork(struct thread *, const struct thread *parent);
+void cfs_enqueue(struct thread *);
+void cfs_dequeue(struct thread *);
+struct thread *cfs_pick_next(void);
+void cfs_charge(struct thread *);
+unsigned cfs_start(struct thread *);
+bool cfs_should_preempt(struct thread *);
+
+#endif /* threads/cfs.h */
@@ -0,0 +1,367 @@
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/tss.h"
+#endif
+
+/* Finds the machine's processors through the tables that the
+ * BIOS leaves in low memory as described by the Intel
+ * MultiProcessor Specification, version 1.4, cited as [MP]
+ * below.  QEMU and Bochs both provide them, and starts the
+ * application processors, the ones other than the processor that
+ * booted the machine.
+ *
+ * An application processor gets its own idle thread, on whose
+ * stack it runs, its own TSS, and the shared GDT and IDT, then
+ * halts with interrupts off.  Semaphores and locks are already
+ * safe against other processors, through the spinlock in each
+ * semaphore, but the scheduler, the interrupt bookkeeping, and
+ * the allocators still rely on interrupts being off on the one
+ * processor that runs threads, so no thread runs anywhere else
+ * yet. */
+
+/* MP floating pointer structure, [MP] 4.1. */
+struct mp_fp {
+    char signature[4];    /* "_MP_". */
+    uint32_t config;      /* Physical address of configuration table. */
+    uint8_t length;       /* Length in 16-byte units, always 1. */
+    uint8_t spec_rev;     /* Specification revision. */
+    uint8_t checksum;     /* Makes all the bytes sum to 0. */
+    uint8_t default_type; /* Nonzero for a default configuration. */
+    uint8_t features[4];  /* Other feature bytes. */
+} PACKED;
+
+/* MP configuration table header, [MP] 4.2. */
+struct mp_config {
+    char signature[4];    /* "PCMP". */
+    uint16_t length;      /* Length of header and base entries. */
+    uint8_t spec_rev;     /* Specification revision. */
+    uint8_t checksum;     /* Makes the LENGTH bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;   /* Number of entries after the header. */
+    uint32_t lapic;       /* Physical address of the local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} PACKED;
+
+/* Configuration table entry types, and their sizes. */
+#define MP_PROCESSOR 0          /* Processor, 20 bytes. */
+#define MP_IOAPIC    2          /* I/O APIC, 8 bytes. */
+#define MP_PROCESSOR_SIZE 20
+#define MP_OTHER_SIZE 8         /* Bus and interrupt assignments. */
+
+/* Processor entry, [MP] 4.3.1. */
+struct mp_processor {
+    uint8_t type;         /* MP_PROCESSOR. */
+    uint8_t apic_id;      /* Local APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;        /* MP_CPU_* flags. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} PACKED;
+
+#define MP_CPU_ENABLED 0x01     /* Usable. */
+#define MP_CPU_BSP     0x02     /* The bootstrap processor. */
+
+/* I/O APIC entry, [MP] 4.3.3. */
+struct mp_ioapic {
+    uint8_t type;         /* MP_IOAPIC. */
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;        /* Bit 0 set if usable. */
+    uint32_t addr;        /* Physical address of registers. */
+} PACKED;
+
+/* Where the APICs are in a default configuration, [MP] 5. */
+#define DEFAULT_LAPIC  0xfee00000
+#define DEFAULT_IOAPIC 0xfec00000
+
+/* Global pages, in control register 4. */
+#define CR4_PGE 0x00000080
+
+/* How long to wait for an application processor to start, in
+ * milliseconds. */
+#define AP_START_MS 100
+
+/* Startup code in ap-start.S, copied to AP_START, and the
+ * parameters in it, at AP_PARAMS within the code. */
+extern const uint8_t ap_start[], ap_params[], ap_start_end[];
+
+/* Filled in by cpu_start() for each application processor in turn
+ * before it starts, in the copy at AP_START. */
+struct ap_params {
+    uint32_t cr0;        /* Control registers to switch to, */
+    uint32_t cr3;        /* ...with CR3 the page directory that */
+    uint32_t cr4;        /* ...also maps the code at AP_START. */
+    void *esp;           /* Top of the idle thread's stack. */
+    struct cpu *cpu;     /* Argument for ap_main(). */
+};
+
+/* The bootstrap processor's CR4, for ap_main() to copy. */
+static uint32_t bsp_cr4;
+
+struct cpu cpus[CPU_MAX];
+size_t cpu_cnt;
+uintptr_t lapic_paddr;
+uintptr_t ioapic_paddr;
+
+static const struct mp_fp *find_fp(void);
+static const struct mp_fp *scan_fp(uintptr_t paddr, size_t size);
+static bool checksum_ok(const void *, size_t size);
+static void read_config(const struct mp_config *);
+static void add_cpu(uint8_t apic_id, bool bsp);
+static bool start_ap(struct cpu *, struct ap_params *);
+void ap_main(struct cpu *) NO_RETURN;
+
+/* Finds the processors and APICs.  Without MP tables, the machine
+ * is taken to have just the processor that booted it, and no
+ * APICs. */
+void
+cpu_init(void)
+{
+    const struct mp_fp *fp = find_fp();
+
+    if (fp == NULL) {
+        add_cpu(0, true);
+    } else if (fp->default_type != 0 || fp->config == 0) {
+        /* Every default configuration has two processors. */
+        add_cpu(0, true);
+        add_cpu(1, false);
+        lapic_paddr = DEFAULT_LAPIC;
+        ioapic_paddr = DEFAULT_IOAPIC;
+    } else {
+        read_config(ptov(fp->config));
+    }
+}
+
+/* Starts the application processors one at a time and reports how
+ * many processors are running.  Must run after timer_calibrate(),
+ * since starting a processor takes timed delays, and with
+ * interrupts on. */
+void
+cpu_start(void)
+{
+    struct ap_params *params;
+    uint32_t *pd;
+    uint32_t cr0;
+    size_t started = 1;
+    size_t i;
+
+    if (cpu_cnt < 2) {
+        return;
+    }
+    if (!lapic_init()) {
+        printf("%zu processors found, but no local APIC to start them.\n",
+               cpu_cnt);
+        return;
+    }
+
+    /* A processor turns on paging while it is still running at
+     * AP_START, so it starts on a copy of the kernel's page
+     * directory that also maps the first 4 MB at address 0.  Its
+     * CR4 leaves global pages off until it is on init_page_dir, so
+     * that none of those low mappings outlive the copy. */
+    pd = palloc_get_page(PAL_ASSERT);
+    memcpy(pd, init_page_dir, PGSIZE);
+    pd[0] = pd[pd_no(PHYS_BASE)];
+
+    memcpy(ptov(AP_START), ap_start, ap_start_end - ap_start);
+    params = ptov(AP_START + (ap_params - ap_start));
+    asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+    asm volatile ("movl %%cr4, %0" : "=r" (bsp_cr4));
+    params->cr0 = cr0;
+    params->cr3 = vtop(pd);
+    params->cr4 = bsp_cr4 & ~CR4_PGE;
+
+    for (i = 0; i < cpu_cnt; i++) {
+        if (!cpus[i].bsp) {
+            if (start_ap(&cpus[i], params)) {
+                started++;
+            } else {
+                /* It might yet start, and read the parameters meant
+                 * for the next one. */
+                printf("Processor %zu did not start.\n", i);
+                break;
+            }
+        }
+    }
+    palloc_free_page(pd);
+    printf("%zu of %zu processors started.\n", started, cpu_cnt);
+}
+
+/* Returns the MP floating pointer structure, or a null pointer
+ * if there is none.  It is in the first kilobyte of the extended
+ * BIOS data area, in the last kilobyte of base memory, or in the
+ * BIOS ROM, [MP] 4. */
+static const struct mp_fp *
+find_fp(void)
+{
+    const uint16_t *bda = ptov(0x400);
+    uintptr_t ebda = (uintptr_t)bda[0x0e / 2] << 4;
+    uintptr_t base_end = (uintptr_t)bda[0x13 / 2] * 1024;
+    const struct mp_fp *fp = NULL;
+
+    if (ebda != 0) {
+        fp = scan_fp(ebda, 1024);
+    }
+    if (fp == NULL && base_end >= 1024) {
+        fp = scan_fp(base_end - 1024, 1024);
+    }
+    if (fp == NULL) {
+        fp = scan_fp(0xf0000, 0x10000);
+    }
+    return fp;
+}
+
+/* Returns a valid MP floating pointer structure in the SIZE
+ * bytes of physical memory at PADDR, or a null pointer. */
+static const struct mp_fp *
+scan_fp(uintptr_t paddr, size_t size)
+{
+    const struct mp_fp *fp;
+
+    if (paddr + size > init_ram_pages * PGSIZE) {
+        return NULL;
+    }
+    for (fp = ptov(paddr); (uintptr_t)fp < (uintptr_t)ptov(paddr + size);
+         fp++) {
+        if (!memcmp(fp->signature, "_MP_", 4)
+            && fp->length == 1 && checksum_ok(fp, sizeof *fp)) {
+            return fp;
+        }
+    }
+    return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0, modulo 256. */
+static bool
+checksum_ok(const void *p_, size_t size)
+{
+    const uint8_t *p = p_;
+    uint8_t sum = 0;
+
+    while (size-- > 0) {
+        sum += *p++;
+    }
+    return sum == 0;
+}
+
+/* Records the processors and APICs listed in configuration table
+ * CONFIG. */
+static void
+read_config(const struct mp_config *config)
+{
+    const uint8_t *entry, *end;
+    size_t i;
+
+    if (memcmp(config->signature, "PCMP", 4)
+        || !checksum_ok(config, config->length)) {
+        add_cpu(0, true);
+        return;
+    }
+    lapic_paddr = config->lapic;
+
+    entry = (const uint8_t *)(config + 1);
+    end = (const uint8_t *)config + config->length;
+    for (i = 0; i < config->entry_cnt && entry < end; i++) {
+        if (*entry == MP_PROCESSOR) {
+            const struct mp_processor *p = (const void *)entry;
+
+            if (p->flags & MP_CPU_ENABLED) {
+                add_cpu(p->apic_id, (p->flags & MP_CPU_BSP) != 0);
+            }
+            entry += MP_PROCESSOR_SIZE;
+        } else {
+            const struct mp_ioapic *io = (const void *)entry;
+
+            if (*entry == MP_IOAPIC && (io->flags & 1)
+                && ioapic_paddr == 0) {
+                ioapic_paddr = io->addr;
+            }
+            entry += MP_OTHER_SIZE;
+        }
+    }
+    if (cpu_cnt == 0) {
+        add_cpu(0, true);
+    }
+}
+
+/* Gives application processor CPU an idle thread and a TSS, and
+ * starts it with PARAMS.  Returns true if it started within
+ * AP_START_MS. */
+static bool
+start_ap(struct cpu *cpu, struct ap_params *params)
+{
+    char name[16];
+    int ms;
+
+    snprintf(name, sizeof name, "idle%zu", (size_t) (cpu - cpus));
+    cpu->idle = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    thread_init_idle(cpu->idle, name);
+#ifdef USERPROG
+    cpu->tss = tss_create((uint8_t *) cpu->idle + PGSIZE);
+#endif
+
+    params->esp = (uint8_t *) cpu->idle + PGSIZE;
+    params->cpu = cpu;
+    barrier();
+    lapic_start_ap(cpu->apic_id, AP_START);
+    for (ms = 0; ms < AP_START_MS && !cpu->started; ms++) {
+        timer_mdelay(1);
+    }
+    return cpu->started;
+}
+
+/* Called by ap-start.S on application processor CPU, running on
+ * its idle thread's stack with interrupts off.  Finishes setting
+ * the processor up, then halts it for good. */
+void
+ap_main(struct cpu *cpu)
+{
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop(init_page_dir)));
+    asm volatile ("movl %0, %%cr4" : : "r" (bsp_cr4));
+    ASSERT(thread_current() == cpu->idle);
+    ASSERT(lapic_id() == cpu->apic_id);
+
+#ifdef USERPROG
+    gdt_init_ap(cpu - cpus, cpu->tss);
+#endif
+    intr_init_ap();
+    lapic_init_ap();
+    cpu->started = true;
+
+    for (;;) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+/* Records a processor, unless CPU_MAX already have been. */
+static void
+add_cpu(uint8_t apic_id, bool bsp)
+{
+    if (cpu_cnt < CPU_MAX) {
+        cpus[cpu_cnt].apic_id = apic_id;
+        cpus[cpu_cnt].bsp = bsp;
+        cpu_cnt++;
+    }
+}
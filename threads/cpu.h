@@ -0,0 +1,65 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+/* Physical address at which the application processors start, in
+ * real mode.  It must be page-aligned and below 1 MB, and this
+ * page is free: palloc leaves the first megabyte alone, and the
+ * initial thread and the loader are in pages 0xe000 and 0x7000. */
+#define AP_START 0x6000
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most processors recorded by cpu_init(). */
+#define CPU_MAX 8
+
+/* A processor described by the firmware.
+ *
+ * There is no per-CPU pointer to the running thread: as on the
+ * bootstrap processor, running_thread() finds it by rounding the
+ * stack pointer down, and each processor runs on its own stack. */
+struct cpu {
+    uint8_t apic_id;       /* Local APIC ID. */
+    bool bsp;              /* The bootstrap processor? */
+    volatile bool started; /* Set by the processor once it runs. */
+    struct thread *idle;   /* Its idle thread, or null for the BSP. */
+#ifdef USERPROG
+    struct tss *tss;       /* Its TSS, or null for the BSP. */
+#endif
+};
+
+/* The machine's processors and interrupt controllers, as found by
+ * cpu_init().  cpu_start() starts the application processors, but
+ * they only idle: threads are scheduled on the bootstrap processor
+ * alone. */
+extern struct cpu cpus[CPU_MAX];
+extern size_t cpu_cnt;
+extern uintptr_t lapic_paddr;  /* Local APIC registers, or 0. */
+extern uintptr_t ioapic_paddr; /* First I/O APIC's registers, or 0. */
+
+void cpu_init(void);
+void cpu_start(void);
+
+/* CPUID leaf 1 EDX feature bits.  See [IA32-v2a] "CPUID--CPU
+ * Identification". */
+#define CPUID_PSE  (1u << 3)  /* 4 MB pages. */
+#define CPUID_APIC (1u << 9)  /* Local APIC. */
+#define CPUID_SEP  (1u << 11) /* SYSENTER and SYSEXIT. */
+#define CPUID_PGE  (1u << 13) /* Global pages. */
+#define CPUID_FXSR (1u << 24) /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE  (1u << 25) /* SSE. */
+
+/* Returns the CPUID_* feature bits of the running processor. */
+static inline uint32_t
+cpuid_features(void)
+{
+    uint32_t features;
+
+    asm ("cpuid" : "=d" (features) : "a" (1) : "ebx", "ecx");
+    return features;
+}
+#endif /* __ASSEMBLER__ */
+
+#endif /* threads/cpu.h */
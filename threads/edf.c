@@ -0,0 +1,234 @@
+#include "threads/edf.h"
+#include <debug.h>
+#include <rbtree.h>
+#include <round.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Earliest-deadline-first scheduling, for kernel threads with
+ * periodic work to finish on time.
+ *
+ * A thread joins with thread_set_deadline(PERIOD, BUDGET): in
+ * every period of PERIOD ticks, starting now, it may run for
+ * BUDGET ticks, and the end of the period is its deadline.
+ * While it has budget left, it is in the EDF class, whose ready
+ * threads all run before any thread in the priority or
+ * fair-share run queues, earliest deadline first.  A thread that
+ * uses up its budget drops back to the ordinary run queues until
+ * its next period starts, so it cannot take more than it was
+ * admitted for.
+ *
+ * On one CPU, EDF meets every deadline as long as the total
+ * utilization, the sum of BUDGET / PERIOD over the EDF threads,
+ * is at most 1.  A thread is admitted only if the total stays
+ * within EDF_UTIL_MAX, which leaves some time over for ordinary
+ * threads and for interrupt handling. */
+
+/* Most total utilization admitted, in thousandths. */
+#define EDF_UTIL_MAX 900
+
+static struct rbtree edf_tree;  /* Ready EDF threads, by deadline. */
+static int edf_util;            /* Admitted utilization, in thousandths. */
+
+static rb_less_func deadline_less;
+static timer_func replenish_timeout;
+static int utilization(int64_t period, int64_t budget);
+static struct thread *earliest(void);
+
+/* Initializes the EDF run queue. */
+void
+edf_init(void)
+{
+    rb_init(&edf_tree, deadline_less, NULL);
+}
+
+/* Admits running thread T to the EDF class with PERIOD and
+ * BUDGET, or changes them if it is already in it, and starts its
+ * first period now.  Returns false, changing nothing, if the
+ * total utilization would exceed EDF_UTIL_MAX. */
+bool
+edf_admit(struct thread *t, int64_t period, int64_t budget)
+{
+    int old_util, new_util;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(0 < budget && budget <= period);
+    ASSERT(!t->edf_queued);
+
+    old_util = t->edf_period != 0 ? utilization(t->edf_period,
+                                                t->edf_budget) : 0;
+    new_util = utilization(period, budget);
+    if (edf_util - old_util + new_util > EDF_UTIL_MAX) {
+        return false;
+    }
+    edf_util += new_util - old_util;
+
+    if (t->edf_period == 0) {
+        timeout_init(&t->edf_timeout, replenish_timeout, t);
+    }
+    t->edf_period = period;
+    t->edf_budget = budget;
+    t->edf_remaining = budget;
+    t->edf_deadline = timer_ticks() + period;
+    timer_add(&t->edf_timeout, period);
+    return true;
+}
+
+/* Takes T, which must not be ready, out of the EDF class, if it
+ * is in it. */
+void
+edf_leave(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(!t->edf_queued);
+
+    if (t->edf_period == 0) {
+        return;
+    }
+    timer_cancel(&t->edf_timeout);
+    edf_util -= utilization(t->edf_period, t->edf_budget);
+    t->edf_period = 0;
+    t->edf_remaining = 0;
+}
+
+/* Starts T's next period, with its full budget and the period's
+ * end as its deadline.  If the timer ran late, the period starts
+ * now instead, rather than with a deadline already past.  T must
+ * not be in the EDF run queue, whose order depends on it; use
+ * thread_replenish(). */
+void
+edf_replenish(struct thread *t)
+{
+    int64_t now = timer_ticks();
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(!t->edf_queued);
+
+    t->edf_deadline += t->edf_period;
+    if (t->edf_deadline <= now) {
+        t->edf_deadline = now + t->edf_period;
+    }
+    t->edf_remaining = t->edf_budget;
+    timer_add(&t->edf_timeout, t->edf_deadline - now);
+}
+
+/* Returns true if T is in the EDF class and has budget left. */
+bool
+edf_active(const struct thread *t)
+{
+    return t->edf_period != 0 && t->edf_remaining > 0;
+}
+
+/* Charges a timer tick to running thread T.  Returns true if that
+ * used up the last of T's budget, so that it must yield. */
+bool
+edf_charge_tick(struct thread *t)
+{
+    return edf_active(t) && --t->edf_remaining == 0;
+}
+
+/* Adds T, which must be active, to the EDF run queue. */
+void
+edf_enqueue(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(edf_active(t));
+
+    rb_insert(&edf_tree, &t->edf_elem);
+    t->edf_queued = true;
+}
+
+/* Removes T from the EDF run queue. */
+void
+edf_dequeue(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(t->edf_queued);
+
+    rb_remove(&edf_tree, &t->edf_elem);
+    t->edf_queued = false;
+}
+
+/* Returns true if T is in the EDF run queue. */
+bool
+edf_queued(const struct thread *t)
+{
+    return t->edf_queued;
+}
+
+/* Removes and returns the ready EDF thread with the earliest
+ * deadline, or returns a null pointer if there is none. */
+struct thread *
+edf_pick_next(void)
+{
+    struct thread *t = earliest();
+
+    if (t != NULL) {
+        edf_dequeue(t);
+    }
+    return t;
+}
+
+/* Returns true if a ready EDF thread should preempt running
+ * thread CUR: always if CUR is not an active EDF thread,
+ * otherwise if the ready thread's deadline is earlier. */
+bool
+edf_should_preempt(const struct thread *cur)
+{
+    struct thread *t = earliest();
+
+    if (t == NULL) {
+        return false;
+    }
+    return !edf_active(cur) || t->edf_deadline < cur->edf_deadline;
+}
+
+/* Runs at the end of each of thread T_'s periods to start the
+ * next, moving T_ into the EDF run queue if it ran out of budget
+ * and is waiting in an ordinary one. */
+static void
+replenish_timeout(void *t_)
+{
+    struct thread *t = t_;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    if (t->edf_period != 0) {
+        thread_replenish(t);
+        thread_yield_to_higher();
+    }
+    intr_set_level(old_level);
+}
+
+/* Orders threads by deadline, then by tid, since keys in the tree
+ * must be unique. */
+static bool
+deadline_less(const struct rb_elem *a_, const struct rb_elem *b_,
+              void *aux UNUSED)
+{
+    const struct thread *a = rb_entry(a_, struct thread, edf_elem);
+    const struct thread *b = rb_entry(b_, struct thread, edf_elem);
+
+    if (a->edf_deadline != b->edf_deadline) {
+        return a->edf_deadline < b->edf_deadline;
+    }
+    return a->tid < b->tid;
+}
+
+/* Returns BUDGET / PERIOD in thousandths, rounded up. */
+static int
+utilization(int64_t period, int64_t budget)
+{
+    return DIV_ROUND_UP(budget * 1000, period);
+}
+
+/* Returns the ready EDF thread with the earliest deadline, or a
+ * null pointer if there is none. */
+static struct thread *
+earliest(void)
+{
+    struct rb_elem *e = rb_first(&edf_tree);
+
+    return e != NULL ? rb_entry(e, struct thread, edf_elem) : NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef THREADS_EDF_H
+#define THREADS_EDF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Earliest-deadline-first scheduling class, ahead of the
+ * priority and fair-share run queues.  All of these must be
+ * called with interrupts off. */
+void edf_init(void);
+bool edf_admit(struct thread *, int64_t period, int64_t budget);
+void edf_leave(struct thread *);
+void edf_replenish(struct thread *);
+bool edf_active(const struct thread *);
+bool edf_charge_tick(struct thread *);
+
+void edf_enqueue(struct thread *);
+void edf_dequeue(struct thread *);
+bool edf_queued(const struct thread *);
+struct thread *edf_pick_next(void);
+bool edf_should_preempt(const struct thread *);
+
+#endif /* threads/edf.h */
@@ -0,0 +1,71 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the
+ * multi-level feedback queue scheduler.  A fixed_point_t holds
+ * 17 integer bits and 14 fractional bits, so it represents
+ * values in roughly [-131072, 131072) with a resolution of
+ * 1/16384.
+ *
+ * Pintos has no floating point in the kernel, so every
+ * computation involving fractional values goes through these
+ * functions.  Products and quotients of two fixed-point values
+ * are computed in 64 bits to avoid overflowing the intermediate
+ * result. */
+typedef int32_t fixed_point_t;
+
+#define FP_SHIFT 14              /* Number of fractional bits. */
+#define FP_ONE   (1 << FP_SHIFT) /* 1.0 in fixed point. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_point_t
+fp_from_int(int n)
+{
+    return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_to_int(fixed_point_t x)
+{
+    return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round(fixed_point_t x)
+{
+    return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_point_t
+fp_add_int(fixed_point_t x, int n)
+{
+    return x + n * FP_ONE;
+}
+
+/* Returns X - N, where N is an integer. */
+static inline fixed_point_t
+fp_sub_int(fixed_point_t x, int n)
+{
+    return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point_t
+fp_mul(fixed_point_t x, fixed_point_t y)
+{
+    return ((int64_t)x) * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_point_t
+fp_div(fixed_point_t x, fixed_point_t y)
+{
+    return ((int64_t)x) * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
@@ -2,12 +2,15 @@
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <log.h>
 #include <random.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "devices/debugcon.h"
+#include "devices/fwcfg.h"
 #include "devices/input.h"
 #include "devices/kbd.h"
 #include "devices/rtc.h"
@@ -15,33 +18,59 @@
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
+#include "userprog/aio.h"
+#include "userprog/elfcache.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vdso.h"
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtblk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/fault.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* CR4 bits that turn on the CPU features used by paging_init(). */
+#define CR4_PSE   0x00000010
+#define CR4_PGE   0x00000080
+
+/* Pages mapped by one page table, or by one large-page PDE. */
+#define PT_PAGES ((size_t) 1 << PTBITS)
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -50,26 +79,64 @@ static bool format_filesys;
  * overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: Size of the RAM disk in kB, or 0 for none. */
+static size_t ramdisk_kb;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
-/* -ul: Maximum number of pages to put into palloc's user pool. */
+/* -ul: Maximum number of pages of user memory. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -bootprof: Print how long each phase of boot took? */
+static bool boot_profile;
+
+/* -snapshot: Wait at the snapshot point to be saved?  And has
+ * this run been restored from a snapshot? */
+static bool take_snapshot;
+static bool snapshot_restored;
+
+/* The fw_cfg file that holds the command line of a run restored
+ * from a snapshot, and how often to look for it. */
+#define SNAPSHOT_ARGS_FILE "opt/pintos/args"
+#define SNAPSHOT_POLL_MS 10
+
+/* Phases of boot so far: each ended when the time-stamp counter
+ * read CYCLES.  The first began at BOOT_START, on entry to
+ * main(). */
+#define BOOT_PHASE_MAX 32
+struct boot_phase {
+    const char *name;           /* Name, e.g. "ide_init". */
+    uint64_t cycles;            /* timer_cycles() at its end. */
+};
+static struct boot_phase boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static uint64_t boot_start;
+
 static void bss_init(void);
 
+static void ram_init(void);
+
 static void paging_init(void);
 
-static char **read_command_line(void);
+static char **read_command_line(uint8_t *cmdline);
 
 static char **parse_options(char **argv);
 
+static bool early_option(const char *name);
+
+static char **snapshot_point(void);
+
 static void run_actions(char **argv);
 
 static void usage(void);
 
+static void boot_phase(const char *name);
+
+static void print_boot_profile(void);
+
 #ifdef FILESYS
 static void locate_block_devices(void);
 
@@ -80,28 +147,40 @@ static void locate_block_device(enum block_type, const char *name);
 int
 main(void)
 {
+    uint64_t start = timer_cycles();
     char **argv;
 
     /* Clear BSS. */
     bss_init();
+    boot_start = start;
 
     /* Break command line into arguments and parse options. */
-    argv = read_command_line();
+    argv = read_command_line(ptov(LOADER_ARG_CNT));
     argv = parse_options(argv);
 
     /* Initialize ourselves as a thread so we can use locks,
      * then enable console locking. */
     thread_init();
     console_init();
+    boot_phase("thread_init");
 
-    /* Greet user. */
+    /* Size RAM and greet user. */
+    ram_init();
     printf("Pintos booting with %'" PRIu32 " kB RAM...\n",
            init_ram_pages * PGSIZE / 1024);
 
     /* Initialize memory system. */
     palloc_init(user_page_limit);
+    boot_phase("palloc_init");
+    trace_init();
+    profile_init();
     malloc_init();
+    kmem_init();
+    boot_phase("malloc_init");
     paging_init();
+    vmalloc_init();
+    cpu_init();
+    boot_phase("paging_init");
 
     /* Segmentation. */
 #ifdef USERPROG
@@ -116,21 +195,61 @@ main(void)
     input_init();
 #ifdef USERPROG
     exception_init();
+    fpu_init();
     syscall_init();
+    elfcache_init();
 #endif
+    boot_phase("intr_init");
 
     /* Start thread scheduler and enable interrupts. */
     thread_start();
+    rcu_init();
+#ifdef USERPROG
+    aio_init();
+#endif
+    palloc_start_zeroer();
+    log_start();
     serial_init_queue();
+    boot_phase("thread_start");
     timer_calibrate();
+    boot_phase("timer_calibrate");
+    cpu_start();
+    boot_phase("cpu_start");
+#ifdef USERPROG
+    vdso_init();
+#endif
+
+    /* Boot is the same every time up to here, where -snapshot
+     * waits to be saved, and a run restored from the snapshot
+     * gets its own command line. */
+    if (take_snapshot) {
+        argv = snapshot_point();
+    }
 
 #ifdef FILESYS
     /* Initialize file system. */
     ide_init();
+    boot_phase("ide_init");
+    virtblk_init();
+    boot_phase("virtblk_init");
+    if (ramdisk_kb > 0) {
+        ramdisk_init(ramdisk_kb);
+    }
     locate_block_devices();
     filesys_init(format_filesys);
+    boot_phase("filesys_init");
+#endif
+#ifdef VM
+    frame_init();
+    page_init();
+    swap_init();
+    shm_init();
+    boot_phase("vm_init");
 #endif
 
+    if (boot_profile) {
+        print_boot_profile();
+    }
     printf("Boot complete.\n");
 
     /* Run actions specified on kernel command line. */
@@ -155,17 +274,82 @@ bss_init(void)
     memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Sizes RAM from the BIOS memory map, if start.S got one: the end
+ * of the highest usable region, up to as much RAM as start.S
+ * mapped, which is LOADER_RAM_MAX with 4 MB pages and
+ * LOADER_RAM_MAX_4K without.  Reports the regions used.  Without
+ * a map, init_ram_pages keeps the size that start.S found the old
+ * way, at most 64 MB.  palloc_init() leaves out the holes between
+ * usable regions.
+ *
+ * Must run before paging_init() makes init_ram_pages, in the
+ * kernel text, read-only. */
+static void
+ram_init(void)
+{
+    uint64_t limit = LOADER_RAM_MAX_4K;
+    uint64_t end = 0;
+    uint32_t i;
+
+    if (init_mem_map_cnt == 0) {
+        return;
+    }
+
+    if (cpuid_features() & CPUID_PSE) {
+        limit = LOADER_RAM_MAX;
+    }
+
+    for (i = 0; i < init_mem_map_cnt; i++) {
+        const struct mem_region *r = &init_mem_map[i];
+        uint64_t r_end = r->base + r->length;
+
+        if (r->type != MEM_USABLE || r->base >= limit) {
+            continue;
+        }
+        if (r_end > limit) {
+            r_end = limit;
+        }
+        printf("Using RAM at %#010" PRIx64 "-%#010" PRIx64 ".\n",
+               r->base, r_end - 1);
+        if (r_end > end) {
+            end = r_end;
+        }
+    }
+    if (end > 0) {
+        init_ram_pages = end / PGSIZE;
+    }
+}
+
 /* Populates the base page directory and page table with the
  * kernel virtual mapping, and then sets up the CPU to use the
  * new page directory.  Points init_page_dir to the page
- * directory it creates. */
+ * directory it creates.
+ *
+ * If the CPU supports them, each aligned 4 MB of RAM that holds
+ * no kernel text, which must stay read-only, is mapped by a
+ * single large-page PDE instead of a page table, and all the
+ * kernel's mappings are global.  Every page directory shares the
+ * same kernel mappings, so global entries can stay in the TLB
+ * when process_activate() loads CR3. */
 static void
 paging_init(void)
 {
     uint32_t *pd, *pt;
+    uint32_t features = cpuid_features();
+    uint32_t cr4;
     size_t page;
     extern char _start, _end_kernel_text;
 
+    /* See [IA32-v3a] 2.5 "Control Registers". */
+    asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+    if (features & CPUID_PSE) {
+        cr4 |= CR4_PSE;
+    }
+    if (features & CPUID_PGE) {
+        cr4 |= CR4_PGE;
+    }
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
     pd = init_page_dir = palloc_get_page(PAL_ASSERT | PAL_ZERO);
     pt = NULL;
     for (page = 0; page < init_ram_pages; page++) {
@@ -175,6 +359,14 @@ paging_init(void)
         size_t pte_idx = pt_no(vaddr);
         bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+        if (pte_idx == 0 && (cr4 & CR4_PSE)
+            && init_ram_pages - page >= PT_PAGES
+            && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text)) {
+            pd[pde_idx] = pde_create_large(vaddr, true);
+            page += PT_PAGES - 1;
+            continue;
+        }
+
         if (pd[pde_idx] == 0) {
             pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
             pd[pde_idx] = pde_create(pt);
@@ -191,18 +383,19 @@ paging_init(void)
     asm volatile ("movl %0, %%cr3" : : "r" (vtop(init_page_dir)));
 }
 
-/* Breaks the kernel command line into words and returns them as
+/* Breaks the kernel command line at CMDLINE, laid out as the
+ * loader's is at LOADER_ARG_CNT, into words and returns them as
  * an argv-like array. */
 static char **
-read_command_line(void)
+read_command_line(uint8_t *cmdline)
 {
     static char *argv[LOADER_ARGS_LEN / 2 + 1];
     char *p, *end;
     int argc;
     int i;
 
-    argc = *(uint32_t *)ptov(LOADER_ARG_CNT);
-    p = ptov(LOADER_ARGS);
+    argc = *(uint32_t *)cmdline;
+    p = (char *)cmdline + LOADER_ARG_CNT_LEN;
     end = p + LOADER_ARGS_LEN;
     for (i = 0; i < argc; i++) {
         if (p >= end) {
@@ -238,7 +431,9 @@ parse_options(char **argv)
         char *name = strtok_r(*argv, "=", &save_ptr);
         char *value = strtok_r(NULL, "", &save_ptr);
 
-        if (!strcmp(name, "-h")) {
+        if (snapshot_restored && early_option(name)) {
+            continue;
+        } else if (!strcmp(name, "-h")) {
             usage();
         } else if (!strcmp(name, "-q")) {
             shutdown_configure(SHUTDOWN_POWER_OFF);
@@ -252,10 +447,16 @@ parse_options(char **argv)
             filesys_bdev_name = value;
         } else if (!strcmp(name, "-scratch")) {
             scratch_bdev_name = value;
+        } else if (!strcmp(name, "-ramdisk")) {
+            ramdisk_kb = atoi(value);
         }
 #ifdef VM
         else if (!strcmp(name, "-swap")) {
             swap_bdev_name = value;
+        } else if (!strcmp(name, "-vmstats")) {
+            fault_report = true;
+        } else if (!strcmp(name, "-zswap")) {
+            swap_cache_pages = atoi(value);
         }
 #endif
 #endif
@@ -263,6 +464,44 @@ parse_options(char **argv)
             random_init(atoi(value));
         } else if (!strcmp(name, "-mlfqs")) {
             thread_mlfqs = true;
+        } else if (!strcmp(name, "-cfs")) {
+            thread_cfs = true;
+        } else if (!strcmp(name, "-tickless")) {
+            timer_tickless = true;
+        } else if (!strcmp(name, "-lapic")) {
+            timer_lapic = true;
+        } else if (!strcmp(name, "-hz")) {
+            timer_freq = atoi(value);
+            if (timer_freq < TIMER_FREQ_MIN || timer_freq > TIMER_FREQ_MAX) {
+                PANIC("-hz must be between %d and %d",
+                      TIMER_FREQ_MIN, TIMER_FREQ_MAX);
+            }
+        } else if (!strcmp(name, "-calibration")) {
+            char *cycles = value != NULL ? strchr(value, ',') : NULL;
+            if (cycles == NULL
+                || !timer_set_calibration(atoi(value), atoi(cycles + 1))) {
+                PANIC("-calibration must be LOOPS,CYCLES as printed at boot");
+            }
+        } else if (!strcmp(name, "-slice")) {
+            int slice = atoi(value);
+            if (slice < 1) {
+                PANIC("-slice must be at least 1 tick");
+            }
+            thread_time_slice = slice;
+        } else if (!strcmp(name, "-trace")) {
+            trace_configure();
+        } else if (!strcmp(name, "-profile")) {
+            profile_configure();
+        } else if (!strcmp(name, "-bootprof")) {
+            boot_profile = true;
+        } else if (!strcmp(name, "-snapshot")) {
+            take_snapshot = true;
+        } else if (!strcmp(name, "-debugcon")) {
+            debugcon_enabled = true;
+        } else if (!strcmp(name, "-baud")) {
+            if (!serial_set_speed(atoi(value))) {
+                PANIC("-baud must divide 115200");
+            }
         }
 #ifdef USERPROG
         else if (!strcmp(name, "-ul")) {
@@ -274,6 +513,10 @@ parse_options(char **argv)
         }
     }
 
+    if (thread_mlfqs && thread_cfs) {
+        PANIC("-mlfqs and -cfs cannot be used together");
+    }
+
     /* Initialize the random number generator based on the system
      * time.  This has no effect if an "-rs" option was specified.
      *
@@ -322,6 +565,7 @@ run_actions(char **argv)
         { "ls",      1, fsutil_ls      },
         { "cat",     2, fsutil_cat     },
         { "rm",      2, fsutil_rm      },
+        { "defrag",  1, fsutil_defrag  },
         { "extract", 1, fsutil_extract },
         { "append",  2, fsutil_append  },
 #endif
@@ -372,6 +616,7 @@ usage(void)
            "  ls                 List files in the root directory.\n"
            "  cat FILE           Print FILE to the console.\n"
            "  rm FILE            Delete FILE.\n"
+           "  defrag             Move each file's data into one extent.\n"
            "Use these actions indirectly via `pintos' -g and -p options:\n"
            "  extract            Untar from scratch device into file system.\n"
            "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -384,12 +629,27 @@ usage(void)
            "  -f                 Format file system device during startup.\n"
            "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
            "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+           "  -ramdisk=KB        Create a KB kB RAM disk named ram0.\n"
 #ifdef VM
            "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+           "  -vmstats           Report each process's paging activity at exit.\n"
+           "  -zswap=PAGES       Keep up to PAGES pages of swap in RAM, compressed.\n"
 #endif
 #endif
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -cfs               Use fair-share scheduler, weighted by nice.\n"
+           "  -tickless          Stop the timer tick while the CPU is idle.\n"
+           "  -lapic             Tick with the local APIC timer, if present.\n"
+           "  -hz=FREQ           Interrupt FREQ times a second (default 100).\n"
+           "  -calibration=L,C   Skip timer calibration, using L,C from a past boot.\n"
+           "  -slice=TICKS       Give each thread TICKS ticks at a time (default 4).\n"
+           "  -trace             Record events and print them at power off.\n"
+           "  -profile           Sample the running code and print a profile.\n"
+           "  -bootprof          Print how long each phase of boot took.\n"
+           "  -snapshot          Wait to be saved before finding disks.\n"
+           "  -debugcon          Write output to debug port 0xe9, not the serial port.\n"
+           "  -baud=BPS          Run the serial port at BPS bits/s (default 115200).\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -397,6 +657,87 @@ usage(void)
     shutdown_power_off();
 }
 
+/* Returns true if NAME is an option that takes effect before the
+ * snapshot point.  A run restored from a snapshot ignores these,
+ * keeping the ones that the snapshot was taken with. */
+static bool
+early_option(const char *name)
+{
+    static const char *const names[] = {
+        "-mlfqs", "-cfs", "-tickless", "-lapic", "-hz", "-calibration",
+        "-trace", "-profile", "-ul", "-snapshot", NULL,
+    };
+    const char *const *n;
+
+    for (n = names; *n != NULL; n++) {
+        if (!strcmp(name, *n)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Waits at the snapshot point, for -snapshot.  The pintos script
+ * saves the machine's state meanwhile and then quits QEMU.  A run
+ * restored from the saved state carries on from here, with its
+ * own command line in fw_cfg file SNAPSHOT_ARGS_FILE, laid out as
+ * the loader's is.  Parses its options, except for early ones,
+ * and returns its actions. */
+static char **
+snapshot_point(void)
+{
+    static uint8_t cmdline[LOADER_ARG_CNT_LEN + LOADER_ARGS_LEN];
+
+    if (!fwcfg_present()) {
+        PANIC("-snapshot requires QEMU");
+    }
+    printf("Snapshot point reached.\n");
+    while (fwcfg_read_file(SNAPSHOT_ARGS_FILE, cmdline, sizeof cmdline) < 0) {
+        timer_msleep(SNAPSHOT_POLL_MS);
+    }
+
+    /* Tests look for the greeting in every run's output. */
+    printf("Restored from snapshot.\n");
+    printf("Pintos booting with %'" PRIu32 " kB RAM...\n",
+           init_ram_pages * PGSIZE / 1024);
+    snapshot_restored = true;
+    return parse_options(read_command_line(cmdline));
+}
+
+/* Notes that the phase of boot called NAME, which began where
+ * the last one ended, is over. */
+static void
+boot_phase(const char *name)
+{
+    if (boot_phase_cnt < BOOT_PHASE_MAX) {
+        struct boot_phase *p = &boot_phases[boot_phase_cnt++];
+
+        p->name = name;
+        p->cycles = timer_cycles();
+    }
+}
+
+/* Prints the time taken by each phase of boot so far, and in all.
+ * Times are only as good as the time-stamp counter calibration,
+ * so timer_calibrate() must have run. */
+static void
+print_boot_profile(void)
+{
+    uint64_t last = boot_start;
+    size_t i;
+
+    printf("Boot profile:\n");
+    for (i = 0; i < boot_phase_cnt; i++) {
+        struct boot_phase *p = &boot_phases[i];
+
+        printf("  %-16s %'10" PRIu64 " us\n", p->name,
+               timer_cycles_to_ns(p->cycles - last) / 1000);
+        last = p->cycles;
+    }
+    printf("  %-16s %'10" PRIu64 " us\n", "total",
+           timer_cycles_to_ns(last - boot_start) / 1000);
+}
+
 #ifdef FILESYS
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
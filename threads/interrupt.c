@@ -3,13 +3,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "devices/lapic.h"
 #include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
  * A PC has two PICs, called the master and slave PICs, with the
@@ -38,6 +44,18 @@ static const char *intr_names[INTR_CNT];
  * unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Profile of each vector: times invoked and, for external
+ * interrupts, time-stamp counter cycles spent from entry to
+ * intr_handler() through the end of interrupt, not counting
+ * deferred work.  Other handlers may sleep or be interrupted, so
+ * their time is not meaningful and is not measured. */
+static unsigned long long intr_cnt[INTR_CNT];
+static uint64_t intr_cycles[INTR_CNT];
+
+/* Runs of run_deferred_work() and the cycles they took. */
+static unsigned long long deferred_cnt;
+static uint64_t deferred_cycles;
+
 /* External interrupts are those generated by devices outside the
  * CPU, such as the timer.  External interrupts run with
  * interrupts turned off, so they never nest, nor are they ever
@@ -48,11 +66,25 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr; /* Are we processing an external interrupt? */
 static bool yield_on_return;  /* Should we yield on interrupt return? */
 
+/* Work deferred by external interrupt handlers with intr_defer().
+ * After acknowledging an interrupt, intr_handler() runs it with
+ * interrupts turned back on, so that a long job such as waking
+ * many sleepers does not hold off other interrupts.  Deferred
+ * work counts as interrupt context: it may not sleep, and a
+ * yield that it requests happens once all of it is done.
+ * Interrupts that arrive while it runs are handled as usual, but
+ * the work they defer joins the list being run rather than
+ * starting a nested run. */
+static struct list deferred_list;
+static bool in_deferred_work;  /* Are we running deferred work? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
 
 static void pic_end_of_interrupt(int irq);
 
+static bool is_external(uint8_t vec_no);
+
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate(void (*)(void), int dpl);
 
@@ -63,6 +95,8 @@ static inline uint64_t make_idtr_operand(uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler(struct intr_frame *args);
 static void unexpected_interrupt(const struct intr_frame *);
+static void run_deferred_work(void);
+static const char *percent(uint64_t part, uint64_t whole);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -93,7 +127,7 @@ intr_enable(void)
 {
     enum intr_level old_level = intr_get_level();
 
-    ASSERT(!intr_context());
+    ASSERT(!in_external_intr);
 
     /* Enable interrupts by setting the interrupt flag.
      *
@@ -127,6 +161,7 @@ intr_init(void)
 
     /* Initialize interrupt controller. */
     pic_init();
+    list_init(&deferred_list);
 
     /* Initialize IDT. */
     for (i = 0; i < INTR_CNT; i++) {
@@ -164,6 +199,16 @@ intr_init(void)
     intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT that intr_init() set up on an application
+ * processor. */
+void
+intr_init_ap(void)
+{
+    uint64_t idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
+
+    asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
  * privilege level DPL.  Names the interrupt NAME for debugging
  * purposes.  The interrupt handler will be invoked with
@@ -189,10 +234,27 @@ void
 intr_register_ext(uint8_t vec_no, intr_handler_func *handler,
                   const char *name)
 {
-    ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+    ASSERT(is_external(vec_no));
     register_handler(vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Masks external interrupt VEC_NO, which must come from a PIC, if
+ * MASKED is true, or unmasks it otherwise.  A masked interrupt is
+ * not delivered until it is unmasked. */
+void
+intr_mask_ext(uint8_t vec_no, bool masked)
+{
+    int port = vec_no < 0x28 ? PIC0_DATA : PIC1_DATA;
+    uint8_t bit = 1 << (vec_no & 7);
+    enum intr_level old_level;
+
+    ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+
+    old_level = intr_disable();
+    outb(port, masked ? inb(port) | bit : inb(port) & ~bit);
+    intr_set_level(old_level);
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
  * is named NAME for debugging purposes.  The interrupt handler
  * will be invoked with interrupt status LEVEL.
@@ -210,16 +272,16 @@ void
 intr_register_int(uint8_t vec_no, int dpl, enum intr_level level,
                   intr_handler_func *handler, const char *name)
 {
-    ASSERT(vec_no < 0x20 || vec_no > 0x2f);
+    ASSERT(!is_external(vec_no));
     register_handler(vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
- * and false at all other times. */
+/* Returns true during processing of an external interrupt or of
+ * the work it deferred, and false at all other times. */
 bool
 intr_context(void)
 {
-    return in_external_intr;
+    return in_external_intr || in_deferred_work;
 }
 
 /* During processing of an external interrupt, directs the
@@ -233,6 +295,36 @@ intr_yield_on_return(void)
     yield_on_return = true;
 }
 
+/* Initializes W to run FUNC, given auxiliary data AUX, whenever
+ * it is deferred. */
+void
+intr_work_init(struct intr_work *w, intr_work_func *func, void *aux)
+{
+    ASSERT(w != NULL);
+    ASSERT(func != NULL);
+
+    w->func = func;
+    w->aux = aux;
+    w->queued = false;
+}
+
+/* Arranges for W to run after the current external interrupt is
+ * acknowledged, with interrupts on, before the interrupted thread
+ * resumes.  Deferring W again before it runs has no further
+ * effect.  May only be called from an external interrupt handler
+ * or from deferred work. */
+void
+intr_defer(struct intr_work *w)
+{
+    ASSERT(intr_context());
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!w->queued) {
+        w->queued = true;
+        list_push_back(&deferred_list, &w->elem);
+    }
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Initializes the PICs.  Refer to [8259A] for details.
@@ -283,6 +375,14 @@ pic_end_of_interrupt(int irq)
     }
 }
 
+/* Returns true if VEC_NO is an external interrupt: one from the
+ * PICs or the local APIC timer. */
+static bool
+is_external(uint8_t vec_no)
+{
+    return (vec_no >= 0x20 && vec_no < 0x30) || vec_no == INTR_LAPIC_TIMER;
+}
+
 /* Creates an gate that invokes FUNCTION.
  *
  * The gate has descriptor privilege level DPL, meaning that it
@@ -355,25 +455,37 @@ intr_handler(struct intr_frame *frame)
 {
     bool external;
     intr_handler_func *handler;
+    uint64_t start = 0;
+
+    trace(TRACE_INTR, frame->vec_no, (uint32_t) frame->eip);
+    intr_cnt[frame->vec_no]++;
 
     /* External interrupts are special.
      * We only handle one at a time (so interrupts must be off)
      * and they need to be acknowledged on the PIC (see below).
      * An external interrupt handler cannot sleep. */
-    external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+    external = is_external(frame->vec_no);
     if (external) {
         ASSERT(intr_get_level() == INTR_OFF);
-        ASSERT(!intr_context());
+        ASSERT(!in_external_intr);
 
         in_external_intr = true;
-        yield_on_return = false;
+        start = timer_cycles();
+
+        /* Bring the tick count up to date before any handler
+         * can look at it, if this interrupt ended a tickless
+         * idle period. */
+        if (frame->vec_no != 0x20 && frame->vec_no != INTR_LAPIC_TIMER) {
+            timer_idle_exit();
+        }
     }
 
     /* Invoke the interrupt's handler. */
     handler = intr_handlers[frame->vec_no];
     if (handler != NULL) {
         handler(frame);
-    } else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
+    } else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+               || frame->vec_no == INTR_LAPIC_SPURIOUS) {
         /* There is no handler, but this interrupt can trigger
          * spuriously due to a hardware fault or hardware race
          * condition.  Ignore it. */
@@ -387,12 +499,58 @@ intr_handler(struct intr_frame *frame)
         ASSERT(intr_context());
 
         in_external_intr = false;
-        pic_end_of_interrupt(frame->vec_no);
+        if (frame->vec_no == INTR_LAPIC_TIMER) {
+            lapic_eoi();
+        } else {
+            pic_end_of_interrupt(frame->vec_no);
+        }
+        intr_cycles[frame->vec_no] += timer_cycles() - start;
 
+        /* An interrupt that arrived during deferred work returns
+         * to it, and the outer handler finishes the job. */
+        if (in_deferred_work) {
+            return;
+        }
+        if (!list_empty(&deferred_list)) {
+            start = timer_cycles();
+            run_deferred_work();
+            deferred_cnt++;
+            deferred_cycles += timer_cycles() - start;
+        }
         if (yield_on_return) {
-            thread_yield();
+            yield_on_return = false;
+            thread_preempt();
         }
     }
+
+#ifdef USERPROG
+    /* A thread of an exiting process exits rather than go back
+     * to user mode. */
+    if (frame->cs == SEL_UCSEG) {
+        process_return_to_user();
+    }
+#endif
+}
+
+/* Runs the work on deferred_list, including any deferred while
+ * it runs, each item with interrupts on.  Called with interrupts
+ * off, and returns with them off. */
+static void
+run_deferred_work(void)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    in_deferred_work = true;
+    while (!list_empty(&deferred_list)) {
+        struct intr_work *w = list_entry(list_pop_front(&deferred_list),
+                                         struct intr_work, elem);
+
+        w->queued = false;
+        intr_enable();
+        w->func(w->aux);
+        intr_disable();
+    }
+    in_deferred_work = false;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -414,6 +572,54 @@ unexpected_interrupt(const struct intr_frame *f)
     }
 }
 
+/* Prints how often each interrupt vector fired and, for external
+ * interrupts, the time their handlers took, as an average and as
+ * a share of the time since boot. */
+void
+intr_print_stats(void)
+{
+    uint64_t uptime_ns = timer_ns();
+    int i;
+
+    printf("Interrupts:  vec %10s %12s %9s %7s  name\n",
+           "count", "total us", "avg ns", "cpu %");
+    for (i = 0; i < INTR_CNT; i++) {
+        if (intr_cnt[i] == 0) {
+            continue;
+        }
+        printf("Interrupts: 0x%02x %10llu", i, intr_cnt[i]);
+        if (is_external(i)) {
+            uint64_t ns = timer_cycles_to_ns(intr_cycles[i]);
+
+            printf(" %12llu %9llu %7s", ns / 1000, ns / intr_cnt[i],
+                   percent(ns, uptime_ns));
+        } else {
+            printf(" %12s %9s %7s", "-", "-", "-");
+        }
+        printf("  %s\n", intr_names[i]);
+    }
+    if (deferred_cnt > 0) {
+        uint64_t ns = timer_cycles_to_ns(deferred_cycles);
+
+        printf("Interrupts: deferred work: %llu runs, %llu us total, "
+               "%llu ns avg, %s%% cpu\n", deferred_cnt, ns / 1000,
+               ns / deferred_cnt, percent(ns, uptime_ns));
+    }
+}
+
+/* Formats PART as a percentage of WHOLE with two decimals, in a
+ * static buffer. */
+static const char *
+percent(uint64_t part, uint64_t whole)
+{
+    static char buf[32];
+    uint64_t hundredths = whole > 0 ? part * 10000 / whole : 0;
+
+    snprintf(buf, sizeof buf, "%llu.%02llu",
+             hundredths / 100, hundredths % 100);
+    return buf;
+}
+
 /* Dumps interrupt frame F to the console, for debugging. */
 void
 intr_dump_frame(const struct intr_frame *f)
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -55,13 +56,36 @@ struct intr_frame {
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Interrupts from the local APIC.  The timer's is an external
+ * interrupt, like the PICs' 0x20...0x2f, but is acknowledged on
+ * the local APIC instead.  The spurious interrupt needs no
+ * acknowledgment and is ignored. */
+#define INTR_LAPIC_TIMER    0xf0
+#define INTR_LAPIC_SPURIOUS 0xff
+
 void intr_init(void);
+void intr_init_ap(void);
 void intr_register_ext(uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int(uint8_t vec, int dpl, enum intr_level,
                        intr_handler_func *, const char *name);
+void intr_mask_ext(uint8_t vec, bool masked);
 bool intr_context(void);
 void intr_yield_on_return(void);
 void intr_dump_frame(const struct intr_frame *);
+void intr_print_stats(void);
+
+/* Work that an external interrupt handler defers until after it
+ * has acknowledged the interrupt.  See intr_defer(). */
+typedef void intr_work_func (void *aux);
+struct intr_work {
+    struct list_elem elem;   /* Element in the deferred work list. */
+    intr_work_func *func;    /* Function to run. */
+    void *aux;               /* Argument to FUNC. */
+    bool queued;             /* In the deferred work list? */
+};
+
+void intr_work_init(struct intr_work *, intr_work_func *, void *aux);
+void intr_defer(struct intr_work *);
 const char *intr_name(uint8_t vec);
 
 #endif /* threads/interrupt.h */
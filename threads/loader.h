@@ -12,6 +12,17 @@
  * Must be aligned on a 4 MB boundary. */
 #define LOADER_PHYS_BASE 0xc0000000 /* 3 GB. */
 
+/* Most physical memory that the kernel maps at LOADER_PHYS_BASE,
+ * and so uses.  The CPU must support 4 MB pages for start.S to map
+ * more than LOADER_RAM_MAX_4K. */
+#define LOADER_RAM_MAX    0x10000000 /* 256 MB. */
+#define LOADER_RAM_MAX_4K 0x04000000 /* 64 MB. */
+
+/* Most entries kept from the BIOS memory map, and the size of
+ * each. */
+#define LOADER_MEM_MAP_MAX 32
+#define LOADER_MEM_MAP_ENTRY_LEN 20
+
 /* Important loader physical addresses. */
 #define LOADER_SIG     (LOADER_END - LOADER_SIG_LEN)      /* 0xaa55 BIOS signature. */
 #define LOADER_PARTS   (LOADER_SIG - LOADER_PARTS_LEN)    /* Partition table. */
@@ -35,6 +46,18 @@
 
 /* Amount of physical memory, in 4 kB pages. */
 extern uint32_t init_ram_pages;
+
+/* A region of physical memory in the BIOS memory map. */
+struct mem_region {
+    uint64_t base;   /* Physical address. */
+    uint64_t length; /* Length in bytes. */
+    uint32_t type;   /* MEM_USABLE, or some kind of reserved. */
+};
+#define MEM_USABLE 1
+
+/* BIOS memory map, as start.S found it, in no particular order. */
+extern struct mem_region init_mem_map[LOADER_MEM_MAP_MAX];
+extern uint32_t init_mem_map_cnt;
 #endif
 
 #endif /* threads/loader.h */
@@ -9,6 +9,7 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
  *
@@ -29,18 +30,49 @@
  * blocks, we remove all of the arena's blocks from the free list
  * and give the arena back to the page allocator.
  *
- * We can't handle blocks bigger than 2 kB using this scheme,
- * because they're too big to fit in a single page with a
- * descriptor.  We handle those by allocating contiguous pages
- * with the page allocator and sticking the allocation size at
- * the beginning of the allocated block's arena header. */
+ * Blocks of 2 kB and more can't share a single page with an
+ * arena header, so their arenas span several pages, enough for
+ * ARENA_BLOCKS blocks each.  The page allocator aligns such an
+ * arena on its own size, and every block in it starts with a
+ * copy of the arena header, so that the page a block's memory
+ * begins in always starts with a header that leads to its
+ * descriptor and from there to the arena.  The block's usable
+ * size is what remains after the header.
+ *
+ * Requests too big for any descriptor get pages of their own,
+ * with the allocation size stuck at the beginning of their arena
+ * header.  The pages come from vmalloc(), which doesn't need
+ * them to be physically contiguous and so keeps working however
+ * fragmented memory gets, or, before vmalloc() is ready or if it
+ * fails, from a contiguous run from the page allocator.
+ *
+ * Each descriptor counts its blocks in use, their high-water mark
+ * and its arenas, for malloc_print_stats().  Building with
+ * MALLOC_PROFILE defined, for example by adding -DMALLOC_PROFILE
+ * to DEFINES in a project's Make.vars, also puts a tag in front
+ * of every block that records the caller's return address and
+ * the requested size, and tallies the live bytes and blocks per
+ * call site, so that whoever holds the memory can be found.  The
+ * backtrace utility turns the addresses into function names. */
+
+/* Blocks in an arena made of more than one page, and the biggest
+ * such block. */
+#define ARENA_BLOCKS 8
+#define MAX_BLOCK_STRIDE (16 * 1024)
 
 /* Descriptor. */
 struct desc {
     size_t      block_size;       /* Size of each element in bytes. */
+    size_t      stride;           /* Distance between elements. */
+    size_t      arena_pages;      /* Pages in an arena. */
     size_t      blocks_per_arena; /* Number of blocks in an arena. */
     struct list free_list;        /* List of free blocks. */
     struct lock lock;             /* Lock. */
+
+    /* Statistics, protected by LOCK. */
+    size_t      in_use;           /* Blocks allocated. */
+    size_t      peak;             /* Maximum IN_USE. */
+    size_t      arena_cnt;        /* Arenas. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -59,32 +91,119 @@ struct block {
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10]; /* Descriptors. */
+static struct desc descs[12]; /* Descriptors. */
 static size_t desc_cnt;       /* Number of descriptors. */
 
+/* Big blocks in use, their pages and the maximum BIG_CNT. */
+static size_t big_cnt, big_pages, big_peak;
+static struct lock big_lock;
+
+#ifdef MALLOC_PROFILE
+/* Tag in front of each block. */
+struct tag {
+    void  *site;   /* Return address of the allocating call. */
+    size_t size;   /* Bytes requested. */
+};
+
+/* Live blocks and bytes allocated from each call site.  Sites
+ * beyond MAX_SITES are lumped together in the last entry, with a
+ * null SITE. */
+#define MAX_SITES 128
+struct site {
+    void  *site;   /* Return address of the allocating call. */
+    size_t cnt;    /* Live blocks. */
+    size_t bytes;  /* Live bytes. */
+};
+static struct site sites[MAX_SITES + 1];
+static struct lock sites_lock;
+
+static void site_count(void *site, size_t size, bool alloc);
+#endif
+
 static struct arena *block_to_arena(struct block *);
 static struct block *arena_to_block(struct arena *, size_t idx);
+static struct desc *add_desc(size_t block_size, size_t stride,
+                             size_t arena_pages);
+static void *malloc_at(size_t, void *site);
+static void *alloc_block(size_t);
+static void free_block(void *);
+static size_t usable_size(void *);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init(void)
 {
-    size_t block_size;
+    size_t block_size, stride;
 
     for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
-        struct desc *d = &descs[desc_cnt++];
-        ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
-        d->block_size = block_size;
+        struct desc *d = add_desc(block_size, block_size, 1);
         d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
-        list_init(&d->free_list);
-        lock_init(&d->lock);
     }
+    for (stride = PGSIZE / 2; stride <= MAX_BLOCK_STRIDE; stride *= 2) {
+        struct desc *d = add_desc(stride - sizeof(struct arena), stride,
+                                  stride * ARENA_BLOCKS / PGSIZE);
+        d->blocks_per_arena = ARENA_BLOCKS;
+        ASSERT(d->arena_pages <= ALIGN_MAX_PAGES);
+    }
+    lock_init(&big_lock);
+#ifdef MALLOC_PROFILE
+    lock_init(&sites_lock);
+#endif
+}
+
+/* Adds and returns a descriptor for blocks of BLOCK_SIZE bytes,
+ * STRIDE bytes apart, in arenas of ARENA_PAGES pages. */
+static struct desc *
+add_desc(size_t block_size, size_t stride, size_t arena_pages)
+{
+    struct desc *d = &descs[desc_cnt++];
+
+    ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
+    d->block_size = block_size;
+    d->stride = stride;
+    d->arena_pages = arena_pages;
+    list_init(&d->free_list);
+    lock_init(&d->lock);
+    d->in_use = d->peak = d->arena_cnt = 0;
+    return d;
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
  * Returns a null pointer if memory is not available. */
 void *
 malloc(size_t size)
+{
+    return malloc_at(size, __builtin_return_address(0));
+}
+
+/* Obtains and returns a new block of at least SIZE bytes for a
+ * caller at SITE, tagging it if profiling. */
+static void *
+malloc_at(size_t size, void *site UNUSED)
+{
+#ifdef MALLOC_PROFILE
+    struct tag *t;
+
+    if (size == 0 || size + sizeof *t < size) {
+        return NULL;
+    }
+    t = alloc_block(size + sizeof *t);
+    if (t == NULL) {
+        return NULL;
+    }
+    t->site = site;
+    t->size = size;
+    site_count(site, size, true);
+    return t + 1;
+#else
+    return alloc_block(size);
+#endif
+}
+
+/* Obtains and returns a new, untagged block of at least SIZE
+ * bytes. */
+static void *
+alloc_block(size_t size)
 {
     struct desc *d;
     struct block *b;
@@ -106,7 +225,10 @@ malloc(size_t size)
         /* SIZE is too big for any descriptor.
          * Allocate enough pages to hold SIZE plus an arena. */
         size_t page_cnt = DIV_ROUND_UP(size + sizeof *a, PGSIZE);
-        a = palloc_get_multiple(0, page_cnt);
+        a = vmalloc(page_cnt);
+        if (a == NULL) {
+            a = palloc_get_multiple(0, page_cnt);
+        }
         if (a == NULL) {
             return NULL;
         }
@@ -116,6 +238,13 @@ malloc(size_t size)
         a->magic = ARENA_MAGIC;
         a->desc = NULL;
         a->free_cnt = page_cnt;
+
+        lock_acquire(&big_lock);
+        big_pages += page_cnt;
+        if (++big_cnt > big_peak) {
+            big_peak = big_cnt;
+        }
+        lock_release(&big_lock);
         return a + 1;
     }
 
@@ -125,19 +254,29 @@ malloc(size_t size)
     if (list_empty(&d->free_list)) {
         size_t i;
 
-        /* Allocate a page. */
-        a = palloc_get_page(0);
+        /* Allocate an arena. */
+        a = palloc_get_multiple(0, d->arena_pages);
         if (a == NULL) {
             lock_release(&d->lock);
             return NULL;
         }
+        ASSERT((uintptr_t) a % (d->arena_pages * PGSIZE) == 0);
+        d->arena_cnt++;
 
-        /* Initialize arena and add its blocks to the free list. */
-        a->magic = ARENA_MAGIC;
-        a->desc = d;
-        a->free_cnt = d->blocks_per_arena;
+        /* Initialize arena and add its blocks to the free list.
+         * In a multi-page arena, each block gets a copy of the
+         * header. */
         for (i = 0; i < d->blocks_per_arena; i++) {
-            struct block *b = arena_to_block(a, i);
+            struct block *b;
+
+            if (i == 0 || d->arena_pages > 1) {
+                struct arena *h = (struct arena *)
+                    ((uint8_t *) a + i * d->stride);
+                h->magic = ARENA_MAGIC;
+                h->desc = d;
+                h->free_cnt = d->blocks_per_arena;
+            }
+            b = arena_to_block(a, i);
             list_push_back(&d->free_list, &b->free_elem);
         }
     }
@@ -146,6 +285,9 @@ malloc(size_t size)
     b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
     a = block_to_arena(b);
     a->free_cnt--;
+    if (++d->in_use > d->peak) {
+        d->peak = d->in_use;
+    }
     lock_release(&d->lock);
     return b;
 }
@@ -165,7 +307,7 @@ calloc(size_t a, size_t b)
     }
 
     /* Allocate and zero memory. */
-    p = malloc(size);
+    p = malloc_at(size, __builtin_return_address(0));
     if (p != NULL) {
         memset(p, 0, size);
     }
@@ -173,15 +315,19 @@ calloc(size_t a, size_t b)
     return p;
 }
 
-/* Returns the number of bytes allocated for BLOCK. */
+/* Returns the number of bytes the caller may use in BLOCK. */
 static size_t
-block_size(void *block)
+usable_size(void *block)
 {
+#ifdef MALLOC_PROFILE
+    return ((struct tag *) block - 1)->size;
+#else
     struct block *b = block;
     struct arena *a = block_to_arena(b);
     struct desc *d = a->desc;
 
     return d != NULL ? d->block_size : PGSIZE *a->free_cnt - pg_ofs(block);
+#endif
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -197,9 +343,9 @@ realloc(void *old_block, size_t new_size)
         free(old_block);
         return NULL;
     } else {
-        void *new_block = malloc(new_size);
+        void *new_block = malloc_at(new_size, __builtin_return_address(0));
         if (old_block != NULL && new_block != NULL) {
-            size_t old_size = block_size(old_block);
+            size_t old_size = usable_size(old_block);
             size_t min_size = new_size < old_size ? new_size : old_size;
             memcpy(new_block, old_block, min_size);
             free(old_block);
@@ -212,6 +358,89 @@ realloc(void *old_block, size_t new_size)
  * malloc(), calloc(), or realloc(). */
 void
 free(void *p)
+{
+#ifdef MALLOC_PROFILE
+    if (p != NULL) {
+        struct tag *t = (struct tag *) p - 1;
+
+        site_count(t->site, t->size, false);
+        p = t;
+    }
+#endif
+    free_block(p);
+}
+
+/* Prints malloc() statistics. */
+void
+malloc_print_stats(void)
+{
+    struct desc *d;
+
+    for (d = descs; d < descs + desc_cnt; d++) {
+        if (d->peak > 0) {
+            printf("malloc: %zu-byte blocks: %zu in use, %zu peak, "
+                   "%zu arenas\n",
+                   d->block_size, d->in_use, d->peak, d->arena_cnt);
+        }
+    }
+    printf("malloc: big blocks: %zu in use in %zu pages, %zu peak\n",
+           big_cnt, big_pages, big_peak);
+
+#ifdef MALLOC_PROFILE
+    {
+        struct site *s;
+
+        lock_acquire(&sites_lock);
+        for (s = sites; s <= sites + MAX_SITES; s++) {
+            if (s->cnt == 0) {
+                continue;
+            }
+            if (s->site != NULL) {
+                printf("malloc: %zu bytes in %zu blocks from %p\n",
+                       s->bytes, s->cnt, s->site);
+            } else {
+                printf("malloc: %zu bytes in %zu blocks from other sites\n",
+                       s->bytes, s->cnt);
+            }
+        }
+        lock_release(&sites_lock);
+    }
+#endif
+}
+
+#ifdef MALLOC_PROFILE
+/* Records the allocation, if ALLOC is true, or the freeing of a
+ * block of SIZE bytes from call site SITE. */
+static void
+site_count(void *site, size_t size, bool alloc)
+{
+    struct site *s;
+
+    lock_acquire(&sites_lock);
+    for (s = sites; s < sites + MAX_SITES; s++) {
+        if (s->site == site || (s->site == NULL && s->cnt == 0)) {
+            break;
+        }
+    }
+    if (s == sites + MAX_SITES) {
+        site = NULL;
+    }
+    s->site = site;
+    if (alloc) {
+        s->cnt++;
+        s->bytes += size;
+    } else {
+        ASSERT(s->cnt > 0 && s->bytes >= size);
+        s->cnt--;
+        s->bytes -= size;
+    }
+    lock_release(&sites_lock);
+}
+#endif
+
+/* Frees untagged block P. */
+static void
+free_block(void *p)
 {
     if (p != NULL) {
         struct block *b = p;
@@ -240,13 +469,23 @@ free(void *p)
                     struct block *b = arena_to_block(a, i);
                     list_remove(&b->free_elem);
                 }
-                palloc_free_page(a);
+                palloc_free_multiple(a, d->arena_pages);
+                d->arena_cnt--;
             }
+            d->in_use--;
 
             lock_release(&d->lock);
         } else {
             /* It's a big block.  Free its pages. */
-            palloc_free_multiple(a, a->free_cnt);
+            lock_acquire(&big_lock);
+            big_cnt--;
+            big_pages -= a->free_cnt;
+            lock_release(&big_lock);
+            if (is_vmalloc_vaddr(a)) {
+                vfree(a, a->free_cnt);
+            } else {
+                palloc_free_multiple(a, a->free_cnt);
+            }
             return;
         }
     }
@@ -262,9 +501,18 @@ block_to_arena(struct block *b)
     ASSERT(a != NULL);
     ASSERT(a->magic == ARENA_MAGIC);
 
+    /* In a multi-page arena, that was only a block's copy of the
+     * header.  The arena itself is aligned on its size. */
+    if (a->desc != NULL && a->desc->arena_pages > 1) {
+        a = (struct arena *) ((uintptr_t) b
+                              & ~(a->desc->arena_pages * PGSIZE - 1));
+        ASSERT(a->magic == ARENA_MAGIC);
+    }
+
     /* Check that the block is properly aligned for the arena. */
     ASSERT(a->desc == NULL
-           || (pg_ofs(b) - sizeof *a) % a->desc->block_size == 0);
+           || ((uint8_t *) b - (uint8_t *) a - sizeof *a)
+              % a->desc->stride == 0);
     ASSERT(a->desc != NULL || pg_ofs(b) == sizeof *a);
 
     return a;
@@ -279,5 +527,5 @@ arena_to_block(struct arena *a, size_t idx)
     ASSERT(idx < a->desc->blocks_per_arena);
     return (struct block *)((uint8_t *)a
                             + sizeof *a
-                            + idx * a->desc->block_size);
+                            + idx * a->desc->stride);
 }
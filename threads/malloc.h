@@ -9,5 +9,6 @@ void *malloc(size_t) __attribute__ ((malloc));
 void *calloc(size_t, size_t) __attribute__ ((malloc));
 void *realloc(void *, size_t);
 void free(void *);
+void malloc_print_stats(void);
 
 #endif /* threads/malloc.h */
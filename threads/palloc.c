@@ -1,95 +1,227 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
  * page-multiple) chunks.  See malloc.h for an allocator that
  * hands out smaller chunks.
  *
- * System memory is divided into two "pools" called the kernel
- * and user pools.  The user pool is for user (virtual) memory
- * pages, the kernel pool for everything else.  The idea here is
- * that the kernel needs to have memory for its own operations
- * even if user processes are swapping like mad.
+ * All of free memory forms a single pool, shared by user
+ * (virtual) memory pages, requested with PAL_USER, and
+ * everything else.  The kernel needs to have memory for its own
+ * operations even if user processes are swapping like mad, so
+ * user allocations fail once no more than a reserve of free pages
+ * is left, and the frame table evicts a page instead.  Kernel
+ * allocations may use the reserve, and if even that runs out,
+ * ask the reclaimer, which the frame table installs, to give
+ * back some user frames before they fail.  User memory may also
+ * be capped at a fixed number of pages.  This way user frames
+ * can use whatever memory the kernel is not using, and the
+ * kernel can take it back when it needs it.
  *
- * By default, half of system RAM is given to the kernel pool and
- * half to the user pool.  That should be huge overkill for the
- * kernel pool, but that's just fine for demonstration purposes. */
+ * The pool is managed as a buddy system.  Its free pages form
+ * blocks of 2**K pages, each aligned to 2**K pages from the
+ * pool's base, on one free list per order K.  A request is
+ * served from the smallest block big enough, split in halves as
+ * needed, and whatever it does not use is freed again at once.
+ * Freeing a block merges it with its buddy, the other half of
+ * the block it was split from, as long as the buddy is free in
+ * its entirety.  Both take time proportional to the number of
+ * orders, however full the pool. */
+
+/* Free memory starts at 1 MB.  Blocks are aligned relative to
+ * the start of the pool, so blocks of up to ALIGN_MAX_PAGES
+ * pages, or 1 MB, are aligned on their own size in virtual
+ * memory too. */
+#define FREE_START (1024 * 1024)
+
+/* Number of block orders.  Blocks of 2**(ORDER_CNT - 1) pages
+ * cover all of a 32-bit address space. */
+#define ORDER_CNT 21
+
+/* Single pages are allocated and freed through a magazine in
+ * front of the pool: a small LIFO cache of free pages that is
+ * accessed with interrupts disabled instead of the pool lock,
+ * and never touches the bitmap or the free lists.  Pages in a
+ * magazine count as allocated as far as the pool is concerned.
+ * An empty magazine is refilled, and a full one drained, by
+ * MAG_BATCH pages at a time under the pool lock.
+ *
+ * The magazine also holds a ready list of up to ZERO_MAX pages
+ * that are known to be zero, so that a PAL_ZERO request normally
+ * costs only a pop.  A low-priority kernel thread takes free
+ * pages from the pool, zeroes them and adds them to the list,
+ * whenever it drops below ZERO_LOW pages. */
+#define MAG_SIZE 32
+#define MAG_BATCH (MAG_SIZE / 2)
+#define ZERO_MAX 64
+#define ZERO_LOW (ZERO_MAX / 2)
+
+/* Free pages reserved for the kernel: 1/RESERVE_DIV of memory,
+ * but at least RESERVE_MIN pages.  A kernel allocation that
+ * fails asks the reclaimer for pages up to RECLAIM_TRIES times
+ * before giving up. */
+#define RESERVE_DIV 16
+#define RESERVE_MIN 64
+#define RECLAIM_TRIES 8
+
+/* A magazine.  Pages in DIRTY may hold anything; pages in ZEROED
+ * are filled with zeros. */
+struct magazine {
+    void   *dirty[MAG_SIZE];  /* Pages of unknown contents. */
+    size_t  dirty_cnt;
+    void   *zeroed[ZERO_MAX]; /* Pages known to be zero. */
+    size_t  zeroed_cnt;
+};
 
 /* A memory pool. */
 struct pool {
     struct lock    lock;     /* Mutual exclusion. */
     struct bitmap *used_map; /* Bitmap of free pages. */
+    struct bitmap *user_map; /* Bitmap of pages allocated to users. */
     uint8_t       *base;     /* Base of pool. */
+    uint8_t       *orders;   /* Per page: 1 + order if it heads a free
+                                block, otherwise 0. */
+    struct list    free_lists[ORDER_CNT]; /* Free blocks by order. */
+    size_t         free_cnt; /* Pages on the free lists. */
+    struct magazine mag;     /* Hot single pages. */
+
+    size_t         user_cnt;   /* Pages allocated to users. */
+    size_t         user_limit; /* Maximum USER_CNT. */
+    size_t         reserve;    /* Free pages kept for the kernel. */
 };
 
-/* Two pools: one for kernel data, one for user pages. */
-static struct pool kernel_pool, user_pool;
+/* The pool of all free memory. */
+static struct pool mem_pool;
+
+/* Gives back user pages under kernel pressure. */
+static palloc_reclaim_func *reclaimer;
+
+/* Page zeroing thread, and whether it is waiting for work. */
+static struct semaphore zeroer_wakeup;
+static bool zeroer_idle;
+
+/* Statistics. */
+static unsigned long long zero_hit_cnt, zero_miss_cnt;
+static unsigned long long user_fail_cnt, reclaim_cnt;
+
+/* A free block, stored in its own first page. */
+struct free_block {
+    struct list_elem elem;   /* Element in a pool's free list. */
+};
 
 static void init_pool(struct pool *, void *base, size_t page_cnt, const char *name);
 
 static bool page_from_pool(const struct pool *, void *page);
 
+static bool ram_usable(uintptr_t paddr);
+
+static size_t block_alloc(struct pool *, size_t order);
+
+static void block_free(struct pool *, size_t page_idx, size_t order);
+
+static void block_insert(struct pool *, size_t page_idx, size_t order);
+
+static void range_free(struct pool *, size_t page_idx, size_t page_cnt);
+
+static void *mag_pop(struct magazine *, bool zero, bool *zeroed);
+
+static bool mag_push(struct magazine *, void *page);
+
+static void *mag_refill(struct pool *);
+
+static void mag_drain(struct pool *, void *page);
+
+static void mag_flush(struct pool *);
+
+static void *pool_get_pages(struct pool *, size_t page_cnt);
+
+static void pool_free_pages(struct pool *, void *pages, size_t page_cnt);
+
+static void pool_free_batch(struct pool *, void **pages, size_t page_cnt);
+
+static void *get_page(struct pool *, enum palloc_flags);
+
+static void *get_multiple(struct pool *, enum palloc_flags, size_t page_cnt);
+
+static bool user_admit(struct pool *, size_t page_cnt);
+
+static void user_charge(struct pool *, void *pages, size_t page_cnt);
+
+static void user_uncharge(struct pool *, void *pages, size_t page_cnt);
+
+static bool reclaim(size_t page_cnt);
+
+static void zeroer_thread(void *aux);
+
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
- * pages are put into the user pool. */
+ * pages are allocated to users at any time. */
 void
 palloc_init(size_t user_page_limit)
 {
     /* Free memory starts at 1 MB and runs to the end of RAM. */
-    uint8_t *free_start = ptov(1024 * 1024);
+    uint8_t *free_start = ptov(FREE_START);
     uint8_t *free_end = ptov(init_ram_pages * PGSIZE);
     size_t free_pages = (free_end - free_start) / PGSIZE;
-    size_t user_pages = free_pages / 2;
-    size_t kernel_pages;
 
-    if (user_pages > user_page_limit) {
-        user_pages = user_page_limit;
+    init_pool(&mem_pool, free_start, free_pages, "page pool");
+    mem_pool.user_limit = user_page_limit;
+    mem_pool.reserve = mem_pool.free_cnt / RESERVE_DIV;
+    if (mem_pool.reserve < RESERVE_MIN) {
+        mem_pool.reserve = RESERVE_MIN;
     }
-    kernel_pages = free_pages - user_pages;
+    printf("%zu pages reserved for the kernel.\n", mem_pool.reserve);
+}
 
-    /* Give half of memory to kernel, half to user. */
-    init_pool(&kernel_pool, free_start, kernel_pages, "kernel pool");
-    init_pool(&user_pool, free_start + kernel_pages * PGSIZE,
-              user_pages, "user pool");
+/* Installs RECLAIM as the function that frees user pages when a
+ * kernel allocation finds no free memory.  It must not sleep
+ * waiting for locks, since its caller may hold any of them. */
+void
+palloc_set_reclaimer(palloc_reclaim_func *reclaim)
+{
+    reclaimer = reclaim;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
- * If PAL_USER is set, the pages are obtained from the user pool,
- * otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+ * If PAL_USER is set, the pages are for user memory and are not
+ * taken out of the kernel reserve.  If PAL_ZERO is set in FLAGS,
  * then the pages are filled with zeros.  If too few pages are
  * available, returns a null pointer, unless PAL_ASSERT is set in
- * FLAGS, in which case the kernel panics. */
+ * FLAGS, in which case the kernel panics.
+ *
+ * If PAGE_CNT is a power of 2 no greater than ALIGN_MAX_PAGES,
+ * the pages are aligned on a multiple of PAGE_CNT pages. */
 void *
 palloc_get_multiple(enum palloc_flags flags, size_t page_cnt)
 {
-    struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
     void *pages;
-    size_t page_idx;
+    int tries = 0;
 
     if (page_cnt == 0) {
         return NULL;
     }
-
-    lock_acquire(&pool->lock);
-    page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-    lock_release(&pool->lock);
-
-    if (page_idx != BITMAP_ERROR) {
-        pages = pool->base + PGSIZE * page_idx;
-    } else {
-        pages = NULL;
+    if (page_cnt == 1) {
+        return palloc_get_page(flags);
     }
 
+    while ((pages = get_multiple(&mem_pool, flags, page_cnt)) == NULL
+           && !(flags & PAL_USER) && tries++ < RECLAIM_TRIES
+           && reclaim(page_cnt)) {
+        continue;
+    }
     if (pages != NULL) {
         if (flags & PAL_ZERO) {
             memset(pages, 0, PGSIZE * page_cnt);
@@ -105,52 +237,326 @@ palloc_get_multiple(enum palloc_flags flags, size_t page_cnt)
 
 /* Obtains a single free page and returns its kernel virtual
  * address.
- * If PAL_USER is set, the page is obtained from the user pool,
- * otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+ * If PAL_USER is set, the page is for user memory and is not
+ * taken out of the kernel reserve.  If PAL_ZERO is set in FLAGS,
  * then the page is filled with zeros.  If no pages are
  * available, returns a null pointer, unless PAL_ASSERT is set in
  * FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page(enum palloc_flags flags)
 {
-    return palloc_get_multiple(flags, 1);
+    void *page;
+    int tries = 0;
+
+    while ((page = get_page(&mem_pool, flags)) == NULL
+           && !(flags & PAL_USER) && tries++ < RECLAIM_TRIES
+           && reclaim(1)) {
+        continue;
+    }
+    if (page == NULL && (flags & PAL_ASSERT)) {
+        PANIC("palloc_get: out of pages");
+    }
+    return page;
+}
+
+/* Takes PAGE_CNT contiguous pages from POOL for palloc_get_multiple(),
+ * without zeroing them.  Returns a null pointer on failure. */
+static void *
+get_multiple(struct pool *pool, enum palloc_flags flags, size_t page_cnt)
+{
+    enum intr_level old_level;
+    void *pages;
+
+    if ((flags & PAL_USER) && !user_admit(pool, page_cnt)) {
+        return NULL;
+    }
+    pages = pool_get_pages(pool, page_cnt);
+    if (pages == NULL) {
+        /* Pages held in the magazine may be what breaks up the
+         * run we need. */
+        mag_flush(pool);
+        pages = pool_get_pages(pool, page_cnt);
+    }
+    if (pages != NULL && (flags & PAL_USER)) {
+        old_level = intr_disable();
+        user_charge(pool, pages, page_cnt);
+        intr_set_level(old_level);
+    }
+    return pages;
+}
+
+/* Takes a page from POOL for palloc_get_page(), zeroing it if
+ * PAL_ZERO is set in FLAGS.  Returns a null pointer on
+ * failure. */
+static void *
+get_page(struct pool *pool, enum palloc_flags flags)
+{
+    enum intr_level old_level;
+    bool zeroed = false;
+    void *page;
+
+    old_level = intr_disable();
+    if ((flags & PAL_USER) && !user_admit(pool, 1)) {
+        intr_set_level(old_level);
+        return NULL;
+    }
+    page = mag_pop(&pool->mag, flags & PAL_ZERO, &zeroed);
+    if (flags & PAL_ZERO) {
+        if (zeroed) {
+            zero_hit_cnt++;
+        } else {
+            zero_miss_cnt++;
+        }
+    }
+    if (zeroer_idle && pool->mag.zeroed_cnt < ZERO_LOW) {
+        zeroer_idle = false;
+        sema_up(&zeroer_wakeup);
+    }
+    intr_set_level(old_level);
+
+    if (page == NULL) {
+        page = mag_refill(pool);
+        zeroed = false;
+    }
+
+    if (page != NULL) {
+        if (flags & PAL_USER) {
+            old_level = intr_disable();
+            user_charge(pool, page, 1);
+            intr_set_level(old_level);
+        }
+        if ((flags & PAL_ZERO) && !zeroed) {
+            memset(page, 0, PGSIZE);
+        }
+    }
+    return page;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple(void *pages, size_t page_cnt)
 {
-    struct pool *pool;
-    size_t page_idx;
+    enum intr_level old_level;
 
     ASSERT(pg_ofs(pages) == 0);
     if (pages == NULL || page_cnt == 0) {
         return;
     }
-
-    if (page_from_pool(&kernel_pool, pages)) {
-        pool = &kernel_pool;
-    } else if (page_from_pool(&user_pool, pages)) {
-        pool = &user_pool;
-    } else {
-        NOT_REACHED();
+    if (page_cnt == 1) {
+        palloc_free_page(pages);
+        return;
     }
 
-    page_idx = pg_no(pages) - pg_no(pool->base);
+    ASSERT(page_from_pool(&mem_pool, pages));
 
 #ifndef NDEBUG
     memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-    ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
-    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+    old_level = intr_disable();
+    user_uncharge(&mem_pool, pages, page_cnt);
+    intr_set_level(old_level);
+    pool_free_pages(&mem_pool, pages, page_cnt);
 }
 
 /* Frees the page at PAGE. */
 void
 palloc_free_page(void *page)
 {
-    palloc_free_multiple(page, 1);
+    enum intr_level old_level;
+    bool pushed;
+
+    ASSERT(pg_ofs(page) == 0);
+    if (page == NULL) {
+        return;
+    }
+    ASSERT(page_from_pool(&mem_pool, page));
+
+#ifndef NDEBUG
+    memset(page, 0xcc, PGSIZE);
+#endif
+
+    old_level = intr_disable();
+    user_uncharge(&mem_pool, page, 1);
+    pushed = mag_push(&mem_pool.mag, page);
+    intr_set_level(old_level);
+
+    if (!pushed) {
+        mag_drain(&mem_pool, page);
+    }
+}
+
+/* Frees the PAGE_CNT single pages whose addresses are in PAGES,
+ * in any order.  Equivalent to calling palloc_free_page() on each,
+ * but cheaper for many pages: interrupts are disabled once to
+ * uncharge them and refill the magazine, and the pool lock is
+ * taken once for the rest. */
+void
+palloc_free_batch(void **pages, size_t page_cnt)
+{
+    enum intr_level old_level;
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++) {
+        ASSERT(pages[i] != NULL && pg_ofs(pages[i]) == 0);
+        ASSERT(page_from_pool(&mem_pool, pages[i]));
+#ifndef NDEBUG
+        memset(pages[i], 0xcc, PGSIZE);
+#endif
+    }
+
+    old_level = intr_disable();
+    for (i = 0; i < page_cnt; i++) {
+        user_uncharge(&mem_pool, pages[i], 1);
+    }
+    for (i = 0; i < page_cnt; i++) {
+        if (!mag_push(&mem_pool.mag, pages[i])) {
+            break;
+        }
+    }
+    intr_set_level(old_level);
+
+    pool_free_batch(&mem_pool, pages + i, page_cnt - i);
+}
+
+/* Starts the thread that keeps zeroed pages ready.  Must be
+ * called after thread_start(). */
+void
+palloc_start_zeroer(void)
+{
+    sema_init(&zeroer_wakeup, 0);
+    thread_create("pagezero", PRI_MIN, zeroer_thread, NULL);
+}
+
+/* Returns the number of pages that may still be allocated to
+ * users before user allocations start to fail, as
+ * user_admit() would judge it. */
+size_t
+palloc_user_free(void)
+{
+    struct pool *pool = &mem_pool;
+    size_t free_cnt = (pool->free_cnt + pool->mag.dirty_cnt
+                       + pool->mag.zeroed_cnt);
+    size_t by_reserve, by_limit;
+
+    by_reserve = free_cnt > pool->reserve ? free_cnt - pool->reserve : 0;
+    by_limit = (pool->user_limit > pool->user_cnt
+                ? pool->user_limit - pool->user_cnt : 0);
+    return by_reserve < by_limit ? by_reserve : by_limit;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats(void)
+{
+    printf("Page allocator: %llu zeroed pages ready, %llu zeroed on "
+           "demand\n", zero_hit_cnt, zero_miss_cnt);
+    printf("Page allocator: %zu user pages, %llu user allocations "
+           "refused, %llu pages reclaimed\n",
+           mem_pool.user_cnt, user_fail_cnt, reclaim_cnt);
+}
+
+/* Returns true if PAGE_CNT more pages may be allocated to users
+ * from POOL: the user limit allows it and more than the kernel
+ * reserve would remain free.  Pages in the magazine count as
+ * free.  The free count is read without the pool lock, which is
+ * good enough for a watermark. */
+static bool
+user_admit(struct pool *pool, size_t page_cnt)
+{
+    size_t free_cnt = (pool->free_cnt + pool->mag.dirty_cnt
+                       + pool->mag.zeroed_cnt);
+
+    if (pool->user_cnt + page_cnt > pool->user_limit
+        || free_cnt < pool->reserve + page_cnt) {
+        user_fail_cnt++;
+        return false;
+    }
+    return true;
+}
+
+/* Records that the PAGE_CNT pages at PAGES in POOL were
+ * allocated to users.  Interrupts must be disabled. */
+static void
+user_charge(struct pool *pool, void *pages, size_t page_cnt)
+{
+    size_t page_idx = pg_no(pages) - pg_no(pool->base);
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    bitmap_set_multiple(pool->user_map, page_idx, page_cnt, true);
+    pool->user_cnt += page_cnt;
+}
+
+/* Undoes user_charge() for the PAGE_CNT pages at PAGES in POOL,
+ * if they were allocated to users.  Interrupts must be
+ * disabled. */
+static void
+user_uncharge(struct pool *pool, void *pages, size_t page_cnt)
+{
+    size_t page_idx = pg_no(pages) - pg_no(pool->base);
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (bitmap_test(pool->user_map, page_idx)) {
+        ASSERT(bitmap_all(pool->user_map, page_idx, page_cnt));
+        bitmap_set_multiple(pool->user_map, page_idx, page_cnt, false);
+        pool->user_cnt -= page_cnt;
+    }
+}
+
+/* Asks the reclaimer to free PAGE_CNT user pages.  Returns true
+ * if it freed any. */
+static bool
+reclaim(size_t page_cnt)
+{
+    size_t freed;
+
+    if (reclaimer == NULL) {
+        return false;
+    }
+    freed = reclaimer(page_cnt);
+    reclaim_cnt += freed;
+    return freed > 0;
+}
+
+/* Page zeroing thread.  Tops up the pool's ready list of zeroed
+ * pages with pages taken straight from its free lists,
+ * then waits until an allocation drains a list below ZERO_LOW.
+ * It runs at the lowest priority, and with the highest nice
+ * value under the MLFQS, so it only uses time that nothing else
+ * wants. */
+static void
+zeroer_thread(void *aux UNUSED)
+{
+    thread_set_nice(NICE_MAX);
+    for (;;) {
+        enum intr_level old_level;
+
+        while (mem_pool.mag.zeroed_cnt < ZERO_MAX) {
+            bool added = false;
+            void *page = pool_get_pages(&mem_pool, 1);
+            if (page == NULL) {
+                break;
+            }
+            memset(page, 0, PGSIZE);
+
+            old_level = intr_disable();
+            if (mem_pool.mag.zeroed_cnt < ZERO_MAX) {
+                mem_pool.mag.zeroed[mem_pool.mag.zeroed_cnt++] = page;
+                added = true;
+            }
+            intr_set_level(old_level);
+            if (!added) {
+                pool_free_pages(&mem_pool, page, 1);
+            }
+        }
+
+        old_level = intr_disable();
+        zeroer_idle = true;
+        intr_set_level(old_level);
+        sema_down(&zeroer_wakeup);
+    }
 }
 
 /* Initializes pool P as starting at START and ending at END,
@@ -158,22 +564,78 @@ palloc_free_page(void *page)
 static void
 init_pool(struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-    /* We'll put the pool's used_map at its base.
-     * Calculate the space needed for the bitmap
-     * and subtract it from the pool's size. */
-    size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+    /* We'll put the pool's bitmaps and order array at its end,
+     * so that the pool keeps the alignment of BASE.  Calculate
+     * the space needed for them and subtract it from the pool's
+     * size. */
+    size_t bm_size = bitmap_buf_size(page_cnt);
+    size_t bm_pages = DIV_ROUND_UP(2 * bm_size + page_cnt, PGSIZE);
+    uint8_t *meta;
+    size_t i, end;
 
     if (bm_pages > page_cnt) {
         PANIC("Not enough memory in %s for bitmap.", name);
     }
     page_cnt -= bm_pages;
 
-    printf("%zu pages available in %s.\n", page_cnt, name);
+    /* Initialize the pool, with every page of usable RAM free and
+     * the rest, which the BIOS keeps for itself, allocated for
+     * good. */
+    lock_init_named(&p->lock, name);
+    p->base = base;
+    meta = p->base + page_cnt * PGSIZE;
+    p->used_map = bitmap_create_in_buf(page_cnt, meta, bm_size);
+    p->user_map = bitmap_create_in_buf(page_cnt, meta + bm_size, bm_size);
+    p->orders = meta + 2 * bm_size;
+    memset(p->orders, 0, page_cnt);
+    for (i = 0; i < ORDER_CNT; i++) {
+        list_init(&p->free_lists[i]);
+    }
+    p->mag.dirty_cnt = p->mag.zeroed_cnt = 0;
+    p->user_cnt = 0;
+    p->free_cnt = 0;
+    for (i = 0; i < page_cnt; i = end) {
+        bool usable = ram_usable(vtop(p->base + i * PGSIZE));
+
+        for (end = i + 1; end < page_cnt; end++) {
+            if (ram_usable(vtop(p->base + end * PGSIZE)) != usable) {
+                break;
+            }
+        }
+        if (usable) {
+            range_free(p, i, end - i);
+            p->free_cnt += end - i;
+        } else {
+            bitmap_set_multiple(p->used_map, i, end - i, true);
+        }
+    }
+
+    printf("%zu pages available in %s.\n", p->free_cnt, name);
+}
+
+/* Returns true if the page at physical address PADDR is usable
+ * RAM according to the BIOS memory map: inside a usable region
+ * and outside every other.  Without a map, all of it is. */
+static bool
+ram_usable(uintptr_t paddr)
+{
+    bool usable = init_mem_map_cnt == 0;
+    uint32_t i;
 
-    /* Initialize the pool. */
-    lock_init(&p->lock);
-    p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
-    p->base = base + bm_pages * PGSIZE;
+    for (i = 0; i < init_mem_map_cnt; i++) {
+        const struct mem_region *r = &init_mem_map[i];
+
+        if (r->base >= paddr + PGSIZE || r->base + r->length <= paddr) {
+            continue;
+        }
+        if (r->type != MEM_USABLE) {
+            return false;
+        }
+        if (r->base <= paddr && paddr + PGSIZE <= r->base + r->length) {
+            usable = true;
+        }
+    }
+    return usable;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -187,3 +649,276 @@ page_from_pool(const struct pool *pool, void *page)
 
     return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages from POOL's free lists and
+ * returns the first, or a null pointer if there is no run that
+ * big. */
+static void *
+pool_get_pages(struct pool *pool, size_t page_cnt)
+{
+    size_t page_idx;
+    size_t order = 0;
+
+    while ((size_t) 1 << order < page_cnt) {
+        order++;
+    }
+
+    lock_acquire(&pool->lock);
+    page_idx = order < ORDER_CNT ? block_alloc(pool, order) : BITMAP_ERROR;
+    if (page_idx != BITMAP_ERROR) {
+        /* Give back the part of the block we don't need. */
+        range_free(pool, page_idx + page_cnt,
+                   ((size_t) 1 << order) - page_cnt);
+        ASSERT(bitmap_none(pool->used_map, page_idx, page_cnt));
+        bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+        pool->free_cnt -= page_cnt;
+    }
+    lock_release(&pool->lock);
+
+    return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Returns the PAGE_CNT pages at PAGES to POOL's free lists.  The
+ * pool lock must not be held. */
+static void
+pool_free_pages(struct pool *pool, void *pages, size_t page_cnt)
+{
+    size_t page_idx = pg_no(pages) - pg_no(pool->base);
+
+    lock_acquire(&pool->lock);
+    ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+    pool->free_cnt += page_cnt;
+    range_free(pool, page_idx, page_cnt);
+    lock_release(&pool->lock);
+}
+
+/* Returns the PAGE_CNT single pages whose addresses are in PAGES
+ * to POOL's free lists, under one acquisition of the pool lock,
+ * which must not be held. */
+static void
+pool_free_batch(struct pool *pool, void **pages, size_t page_cnt)
+{
+    size_t i;
+
+    if (page_cnt == 0) {
+        return;
+    }
+
+    lock_acquire(&pool->lock);
+    for (i = 0; i < page_cnt; i++) {
+        size_t page_idx = pg_no(pages[i]) - pg_no(pool->base);
+
+        ASSERT(bitmap_test(pool->used_map, page_idx));
+        bitmap_reset(pool->used_map, page_idx);
+        range_free(pool, page_idx, 1);
+    }
+    pool->free_cnt += page_cnt;
+    lock_release(&pool->lock);
+}
+
+/* Pops a page off MAG and returns it, or returns a null pointer
+ * if MAG is empty.  Takes a zeroed page if ZERO is true, a dirty
+ * one otherwise, if there is a choice, and sets *ZEROED to tell
+ * which it was.  Interrupts must be disabled. */
+static void *
+mag_pop(struct magazine *mag, bool zero, bool *zeroed)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    *zeroed = mag->zeroed_cnt > 0 && (zero || mag->dirty_cnt == 0);
+    if (*zeroed) {
+        return mag->zeroed[--mag->zeroed_cnt];
+    } else if (mag->dirty_cnt > 0) {
+        return mag->dirty[--mag->dirty_cnt];
+    } else {
+        return NULL;
+    }
+}
+
+/* Pushes PAGE, of unknown contents, onto MAG.  Returns true if
+ * successful, false if MAG is full.  Interrupts must be
+ * disabled. */
+static bool
+mag_push(struct magazine *mag, void *page)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (mag->dirty_cnt >= MAG_SIZE) {
+        return false;
+    }
+    mag->dirty[mag->dirty_cnt++] = page;
+    return true;
+}
+
+/* Takes up to MAG_BATCH pages from POOL's free lists, returns
+ * one of them and puts the rest into POOL's magazine.  Returns a
+ * null pointer if POOL has no free pages. */
+static void *
+mag_refill(struct pool *pool)
+{
+    void *pages[MAG_BATCH];
+    size_t page_cnt = 0;
+    enum intr_level old_level;
+    size_t i;
+
+    lock_acquire(&pool->lock);
+    while (page_cnt < MAG_BATCH) {
+        size_t page_idx = block_alloc(pool, 0);
+        if (page_idx == BITMAP_ERROR) {
+            break;
+        }
+        ASSERT(!bitmap_test(pool->used_map, page_idx));
+        bitmap_mark(pool->used_map, page_idx);
+        pages[page_cnt++] = pool->base + PGSIZE * page_idx;
+    }
+    pool->free_cnt -= page_cnt;
+    lock_release(&pool->lock);
+
+    if (page_cnt == 0) {
+        return NULL;
+    }
+
+    /* Other threads may have filled the magazine meanwhile. */
+    old_level = intr_disable();
+    for (i = 1; i < page_cnt && mag_push(&pool->mag, pages[i]); i++) {
+        continue;
+    }
+    intr_set_level(old_level);
+    for (; i < page_cnt; i++) {
+        pool_free_pages(pool, pages[i], 1);
+    }
+    return pages[0];
+}
+
+/* Frees PAGE, for which POOL's magazine has no room, together
+ * with MAG_BATCH other pages taken out of the magazine, to
+ * POOL's free lists.  Dirty pages go first, so that zeroed ones
+ * stay available. */
+static void
+mag_drain(struct pool *pool, void *page)
+{
+    void *pages[MAG_BATCH + 1];
+    size_t page_cnt = 0;
+    enum intr_level old_level;
+
+    pages[page_cnt++] = page;
+    old_level = intr_disable();
+    while (page_cnt <= MAG_BATCH) {
+        bool zeroed;
+        void *p = mag_pop(&pool->mag, false, &zeroed);
+        if (p == NULL) {
+            break;
+        }
+        pages[page_cnt++] = p;
+    }
+    intr_set_level(old_level);
+
+    pool_free_batch(pool, pages, page_cnt);
+}
+
+/* Returns every page in POOL's magazine to its free lists. */
+static void
+mag_flush(struct pool *pool)
+{
+    for (;;) {
+        enum intr_level old_level;
+        bool zeroed;
+        void *page;
+
+        old_level = intr_disable();
+        page = mag_pop(&pool->mag, false, &zeroed);
+        intr_set_level(old_level);
+        if (page == NULL) {
+            break;
+        }
+        pool_free_pages(pool, page, 1);
+    }
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+ * bigger one if necessary, and returns the index of its first
+ * page.  Returns BITMAP_ERROR if there is no big enough block. */
+static size_t
+block_alloc(struct pool *pool, size_t order)
+{
+    struct free_block *b;
+    size_t page_idx;
+    size_t k;
+
+    for (k = order; list_empty(&pool->free_lists[k]); k++) {
+        if (k + 1 >= ORDER_CNT) {
+            return BITMAP_ERROR;
+        }
+    }
+
+    b = list_entry(list_pop_front(&pool->free_lists[k]),
+                   struct free_block, elem);
+    page_idx = pg_no(b) - pg_no(pool->base);
+    pool->orders[page_idx] = 0;
+
+    /* Put back the upper half of each split. */
+    while (k > order) {
+        k--;
+        block_insert(pool, page_idx + ((size_t) 1 << k), k);
+    }
+    return page_idx;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+ * it with its buddy for as long as the buddy is free too. */
+static void
+block_free(struct pool *pool, size_t page_idx, size_t order)
+{
+    size_t page_cnt = bitmap_size(pool->used_map);
+
+    while (order + 1 < ORDER_CNT) {
+        size_t buddy = page_idx ^ ((size_t) 1 << order);
+        struct free_block *b;
+
+        if (buddy + ((size_t) 1 << order) > page_cnt
+            || pool->orders[buddy] != order + 1) {
+            break;
+        }
+        b = (struct free_block *) (pool->base + buddy * PGSIZE);
+        list_remove(&b->elem);
+        pool->orders[buddy] = 0;
+        if (buddy < page_idx) {
+            page_idx = buddy;
+        }
+        order++;
+    }
+    block_insert(pool, page_idx, order);
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+ * list for ORDER, without merging. */
+static void
+block_insert(struct pool *pool, size_t page_idx, size_t order)
+{
+    struct free_block *b;
+
+    b = (struct free_block *) (pool->base + page_idx * PGSIZE);
+    list_push_front(&pool->free_lists[order], &b->elem);
+    pool->orders[page_idx] = order + 1;
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, which need not
+ * form a single block, by freeing the largest aligned blocks
+ * that make them up. */
+static void
+range_free(struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    while (page_cnt > 0) {
+        size_t order = 0;
+
+        while (order + 1 < ORDER_CNT
+               && page_idx % ((size_t) 2 << order) == 0
+               && (size_t) 2 << order <= page_cnt) {
+            order++;
+        }
+        block_free(pool, page_idx, order);
+        page_idx += (size_t) 1 << order;
+        page_cnt -= (size_t) 1 << order;
+    }
+}
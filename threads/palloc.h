@@ -10,10 +10,23 @@ enum palloc_flags {
     PAL_USER   = 004  /* User page. */
 };
 
+/* palloc_get_multiple() aligns runs of a power of 2 pages up to
+ * this many on their own size. */
+#define ALIGN_MAX_PAGES 256
+
+/* Frees up to PAGE_CNT pages of user memory, returning the
+ * number freed. */
+typedef size_t palloc_reclaim_func(size_t page_cnt);
+
 void palloc_init(size_t user_page_limit);
+void palloc_set_reclaimer(palloc_reclaim_func *);
 void *palloc_get_page(enum palloc_flags);
 void *palloc_get_multiple(enum palloc_flags, size_t page_cnt);
 void palloc_free_page(void *);
 void palloc_free_multiple(void *, size_t page_cnt);
+void palloc_free_batch(void **pages, size_t page_cnt);
+void palloc_start_zeroer(void);
+size_t palloc_user_free(void);
+void palloc_print_stats(void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,178 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Samples are only taken in the timer interrupt, so the tables
+ * need no lock.  The address histogram is an open-addressed hash
+ * table with linear probing that is never shrunk: a profile run
+ * touches a few thousand distinct addresses at most, and once the
+ * table is full, samples at new addresses are only counted as
+ * dropped.  The smaller thread table works the same way. */
+
+/* Number of (thread, address) pairs kept, a power of 2. */
+#define PROFILE_SLOT_CNT 4096
+
+/* Number of threads kept, a power of 2. */
+#define PROFILE_THREAD_CNT 128
+
+/* Samples at one address in one thread. */
+struct profile_slot {
+    uint32_t eip;               /* Sampled address, 0 if free. */
+    tid_t tid;                  /* Sampled thread. */
+    uint32_t cnt;               /* Number of samples. */
+};
+
+/* Samples in one thread. */
+struct profile_thread {
+    tid_t tid;                  /* Thread, 0 if free. */
+    uint32_t user_cnt;          /* Samples in user mode. */
+    uint32_t kernel_cnt;        /* Samples in kernel mode. */
+    char name[16];              /* The thread's name when first seen. */
+};
+
+/* Pages taken by the tables. */
+#define PROFILE_PAGE_CNT                                          \
+    DIV_ROUND_UP(PROFILE_SLOT_CNT * sizeof(struct profile_slot)     \
+                 + PROFILE_THREAD_CNT * sizeof(struct profile_thread), \
+                 PGSIZE)
+
+/* True while samples are being taken. */
+bool profile_enabled;
+
+static bool requested;                  /* -profile was given. */
+static struct profile_slot *slots;      /* PROFILE_SLOT_CNT slots. */
+static struct profile_thread *threads;  /* PROFILE_THREAD_CNT threads. */
+static uint32_t sample_cnt;             /* Samples taken. */
+static uint32_t dropped_cnt;            /* Samples the tables had no room for. */
+
+static unsigned hash_sample(tid_t, uint32_t eip);
+
+/* Asks for profiling to be turned on by profile_init().  Called
+ * for the -profile option, before memory can be allocated. */
+void
+profile_configure(void)
+{
+    requested = true;
+}
+
+/* Allocates the tables and starts sampling, if
+ * profile_configure() was called.  Must be called after
+ * palloc_init(). */
+void
+profile_init(void)
+{
+    if (requested) {
+        slots = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, PROFILE_PAGE_CNT);
+        threads = (struct profile_thread *) (slots + PROFILE_SLOT_CNT);
+        profile_enabled = true;
+    }
+}
+
+/* Counts a sample of interrupted frame F against the running
+ * thread.  Called from the timer interrupt; use profile_sample()
+ * rather than calling this directly. */
+void
+profile_record(const struct intr_frame *f)
+{
+    struct thread *cur = thread_current();
+    uint32_t eip = (uint32_t) f->eip;
+    bool user = (f->cs & 3) == 3;
+    unsigned h, i;
+
+    ASSERT(intr_context());
+
+    sample_cnt++;
+
+    /* Charge the thread. */
+    h = hash_sample(cur->tid, 0);
+    for (i = 0; i < PROFILE_THREAD_CNT; i++) {
+        struct profile_thread *t = &threads[(h + i) & (PROFILE_THREAD_CNT - 1)];
+
+        if (t->tid == 0) {
+            t->tid = cur->tid;
+            strlcpy(t->name, cur->name, sizeof t->name);
+        }
+        if (t->tid == cur->tid) {
+            if (user) {
+                t->user_cnt++;
+            } else {
+                t->kernel_cnt++;
+            }
+            break;
+        }
+    }
+
+    /* Charge the address. */
+    h = hash_sample(cur->tid, eip);
+    for (i = 0; i < PROFILE_SLOT_CNT; i++) {
+        struct profile_slot *s = &slots[(h + i) & (PROFILE_SLOT_CNT - 1)];
+
+        if (s->eip == 0) {
+            s->eip = eip;
+            s->tid = cur->tid;
+        }
+        if (s->eip == eip && s->tid == cur->tid) {
+            s->cnt++;
+            return;
+        }
+    }
+    dropped_cnt++;
+}
+
+/* Stops sampling and writes the tables to the console, as one
+ * "PT <tid> <user> <kernel> <name>" line per thread followed by
+ * one "PS <tid> <u|k> <eip> <count>" line per address, in hex. */
+void
+profile_dump(void)
+{
+    unsigned i;
+
+    if (!profile_enabled) {
+        return;
+    }
+    profile_enabled = false;
+
+    printf("Profile: begin\n");
+    for (i = 0; i < PROFILE_THREAD_CNT; i++) {
+        const struct profile_thread *t = &threads[i];
+
+        if (t->tid != 0) {
+            printf("PT %04x %08"PRIx32" %08"PRIx32" %s\n",
+                   t->tid, t->user_cnt, t->kernel_cnt, t->name);
+        }
+    }
+    for (i = 0; i < PROFILE_SLOT_CNT; i++) {
+        const struct profile_slot *s = &slots[i];
+
+        if (s->eip != 0) {
+            printf("PS %04x %c %08"PRIx32" %08"PRIx32"\n", s->tid,
+                   is_user_vaddr((void *) s->eip) ? 'u' : 'k',
+                   s->eip, s->cnt);
+        }
+    }
+    printf("Profile: end\n");
+}
+
+/* Prints profiling statistics. */
+void
+profile_print_stats(void)
+{
+    if (slots != NULL) {
+        printf("Profile: %"PRIu32" samples, %"PRIu32" dropped\n",
+               sample_cnt, dropped_cnt);
+    }
+}
+
+/* Returns a hash of thread TID and address EIP. */
+static unsigned
+hash_sample(tid_t tid, uint32_t eip)
+{
+    return (eip >> 2) * 2654435761u + (unsigned) tid * 40503u;
+}
@@ -0,0 +1,38 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+
+#include "threads/interrupt.h"
+
+/* Sampling profiler.
+ *
+ * On every timer tick, the timer interrupt hands its frame to
+ * profile_sample(), which counts the interrupted instruction's
+ * address in a histogram keyed by thread and address, and counts
+ * the tick as user or kernel time for the thread.  A function's
+ * share of the samples estimates its share of the CPU.
+ *
+ * Profiling is off unless the kernel is started with -profile.
+ * Then the histogram is written to the console at power off, one
+ * hex line per address, for utils/pintos-profile to aggregate by
+ * function using kernel.o and the user programs. */
+
+extern bool profile_enabled;
+
+void profile_configure(void);
+void profile_init(void);
+void profile_record(const struct intr_frame *);
+void profile_dump(void);
+void profile_print_stats(void);
+
+/* Takes a sample of interrupted frame F, if profiling is on. */
+static inline void
+profile_sample(const struct intr_frame *f)
+{
+    if (profile_enabled) {
+        profile_record(f);
+    }
+}
+
+#endif /* threads/profile.h */
@@ -67,8 +67,12 @@ pd_no(const void *va)
 #define PTE_P     0x1        /* 1=present, 0=not present. */
 #define PTE_W     0x2        /* 1=read/write, 0=read-only. */
 #define PTE_U     0x4        /* 1=user/kernel, 0=kernel only. */
+#define PTE_PWT   0x8        /* 1=write-through, 0=write-back. */
+#define PTE_PCD   0x10       /* 1=cache disabled, 0=cache enabled. */
 #define PTE_A     0x20       /* 1=accessed, 0=not acccessed. */
 #define PTE_D     0x40       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS    0x80       /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G     0x100      /* 1=global, kept in the TLB across CR3 loads. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t
@@ -78,34 +82,57 @@ pde_create(uint32_t *pt)
     return vtop(pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps a 4 MB kernel page starting at PAGE,
+ * which must be 4 MB-aligned, without a page table.  The page is
+ * readable, and writable as well if WRITABLE is true, and global
+ * like pte_create_kernel()'s.  Requires CR4.PSE.  See [IA32-v3a]
+ * 3.7.3 "Mixing 4-KByte and 4-MByte Pages". */
+static inline uint32_t
+pde_create_large(void *page, bool writable)
+{
+    ASSERT((vtop(page) & (PTSPAN - 1)) == 0);
+    return vtop(page) | PTE_PS | PTE_G | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a pointer to the page table that page directory entry
  * PDE, which must "present", points to. */
 static inline uint32_t *
 pde_get_pt(uint32_t pde)
 {
     ASSERT(pde & PTE_P);
+    ASSERT(!(pde & PTE_PS));
     return ptov(pde & PTE_ADDR);
 }
 
 /* Returns a PTE that points to PAGE.
  * The PTE's page is readable.
  * If WRITABLE is true then it will be writable as well.
- * The page will be usable only by ring 0 code (the kernel). */
+ * The page will be usable only by ring 0 code (the kernel).
+ *
+ * Every page directory has the same kernel mappings, so the PTE
+ * is global: with CR4.PGE set, its TLB entry survives the CR3
+ * load of a switch to another process.  Changing or removing such
+ * a mapping must therefore be followed by INVLPG on the page,
+ * since reloading CR3 does not flush it.  Without CR4.PGE the bit
+ * is ignored. */
 static inline uint32_t
 pte_create_kernel(void *page, bool writable)
 {
     ASSERT(pg_ofs(page) == 0);
-    return vtop(page) | PTE_P | (writable ? PTE_W : 0);
+    return vtop(page) | PTE_G | PTE_P | (writable ? PTE_W : 0);
 }
 
 /* Returns a PTE that points to PAGE.
  * The PTE's page is readable.
  * If WRITABLE is true then it will be writable as well.
- * The page will be usable by both user and kernel code. */
+ * The page will be usable by both user and kernel code.
+ * Unlike a kernel PTE, it is not global, since user mappings
+ * differ from one page directory to the next. */
 static inline uint32_t
 pte_create_user(void *page, bool writable)
 {
-    return pte_create_kernel(page, writable) | PTE_U;
+    ASSERT(pg_ofs(page) == 0);
+    return vtop(page) | PTE_U | PTE_P | (writable ? PTE_W : 0);
 }
 
 /* Returns a pointer to the page that page table entry PTE points
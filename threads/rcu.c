@@ -0,0 +1,131 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include <stdio.h>
+
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Callbacks waiting for a grace period, oldest first.  Protected
+ * by disabling interrupts, so that call_rcu() works in interrupt
+ * handlers too. */
+static struct list pending;
+
+/* Runs the pending callbacks. */
+static struct workqueue rcu_wq;
+static struct work reclaim_work;
+
+/* Statistics. */
+static unsigned long long callback_cnt; /* Callbacks run. */
+static unsigned long long grace_cnt;    /* Grace periods completed. */
+
+static void reclaim(struct work *);
+
+/* Starts the thread that runs call_rcu() callbacks.  Must be
+ * called after thread_start() and before call_rcu(). */
+void
+rcu_init(void)
+{
+    list_init(&pending);
+    work_init(&reclaim_work, reclaim);
+    workqueue_init(&rcu_wq, "rcu", PRI_DEFAULT, 1);
+}
+
+/* Starts a read section, in which the running thread will not
+ * be preempted.  Read sections nest.  May be called from an
+ * interrupt handler, where it protects the interrupted thread's
+ * walk as well. */
+void
+rcu_read_lock(void)
+{
+    thread_current()->rcu_nesting++;
+    barrier();
+}
+
+/* Ends a read section.  If the running thread should have been
+ * preempted meanwhile, it is preempted now. */
+void
+rcu_read_unlock(void)
+{
+    struct thread *cur = thread_current();
+
+    barrier();
+    ASSERT(cur->rcu_nesting > 0);
+    if (--cur->rcu_nesting == 0 && cur->rcu_preempted) {
+        cur->rcu_preempted = false;
+        if (intr_context()) {
+            intr_yield_on_return();
+        } else {
+            thread_preempt();
+        }
+    }
+}
+
+/* Called when the running thread is about to be preempted.  If
+ * it is in a read section, notes that it must yield at the end of
+ * the section and returns true.  Otherwise, returns false. */
+bool
+rcu_defer_preempt(void)
+{
+    struct thread *cur = thread_current();
+
+    if (cur->rcu_nesting == 0) {
+        return false;
+    }
+    cur->rcu_preempted = true;
+    return true;
+}
+
+/* Arranges for FUNC to be called with HEAD after every read
+ * section now in progress has ended.  May be called from an
+ * interrupt handler or within a read section. */
+void
+call_rcu(struct rcu_head *head, rcu_func *func)
+{
+    enum intr_level old_level;
+
+    ASSERT(head != NULL);
+    ASSERT(func != NULL);
+
+    head->func = func;
+    old_level = intr_disable();
+    list_push_back(&pending, &head->elem);
+    work_queue(&rcu_wq, &reclaim_work);
+    intr_set_level(old_level);
+}
+
+/* Prints RCU statistics. */
+void
+rcu_print_stats(void)
+{
+    printf("RCU: %llu callbacks after %llu grace periods\n",
+           callback_cnt, grace_cnt);
+}
+
+/* Runs the callbacks queued so far.  Any thread that queued one
+ * has since been switched out, or was interrupted by a handler
+ * that queued one and then switched out, because this worker is
+ * running; that is the grace period. */
+static void
+reclaim(struct work *w UNUSED)
+{
+    struct list batch;
+    enum intr_level old_level;
+
+    list_init(&batch);
+    old_level = intr_disable();
+    while (!list_empty(&pending)) {
+        list_push_back(&batch, list_pop_front(&pending));
+    }
+    grace_cnt++;
+    intr_set_level(old_level);
+
+    while (!list_empty(&batch)) {
+        struct rcu_head *head = list_entry(list_pop_front(&batch),
+                                           struct rcu_head, elem);
+
+        callback_cnt++;
+        head->func(head);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read-copy update.
+ *
+ * For lists and tables that are walked far more often than they
+ * change.  A reader brackets its walk with rcu_read_lock() and
+ * rcu_read_unlock(), which neither take a lock nor turn
+ * interrupts off: they only keep the running thread from being
+ * preempted until the walk is over.  A read section must not
+ * sleep or yield.
+ *
+ * A writer, serialized against other writers by its own means,
+ * unlinks an object and hands it to call_rcu() instead of
+ * freeing it.  The callback runs after a grace period, once
+ * every reader that might still see the object is done.  On one
+ * CPU a thread that has been switched out is in a quiescent
+ * state, since its read sections can neither sleep nor be
+ * preempted, so the grace period is over by the time another
+ * thread runs.  Callbacks run in a worker thread, which cannot
+ * get the CPU until then; they may sleep. */
+
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+
+/* A pending call_rcu() callback, embedded in the object that it
+ * frees. */
+struct rcu_head {
+    struct list_elem elem; /* Element in the list of callbacks. */
+    rcu_func *func;        /* Function to run. */
+};
+
+/* Converts pointer to rcu_head HEAD into a pointer to the
+ * structure that HEAD is embedded inside. */
+#define rcu_entry(HEAD, STRUCT, MEMBER)                   \
+    ((STRUCT *) ((uint8_t *) (HEAD) - offsetof(STRUCT, MEMBER)))
+
+void rcu_init(void);
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+bool rcu_defer_preempt(void);
+void call_rcu(struct rcu_head *, rcu_func *);
+void rcu_print_stats(void);
+
+#endif /* threads/rcu.h */
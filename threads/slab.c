@@ -0,0 +1,281 @@
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches, a slab allocator after Bonwick's.
+ *
+ * malloc() rounds each request up to a power of 2, which wastes
+ * up to half of every block, and every subsystem that allocates
+ * blocks of the same size shares one descriptor lock.  An object
+ * cache instead hands out objects of a single type.  Its memory
+ * comes in one-page "slabs", each cut into as many objects of
+ * exactly the cache's size as fit after the slab's header, and
+ * each cache has a lock of its own.
+ *
+ * A cache may have a constructor, which is called on each object
+ * once, when its slab is created, rather than on every
+ * allocation.  Objects must then be freed in their constructed
+ * state, so that the next allocation can skip the work.  To make
+ * that possible, the free objects in a slab are tracked by index
+ * in the header instead of being linked through the objects
+ * themselves.
+ *
+ * Slabs with free objects are kept on the cache's list of partial
+ * slabs; full ones are on no list.  A slab whose last object is
+ * freed goes back to the page allocator, unless it is the cache's
+ * only empty slab, which is kept to absorb an allocation and a
+ * free that alternate across a slab boundary. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Marks the end of a slab's free list. */
+#define SLAB_NONE UINT16_MAX
+
+/* An object cache. */
+struct kmem_cache {
+    const char *name;         /* Name, for statistics. */
+    size_t size;              /* Object size, rounded up to alignment. */
+    size_t obj_ofs;           /* Offset of the first object in a slab. */
+    size_t obj_cnt;           /* Objects per slab. */
+    kmem_ctor_func *ctor;     /* Constructor, or a null pointer. */
+    struct lock lock;         /* Protects everything below. */
+    struct list partial;      /* Slabs with free objects. */
+    size_t empty_cnt;         /* Partial slabs with no objects in use. */
+    size_t slab_cnt;          /* Slabs. */
+    size_t in_use;            /* Objects allocated. */
+    struct list_elem elem;    /* Element in the list of caches. */
+};
+
+/* A slab, stored at the start of the page it describes.  NEXT
+ * links the free objects by index. */
+struct slab {
+    unsigned magic;           /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache; /* Owning cache. */
+    struct list_elem elem;    /* Element in the cache's partial list. */
+    size_t in_use;            /* Objects allocated. */
+    uint16_t free;            /* First free object, or SLAB_NONE. */
+    uint16_t next[];          /* Next free object after each one. */
+};
+
+/* Every cache, for statistics. */
+static struct list caches;
+static struct lock caches_lock;
+
+static struct slab *slab_create(struct kmem_cache *);
+
+static void *slab_object(struct kmem_cache *, struct slab *, size_t idx);
+
+/* Initializes the object cache allocator. */
+void
+kmem_init(void)
+{
+    list_init(&caches);
+    lock_init(&caches_lock);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes each,
+ * aligned on ALIGN bytes, which must be a power of 2, or on the
+ * natural word size if ALIGN is 0.  If CTOR is nonnull, it is
+ * called on each object when the object's slab is created.  NAME
+ * identifies the cache in statistics.  Panics if memory for the
+ * cache is not available, since caches are created while the
+ * kernel initializes. */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+                  kmem_ctor_func *ctor)
+{
+    struct kmem_cache *c;
+    size_t obj_cnt;
+
+    if (align == 0) {
+        align = sizeof(void *);
+    }
+    ASSERT((align & (align - 1)) == 0);
+    size = ROUND_UP(size > 0 ? size : 1, align);
+
+    /* Fit as many objects as we can after the header and its
+     * free list. */
+    obj_cnt = (PGSIZE - sizeof(struct slab)) / (size + sizeof(uint16_t));
+    while (obj_cnt > 0
+           && ROUND_UP(sizeof(struct slab) + obj_cnt * sizeof(uint16_t),
+                       align) + obj_cnt * size > PGSIZE) {
+        obj_cnt--;
+    }
+    if (obj_cnt == 0 || obj_cnt >= SLAB_NONE) {
+        PANIC("kmem_cache_create: can't fit %s objects in a slab", name);
+    }
+
+    c = malloc(sizeof *c);
+    if (c == NULL) {
+        PANIC("kmem_cache_create: out of memory for %s cache", name);
+    }
+    c->name = name;
+    c->size = size;
+    c->obj_cnt = obj_cnt;
+    c->obj_ofs = ROUND_UP(sizeof(struct slab) + obj_cnt * sizeof(uint16_t),
+                          align);
+    c->ctor = ctor;
+    lock_init_named(&c->lock, name);
+    list_init(&c->partial);
+    c->empty_cnt = 0;
+    c->slab_cnt = 0;
+    c->in_use = 0;
+
+    lock_acquire(&caches_lock);
+    list_push_back(&caches, &c->elem);
+    lock_release(&caches_lock);
+    return c;
+}
+
+/* Allocates and returns an object from cache C, in constructed
+ * state if C has a constructor.  Returns a null pointer if
+ * memory is not available. */
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+    struct slab *s;
+    void *obj;
+
+    lock_acquire(&c->lock);
+    if (list_empty(&c->partial)) {
+        s = slab_create(c);
+        if (s == NULL) {
+            lock_release(&c->lock);
+            return NULL;
+        }
+    }
+    s = list_entry(list_front(&c->partial), struct slab, elem);
+
+    if (s->in_use++ == 0) {
+        c->empty_cnt--;
+    }
+    obj = slab_object(c, s, s->free);
+    s->free = s->next[s->free];
+    if (s->free == SLAB_NONE) {
+        list_remove(&s->elem);
+    }
+    c->in_use++;
+    lock_release(&c->lock);
+    return obj;
+}
+
+/* Allocates and returns an object from cache C, which must not
+ * have a constructor, filled with zeros.  Returns a null pointer
+ * if memory is not available. */
+void *
+kmem_cache_zalloc(struct kmem_cache *c)
+{
+    void *obj;
+
+    ASSERT(c->ctor == NULL);
+
+    obj = kmem_cache_alloc(c);
+    if (obj != NULL) {
+        memset(obj, 0, c->size);
+    }
+    return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C, or
+ * does nothing if OBJ is a null pointer. */
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+    struct slab *s;
+    size_t idx;
+
+    if (obj == NULL) {
+        return;
+    }
+    s = pg_round_down(obj);
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->cache == c);
+    idx = ((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) / c->size;
+    ASSERT(slab_object(c, s, idx) == obj);
+
+    lock_acquire(&c->lock);
+    if (s->free == SLAB_NONE) {
+        /* Full slabs go first, for the next allocation to fill. */
+        list_push_front(&c->partial, &s->elem);
+    }
+    s->next[idx] = s->free;
+    s->free = idx;
+    c->in_use--;
+    if (--s->in_use == 0) {
+        if (c->empty_cnt > 0) {
+            list_remove(&s->elem);
+            c->slab_cnt--;
+            lock_release(&c->lock);
+            s->magic = 0;
+            palloc_free_page(s);
+            return;
+        }
+        c->empty_cnt++;
+    }
+    lock_release(&c->lock);
+}
+
+/* Prints object cache statistics. */
+void
+kmem_print_stats(void)
+{
+    struct list_elem *e;
+
+    lock_acquire(&caches_lock);
+    for (e = list_begin(&caches); e != list_end(&caches); e = list_next(e)) {
+        struct kmem_cache *c = list_entry(e, struct kmem_cache, elem);
+
+        printf("Object cache %s: %zu objects of %zu bytes in use, "
+               "%zu slabs of %zu\n",
+               c->name, c->in_use, c->size, c->slab_cnt, c->obj_cnt);
+    }
+    lock_release(&caches_lock);
+}
+
+/* Creates a new, empty slab for cache C and adds it to C's
+ * partial list.  Returns the slab, or a null pointer if memory
+ * is not available.  C's lock must be held. */
+static struct slab *
+slab_create(struct kmem_cache *c)
+{
+    struct slab *s;
+    size_t i;
+
+    ASSERT(lock_held_by_current_thread(&c->lock));
+
+    s = palloc_get_page(0);
+    if (s == NULL) {
+        return NULL;
+    }
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->in_use = 0;
+    s->free = 0;
+    for (i = 0; i < c->obj_cnt; i++) {
+        s->next[i] = i + 1 < c->obj_cnt ? i + 1 : SLAB_NONE;
+        if (c->ctor != NULL) {
+            c->ctor(slab_object(c, s, i));
+        }
+    }
+    list_push_back(&c->partial, &s->elem);
+    c->empty_cnt++;
+    c->slab_cnt++;
+    return s;
+}
+
+/* Returns object IDX in slab S of cache C. */
+static void *
+slab_object(struct kmem_cache *c, struct slab *s, size_t idx)
+{
+    return (uint8_t *) s + c->obj_ofs + idx * c->size;
+}
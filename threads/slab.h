@@ -0,0 +1,21 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* An object cache.  See slab.c. */
+struct kmem_cache;
+
+/* Puts newly allocated memory for an object into its initial,
+ * "constructed" state. */
+typedef void kmem_ctor_func(void *obj);
+
+void kmem_init(void);
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, kmem_ctor_func *);
+void *kmem_cache_alloc(struct kmem_cache *);
+void *kmem_cache_zalloc(struct kmem_cache *);
+void kmem_cache_free(struct kmem_cache *, void *);
+void kmem_print_stats(void);
+
+#endif /* threads/slab.h */
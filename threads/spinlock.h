@@ -0,0 +1,52 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include "threads/atomic.h"
+#include "threads/interrupt.h"
+
+/* Spinlock, for the short critical sections inside semaphores and
+ * the other primitives built on them.
+ *
+ * Turning interrupts off shuts out everything else on the running
+ * processor only.  A spinlock, always taken with interrupts off
+ * already, shuts out the other processors as well: one that finds
+ * it held spins until the holder, which nothing can interrupt,
+ * lets go.  So it must be held only briefly, and never across
+ * anything that sleeps. */
+struct spinlock {
+    int locked; /* 1 if held, 0 if free. */
+};
+
+static inline void
+spinlock_init(struct spinlock *s)
+{
+    s->locked = 0;
+}
+
+/* Acquires S, spinning until it is free.  Interrupts must be
+ * off. */
+static inline void
+spin_lock(struct spinlock *s)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    while (atomic_xchg(&s->locked, 1) != 0) {
+        /* Wait with plain reads, which do not take the cache line
+         * away from the holder, before trying again. */
+        while (*(volatile int *) &s->locked) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+/* Releases S, which the running processor holds. */
+static inline void
+spin_unlock(struct spinlock *s)
+{
+    ASSERT(s->locked);
+
+    atomic_xchg(&s->locked, 0);
+}
+
+#endif /* threads/spinlock.h */
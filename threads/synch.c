@@ -27,11 +27,114 @@
  */
 
 #include <stdio.h>
+#include <kstat.h>
 #include <string.h>
 
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+static void insert_by_priority(struct list *, struct list_elem *,
+                               list_less_func *);
+
+static bool thread_priority_less(const struct list_elem *a,
+                                 const struct list_elem *b, void *aux);
+
+/* Locks acquired, and the acquisitions that had to wait first,
+ * for kstat().  Updated with interrupts off. */
+static unsigned long long lock_acquire_cnt, lock_contend_cnt;
+
+#ifdef LOCKSTAT
+/* Statistics for the locks with one name.  Times are in
+ * timer_cycles(). */
+struct lock_class {
+    const char *name;             /* Lock name, null if unused. */
+    unsigned long long acquired;  /* Acquisitions. */
+    unsigned long long contended; /* Waits to acquire. */
+    uint64_t wait, max_wait;      /* Total and longest wait. */
+    uint64_t hold, max_hold;      /* Total and longest hold. */
+};
+
+/* Lock classes.  Names beyond LOCKSTAT_CLASSES share the last
+ * entry. */
+static struct lock_class lock_classes[LOCKSTAT_CLASSES + 1];
+
+/* Gives LOCK the class for NAME. */
+static void
+lockstat_init(struct lock *lock, const char *name)
+{
+    enum intr_level old_level = intr_disable();
+    struct lock_class *c;
+
+    for (c = lock_classes; c < lock_classes + LOCKSTAT_CLASSES; c++) {
+        if (c->name == NULL) {
+            c->name = name;
+            break;
+        } else if (c->name == name || !strcmp(c->name, name)) {
+            break;
+        }
+    }
+    if (c == lock_classes + LOCKSTAT_CLASSES) {
+        c->name = "other locks";
+    }
+    lock->class = c;
+    intr_set_level(old_level);
+}
+
+/* Returns the time at which the running thread starts waiting
+ * for LOCK, or 0 if LOCK is free.  Interrupts must be off. */
+static uint64_t
+lockstat_wait_begin(struct lock *lock)
+{
+    return lock->semaphore.value == 0 ? timer_cycles() : 0;
+}
+
+/* Counts the end of a wait for LOCK that began at START, as
+ * returned by lockstat_wait_begin().  Interrupts must be off. */
+static void
+lockstat_wait_end(struct lock *lock, uint64_t start)
+{
+    struct lock_class *c = lock->class;
+    uint64_t wait;
+
+    if (start != 0) {
+        wait = timer_cycles() - start;
+        c->contended++;
+        c->wait += wait;
+        if (wait > c->max_wait) {
+            c->max_wait = wait;
+        }
+    }
+}
+
+/* Counts an acquisition of LOCK.  Interrupts must be off. */
+static void
+lockstat_take(struct lock *lock)
+{
+    lock->class->acquired++;
+    lock->taken_at = timer_cycles();
+}
+
+/* Counts the release of LOCK.  Interrupts must be off. */
+static void
+lockstat_release(struct lock *lock)
+{
+    struct lock_class *c = lock->class;
+    uint64_t hold = timer_cycles() - lock->taken_at;
+
+    c->hold += hold;
+    if (hold > c->max_hold) {
+        c->max_hold = hold;
+    }
+}
+#else
+#define lockstat_init(LOCK, NAME) ((void) 0)
+#define lockstat_wait_begin(LOCK) 0
+#define lockstat_wait_end(LOCK, START) ((void) (START))
+#define lockstat_take(LOCK) ((void) 0)
+#define lockstat_release(LOCK) ((void) 0)
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
  * nonnegative integer along with two atomic operators for
@@ -47,6 +150,7 @@ sema_init(struct semaphore *sema, unsigned value)
 {
     ASSERT(sema != NULL);
 
+    spinlock_init(&sema->guard);
     sema->value = value;
     list_init(&sema->waiters);
 }
@@ -54,6 +158,16 @@ sema_init(struct semaphore *sema, unsigned value)
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
  * to become positive and then atomically decrements it.
  *
+ * Waiters are kept in descending order of priority, with
+ * threads of equal priority in FIFO order, so that sema_up()
+ * can wake the highest-priority waiter without a search.
+ *
+ * SEMA's guard covers its value and waiters against other
+ * processors.  It is dropped just before thread_block(), since a
+ * spinlock must not be held while sleeping; interrupts stay off
+ * across the gap, and only the bootstrap processor schedules
+ * threads, so no sema_up() can come between.
+ *
  * This function may sleep, so it must not be called within an
  * interrupt handler.  This function may be called with
  * interrupts disabled, but if it sleeps then the next scheduled
@@ -67,12 +181,98 @@ sema_down(struct semaphore *sema)
     ASSERT(!intr_context());
 
     old_level = intr_disable();
+    spin_lock(&sema->guard);
     while (sema->value == 0) {
-        list_push_back(&sema->waiters, &thread_current()->elem);
+        struct thread *cur = thread_current();
+
+        insert_by_priority(&sema->waiters, &cur->elem, thread_priority_less);
+        cur->waiting_sema = sema;
+        spin_unlock(&sema->guard);
         thread_block();
+        spin_lock(&sema->guard);
+        cur->waiting_sema = NULL;
     }
     sema->value--;
+    spin_unlock(&sema->guard);
+    intr_set_level(old_level);
+}
+
+/* A thread waiting in sema_down_timeout(). */
+struct sema_waiter {
+    struct timeout timeout; /* Ends the wait. */
+    struct thread *thread;  /* Waiting thread. */
+    bool timed_out;         /* Has TIMEOUT run? */
+};
+
+/* Runs when a sema_down_timeout() wait times out.  Takes the
+ * waiting thread off the semaphore's waiters and wakes it, unless
+ * sema_up() already has. */
+static void
+sema_timeout(void *waiter_)
+{
+    struct sema_waiter *w = waiter_;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    w->timed_out = true;
+    if (w->thread->status == THREAD_BLOCKED) {
+        struct semaphore *sema = w->thread->waiting_sema;
+
+        ASSERT(sema != NULL);
+        spin_lock(&sema->guard);
+        list_remove(&w->thread->elem);
+        spin_unlock(&sema->guard);
+        thread_unblock(w->thread);
+        thread_yield_to_higher();
+    }
+    intr_set_level(old_level);
+}
+
+/* Down or "P" operation on a semaphore, giving up after TICKS
+ * timer ticks.  Returns true if SEMA was decremented, false if
+ * the wait timed out.  With TICKS of 0 or less this is
+ * sema_try_down().
+ *
+ * The wait is ended by a timer_add() callback, so it costs
+ * nothing while the semaphore is being upped in time.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. */
+bool
+sema_down_timeout(struct semaphore *sema, int64_t ticks)
+{
+    struct sema_waiter w;
+    enum intr_level old_level;
+    bool success;
+
+    ASSERT(sema != NULL);
+    ASSERT(!intr_context());
+
+    old_level = intr_disable();
+    spin_lock(&sema->guard);
+    if (sema->value == 0 && ticks > 0) {
+        w.thread = thread_current();
+        w.timed_out = false;
+        timeout_init(&w.timeout, sema_timeout, &w);
+        timer_add(&w.timeout, ticks);
+        while (sema->value == 0 && !w.timed_out) {
+            insert_by_priority(&sema->waiters, &w.thread->elem,
+                               thread_priority_less);
+            w.thread->waiting_sema = sema;
+            spin_unlock(&sema->guard);
+            thread_block();
+            spin_lock(&sema->guard);
+            w.thread->waiting_sema = NULL;
+        }
+        timer_cancel(&w.timeout);
+    }
+    success = sema->value > 0;
+    if (success) {
+        sema->value--;
+    }
+    spin_unlock(&sema->guard);
     intr_set_level(old_level);
+    return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -89,37 +289,82 @@ sema_try_down(struct semaphore *sema)
     ASSERT(sema != NULL);
 
     old_level = intr_disable();
+    spin_lock(&sema->guard);
     if (sema->value > 0) {
         sema->value--;
         success = true;
     } else {
         success = false;
     }
+    spin_unlock(&sema->guard);
     intr_set_level(old_level);
 
     return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
- * and wakes up one thread of those waiting for SEMA, if any.
+ * and wakes up the highest-priority thread of those waiting for
+ * SEMA, if any.  If that thread outranks the running thread, the
+ * running thread yields to it at once, or, in an interrupt
+ * handler, as soon as the handler returns.
  *
  * This function may be called from an interrupt handler. */
 void
 sema_up(struct semaphore *sema)
 {
     enum intr_level old_level;
+    struct thread *t = NULL;
 
     ASSERT(sema != NULL);
 
     old_level = intr_disable();
+    spin_lock(&sema->guard);
     if (!list_empty(&sema->waiters)) {
-        thread_unblock(list_entry(list_pop_front(&sema->waiters),
-                                  struct thread, elem));
+        t = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
     }
     sema->value++;
+    spin_unlock(&sema->guard);
+    if (t != NULL) {
+        thread_unblock(t);
+    }
+    thread_yield_to_higher();
     intr_set_level(old_level);
 }
 
+/* Moves T, which is blocked in sema_down() on SEMA, to the
+ * position in SEMA's waiters that matches T's new priority.
+ * Called when a donation changes the priority of a blocked
+ * thread.  Interrupts must be off. */
+void
+sema_reposition(struct semaphore *sema, struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spin_lock(&sema->guard);
+    list_remove(&t->elem);
+    insert_by_priority(&sema->waiters, &t->elem, thread_priority_less);
+    spin_unlock(&sema->guard);
+}
+
+/* Inserts ELEM into LIST, which is sorted in descending order
+ * according to LESS, after every element that is not less than
+ * ELEM.  The scan starts from the back, so appending behind
+ * waiters of equal or higher priority, by far the common case,
+ * takes constant time. */
+static void
+insert_by_priority(struct list *list, struct list_elem *elem,
+                   list_less_func *less)
+{
+    struct list_elem *e;
+
+    for (e = list_rbegin(list); e != list_rend(list); e = list_prev(e)) {
+        if (!less(e, elem, NULL)) {
+            break;
+        }
+    }
+    list_insert(list_next(e), elem);
+}
+
 static void sema_test_helper(void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -169,20 +414,103 @@ sema_test_helper(void *sema_)
  * another one "up" it, but with a lock the same thread must both
  * acquire and release it.  When these restrictions prove
  * onerous, it's a good sign that a semaphore should be used,
- * instead of a lock. */
+ * instead of a lock.
+ *
+ * NAME, which must stay valid, is the lock's name for
+ * lock_print_stats().  The lock_init() macro supplies one. */
 void
-lock_init(struct lock *lock)
+lock_init_named(struct lock *lock, const char *name)
 {
     ASSERT(lock != NULL);
+    ASSERT(name != NULL);
 
     lock->holder = NULL;
     sema_init(&lock->semaphore, 1);
+    lock->priority = PRI_MIN - 1;
+    lockstat_init(lock, name);
+}
+
+/* Donates the running thread's priority to the holder of LOCK,
+ * which the running thread is about to wait for, and onward
+ * along the chain of locks that each holder is itself waiting
+ * for.  The walk stops after LOCK_DONATION_DEPTH links or as
+ * soon as a lock already carries at least this priority, since
+ * everything beyond it was then updated by an earlier donation.
+ * Interrupts must be off. */
+static void
+donate_priority(struct lock *lock)
+{
+    int priority = thread_current()->priority;
+    int depth;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (depth = 0; lock != NULL && depth < LOCK_DONATION_DEPTH; depth++) {
+        struct thread *holder = lock->holder;
+
+        if (lock->priority >= priority) {
+            break;
+        }
+        lock->priority = priority;
+        if (holder == NULL) {
+            break;
+        }
+        if (holder->priority < priority) {
+            thread_reprioritize(holder, priority);
+        }
+        lock = holder->waiting_lock;
+    }
+}
+
+/* Orders threads by ascending effective priority. */
+static bool
+thread_priority_less(const struct list_elem *a, const struct list_elem *b,
+                     void *aux UNUSED)
+{
+    return list_entry(a, struct thread, elem)->priority
+           < list_entry(b, struct thread, elem)->priority;
+}
+
+/* Makes the running thread the holder of LOCK, which it has
+ * just obtained, and picks up whatever priority the threads
+ * still waiting on LOCK are donating.  Interrupts must be
+ * off. */
+static void
+lock_take(struct lock *lock)
+{
+    struct thread *cur = thread_current();
+    struct list *waiters = &lock->semaphore.waiters;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    lock->holder = cur;
+    cur->waiting_lock = NULL;
+    list_push_back(&cur->locks, &lock->elem);
+    lock_acquire_cnt++;
+    lockstat_take(lock);
+
+    spin_lock(&lock->semaphore.guard);
+    lock->priority = (list_empty(waiters)
+                      ? PRI_MIN - 1
+                      : list_entry(list_front(waiters),
+                                   struct thread, elem)->priority);
+    spin_unlock(&lock->semaphore.guard);
+    if (lock->priority >= PRI_MIN) {
+        if (!thread_mlfqs && lock->priority > cur->priority) {
+            thread_reprioritize(cur, lock->priority);
+        }
+    }
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
  * necessary.  The lock must not already be held by the current
  * thread.
  *
+ * If the lock is held by a lower-priority thread, the running
+ * thread donates its priority to the holder for as long as it
+ * waits (see donate_priority()).  Donation is disabled under the
+ * MLFQS.
+ *
  * This function may sleep, so it must not be called within an
  * interrupt handler.  This function may be called with
  * interrupts disabled, but interrupts will be turned back on if
@@ -190,12 +518,91 @@ lock_init(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+    enum intr_level old_level;
+    uint64_t wait_start;
+
     ASSERT(lock != NULL);
     ASSERT(!intr_context());
     ASSERT(!lock_held_by_current_thread(lock));
 
+    old_level = intr_disable();
+    wait_start = lockstat_wait_begin(lock);
+    if (lock->holder != NULL) {
+        lock_contend_cnt++;
+        thread_current()->waiting_lock = lock;
+        if (!thread_mlfqs) {
+            donate_priority(lock);
+        }
+    }
     sema_down(&lock->semaphore);
-    lock->holder = thread_current();
+    lockstat_wait_end(lock, wait_start);
+    lock_take(lock);
+    intr_set_level(old_level);
+}
+
+/* Takes back the priority the running thread donated through
+ * LOCK, which it has stopped waiting for without obtaining it.
+ * LOCK's priority is recomputed from the remaining waiters and
+ * its holder's from the locks it holds.  Priority donated to
+ * locks further along the chain stays until they are released.
+ * Interrupts must be off. */
+static void
+withdraw_priority(struct lock *lock)
+{
+    struct list *waiters = &lock->semaphore.waiters;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spin_lock(&lock->semaphore.guard);
+    lock->priority = (list_empty(waiters)
+                      ? PRI_MIN - 1
+                      : list_entry(list_front(waiters),
+                                   struct thread, elem)->priority);
+    spin_unlock(&lock->semaphore.guard);
+    if (lock->holder != NULL) {
+        thread_recompute_priority(lock->holder);
+    }
+}
+
+/* Acquires LOCK like lock_acquire(), but gives up after TICKS
+ * timer ticks.  Returns true if the lock was acquired, false if
+ * the wait timed out, in which case any priority donated to the
+ * holder is taken back.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. */
+bool
+lock_acquire_timeout(struct lock *lock, int64_t ticks)
+{
+    enum intr_level old_level;
+    uint64_t wait_start;
+    bool success;
+
+    ASSERT(lock != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!lock_held_by_current_thread(lock));
+
+    old_level = intr_disable();
+    wait_start = lockstat_wait_begin(lock);
+    if (lock->holder != NULL) {
+        lock_contend_cnt++;
+        thread_current()->waiting_lock = lock;
+        if (!thread_mlfqs) {
+            donate_priority(lock);
+        }
+    }
+    success = sema_down_timeout(&lock->semaphore, ticks);
+    lockstat_wait_end(lock, wait_start);
+    if (success) {
+        lock_take(lock);
+    } else {
+        thread_current()->waiting_lock = NULL;
+        if (!thread_mlfqs) {
+            withdraw_priority(lock);
+        }
+    }
+    intr_set_level(old_level);
+    return success;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -207,19 +614,25 @@ lock_acquire(struct lock *lock)
 bool
 lock_try_acquire(struct lock *lock)
 {
+    enum intr_level old_level;
     bool success;
 
     ASSERT(lock != NULL);
     ASSERT(!lock_held_by_current_thread(lock));
 
+    old_level = intr_disable();
     success = sema_try_down(&lock->semaphore);
     if (success) {
-        lock->holder = thread_current();
+        lock_take(lock);
     }
+    intr_set_level(old_level);
     return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+ * Gives up any priority donated through LOCK, recomputing the
+ * running thread's priority from the locks it still holds, and
+ * yields if that leaves a ready thread with higher priority.
  *
  * An interrupt handler cannot acquire a lock, so it does not
  * make sense to try to release a lock within an interrupt
@@ -227,11 +640,21 @@ lock_try_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
+    enum intr_level old_level;
+
     ASSERT(lock != NULL);
     ASSERT(lock_held_by_current_thread(lock));
 
+    old_level = intr_disable();
+    lockstat_release(lock);
+    list_remove(&lock->elem);
     lock->holder = NULL;
+    if (!thread_mlfqs) {
+        thread_recompute_priority(thread_current());
+    }
     sema_up(&lock->semaphore);
+    thread_yield_to_higher();
+    intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -245,12 +668,68 @@ lock_held_by_current_thread(const struct lock *lock)
     return lock->holder == thread_current();
 }
 
+/* Prints the LOCKSTAT_TOP lock names that were waited for
+ * longest in all, if built with LOCKSTAT. */
+void
+lock_print_stats(void)
+{
+#ifdef LOCKSTAT
+    bool printed[LOCKSTAT_CLASSES + 1] = {false};
+    int i;
+
+    for (i = 0; i < LOCKSTAT_TOP; i++) {
+        struct lock_class *c, *top = NULL;
+
+        for (c = lock_classes; c <= lock_classes + LOCKSTAT_CLASSES; c++) {
+            if (c->acquired > 0 && !printed[c - lock_classes]
+                && (top == NULL || c->wait > top->wait)) {
+                top = c;
+            }
+        }
+        if (top == NULL) {
+            break;
+        }
+        printed[top - lock_classes] = true;
+        printf("lockstat: %s: %llu acquired, %llu contended, "
+               "wait %llu us (max %llu), hold %llu us (max %llu)\n",
+               top->name, top->acquired, top->contended,
+               timer_cycles_to_ns(top->wait) / 1000,
+               timer_cycles_to_ns(top->max_wait) / 1000,
+               timer_cycles_to_ns(top->hold) / 1000,
+               timer_cycles_to_ns(top->max_hold) / 1000);
+    }
+#endif
+}
+
+/* Stores the counts of locks acquired, and of those that had to
+ * be waited for, in *ST. */
+void
+lock_kstat(struct kstat *st)
+{
+    enum intr_level old_level = intr_disable();
+
+    st->lock_acquires = lock_acquire_cnt;
+    st->lock_contentions = lock_contend_cnt;
+    intr_set_level(old_level);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem {
     struct list_elem elem;      /* List element. */
     struct semaphore semaphore; /* This semaphore. */
+    struct thread   *thread;    /* Thread waiting on the semaphore. */
 };
 
+/* Orders condition variable waiters by ascending priority of
+ * the waiting thread. */
+static bool
+waiter_priority_less(const struct list_elem *a, const struct list_elem *b,
+                     void *aux UNUSED)
+{
+    return list_entry(a, struct semaphore_elem, elem)->thread->priority
+           < list_entry(b, struct semaphore_elem, elem)->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
  * allows one piece of code to signal a condition and cooperating
  * code to receive the signal and act upon it. */
@@ -293,15 +772,54 @@ cond_wait(struct condition *cond, struct lock *lock)
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
-    list_push_back(&cond->waiters, &waiter.elem);
+    waiter.thread = thread_current();
+    insert_by_priority(&cond->waiters, &waiter.elem, waiter_priority_less);
     lock_release(lock);
     sema_down(&waiter.semaphore);
     lock_acquire(lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND after TICKS
+ * timer ticks.  LOCK is reacquired before returning either way.
+ * Returns true if COND was signaled, false if the wait timed
+ * out.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. */
+bool
+cond_wait_timeout(struct condition *cond, struct lock *lock, int64_t ticks)
+{
+    struct semaphore_elem waiter;
+    bool signaled;
+
+    ASSERT(cond != NULL);
+    ASSERT(lock != NULL);
+    ASSERT(!intr_context());
+    ASSERT(lock_held_by_current_thread(lock));
+
+    sema_init(&waiter.semaphore, 0);
+    waiter.thread = thread_current();
+    insert_by_priority(&cond->waiters, &waiter.elem, waiter_priority_less);
+    lock_release(lock);
+    signaled = sema_down_timeout(&waiter.semaphore, ticks);
+    lock_acquire(lock);
+
+    /* COND's waiters are protected by LOCK, so only now can we
+     * tell whether a signal came in after the timeout or we are
+     * still waiting and must leave. */
+    if (!signaled) {
+        signaled = sema_try_down(&waiter.semaphore);
+        if (!signaled) {
+            list_remove(&waiter.elem);
+        }
+    }
+    return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
- * this function signals one of them to wake up from its wait.
- * LOCK must be held before calling this function.
+ * this function signals the one with the highest priority, as
+ * of when it began waiting, to wake up from its wait.  LOCK must
+ * be held before calling this function.
  *
  * An interrupt handler cannot acquire a lock, so it does not
  * make sense to try to signal a condition variable within an
@@ -336,3 +854,150 @@ cond_broadcast(struct condition *cond, struct lock *lock)
         cond_signal(cond, lock);
     }
 }
+
+/* Initializes readers-writer lock RW.
+ *
+ * The writer side is an ordinary lock, WRITE_LOCK, held for the
+ * whole write critical section.  A reader takes WRITE_LOCK only
+ * long enough to register itself in READERS.  This gives three
+ * properties at once.  Waiting writers and readers block on
+ * WRITE_LOCK, so they donate priority to the active writer and
+ * are admitted in priority order.  A writer that holds
+ * WRITE_LOCK but is waiting for earlier readers to drain keeps
+ * new readers out, which is writer preference.  And readers
+ * never wait on each other beyond that brief registration. */
+void
+rwlock_init(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_init(&rw->write_lock);
+    rw->readers = 0;
+    rw->draining = false;
+    sema_init(&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+ * is waiting for it.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. */
+void
+rw_read_acquire(struct rwlock *rw)
+{
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+
+    lock_acquire(&rw->write_lock);
+    old_level = intr_disable();
+    rw->readers++;
+    intr_set_level(old_level);
+    lock_release(&rw->write_lock);
+}
+
+/* Tries to acquire RW for reading and returns true if
+ * successful or false if a writer holds it or is waiting for
+ * it.  Does not sleep. */
+bool
+rw_read_try_acquire(struct rwlock *rw)
+{
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+
+    if (!lock_try_acquire(&rw->write_lock)) {
+        return false;
+    }
+    old_level = intr_disable();
+    rw->readers++;
+    intr_set_level(old_level);
+    lock_release(&rw->write_lock);
+    return true;
+}
+
+/* Releases RW, which the current thread must hold for reading.
+ * If this is the last reader and a writer is waiting for the
+ * readers to drain, wakes the writer. */
+void
+rw_read_release(struct rwlock *rw)
+{
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+
+    old_level = intr_disable();
+    ASSERT(rw->readers > 0);
+    if (--rw->readers == 0 && rw->draining) {
+        rw->draining = false;
+        sema_up(&rw->drained);
+    }
+    intr_set_level(old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+ * it and all readers have released it.  RW must not already be
+ * held by the current thread.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. */
+void
+rw_write_acquire(struct rwlock *rw)
+{
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+
+    lock_acquire(&rw->write_lock);
+    old_level = intr_disable();
+    while (rw->readers > 0) {
+        rw->draining = true;
+        sema_down(&rw->drained);
+    }
+    intr_set_level(old_level);
+}
+
+/* Tries to acquire RW for writing and returns true if
+ * successful or false if it is held by a writer or any reader.
+ * Does not sleep. */
+bool
+rw_write_try_acquire(struct rwlock *rw)
+{
+    enum intr_level old_level;
+    bool success;
+
+    ASSERT(rw != NULL);
+
+    if (!lock_try_acquire(&rw->write_lock)) {
+        return false;
+    }
+    old_level = intr_disable();
+    success = rw->readers == 0;
+    intr_set_level(old_level);
+    if (!success) {
+        lock_release(&rw->write_lock);
+    }
+    return success;
+}
+
+/* Releases RW, which the current thread must hold for
+ * writing. */
+void
+rw_write_release(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_release(&rw->write_lock);
+}
+
+/* Returns true if the current thread holds RW for writing,
+ * false otherwise. */
+bool
+rw_write_held_by_current_thread(const struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    return lock_held_by_current_thread(&rw->write_lock);
+}
@@ -3,41 +3,165 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+
+struct thread;
+struct kstat;
+struct lock_class;
 
 /* A counting semaphore. */
 struct semaphore {
-    unsigned    value;   /* Current value. */
-    struct list waiters; /* List of waiting threads. */
+    struct spinlock guard; /* Guards the members below. */
+    unsigned    value;     /* Current value. */
+    struct list waiters;   /* Waiting threads, highest priority first. */
 };
 
 void sema_init(struct semaphore *, unsigned value);
 void sema_down(struct semaphore *);
 bool sema_try_down(struct semaphore *);
+bool sema_down_timeout(struct semaphore *, int64_t ticks);
 void sema_up(struct semaphore *);
+void sema_reposition(struct semaphore *, struct thread *);
 void sema_self_test(void);
 
-/* Lock. */
+/* Maximum number of `holder' links followed when donating
+ * priority through a chain of nested locks. */
+#ifndef LOCK_DONATION_DEPTH
+#define LOCK_DONATION_DEPTH 8
+#endif
+
+/* Lock.
+ *
+ * Building with LOCKSTAT defined, for example by adding
+ * -DLOCKSTAT to DEFINES in a project's Make.vars, makes every
+ * lock count its acquisitions, how many of them had to wait, and
+ * the time spent waiting for and holding it.  Locks are counted
+ * together by name, so that, say, all the inode locks add up to
+ * one line, and lock_print_stats() prints the LOCKSTAT_TOP names
+ * with the most waiting at power off.  lock_init() names a lock
+ * after its argument, as in "&inode->lock"; lock_init_named()
+ * gives it a better one. */
 struct lock {
     struct thread   *holder;    /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    int              priority;  /* Highest waiter priority, or -1. */
+    struct list_elem elem;      /* Element in holder's `locks' list. */
+#ifdef LOCKSTAT
+    struct lock_class *class;   /* Statistics for locks of this name. */
+    uint64_t         taken_at;  /* timer_cycles() when last acquired. */
+#endif
 };
 
-void lock_init(struct lock *);
+/* Number of names with their own statistics, and number printed
+ * by lock_print_stats(). */
+#define LOCKSTAT_CLASSES 64
+#define LOCKSTAT_TOP 10
+
+void lock_init_named(struct lock *, const char *name);
+#define lock_init(LOCK) lock_init_named(LOCK, #LOCK)
 void lock_acquire(struct lock *);
+bool lock_acquire_timeout(struct lock *, int64_t ticks);
 bool lock_try_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_held_by_current_thread(const struct lock *);
+void lock_print_stats(void);
+void lock_kstat(struct kstat *);
 
 /* Condition variable. */
 struct condition {
-    struct list waiters; /* List of waiting threads. */
+    struct list waiters; /* Waiting threads, highest priority first. */
 };
 
 void cond_init(struct condition *);
 void cond_wait(struct condition *, struct lock *);
+bool cond_wait_timeout(struct condition *, struct lock *, int64_t ticks);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/* Readers-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or a single
+ * writer.  Writers are preferred: once a writer is waiting, new
+ * readers queue behind it.  Waiting writers and readers donate
+ * their priority to an active writer. */
+struct rwlock {
+    struct lock      write_lock; /* Held by the writer, briefly by readers. */
+    unsigned         readers;    /* Number of active readers. */
+    bool             draining;   /* Writer waiting for readers to leave? */
+    struct semaphore drained;    /* Upped when the last reader leaves. */
+};
+
+void rwlock_init(struct rwlock *);
+void rw_read_acquire(struct rwlock *);
+bool rw_read_try_acquire(struct rwlock *);
+void rw_read_release(struct rwlock *);
+void rw_write_acquire(struct rwlock *);
+bool rw_write_try_acquire(struct rwlock *);
+void rw_write_release(struct rwlock *);
+bool rw_write_held_by_current_thread(const struct rwlock *);
+
+/* Wait queue: the threads polling an object for readiness.
+ *
+ * A poller puts an entry on the queue of every object it is
+ * interested in, all naming the same semaphore, and sleeps on the
+ * semaphore; whatever makes one of the objects ready wakes the
+ * object's queue, upping every poller's semaphore.  Pollers
+ * check the objects again after waking, so a spurious or
+ * repeated up costs only a rescan.
+ *
+ * The object guards its queue as it guards its own state: with
+ * its lock, or with interrupts off if an interrupt handler wakes
+ * the queue. */
+struct waitq {
+    struct list entries;        /* List of waitq_entry. */
+};
+
+/* One poller's place in a wait queue. */
+struct waitq_entry {
+    struct semaphore *sema;     /* Upped when the object changes. */
+    struct list_elem elem;      /* Element in waitq's ENTRIES. */
+};
+
+static inline void
+waitq_init(struct waitq *q)
+{
+    list_init(&q->entries);
+}
+
+/* Initializes E to up SEMA when a queue it is on is woken. */
+static inline void
+waitq_entry_init(struct waitq_entry *e, struct semaphore *sema)
+{
+    e->sema = sema;
+}
+
+/* Adds E to Q. */
+static inline void
+waitq_add(struct waitq *q, struct waitq_entry *e)
+{
+    list_push_back(&q->entries, &e->elem);
+}
+
+/* Removes E from the queue it is on. */
+static inline void
+waitq_remove(struct waitq_entry *e)
+{
+    list_remove(&e->elem);
+}
+
+/* Ups the semaphore of every entry on Q.  The entries stay. */
+static inline void
+waitq_wake(struct waitq *q)
+{
+    struct list_elem *e;
+
+    for (e = list_begin(&q->entries); e != list_end(&q->entries);
+         e = list_next(e)) {
+        sema_up(list_entry(e, struct waitq_entry, elem)->sema);
+    }
+}
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -45,4 +169,75 @@ void cond_broadcast(struct condition *, struct lock *);
  * reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
+/* Sequence lock, for data that is read far more often than it
+ * is written, such as a 64-bit counter that an interrupt handler
+ * advances.
+ *
+ * A reader never writes to the lock and never disables
+ * interrupts.  It notes the sequence number, reads the data, and
+ * tries again if a write began or was in progress meanwhile:
+ *
+ *     do {
+ *         seq = seq_read_begin(&lock);
+ *         copy = data;
+ *     } while (seq_read_retry(&lock, seq));
+ *
+ * Writers make the sequence number odd for the length of the
+ * write, and must exclude each other by other means.  A reader
+ * spins for as long as a write is in progress, so a writer must
+ * not be interruptible by a reader: in practice, writes happen
+ * with interrupts off.  x86 keeps loads in order with loads and
+ * stores with stores, so compiler barriers are all that is
+ * needed. */
+struct seqlock {
+    unsigned seq; /* Even when idle, odd during a write. */
+};
+
+#define SEQLOCK_INITIALIZER {0}
+
+static inline void
+seqlock_init(struct seqlock *lock)
+{
+    lock->seq = 0;
+}
+
+/* Starts a read of the data protected by LOCK.  Returns the
+ * value to pass to seq_read_retry(). */
+static inline unsigned
+seq_read_begin(const struct seqlock *lock)
+{
+    unsigned seq;
+
+    do {
+        seq = *(volatile const unsigned *) &lock->seq;
+    } while (seq & 1);
+    barrier();
+    return seq;
+}
+
+/* Returns true if the read of the data protected by LOCK that
+ * seq_read_begin() returned SEQ for must be done again. */
+static inline bool
+seq_read_retry(const struct seqlock *lock, unsigned seq)
+{
+    barrier();
+    return *(volatile const unsigned *) &lock->seq != seq;
+}
+
+/* Starts a write of the data protected by LOCK. */
+static inline void
+seq_write_begin(struct seqlock *lock)
+{
+    lock->seq++;
+    barrier();
+}
+
+/* Ends a write of the data protected by LOCK. */
+static inline void
+seq_write_end(struct seqlock *lock)
+{
+    barrier();
+    lock->seq++;
+}
+
 #endif /* threads/synch.h */
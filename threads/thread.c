@@ -1,21 +1,32 @@
 #include <debug.h>
+#include <kstat.h>
 #include <random.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "devices/timer.h"
+#include "threads/atomic.h"
+#include "threads/cfs.h"
+#include "threads/edf.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/rcu.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
+#include "userprog/fpu.h"
 #include "userprog/process.h"
 #endif
 
+#define LOGGING_LEVEL LOG_LEVEL_THREADS
+
 #include <log.h>
 
 /* Random value for struct thread's `magic' member.
@@ -23,9 +34,18 @@
  * of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
- * that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+ * processes that are ready to run but not actually running.
+ *
+ * There is one FIFO list per priority level, plus a bitmap with
+ * bit P set whenever ready_queues[P] is nonempty, so that the
+ * highest-priority ready thread is found with a single bit scan
+ * regardless of how many threads are runnable. */
+#define PRI_CNT      (PRI_MAX - PRI_MIN + 1) /* Number of priority levels. */
+#define READY_WORDS  ((PRI_CNT + 31) / 32)   /* Words in ready_levels. */
+static struct list ready_queues[PRI_CNT];
+static uint32_t ready_levels[READY_WORDS];
+static size_t ready_cnt; /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
  * when they are first scheduled and removed when they exit. */
@@ -37,8 +57,13 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Pages of exited threads kept for reuse by thread_create(),
+ * linked through their `elem' members, so that spawning a thread
+ * need not go through the page allocator and its pool lock.
+ * Accessed only with interrupts off. */
+#define THREAD_CACHE_MAX 8 /* Most pages kept in thread_cache. */
+static struct list thread_cache;
+static size_t thread_cache_cnt;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame {
@@ -47,20 +72,61 @@ struct kernel_thread_frame {
     void        *aux;      /* Auxiliary data for function. */
 };
 
-/* Statistics. */
+/* Statistics.  Written with interrupts off under TICKS_SEQ, so
+ * that they can be read together without turning interrupts
+ * off. */
 static long long idle_ticks;   /* # of timer ticks spent idle. */
 static long long kernel_ticks; /* # of timer ticks in kernel threads. */
 static long long user_ticks;   /* # of timer ticks in user programs. */
+static struct seqlock ticks_seq;
+
+/* Context switch counts, including threads that have exited. */
+static long long voluntary_switches;   /* Blocked or yielded. */
+static long long involuntary_switches; /* Preempted. */
+
+/* Histogram of the time threads spend in the run queue between
+ * becoming ready and starting to run, in microseconds, measured
+ * with the time-stamp counter since most waits are far shorter
+ * than a tick.  Bucket 0 counts waits shorter than 1 us and
+ * bucket B > 0 counts waits of [2**(B-1), 2**B) us; the last
+ * bucket also absorbs anything longer. */
+#define LATENCY_BUCKETS 20
+static long long latency_hist[LATENCY_BUCKETS];
 
 /* Scheduling. */
-#define TIME_SLICE 4 /* # of timer ticks to give each thread. */
 static unsigned thread_ticks; /* # of timer ticks since last yield. */
+static unsigned thread_slice; /* # of timer ticks the running thread gets. */
+
+/* # of timer ticks to give each thread.
+ * Controlled by kernel command-line option "-slice". */
+unsigned thread_time_slice = TIME_SLICE_DEFAULT;
 
 /* If false (default), use round-robin scheduler.
  * If true, use multi-level feedback queue scheduler.
  * Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler in threads/cfs.c.
+ * Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+/* MLFQS state. */
+#define MLFQS_PRI_INTERVAL 4 /* Ticks between priority updates. */
+static fixed_point_t load_avg; /* System load average. */
+
+/* Threads whose recent_cpu has changed since their priority was
+ * last recomputed.  Between the once-per-second decay passes
+ * only threads that actually took timer ticks land here, so the
+ * every-fourth-tick priority update touches a handful of threads
+ * instead of every thread in all_list. */
+static struct list cpu_dirty_list;
+
+/* The timer interrupt defers the MLFQS recomputations to
+ * mlfqs_work, and sets mlfqs_second_due when the once-per-second
+ * update is among them. */
+static struct intr_work mlfqs_work;
+static bool mlfqs_second_due;
+
 static void kernel_thread(thread_func *, void *aux);
 
 static void idle(void *aux UNUSED);
@@ -69,17 +135,45 @@ static struct thread *running_thread(void);
 
 static struct thread *next_thread_to_run(void);
 
+static void ready_push(struct thread *);
+
+static int ready_max_priority(void);
+
+static bool ready_preempts(struct thread *cur);
+
+static void ready_remove(struct thread *);
+
+static void mlfqs_tick(struct thread *cur);
+
+static intr_work_func mlfqs_update;
+
+static int mlfqs_priority(const struct thread *);
+
+static void mlfqs_mark_dirty(struct thread *);
+
+static void mlfqs_decay_recent_cpu(struct thread *, void *coeff);
+
 static void init_thread(struct thread *, const char *name, int priority);
 
 static bool is_thread(struct thread *) UNUSED;
 
 static void *alloc_frame(struct thread *, size_t size);
 
-static void schedule(void);
+static void schedule(bool preempted);
+
+static void yield_cpu(bool preempted);
+
+static void record_ready_latency(struct thread *);
+
+static void print_thread_stats(struct thread *, void *aux UNUSED);
 
 void thread_schedule_tail(struct thread *prev);
 static tid_t allocate_tid(void);
 
+static struct thread *thread_page_alloc(void);
+
+static void thread_page_free(struct thread *);
+
 /* Initializes the threading system by transforming the code
  * that's currently running into a thread.  This can't work in
  * general and it is possible in this case only because loader.S
@@ -96,17 +190,45 @@ static tid_t allocate_tid(void);
 void
 thread_init(void)
 {
+    int i;
+
     ASSERT(intr_get_level() == INTR_OFF);
 
-    lock_init(&tid_lock);
-    list_init(&ready_list);
+    for (i = 0; i < PRI_CNT; i++) {
+        list_init(&ready_queues[i]);
+    }
+    cfs_init();
+    edf_init();
     list_init(&all_list);
+    list_init(&cpu_dirty_list);
+    intr_work_init(&mlfqs_work, mlfqs_update, NULL);
+    list_init(&thread_cache);
 
     /* Set up a thread structure for the running thread. */
     initial_thread = running_thread();
     init_thread(initial_thread, "main", PRI_DEFAULT);
     initial_thread->status = THREAD_RUNNING;
     initial_thread->tid = allocate_tid();
+    thread_slice = thread_time_slice;
+}
+
+/* Sets up T, a page from palloc_get_page(), as the idle thread of
+ * an application processor, named NAME.  The processor runs on
+ * T's stack from the moment it starts, so T is already running.
+ * It is left out of all_list, which holds the threads that the
+ * scheduler manages. */
+void
+thread_init_idle(struct thread *t, const char *name)
+{
+    enum intr_level old_level;
+
+    init_thread(t, name, PRI_MIN);
+    t->status = THREAD_RUNNING;
+    t->tid = allocate_tid();
+
+    old_level = intr_disable();
+    list_remove(&t->allelem);
+    intr_set_level(old_level);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -135,6 +257,8 @@ thread_tick(void)
     struct thread *t = thread_current();
 
     /* Update statistics. */
+    t->run_ticks++;
+    seq_write_begin(&ticks_seq);
     if (t == idle_thread) {
         idle_ticks++;
     }
@@ -146,19 +270,109 @@ thread_tick(void)
     else {
         kernel_ticks++;
     }
+    seq_write_end(&ticks_seq);
 
-    /* Enforce preemption. */
-    if (++thread_ticks >= TIME_SLICE) {
+    if (thread_mlfqs) {
+        mlfqs_tick(t);
+    }
+
+    /* Enforce the EDF budget and preemption. */
+    if (edf_charge_tick(t)) {
+        intr_yield_on_return();
+    }
+    if (++thread_ticks >= thread_slice) {
         intr_yield_on_return();
     }
 }
 
-/* Prints thread statistics. */
+/* Credits TICKS timer ticks to the idle thread.  Used by the
+ * timer for ticks that passed without an interrupt because the
+ * periodic tick was stopped during idle. */
+void
+thread_account_idle(int64_t ticks)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    seq_write_begin(&ticks_seq);
+    idle_ticks += ticks;
+    seq_write_end(&ticks_seq);
+}
+
+/* Prints thread statistics: global tick and context switch
+ * counts, the ready-to-running latency histogram, and per-thread
+ * figures for every thread still alive. */
 void
 thread_print_stats(void)
 {
+    enum intr_level old_level;
+    long long idle, kernel, user;
+    unsigned seq;
+    int last, i;
+
+    do {
+        seq = seq_read_begin(&ticks_seq);
+        idle = idle_ticks;
+        kernel = kernel_ticks;
+        user = user_ticks;
+    } while (seq_read_retry(&ticks_seq, seq));
     printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-           idle_ticks, kernel_ticks, user_ticks);
+           idle, kernel, user);
+    printf("Thread: %lld voluntary, %lld involuntary context switches\n",
+           voluntary_switches, involuntary_switches);
+
+    for (last = LATENCY_BUCKETS - 1; last > 0; last--) {
+        if (latency_hist[last] != 0) {
+            break;
+        }
+    }
+    printf("Thread: ready latency (us):");
+    for (i = 0; i <= last; i++) {
+        if (i == 0) {
+            printf(" <1:%lld", latency_hist[i]);
+        } else if (i == LATENCY_BUCKETS - 1) {
+            printf(" >=%d:%lld", 1 << (i - 1), latency_hist[i]);
+        } else {
+            printf(" %d-%d:%lld", 1 << (i - 1), (1 << i) - 1, latency_hist[i]);
+        }
+    }
+    printf("\n");
+
+    old_level = intr_disable();
+    thread_foreach(print_thread_stats, NULL);
+    intr_set_level(old_level);
+}
+
+/* Stores the tick and context switch counts, and the number of
+ * ready threads, in *ST. */
+void
+thread_kstat(struct kstat *st)
+{
+    enum intr_level old_level;
+    unsigned seq;
+
+    do {
+        seq = seq_read_begin(&ticks_seq);
+        st->idle_ticks = idle_ticks;
+        st->kernel_ticks = kernel_ticks;
+        st->user_ticks = user_ticks;
+    } while (seq_read_retry(&ticks_seq, seq));
+
+    old_level = intr_disable();
+    st->voluntary_switches = voluntary_switches;
+    st->involuntary_switches = involuntary_switches;
+    st->ready_threads = ready_cnt;
+    intr_set_level(old_level);
+}
+
+/* Prints the scheduler statistics of thread T. */
+static void
+print_thread_stats(struct thread *t, void *aux UNUSED)
+{
+    printf("Thread: %d %s: %lld run ticks, %llu us ready, "
+           "%u voluntary, %u involuntary switches\n",
+           t->tid, t->name, t->run_ticks,
+           timer_cycles_to_ns(t->ready_cycles) / 1000,
+           t->voluntary_switches, t->involuntary_switches);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -173,9 +387,11 @@ thread_print_stats(void)
  * scheduled.  Use a semaphore or some other form of
  * synchronization if you need to ensure ordering.
  *
- * The code provided sets the new thread's `priority' member to
- * PRIORITY, but no actual priority scheduling is implemented.
- * Priority scheduling is the goal of Problem 1-3. */
+ * If the new thread has a higher priority than the running
+ * thread, the running thread yields to it immediately.  Under
+ * the MLFQS, PRIORITY is ignored: the new thread inherits its
+ * parent's nice and recent_cpu values and its priority is
+ * computed from those. */
 tid_t
 thread_create(const char *name, int priority,
               thread_func *function, void *aux)
@@ -188,8 +404,11 @@ thread_create(const char *name, int priority,
 
     ASSERT(function != NULL);
 
-    /* Allocate thread. */
-    t = palloc_get_page(PAL_ZERO);
+    /* Allocate thread.  The page is not zeroed: init_thread()
+     * clears `struct thread' and alloc_frame() clears each stack
+     * frame, and nothing else in the page is read before it is
+     * written. */
+    t = thread_page_alloc();
     if (t == NULL) {
         return TID_ERROR;
     }
@@ -215,6 +434,7 @@ thread_create(const char *name, int priority,
 
     /* Add to run queue. */
     thread_unblock(t);
+    thread_yield_to_higher();
 
     return tid;
 }
@@ -232,7 +452,7 @@ thread_block(void)
     ASSERT(intr_get_level() == INTR_OFF);
 
     thread_current()->status = THREAD_BLOCKED;
-    schedule();
+    schedule(false);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -252,7 +472,8 @@ thread_unblock(struct thread *t)
 
     old_level = intr_disable();
     ASSERT(t->status == THREAD_BLOCKED);
-    list_push_back(&ready_list, &t->elem);
+    t->ready_since = timer_cycles();
+    ready_push(t);
     t->status = THREAD_READY;
     intr_set_level(old_level);
 }
@@ -299,15 +520,20 @@ thread_exit(void)
 
 #ifdef USERPROG
     process_exit();
+    fpu_exit();
 #endif
 
     /* Remove thread from all threads list, set our status to dying,
      * and schedule another process.  That process will destroy us
      * when it calls thread_schedule_tail(). */
     intr_disable();
+    edf_leave(thread_current());
     list_remove(&thread_current()->allelem);
+    if (thread_current()->cpu_dirty) {
+        list_remove(&thread_current()->dirtyelem);
+    }
     thread_current()->status = THREAD_DYING;
-    schedule();
+    schedule(false);
     NOT_REACHED();
 }
 
@@ -315,6 +541,28 @@ thread_exit(void)
  * may be scheduled again immediately at the scheduler's whim. */
 void
 thread_yield(void)
+{
+    yield_cpu(false);
+}
+
+/* Yields the CPU on behalf of the scheduler, because the
+ * running thread's time slice expired or a higher-priority
+ * thread became ready.  Like thread_yield(), but counted as an
+ * involuntary context switch.  A thread in an RCU read section
+ * yields when the section ends instead. */
+void
+thread_preempt(void)
+{
+    if (!rcu_defer_preempt()) {
+        yield_cpu(true);
+    }
+}
+
+/* Puts the running thread back on the run queue and schedules
+ * another.  PREEMPTED tells whether the switch was forced on the
+ * thread rather than requested by it. */
+static void
+yield_cpu(bool preempted)
 {
     struct thread *cur = thread_current();
     enum intr_level old_level;
@@ -323,34 +571,80 @@ thread_yield(void)
 
     old_level = intr_disable();
     if (cur != idle_thread) {
-        list_push_back(&ready_list, &cur->elem);
+        cur->ready_since = timer_cycles();
+        ready_push(cur);
     }
     cur->status = THREAD_READY;
-    schedule();
+    schedule(preempted);
+    intr_set_level(old_level);
+}
+
+/* Yields the CPU if some ready thread has a higher priority
+ * than the running thread, or under the CFS, if some ready
+ * thread is owed the CPU, or if an EDF thread with an earlier
+ * deadline is ready.  In an external interrupt context,
+ * arranges to yield just before the interrupt returns
+ * instead. */
+void
+thread_yield_to_higher(void)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (ready_preempts(running_thread())) {
+        if (intr_context()) {
+            intr_yield_on_return();
+        } else {
+            thread_preempt();
+        }
+    }
     intr_set_level(old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
- * This function must be called with interrupts off. */
+ * The walk is an RCU read section, so interrupts may stay on,
+ * but FUNC must not sleep, and must turn interrupts off itself
+ * to change anything an interrupt handler also touches.
+ *
+ * Threads join and leave all_list with interrupts off, which no
+ * read section in progress can observe half done, and a dying
+ * thread's page is freed only once another thread has been
+ * switched in, after which no read section can still be looking
+ * at it. */
 void
 thread_foreach(thread_action_func *func, void *aux)
 {
     struct list_elem *e;
 
-    ASSERT(intr_get_level() == INTR_OFF);
-
+    rcu_read_lock();
     for (e = list_begin(&all_list); e != list_end(&all_list);
          e = list_next(e)) {
         struct thread *t = list_entry(e, struct thread, allelem);
         func(t, aux);
     }
+    rcu_read_unlock();
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+ * effective priority stays higher if a donation exceeds it.
+ * Yields if some ready thread now has a higher priority.
+ * Ignored when the MLFQS is in use, since it manages priorities
+ * itself. */
 void
 thread_set_priority(int new_priority)
 {
-    thread_current()->priority = new_priority;
+    enum intr_level old_level;
+
+    ASSERT(PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+    if (thread_mlfqs) {
+        return;
+    }
+
+    old_level = intr_disable();
+    thread_current()->base_priority = new_priority;
+    thread_recompute_priority(thread_current());
+    thread_yield_to_higher();
+    intr_set_level(old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -360,35 +654,85 @@ thread_get_priority(void)
     return thread_current()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+ * priority, and yields if it no longer has the highest
+ * priority.  Under the CFS, the time it has run so far is
+ * charged at its old weight. */
 void
-thread_set_nice(int nice UNUSED)
+thread_set_nice(int nice)
 {
-    /* Not yet implemented. */
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(NICE_MIN <= nice && nice <= NICE_MAX);
+
+    old_level = intr_disable();
+    if (thread_cfs) {
+        cfs_charge(cur);
+    }
+    cur->nice = nice;
+    if (thread_mlfqs) {
+        cur->priority = mlfqs_priority(cur);
+        thread_yield_to_higher();
+    } else if (thread_cfs) {
+        thread_yield_to_higher();
+    }
+    intr_set_level(old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice(void)
 {
-    /* Not yet implemented. */
-    return 0;
+    return thread_current()->nice;
+}
+
+/* Makes the current thread an EDF thread that may run for
+ * BUDGET timer ticks in every PERIOD ticks, starting now, with
+ * the end of each period as its deadline.  See threads/edf.c.
+ * A PERIOD of 0 makes it an ordinary thread again.  Returns
+ * false, changing nothing, if admitting the thread would take
+ * the EDF threads' total utilization over the limit. */
+bool
+thread_set_deadline(int64_t period, int64_t budget)
+{
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
+    bool ok = true;
+
+    ASSERT(period == 0 || (0 < budget && budget <= period));
+
+    old_level = intr_disable();
+    if (period == 0) {
+        edf_leave(cur);
+    } else {
+        ok = edf_admit(cur, period, budget);
+    }
+    thread_yield_to_higher();
+    intr_set_level(old_level);
+    return ok;
 }
 
-/* Returns 100 times the system load average. */
+/* Returns 100 times the system load average.  LOAD_AVG is a
+ * single word, which mlfqs_update() replaces in one store, so
+ * reading it needs neither a lock nor a sequence lock. */
 int
 thread_get_load_avg(void)
 {
-    /* Not yet implemented. */
-    return 0;
+    fixed_point_t avg = *(volatile fixed_point_t *) &load_avg;
+
+    return fp_round(avg * 100);
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu(void)
 {
-    /* Not yet implemented. */
-    return 0;
+    enum intr_level old_level = intr_disable();
+    int value = fp_round(thread_current()->recent_cpu * 100);
+
+    intr_set_level(old_level);
+    return value;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -424,7 +768,13 @@ idle(void *idle_started_ UNUSED)
          * time.
          *
          * See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         * 7.11.1 "HLT Instruction". */
+         * 7.11.1 "HLT Instruction".
+         *
+         * Nothing is ready to run, so with "-tickless" the timer
+         * may first replace the periodic tick by a countdown to
+         * the next deadline.  Whichever interrupt wakes us
+         * restores the periodic tick. */
+        timer_idle_enter();
         asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -476,16 +826,47 @@ init_thread(struct thread *t, const char *name, int priority)
     t->status = THREAD_BLOCKED;
     strlcpy(t->name, name, sizeof t->name);
     t->stack = (uint8_t *)t + PGSIZE;
-    t->priority = priority;
+    t->priority = t->base_priority = priority;
+    list_init(&t->locks);
+#ifdef USERPROG
+    t->leader = t;
+    t->exit_status = -1;
+    list_init(&t->children);
+    list_init(&t->uthreads);
+    list_init(&t->futex_waiters);
+#endif
+#ifdef VM
+    lock_init(&t->vm_lock);
+#endif
     t->magic = THREAD_MAGIC;
 
+    /* A new thread inherits its parent's MLFQS state.  The
+     * initial thread has no parent and starts from zero. */
+    if (thread_mlfqs) {
+        struct thread *parent = running_thread();
+
+        if (parent != t && is_thread(parent)) {
+            t->nice = parent->nice;
+            t->recent_cpu = parent->recent_cpu;
+        }
+        t->priority = mlfqs_priority(t);
+    }
+
+    /* Likewise for the CFS, except that a new thread's virtual
+     * runtime starts from the least in the system. */
+    if (thread_cfs) {
+        struct thread *parent = running_thread();
+
+        cfs_fork(t, parent != t && is_thread(parent) ? parent : NULL);
+    }
+
     old_level = intr_disable();
     list_push_back(&all_list, &t->allelem);
     intr_set_level(old_level);
 }
 
-/* Allocates a SIZE-byte frame at the top of thread T's stack and
- * returns a pointer to the frame's base. */
+/* Allocates a zeroed SIZE-byte frame at the top of thread T's
+ * stack and returns a pointer to the frame's base. */
 static void *
 alloc_frame(struct thread *t, size_t size)
 {
@@ -494,22 +875,369 @@ alloc_frame(struct thread *t, size_t size)
     ASSERT(size % sizeof(uint32_t) == 0);
 
     t->stack -= size;
+    memset(t->stack, 0, size);
     return t->stack;
 }
 
+/* Returns a page for a new thread, recycled from thread_cache if
+ * possible, or a null pointer if none is available.  The page's
+ * contents are unspecified. */
+static struct thread *
+thread_page_alloc(void)
+{
+    struct thread *t = NULL;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    if (!list_empty(&thread_cache)) {
+        t = list_entry(list_pop_front(&thread_cache), struct thread, elem);
+        thread_cache_cnt--;
+    }
+    intr_set_level(old_level);
+
+    if (t == NULL) {
+        t = palloc_get_page(0);
+    }
+    return t;
+}
+
+/* Releases the page of dead thread T, keeping it in thread_cache
+ * unless the cache is full.  Interrupts must be off, so the page
+ * is handed back to palloc only when the cache overflows. */
+static void
+thread_page_free(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    t->magic = 0;
+    if (thread_cache_cnt < THREAD_CACHE_MAX) {
+        list_push_front(&thread_cache, &t->elem);
+        thread_cache_cnt++;
+    } else {
+        palloc_free_page(t);
+    }
+}
+
+/* Adds T to the tail of the run queue for its priority, or under
+ * the CFS, to the CFS run queue.  An EDF thread with budget left
+ * goes to the EDF run queue instead.  Interrupts must be off. */
+static void
+ready_push(struct thread *t)
+{
+    int level = t->priority - PRI_MIN;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (edf_active(t)) {
+        edf_enqueue(t);
+        ready_cnt++;
+        return;
+    }
+    if (thread_cfs) {
+        cfs_enqueue(t);
+        ready_cnt++;
+        return;
+    }
+    list_push_back(&ready_queues[level], &t->elem);
+    ready_levels[level / 32] |= 1u << (level % 32);
+    ready_cnt++;
+}
+
+/* Removes T, which must be in the THREAD_READY state, from the
+ * run queue.  Interrupts must be off. */
+static void
+ready_remove(struct thread *t)
+{
+    int level = t->priority - PRI_MIN;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(t->status == THREAD_READY);
+
+    if (edf_queued(t)) {
+        edf_dequeue(t);
+        ready_cnt--;
+        return;
+    }
+    if (thread_cfs) {
+        cfs_dequeue(t);
+        ready_cnt--;
+        return;
+    }
+    list_remove(&t->elem);
+    if (list_empty(&ready_queues[level])) {
+        ready_levels[level / 32] &= ~(1u << (level % 32));
+    }
+    ready_cnt--;
+}
+
+/* Changes T's effective priority to PRIORITY, moving T to the
+ * matching run queue if it is ready.  The CFS run queue is not
+ * ordered by priority, so there T stays put.  Does not preempt
+ * the running thread.  Interrupts must be off. */
+void
+thread_reprioritize(struct thread *t, int priority)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+    if (t->priority == priority) {
+        return;
+    }
+    if (t->status == THREAD_READY && !thread_cfs) {
+        ready_remove(t);
+        t->priority = priority;
+        ready_push(t);
+    } else {
+        t->priority = priority;
+        if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL) {
+            sema_reposition(t->waiting_sema, t);
+        }
+    }
+}
+
+/* Starts a new EDF period for T, moving T into the EDF run
+ * queue if it is ready and had run out of budget.  Does not
+ * preempt the running thread.  Interrupts must be off. */
+void
+thread_replenish(struct thread *t)
+{
+    bool ready = t->status == THREAD_READY;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (ready) {
+        ready_remove(t);
+    }
+    edf_replenish(t);
+    if (ready) {
+        ready_push(t);
+    }
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+ * priority and the priorities donated through the locks it
+ * holds.  Each lock caches the highest priority among its
+ * waiters, so this costs one step per held lock rather than one
+ * per waiting thread.  Interrupts must be off. */
+void
+thread_recompute_priority(struct thread *t)
+{
+    int priority = t->base_priority;
+    struct list_elem *e;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (e = list_begin(&t->locks); e != list_end(&t->locks);
+         e = list_next(e)) {
+        struct lock *lock = list_entry(e, struct lock, elem);
+
+        if (lock->priority > priority) {
+            priority = lock->priority;
+        }
+    }
+    thread_reprioritize(t, priority);
+}
+
+/* Returns the highest priority of any thread in the run queue,
+ * or PRI_MIN - 1 if the run queue is empty.  Interrupts must be
+ * off. */
+static int
+ready_max_priority(void)
+{
+    int word;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (word = READY_WORDS - 1; word >= 0; word--) {
+        if (ready_levels[word] != 0) {
+            uint32_t bit;
+
+            /* Index of the most significant set bit.  See
+             * [IA32-v2a] "BSR--Bit Scan Reverse". */
+            asm ("bsrl %1, %0" : "=r" (bit) : "rm" (ready_levels[word]));
+            return PRI_MIN + word * 32 + bit;
+        }
+    }
+    return PRI_MIN - 1;
+}
+
+/* Returns true if a ready thread should preempt running thread
+ * CUR.  Interrupts must be off. */
+static bool
+ready_preempts(struct thread *cur)
+{
+    if (edf_should_preempt(cur)) {
+        return true;
+    } else if (edf_active(cur)) {
+        return false;
+    } else if (!thread_cfs) {
+        return ready_max_priority() > cur->priority;
+    } else if (cur == idle_thread) {
+        return ready_cnt > 0;
+    } else {
+        return cfs_should_preempt(cur);
+    }
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
  * return a thread from the run queue, unless the run queue is
  * empty.  (If the running thread can continue running, then it
  * will be in the run queue.)  If the run queue is empty, return
- * idle_thread. */
+ * idle_thread.
+ *
+ * The thread returned is the one at the front of the
+ * highest-priority nonempty queue, so threads of equal priority
+ * are scheduled round-robin.  Under the CFS, it is the one with
+ * the least virtual runtime instead.  Either way, a ready EDF
+ * thread comes first. */
 static struct thread *
 next_thread_to_run(void)
 {
-    if (list_empty(&ready_list)) {
+    int priority;
+    int level;
+    struct list *queue;
+    struct thread *t;
+
+    t = edf_pick_next();
+    if (t != NULL) {
+        ready_cnt--;
+        return t;
+    }
+    if (thread_cfs) {
+        t = cfs_pick_next();
+        if (t == NULL) {
+            return idle_thread;
+        }
+        ready_cnt--;
+        return t;
+    }
+
+    priority = ready_max_priority();
+    if (priority < PRI_MIN) {
         return idle_thread;
-    } else {
-        return list_entry(list_pop_front(&ready_list), struct thread, elem);
     }
+
+    level = priority - PRI_MIN;
+    queue = &ready_queues[level];
+    t = list_entry(list_pop_front(queue), struct thread, elem);
+    if (list_empty(queue)) {
+        ready_levels[level / 32] &= ~(1u << (level % 32));
+    }
+    ready_cnt--;
+    return t;
+}
+
+/* Returns T's MLFQS priority,
+ * PRI_MAX - (recent_cpu / 4) - (nice * 2), clamped to the valid
+ * priority range. */
+static int
+mlfqs_priority(const struct thread *t)
+{
+    int priority = PRI_MAX - fp_to_int(t->recent_cpu / 4) - t->nice * 2;
+
+    if (priority < PRI_MIN) {
+        return PRI_MIN;
+    } else if (priority > PRI_MAX) {
+        return PRI_MAX;
+    }
+    return priority;
+}
+
+/* Records that T's recent_cpu changed, so that its priority is
+ * recomputed at the next priority update. */
+static void
+mlfqs_mark_dirty(struct thread *t)
+{
+    if (!t->cpu_dirty) {
+        t->cpu_dirty = true;
+        list_push_back(&cpu_dirty_list, &t->dirtyelem);
+    }
+}
+
+/* Applies the once-per-second recent_cpu decay to T, where
+ * COEFF_ points to (2 * load_avg) / (2 * load_avg + 1).  Threads
+ * whose value does not change (an idle thread with zero
+ * recent_cpu and zero niceness, say) are left off
+ * cpu_dirty_list. */
+static void
+mlfqs_decay_recent_cpu(struct thread *t, void *coeff_)
+{
+    const fixed_point_t *coeff = coeff_;
+    enum intr_level old_level;
+    fixed_point_t recent_cpu;
+
+    if (t == idle_thread) {
+        return;
+    }
+
+    /* The timer interrupt charges ticks to recent_cpu too. */
+    old_level = intr_disable();
+    recent_cpu = fp_add_int(fp_mul(*coeff, t->recent_cpu), t->nice);
+    if (recent_cpu != t->recent_cpu) {
+        t->recent_cpu = recent_cpu;
+        mlfqs_mark_dirty(t);
+    }
+    intr_set_level(old_level);
+}
+
+/* MLFQS bookkeeping for one timer tick, given the running thread
+ * CUR.  Runs in an external interrupt context, so it only charges
+ * the tick and leaves the recomputations to mlfqs_update(). */
+static void
+mlfqs_tick(struct thread *cur)
+{
+    int64_t now = timer_ticks();
+
+    /* The running thread used this tick. */
+    if (cur != idle_thread) {
+        cur->recent_cpu = fp_add_int(cur->recent_cpu, 1);
+        mlfqs_mark_dirty(cur);
+    }
+
+    if (now % TIMER_FREQ == 0) {
+        mlfqs_second_due = true;
+        intr_defer(&mlfqs_work);
+    }
+    if (now % MLFQS_PRI_INTERVAL == 0) {
+        intr_defer(&mlfqs_work);
+    }
+}
+
+/* Deferred MLFQS work: once per second, updates the load average
+ * and decays every thread's recent_cpu, and then recomputes the
+ * priorities of the threads whose recent_cpu changed.  Interrupts
+ * are turned back on during the walk over all threads and between
+ * one thread's priority and the next. */
+static void
+mlfqs_update(void *aux UNUSED)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (mlfqs_second_due) {
+        struct thread *cur = running_thread();
+        int ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+        fixed_point_t coeff;
+
+        mlfqs_second_due = false;
+        load_avg = fp_mul(fp_div(fp_from_int(59), fp_from_int(60)), load_avg)
+                   + fp_from_int(ready_threads) / 60;
+        coeff = fp_div(load_avg * 2, fp_add_int(load_avg * 2, 1));
+        intr_set_level(old_level);
+        thread_foreach(mlfqs_decay_recent_cpu, &coeff);
+        intr_disable();
+    }
+
+    while (!list_empty(&cpu_dirty_list)) {
+        struct thread *t = list_entry(list_pop_front(&cpu_dirty_list),
+                                      struct thread, dirtyelem);
+
+        t->cpu_dirty = false;
+        thread_reprioritize(t, mlfqs_priority(t));
+        intr_set_level(old_level);
+        intr_disable();
+    }
+    thread_yield_to_higher();
+    intr_set_level(old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -537,13 +1265,18 @@ thread_schedule_tail(struct thread *prev)
 
     /* Mark us as running. */
     cur->status = THREAD_RUNNING;
+    record_ready_latency(cur);
 
     /* Start new time slice. */
     thread_ticks = 0;
+    thread_slice = (thread_cfs && cur != idle_thread
+                    ? cfs_start(cur) : thread_time_slice);
 
 #ifdef USERPROG
-    /* Activate the new address space. */
+    /* Activate the new address space, and the FPU if this thread's
+     * state is in it. */
     process_activate();
+    fpu_activate(cur);
 #endif
 
     /* If the thread we switched from is dying, destroy its struct
@@ -553,19 +1286,49 @@ thread_schedule_tail(struct thread *prev)
      * palloc().) */
     if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) {
         ASSERT(prev != cur);
-        palloc_free_page(prev);
+        thread_page_free(prev);
     }
 }
 
+/* Charges the time thread T, which is about to run, spent in
+ * the run queue since it became ready to T and to the latency
+ * histogram.  The idle thread never waits in the run queue, so
+ * it is not counted. */
+static void
+record_ready_latency(struct thread *t)
+{
+    uint64_t cycles, ns;
+    uint32_t us;
+    int bucket;
+
+    if (t == idle_thread) {
+        return;
+    }
+
+    cycles = timer_cycles() - t->ready_since;
+    t->ready_cycles += cycles;
+
+    /* A 32-bit division suffices short of 4 s, which the last
+     * bucket absorbs anyway. */
+    ns = timer_cycles_to_ns(cycles);
+    us = ns < UINT32_MAX ? (uint32_t) ns / 1000 : UINT32_MAX;
+    for (bucket = 0; us > 0 && bucket < LATENCY_BUCKETS - 1; bucket++) {
+        us >>= 1;
+    }
+    latency_hist[bucket]++;
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
  * the running process's state must have been changed from
  * running to some other state.  This function finds another
- * thread to run and switches to it.
+ * thread to run and switches to it.  PREEMPTED tells whether a
+ * thread that is still ready is being switched out against its
+ * will, for the context switch statistics.
  *
  * It's not safe to call printf() until thread_schedule_tail()
  * has completed. */
 static void
-schedule(void)
+schedule(bool preempted)
 {
     struct thread *cur = running_thread();
     struct thread *next = next_thread_to_run();
@@ -575,7 +1338,20 @@ schedule(void)
     ASSERT(cur->status != THREAD_RUNNING);
     ASSERT(is_thread(next));
 
+    /* A thread going back on the CFS run queue was charged
+     * already, since its place there depends on it. */
+    if (thread_cfs && cur != idle_thread && cur->status != THREAD_READY) {
+        cfs_charge(cur);
+    }
     if (cur != next) {
+        if (cur->status == THREAD_READY && preempted) {
+            cur->involuntary_switches++;
+            involuntary_switches++;
+        } else if (cur->status != THREAD_DYING) {
+            cur->voluntary_switches++;
+            voluntary_switches++;
+        }
+        trace(TRACE_SWITCH, next->tid, preempted);
         prev = switch_threads(cur, next);
     }
     thread_schedule_tail(prev);
@@ -586,13 +1362,8 @@ static tid_t
 allocate_tid(void)
 {
     static tid_t next_tid = 1;
-    tid_t tid;
 
-    lock_acquire(&tid_lock);
-    tid = next_tid++;
-    lock_release(&tid_lock);
-
-    return tid;
+    return atomic_fetch_add(&next_tid, 1);
 }
 
 /* Offset of `stack' member within `struct thread'.
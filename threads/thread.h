@@ -2,9 +2,21 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <ohash.h>
+#include <rbtree.h>
 #include <stdint.h>
 
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
+#ifdef USERPROG
+#include "userprog/fdtable.h"
+#endif
+#ifdef VM
+#include "vm/fault.h"
+#endif
+
 /* States in a thread's life cycle. */
 enum thread_status {
     THREAD_RUNNING, /* Running thread. */
@@ -23,6 +35,13 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX     63 /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN     -20 /* Nicest to other threads. */
+#define NICE_DEFAULT 0   /* Default niceness. */
+#define NICE_MAX     20  /* Least nice to other threads. */
+
+struct kstat;
+
 /* A kernel thread or user process.
  *
  * Each thread structure is stored in its own 4 kB page.  The
@@ -73,27 +92,119 @@ typedef int tid_t;
  * the `magic' member of the running thread's `struct thread' is
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element in
+ * the run queue (thread.c), an element in a semaphore wait list
+ * (synch.c), or an element in the timer's sleep list (timer.c).
+ * It can be used these ways only because they are mutually
+ * exclusive: only a thread in the ready state is on the run
+ * queue, whereas only a thread in the blocked state is on a
+ * semaphore wait list or the sleep list, and a sleeping thread
+ * is not waiting on any semaphore. */
 struct thread {
     /* Owned by thread.c. */
     tid_t              tid;      /* Thread identifier. */
     enum thread_status status;   /* Thread state. */
     char               name[16]; /* Name (for debugging purposes). */
     uint8_t           *stack;    /* Saved stack pointer. */
-    int                priority; /* Priority. */
+    int                priority; /* Effective priority. */
     struct list_elem   allelem;  /* List element for all threads list. */
 
-    /* Shared between thread.c and synch.c. */
+    /* Owned by thread.c, for scheduler statistics. */
+    int64_t  run_ticks;            /* Timer ticks spent running. */
+    uint64_t ready_cycles;         /* CPU cycles spent in the run queue. */
+    uint64_t ready_since;          /* Cycle at which it last became ready. */
+    unsigned voluntary_switches;   /* Switches away by blocking or yielding. */
+    unsigned involuntary_switches; /* Switches away by preemption. */
+
+    /* Shared between thread.c and synch.c, for priority donation. */
+    int           base_priority; /* Priority before donation. */
+    struct list   locks;         /* Locks held by this thread. */
+    struct lock  *waiting_lock;  /* Lock being waited for, or NULL. */
+    struct semaphore *waiting_sema; /* Semaphore blocked on, or NULL. */
+
+    /* Owned by thread.c, used only by the MLFQS. */
+    int              nice;       /* Niceness, also used by the CFS. */
+    fixed_point_t    recent_cpu; /* Recent CPU usage. */
+    bool             cpu_dirty;  /* On cpu_dirty_list? */
+    struct list_elem dirtyelem;  /* List element for cpu_dirty_list. */
+
+    /* Owned by threads/cfs.c. */
+    uint64_t       vruntime;   /* Weighted CPU time, in cycles. */
+    uint64_t       exec_start; /* Cycle at which it was last charged. */
+    struct rb_elem cfs_elem;   /* Element in the CFS run queue. */
+
+    /* Owned by threads/edf.c. */
+    int64_t        edf_period;    /* Ticks per period, or 0 if not EDF. */
+    int64_t        edf_budget;    /* Ticks it may run per period. */
+    int64_t        edf_remaining; /* Ticks of budget left this period. */
+    int64_t        edf_deadline;  /* Tick at which this period ends. */
+    bool           edf_queued;    /* In the EDF run queue? */
+    struct rb_elem edf_elem;      /* Element in the EDF run queue. */
+    struct timeout edf_timeout;   /* Starts the next period. */
+
+    /* Shared between thread.c, synch.c and timer.c. */
     struct list_elem elem; /* List element. */
 
+    /* Owned by threads/rcu.c. */
+    int  rcu_nesting;   /* Depth of rcu_read_lock() calls. */
+    bool rcu_preempted; /* Preemption deferred to rcu_read_unlock()? */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;         /* Tick at which a sleeping thread wakes. */
+    struct heap_elem sleep_elem; /* Heap element for the sleep queue. */
+
+    /* Owned by devices/block.c. */
+    bool io_idle;                /* Idle class I/O? */
+
 #ifdef USERPROG
-    /* Owned by userprog/process.c. */
-    uint32_t *pagedir; /* Page directory. */
+    /* Owned by userprog/process.c.  A process's state is kept in
+     * its leader, the thread that runs main(); the process's
+     * other threads share its page directory. */
+    uint32_t *pagedir;      /* Page directory. */
+    struct thread *leader;  /* Thread holding the process's state. */
+    int exit_status;        /* Status reported when the process exits. */
+    bool exiting;           /* Leader: is the process exiting? */
+    struct list children;   /* Status records of children, oldest first. */
+    struct child *child;    /* Own status or join record. */
+    struct list uthreads;   /* Leader: join records of other threads. */
+    struct dir *cwd;        /* Leader: working directory, or null. */
+    struct file *exec_file; /* Leader: running executable, kept open
+                             * and unwritable until exit. */
+
+    /* Owned by userprog/futex.c. */
+    struct list futex_waiters; /* Leader: threads in futex_wait(). */
+
+    /* Owned by userprog/aio.c. */
+    struct aio_ctx *aio;       /* Leader: asynchronous I/O rings, or null. */
+
+    /* Owned by userprog/fpu.c. */
+    struct fpu_state *fpu;     /* Saved FPU registers, or null if unused. */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd_table fds; /* Open file descriptors. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c.  Those below VM_LOCK are kept in the
+     * leader, and VM_LOCK guards them against its other threads. */
+    void *user_esp;            /* User stack pointer at system call entry. */
+    struct lock vm_lock;       /* Guards the address space. */
+    struct ohash pages;        /* Supplemental page table. */
+    size_t stack_chunk;        /* Stack pages added by the last growth. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mmaps;         /* Memory-mapped files. */
+    int next_mapid;            /* Identifier for the next mapping. */
+
+    /* Owned by vm/brk.c. */
+    uint8_t *heap_start;       /* First byte of the heap. */
+    uint8_t *heap_break;       /* End of the heap (the program break). */
+
+    /* Owned by vm/fault.c. */
+    struct fault_stats fault_stats; /* Paging activity. */
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;         /* Nesting of journaled operations. */
 #endif
 
     /* Owned by thread.c. */
@@ -105,10 +216,22 @@ struct thread {
  * Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler in threads/cfs.c, which
+ * divides the CPU by nice value and ignores priorities.
+ * Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* Default number of timer ticks to give each thread. */
+#define TIME_SLICE_DEFAULT 4
+extern unsigned thread_time_slice;
+
 void thread_init(void);
+void thread_init_idle(struct thread *, const char *name);
 void thread_start(void);
 void thread_tick(void);
 void thread_print_stats(void);
+void thread_kstat(struct kstat *);
+void thread_account_idle(int64_t ticks);
 
 typedef void thread_func (void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
@@ -120,6 +243,12 @@ tid_t thread_tid(void);
 const char *thread_name(void);
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_preempt(void);
+void thread_yield_to_higher(void);
+
+void thread_reprioritize(struct thread *, int priority);
+void thread_recompute_priority(struct thread *);
+void thread_replenish(struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -132,4 +261,6 @@ void thread_set_nice(int);
 int thread_get_recent_cpu(void);
 int thread_get_load_avg(void);
 
+bool thread_set_deadline(int64_t period, int64_t budget);
+
 #endif /* threads/thread.h */
@@ -0,0 +1,114 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The ring is overwritten oldest first, so it never fills up and
+ * a record is just a store at the next index.  Events come from
+ * threads and interrupt handlers alike, so each is written with
+ * interrupts off, which on a single CPU keeps writers from
+ * interleaving without a lock.  The index runs freely, so
+ * HEAD & (TRACE_EVENT_CNT - 1) is the slot of the next event and
+ * HEAD itself is the number recorded so far. */
+
+/* Pages taken by the ring. */
+#define TRACE_PAGE_CNT \
+    DIV_ROUND_UP(TRACE_EVENT_CNT * sizeof(struct trace_event), PGSIZE)
+
+/* True while events are being recorded. */
+bool trace_enabled;
+
+static bool requested;              /* -trace was given. */
+static struct trace_event *events;  /* TRACE_EVENT_CNT events. */
+static uint32_t head;               /* Number of events recorded. */
+
+static tid_t running_tid(void);
+
+/* Asks for tracing to be turned on by trace_init().  Called for
+ * the -trace option, before memory can be allocated. */
+void
+trace_configure(void)
+{
+    requested = true;
+}
+
+/* Allocates the ring and starts recording, if trace_configure()
+ * was called.  Must be called after palloc_init(). */
+void
+trace_init(void)
+{
+    if (requested) {
+        events = palloc_get_multiple(PAL_ASSERT, TRACE_PAGE_CNT);
+        trace_enabled = true;
+    }
+}
+
+/* Records an event of TYPE with details A and B.  Use trace()
+ * rather than calling this directly. */
+void
+trace_record(enum trace_type type, uint32_t a, uint32_t b)
+{
+    enum intr_level old_level = intr_disable();
+    struct trace_event *e = &events[head++ & (TRACE_EVENT_CNT - 1)];
+
+    e->tsc = timer_cycles();
+    e->ticks = timer_ticks();
+    e->type = type;
+    e->tid = running_tid();
+    e->a = a;
+    e->b = b;
+    intr_set_level(old_level);
+}
+
+/* Stops recording and writes the events in the ring to the
+ * console, oldest first, one per line as
+ * "TR <tsc> <ticks> <type> <tid> <a> <b>" in hex. */
+void
+trace_dump(void)
+{
+    uint32_t i, first;
+
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = false;
+
+    first = head > TRACE_EVENT_CNT ? head - TRACE_EVENT_CNT : 0;
+    printf("Trace: begin\n");
+    for (i = first; i != head; i++) {
+        const struct trace_event *e = &events[i & (TRACE_EVENT_CNT - 1)];
+
+        printf("TR %016llx %08x %04x %04x %08x %08x\n",
+               e->tsc, e->ticks, e->type, e->tid, e->a, e->b);
+    }
+    printf("Trace: end\n");
+}
+
+/* Prints tracing statistics. */
+void
+trace_print_stats(void)
+{
+    if (events != NULL) {
+        printf("Trace: %"PRIu32" events, %"PRIu32" overwritten\n", head,
+               head > TRACE_EVENT_CNT ? head - TRACE_EVENT_CNT : 0);
+    }
+}
+
+/* Returns the tid of the thread whose stack we are on.  Unlike
+ * thread_current(), this works in schedule(), while the current
+ * thread is no longer marked running. */
+static tid_t
+running_tid(void)
+{
+    uint32_t *esp;
+
+    asm ("mov %%esp, %0" : "=g" (esp));
+    return ((struct thread *) pg_round_down(esp))->tid;
+}
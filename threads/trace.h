@@ -0,0 +1,60 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Event tracing.
+ *
+ * A flight recorder for diagnosing latency: each event is a small
+ * fixed-size binary record, stamped with the timer tick and the
+ * CPU's time-stamp counter, in a ring that always keeps the most
+ * recent TRACE_EVENT_CNT events.  Recording one costs a few tens
+ * of cycles and no lock, so it is safe in interrupt handlers and
+ * in the scheduler.
+ *
+ * Tracing is off unless the kernel is started with -trace.  Then
+ * the ring is written to the console at power off, one hex line
+ * per event, for utils/trace-decode to turn back into text. */
+
+/* Kinds of events, with the meaning of their A and B. */
+enum trace_type {
+    TRACE_SWITCH,       /* Thread switch: A = next tid, B = preempted. */
+    TRACE_INTR,         /* Interrupt: A = vector, B = interrupted eip. */
+    TRACE_PAGE_FAULT,   /* Page fault: A = address, B = error code. */
+    TRACE_BLOCK_READ,   /* Sector read: A = sector, B = cycles taken. */
+    TRACE_BLOCK_WRITE,  /* Sector write: A = sector, B = cycles taken. */
+    TRACE_TYPE_CNT
+};
+
+/* An event, 24 bytes. */
+struct trace_event {
+    uint64_t tsc;       /* Time-stamp counter. */
+    uint32_t ticks;     /* Timer ticks since boot, low 32 bits. */
+    uint16_t type;      /* One of enum trace_type. */
+    uint16_t tid;       /* Running thread, low 16 bits. */
+    uint32_t a, b;      /* Details, by type. */
+};
+
+/* Number of events kept, a power of 2. */
+#define TRACE_EVENT_CNT 2048
+
+extern bool trace_enabled;
+
+void trace_configure(void);
+void trace_init(void);
+void trace_record(enum trace_type, uint32_t a, uint32_t b);
+void trace_dump(void);
+void trace_print_stats(void);
+
+/* Records an event of TYPE with details A and B, if tracing is
+ * on. */
+static inline void
+trace(enum trace_type type, uint32_t a, uint32_t b)
+{
+    if (trace_enabled) {
+        trace_record(type, a, b);
+    }
+}
+
+#endif /* threads/trace.h */
@@ -0,0 +1,194 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* Virtually contiguous kernel memory.
+ *
+ * Kernel memory from the page allocator is physically contiguous,
+ * since the kernel sees RAM through a direct mapping at
+ * PHYS_BASE.  A big buffer therefore needs a run of free physical
+ * pages, which gets harder to find the longer the system runs.
+ * vmalloc() instead takes single pages wherever they are and maps
+ * them side by side into a region of kernel virtual memory above
+ * the direct mapping.
+ *
+ * The region's page tables are created at boot and entered in
+ * init_page_dir before any process exists.  Every page directory
+ * copies the kernel's entries from init_page_dir, so all of them
+ * share these page tables and see each mapping as soon as it is
+ * made.  Each allocation is followed by an unmapped guard page, so
+ * that running off its end faults instead of corrupting the next
+ * one.
+ *
+ * vtop() does not work on these addresses, so vmalloc() memory
+ * must not be handed to anything that needs a page's physical
+ * address. */
+
+/* Start and size of the region: 16 MB starting just past the
+ * direct mapping of at most LOADER_RAM_MAX (256 MB) of RAM. */
+#define VMALLOC_START ((uint8_t *) PHYS_BASE + LOADER_RAM_MAX)
+#define VMALLOC_PAGES 4096
+
+/* Pages of the region in use, counting guard pages. */
+static struct bitmap *used_map;
+static struct lock vmalloc_lock;
+
+static uint32_t *lookup_pte(const void *vaddr);
+
+/* Creates the page tables for the vmalloc() region.  Must be
+ * called after paging_init() and before any page directory is
+ * created. */
+void
+vmalloc_init(void)
+{
+    size_t i;
+
+    for (i = 0; i < VMALLOC_PAGES; i += PGSIZE / sizeof(uint32_t)) {
+        uint32_t *pde = init_page_dir + pd_no(VMALLOC_START + i * PGSIZE);
+
+        ASSERT(*pde == 0);
+        *pde = pde_create(palloc_get_page(PAL_ASSERT | PAL_ZERO));
+    }
+    used_map = bitmap_create(VMALLOC_PAGES);
+    if (used_map == NULL) {
+        PANIC("vmalloc_init: out of memory");
+    }
+    lock_init(&vmalloc_lock);
+}
+
+/* Obtains PAGE_CNT pages, which need not be physically
+ * contiguous, maps them at consecutive kernel virtual addresses
+ * and returns the first.  Returns a null pointer if memory or
+ * address space runs out, or if vmalloc_init() has not been
+ * called yet. */
+void *
+vmalloc(size_t page_cnt)
+{
+    uint8_t *vaddr;
+    size_t start, i;
+
+    if (used_map == NULL || page_cnt == 0) {
+        return NULL;
+    }
+
+    lock_acquire(&vmalloc_lock);
+    start = bitmap_scan_and_flip(used_map, 0, page_cnt + 1, false);
+    lock_release(&vmalloc_lock);
+    if (start == BITMAP_ERROR) {
+        return NULL;
+    }
+    vaddr = VMALLOC_START + start * PGSIZE;
+
+    for (i = 0; i < page_cnt; i++) {
+        void *kpage = palloc_get_page(0);
+        if (kpage == NULL) {
+            /* Give back the pages mapped so far, and the rest of
+             * the address space. */
+            vfree(vaddr, i);
+            lock_acquire(&vmalloc_lock);
+            bitmap_set_multiple(used_map, start + i + 1, page_cnt - i, false);
+            lock_release(&vmalloc_lock);
+            return NULL;
+        }
+        *lookup_pte(vaddr + i * PGSIZE) = pte_create_kernel(kpage, true);
+    }
+    return vaddr;
+}
+
+/* Unmaps and frees the PAGE_CNT pages at VADDR, which must have
+ * been obtained from vmalloc(). */
+void
+vfree(void *vaddr_, size_t page_cnt)
+{
+    uint8_t *vaddr = vaddr_;
+    size_t i;
+
+    ASSERT(is_vmalloc_vaddr(vaddr));
+    ASSERT(pg_ofs(vaddr) == 0);
+
+    for (i = 0; i < page_cnt; i++) {
+        uint8_t *page = vaddr + i * PGSIZE;
+        uint32_t *pte = lookup_pte(page);
+        void *kpage;
+
+        ASSERT(*pte & PTE_P);
+        kpage = pte_get_page(*pte);
+        *pte = 0;
+        asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+        palloc_free_page(kpage);
+    }
+
+    lock_acquire(&vmalloc_lock);
+    bitmap_set_multiple(used_map, (vaddr - VMALLOC_START) / PGSIZE,
+                        page_cnt + 1, false);
+    lock_release(&vmalloc_lock);
+}
+
+/* Maps the PAGE_CNT pages of device memory starting at physical
+ * address PADDR, which must be page-aligned, uncached into the
+ * vmalloc() region and returns their kernel virtual address.
+ * Returns a null pointer if address space runs out.  The mapping
+ * is permanent. */
+void *
+vmalloc_map_io(uintptr_t paddr, size_t page_cnt)
+{
+    uint8_t *vaddr;
+    size_t start, i;
+
+    ASSERT(paddr % PGSIZE == 0);
+
+    if (used_map == NULL || page_cnt == 0) {
+        return NULL;
+    }
+
+    lock_acquire(&vmalloc_lock);
+    start = bitmap_scan_and_flip(used_map, 0, page_cnt + 1, false);
+    lock_release(&vmalloc_lock);
+    if (start == BITMAP_ERROR) {
+        return NULL;
+    }
+    vaddr = VMALLOC_START + start * PGSIZE;
+
+    for (i = 0; i < page_cnt; i++) {
+        *lookup_pte(vaddr + i * PGSIZE) = ((paddr + i * PGSIZE)
+                                           | PTE_P | PTE_W | PTE_PCD | PTE_PWT);
+    }
+    return vaddr;
+}
+
+/* Returns true if VADDR lies in the vmalloc() region. */
+bool
+is_vmalloc_vaddr(const void *vaddr)
+{
+    const uint8_t *p = vaddr;
+
+    return p >= VMALLOC_START && p < VMALLOC_START + VMALLOC_PAGES * PGSIZE;
+}
+
+/* Returns the physical address that VADDR, in a page obtained
+ * from vmalloc(), maps to. */
+uintptr_t
+vmalloc_vtop(const void *vaddr)
+{
+    uint32_t pte = *lookup_pte(vaddr);
+
+    ASSERT(pte & PTE_P);
+    return (pte & PTE_ADDR) | pg_ofs(vaddr);
+}
+
+/* Returns the page table entry for VADDR in the vmalloc()
+ * region. */
+static uint32_t *
+lookup_pte(const void *vaddr)
+{
+    ASSERT(is_vmalloc_vaddr(vaddr));
+
+    return pde_get_pt(init_page_dir[pd_no(vaddr)]) + pt_no(vaddr);
+}
@@ -0,0 +1,15 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void vmalloc_init(void);
+void *vmalloc(size_t page_cnt);
+void vfree(void *, size_t page_cnt);
+bool is_vmalloc_vaddr(const void *);
+uintptr_t vmalloc_vtop(const void *);
+void *vmalloc_map_io(uintptr_t paddr, size_t page_cnt);
+
+#endif /* threads/vmalloc.h */
@@ -0,0 +1,152 @@
+#include <debug.h>
+#include <stdio.h>
+
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Work queues.
+ *
+ * A subsystem that needs work done in the background embeds a
+ * struct work in whatever the work is about and hands it to a
+ * queue with work_queue(), which costs a list push and, if a
+ * worker is asleep, a sema_up().  Each queue is served by a fixed
+ * number of worker threads, created once at the queue's priority,
+ * so that subsystems share threads instead of each running its
+ * own.
+ *
+ * A worker that wakes takes up to WORK_BATCH items off the queue
+ * at once and runs them one after another, so that a burst of
+ * work costs one wakeup rather than one per item.  If it leaves
+ * items behind, it wakes another idle worker for them.
+ *
+ * The queue is protected by disabling interrupts, so work may be
+ * queued from an interrupt handler as well as from a thread.
+ * Work runs in a thread, with interrupts on, and may sleep. */
+
+/* Most items a worker takes off its queue at a time. */
+#define WORK_BATCH 16
+
+static thread_func worker;
+static void wake_worker(struct workqueue *);
+
+/* Initializes WQ and starts WORKER_CNT threads named NAME, at
+ * PRIORITY, to run the work queued on it.  WQ must never be
+ * destroyed. */
+void
+workqueue_init(struct workqueue *wq, const char *name, int priority,
+               size_t worker_cnt)
+{
+    size_t i;
+
+    ASSERT(wq != NULL);
+    ASSERT(worker_cnt > 0 && worker_cnt <= WORKQUEUE_WORKERS_MAX);
+
+    wq->name = name;
+    list_init(&wq->items);
+    sema_init(&wq->wakeup, 0);
+    wq->idle_cnt = 0;
+    wq->queued_cnt = wq->batch_cnt = 0;
+
+    for (i = 0; i < worker_cnt; i++) {
+        if (thread_create(name, priority, worker, wq) == TID_ERROR) {
+            PANIC("workqueue_init: %s: cannot create worker", name);
+        }
+    }
+}
+
+/* Prints how much work WQ has run and in how many batches. */
+void
+workqueue_print_stats(const struct workqueue *wq)
+{
+    printf("Work queue %s: %llu items in %llu batches\n",
+           wq->name, wq->queued_cnt, wq->batch_cnt);
+}
+
+/* Initializes W to run FUNC whenever it is queued. */
+void
+work_init(struct work *w, work_func *func)
+{
+    ASSERT(w != NULL);
+    ASSERT(func != NULL);
+
+    w->func = func;
+    w->queued = false;
+}
+
+/* Queues W to run on WQ.  Returns true if W was queued, or false
+ * if it already was queued and has not started yet, in which case
+ * it runs only once.  W may be queued again once it has started,
+ * even by its own function.  May be called from an interrupt
+ * handler. */
+bool
+work_queue(struct workqueue *wq, struct work *w)
+{
+    enum intr_level old_level;
+    bool queued;
+
+    ASSERT(wq != NULL);
+    ASSERT(w != NULL);
+
+    old_level = intr_disable();
+    queued = !w->queued;
+    if (queued) {
+        w->queued = true;
+        list_push_back(&wq->items, &w->elem);
+        wq->queued_cnt++;
+        wake_worker(wq);
+    }
+    intr_set_level(old_level);
+    return queued;
+}
+
+/* Worker thread for the struct workqueue passed as WQ_. */
+static void
+worker(void *wq_)
+{
+    struct workqueue *wq = wq_;
+    struct list batch;
+
+    list_init(&batch);
+    for (;;) {
+        enum intr_level old_level = intr_disable();
+        size_t i;
+
+        while (list_empty(&wq->items)) {
+            wq->idle_cnt++;
+            sema_down(&wq->wakeup);
+        }
+        for (i = 0; i < WORK_BATCH && !list_empty(&wq->items); i++) {
+            list_push_back(&batch, list_pop_front(&wq->items));
+        }
+        wq->batch_cnt++;
+        if (!list_empty(&wq->items)) {
+            wake_worker(wq);
+        }
+        intr_set_level(old_level);
+
+        while (!list_empty(&batch)) {
+            struct work *w;
+
+            old_level = intr_disable();
+            w = list_entry(list_pop_front(&batch), struct work, elem);
+            w->queued = false;
+            intr_set_level(old_level);
+
+            w->func(w);
+        }
+    }
+}
+
+/* Wakes one of WQ's idle workers, if any.  Interrupts must be
+ * off. */
+static void
+wake_worker(struct workqueue *wq)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (wq->idle_cnt > 0) {
+        wq->idle_cnt--;
+        sema_up(&wq->wakeup);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "threads/synch.h"
+
+/* Most worker threads serving one queue. */
+#define WORKQUEUE_WORKERS_MAX 8
+
+/* A work item, embedded in the structure it works on in the same
+ * way as a list_elem.  work_entry() recovers the structure. */
+struct work;
+typedef void work_func (struct work *);
+struct work {
+    struct list_elem elem; /* Element in the queue's list. */
+    work_func *func;       /* Function to run. */
+    bool queued;           /* Queued and not yet started? */
+};
+
+/* Converts pointer to work item WORK into a pointer to the
+ * structure that WORK is embedded inside. */
+#define work_entry(WORK, STRUCT, MEMBER)                  \
+    ((STRUCT *) ((uint8_t *) (WORK) - offsetof(STRUCT, MEMBER)))
+
+/* A queue of work items served by a fixed set of kernel threads. */
+struct workqueue {
+    const char *name;         /* Name of the worker threads. */
+    struct list items;        /* Queued work, oldest first. */
+    struct semaphore wakeup;  /* Upped once for each worker woken. */
+    size_t idle_cnt;          /* Workers asleep and not yet woken. */
+
+    /* Statistics. */
+    unsigned long long queued_cnt; /* Items queued. */
+    unsigned long long batch_cnt;  /* Batches taken off the queue. */
+};
+
+void workqueue_init(struct workqueue *, const char *name, int priority,
+                    size_t worker_cnt);
+void workqueue_print_stats(const struct workqueue *);
+
+void work_init(struct work *, work_func *);
+bool work_queue(struct workqueue *, struct work *);
+
+#endif /* threads/workqueue.h */
@@ -0,0 +1,356 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <stddef.h>
+#include <syscall-nr.h>
+
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "userprog/fdtable.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+
+/* Asynchronous I/O.
+ *
+ * A process that calls aio_setup() registers a pair of rings in
+ * its own memory: a submission ring, which it fills with
+ * requests and whose tail it advances, and a completion ring,
+ * which the kernel fills and whose head the process advances.
+ * aio_enter() does all the kernel's side in one system call: it
+ * takes every new submission, waits until at least MIN_COMPLETE
+ * requests have completed, and posts as many completions as the
+ * completion ring has room for.  A process may thus keep up to a
+ * ring's worth of requests in flight and handle them in batches.
+ *
+ * The transfers themselves run on the "aio" work queue, whose
+ * workers are kernel threads outside any process and so cannot
+ * touch user memory.  Each request therefore carries a kernel
+ * buffer: data to write is copied in when the request is taken,
+ * and data read is copied out when its completion is posted,
+ * both in the process's own context.  Each request also holds
+ * its own reopened file, so that closing the descriptor while a
+ * request is in flight is harmless.  AIO_READ and AIO_WRITE use
+ * and advance the descriptor's position when they are taken, as
+ * though they will transfer in full.
+ *
+ * The contexts and the requests are protected by each context's
+ * lock.  Only one thread of a process should call aio_enter() at
+ * a time, since the rings have a single producer and consumer on
+ * each side. */
+
+/* Worker threads serving asynchronous I/O. */
+#define AIO_WORKERS 4
+
+/* A process's asynchronous I/O context. */
+struct aio_ctx {
+    struct aio_ring *uring;  /* Ring header, in user memory. */
+    unsigned entries;        /* Slots in each ring. */
+    struct lock lock;        /* Guards the members below. */
+    struct condition done;   /* Signaled when a request completes. */
+    struct list completed;   /* Completed requests not yet posted. */
+    unsigned in_flight;      /* Requests taken and not yet posted. */
+};
+
+/* An asynchronous I/O request. */
+struct aio_req {
+    struct work work;        /* Work item on aio_wq. */
+    struct aio_ctx *ctx;     /* Owning context. */
+    int opcode;              /* AIO_READ, AIO_WRITE, ... */
+    struct file *file;       /* Own reopened file, or null. */
+    void *ubuf;              /* User buffer. */
+    uint8_t *kbuf;           /* Kernel buffer, or null. */
+    unsigned len;            /* Bytes to transfer. */
+    off_t ofs;               /* File offset. */
+    uint32_t user_data;      /* Copied to the completion. */
+    int result;              /* Bytes transferred, or -1. */
+    struct list_elem elem;   /* Element in ctx->completed. */
+};
+
+static struct workqueue aio_wq;
+
+static bool take(struct aio_ctx *, const struct aio_sqe *);
+static bool prepare(struct aio_req *, const struct aio_sqe *);
+static void run(struct work *);
+static void complete(struct aio_req *);
+static void req_free(struct aio_req *);
+static void copy_out(void *udst, const void *src, size_t size);
+
+/* Starts the asynchronous I/O workers. */
+void
+aio_init(void)
+{
+    workqueue_init(&aio_wq, "aio", PRI_DEFAULT, AIO_WORKERS);
+}
+
+/* Registers the rings whose header is at URING for the current
+ * process.  Returns 0, or -1 if the process already has rings,
+ * if the number of entries is not a power of 2 no greater than
+ * AIO_ENTRIES_MAX, or if memory runs out. */
+int
+aio_setup(struct aio_ring *uring)
+{
+    struct thread *leader = thread_current()->leader;
+    struct aio_ring ring;
+    struct aio_ctx *ctx;
+
+    if (!copy_from_user(&ring, uring, sizeof ring)) {
+        process_terminate(-1);
+    }
+    if (leader->aio != NULL || ring.entries == 0
+        || ring.entries > AIO_ENTRIES_MAX
+        || (ring.entries & (ring.entries - 1)) != 0) {
+        return -1;
+    }
+
+    ctx = malloc(sizeof *ctx);
+    if (ctx == NULL) {
+        return -1;
+    }
+    ctx->uring = uring;
+    ctx->entries = ring.entries;
+    lock_init(&ctx->lock);
+    cond_init(&ctx->done);
+    list_init(&ctx->completed);
+    ctx->in_flight = 0;
+    leader->aio = ctx;
+    return 0;
+}
+
+/* Takes the current process's new submissions, waits for at
+ * least MIN_COMPLETE requests to complete, or for all of them if
+ * fewer are in flight, and posts the completions that fit in
+ * the completion ring.  Returns the number of submissions taken,
+ * or -1 if the process has no rings. */
+int
+aio_enter(unsigned min_complete)
+{
+    struct aio_ctx *ctx = thread_current()->leader->aio;
+    unsigned mask, taken = 0;
+    struct aio_ring ring;
+    struct list posted;
+
+    if (ctx == NULL) {
+        return -1;
+    }
+    mask = ctx->entries - 1;
+    if (!copy_from_user(&ring, ctx->uring, sizeof ring)) {
+        process_terminate(-1);
+    }
+
+    /* Take new submissions, as many as may be in flight. */
+    while (ring.sq_head != ring.sq_tail && ctx->in_flight < ctx->entries) {
+        struct aio_sqe sqe;
+
+        if (!copy_from_user(&sqe, &ring.sqes[ring.sq_head & mask],
+                            sizeof sqe)) {
+            process_terminate(-1);
+        }
+        if (!take(ctx, &sqe)) {
+            break;
+        }
+        ring.sq_head++;
+        taken++;
+    }
+    copy_out(&ctx->uring->sq_head, &ring.sq_head, sizeof ring.sq_head);
+
+    /* Wait, then take off as many completions as there is room
+     * for. */
+    list_init(&posted);
+    lock_acquire(&ctx->lock);
+    while (list_size(&ctx->completed) < min_complete
+           && list_size(&ctx->completed) < ctx->in_flight) {
+        cond_wait(&ctx->done, &ctx->lock);
+    }
+    while (!list_empty(&ctx->completed)
+           && ring.cq_tail - ring.cq_head + list_size(&posted)
+              < ctx->entries) {
+        list_push_back(&posted, list_pop_front(&ctx->completed));
+        ctx->in_flight--;
+    }
+    lock_release(&ctx->lock);
+
+    /* Post them, copying out the data read. */
+    while (!list_empty(&posted)) {
+        struct aio_req *r = list_entry(list_pop_front(&posted),
+                                       struct aio_req, elem);
+        struct aio_cqe cqe;
+
+        cqe.user_data = r->user_data;
+        cqe.result = r->result;
+        if ((r->opcode == AIO_READ || r->opcode == AIO_PREAD)
+            && r->result > 0
+            && !copy_to_user(r->ubuf, r->kbuf, r->result)) {
+            req_free(r);
+            while (!list_empty(&posted)) {
+                req_free(list_entry(list_pop_front(&posted),
+                                    struct aio_req, elem));
+            }
+            process_terminate(-1);
+        }
+        req_free(r);
+        copy_out(&ring.cqes[ring.cq_tail & mask], &cqe, sizeof cqe);
+        ring.cq_tail++;
+    }
+    copy_out(&ctx->uring->cq_tail, &ring.cq_tail, sizeof ring.cq_tail);
+    return taken;
+}
+
+/* Waits for the requests of LEADER's process that are still in
+ * flight, then frees them and its context, as on exit. */
+void
+aio_destroy(struct thread *leader)
+{
+    struct aio_ctx *ctx = leader->aio;
+
+    if (ctx == NULL) {
+        return;
+    }
+    lock_acquire(&ctx->lock);
+    while (list_size(&ctx->completed) < ctx->in_flight) {
+        cond_wait(&ctx->done, &ctx->lock);
+    }
+    lock_release(&ctx->lock);
+    while (!list_empty(&ctx->completed)) {
+        req_free(list_entry(list_pop_front(&ctx->completed),
+                            struct aio_req, elem));
+    }
+    free(ctx);
+    leader->aio = NULL;
+}
+
+/* Takes submission SQE into CTX: queues it for a worker, or
+ * completes it at once with -1 if it is not valid.  Returns
+ * false, leaving the submission for a later call, if memory runs
+ * out. */
+static bool
+take(struct aio_ctx *ctx, const struct aio_sqe *sqe)
+{
+    struct aio_req *r = calloc(1, sizeof *r);
+    bool valid;
+
+    if (r == NULL) {
+        return false;
+    }
+    r->ctx = ctx;
+    r->user_data = sqe->user_data;
+    valid = prepare(r, sqe);
+
+    lock_acquire(&ctx->lock);
+    ctx->in_flight++;
+    lock_release(&ctx->lock);
+    if (!valid) {
+        r->result = -1;
+        complete(r);
+    } else {
+        work_init(&r->work, run);
+        work_queue(&aio_wq, &r->work);
+    }
+    return true;
+}
+
+/* Fills in R from SQE, reopening the file and copying in the
+ * data to write.  Returns false if SQE is not valid.  Kills the
+ * process if the data to write is not mapped. */
+static bool
+prepare(struct aio_req *r, const struct aio_sqe *sqe)
+{
+    struct fd_table *fds = &thread_current()->leader->fds;
+    struct fd fd;
+
+    r->opcode = sqe->opcode;
+    if (r->opcode < AIO_READ || r->opcode > AIO_FSYNC
+        || !fd_lookup(fds, sqe->fd, &fd)) {
+        return false;
+    }
+    r->file = fd.type == FD_FILE ? file_reopen(fd.file) : NULL;
+    if (r->file == NULL || r->opcode == AIO_FSYNC) {
+        fd_put(fds, sqe->fd);
+        return r->file != NULL;
+    }
+
+    if (sqe->len > AIO_LEN_MAX || !is_user_range(sqe->buf, sqe->len)
+        || (int) sqe->offset < 0) {
+        fd_put(fds, sqe->fd);
+        return false;
+    }
+    r->ubuf = sqe->buf;
+    r->len = sqe->len;
+    if (r->opcode == AIO_READ || r->opcode == AIO_WRITE) {
+        r->ofs = file_tell(fd.file);
+        file_seek(fd.file, r->ofs + r->len);
+    } else {
+        r->ofs = sqe->offset;
+    }
+    fd_put(fds, sqe->fd);
+    if (r->len > 0) {
+        r->kbuf = malloc(r->len);
+        if (r->kbuf == NULL) {
+            return false;
+        }
+    }
+    if ((r->opcode == AIO_WRITE || r->opcode == AIO_PWRITE)
+        && !copy_from_user(r->kbuf, r->ubuf, r->len)) {
+        req_free(r);
+        process_terminate(-1);
+    }
+    return true;
+}
+
+/* Carries out a request, in a worker thread. */
+static void
+run(struct work *w)
+{
+    struct aio_req *r = work_entry(w, struct aio_req, work);
+
+    switch (r->opcode) {
+    case AIO_READ:
+    case AIO_PREAD:
+        r->result = file_read_at(r->file, r->kbuf, r->len, r->ofs);
+        break;
+    case AIO_WRITE:
+    case AIO_PWRITE:
+        r->result = file_write_at(r->file, r->kbuf, r->len, r->ofs);
+        break;
+    case AIO_FSYNC:
+        file_sync(r->file, false);
+        r->result = 0;
+        break;
+    default:
+        NOT_REACHED();
+    }
+    complete(r);
+}
+
+/* Adds R to its context's completed requests. */
+static void
+complete(struct aio_req *r)
+{
+    struct aio_ctx *ctx = r->ctx;
+
+    lock_acquire(&ctx->lock);
+    list_push_back(&ctx->completed, &r->elem);
+    cond_signal(&ctx->done, &ctx->lock);
+    lock_release(&ctx->lock);
+}
+
+/* Frees R and what it holds. */
+static void
+req_free(struct aio_req *r)
+{
+    file_close(r->file);
+    free(r->kbuf);
+    free(r);
+}
+
+/* Copies SIZE bytes from SRC to user address UDST, or kills the
+ * process if UDST is not mapped. */
+static void
+copy_out(void *udst, const void *src, size_t size)
+{
+    if (!copy_to_user(udst, src, size)) {
+        process_terminate(-1);
+    }
+}
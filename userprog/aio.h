@@ -0,0 +1,49 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <stdint.h>
+
+struct thread;
+
+/* Most slots in each ring of an asynchronous I/O context. */
+#define AIO_ENTRIES_MAX 256
+
+/* Most bytes one asynchronous read or write may transfer. */
+#define AIO_LEN_MAX 65536
+
+/* A submission queue entry.  Must match the definition in
+ * lib/user/syscall.h. */
+struct aio_sqe {
+    int opcode;         /* AIO_READ, AIO_WRITE, ... */
+    int fd;             /* File descriptor. */
+    void *buf;          /* User buffer. */
+    unsigned len;       /* Bytes to transfer. */
+    unsigned offset;    /* File offset, for AIO_PREAD and AIO_PWRITE. */
+    uint32_t user_data; /* Copied to the completion. */
+};
+
+/* A completion queue entry.  Must match the definition in
+ * lib/user/syscall.h. */
+struct aio_cqe {
+    uint32_t user_data; /* From the submission. */
+    int result;         /* Bytes transferred, or -1 on error. */
+};
+
+/* The header of a pair of rings in user memory.  Must match the
+ * definition in lib/user/syscall.h. */
+struct aio_ring {
+    unsigned sq_head;     /* Next submission to take; kernel writes. */
+    unsigned sq_tail;     /* Next free submission slot; user writes. */
+    unsigned cq_head;     /* Next completion to reap; user writes. */
+    unsigned cq_tail;     /* Next free completion slot; kernel writes. */
+    unsigned entries;     /* Slots in each ring, a power of 2. */
+    struct aio_sqe *sqes; /* Submission ring. */
+    struct aio_cqe *cqes; /* Completion ring. */
+};
+
+void aio_init(void);
+int aio_setup(struct aio_ring *uring);
+int aio_enter(unsigned min_complete);
+void aio_destroy(struct thread *leader);
+
+#endif /* userprog/aio.h */
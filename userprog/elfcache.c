@@ -0,0 +1,141 @@
+#include <list.h>
+#include <stdio.h>
+
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "userprog/elfcache.h"
+
+/* Cache of parsed executables.
+ *
+ * Executing a program reads and checks its ELF header and every
+ * program header before any segment is mapped.  Programs are
+ * often run again and again, so the result is kept here, keyed
+ * by inode.  Each entry keeps its inode open, so that the
+ * inode's write count survives between runs; an entry whose
+ * inode has been written since it was parsed is stale and is
+ * dropped on lookup, as is one whose file has been removed, so
+ * that the cache does not hold on to its disk space. */
+
+/* Number of executables cached. */
+#define ELFCACHE_SIZE 8
+
+struct elfcache_entry {
+    struct inode *inode;     /* Executable, or null if unused. */
+    unsigned write_cnt;      /* inode_write_cnt() when parsed. */
+    struct elf_image image;  /* Parsed headers. */
+    struct list_elem elem;   /* Element in lru_list. */
+};
+
+static struct elfcache_entry entries[ELFCACHE_SIZE];
+static struct list lru_list;  /* All entries, most recently used first. */
+static struct lock elfcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;   /* Lookups that found a current entry. */
+static long long miss_cnt;  /* Lookups that did not. */
+static long long stale_cnt; /* Entries dropped as out of date. */
+
+static void drop(struct elfcache_entry *);
+
+/* Initializes the executable cache. */
+void
+elfcache_init(void)
+{
+    size_t i;
+
+    list_init(&lru_list);
+    lock_init(&elfcache_lock);
+    for (i = 0; i < ELFCACHE_SIZE; i++) {
+        list_push_back(&lru_list, &entries[i].elem);
+    }
+}
+
+/* Looks up INODE.  If it is cached and has not been written since
+ * it was parsed, copies its parsed headers into *IMAGE and returns
+ * true.  Otherwise returns false. */
+bool
+elfcache_lookup(struct inode *inode, struct elf_image *image)
+{
+    struct list_elem *e, *next;
+    bool found = false;
+
+    lock_acquire(&elfcache_lock);
+    for (e = list_begin(&lru_list); e != list_end(&lru_list); e = next) {
+        struct elfcache_entry *ce = list_entry(e, struct elfcache_entry, elem);
+
+        /* drop() moves CE to the back, where it is skipped. */
+        next = list_next(e);
+        if (ce->inode == NULL) {
+            continue;
+        }
+        if (inode_is_removed(ce->inode)
+            || inode_write_cnt(ce->inode) != ce->write_cnt) {
+            drop(ce);
+            stale_cnt++;
+        } else if (ce->inode == inode) {
+            *image = ce->image;
+            list_remove(&ce->elem);
+            list_push_front(&lru_list, &ce->elem);
+            found = true;
+            break;
+        }
+    }
+    if (found) {
+        hit_cnt++;
+    } else {
+        miss_cnt++;
+    }
+    lock_release(&elfcache_lock);
+    return found;
+}
+
+/* Caches IMAGE as the parsed headers of INODE, which had write
+ * count WRITE_CNT before they were read, replacing the least
+ * recently used entry. */
+void
+elfcache_insert(struct inode *inode, unsigned write_cnt,
+                const struct elf_image *image)
+{
+    struct elfcache_entry *ce;
+    struct list_elem *e;
+
+    lock_acquire(&elfcache_lock);
+    for (e = list_begin(&lru_list); e != list_end(&lru_list);
+         e = list_next(e)) {
+        ce = list_entry(e, struct elfcache_entry, elem);
+        if (ce->inode == inode) {
+            drop(ce);
+            break;
+        }
+    }
+
+    ce = list_entry(list_back(&lru_list), struct elfcache_entry, elem);
+    drop(ce);
+    ce->inode = inode_reopen(inode);
+    ce->write_cnt = write_cnt;
+    ce->image = *image;
+    list_remove(&ce->elem);
+    list_push_front(&lru_list, &ce->elem);
+    lock_release(&elfcache_lock);
+}
+
+/* Prints executable cache statistics. */
+void
+elfcache_print_stats(void)
+{
+    printf("Exec cache: %lld hits, %lld misses, %lld stale\n",
+           hit_cnt, miss_cnt, stale_cnt);
+}
+
+/* Empties CE and moves it to the back of the LRU list, so that it
+ * is reused first. */
+static void
+drop(struct elfcache_entry *ce)
+{
+    if (ce->inode != NULL) {
+        inode_close(ce->inode);
+        ce->inode = NULL;
+    }
+    list_remove(&ce->elem);
+    list_push_back(&lru_list, &ce->elem);
+}
@@ -0,0 +1,37 @@
+#ifndef USERPROG_ELFCACHE_H
+#define USERPROG_ELFCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct inode;
+
+/* Most loadable segments an executable may have. */
+#define ELF_MAX_SEGMENTS 16
+
+/* A loadable segment, already checked by validate_segment() and
+ * converted to the arguments load_segment() takes. */
+struct elf_segment {
+    uint32_t file_page;  /* Page-aligned offset in the file. */
+    uint32_t mem_page;   /* Page-aligned user virtual address. */
+    uint32_t read_bytes; /* Bytes to read from the file. */
+    uint32_t zero_bytes; /* Bytes to zero after them. */
+    bool writable;       /* Writable by the process? */
+};
+
+/* What load() needs to know about an executable after parsing
+ * its headers. */
+struct elf_image {
+    uint32_t entry;                               /* Entry point. */
+    size_t seg_cnt;                               /* Number of segments. */
+    struct elf_segment segs[ELF_MAX_SEGMENTS];    /* Loadable segments. */
+};
+
+void elfcache_init(void);
+bool elfcache_lookup(struct inode *, struct elf_image *);
+void elfcache_insert(struct inode *, unsigned write_cnt,
+                     const struct elf_image *);
+void elfcache_print_stats(void);
+
+#endif /* userprog/elfcache.h */
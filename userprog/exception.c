@@ -1,15 +1,28 @@
 #include <inttypes.h>
+#include <kstat.h>
 #include <stdio.h>
 
+#include "devices/timer.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
 static void kill(struct intr_frame *);
+static void debug(struct intr_frame *);
+static void device_not_available(struct intr_frame *);
 static void page_fault(struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -43,9 +56,10 @@ exception_init(void)
      * caused indirectly, e.g. #DE can be caused by dividing by
      * 0.  */
     intr_register_int(0,  0, INTR_ON, kill, "#DE Divide Error");
-    intr_register_int(1,  0, INTR_ON, kill, "#DB Debug Exception");
+    intr_register_int(1,  0, INTR_ON, debug, "#DB Debug Exception");
     intr_register_int(6,  0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-    intr_register_int(7,  0, INTR_ON, kill, "#NM Device Not Available Exception");
+    intr_register_int(7,  0, INTR_ON, device_not_available,
+                      "#NM Device Not Available Exception");
     intr_register_int(11, 0, INTR_ON, kill, "#NP Segment Not Present");
     intr_register_int(12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
     intr_register_int(13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -65,6 +79,24 @@ exception_print_stats(void)
     printf("Exception: %lld page faults\n", page_fault_cnt);
 }
 
+/* Stores the number of page faults in *ST. */
+void
+exception_kstat(struct kstat *st)
+{
+    st->page_faults = page_fault_cnt;
+}
+
+/* #NM handler: a thread's first use of the FPU since it last
+ * ran.  Loads its FPU state, or kills it if the FPU cannot be
+ * used. */
+static void
+device_not_available(struct intr_frame *f)
+{
+    if (!fpu_restore()) {
+        kill(f);
+    }
+}
+
 /* Handler for an exception (probably) caused by a user process. */
 static void
 kill(struct intr_frame *f)
@@ -86,7 +118,7 @@ kill(struct intr_frame *f)
         printf("%s: dying due to interrupt %#04x (%s).\n",
                thread_name(), f->vec_no, intr_name(f->vec_no));
         intr_dump_frame(f);
-        thread_exit();
+        process_terminate(-1);
 
     case SEL_KCSEG:
         /* Kernel's code segment, which indicates a kernel bug.
@@ -105,6 +137,21 @@ kill(struct intr_frame *f)
     }
 }
 
+/* Debug exception handler.  The kernel never sets the trap
+ * flag, but SYSENTER, unlike an interrupt gate, keeps the user's,
+ * so the kernel takes a single-step trap at sysenter_entry.
+ * Clear the flag and carry on; otherwise treat it like any other
+ * exception. */
+static void
+debug(struct intr_frame *f)
+{
+    if (f->cs == SEL_KCSEG && (f->eflags & FLAG_TF)) {
+        f->eflags &= ~FLAG_TF;
+        return;
+    }
+    kill(f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
  * to implement virtual memory.  Some solutions to project 2 may
  * also require modifying this code.
@@ -139,15 +186,45 @@ page_fault(struct intr_frame *f)
 
     /* Count page faults. */
     page_fault_cnt++;
+    trace(TRACE_PAGE_FAULT, (uint32_t) fault_addr, f->error_code);
 
     /* Determine cause. */
     not_present = (f->error_code & PF_P) == 0;
     write = (f->error_code & PF_W) != 0;
     user = (f->error_code & PF_U) != 0;
 
-    /* To implement virtual memory, delete the rest of the function
-     * body, and replace it with code that brings in the page to
-     * which fault_addr refers. */
+#ifdef VM
+    /* A fault on a page the process has but that isn't resident
+     * yet, or on a new page of its stack, is resolved by bringing
+     * the page in and retrying the access; so is the first write
+     * to a page backed by the read-only zero page.  Kernel faults
+     * on user addresses count too: system calls touch user buffers
+     * directly, and then the user stack pointer is the one saved
+     * on entry to the system call. */
+    if (is_user_vaddr(fault_addr)) {
+        uint64_t start = timer_cycles();
+        enum fault_class cls;
+        bool handled;
+
+        handled = page_fault_in(fault_addr, write,
+                                user ? f->esp : thread_current()->user_esp,
+                                &cls);
+        fault_record(handled ? cls : FAULT_INVALID, timer_cycles() - start);
+        if (handled) {
+            return;
+        }
+    }
+#endif
+
+    /* A kernel fault on a user address inside one of the user
+     * access routines means the user passed a bad pointer.  Make
+     * the routine return false instead of panicking. */
+    if (!user && is_user_vaddr(fault_addr)
+        && (char *)f->eip >= uaccess_start && (char *)f->eip < uaccess_end) {
+        f->eip = (void (*)(void))uaccess_fixup;
+        return;
+    }
+
     printf("Page fault at %p: %s error %s page in %s context.\n",
            fault_addr,
            not_present ? "not present" : "rights violation",
@@ -0,0 +1,264 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <limits.h>
+#include <string.h>
+
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "userprog/fdtable.h"
+#include "userprog/pipe.h"
+
+/* Descriptors in a new table. */
+#define FD_TABLE_INIT 16
+
+static bool clone(struct fd_table *, const struct fd_table *);
+static bool is_open(const struct fd_table *, int fd);
+static bool grow(struct fd_table *);
+static void release(struct fd *);
+
+/* Initializes T with descriptors 0 and 1 open on the console.
+ * Returns false if memory could not be allocated. */
+bool
+fd_table_init(struct fd_table *t)
+{
+    struct fd in = {FD_STDIN, NULL, NULL, NULL, 0, false};
+    struct fd out = {FD_STDOUT, NULL, NULL, NULL, 0, false};
+
+    lock_init(&t->lock);
+    t->capacity = FD_TABLE_INIT;
+    t->fds = malloc(sizeof *t->fds * t->capacity);
+    t->used = bitmap_create(t->capacity);
+    if (t->fds == NULL || t->used == NULL) {
+        fd_table_destroy(t);
+        return false;
+    }
+    fd_install(t, &in);
+    fd_install(t, &out);
+    return true;
+}
+
+/* Initializes T as a copy of FROM, for a forked process.  Each
+ * open file is reopened at the same position.  Returns false if
+ * memory could not be allocated. */
+bool
+fd_table_clone(struct fd_table *t, struct fd_table *from)
+{
+    bool success;
+
+    lock_init(&t->lock);
+    lock_acquire(&from->lock);
+    success = clone(t, from);
+    lock_release(&from->lock);
+    return success;
+}
+
+/* Does the work of fd_table_clone() with FROM's lock held. */
+static bool
+clone(struct fd_table *t, const struct fd_table *from)
+{
+    size_t i;
+
+    t->capacity = from->capacity;
+    t->fds = malloc(sizeof *t->fds * t->capacity);
+    t->used = bitmap_create(t->capacity);
+    if (t->fds == NULL || t->used == NULL) {
+        fd_table_destroy(t);
+        return false;
+    }
+    for (i = 0; i < from->capacity; i++) {
+        struct fd *fd = &t->fds[i];
+
+        if (!bitmap_test(from->used, i) || from->fds[i].closing) {
+            continue;
+        }
+        *fd = from->fds[i];
+        fd->users = 0;
+        if (fd->type == FD_FILE) {
+            fd->file = file_reopen(fd->file);
+            if (fd->file == NULL) {
+                fd_table_destroy(t);
+                return false;
+            }
+            file_seek(fd->file, file_tell(from->fds[i].file));
+        } else if (fd->type == FD_DIR) {
+            fd->dir = dir_reopen(fd->dir);
+            if (fd->dir == NULL) {
+                fd_table_destroy(t);
+                return false;
+            }
+        } else if (fd->type == FD_PIPE_R || fd->type == FD_PIPE_W) {
+            pipe_reopen(fd->pipe, fd->type == FD_PIPE_W);
+        }
+        bitmap_mark(t->used, i);
+    }
+    return true;
+}
+
+/* Closes every descriptor in T and frees its storage.  T may
+ * also be a table that was never initialized but is zeroed, as
+ * in a process that failed to load.  No other thread may be
+ * using T, but a descriptor that a killed thread left in use
+ * is closed here. */
+void
+fd_table_destroy(struct fd_table *t)
+{
+    size_t i;
+
+    if (t->used != NULL) {
+        for (i = 0; i < t->capacity; i++) {
+            if (bitmap_test(t->used, i)) {
+                release(&t->fds[i]);
+            }
+        }
+        bitmap_destroy(t->used);
+    }
+    free(t->fds);
+    t->fds = NULL;
+    t->used = NULL;
+    t->capacity = 0;
+}
+
+/* Adds FD to T under the lowest free descriptor number and
+ * returns that number, or -1 if memory could not be allocated.
+ * On success T takes over FD's file or directory. */
+int
+fd_install(struct fd_table *t, const struct fd *fd)
+{
+    size_t idx;
+
+    lock_acquire(&t->lock);
+    idx = bitmap_scan_and_flip(t->used, 0, 1, false);
+    if (idx == BITMAP_ERROR) {
+        idx = t->capacity;
+        if (idx > INT_MAX / 2 || !grow(t)) {
+            lock_release(&t->lock);
+            return -1;
+        }
+        bitmap_mark(t->used, idx);
+    }
+    t->fds[idx] = *fd;
+    t->fds[idx].users = 0;
+    t->fds[idx].closing = false;
+    lock_release(&t->lock);
+    return idx;
+}
+
+/* Copies descriptor FD in T into *OUT and returns true, or
+ * returns false if FD is not open.  On success, what FD refers
+ * to stays open until the caller passes FD to fd_put(), even if
+ * another thread closes FD meanwhile. */
+bool
+fd_lookup(struct fd_table *t, int fd, struct fd *out)
+{
+    bool open;
+
+    lock_acquire(&t->lock);
+    open = is_open(t, fd);
+    if (open) {
+        t->fds[fd].users++;
+        *out = t->fds[fd];
+    }
+    lock_release(&t->lock);
+    return open;
+}
+
+/* Ends a successful fd_lookup() of FD in T.  If FD was closed
+ * since, and this was its last user, closes what it referred to
+ * and frees the descriptor number. */
+void
+fd_put(struct fd_table *t, int fd)
+{
+    struct fd *d;
+    struct fd closed;
+
+    lock_acquire(&t->lock);
+    ASSERT(fd >= 0 && (size_t)fd < t->capacity && bitmap_test(t->used, fd));
+    d = &t->fds[fd];
+    ASSERT(d->users > 0);
+    if (--d->users > 0 || !d->closing) {
+        lock_release(&t->lock);
+        return;
+    }
+    closed = *d;
+    bitmap_reset(t->used, fd);
+    lock_release(&t->lock);
+
+    release(&closed);
+}
+
+/* Closes descriptor FD in T and returns true, or returns false
+ * if FD is not open.  If a lookup of FD is in progress, leaves
+ * it to fd_put() to finish the job. */
+bool
+fd_close(struct fd_table *t, int fd)
+{
+    struct fd closed;
+
+    lock_acquire(&t->lock);
+    if (!is_open(t, fd)) {
+        lock_release(&t->lock);
+        return false;
+    }
+    if (t->fds[fd].users > 0) {
+        t->fds[fd].closing = true;
+        lock_release(&t->lock);
+        return true;
+    }
+    closed = t->fds[fd];
+    bitmap_reset(t->used, fd);
+    lock_release(&t->lock);
+
+    release(&closed);
+    return true;
+}
+
+/* Returns true if descriptor FD in T is open and not closing. */
+static bool
+is_open(const struct fd_table *t, int fd)
+{
+    return fd >= 0 && (size_t)fd < t->capacity && bitmap_test(t->used, fd)
+           && !t->fds[fd].closing;
+}
+
+/* Doubles the capacity of T.  Returns false if memory could not
+ * be allocated, leaving T unchanged. */
+static bool
+grow(struct fd_table *t)
+{
+    size_t capacity = t->capacity * 2;
+    struct bitmap *used;
+    struct fd *fds;
+    size_t i;
+
+    used = bitmap_create(capacity);
+    if (used == NULL) {
+        return false;
+    }
+    fds = realloc(t->fds, sizeof *fds * capacity);
+    if (fds == NULL) {
+        bitmap_destroy(used);
+        return false;
+    }
+    for (i = 0; i < t->capacity; i++) {
+        bitmap_set(used, i, bitmap_test(t->used, i));
+    }
+    bitmap_destroy(t->used);
+    t->fds = fds;
+    t->used = used;
+    t->capacity = capacity;
+    return true;
+}
+
+/* Closes whatever FD refers to. */
+static void
+release(struct fd *fd)
+{
+    if (fd->type == FD_FILE) {
+        file_close(fd->file);
+    } else if (fd->type == FD_DIR) {
+        dir_close(fd->dir);
+    } else if (fd->type == FD_PIPE_R || fd->type == FD_PIPE_W) {
+        pipe_close(fd->pipe, fd->type == FD_PIPE_W);
+    }
+}
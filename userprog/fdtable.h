@@ -0,0 +1,61 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+struct bitmap;
+struct dir;
+struct file;
+struct pipe;
+
+/* What a file descriptor refers to. */
+enum fd_type {
+    FD_STDIN,  /* Console input. */
+    FD_STDOUT, /* Console output. */
+    FD_FILE,   /* Open file. */
+    FD_DIR,    /* Open directory. */
+    FD_PIPE_R, /* Read end of a pipe. */
+    FD_PIPE_W  /* Write end of a pipe. */
+};
+
+/* An open file descriptor. */
+struct fd {
+    enum fd_type type;  /* What the descriptor refers to. */
+    struct file *file;  /* Open file, for FD_FILE. */
+    struct dir *dir;    /* Open directory, for FD_DIR. */
+    struct pipe *pipe;  /* Pipe, for FD_PIPE_R and FD_PIPE_W. */
+    int users;          /* In the table, lookups not yet put. */
+    bool closing;       /* In the table, closed but still in use? */
+};
+
+/* A process's file descriptors.  Descriptor N is FDS[N] when bit
+ * N of USED is set, so lookup is a bounds check and a bit test.
+ * New descriptors take the lowest free number, as in Unix.  The
+ * array doubles when it fills up.
+ *
+ * The threads of a process share its table, so LOCK guards it,
+ * and lookups copy a descriptor out rather than point into an
+ * array that another thread may move.  A lookup also counts as a
+ * user of the descriptor until fd_put(), and closing a
+ * descriptor in use only marks it, leaving the last user to close
+ * the object and free the number, so that another thread's
+ * close() cannot free an object out from under a system call. */
+struct fd_table {
+    struct lock lock;     /* Guards the members below. */
+    struct fd *fds;       /* Array of CAPACITY descriptors. */
+    struct bitmap *used;  /* One bit per descriptor, true if in use. */
+    size_t capacity;      /* Number of descriptors that fit. */
+};
+
+bool fd_table_init(struct fd_table *);
+bool fd_table_clone(struct fd_table *, struct fd_table *);
+void fd_table_destroy(struct fd_table *);
+
+int fd_install(struct fd_table *, const struct fd *);
+bool fd_lookup(struct fd_table *, int fd, struct fd *);
+void fd_put(struct fd_table *, int fd);
+bool fd_close(struct fd_table *, int fd);
+
+#endif /* userprog/fdtable.h */
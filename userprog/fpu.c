@@ -0,0 +1,207 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.
+ *
+ * The x87 and SSE registers are not saved by switch_threads().
+ * Instead, they hold the state of one thread, FPU_OWNER, at a
+ * time, and CR0.TS is set whenever any other thread runs, so
+ * that its first FPU or SSE instruction raises #NM.  The #NM
+ * handler then saves the owner's registers into its fpu_state,
+ * loads the running thread's, and makes it the owner.  A thread
+ * that never uses the FPU never has its state saved or
+ * restored, nor even allocated.
+ *
+ * The kernel itself is compiled with -msoft-float and never
+ * touches the FPU. */
+
+/* CR0 and CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002         /* Monitor coprocessor. */
+#define CR0_EM 0x00000004         /* Emulation: FPU instructions fault. */
+#define CR0_TS 0x00000008         /* Task switched: FPU use faults. */
+#define CR0_NE 0x00000020         /* Report x87 errors as #MF. */
+#define CR4_OSFXSR 0x00000200     /* FXSAVE/FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* Unmasked SSE errors raise #XF. */
+
+/* x87, MMX and SSE registers as saved by FXSAVE.  See
+ * [IA32-v2a] "FXSAVE". */
+struct fpu_state {
+    uint8_t regs[512];
+} __attribute__((aligned(16)));
+
+/* True if the FPU may be used at all.  If not, CR0.EM stays set
+ * and FPU instructions kill the process, as before. */
+static bool fpu_enabled;
+
+/* Thread whose state is in the FPU registers, or null. */
+static struct thread *fpu_owner;
+
+/* True if CR0.TS is set. */
+static bool fpu_trapping;
+
+/* State of a freshly initialized FPU, loaded on a thread's first
+ * use. */
+static struct fpu_state initial_state;
+
+/* Cache of fpu_state objects. */
+static struct kmem_cache *fpu_cache;
+
+static void set_trapping(bool);
+
+/* Turns on the FPU, if it supports FXSAVE, with CR0.TS set so
+ * that the first thread to use it traps. */
+void
+fpu_init(void)
+{
+    uint32_t features = cpuid_features();
+    uint32_t cr0, cr4;
+
+    if (!(features & CPUID_FXSR)) {
+        printf("fpu: no FXSAVE support, FPU disabled\n");
+        return;
+    }
+
+    asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+    cr4 |= CR4_OSFXSR;
+    if (features & CPUID_SSE) {
+        cr4 |= CR4_OSXMMEXCPT;
+    }
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
+    asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+    asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+    asm volatile ("fninit; fxsave %0" : "=m" (initial_state));
+
+    fpu_cache = kmem_cache_create("fpu", sizeof(struct fpu_state), 16,
+                                  NULL);
+    fpu_enabled = true;
+    set_trapping(true);
+}
+
+/* Handles #NM for the running thread: makes it the FPU's owner,
+ * saving the previous owner's state and loading the running
+ * thread's, which is allocated in the initial state on first
+ * use.  Returns false if the FPU is disabled or no memory is
+ * available, in which case the thread may not use the FPU. */
+bool
+fpu_restore(void)
+{
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
+
+    if (!fpu_enabled) {
+        return false;
+    }
+    if (cur->fpu == NULL) {
+        cur->fpu = kmem_cache_alloc(fpu_cache);
+        if (cur->fpu == NULL) {
+            return false;
+        }
+        *cur->fpu = initial_state;
+    }
+
+    old_level = intr_disable();
+    set_trapping(false);
+    if (fpu_owner != cur) {
+        if (fpu_owner != NULL) {
+            asm volatile ("fxsave %0" : "=m" (*fpu_owner->fpu));
+        }
+        asm volatile ("fxrstor %0" : : "m" (*cur->fpu));
+        fpu_owner = cur;
+    }
+    intr_set_level(old_level);
+    return true;
+}
+
+/* Arranges for thread T, which is about to run, to trap on its
+ * first use of the FPU, unless its state is already loaded.
+ * Interrupts must be off. */
+void
+fpu_activate(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (fpu_enabled) {
+        set_trapping(t != fpu_owner);
+    }
+}
+
+/* Gives the running thread, which must not have used the FPU
+ * yet, a copy of thread FROM's FPU state.  FROM must not run
+ * meanwhile.  Returns false if out of memory. */
+bool
+fpu_clone(struct thread *from)
+{
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(cur->fpu == NULL);
+
+    if (from->fpu == NULL) {
+        return true;
+    }
+    cur->fpu = kmem_cache_alloc(fpu_cache);
+    if (cur->fpu == NULL) {
+        return false;
+    }
+
+    old_level = intr_disable();
+    if (fpu_owner == from) {
+        /* FROM's latest state is still in the registers. */
+        set_trapping(false);
+        asm volatile ("fxsave %0" : "=m" (*from->fpu));
+        set_trapping(true);
+    }
+    intr_set_level(old_level);
+
+    *cur->fpu = *from->fpu;
+    return true;
+}
+
+/* Frees the running thread's FPU state, which is about to exit. */
+void
+fpu_exit(void)
+{
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
+
+    if (cur->fpu == NULL) {
+        return;
+    }
+
+    old_level = intr_disable();
+    if (fpu_owner == cur) {
+        fpu_owner = NULL;
+        set_trapping(true);
+    }
+    intr_set_level(old_level);
+
+    kmem_cache_free(fpu_cache, cur->fpu);
+    cur->fpu = NULL;
+}
+
+/* Sets CR0.TS if TRAPPING is true, or clears it if not, unless it
+ * is already so. */
+static void
+set_trapping(bool trapping)
+{
+    if (trapping != fpu_trapping) {
+        if (trapping) {
+            uint32_t cr0;
+
+            asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+            asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS));
+        } else {
+            asm volatile ("clts");
+        }
+        fpu_trapping = trapping;
+    }
+}
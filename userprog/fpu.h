@@ -0,0 +1,14 @@
+#ifndef USERPROG_FPU_H
+#define USERPROG_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init(void);
+bool fpu_restore(void);
+void fpu_activate(struct thread *);
+bool fpu_clone(struct thread *);
+void fpu_exit(void);
+
+#endif /* userprog/fpu.h */
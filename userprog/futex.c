@@ -0,0 +1,138 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/uaccess.h"
+
+/* Futexes: sleeping and waking on a word of user memory, so that
+ * user locks need a system call only when they are contended.
+ *
+ * A thread that finds a lock taken calls futex_wait() with the
+ * value it saw; it sleeps only if the word still holds it, so a
+ * release that slips in between is not missed.  The releasing
+ * thread calls futex_wake() only if it saw that someone might be
+ * waiting.
+ *
+ * Waiters are kept in a list in the process's leader, keyed by
+ * user address, and each waits on a semaphore of its own.  The
+ * list is protected by turning interrupts off.  The word itself
+ * is read with interrupts on, since reading it may fault a page
+ * in, so a waiter joins the list before reading the word and
+ * leaves again if it does not hold the value: a wake that
+ * arrives meanwhile finds it already listed. */
+
+/* A thread in futex_wait(). */
+struct futex_waiter {
+    const int *uaddr;       /* Word waited on. */
+    struct semaphore woken; /* Upped by futex_wake(). */
+    bool listed;            /* On the leader's futex_waiters? */
+    struct list_elem elem;  /* Element in futex_waiters. */
+};
+
+static void wake(struct list *);
+
+/* Sleeps until futex_wake() is called on UADDR, if the word at
+ * UADDR holds VAL.  Does not sleep if the process is exiting. */
+enum futex_result
+futex_wait(const int *uaddr, int val)
+{
+    struct thread *leader = thread_current()->leader;
+    struct futex_waiter w;
+    enum intr_level old_level;
+    bool fault;
+    int cur;
+
+    if ((uintptr_t) uaddr % sizeof *uaddr != 0) {
+        return FUTEX_FAULT;
+    }
+
+    w.uaddr = uaddr;
+    sema_init(&w.woken, 0);
+    w.listed = true;
+    old_level = intr_disable();
+    list_push_back(&leader->futex_waiters, &w.elem);
+    intr_set_level(old_level);
+
+    fault = !copy_from_user(&cur, uaddr, sizeof cur);
+
+    old_level = intr_disable();
+    if (w.listed && (fault || cur != val || leader->exiting)) {
+        list_remove(&w.elem);
+        intr_set_level(old_level);
+        return fault ? FUTEX_FAULT : FUTEX_CHANGED;
+    }
+    intr_set_level(old_level);
+
+    sema_down(&w.woken);
+    return FUTEX_WOKEN;
+}
+
+/* Wakes up to CNT threads waiting on UADDR, oldest first, and
+ * returns the number woken. */
+int
+futex_wake(const int *uaddr, int cnt)
+{
+    struct thread *leader = thread_current()->leader;
+    struct list woken;
+    struct list_elem *e;
+    enum intr_level old_level;
+    int woken_cnt = 0;
+
+    /* Take the waiters off the list first, since sema_up() may
+     * switch threads. */
+    list_init(&woken);
+    old_level = intr_disable();
+    e = list_begin(&leader->futex_waiters);
+    while (e != list_end(&leader->futex_waiters) && woken_cnt < cnt) {
+        struct futex_waiter *w = list_entry(e, struct futex_waiter, elem);
+
+        if (w->uaddr == uaddr) {
+            e = list_remove(e);
+            w->listed = false;
+            list_push_back(&woken, &w->elem);
+            woken_cnt++;
+        } else {
+            e = list_next(e);
+        }
+    }
+    intr_set_level(old_level);
+
+    wake(&woken);
+    return woken_cnt;
+}
+
+/* Wakes every thread in a futex wait in LEADER's process, which
+ * is exiting. */
+void
+futex_wake_all(struct thread *leader)
+{
+    struct list woken;
+    struct list_elem *e;
+    enum intr_level old_level;
+
+    list_init(&woken);
+    old_level = intr_disable();
+    for (e = list_begin(&leader->futex_waiters);
+         e != list_end(&leader->futex_waiters); e = list_next(e)) {
+        list_entry(e, struct futex_waiter, elem)->listed = false;
+    }
+    list_splice(list_end(&woken), list_begin(&leader->futex_waiters),
+                list_end(&leader->futex_waiters));
+    intr_set_level(old_level);
+
+    wake(&woken);
+}
+
+/* Wakes each waiter in list WOKEN. */
+static void
+wake(struct list *woken)
+{
+    while (!list_empty(woken)) {
+        struct list_elem *e = list_pop_front(woken);
+
+        sema_up(&list_entry(e, struct futex_waiter, elem)->woken);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Results of futex_wait(). */
+enum futex_result {
+    FUTEX_WOKEN,    /* Slept until woken. */
+    FUTEX_CHANGED,  /* Word did not hold the value; did not sleep. */
+    FUTEX_FAULT     /* Word is not valid user memory. */
+};
+
+enum futex_result futex_wait(const int *uaddr, int val);
+int futex_wake(const int *uaddr, int cnt);
+void futex_wake_all(struct thread *leader);
+
+#endif /* userprog/futex.h */
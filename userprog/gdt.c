@@ -1,5 +1,6 @@
 #include <debug.h>
 
+#include "threads/cpu.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
@@ -22,8 +23,12 @@
  *
  * For more information on the GDT as used here, refer to
  * [IA32-v3a] 3.2 "Using Segments" through 3.5 "System Descriptor
- * Types". */
-static uint64_t gdt[SEL_CNT];
+ * Types".
+ *
+ * A TSS descriptor is marked busy while loaded, so each
+ * application processor has its own, in the entries past
+ * SEL_CNT. */
+static uint64_t gdt[SEL_CNT + CPU_MAX];
 
 /* GDT helpers. */
 static uint64_t make_code_desc(int dpl);
@@ -57,6 +62,22 @@ gdt_init(void)
     asm volatile ("ltr %w0" : : "q" (SEL_TSS));
 }
 
+/* Loads the GDT on the application processor that is cpus[IDX],
+ * with TSS as its task-state segment. */
+void
+gdt_init_ap(size_t idx, struct tss *tss)
+{
+    uint64_t gdtr_operand;
+    unsigned sel = (SEL_CNT + idx) * sizeof *gdt;
+
+    ASSERT(idx < CPU_MAX);
+
+    gdt[sel / sizeof *gdt] = make_tss_desc(tss);
+    gdtr_operand = make_gdtr_operand(sizeof gdt - 1, gdt);
+    asm volatile ("lgdt %0" : : "m" (gdtr_operand));
+    asm volatile ("ltr %w0" : : "q" (sel));
+}
+
 /* System segment or code/data segment? */
 enum seg_class {
     CLS_SYSTEM    = 0, /* System segment. */
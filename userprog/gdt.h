@@ -10,6 +10,13 @@
 #define SEL_TSS   0x28 /* Task-state segment. */
 #define SEL_CNT   6    /* Number of segments. */
 
+#ifndef __ASSEMBLER__
+#include <stddef.h>
+
+struct tss;
+
 void gdt_init(void);
+void gdt_init_ap(size_t idx, struct tss *);
+#endif
 
 #endif /* userprog/gdt.h */
@@ -1,15 +1,48 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "userprog/pagedir.h"
 
+/* Most pages pagedir_invalidate_range() invalidates one at a
+ * time rather than flushing the whole TLB. */
+#define INVLPG_MAX 32
+
+/* Pages pagedir_destroy() gathers before freeing them together. */
+#define FREE_BATCH 64
+
+/* Most page tables, and most page directories, kept for reuse. */
+#define RECYCLE_MAX 64
+
+/* Pages that pagedir_destroy() kept for reuse rather than freeing,
+ * linked through their first word.  A recycled page table is all
+ * zeros, and a recycled page directory has the kernel's entries
+ * and nothing else, apart from the link, which is cleared when
+ * the page is taken.  This saves zeroing or copying a whole page
+ * each time an address space is created, and a trip through
+ * palloc for each page table.  The kernel's entries never change
+ * after boot (see threads/vmalloc.c), so a recycled directory's
+ * copy of them stays current.  Interrupts are disabled while a
+ * list is updated. */
+struct recycle {
+    void *head;                 /* First page, or null. */
+    size_t cnt;                 /* Number of pages. */
+    long long reuse_cnt;        /* Pages taken from the list. */
+};
+static struct recycle free_pts, free_pds;
+
+static void *recycle_get(struct recycle *);
+static bool recycle_put(struct recycle *, void *page);
+static void free_later(void **batch, size_t *batch_cnt, void *page);
+
 static uint32_t *active_pd(void);
 
-static void invalidate_pagedir(uint32_t *);
+static void invalidate_page(uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
@@ -18,19 +51,28 @@ static void invalidate_pagedir(uint32_t *);
 uint32_t *
 pagedir_create(void)
 {
-    uint32_t *pd = palloc_get_page(0);
+    size_t user_cnt = pd_no(PHYS_BASE);
+    uint32_t *pd = recycle_get(&free_pds);
 
-    if (pd != NULL) {
-        memcpy(pd, init_page_dir, PGSIZE);
+    if (pd == NULL) {
+        pd = palloc_get_page(0);
+        if (pd != NULL) {
+            memset(pd, 0, user_cnt * sizeof *pd);
+            memcpy(pd + user_cnt, init_page_dir + user_cnt,
+                   PGSIZE - user_cnt * sizeof *pd);
+        }
     }
     return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
- * references. */
+ * references.  Clears each entry on the way, so that PD and its
+ * page tables can be recycled. */
 void
 pagedir_destroy(uint32_t *pd)
 {
+    void *batch[FREE_BATCH];
+    size_t batch_cnt = 0;
     uint32_t *pde;
 
     if (pd == NULL) {
@@ -45,13 +87,98 @@ pagedir_destroy(uint32_t *pd)
 
             for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++) {
                 if (*pte & PTE_P) {
-                    palloc_free_page(pte_get_page(*pte));
+                    free_later(batch, &batch_cnt, pte_get_page(*pte));
                 }
+                *pte = 0;
+            }
+            if (!recycle_put(&free_pts, pt)) {
+                free_later(batch, &batch_cnt, pt);
             }
-            palloc_free_page(pt);
         }
+        *pde = 0;
+    }
+    palloc_free_batch(batch, batch_cnt);
+    if (!recycle_put(&free_pds, pd)) {
+        palloc_free_page(pd);
+    }
+}
+
+/* Returns the number of pages that PD itself occupies: the page
+ * directory and the page tables for user addresses.  The kernel's
+ * page tables are shared by every page directory, so they are not
+ * counted. */
+size_t
+pagedir_page_cnt(uint32_t *pd)
+{
+    size_t cnt = 1;
+    uint32_t *pde;
+
+    for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++) {
+        if (*pde & PTE_P) {
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/* Prints page table recycling statistics. */
+void
+pagedir_print_stats(void)
+{
+    printf("Page tables: %lld page directories and %lld page tables "
+           "reused, %zu and %zu kept\n", free_pds.reuse_cnt,
+           free_pts.reuse_cnt, free_pds.cnt, free_pts.cnt);
+}
+
+/* Takes a page from list R and returns it, with its link cleared,
+ * or returns a null pointer if R is empty. */
+static void *
+recycle_get(struct recycle *r)
+{
+    enum intr_level old_level = intr_disable();
+    void **page = r->head;
+
+    if (page != NULL) {
+        r->head = *page;
+        r->cnt--;
+        r->reuse_cnt++;
+    }
+    intr_set_level(old_level);
+
+    if (page != NULL) {
+        *page = NULL;
+    }
+    return page;
+}
+
+/* Adds PAGE to list R and returns true, or returns false if R is
+ * already full.  The caller must have cleared PAGE's first word,
+ * which becomes the link. */
+static bool
+recycle_put(struct recycle *r, void *page)
+{
+    enum intr_level old_level = intr_disable();
+    bool kept = r->cnt < RECYCLE_MAX;
+
+    if (kept) {
+        *(void **) page = r->head;
+        r->head = page;
+        r->cnt++;
+    }
+    intr_set_level(old_level);
+    return kept;
+}
+
+/* Adds PAGE to the *BATCH_CNT pages in BATCH, an array of
+ * FREE_BATCH, first freeing those if it is full. */
+static void
+free_later(void **batch, size_t *batch_cnt, void *page)
+{
+    if (*batch_cnt == FREE_BATCH) {
+        palloc_free_batch(batch, *batch_cnt);
+        *batch_cnt = 0;
     }
-    palloc_free_page(pd);
+    batch[(*batch_cnt)++] = page;
 }
 
 /* Returns the address of the page table entry for virtual
@@ -75,7 +202,10 @@ lookup_page(uint32_t *pd, const void *vaddr, bool create)
     pde = pd + pd_no(vaddr);
     if (*pde == 0) {
         if (create) {
-            pt = palloc_get_page(PAL_ZERO);
+            pt = recycle_get(&free_pts);
+            if (pt == NULL) {
+                pt = palloc_get_page(PAL_ZERO);
+            }
             if (pt == NULL) {
                 return NULL;
             }
@@ -156,7 +286,7 @@ pagedir_clear_page(uint32_t *pd, void *upage)
     pte = lookup_page(pd, upage, false);
     if (pte != NULL && (*pte & PTE_P) != 0) {
         *pte &= ~PTE_P;
-        invalidate_pagedir(pd);
+        invalidate_page(pd, upage);
     }
 }
 
@@ -184,7 +314,7 @@ pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty)
             *pte |= PTE_D;
         } else {
             *pte &= ~(uint32_t)PTE_D;
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
@@ -213,7 +343,7 @@ pagedir_set_accessed(uint32_t *pd, const void *vpage, bool accessed)
             *pte |= PTE_A;
         } else {
             *pte &= ~(uint32_t)PTE_A;
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
@@ -235,6 +365,40 @@ pagedir_activate(uint32_t *pd)
     asm volatile ("movl %0, %%cr3" : : "r" (vtop(pd)) : "memory");
 }
 
+/* Drops the TLB entries for the PAGE_CNT pages starting at
+ * VADDR, if PD is the active page directory, after their page
+ * table entries have been changed together.  Each page is
+ * invalidated on its own up to INVLPG_MAX pages; past that,
+ * reloading CR3 to flush the whole TLB is cheaper than the
+ * individual invalidations and the refills they save. */
+void
+pagedir_invalidate_range(uint32_t *pd, const void *vaddr, size_t page_cnt)
+{
+    const uint8_t *page = vaddr;
+    size_t i;
+
+    ASSERT(pg_ofs(vaddr) == 0);
+
+    if (active_pd() != pd) {
+        return;
+    }
+    if (page_cnt > INVLPG_MAX) {
+        pagedir_activate(pd);
+        return;
+    }
+    for (i = 0; i < page_cnt; i++) {
+        asm volatile ("invlpg (%0)" : : "r" (page + i * PGSIZE) : "memory");
+    }
+}
+
+/* Returns true if PD, or init_page_dir if PD is null, is the
+ * page directory currently loaded into the CPU. */
+bool
+pagedir_is_active(uint32_t *pd)
+{
+    return active_pd() == (pd != NULL ? pd : init_page_dir);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd(void)
@@ -249,20 +413,21 @@ active_pd(void)
     return ptov(pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
  * lookaside buffer (TLB) to become out-of-sync with the page
- * table.  When this happens, we have to "invalidate" the TLB by
- * re-activating it.
+ * table.  When this happens, we have to "invalidate" the stale
+ * entry.
  *
- * This function invalidates the TLB if PD is the active page
- * directory.  (If PD is not active then its entries are not in
- * the TLB, so there is no need to invalidate anything.) */
+ * This function drops the TLB entry for VADDR if PD is the active
+ * page directory.  (If PD is not active then its entries are not
+ * in the TLB, so there is no need to invalidate anything.)
+ * INVLPG leaves the rest of the TLB alone, unlike re-activating
+ * PD.  See [IA32-v3a] 3.12 "Translation Lookaside Buffers
+ * (TLBs)". */
 static void
-invalidate_pagedir(uint32_t *pd)
+invalidate_page(uint32_t *pd, const void *vaddr)
 {
     if (active_pd() == pd) {
-        /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         * "Translation Lookaside Buffers (TLBs)". */
-        pagedir_activate(pd);
+        asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
     }
 }
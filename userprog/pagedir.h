@@ -2,10 +2,13 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 uint32_t *pagedir_create(void);
 void pagedir_destroy(uint32_t *pd);
+size_t pagedir_page_cnt(uint32_t *pd);
+void pagedir_print_stats(void);
 bool pagedir_set_page(uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page(uint32_t *pd, const void *upage);
 void pagedir_clear_page(uint32_t *pd, void *upage);
@@ -13,6 +16,9 @@ bool pagedir_is_dirty(uint32_t *pd, const void *upage);
 void pagedir_set_dirty(uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed(uint32_t *pd, const void *upage);
 void pagedir_set_accessed(uint32_t *pd, const void *upage, bool accessed);
+void pagedir_invalidate_range(uint32_t *pd, const void *vaddr,
+                              size_t page_cnt);
 void pagedir_activate(uint32_t *pd);
+bool pagedir_is_active(uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
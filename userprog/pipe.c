@@ -0,0 +1,242 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <syscall-nr.h>
+
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/uaccess.h"
+
+/* Pipes.
+ *
+ * A pipe is a ring buffer of kernel pages with a read end and a
+ * write end, each of which may be open in any number of
+ * descriptors.  Data moves straight between the ring and the
+ * user's buffer, so each byte is copied once on the way in and
+ * once on the way out, with no bounce buffer; a page-aligned
+ * write of whole pages fills whole ring pages with one copy
+ * each.
+ *
+ * A reader sleeps on a condition variable while the ring is
+ * empty and a writer sleeps while it is full.  A read returns as
+ * soon as some data has arrived, or 0 once the ring is empty and
+ * every write end is closed.  A write returns once all of its
+ * data is in the ring, or early if every read end is closed.
+ * Threads in poll() wait on POLLERS instead, which is woken
+ * whenever either condition is signaled. */
+
+struct pipe {
+    struct lock lock;           /* Guards the members below. */
+    struct condition readable;  /* Signaled when data arrives. */
+    struct condition writable;  /* Signaled when space frees up. */
+    struct waitq pollers;       /* Woken along with either condition. */
+    uint8_t *pages[PIPE_PAGES]; /* Ring of pages. */
+    unsigned head;              /* Bytes read so far, ever. */
+    unsigned tail;              /* Bytes written so far, ever. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+};
+
+static void destroy(struct pipe *);
+
+/* Creates and returns a new, empty pipe with one read end and
+ * one write end open, or returns a null pointer if memory could
+ * not be allocated. */
+struct pipe *
+pipe_create(void)
+{
+    struct pipe *p = calloc(1, sizeof *p);
+    int i;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < PIPE_PAGES; i++) {
+        p->pages[i] = palloc_get_page(0);
+        if (p->pages[i] == NULL) {
+            destroy(p);
+            return NULL;
+        }
+    }
+    lock_init(&p->lock);
+    cond_init(&p->readable);
+    cond_init(&p->writable);
+    waitq_init(&p->pollers);
+    p->readers = p->writers = 1;
+    return p;
+}
+
+/* Opens another write end of P if WRITER is true, otherwise
+ * another read end. */
+void
+pipe_reopen(struct pipe *p, bool writer)
+{
+    lock_acquire(&p->lock);
+    if (writer) {
+        p->writers++;
+    } else {
+        p->readers++;
+    }
+    lock_release(&p->lock);
+}
+
+/* Closes a write end of P if WRITER is true, otherwise a read
+ * end.  Frees P once both ends are closed everywhere. */
+void
+pipe_close(struct pipe *p, bool writer)
+{
+    bool last;
+
+    lock_acquire(&p->lock);
+    if (writer) {
+        ASSERT(p->writers > 0);
+        if (--p->writers == 0) {
+            cond_broadcast(&p->readable, &p->lock);
+            waitq_wake(&p->pollers);
+        }
+    } else {
+        ASSERT(p->readers > 0);
+        if (--p->readers == 0) {
+            cond_broadcast(&p->writable, &p->lock);
+            waitq_wake(&p->pollers);
+        }
+    }
+    last = p->readers == 0 && p->writers == 0;
+    lock_release(&p->lock);
+
+    if (last) {
+        destroy(p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into user buffer UBUF, waiting
+ * until there is at least one byte or no writer is left.
+ * Returns the number of bytes read, 0 at end of file, or -1 if
+ * UBUF is not mapped. */
+int
+pipe_read(struct pipe *p, uint8_t *ubuf, unsigned size)
+{
+    unsigned done = 0;
+
+    lock_acquire(&p->lock);
+    while (p->head == p->tail && p->writers > 0 && size > 0) {
+        cond_wait(&p->readable, &p->lock);
+    }
+    while (done < size && p->head != p->tail) {
+        unsigned ofs = p->head % PGSIZE;
+        unsigned chunk = PGSIZE - ofs;
+
+        if (chunk > p->tail - p->head) {
+            chunk = p->tail - p->head;
+        }
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        if (!copy_to_user(ubuf + done,
+                          p->pages[p->head / PGSIZE % PIPE_PAGES] + ofs,
+                          chunk)) {
+            lock_release(&p->lock);
+            return -1;
+        }
+        p->head += chunk;
+        done += chunk;
+    }
+    if (done > 0) {
+        cond_broadcast(&p->writable, &p->lock);
+        waitq_wake(&p->pollers);
+    }
+    lock_release(&p->lock);
+    return done;
+}
+
+/* Writes SIZE bytes from user buffer UBUF to P, waiting for
+ * space as needed.  Returns the number of bytes written, which
+ * is less than SIZE only if every reader has gone, or -1 if UBUF
+ * is not mapped. */
+int
+pipe_write(struct pipe *p, const uint8_t *ubuf, unsigned size)
+{
+    unsigned done = 0;
+
+    lock_acquire(&p->lock);
+    while (done < size && p->readers > 0) {
+        unsigned ofs = p->tail % PGSIZE;
+        unsigned chunk = PGSIZE - ofs;
+
+        if (p->tail - p->head == PIPE_SIZE) {
+            cond_wait(&p->writable, &p->lock);
+            continue;
+        }
+        if (chunk > PIPE_SIZE - (p->tail - p->head)) {
+            chunk = PIPE_SIZE - (p->tail - p->head);
+        }
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        if (!copy_from_user(p->pages[p->tail / PGSIZE % PIPE_PAGES] + ofs,
+                            ubuf + done, chunk)) {
+            lock_release(&p->lock);
+            return -1;
+        }
+        p->tail += chunk;
+        done += chunk;
+        cond_broadcast(&p->readable, &p->lock);
+        waitq_wake(&p->pollers);
+    }
+    lock_release(&p->lock);
+    return done;
+}
+
+/* Returns the poll events ready on a write end of P if WRITER is
+ * true, otherwise on a read end: POLLIN if a read would not wait,
+ * and POLLHUP too if that is because no writer is left; POLLOUT if
+ * a write would not wait, or POLLERR if no reader is left.  If E
+ * is non-null, it is also put on P's pollers, until
+ * pipe_unpoll(). */
+unsigned
+pipe_poll(struct pipe *p, bool writer, struct waitq_entry *e)
+{
+    unsigned events = 0;
+
+    lock_acquire(&p->lock);
+    if (writer) {
+        if (p->readers == 0) {
+            events |= POLLERR;
+        } else if (p->tail - p->head < PIPE_SIZE) {
+            events |= POLLOUT;
+        }
+    } else {
+        if (p->writers == 0) {
+            events |= POLLIN | POLLHUP;
+        } else if (p->head != p->tail) {
+            events |= POLLIN;
+        }
+    }
+    if (e != NULL) {
+        waitq_add(&p->pollers, e);
+    }
+    lock_release(&p->lock);
+    return events;
+}
+
+/* Takes E, added by pipe_poll(), off P's pollers. */
+void
+pipe_unpoll(struct pipe *p, struct waitq_entry *e)
+{
+    lock_acquire(&p->lock);
+    waitq_remove(e);
+    lock_release(&p->lock);
+}
+
+/* Frees P and its pages. */
+static void
+destroy(struct pipe *p)
+{
+    int i;
+
+    for (i = 0; i < PIPE_PAGES; i++) {
+        palloc_free_page(p->pages[i]);
+    }
+    free(p);
+}
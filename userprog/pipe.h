@@ -0,0 +1,24 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "threads/vaddr.h"
+
+/* Pages in a pipe's ring. */
+#define PIPE_PAGES 4
+#define PIPE_SIZE (PIPE_PAGES * PGSIZE)
+
+struct pipe;
+struct waitq_entry;
+
+struct pipe *pipe_create(void);
+void pipe_reopen(struct pipe *, bool writer);
+void pipe_close(struct pipe *, bool writer);
+int pipe_read(struct pipe *, uint8_t *ubuf, unsigned size);
+int pipe_write(struct pipe *, const uint8_t *ubuf, unsigned size);
+unsigned pipe_poll(struct pipe *, bool writer, struct waitq_entry *);
+void pipe_unpoll(struct pipe *, struct waitq_entry *);
+
+#endif /* userprog/pipe.h */
@@ -0,0 +1,149 @@
+#include "userprog/poll.h"
+#include <debug.h>
+#include <syscall-nr.h>
+
+#include "devices/input.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/fdtable.h"
+#include "userprog/pipe.h"
+
+/* Waiting on several descriptors at once.
+ *
+ * Each pass looks at every descriptor, and for those that can
+ * become ready later, console input and pipes, puts an entry on
+ * the object's wait queue.  If nothing is ready, the thread
+ * sleeps once on a semaphore that all of its entries name, until
+ * one of the objects changes or the timeout passes, then takes
+ * its entries off and looks again.  Files, directories, and
+ * console output never make a caller wait, so they are always
+ * ready. */
+
+/* What poll_wait() knows about one descriptor during a pass. */
+struct poller {
+    struct fd fd;               /* Copy of the descriptor. */
+    bool queued;                /* ENTRY on the object's wait queue? */
+    struct waitq_entry entry;   /* Place in the object's wait queue. */
+};
+
+static unsigned poll_one(struct fd_table *, const struct pollfd *,
+                         struct poller *);
+static void unpoll_one(struct poller *);
+
+/* Waits until at least one of the CNT descriptors in FDS is ready
+ * for one of the events it asks for, or TIMEOUT_MS milliseconds
+ * pass.  A negative timeout waits forever, and 0 does not wait.
+ * Sets each descriptor's REVENTS to the events seen, plus
+ * POLLERR, POLLHUP or POLLNVAL whether asked for or not.
+ * Returns the number of descriptors with events, 0 on timeout,
+ * or -1 if memory runs out. */
+int
+poll_wait(struct pollfd *fds, size_t cnt, int timeout_ms)
+{
+    struct fd_table *table = &thread_current()->leader->fds;
+    int64_t deadline = 0;
+    struct poller *pollers;
+    struct semaphore wake;
+    bool timed_out = false;
+    int ready;
+    size_t i;
+
+    ASSERT(cnt <= POLL_MAX);
+
+    pollers = calloc(cnt > 0 ? cnt : 1, sizeof *pollers);
+    if (pollers == NULL) {
+        return -1;
+    }
+    if (timeout_ms > 0) {
+        deadline = timer_ticks()
+                   + ((int64_t) timeout_ms * TIMER_FREQ + 999) / 1000;
+    }
+
+    for (;;) {
+        sema_init(&wake, 0);
+        ready = 0;
+        for (i = 0; i < cnt; i++) {
+            waitq_entry_init(&pollers[i].entry, &wake);
+            fds[i].revents = poll_one(table, &fds[i], &pollers[i]);
+            if (fds[i].revents != 0) {
+                ready++;
+            }
+        }
+
+        if (ready == 0 && timeout_ms < 0) {
+            sema_down(&wake);
+        } else if (ready == 0 && timeout_ms > 0) {
+            int64_t left = deadline - timer_ticks();
+
+            timed_out = left <= 0 || !sema_down_timeout(&wake, left);
+        }
+
+        for (i = 0; i < cnt; i++) {
+            unpoll_one(&pollers[i]);
+        }
+        if (ready > 0 || timeout_ms == 0 || timed_out) {
+            break;
+        }
+    }
+    free(pollers);
+    return ready;
+}
+
+/* Looks up the descriptor in PFD and returns the events of
+ * interest ready on it.  If it can become ready later, also
+ * queues P's entry where it will be woken, keeping the object
+ * open meanwhile, for unpoll_one() to undo. */
+static unsigned
+poll_one(struct fd_table *table, const struct pollfd *pfd,
+         struct poller *p)
+{
+    unsigned events;
+
+    p->queued = false;
+    if (pfd->fd < 0) {
+        return 0;
+    }
+    if (!fd_lookup(table, pfd->fd, &p->fd)) {
+        return POLLNVAL;
+    }
+
+    switch (p->fd.type) {
+    case FD_STDIN:
+        events = input_poll(&p->entry) ? POLLIN : 0;
+        p->queued = true;
+        break;
+    case FD_PIPE_R:
+    case FD_PIPE_W:
+        /* Another thread may close the descriptor while we
+         * sleep, so hold an end of our own. */
+        pipe_reopen(p->fd.pipe, p->fd.type == FD_PIPE_W);
+        events = pipe_poll(p->fd.pipe, p->fd.type == FD_PIPE_W, &p->entry);
+        p->queued = true;
+        break;
+    case FD_STDOUT:
+        events = POLLOUT;
+        break;
+    default:
+        events = POLLIN | POLLOUT;
+        break;
+    }
+    fd_put(table, pfd->fd);
+    return events & (pfd->events | POLLERR | POLLHUP);
+}
+
+/* Undoes what poll_one() did to P. */
+static void
+unpoll_one(struct poller *p)
+{
+    if (!p->queued) {
+        return;
+    }
+    if (p->fd.type == FD_STDIN) {
+        input_unpoll(&p->entry);
+    } else {
+        pipe_unpoll(p->fd.pipe, &p->entry);
+        pipe_close(p->fd.pipe, p->fd.type == FD_PIPE_W);
+    }
+}
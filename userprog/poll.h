@@ -0,0 +1,19 @@
+#ifndef USERPROG_POLL_H
+#define USERPROG_POLL_H
+
+#include <stddef.h>
+
+/* Most descriptors one poll() may watch. */
+#define POLL_MAX 64
+
+/* A descriptor to watch, the events of interest, and the events
+ * seen.  Must match the definition in lib/user/syscall.h. */
+struct pollfd {
+    int fd;          /* Descriptor, or negative to skip. */
+    short events;    /* POLLIN and POLLOUT wanted. */
+    short revents;   /* Events seen, set by the kernel. */
+};
+
+int poll_wait(struct pollfd *, size_t cnt, int timeout_ms);
+
+#endif /* userprog/poll.h */
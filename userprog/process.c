@@ -8,65 +8,152 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/aio.h"
+#include "userprog/elfcache.h"
+#include "userprog/fdtable.h"
+#include "userprog/fpu.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "userprog/tss.h"
+#include "userprog/vdso.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/fault.h"
+#include "vm/brk.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
 
-#define LOGGING_LEVEL 6
+#define LOGGING_LEVEL LOG_LEVEL_USERPROG
 
 #include <log.h>
 
+/* Address space switches done and avoided by process_activate(). */
+static long long cr3_loads;         /* CR3 reloaded, flushing the TLB. */
+static long long cr3_loads_avoided; /* Active page directory kept. */
+
+/* Exit status of a child process, shared by the child and its
+ * parent.  Each side holds one reference and drops it when it
+ * exits, so the record outlives whichever dies first, and the
+ * child's thread can be destroyed as soon as it exits even if
+ * nobody has waited for it yet.
+ *
+ * The same record serves for joining a thread of a process other
+ * than its leader, shared by the thread and the leader's
+ * uthreads list. */
+struct child {
+    tid_t tid;               /* Child's thread id. */
+    int exit_status;         /* Valid once EXITED has been upped. */
+    struct semaphore exited; /* Upped when the child exits. */
+    int ref_cnt;             /* References held, 0 to 2. */
+    struct list_elem elem;   /* Element in the parent's children list. */
+};
+
+/* Hand-off between process_execute() and the process it starts. */
+struct exec_info {
+    const char *cmd_line;    /* Command line, owned by the parent. */
+    struct child *child;     /* Child's status record. */
+    struct semaphore loaded; /* Upped when loading is done. */
+    bool success;            /* Did the executable load? */
+};
+
+/* Hand-off between process_thread_create() and the thread it
+ * starts. */
+struct uthread_info {
+    struct thread *leader;    /* Leader of the process. */
+    struct child *record;     /* New thread's join record. */
+    void (*eip)(void);        /* User code to start at. */
+    void *esp;                /* User stack pointer to start with. */
+    struct semaphore started; /* Upped once the above are read. */
+};
+
+static struct child *child_create(void);
+static void child_release(struct child *);
+static void uthread_exit(void);
+
 static thread_func start_process NO_RETURN;
+static thread_func start_uthread NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+#endif
 static bool load(const char *cmdline, void(**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
- * FILENAME.  The new thread may be scheduled (and may even exit)
- * before process_execute() returns.  Returns the new process's
- * thread id, or TID_ERROR if the thread cannot be created. */
+ * CMD_LINE and waits for it to load.  The first word of CMD_LINE
+ * names the program and the rest are its arguments.  Returns the
+ * new process's thread id, or TID_ERROR if the thread cannot be
+ * created or the program cannot be loaded. */
 tid_t
-process_execute(const char *file_name)
+process_execute(const char *cmd_line)
 {
-    char *fn_copy;
+    struct thread *leader = thread_current()->leader;
+    char name[sizeof leader->name];
+    struct exec_info info;
+    enum intr_level old_level;
+    size_t len;
     tid_t tid;
 
     // NOTE:
-    // To see this print, make sure LOGGING_LEVEL in this file is <= L_TRACE (6)
-    // AND LOGGING_ENABLE = 1 in lib/log.h
-    // Also, probably won't pass with logging enabled.
-    log(L_TRACE, "Started process execute: %s", file_name);
-
-    /* Make a copy of FILE_NAME.
-     * Otherwise there's a race between the caller and load(). */
-    fn_copy = palloc_get_page(0);
-    if (fn_copy == NULL) {
+    // To see this print, add -DLOG_LEVEL_USERPROG=L_TRACE to DEFINES.
+    // Messages are queued and printed by the logger thread, so the
+    // output of tests that compare console logs will still differ.
+    log(L_TRACE, "Started process execute: %s", cmd_line);
+
+    /* The process is named after its program.  CMD_LINE itself
+     * is copied only once, straight onto the new process's stack:
+     * we wait for the load to finish, so it stays valid until
+     * then. */
+    cmd_line += strspn(cmd_line, " ");
+    len = strcspn(cmd_line, " ");
+    strlcpy(name, cmd_line, len + 1 < sizeof name ? len + 1 : sizeof name);
+    info.cmd_line = cmd_line;
+    info.child = child_create();
+    if (info.child == NULL) {
         return TID_ERROR;
     }
-    strlcpy(fn_copy, file_name, PGSIZE);
+    sema_init(&info.loaded, 0);
+    info.success = false;
 
-    /* Create a new thread to execute FILE_NAME. */
-    tid = thread_create(file_name, PRI_DEFAULT, start_process, fn_copy);
+    /* Create a new thread to execute CMD_LINE. */
+    tid = thread_create(name, PRI_DEFAULT, start_process, &info);
     if (tid == TID_ERROR) {
-        palloc_free_page(fn_copy);
+        free(info.child);
+        return TID_ERROR;
+    }
+    sema_down(&info.loaded);
+    if (!info.success) {
+        child_release(info.child);
+        return TID_ERROR;
     }
+    info.child->tid = tid;
+    old_level = intr_disable();
+    list_push_back(&leader->children, &info.child->elem);
+    intr_set_level(old_level);
     return tid;
 }
 
 /* A thread function that loads a user process and starts it
  * running. */
 static void
-start_process(void *file_name_)
+start_process(void *info_)
 {
-    char *file_name = file_name_;
+    struct exec_info *info = info_;
     struct intr_frame if_;
     bool success;
 
+    thread_current()->child = info->child;
     log(L_TRACE, "start_process()");
 
     /* Initialize interrupt frame and load executable. */
@@ -74,10 +161,12 @@ start_process(void *file_name_)
     if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
-    success = load(file_name, &if_.eip, &if_.esp);
+    success = load(info->cmd_line, &if_.eip, &if_.esp);
 
-    /* If load failed, quit. */
-    palloc_free_page(file_name);
+    /* Report the outcome.  INFO lives on the parent's stack, so
+     * it must not be touched after this.  If load failed, quit. */
+    info->success = success;
+    sema_up(&info->loaded);
     if (!success) {
         thread_exit();
     }
@@ -92,6 +181,124 @@ start_process(void *file_name_)
     NOT_REACHED();
 }
 
+#ifdef VM
+/* Hand-off between process_fork() and the child it creates. */
+struct fork_info {
+    struct thread *parent;   /* Process being copied. */
+    struct thread *caller;   /* Thread that called fork(). */
+    struct intr_frame if_;   /* Parent's user context at the system call. */
+    struct child *child;     /* Child's status record. */
+    struct semaphore done;   /* Upped when the copy is complete. */
+    bool success;            /* Did the copy succeed? */
+};
+
+/* Starts a new process that is a copy of the current one,
+ * resuming in user mode from interrupt frame F with a return
+ * value of 0.  The address space is copied on write: the child
+ * starts out sharing every resident page of the parent, and only
+ * a page that one of them writes is ever duplicated.  Returns
+ * the child's thread id, or TID_ERROR if the copy fails. */
+tid_t
+process_fork(const struct intr_frame *f)
+{
+    struct fork_info info;
+    enum intr_level old_level;
+    tid_t tid;
+
+    /* Only the calling thread is copied, into a process of its
+     * own. */
+    info.parent = thread_current()->leader;
+    info.caller = thread_current();
+    info.if_ = *f;
+    info.child = child_create();
+    if (info.child == NULL) {
+        return TID_ERROR;
+    }
+    sema_init(&info.done, 0);
+    info.success = false;
+
+    /* The parent waits in sema_down() until the child has copied
+     * its page table, so that the table holds still meanwhile. */
+    tid = thread_create(info.parent->name, thread_get_priority(),
+                        start_fork, &info);
+    if (tid == TID_ERROR) {
+        free(info.child);
+        return TID_ERROR;
+    }
+    sema_down(&info.done);
+    if (!info.success) {
+        child_release(info.child);
+        return TID_ERROR;
+    }
+    info.child->tid = tid;
+    old_level = intr_disable();
+    list_push_back(&info.parent->children, &info.child->elem);
+    intr_set_level(old_level);
+    return tid;
+}
+
+/* A thread function that copies the address space of the process
+ * that called process_fork() and starts running it. */
+static void
+start_fork(void *info_)
+{
+    struct fork_info *info = info_;
+    struct thread *parent = info->parent;
+    struct thread *t = thread_current();
+    struct intr_frame if_ = info->if_;
+    bool success = false;
+
+    t->child = info->child;
+    t->pagedir = pagedir_create();
+    if (t->pagedir == NULL) {
+        goto done;
+    }
+    if (!page_table_init(&t->pages)) {
+        pagedir_destroy(t->pagedir);
+        t->pagedir = NULL;
+        goto done;
+    }
+    list_init(&t->mmaps);
+    process_activate();
+    if (!vdso_map(t->pagedir)) {
+        goto done;
+    }
+
+    if (!fpu_clone(info->caller)) {
+        goto done;
+    }
+
+    t->exec_file = file_reopen(parent->exec_file);
+    if (t->exec_file == NULL) {
+        goto done;
+    }
+    file_deny_write(t->exec_file);
+    t->fault_stats.rss_limit = parent->fault_stats.rss_limit;
+    t->cwd = dir_reopen(parent->cwd);
+    if (t->cwd == NULL) {
+        goto done;
+    }
+    lock_acquire(&parent->vm_lock);
+    brk_clone(parent);
+    success = (fd_table_clone(&t->fds, &parent->fds)
+               && mmap_clone(parent) && page_table_clone(parent));
+    lock_release(&parent->vm_lock);
+
+done:
+    /* INFO lives on the parent's stack, so it must not be touched
+     * after this. */
+    info->success = success;
+    sema_up(&info->done);
+    if (!success) {
+        thread_exit();
+    }
+
+    if_.eax = 0;
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
  * it was terminated by the kernel (i.e. killed due to an
  * exception), returns -1.  If TID is invalid or if it was not a
@@ -99,12 +306,214 @@ start_process(void *file_name_)
  * been successfully called for the given TID, returns -1
  * immediately, without waiting.
  *
- * This function will be implemented in problem 2-2.  For now, it
- * does nothing. */
+ * Children are kept in creation order, so a parent that waits
+ * for them in that order finds each one at the front of its
+ * list. */
+int
+process_wait(tid_t child_tid)
+{
+    struct thread *leader = thread_current()->leader;
+    struct child *c = NULL;
+    enum intr_level old_level;
+    struct list_elem *e;
+    int status;
+
+    /* Any thread of the process may wait, so the list is
+     * searched with interrupts off. */
+    old_level = intr_disable();
+    for (e = list_begin(&leader->children); e != list_end(&leader->children);
+         e = list_next(e)) {
+        if (list_entry(e, struct child, elem)->tid == child_tid) {
+            c = list_entry(e, struct child, elem);
+            list_remove(&c->elem);
+            break;
+        }
+    }
+    intr_set_level(old_level);
+    if (c == NULL) {
+        return -1;
+    }
+
+    sema_down(&c->exited);
+    status = c->exit_status;
+    child_release(c);
+    return status;
+}
+
+/* Starts a new thread in the current process, sharing its
+ * address space and open files, that begins running user code
+ * at EIP with stack pointer ESP.  Returns the new thread's id, or
+ * TID_ERROR if it cannot be created or the process is exiting. */
+tid_t
+process_thread_create(void (*eip)(void), void *esp)
+{
+    struct thread *leader = thread_current()->leader;
+    struct uthread_info info;
+    enum intr_level old_level;
+    struct child *c;
+    tid_t tid;
+
+    c = child_create();
+    if (c == NULL) {
+        return TID_ERROR;
+    }
+
+    /* List the record before the thread exists, so that if the
+     * process exits, it waits for the thread to leave. */
+    old_level = intr_disable();
+    if (leader->exiting) {
+        intr_set_level(old_level);
+        free(c);
+        return TID_ERROR;
+    }
+    list_push_back(&leader->uthreads, &c->elem);
+    intr_set_level(old_level);
+
+    info.leader = leader;
+    info.record = c;
+    info.eip = eip;
+    info.esp = esp;
+    sema_init(&info.started, 0);
+    tid = thread_create(leader->name, thread_get_priority(), start_uthread,
+                        &info);
+    if (tid == TID_ERROR) {
+        /* The record stays listed, for process_exit() to free,
+         * but nothing can join it. */
+        sema_up(&c->exited);
+        child_release(c);
+        return TID_ERROR;
+    }
+    c->tid = tid;
+    sema_down(&info.started);
+    return tid;
+}
+
+/* A thread function that starts a thread created by
+ * process_thread_create() running in user mode. */
+static void
+start_uthread(void *info_)
+{
+    struct uthread_info *info = info_;
+    struct thread *t = thread_current();
+    struct intr_frame if_;
+
+    t->leader = info->leader;
+    t->child = info->record;
+    t->pagedir = t->leader->pagedir;
+    process_activate();
+
+    memset(&if_, 0, sizeof if_);
+    if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+    if_.cs = SEL_UCSEG;
+    if_.eflags = FLAG_IF | FLAG_MBS;
+    if_.eip = info->eip;
+    if_.esp = info->esp;
+
+    /* INFO lives on the creator's stack, so it must not be
+     * touched after this. */
+    sema_up(&info->started);
+    process_return_to_user();
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED();
+}
+
+/* Waits for thread TID of the current process, other than the
+ * leader and the caller, to exit.  Returns 0, or -1 if there is
+ * no such thread or it has already been joined. */
 int
-process_wait(tid_t child_tid UNUSED)
+process_thread_join(tid_t tid)
+{
+    struct thread *cur = thread_current();
+    struct thread *leader = cur->leader;
+    struct child *c = NULL;
+    enum intr_level old_level;
+    struct list_elem *e;
+
+    if (tid == TID_ERROR || tid == cur->tid) {
+        return -1;
+    }
+    old_level = intr_disable();
+    for (e = list_begin(&leader->uthreads); e != list_end(&leader->uthreads);
+         e = list_next(e)) {
+        if (list_entry(e, struct child, elem)->tid == tid) {
+            c = list_entry(e, struct child, elem);
+            list_remove(&c->elem);
+            break;
+        }
+    }
+    intr_set_level(old_level);
+    if (c == NULL) {
+        return -1;
+    }
+
+    sema_down(&c->exited);
+    child_release(c);
+    return 0;
+}
+
+/* Ends the current process with exit status STATUS, unless it is
+ * already exiting with another.  The calling thread exits now,
+ * and the process's other threads on their way back to user
+ * mode; process_exit() in the leader waits for all of them. */
+void
+process_terminate(int status)
+{
+    struct thread *leader = thread_current()->leader;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    if (!leader->exiting) {
+        leader->exiting = true;
+        leader->exit_status = status;
+    }
+    intr_set_level(old_level);
+
+    /* Threads asleep in futex waits would otherwise never get
+     * back to user mode. */
+    futex_wake_all(leader);
+    thread_exit();
+}
+
+/* Called just before an interrupt returns to user mode.  If the
+ * current thread's process is exiting, exits the thread
+ * instead. */
+void
+process_return_to_user(void)
+{
+    if (thread_current()->leader->exiting) {
+        intr_enable();
+        thread_exit();
+    }
+}
+
+/* Returns a new child status record holding references for both
+ * the parent and the child, or a null pointer if memory is
+ * exhausted. */
+static struct child *
+child_create(void)
+{
+    struct child *c = malloc(sizeof *c);
+
+    if (c != NULL) {
+        c->tid = TID_ERROR;
+        c->exit_status = -1;
+        sema_init(&c->exited, 0);
+        c->ref_cnt = 2;
+    }
+    return c;
+}
+
+/* Drops one reference to C, freeing it when none remain. */
+static void
+child_release(struct child *c)
 {
-    return -1;
+    enum intr_level old_level = intr_disable();
+    bool last = --c->ref_cnt == 0;
+
+    intr_set_level(old_level);
+    if (last) {
+        free(c);
+    }
 }
 
 /* Free the current process's resources. */
@@ -112,12 +521,72 @@ void
 process_exit(void)
 {
     struct thread *cur = thread_current();
+    enum intr_level old_level;
     uint32_t *pd;
 
+    if (cur->leader != cur) {
+        uthread_exit();
+        return;
+    }
+
+    /* Make the process's other threads exit, and wait until they
+     * have, since they use everything freed below. */
+    old_level = intr_disable();
+    cur->exiting = true;
+    intr_set_level(old_level);
+    futex_wake_all(cur);
+    for (;;) {
+        struct child *c;
+
+        old_level = intr_disable();
+        if (list_empty(&cur->uthreads)) {
+            intr_set_level(old_level);
+            break;
+        }
+        c = list_entry(list_pop_front(&cur->uthreads), struct child, elem);
+        intr_set_level(old_level);
+        sema_down(&c->exited);
+        child_release(c);
+    }
+
+    aio_destroy(cur);
+    fd_table_destroy(&cur->fds);
+    dir_close(cur->cwd);
+    cur->cwd = NULL;
+
+    /* Report our exit status to the parent, and let go of the
+     * records of children nobody waited for. */
+    if (cur->child != NULL) {
+        cur->child->exit_status = cur->exit_status;
+        sema_up(&cur->child->exited);
+        child_release(cur->child);
+        cur->child = NULL;
+    }
+    while (!list_empty(&cur->children)) {
+        struct list_elem *e = list_pop_front(&cur->children);
+
+        child_release(list_entry(e, struct child, elem));
+    }
+
     /* Destroy the current process's page directory and switch back
      * to the kernel-only page directory. */
     pd = cur->pagedir;
     if (pd != NULL) {
+        printf("%s: exit(%d)\n", cur->name, cur->exit_status);
+
+#ifdef VM
+        fault_print_process();
+
+        /* Give back resident frames first, while the page
+         * directory still maps them, so that eviction never sees
+         * a frame whose mapping is gone. */
+        mmap_unmap_all();
+        shm_exit();
+        page_table_destroy(&cur->pages);
+#endif
+        file_close(cur->exec_file);
+        cur->exec_file = NULL;
+
         /* Correct ordering here is crucial.  We must set
          * cur->pagedir to NULL before switching page directories,
          * so that a timer interrupt can't switch back to the
@@ -127,10 +596,27 @@ process_exit(void)
          * that's been freed (and cleared). */
         cur->pagedir = NULL;
         pagedir_activate(NULL);
+        vdso_unmap(pd);
         pagedir_destroy(pd);
     }
 }
 
+/* Exits the current thread, which belongs to a process but is
+ * not its leader, leaving the process's state to the leader. */
+static void
+uthread_exit(void)
+{
+    struct thread *cur = thread_current();
+
+    /* Let go of the shared page directory before telling the
+     * leader, which may destroy it as soon as we do. */
+    cur->pagedir = NULL;
+    pagedir_activate(NULL);
+    sema_up(&cur->child->exited);
+    child_release(cur->child);
+    cur->child = NULL;
+}
+
 /* Sets up the CPU for running user code in the current
  * thread.
  * This function is called on every context switch. */
@@ -139,12 +625,39 @@ process_activate(void)
 {
     struct thread *t = thread_current();
 
-    /* Activate thread's page tables. */
-    pagedir_activate(t->pagedir);
+    /* A kernel thread touches only kernel mappings, which every
+     * page directory shares, so it can run on whatever page
+     * directory is already loaded.  It also never enters user
+     * mode, so it needs no TSS update.  Skipping CR3 here avoids
+     * a TLB flush on every switch to or from a kernel thread.
+     * This is safe because a process switches to init_page_dir
+     * before destroying its own page directory in
+     * process_exit(). */
+    if (t->pagedir == NULL) {
+        cr3_loads_avoided++;
+        return;
+    }
+
+    /* Activate thread's page tables, unless they already are. */
+    if (pagedir_is_active(t->pagedir)) {
+        cr3_loads_avoided++;
+    } else {
+        pagedir_activate(t->pagedir);
+        cr3_loads++;
+    }
 
     /* Set thread's kernel stack for use in processing
      * interrupts. */
     tss_update();
+    vdso_switch(t);
+}
+
+/* Prints address space switch statistics. */
+void
+process_print_stats(void)
+{
+    printf("Process: %lld page directory loads, %lld avoided\n",
+           cr3_loads, cr3_loads_avoided);
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -208,32 +721,53 @@ struct Elf32_Phdr {
 #define PF_W 2 /* Writable. */
 #define PF_R 4 /* Readable. */
 
-static bool setup_stack(void **esp);
+static bool setup_stack(const char *cmd_line, void **esp);
+static bool push_args(const char *cmd_line, void **esp);
 
+static bool parse_elf(struct file *, struct elf_image *);
 static bool validate_segment(const struct Elf32_Phdr *, struct file *);
 static bool load_segment(struct file *file, off_t ofs, uint8_t *upage, uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads the ELF executable named by the first word of CMD_LINE
+ * into the current thread, passing the remaining words as
+ * arguments.  The program name is also the thread's name.
  * Stores the executable's entry point into *EIP
  * and its initial stack pointer into *ESP.
  * Returns true if successful, false otherwise. */
 bool
-load(const char *file_name, void(**eip) (void), void **esp)
+load(const char *cmd_line, void(**eip) (void), void **esp)
 {
     log(L_TRACE, "load()");
     struct thread *t = thread_current();
-    struct Elf32_Ehdr ehdr;
+    const char *file_name = t->name;
+    struct elf_image image;
     struct file *file = NULL;
-    off_t file_ofs;
+    struct inode *inode;
+    uintptr_t heap_start = 0;
     bool success = false;
-    int i;
+    size_t i;
 
     /* Allocate and activate page directory. */
     t->pagedir = pagedir_create();
     if (t->pagedir == NULL) {
         goto done;
     }
+#ifdef VM
+    if (!page_table_init(&t->pages)) {
+        pagedir_destroy(t->pagedir);
+        t->pagedir = NULL;
+        goto done;
+    }
+    list_init(&t->mmaps);
+#endif
     process_activate();
+    if (!vdso_map(t->pagedir) || !fd_table_init(&t->fds)) {
+        goto done;
+    }
+    t->cwd = dir_open_root();
+    if (t->cwd == NULL) {
+        goto done;
+    }
 
     /* Open executable file. */
     file = filesys_open(file_name);
@@ -242,6 +776,77 @@ load(const char *file_name, void(**eip) (void), void **esp)
         goto done;
     }
 
+    /* Parse the headers, unless they are cached.  The write count
+     * is sampled first, so that a write racing with the parse
+     * leaves the cache entry stale. */
+    inode = file_get_inode(file);
+    if (!elfcache_lookup(inode, &image)) {
+        unsigned write_cnt = inode_write_cnt(inode);
+
+        if (!parse_elf(file, &image)) {
+            printf("load: %s: error loading executable\n", file_name);
+            goto done;
+        }
+        elfcache_insert(inode, write_cnt, &image);
+    }
+
+    for (i = 0; i < image.seg_cnt; i++) {
+        const struct elf_segment *seg = &image.segs[i];
+        uintptr_t seg_end = seg->mem_page + seg->read_bytes + seg->zero_bytes;
+
+        if (!load_segment(file, seg->file_page, (void *)seg->mem_page,
+                          seg->read_bytes, seg->zero_bytes, seg->writable)) {
+            goto done;
+        }
+        if (seg_end > heap_start) {
+            heap_start = seg_end;
+        }
+    }
+#ifdef VM
+    /* The heap starts out empty just past the last segment. */
+    brk_init((void *)heap_start);
+#endif
+
+    /* Set up stack. */
+    if (!setup_stack(cmd_line, esp)) {
+        goto done;
+    }
+
+    /* Start address. */
+    *eip = (void (*)(void))image.entry;
+
+    success = true;
+
+done:
+    /* We arrive here whether the load is successful or not.  A
+     * loaded executable stays open, and unmodified, until the
+     * process exits, since under VM its segments are read on
+     * demand. */
+    if (success) {
+        file_deny_write(file);
+        t->exec_file = file;
+        return success;
+    }
+    file_close(file);
+    return success;
+}
+
+/* load() helpers. */
+
+#ifndef VM
+static bool install_page(void *upage, void *kpage, bool writable);
+#endif
+
+/* Reads and checks the ELF header and program headers of FILE
+ * and describes its loadable segments in *IMAGE.  Returns true if
+ * FILE is an executable we can load, false otherwise. */
+static bool
+parse_elf(struct file *file, struct elf_image *image)
+{
+    struct Elf32_Ehdr ehdr;
+    off_t file_ofs;
+    int i;
+
     /* Read and verify executable header. */
     if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr
         || memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7)
@@ -250,9 +855,10 @@ load(const char *file_name, void(**eip) (void), void **esp)
         || ehdr.e_version != 1
         || ehdr.e_phentsize != sizeof(struct Elf32_Phdr)
         || ehdr.e_phnum > 1024) {
-        printf("load: %s: error loading executable\n", file_name);
-        goto done;
+        return false;
     }
+    image->entry = ehdr.e_entry;
+    image->seg_cnt = 0;
 
     /* Read program headers. */
     file_ofs = ehdr.e_phoff;
@@ -260,12 +866,12 @@ load(const char *file_name, void(**eip) (void), void **esp)
         struct Elf32_Phdr phdr;
 
         if (file_ofs < 0 || file_ofs > file_length(file)) {
-            goto done;
+            return false;
         }
         file_seek(file, file_ofs);
 
         if (file_read(file, &phdr, sizeof phdr) != sizeof phdr) {
-            goto done;
+            return false;
         }
         file_ofs += sizeof phdr;
         switch (phdr.p_type) {
@@ -279,57 +885,37 @@ load(const char *file_name, void(**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-            goto done;
+            return false;
         case PT_LOAD:
-            if (validate_segment(&phdr, file)) {
-                bool writable = (phdr.p_flags & PF_W) != 0;
-                uint32_t file_page = phdr.p_offset & ~PGMASK;
-                uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+            if (validate_segment(&phdr, file)
+                && image->seg_cnt < ELF_MAX_SEGMENTS) {
+                struct elf_segment *seg = &image->segs[image->seg_cnt++];
                 uint32_t page_offset = phdr.p_vaddr & PGMASK;
-                uint32_t read_bytes, zero_bytes;
+
+                seg->writable = (phdr.p_flags & PF_W) != 0;
+                seg->file_page = phdr.p_offset & ~PGMASK;
+                seg->mem_page = phdr.p_vaddr & ~PGMASK;
                 if (phdr.p_filesz > 0) {
                     /* Normal segment.
                      * Read initial part from disk and zero the rest. */
-                    read_bytes = page_offset + phdr.p_filesz;
-                    zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE)
-                                  - read_bytes);
+                    seg->read_bytes = page_offset + phdr.p_filesz;
+                    seg->zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE)
+                                       - seg->read_bytes);
                 } else {
                     /* Entirely zero.
                      * Don't read anything from disk. */
-                    read_bytes = 0;
-                    zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
-                }
-                if (!load_segment(file, file_page, (void *)mem_page,
-                                  read_bytes, zero_bytes, writable)) {
-                    goto done;
+                    seg->read_bytes = 0;
+                    seg->zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
                 }
             } else {
-                goto done;
+                return false;
             }
             break;
         }
     }
-
-    /* Set up stack. */
-    if (!setup_stack(esp)) {
-        goto done;
-    }
-
-    /* Start address. */
-    *eip = (void (*)(void))ehdr.e_entry;
-
-    success = true;
-
-done:
-    /* We arrive here whether the load is successful or not. */
-    file_close(file);
-    return success;
+    return true;
 }
 
-/* load() helpers. */
-
-static bool install_page(void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
  * FILE and returns true if so, false otherwise. */
 static bool
@@ -379,6 +965,12 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
         return false;
     }
 
+    /* The kernel data page has its own place. */
+    if (phdr->p_vaddr < (uintptr_t) VDSO_ADDR + PGSIZE
+        && phdr->p_vaddr + phdr->p_memsz > (uintptr_t) VDSO_ADDR) {
+        return false;
+    }
+
     /* It's okay. */
     return true;
 }
@@ -395,6 +987,12 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * With VM, the pages are only recorded in the supplemental page
+ * table here; each is read in by the page fault handler the
+ * first time it is touched.  Read-only pages with file data are
+ * shared: every process running the same executable maps the
+ * same frame for them.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool
@@ -415,6 +1013,19 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
         size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+        struct page *p;
+
+        if (!writable && page_read_bytes > 0) {
+            p = page_add_shared(upage, file, ofs, page_read_bytes, false);
+        } else {
+            p = page_add_file(upage, file, ofs, page_read_bytes, writable);
+        }
+        if (p == NULL) {
+            return false;
+        }
+        ofs += page_read_bytes;
+#else
         /* Get a page of memory. */
         uint8_t *kpage = palloc_get_page(PAL_USER);
         if (kpage == NULL) {
@@ -433,6 +1044,7 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
             palloc_free_page(kpage);
             return false;
         }
+#endif
 
         /* Advance. */
         read_bytes -= page_read_bytes;
@@ -445,26 +1057,83 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 /* Create a minimal stack by mapping a zeroed page at the top of
  * user virtual memory. */
 static bool
-setup_stack(void **esp)
+setup_stack(const char *cmd_line, void **esp)
 {
-    uint8_t *kpage;
     bool success = false;
 
     log(L_TRACE, "setup_stack()");
 
-    kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+    /* The first push faults the page in, from the frame table
+     * like any other user page. */
+    success = page_add_zero(((uint8_t *)PHYS_BASE) - PGSIZE, true) != NULL;
+#else
+    uint8_t *kpage = palloc_get_page(PAL_USER | PAL_ZERO);
     if (kpage != NULL) {
         success = install_page(((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
-        if (success) {
-            *esp = PHYS_BASE;
-        } else {
+        if (!success) {
             palloc_free_page(kpage);
         }
+    }
+#endif
+    if (success) {
+        success = push_args(cmd_line, esp);
         // hex_dump( *(int*)esp, *esp, 128, true ); // NOTE: uncomment this to check arg passing
     }
     return success;
 }
 
+/* Builds the initial stack frame for main(argc, argv) at the top
+ * of the freshly mapped user stack page and points *ESP at it.
+ * The whole frame's size is known before anything is written, so
+ * CMD_LINE is copied just once, straight onto the user stack, and
+ * split into arguments in place there; argv points into that
+ * copy.  Returns false if the frame does not fit in the page. */
+static bool
+push_args(const char *cmd_line, void **esp)
+{
+    size_t len = strlen(cmd_line) + 1;
+    char *str, *token, *save_ptr;
+    char **argv;
+    uint32_t *sp;
+    int argc = 0;
+    int i;
+
+    /* Count the words the same way strtok_r() will split them. */
+    for (i = 0; cmd_line[i] != '\0'; i++) {
+        if (cmd_line[i] != ' ' && (i == 0 || cmd_line[i - 1] == ' ')) {
+            argc++;
+        }
+    }
+
+    /* Strings, word-aligned; argv[0..argc]; argv and argc; and a
+     * fake return address. */
+    if (ROUND_UP(len, sizeof(uint32_t))
+        + (argc + 1) * sizeof(char *) + 3 * sizeof(uint32_t) > PGSIZE) {
+        return false;
+    }
+
+    str = (char *)PHYS_BASE - len;
+    if (!copy_to_user(str, cmd_line, len)) {
+        return false;
+    }
+    argv = (char **)ROUND_DOWN((uintptr_t)str, sizeof(uint32_t)) - (argc + 1);
+    i = 0;
+    for (token = strtok_r(str, " ", &save_ptr); token != NULL;
+         token = strtok_r(NULL, " ", &save_ptr)) {
+        argv[i++] = token;
+    }
+    argv[argc] = NULL;
+
+    sp = (uint32_t *)argv;
+    *--sp = (uint32_t)argv;
+    *--sp = argc;
+    *--sp = 0;
+    *esp = sp;
+    return true;
+}
+
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
  * virtual address KPAGE to the page table.
  * If WRITABLE is true, the user process may modify the page;
@@ -484,3 +1153,4 @@ install_page(void *upage, void *kpage, bool writable)
     return pagedir_get_page(t->pagedir, upage) == NULL
            && pagedir_set_page(t->pagedir, upage, kpage, writable);
 }
+#endif
@@ -3,9 +3,18 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute(const char *file_name);
+tid_t process_execute(const char *cmd_line);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork(const struct intr_frame *);
+#endif
 int process_wait(tid_t);
+tid_t process_thread_create(void (*eip)(void), void *esp);
+int process_thread_join(tid_t);
+void process_terminate(int status) NO_RETURN;
+void process_return_to_user(void);
 void process_exit(void);
 void process_activate(void);
+void process_print_stats(void);
 
 #endif /* userprog/process.h */
@@ -1,23 +1,1362 @@
+#include <console.h>
+#include <iovec.h>
+#include <kstat.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 
+#include "devices/block.h"
+#include "devices/input.h"
+#include "devices/kbd.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "lib/kernel/stdio.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/aio.h"
+#include "userprog/exception.h"
+#include "userprog/fdtable.h"
+#include "userprog/futex.h"
+#include "userprog/pipe.h"
+#include "userprog/poll.h"
+#include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "userprog/tss.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/brk.h"
+#include "vm/fault.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
+
+/* Most arguments any system call takes. */
+#define SYSCALL_MAX_ARGS 4
+
+/* MSRs that set up SYSENTER and SYSEXIT.  See [IA32-v3a] 5.8.7
+ * "Performing Fast Calls to System Procedures with the SYSENTER
+ * and SYSEXIT Instructions". */
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/* A system call made by batch().  Must match the definition in
+ * lib/user/syscall.h. */
+struct batch_call {
+    int number;        /* SYS_* number. */
+    unsigned links;    /* Bit I set: ARGS[I] is a record index. */
+    uint32_t args[4];  /* Arguments. */
+    int result;        /* Return value, filled in by the kernel. */
+};
+
+/* Most records passed to batch(), and its flags. */
+#define BATCH_MAX 16
+#define BATCH_STOP 1 /* Stop after the first result of -1. */
+
+/* A system call handler.  ARGS holds the call's arguments,
+ * already copied out of the user stack; F is the caller's
+ * interrupt frame.  The return value goes to the user in %eax. */
+typedef uint32_t syscall_func(const uint32_t *args, struct intr_frame *f);
+
+/* An entry in the system call table. */
+struct syscall {
+    syscall_func *func; /* Handler, or NULL if unimplemented. */
+    int arg_cnt;        /* Number of 32-bit arguments. */
+};
 
 static void syscall_handler(struct intr_frame *);
+static void write_msr(uint32_t msr, uint32_t value);
+static void copy_in(void *dst, const void *usrc, size_t size);
+static char *copy_in_string(const char *us);
+static struct file *lookup_file(int fd);
+static void put_fd(int fd);
+static bool is_readable(const struct fd *);
+static bool is_writable(const struct fd *);
+static void kill_process(void) NO_RETURN;
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_readv, sys_writev, sys_pread, sys_pwrite;
+static syscall_func sys_blockstats, sys_uptime, sys_iostat, sys_kstat;
+static syscall_func sys_thread_create, sys_thread_join, sys_thread_exit;
+static syscall_func sys_futex, sys_pipe, sys_copy_file, sys_clone_file;
+static syscall_func sys_aio_setup, sys_aio_enter, sys_batch;
+static syscall_func sys_poll, sys_getdents, sys_seek64, sys_tell64;
+static syscall_func sys_fsync, sys_fdatasync, sys_compress;
+#ifdef VM
+static syscall_func sys_mmap, sys_munmap, sys_fork, sys_vmstat, sys_sbrk;
+static syscall_func sys_shm_create, sys_shm_attach, sys_shm_detach;
+static syscall_func sys_madvise, sys_rss_limit;
+#endif
+
+/* System call table, indexed by SYS_* number. */
+static const struct syscall syscall_table[] = {
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_CREATE] = {sys_create, 2},
+    [SYS_REMOVE] = {sys_remove, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+#ifdef VM
+    [SYS_MMAP] = {sys_mmap, 3},
+    [SYS_MUNMAP] = {sys_munmap, 1},
+    [SYS_FORK] = {sys_fork, 0},
+    [SYS_VMSTAT] = {sys_vmstat, 1},
+    [SYS_SBRK] = {sys_sbrk, 1},
+    [SYS_SHM_CREATE] = {sys_shm_create, 1},
+    [SYS_SHM_ATTACH] = {sys_shm_attach, 2},
+    [SYS_SHM_DETACH] = {sys_shm_detach, 1},
+    [SYS_MADVISE] = {sys_madvise, 3},
+    [SYS_RSS_LIMIT] = {sys_rss_limit, 1},
+#endif
+    [SYS_READV] = {sys_readv, 3},
+    [SYS_WRITEV] = {sys_writev, 3},
+    [SYS_PREAD] = {sys_pread, 4},
+    [SYS_PWRITE] = {sys_pwrite, 4},
+    [SYS_BLOCKSTATS] = {sys_blockstats, 0},
+    [SYS_UPTIME] = {sys_uptime, 1},
+    [SYS_IOSTAT] = {sys_iostat, 1},
+    [SYS_THREAD_CREATE] = {sys_thread_create, 2},
+    [SYS_THREAD_JOIN] = {sys_thread_join, 1},
+    [SYS_THREAD_EXIT] = {sys_thread_exit, 0},
+    [SYS_FUTEX] = {sys_futex, 3},
+    [SYS_PIPE] = {sys_pipe, 1},
+    [SYS_COPY_FILE] = {sys_copy_file, 3},
+    [SYS_AIO_SETUP] = {sys_aio_setup, 1},
+    [SYS_AIO_ENTER] = {sys_aio_enter, 1},
+    [SYS_BATCH] = {sys_batch, 3},
+    [SYS_POLL] = {sys_poll, 3},
+    [SYS_GETDENTS] = {sys_getdents, 3},
+    [SYS_SEEK64] = {sys_seek64, 3},
+    [SYS_TELL64] = {sys_tell64, 2},
+    [SYS_FSYNC] = {sys_fsync, 1},
+    [SYS_FDATASYNC] = {sys_fdatasync, 1},
+    [SYS_COMPRESS] = {sys_compress, 1},
+    [SYS_KSTAT] = {sys_kstat, 2},
+    [SYS_CLONE_FILE] = {sys_clone_file, 2},
+};
+
+/* Entry point from sysenter_entry in sysenter.S. */
+void syscall_sysenter(struct intr_frame *);
+void sysenter_entry(void);
 
 void
 syscall_init(void)
 {
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+
+    /* User programs use SYSENTER instead when the CPU has it,
+     * by the same test.  sysenter_entry finds the running
+     * thread's stack through the TSS. */
+    if (cpuid_features() & CPUID_SEP) {
+        write_msr(MSR_SYSENTER_CS, SEL_KCSEG);
+        write_msr(MSR_SYSENTER_ESP, (uint32_t) tss_sysenter_esp());
+        write_msr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
+}
+
+/* Handles a system call made with SYSENTER, whose frame
+ * sysenter_entry has laid out as for "int $0x30".  Does what
+ * intr_handler() would, for an internal interrupt from user
+ * mode. */
+void
+syscall_sysenter(struct intr_frame *f)
+{
+    syscall_handler(f);
+    process_return_to_user();
 }
 
+/* Writes VALUE to model-specific register MSR. */
 static void
-syscall_handler(struct intr_frame *f UNUSED)
+write_msr(uint32_t msr, uint32_t value)
+{
+    asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* Dispatches the system call whose number and arguments are on
+ * the user stack at F->esp.  The number picks a table entry,
+ * whose argument count says how many words to fetch; they are
+ * fetched with a single validated copy rather than one check per
+ * argument. */
+static void
+syscall_handler(struct intr_frame *f)
+{
+    uint32_t args[SYSCALL_MAX_ARGS];
+    const struct syscall *sc;
+    uint32_t nr;
+
+#ifdef VM
+    /* Page faults on user memory taken from here on need the
+     * user's stack pointer to recognize stack growth. */
+    thread_current()->user_esp = f->esp;
+#endif
+
+    copy_in(&nr, f->esp, sizeof nr);
+    if (nr >= sizeof syscall_table / sizeof *syscall_table) {
+        kill_process();
+    }
+    sc = &syscall_table[nr];
+    if (sc->func == NULL) {
+        kill_process();
+    }
+
+    copy_in(args, (const uint32_t *)f->esp + 1, sizeof *args * sc->arg_cnt);
+    f->eax = sc->func(args, f);
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+ * DST.  Kills the process if any part of the source is not valid
+ * user memory. */
+static void
+copy_in(void *dst, const void *usrc, size_t size)
+{
+    if (!copy_from_user(dst, usrc, size)) {
+        kill_process();
+    }
+}
+
+/* Copies the null-terminated string at user address US into a
+ * new page and returns it.  The caller must free the page with
+ * palloc_free_page().  Kills the process if the string is not
+ * valid user memory or does not fit in a page. */
+static char *
+copy_in_string(const char *us)
+{
+    char *ks;
+    size_t i;
+
+    ks = palloc_get_page(0);
+    if (ks == NULL) {
+        kill_process();
+    }
+    for (i = 0; i < PGSIZE; i++) {
+        if (!get_user((uint8_t *)ks + i, (const uint8_t *)us + i)) {
+            break;
+        }
+        if (ks[i] == '\0') {
+            return ks;
+        }
+    }
+    palloc_free_page(ks);
+    kill_process();
+}
+
+/* Returns the open file that descriptor FD refers to, which
+ * stays open until put_fd(FD).  Kills the process if FD is not
+ * open on a file. */
+static struct file *
+lookup_file(int fd)
+{
+    struct fd d;
+
+    if (!fd_lookup(&thread_current()->leader->fds, fd, &d)) {
+        kill_process();
+    }
+    if (d.type != FD_FILE) {
+        put_fd(fd);
+        kill_process();
+    }
+    return d.file;
+}
+
+/* Ends a lookup of descriptor FD in the current process. */
+static void
+put_fd(int fd)
+{
+    fd_put(&thread_current()->leader->fds, fd);
+}
+
+/* Returns true if FD can be read with read() or readv(). */
+static bool
+is_readable(const struct fd *fd)
+{
+    return fd->type == FD_STDIN || fd->type == FD_FILE
+           || fd->type == FD_PIPE_R;
+}
+
+/* Returns true if FD can be written with write() or writev(). */
+static bool
+is_writable(const struct fd *fd)
+{
+    return fd->type == FD_STDOUT || fd->type == FD_FILE
+           || fd->type == FD_PIPE_W;
+}
+
+/* Terminates the current process with exit status -1. */
+static void
+kill_process(void)
+{
+    process_terminate(-1);
+}
+
+/* halt(): powers off the machine. */
+static uint32_t
+sys_halt(const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+    shutdown_power_off();
+}
+
+/* exit(status): terminates the process. */
+static uint32_t
+sys_exit(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    process_terminate((int)args[0]);
+}
+
+/* exec(cmd_line): runs a new process and returns its id. */
+static uint32_t
+sys_exec(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    char *cmd_line = copy_in_string((const char *)args[0]);
+    tid_t tid;
+
+    tid = process_execute(cmd_line);
+    palloc_free_page(cmd_line);
+    return tid;
+}
+
+/* wait(pid): waits for a child process and returns its status. */
+static uint32_t
+sys_wait(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    return process_wait((tid_t)args[0]);
+}
+
+/* create(file, initial_size): creates a file. */
+static uint32_t
+sys_create(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    char *name = copy_in_string((const char *)args[0]);
+    bool ok;
+
+    ok = filesys_create(name, args[1]);
+    palloc_free_page(name);
+    return ok;
+}
+
+/* remove(file): deletes a file. */
+static uint32_t
+sys_remove(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    char *name = copy_in_string((const char *)args[0]);
+    bool ok;
+
+    ok = filesys_remove(name);
+    palloc_free_page(name);
+    return ok;
+}
+
+/* open(file): opens a file and returns a new descriptor for
+ * it, or -1 on failure. */
+static uint32_t
+sys_open(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    char *name = copy_in_string((const char *)args[0]);
+    struct fd fd = {FD_FILE, NULL, NULL, NULL, 0, false};
+    int handle = -1;
+
+    fd.dir = filesys_open_dir(name);
+    if (fd.dir != NULL) {
+        fd.type = FD_DIR;
+    } else {
+        fd.file = filesys_open(name);
+    }
+    palloc_free_page(name);
+    if (fd.file != NULL || fd.dir != NULL) {
+        handle = fd_install(&thread_current()->leader->fds, &fd);
+        if (handle < 0) {
+            file_close(fd.file);
+            dir_close(fd.dir);
+        }
+    }
+    return handle;
+}
+
+/* filesize(fd): returns the size of an open file. */
+static uint32_t
+sys_filesize(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    off_t length = file_length(lookup_file(args[0]));
+
+    put_fd(args[0]);
+    return length;
+}
+
+/* Pins the SIZE bytes of user memory at UBUF, to be written if
+ * WRITE is true, for a copy made with a lock held: a pipe copies
+ * with its lock held, and a page fault in the copy would make
+ * everyone else using the pipe wait for the fault's I/O.
+ * Returns true if the memory is pinned and must be unpinned with
+ * unpin_user(), false if the copy must take its chances. */
+static bool
+pin_user(const void *ubuf, size_t size, bool write)
+{
+#ifdef VM
+    return page_pin(ubuf, size, write);
+#else
+    return false;
+#endif
+}
+
+/* Unpins memory that pin_user() pinned. */
+static void
+unpin_user(const void *ubuf UNUSED, size_t size UNUSED)
+{
+#ifdef VM
+    page_unpin(ubuf, size);
+#endif
+}
+
+/* Reads up to SIZE bytes from FD into user buffer UBUF, which
+ * the caller has checked lies in user space, and returns the
+ * number of bytes read.  A file is read at *OFS, which is
+ * advanced, or at its own position if OFS is null.  File data
+ * goes through page BOUNCE a chunk at a time, so that a bad user
+ * pointer is caught by the copy rather than inside the file
+ * system.  A pipe copies straight into UBUF instead, which is
+ * pinned for it.  Kills the process if UBUF is not mapped. */
+static unsigned
+read_fd(struct fd *fd, uint8_t *ubuf, unsigned size, off_t *ofs,
+        char *bounce)
+{
+    unsigned done;
+
+    if (fd->type == FD_PIPE_R) {
+        /* A read never returns more than the ring holds. */
+        unsigned chunk = size < PIPE_SIZE ? size : PIPE_SIZE;
+        bool pinned = pin_user(ubuf, chunk, true);
+        int cnt = pipe_read(fd->pipe, ubuf, chunk);
+
+        if (pinned) {
+            unpin_user(ubuf, chunk);
+        }
+        if (cnt < 0) {
+            palloc_free_page(bounce);
+            kill_process();
+        }
+        return cnt;
+    }
+    if (fd->type == FD_STDIN) {
+        for (done = 0; done < size; done++) {
+            if (!put_user(ubuf + done, input_getc())) {
+                palloc_free_page(bounce);
+                kill_process();
+            }
+        }
+        return size;
+    }
+
+    for (done = 0; done < size; ) {
+        size_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+        off_t cnt;
+
+        if (ofs != NULL) {
+            cnt = file_read_at(fd->file, bounce, chunk, *ofs);
+            *ofs += cnt;
+        } else {
+            cnt = file_read(fd->file, bounce, chunk);
+        }
+        if (!copy_to_user(ubuf + done, bounce, cnt)) {
+            palloc_free_page(bounce);
+            kill_process();
+        }
+        done += cnt;
+        if ((size_t)cnt < chunk) {
+            break;
+        }
+    }
+    return done;
+}
+
+/* Writes SIZE bytes from user buffer UBUF to FD, the same way
+ * read_fd() reads, and returns the number of bytes written. */
+static unsigned
+write_fd(struct fd *fd, const uint8_t *ubuf, unsigned size, off_t *ofs,
+         char *bounce)
+{
+    unsigned done;
+
+    if (fd->type == FD_PIPE_W) {
+        /* A ringful at a time, to bound how much is pinned. */
+        for (done = 0; done < size; ) {
+            unsigned chunk = size - done < PIPE_SIZE ? size - done : PIPE_SIZE;
+            bool pinned = pin_user(ubuf + done, chunk, false);
+            int cnt = pipe_write(fd->pipe, ubuf + done, chunk);
+
+            if (pinned) {
+                unpin_user(ubuf + done, chunk);
+            }
+            if (cnt < 0) {
+                palloc_free_page(bounce);
+                kill_process();
+            }
+            done += cnt;
+            if ((unsigned) cnt < chunk) {
+                break;
+            }
+        }
+        return done;
+    }
+    for (done = 0; done < size; ) {
+        size_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+        off_t cnt;
+
+        if (!copy_from_user(bounce, ubuf + done, chunk)) {
+            palloc_free_page(bounce);
+            kill_process();
+        }
+        if (fd->type == FD_STDOUT) {
+            putbuf(bounce, chunk);
+            cnt = chunk;
+        } else if (ofs != NULL) {
+            cnt = file_write_at(fd->file, bounce, chunk, *ofs);
+            *ofs += cnt;
+        } else {
+            cnt = file_write(fd->file, bounce, chunk);
+        }
+        done += cnt;
+        if ((size_t)cnt < chunk) {
+            break;
+        }
+    }
+    return done;
+}
+
+/* read(fd, buffer, size): reads from a file or the keyboard and
+ * returns the number of bytes read. */
+static uint32_t
+sys_read(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    uint8_t *buffer = (uint8_t *)args[1];
+    unsigned size = args[2];
+    unsigned done;
+    char *bounce;
+
+    if (!is_user_range(buffer, size)) {
+        kill_process();
+    }
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = !is_readable(&fd) ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    done = read_fd(&fd, buffer, size, NULL, bounce);
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* write(fd, buffer, size): writes to a file or the console and
+ * returns the number of bytes written. */
+static uint32_t
+sys_write(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    const uint8_t *buffer = (const uint8_t *)args[1];
+    unsigned size = args[2];
+    unsigned done;
+    char *bounce;
+
+    if (!is_user_range(buffer, size)) {
+        kill_process();
+    }
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = !is_writable(&fd) ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    done = write_fd(&fd, buffer, size, NULL, bounce);
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* Copies the IOVCNT-element iovec array at user address UIOV into
+ * IOV, in one copy, and checks that every buffer it describes
+ * lies in user space.  Returns the total length of the buffers,
+ * or -1 if IOVCNT is out of range or the total overflows.  Kills
+ * the process if a pointer is bad. */
+static int
+copy_in_iovec(struct iovec *iov, const struct iovec *uiov, int iovcnt)
+{
+    unsigned total = 0;
+    int i;
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        return -1;
+    }
+    copy_in(iov, uiov, sizeof *iov * iovcnt);
+    for (i = 0; i < iovcnt; i++) {
+        if (!is_user_range(iov[i].iov_base, iov[i].iov_len)) {
+            kill_process();
+        }
+        if (iov[i].iov_len > INT_MAX - total) {
+            return -1;
+        }
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+/* readv(fd, iov, iovcnt): reads from a file or the keyboard into
+ * each buffer in turn, stopping early at end of file, and returns
+ * the total number of bytes read. */
+static uint32_t
+sys_readv(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    struct iovec iov[IOV_MAX];
+    int iovcnt = args[2];
+    unsigned done = 0;
+    char *bounce;
+    int i;
+
+    if (copy_in_iovec(iov, (const struct iovec *)args[1], iovcnt) < 0) {
+        return -1;
+    }
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = !is_readable(&fd) ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        unsigned cnt = read_fd(&fd, iov[i].iov_base, iov[i].iov_len, NULL,
+                               bounce);
+
+        done += cnt;
+        if (cnt < iov[i].iov_len) {
+            break;
+        }
+    }
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* writev(fd, iov, iovcnt): writes each buffer in turn to a file or
+ * the console and returns the total number of bytes written. */
+static uint32_t
+sys_writev(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    struct iovec iov[IOV_MAX];
+    int iovcnt = args[2];
+    unsigned done = 0;
+    char *bounce;
+    int i;
+
+    if (copy_in_iovec(iov, (const struct iovec *)args[1], iovcnt) < 0) {
+        return -1;
+    }
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = !is_writable(&fd) ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        unsigned cnt = write_fd(&fd, iov[i].iov_base, iov[i].iov_len, NULL,
+                                bounce);
+
+        done += cnt;
+        if (cnt < iov[i].iov_len) {
+            break;
+        }
+    }
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* pread(fd, buffer, size, offset): reads from a file at OFFSET
+ * without moving its position and returns the number of bytes
+ * read. */
+static uint32_t
+sys_pread(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    uint8_t *buffer = (uint8_t *)args[1];
+    unsigned size = args[2];
+    off_t ofs = args[3];
+    unsigned done;
+    char *bounce;
+
+    if (!is_user_range(buffer, size)) {
+        kill_process();
+    }
+    if (ofs < 0
+        || !fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = fd.type != FD_FILE ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    done = read_fd(&fd, buffer, size, &ofs, bounce);
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* pwrite(fd, buffer, size, offset): writes to a file at OFFSET
+ * without moving its position and returns the number of bytes
+ * written. */
+static uint32_t
+sys_pwrite(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd fd;
+    const uint8_t *buffer = (const uint8_t *)args[1];
+    unsigned size = args[2];
+    off_t ofs = args[3];
+    unsigned done;
+    char *bounce;
+
+    if (!is_user_range(buffer, size)) {
+        kill_process();
+    }
+    if (ofs < 0
+        || !fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    bounce = fd.type != FD_FILE ? NULL : palloc_get_page(0);
+    if (bounce == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    done = write_fd(&fd, buffer, size, &ofs, bounce);
+    palloc_free_page(bounce);
+    put_fd(args[0]);
+    return done;
+}
+
+/* blockstats(): prints block device statistics to the console,
+ * as at shutdown. */
+static uint32_t
+sys_blockstats(const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
 {
-    /* Remove these when implementing syscalls */
-    printf("system call!\n");
+    block_print_stats();
+    return 0;
+}
+
+/* uptime(ns): stores the nanoseconds since boot in *NS. */
+static uint32_t
+sys_uptime(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    uint64_t ns = timer_ns();
+
+    if (!copy_to_user((void *) args[0], &ns, sizeof ns)) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* iostat(st): stores the transfers done so far by the file system
+ * device in *ST, which has the layout of struct block_counts.
+ * Reports all zeros if there is no file system device. */
+static uint32_t
+sys_iostat(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct block *fs_device = block_get_role(BLOCK_FILESYS);
+    struct block_counts counts;
+
+    memset(&counts, 0, sizeof counts);
+    if (fs_device != NULL) {
+        block_get_counts(fs_device, &counts);
+    }
+    if (!copy_to_user((void *) args[0], &counts, sizeof counts)) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* kstat(st, size): stores system-wide statistics, a struct kstat,
+ * in the SIZE bytes at ST, or in as much of them as the kernel's
+ * structure covers, and returns the size of the kernel's
+ * structure.  See <kstat.h> for how the layout evolves. */
+static uint32_t
+sys_kstat(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct block *fs_device = block_get_role(BLOCK_FILESYS);
+    struct block_counts counts;
+    struct kstat st;
+    size_t size = args[1] < sizeof st ? args[1] : sizeof st;
+
+    memset(&st, 0, sizeof st);
+    st.version = KSTAT_VERSION;
+    st.size = size;
+    st.uptime_ns = timer_ns();
+    st.ticks = timer_ticks();
+    thread_kstat(&st);
+    lock_kstat(&st);
+    console_kstat(&st);
+    kbd_kstat(&st);
+    exception_kstat(&st);
+    if (fs_device != NULL) {
+        block_get_counts(fs_device, &counts);
+        st.disk_read_sectors = counts.read_sectors;
+        st.disk_write_sectors = counts.write_sectors;
+        st.disk_read_reqs = counts.read_reqs;
+        st.disk_write_reqs = counts.write_reqs;
+    }
+    cache_kstat(&st);
+    st.free_user_pages = palloc_user_free();
+#ifdef VM
+    fault_kstat(&st);
+    frame_kstat(&st);
+    swap_kstat(&st);
+#endif
+
+    if (!copy_to_user((void *) args[0], &st, size)) {
+        kill_process();
+    }
+    return sizeof st;
+}
+
+/* seek(fd, position): sets the position of an open file. */
+static uint32_t
+sys_seek(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    file_seek(lookup_file(args[0]), args[1]);
+    put_fd(args[0]);
+    return 0;
+}
 
+/* tell(fd): returns the position of an open file. */
+static uint32_t
+sys_tell(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    off_t pos = file_tell(lookup_file(args[0]));
+
+    put_fd(args[0]);
+    return pos;
+}
+
+/* seek64(fd, lo, hi): sets the position of an open file to the
+ * 64-bit offset whose low and high words are LO and HI.  Kills
+ * the process if the offset is negative. */
+static uint32_t
+sys_seek64(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    off_t pos = (off_t) (((uint64_t) args[2] << 32) | args[1]);
+
+    if (pos < 0) {
+        kill_process();
+    }
+    file_seek(lookup_file(args[0]), pos);
+    put_fd(args[0]);
+    return 0;
+}
+
+/* tell64(fd, pos): stores the position of an open file in *POS,
+ * a 64-bit integer. */
+static uint32_t
+sys_tell64(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    uint64_t pos = file_tell(lookup_file(args[0]));
+
+    put_fd(args[0]);
+    if (!copy_to_user((void *) args[1], &pos, sizeof pos)) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* fsync(fd): writes the data, size and block map of an open file
+ * to disk. */
+static uint32_t
+sys_fsync(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    file_sync(lookup_file(args[0]), false);
+    put_fd(args[0]);
+    return 0;
+}
+
+/* fdatasync(fd): writes the data of an open file to disk, along
+ * with its size and block map only if they changed. */
+static uint32_t
+sys_fdatasync(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    file_sync(lookup_file(args[0]), true);
+    put_fd(args[0]);
+    return 0;
+}
+
+/* compress(fd): makes an open file, which must be empty, store
+ * its data compressed.  Returns true if successful. */
+static uint32_t
+sys_compress(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    bool success = file_set_compressed(lookup_file(args[0]));
+
+    put_fd(args[0]);
+    return success;
+}
+
+/* close(fd): closes a file descriptor. */
+static uint32_t
+sys_close(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    if (!fd_close(&thread_current()->leader->fds, args[0])) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* thread_create(eip, esp): starts a new thread in the process at
+ * EIP with stack pointer ESP and returns its id, or TID_ERROR. */
+static uint32_t
+sys_thread_create(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    void *eip = (void *)args[0];
+    void *esp = (void *)args[1];
+
+    if (!is_user_vaddr(eip) || !is_user_vaddr(esp)) {
+        return TID_ERROR;
+    }
+    return process_thread_create(eip, esp);
+}
+
+/* thread_join(tid): waits for thread TID of the process to end.
+ * Returns 0, or -1 if TID is not a thread that can be joined. */
+static uint32_t
+sys_thread_join(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    return process_thread_join(args[0]);
+}
+
+/* thread_exit(): ends the calling thread.  In the process's first
+ * thread, ends the process with status 0. */
+static uint32_t
+sys_thread_exit(const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+    struct thread *t = thread_current();
+
+    if (t == t->leader) {
+        process_terminate(0);
+    }
     thread_exit();
 }
+
+/* futex(op, uaddr, val): for FUTEX_WAIT, sleeps until woken if
+ * the int at UADDR still holds VAL, returning 0 if woken or -1
+ * if the value had changed; for FUTEX_WAKE, wakes up to VAL
+ * threads waiting on UADDR and returns how many it woke. */
+static uint32_t
+sys_futex(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    int *uaddr = (int *)args[1];
+    int val = args[2];
+
+    if (!is_user_range(uaddr, sizeof *uaddr)) {
+        kill_process();
+    }
+    if (args[0] == FUTEX_WAIT) {
+        enum futex_result result = futex_wait(uaddr, val);
+
+        if (result == FUTEX_FAULT) {
+            kill_process();
+        }
+        return result == FUTEX_WOKEN ? 0 : -1;
+    } else if (args[0] == FUTEX_WAKE) {
+        return futex_wake(uaddr, val);
+    }
+    kill_process();
+}
+
+/* pipe(fds): creates a pipe and stores descriptors for its read
+ * and write ends in FDS[0] and FDS[1].  Returns 0, or -1 if
+ * memory runs out. */
+static uint32_t
+sys_pipe(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd_table *fds = &thread_current()->leader->fds;
+    struct fd r = {FD_PIPE_R, NULL, NULL, NULL, 0, false};
+    struct fd w = {FD_PIPE_W, NULL, NULL, NULL, 0, false};
+    int handles[2];
+
+    if (!is_user_range((void *) args[0], sizeof handles)) {
+        kill_process();
+    }
+    r.pipe = w.pipe = pipe_create();
+    if (r.pipe == NULL) {
+        return -1;
+    }
+    handles[0] = fd_install(fds, &r);
+    if (handles[0] < 0) {
+        pipe_close(r.pipe, false);
+        pipe_close(w.pipe, true);
+        return -1;
+    }
+    handles[1] = fd_install(fds, &w);
+    if (handles[1] < 0) {
+        fd_close(fds, handles[0]);
+        pipe_close(w.pipe, true);
+        return -1;
+    }
+    if (!copy_to_user((void *) args[0], handles, sizeof handles)) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* copy_file(dst_fd, src_fd, size): copies up to SIZE bytes from
+ * file SRC_FD to file DST_FD, each at its current position, and
+ * returns the number of bytes copied, or -1 if either descriptor
+ * is not an open file. */
+static uint32_t
+sys_copy_file(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd_table *fds = &thread_current()->leader->fds;
+    struct fd dst, src;
+    off_t size = args[2] < INT_MAX ? args[2] : INT_MAX;
+
+    int copied = -1;
+
+    if (!fd_lookup(fds, args[0], &dst)) {
+        return -1;
+    }
+    if (fd_lookup(fds, args[1], &src)) {
+        if (dst.type == FD_FILE && src.type == FD_FILE) {
+            copied = file_copy(dst.file, src.file, size);
+        }
+        fd_put(fds, args[1]);
+    }
+    fd_put(fds, args[0]);
+    return copied;
+}
+
+/* clone_file(dst_fd, src_fd): makes the empty file open as
+ * DST_FD a copy of the one open as SRC_FD that shares its data
+ * sectors.  Returns true if successful, false if the files do
+ * not allow it, in which case the caller can use copy_file(). */
+static uint32_t
+sys_clone_file(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fd_table *fds = &thread_current()->leader->fds;
+    struct fd dst, src;
+
+    bool success = false;
+
+    if (!fd_lookup(fds, args[0], &dst)) {
+        return false;
+    }
+    if (fd_lookup(fds, args[1], &src)) {
+        if (dst.type == FD_FILE && src.type == FD_FILE) {
+            success = file_clone(dst.file, src.file);
+        }
+        fd_put(fds, args[1]);
+    }
+    fd_put(fds, args[0]);
+    return success;
+}
+
+/* aio_setup(ring): registers the asynchronous I/O rings whose
+ * header is at RING.  Returns 0 or -1. */
+static uint32_t
+sys_aio_setup(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    return aio_setup((struct aio_ring *) args[0]);
+}
+
+/* aio_enter(min_complete): takes new asynchronous I/O
+ * submissions and posts completions, after waiting for
+ * MIN_COMPLETE of them.  Returns the number of submissions
+ * taken, or -1. */
+static uint32_t
+sys_aio_enter(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    return aio_enter(args[0]);
+}
+
+/* batch(calls, cnt, flags): makes the CNT system calls described
+ * by CALLS in order, storing each one's return value in its
+ * record, and returns the number made.  An argument whose bit is
+ * set in a record's LINKS is the index of an earlier record,
+ * whose result is passed instead, so that e.g. the descriptor
+ * that open() returns can be read and closed in the same batch.
+ * A record with an unknown number, a bad link, or a number that
+ * cannot be batched, which is fork() and batch() itself, gets
+ * -1.  With BATCH_STOP, stops after the first record whose
+ * result is -1.  Returns -1 if CNT is out of range. */
+static uint32_t
+sys_batch(const uint32_t *args, struct intr_frame *f)
+{
+    struct batch_call *ucalls = (struct batch_call *) args[0];
+    int cnt = args[1];
+    unsigned flags = args[2];
+    struct batch_call calls[BATCH_MAX];
+    int i, j;
+
+    if (cnt < 0 || cnt > BATCH_MAX) {
+        return -1;
+    }
+    copy_in(calls, ucalls, sizeof *calls * cnt);
+
+    for (i = 0; i < cnt; ) {
+        struct batch_call *c = &calls[i++];
+        uint32_t nr = c->number;
+        const struct syscall *sc = NULL;
+        uint32_t call_args[SYSCALL_MAX_ARGS];
+
+        if (nr < sizeof syscall_table / sizeof *syscall_table
+            && nr != SYS_BATCH && nr != SYS_FORK) {
+            sc = &syscall_table[nr];
+        }
+        c->result = -1;
+        if (sc != NULL && sc->func != NULL) {
+            for (j = 0; j < sc->arg_cnt; j++) {
+                call_args[j] = c->args[j];
+                if (c->links & (1u << j)) {
+                    if (c->args[j] >= (unsigned) i - 1) {
+                        break;
+                    }
+                    call_args[j] = calls[c->args[j]].result;
+                }
+            }
+            if (j == sc->arg_cnt) {
+                c->result = sc->func(call_args, f);
+            }
+        }
+        if ((flags & BATCH_STOP) && c->result == -1) {
+            break;
+        }
+    }
+
+    /* Store only the results, since the calls may have written
+     * the rest of the records' memory. */
+    for (j = 0; j < i; j++) {
+        if (!copy_to_user(&ucalls[j].result, &calls[j].result,
+                          sizeof calls[j].result)) {
+            kill_process();
+        }
+    }
+    return i;
+}
+
+/* poll(fds, cnt, timeout): waits up to TIMEOUT milliseconds, or
+ * forever if TIMEOUT is negative, for one of the CNT descriptors
+ * in FDS to become ready, and returns the number that are, or -1
+ * if CNT is out of range. */
+static uint32_t
+sys_poll(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct pollfd *ufds = (struct pollfd *) args[0];
+    unsigned cnt = args[1];
+    struct pollfd fds[POLL_MAX];
+    int ready;
+
+    if (cnt > POLL_MAX) {
+        return -1;
+    }
+    copy_in(fds, ufds, sizeof *fds * cnt);
+    ready = poll_wait(fds, cnt, args[2]);
+    if (ready >= 0 && !copy_to_user(ufds, fds, sizeof *fds * cnt)) {
+        kill_process();
+    }
+    return ready;
+}
+
+/* getdents(fd, entries, cnt): reads up to CNT of the next
+ * entries of directory FD into the struct dirent array at
+ * ENTRIES, as many as fit in a page at most, and returns the
+ * number read, 0 at the end of the directory, or -1 if FD is not
+ * an open directory. */
+static uint32_t
+sys_getdents(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct dirent *entries;
+    size_t cnt = args[2];
+    struct fd fd;
+
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return -1;
+    }
+    if (cnt > PGSIZE / sizeof *entries) {
+        cnt = PGSIZE / sizeof *entries;
+    }
+    entries = fd.type != FD_DIR ? NULL : palloc_get_page(0);
+    if (entries == NULL) {
+        put_fd(args[0]);
+        return -1;
+    }
+    cnt = dir_getdents(fd.dir, entries, cnt);
+    put_fd(args[0]);
+    if (!copy_to_user((void *) args[1], entries, cnt * sizeof *entries)) {
+        palloc_free_page(entries);
+        kill_process();
+    }
+    palloc_free_page(entries);
+    return cnt;
+}
+
+#ifdef VM
+/* mmap(fd, addr, flags): maps an open file at ADDR and returns
+ * the mapping's id, or MAP_FAILED.  FLAGS may hold MAP_POPULATE. */
+static uint32_t
+sys_mmap(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    struct fd fd;
+    mapid_t id;
+
+    if (!fd_lookup(&thread_current()->leader->fds, args[0], &fd)) {
+        return MAP_FAILED;
+    }
+    id = MAP_FAILED;
+    if (fd.type == FD_FILE) {
+        lock_acquire(vm_lock);
+        id = mmap_map(fd.file, (void *)args[1], args[2]);
+        lock_release(vm_lock);
+    }
+    put_fd(args[0]);
+    return id;
+}
+
+/* munmap(mapping): removes a mapping made by mmap(). */
+static uint32_t
+sys_munmap(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+
+    lock_acquire(vm_lock);
+    mmap_unmap(args[0]);
+    lock_release(vm_lock);
+    return 0;
+}
+
+/* fork(): copies the process and returns the child's id, or 0 in
+ * the child. */
+static uint32_t
+sys_fork(const uint32_t *args UNUSED, struct intr_frame *f)
+{
+    return process_fork(f);
+}
+
+/* vmstat(st): stores the calling process's paging activity and
+ * memory use, a struct fault_stats, in *ST. */
+static uint32_t
+sys_vmstat(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    const struct fault_stats *s = &thread_current()->leader->fault_stats;
+
+    fault_update_usage();
+    if (!copy_to_user((void *) args[0], s, sizeof *s)) {
+        kill_process();
+    }
+    return 0;
+}
+
+/* sbrk(increment): moves the program break by INCREMENT bytes and
+ * returns the old break, or (void *) -1 on failure. */
+static uint32_t
+sys_sbrk(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    void *old_break;
+
+    lock_acquire(vm_lock);
+    old_break = brk_move((int32_t)args[0]);
+    lock_release(vm_lock);
+    return (uint32_t)old_break;
+}
+
+/* shm_create(size): creates a shared memory segment of SIZE bytes
+ * and returns its id, or -1. */
+static uint32_t
+sys_shm_create(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    return shm_create(args[0]);
+}
+
+/* shm_attach(id, addr): maps segment ID at ADDR.  Returns true
+ * if successful. */
+static uint32_t
+sys_shm_attach(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    bool success;
+
+    lock_acquire(vm_lock);
+    success = shm_attach(args[0], (void *)args[1]);
+    lock_release(vm_lock);
+    return success;
+}
+
+/* shm_detach(addr): unmaps the segment attached at ADDR.  Returns
+ * true if there was one. */
+static uint32_t
+sys_shm_detach(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    bool success;
+
+    lock_acquire(vm_lock);
+    success = shm_detach((void *)args[0]);
+    lock_release(vm_lock);
+    return success;
+}
+
+/* madvise(addr, length, advice): advises how the pages from ADDR
+ * through LENGTH bytes after it will be used.  Returns 0 if
+ * successful, -1 if ADDR is not page-aligned, ADVICE is unknown,
+ * or some page in the range is not mapped. */
+static uint32_t
+sys_madvise(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    bool success;
+
+    lock_acquire(vm_lock);
+    success = page_advise((void *)args[0], args[1], args[2]);
+    lock_release(vm_lock);
+    return success ? 0 : -1;
+}
+
+/* rss_limit(pages): limits the calling process to PAGES resident
+ * pages, or lifts the limit if PAGES is 0, and returns the old
+ * limit.  A process at its limit evicts its own pages to make
+ * room for new ones, before anyone else's. */
+static uint32_t
+sys_rss_limit(const uint32_t *args, struct intr_frame *f UNUSED)
+{
+    struct fault_stats *s = &thread_current()->leader->fault_stats;
+    unsigned old = s->rss_limit;
+
+    s->rss_limit = args[0];
+    return old;
+}
+#endif
@@ -75,17 +75,33 @@ struct tss {
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Copy of tss->esp0 at the top of the TSS's page, for SYSENTER. */
+static void **sysenter_esp0;
+
 /* Initializes the kernel TSS. */
 void
 tss_init(void)
 {
+    tss = tss_create(NULL);
+    sysenter_esp0 = (void **)((uint8_t *)tss + PGSIZE) - 1;
+    tss_update();
+}
+
+/* Returns a new TSS whose ring 0 stack pointer is ESP0.  The
+ * kernel TSS is one, and each application processor has another. */
+struct tss *
+tss_create(void *esp0)
+{
+    struct tss *t;
+
     /* Our TSS is never used in a call gate or task gate, so only a
      * few fields of it are ever referenced, and those are the only
      * ones we initialize. */
-    tss = palloc_get_page(PAL_ASSERT | PAL_ZERO);
-    tss->ss0 = SEL_KDSEG;
-    tss->bitmap = 0xdfff;
-    tss_update();
+    t = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    t->ss0 = SEL_KDSEG;
+    t->esp0 = esp0;
+    t->bitmap = 0xdfff;
+    return t;
 }
 
 /* Returns the kernel TSS. */
@@ -96,6 +112,18 @@ tss_get(void)
     return tss;
 }
 
+/* Returns the stack pointer for SYSENTER: the last word of the
+ * TSS's page, which holds a copy of esp0 for sysenter_entry to
+ * switch to.  The rest of the page, above the TSS itself, is the
+ * stack for a debug exception taken before the switch, which
+ * happens if a user program enters with the trap flag set. */
+void *
+tss_sysenter_esp(void)
+{
+    ASSERT(tss != NULL);
+    return sysenter_esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
  * of the thread stack. */
 void
@@ -103,4 +131,5 @@ tss_update(void)
 {
     ASSERT(tss != NULL);
     tss->esp0 = (uint8_t *)thread_current() + PGSIZE;
+    *sysenter_esp0 = tss->esp0;
 }
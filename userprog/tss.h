@@ -6,7 +6,9 @@
 struct tss;
 
 void tss_init(void);
+struct tss *tss_create(void *esp0);
 struct tss *tss_get(void);
+void *tss_sysenter_esp(void);
 void tss_update(void);
 
 #endif /* userprog/tss.h */
@@ -0,0 +1,65 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "threads/vaddr.h"
+
+/* Kernel access to user memory.
+ *
+ * These functions access user memory directly and rely on the
+ * page fault handler to recover if the memory is not mapped, so
+ * they do no page table walks.  Each returns true if the access
+ * succeeded, false if some part of the user range is invalid.  A
+ * failed copy may have transferred part of the data. */
+
+/* Routines in uaccess.S.  Use the wrappers below instead. */
+bool uaccess_copy(void *dst, const void *src, size_t size);
+bool uaccess_get_byte(uint8_t *dst, const uint8_t *src);
+bool uaccess_put_byte(uint8_t *dst, uint8_t byte);
+
+/* Bounds of the code that page_fault() recovers in. */
+extern const char uaccess_start[], uaccess_end[], uaccess_fixup[];
+
+/* Returns true if the SIZE bytes at UADDR lie entirely in user
+ * space. */
+static inline bool
+is_user_range(const void *uaddr, size_t size)
+{
+    return is_user_vaddr(uaddr)
+           && (size_t)((const uint8_t *)PHYS_BASE - (const uint8_t *)uaddr) >= size;
+}
+
+/* Reads the byte at user address USRC into *DST. */
+static inline bool
+get_user(uint8_t *dst, const uint8_t *usrc)
+{
+    return is_user_vaddr(usrc) && uaccess_get_byte(dst, usrc);
+}
+
+/* Writes BYTE to user address UDST. */
+static inline bool
+put_user(uint8_t *udst, uint8_t byte)
+{
+    return is_user_vaddr(udst) && uaccess_put_byte(udst, byte);
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+ * DST. */
+static inline bool
+copy_from_user(void *dst, const void *usrc, size_t size)
+{
+    return is_user_range(usrc, size) && uaccess_copy(dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+ * UDST. */
+static inline bool
+copy_to_user(void *udst, const void *src, size_t size)
+{
+    return is_user_range(udst, size) && uaccess_copy(udst, src, size);
+}
+
+#endif /* userprog/uaccess.h */
@@ -0,0 +1,83 @@
+#include "userprog/vdso.h"
+#include <debug.h>
+
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+
+/* Kernel data page.
+ *
+ * One page of kernel memory is mapped read-only at VDSO_ADDR in
+ * every process, so that a program can read the time, the TSC
+ * calibration to convert its own TSC readings, and the ids of the
+ * running thread and process without a system call.  The kernel
+ * keeps it current: the tick count on every timer tick and the
+ * ids on every switch to a user thread.  There is only one CPU,
+ * so whichever thread reads the ids is the one they describe.
+ *
+ * A user program can be interrupted partway through reading the
+ * 64-bit tick count, so the count is guarded by a sequence
+ * number in the page, following the same protocol as struct
+ * seqlock: odd while a write is under way, and bumped by every
+ * write.  A reader that sees it odd or changed tries again. */
+
+static volatile struct vdso_data *vdso;
+
+/* Sets up the kernel data page.  Must be called after
+ * timer_calibrate() and before any process starts. */
+void
+vdso_init(void)
+{
+    vdso = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    vdso->ticks = timer_ticks();
+    vdso->tick_freq = TIMER_FREQ;
+    vdso->boot_cycles = timer_boot_cycles();
+    vdso->cycles_per_sec = timer_cycles_per_sec();
+}
+
+/* Maps the kernel data page into page directory PD, read-only.
+ * Returns false if memory runs out. */
+bool
+vdso_map(uint32_t *pd)
+{
+    ASSERT(vdso != NULL);
+    return pagedir_set_page(pd, VDSO_ADDR, (void *) vdso, false);
+}
+
+/* Removes the kernel data page from page directory PD, if it is
+ * there, so that pagedir_destroy() does not free it. */
+void
+vdso_unmap(uint32_t *pd)
+{
+    pagedir_clear_page(pd, VDSO_ADDR);
+}
+
+/* Publishes the tick count TICKS.  Called with interrupts off by
+ * the timer whenever the count changes. */
+void
+vdso_set_ticks(int64_t ticks)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (vdso != NULL) {
+        vdso->seq++;
+        barrier();
+        vdso->ticks = ticks;
+        barrier();
+        vdso->seq++;
+    }
+}
+
+/* Publishes T, which belongs to a process, as the running
+ * thread. */
+void
+vdso_switch(const struct thread *t)
+{
+    if (vdso != NULL) {
+        vdso->tid = t->tid;
+        vdso->pid = t->leader->tid;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef USERPROG_VDSO_H
+#define USERPROG_VDSO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* User address of the kernel data page, below where executables
+ * are linked and outside the heap and stack. */
+#define VDSO_ADDR ((void *) 0x08000000)
+
+/* Contents of the kernel data page.  Must match the definition
+ * in lib/user/vdso.h. */
+struct vdso_data {
+    uint32_t seq;            /* Odd while TICKS is being updated. */
+    int64_t ticks;           /* Timer ticks since boot. */
+    uint32_t tick_freq;      /* Timer ticks per second. */
+    uint64_t boot_cycles;    /* Time-stamp counter at boot. */
+    uint64_t cycles_per_sec; /* Time-stamp counter rate. */
+    int tid;                 /* Running thread. */
+    int pid;                 /* Its process. */
+};
+
+void vdso_init(void);
+bool vdso_map(uint32_t *pd);
+void vdso_unmap(uint32_t *pd);
+void vdso_set_ticks(int64_t ticks);
+void vdso_switch(const struct thread *);
+
+#endif /* userprog/vdso.h */
@@ -0,0 +1,48 @@
+/* Included ahead of every kernel library source that lib-bench
+   compiles for the host.  Renames the functions of lib/string.c
+   and lib/stdlib.c, which would otherwise replace the host C
+   library's own, and declares what the host headers lack. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define memcpy pintos_memcpy
+#define memmove pintos_memmove
+#define memcmp pintos_memcmp
+#define memchr pintos_memchr
+#define memset pintos_memset
+#define strcmp pintos_strcmp
+#define strchr pintos_strchr
+#define strcspn pintos_strcspn
+#define strpbrk pintos_strpbrk
+#define strrchr pintos_strrchr
+#define strspn pintos_strspn
+#define strstr pintos_strstr
+#define strtok_r pintos_strtok_r
+#define strlen pintos_strlen
+#define strnlen pintos_strnlen
+#define strlcpy pintos_strlcpy
+#define strlcat pintos_strlcat
+#define atoi pintos_atoi
+#define qsort pintos_qsort
+#define bsearch pintos_bsearch
+
+/* lib/stdlib.h. */
+void sort (void *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux);
+void merge_sort (void *array, size_t cnt, size_t size, void *scratch,
+                 int (*compare) (const void *, const void *, void *aux),
+                 void *aux);
+void *binary_search (const void *key, const void *array, size_t cnt,
+                     size_t size,
+                     int (*compare) (const void *, const void *, void *aux),
+                     void *aux);
+
+/* lib/string.h. */
+size_t strlcpy (char *, const char *, size_t);
+size_t strlcat (char *, const char *, size_t);
+
+/* lib/stdio.h. */
+void hex_dump (uintptr_t ofs, const void *, size_t size, bool ascii);
@@ -0,0 +1 @@
+#include "../../lib/random.h"
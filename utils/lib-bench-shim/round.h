@@ -0,0 +1 @@
+#include "../../lib/round.h"
@@ -0,0 +1,2 @@
+/* The host's allocator stands in for the kernel's. */
+#include <stdlib.h>
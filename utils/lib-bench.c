@@ -0,0 +1,455 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib/debug.h"
+#include "lib/kernel/bitmap.h"
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
+
+/* Benchmarks the kernel's lists, hash tables and bitmaps, and
+   its string and sorting routines, built for the host instead of
+   run inside a simulator, so that changes to them can be timed
+   in seconds and examined with host profilers.
+
+   Each benchmark runs at several sizes and prints a line of the
+   form
+
+     BENCH WHAT-SIZE ops=N ns_per_op=T
+
+   Arguments, if any, are name prefixes: only benchmarks whose
+   names start with one of them run. */
+
+/* Element counts, or byte counts for the string routines. */
+static const size_t sizes[] = {16, 256, 4096, 65536};
+#define SIZE_CNT (sizeof sizes / sizeof *sizes)
+
+/* Each measurement repeats until it has done at least this many
+   operations, so that small sizes are not lost in timer noise. */
+#define MIN_OPS 1000000
+
+/* lib/string.c and lib/stdlib.c, as renamed by
+   lib-bench-shim/pintos.h. */
+void *pintos_memcpy (void *, const void *, size_t);
+void *pintos_memset (void *, int, size_t);
+size_t pintos_strlen (const char *);
+void sort (void *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux);
+void merge_sort (void *array, size_t cnt, size_t size, void *scratch,
+                 int (*compare) (const void *, const void *, void *aux),
+                 void *aux);
+
+/* An element of the lists and hash tables. */
+struct item
+  {
+    struct list_elem list_elem;
+    struct hash_elem hash_elem;
+    unsigned key;
+  };
+
+static unsigned item_key_hash (const struct item *);
+static bool item_key_equal (const struct item *, const struct item *);
+HASH_DEFINE (item_table, struct item, hash_elem, item_key_hash,
+             item_key_equal)
+
+static char **prefixes;
+static int prefix_cnt;
+
+/* Returns true if benchmark NAME was asked for. */
+static bool
+selected (const char *name)
+{
+  int i;
+
+  if (prefix_cnt == 0)
+    return true;
+  for (i = 0; i < prefix_cnt; i++)
+    if (!strncmp (name, prefixes[i], strlen (prefixes[i])))
+      return true;
+  return false;
+}
+
+/* Returns the current time in nanoseconds. */
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns the number of times to repeat a measurement of N
+   operations. */
+static unsigned
+reps_for (size_t n)
+{
+  return n >= MIN_OPS ? 1 : (MIN_OPS + n - 1) / n;
+}
+
+/* Reports that OPS operations of kind WHAT on SIZE elements took
+   NS nanoseconds in all. */
+static void
+report (const char *what, size_t size, uint64_t ops, uint64_t ns)
+{
+  printf ("BENCH %s-%zu ops=%llu ns_per_op=%.2f\n", what, size,
+          (unsigned long long) ops, (double) ns / ops);
+}
+
+/* Returns a pseudo-random number, the same sequence every run. */
+static unsigned
+next_random (void)
+{
+  static uint32_t state = 1;
+
+  state = state * 1103515245 + 12345;
+  return state >> 8;
+}
+
+/* Returns an array of N items with distinct keys, in random
+   order. */
+static struct item *
+make_items (size_t n)
+{
+  struct item *items = malloc (n * sizeof *items);
+  size_t i;
+
+  if (items == NULL)
+    {
+      fprintf (stderr, "lib-bench: out of memory\n");
+      exit (1);
+    }
+  for (i = 0; i < n; i++)
+    items[i].key = i;
+  for (i = n; i > 1; i--)
+    {
+      size_t j = next_random () % i;
+      unsigned t = items[i - 1].key;
+      items[i - 1].key = items[j].key;
+      items[j].key = t;
+    }
+  return items;
+}
+
+static bool
+item_list_less (const struct list_elem *a, const struct list_elem *b,
+                void *aux UNUSED)
+{
+  return (list_entry (a, struct item, list_elem)->key
+          < list_entry (b, struct item, list_elem)->key);
+}
+
+static unsigned
+item_key_hash (const struct item *i)
+{
+  return hash_int (i->key);
+}
+
+static bool
+item_key_equal (const struct item *a, const struct item *b)
+{
+  return a->key == b->key;
+}
+
+static unsigned
+item_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return item_key_hash (hash_entry (e, struct item, hash_elem));
+}
+
+static bool
+item_hash_less (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+  return (hash_entry (a, struct item, hash_elem)->key
+          < hash_entry (b, struct item, hash_elem)->key);
+}
+
+static int
+compare_unsigned (const void *a_, const void *b_, void *aux UNUSED)
+{
+  unsigned a = *(const unsigned *) a_;
+  unsigned b = *(const unsigned *) b_;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Times list_push_back(), a walk over the list, list_sort(), and
+   for sizes where it is not quadratic in the extreme,
+   list_insert_ordered(). */
+static void
+bench_list (size_t n)
+{
+  struct item *items = make_items (n);
+  unsigned reps = reps_for (n), r;
+  struct list list;
+  uint64_t start, push_ns = 0, sort_ns = 0;
+  volatile unsigned sum = 0;
+  size_t i;
+
+  for (r = 0; r < reps; r++)
+    {
+      list_init (&list);
+      start = now_ns ();
+      for (i = 0; i < n; i++)
+        list_push_back (&list, &items[i].list_elem);
+      push_ns += now_ns () - start;
+
+      start = now_ns ();
+      list_sort (&list, item_list_less, NULL);
+      sort_ns += now_ns () - start;
+
+      /* Put the items back in random order for the next sort. */
+      for (i = n; i > 1; i--)
+        {
+          size_t j = next_random () % i;
+          unsigned t = items[i - 1].key;
+          items[i - 1].key = items[j].key;
+          items[j].key = t;
+        }
+    }
+  if (selected ("list-push"))
+    report ("list-push", n, (uint64_t) reps * n, push_ns);
+  if (selected ("list-sort"))
+    report ("list-sort", n, (uint64_t) reps * n, sort_ns);
+
+  if (selected ("list-scan"))
+    {
+      struct list_elem *e;
+
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        for (e = list_begin (&list); e != list_end (&list);
+             e = list_next (e))
+          sum += list_entry (e, struct item, list_elem)->key;
+      report ("list-scan", n, (uint64_t) reps * n, now_ns () - start);
+    }
+
+  if (n <= 4096 && selected ("list-insert-ordered"))
+    {
+      unsigned ordered_reps = reps_for (n * n / 2);
+
+      start = now_ns ();
+      for (r = 0; r < ordered_reps; r++)
+        {
+          list_init (&list);
+          for (i = 0; i < n; i++)
+            list_insert_ordered (&list, &items[i].list_elem,
+                                 item_list_less, NULL);
+        }
+      report ("list-insert-ordered", n, (uint64_t) ordered_reps * n,
+              now_ns () - start);
+    }
+
+  free (items);
+}
+
+/* Times hash_insert(), hash_find() and hash_delete(), and
+   lookups through HASH_DEFINE's specialized find. */
+static void
+bench_hash (size_t n)
+{
+  struct item *items = make_items (n);
+  unsigned reps = reps_for (n), r;
+  struct hash h;
+  uint64_t start, insert_ns = 0, find_ns = 0, typed_ns = 0;
+  uint64_t delete_ns = 0;
+  size_t i;
+
+  for (r = 0; r < reps; r++)
+    {
+      hash_init (&h, item_hash, item_hash_less, NULL);
+
+      start = now_ns ();
+      for (i = 0; i < n; i++)
+        hash_insert (&h, &items[i].hash_elem);
+      insert_ns += now_ns () - start;
+
+      start = now_ns ();
+      for (i = 0; i < n; i++)
+        if (hash_find (&h, &items[n - 1 - i].hash_elem) == NULL)
+          abort ();
+      find_ns += now_ns () - start;
+
+      start = now_ns ();
+      for (i = 0; i < n; i++)
+        if (item_table_find (&h, &items[n - 1 - i]) == NULL)
+          abort ();
+      typed_ns += now_ns () - start;
+
+      start = now_ns ();
+      for (i = 0; i < n; i++)
+        hash_delete (&h, &items[i].hash_elem);
+      delete_ns += now_ns () - start;
+
+      hash_destroy (&h, NULL);
+    }
+  if (selected ("hash-insert"))
+    report ("hash-insert", n, (uint64_t) reps * n, insert_ns);
+  if (selected ("hash-find"))
+    report ("hash-find", n, (uint64_t) reps * n, find_ns);
+  if (selected ("hash-find-typed"))
+    report ("hash-find-typed", n, (uint64_t) reps * n, typed_ns);
+  if (selected ("hash-delete"))
+    report ("hash-delete", n, (uint64_t) reps * n, delete_ns);
+
+  free (items);
+}
+
+/* Times bitmap_scan() for a single clear bit at the end of an
+   otherwise full bitmap of N bits, and bitmap_count() over all
+   of it, per bitmap. */
+static void
+bench_bitmap (size_t n)
+{
+  struct bitmap *b = bitmap_create (n);
+  unsigned reps = reps_for (n / 32 + 1), r;
+  uint64_t start;
+
+  bitmap_set_all (b, true);
+  bitmap_reset (b, n - 1);
+
+  if (selected ("bitmap-scan"))
+    {
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        if (bitmap_scan (b, 0, 1, false) != n - 1)
+          abort ();
+      report ("bitmap-scan", n, reps, now_ns () - start);
+    }
+  if (selected ("bitmap-count"))
+    {
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        if (bitmap_count (b, 0, n, true) != n - 1)
+          abort ();
+      report ("bitmap-count", n, reps, now_ns () - start);
+    }
+
+  bitmap_destroy (b);
+}
+
+/* Times sort() and merge_sort() of N unsigned ints, per
+   element. */
+static void
+bench_sort (size_t n)
+{
+  unsigned *array = malloc (n * sizeof *array);
+  unsigned *scratch = malloc (n * sizeof *scratch);
+  unsigned reps = reps_for (n), r;
+  uint64_t start, sort_ns = 0, merge_ns = 0;
+  size_t i;
+
+  for (r = 0; r < reps; r++)
+    {
+      for (i = 0; i < n; i++)
+        array[i] = next_random ();
+      start = now_ns ();
+      sort (array, n, sizeof *array, compare_unsigned, NULL);
+      sort_ns += now_ns () - start;
+
+      for (i = 0; i < n; i++)
+        array[i] = next_random ();
+      start = now_ns ();
+      merge_sort (array, n, sizeof *array, scratch, compare_unsigned,
+                  NULL);
+      merge_ns += now_ns () - start;
+    }
+  if (selected ("sort"))
+    report ("sort", n, (uint64_t) reps * n, sort_ns);
+  if (selected ("merge-sort"))
+    report ("merge-sort", n, (uint64_t) reps * n, merge_ns);
+
+  free (array);
+  free (scratch);
+}
+
+/* Times memcpy(), memset() and strlen() of N bytes, per call. */
+static void
+bench_string (size_t n)
+{
+  char *src = malloc (n + 1);
+  char *dst = malloc (n + 1);
+  unsigned reps = reps_for (n / 16 + 1), r;
+  uint64_t start;
+
+  memset (src, 'x', n);
+  src[n] = '\0';
+
+  if (selected ("memcpy"))
+    {
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        pintos_memcpy (dst, src, n);
+      report ("memcpy", n, reps, now_ns () - start);
+    }
+  if (selected ("memset"))
+    {
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        pintos_memset (dst, r, n);
+      report ("memset", n, reps, now_ns () - start);
+    }
+  if (selected ("strlen"))
+    {
+      start = now_ns ();
+      for (r = 0; r < reps; r++)
+        if (pintos_strlen (src) != n)
+          abort ();
+      report ("strlen", n, reps, now_ns () - start);
+    }
+
+  free (src);
+  free (dst);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t i;
+
+  prefixes = argv + 1;
+  prefix_cnt = argc - 1;
+  for (i = 0; i < SIZE_CNT; i++)
+    {
+      bench_list (sizes[i]);
+      bench_hash (sizes[i]);
+      bench_bitmap (sizes[i]);
+      bench_sort (sizes[i]);
+      bench_string (sizes[i]);
+    }
+  return 0;
+}
+
+/* The kernel's PANIC(), for failed assertions in the library
+   code. */
+void
+debug_panic (const char *file, int line, const char *function,
+             const char *message, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "lib-bench: PANIC at %s:%d in %s(): ", file, line,
+           function);
+  va_start (args, message);
+  vfprintf (stderr, message, args);
+  va_end (args);
+  fputc ('\n', stderr);
+  abort ();
+}
+
+/* The kernel's hex_dump(), for bitmap_dump(). */
+void
+hex_dump (uintptr_t ofs, const void *buf_, size_t size, bool ascii UNUSED)
+{
+  const uint8_t *buf = buf_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    printf ("%s%02x", i % 16 == 0 ? (i ? "\n" : "") : " ", buf[i]);
+  printf ("\n");
+  (void) ofs;
+}
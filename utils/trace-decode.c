@@ -0,0 +1,156 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Decodes the event trace that a Pintos kernel run with -trace
+   prints at power off.  Reads the kernel's output, picks out the
+   "TR" lines, and prints each event on a line of its own with its
+   time relative to the first event.  Keep the event types in sync
+   with threads/trace.h. */
+
+enum trace_type
+  {
+    TRACE_SWITCH,
+    TRACE_INTR,
+    TRACE_PAGE_FAULT,
+    TRACE_BLOCK_READ,
+    TRACE_BLOCK_WRITE
+  };
+
+static void usage (const char *program_name);
+static const char *intr_name (unsigned vec_no);
+
+int
+main (int argc, char *argv[])
+{
+  const char *program_name = argv[0];
+  double mhz = 0.0;
+  FILE *in = stdin;
+  char line[256];
+  uint64_t first_tsc = 0, prev_tsc = 0;
+  int have_first = 0;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "-m") && i + 1 < argc)
+        mhz = atof (argv[++i]);
+      else if (!strcmp (argv[i], "-h") || argv[i][0] == '-')
+        usage (program_name);
+      else if (in != stdin)
+        usage (program_name);
+      else
+        {
+          in = fopen (argv[i], "r");
+          if (in == NULL)
+            {
+              perror (argv[i]);
+              return EXIT_FAILURE;
+            }
+        }
+    }
+
+  if (mhz > 0.0)
+    printf ("%14s %10s", "usec", "+usec");
+  else
+    printf ("%14s %10s", "cycles", "+cycles");
+  printf (" %8s %5s  event\n", "ticks", "tid");
+
+  while (fgets (line, sizeof line, in) != NULL)
+    {
+      unsigned long long tsc;
+      unsigned ticks, type, tid, a, b;
+      const char *p = strstr (line, "TR ");
+      double t, dt;
+
+      if (p == NULL
+          || sscanf (p, "TR %llx %x %x %x %x %x",
+                     &tsc, &ticks, &type, &tid, &a, &b) != 6)
+        continue;
+
+      if (!have_first)
+        {
+          first_tsc = prev_tsc = tsc;
+          have_first = 1;
+        }
+      t = tsc - first_tsc;
+      dt = tsc - prev_tsc;
+      prev_tsc = tsc;
+      if (mhz > 0.0)
+        printf ("%14.3f %10.3f", t / mhz, dt / mhz);
+      else
+        printf ("%14.0f %10.0f", t, dt);
+      printf (" %8u %5u  ", ticks, tid);
+
+      switch (type)
+        {
+        case TRACE_SWITCH:
+          printf ("switch to %u%s\n", a, b ? " (preempted)" : "");
+          break;
+        case TRACE_INTR:
+          printf ("interrupt %#04x (%s) at %#010x\n", a, intr_name (a), b);
+          break;
+        case TRACE_PAGE_FAULT:
+          printf ("page fault at %#010x: %s error %s page in %s context\n",
+                  a, b & 1 ? "rights violation" : "not present",
+                  b & 2 ? "writing" : "reading", b & 4 ? "user" : "kernel");
+          break;
+        case TRACE_BLOCK_READ:
+        case TRACE_BLOCK_WRITE:
+          printf ("%s sector %u",
+                  type == TRACE_BLOCK_READ ? "read" : "write", a);
+          if (mhz > 0.0)
+            printf (" in %.3f usec\n", b / mhz);
+          else
+            printf (" in %u cycles\n", b);
+          break;
+        default:
+          printf ("unknown event %u (%#x, %#x)\n", type, a, b);
+          break;
+        }
+    }
+
+  if (!have_first)
+    fprintf (stderr, "%s: no trace events found "
+             "(was the kernel run with -trace?)\n", program_name);
+  return EXIT_SUCCESS;
+}
+
+static void
+usage (const char *program_name)
+{
+  fprintf (stderr,
+           "trace-decode: prints the event trace of a Pintos run\n"
+           "usage: %s [-m MHZ] [FILE]\n"
+           "Reads the kernel's console output from FILE, or from\n"
+           "standard input, and prints the events recorded by the\n"
+           "-trace kernel option.  With -m, times are converted to\n"
+           "microseconds for a CPU clocked at MHZ.\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+/* Returns a short name for interrupt VEC_NO. */
+static const char *
+intr_name (unsigned vec_no)
+{
+  switch (vec_no)
+    {
+    case 0x0e:
+      return "page fault";
+    case 0x20:
+      return "timer";
+    case 0x21:
+      return "keyboard";
+    case 0x24:
+      return "serial";
+    case 0x2e:
+    case 0x2f:
+      return "ide";
+    case 0x30:
+      return "system call";
+    default:
+      return vec_no < 0x20 ? "exception" : vec_no < 0x30 ? "irq" : "other";
+    }
+}
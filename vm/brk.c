@@ -0,0 +1,88 @@
+#include <debug.h>
+#include <round.h>
+
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/brk.h"
+#include "vm/page.h"
+
+/* The heap of a user process: the pages from the end of its
+ * loaded segments up to its break, which sbrk() moves.  Heap
+ * pages are ordinary zero pages in the supplemental page table,
+ * so a page costs no frame until it is first touched, and pages
+ * given back are freed along with their frames and swap slots.
+ * The heap may grow until it meets a mapped page or the region
+ * reserved for the stack. */
+
+static void remove_pages(uint8_t *start, uint8_t *end);
+
+/* Starts the current process's heap, empty, at START, the end of
+ * its loaded segments. */
+void
+brk_init(void *start)
+{
+    struct thread *t = thread_current()->leader;
+
+    t->heap_start = t->heap_break = pg_round_up(start);
+}
+
+/* Moves the current process's break by INCREMENT bytes, adding
+ * zero pages to its address space or removing them as needed.
+ * Returns the old break, or (void *) -1 if the break would fall
+ * below the start of the heap, if a page in the way is already
+ * in use, or if memory runs out. */
+void *
+brk_move(intptr_t increment)
+{
+    struct thread *t = thread_current()->leader;
+    uint8_t *old_break = t->heap_break;
+    uint8_t *new_break = old_break + increment;
+    uint8_t *old_end = pg_round_up(old_break);
+    uint8_t *new_end;
+    uint8_t *upage;
+
+    if ((increment > 0 && new_break < old_break)
+        || (increment < 0 && new_break > old_break)
+        || new_break < t->heap_start
+        || new_break > (uint8_t *)PHYS_BASE - STACK_MAX) {
+        return (void *) -1;
+    }
+    new_end = pg_round_up(new_break);
+
+    for (upage = old_end; upage < new_end; upage += PGSIZE) {
+        if (page_add_zero(upage, true) == NULL) {
+            remove_pages(old_end, upage);
+            return (void *) -1;
+        }
+    }
+    remove_pages(new_end, old_end);
+
+    t->heap_break = new_break;
+    return old_break;
+}
+
+/* Gives the current process the same heap as PARENT, as for
+ * fork.  The pages themselves are copied along with the rest of
+ * the page table. */
+void
+brk_clone(struct thread *parent)
+{
+    struct thread *t = thread_current()->leader;
+
+    t->heap_start = parent->heap_start;
+    t->heap_break = parent->heap_break;
+}
+
+/* Removes the heap pages from START up to END. */
+static void
+remove_pages(uint8_t *start, uint8_t *end)
+{
+    uint8_t *upage;
+
+    for (upage = start; upage < end; upage += PGSIZE) {
+        struct page *p = page_lookup(upage);
+
+        ASSERT(p != NULL);
+        page_remove(p);
+    }
+}
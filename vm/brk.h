@@ -0,0 +1,12 @@
+#ifndef VM_BRK_H
+#define VM_BRK_H
+
+#include <stdint.h>
+
+struct thread;
+
+void brk_init(void *start);
+void *brk_move(intptr_t increment);
+void brk_clone(struct thread *parent);
+
+#endif /* vm/brk.h */
@@ -0,0 +1,144 @@
+#include <kstat.h>
+#include <stdio.h>
+
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/fault.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Latency histogram buckets.  Bucket I counts faults taking
+ * fewer than 2**(I + HIST_SHIFT + 1) cycles, and the last bucket
+ * everything slower. */
+#define HIST_BUCKETS 16
+#define HIST_SHIFT 9
+
+bool fault_report;
+
+static const char *class_names[FAULT_CLASS_CNT] = {
+    "file", "zero", "swap", "stack", "cow", "invalid"
+};
+
+/* System-wide counts and latency histograms. */
+static long long fault_cnt[FAULT_CLASS_CNT];
+static long long fault_hist[FAULT_CLASS_CNT][HIST_BUCKETS];
+
+/* Records a fault of class CLS, which took CYCLES to handle,
+ * against the current process and the system-wide totals. */
+void
+fault_record(enum fault_class cls, uint64_t cycles)
+{
+    struct fault_stats *s = &thread_current()->leader->fault_stats;
+    enum intr_level old_level;
+    int bucket = 0;
+
+    while (bucket < HIST_BUCKETS - 1
+           && cycles >= (uint64_t) 1 << (bucket + HIST_SHIFT + 1)) {
+        bucket++;
+    }
+
+    s->cnt[cls]++;
+    s->cycles[cls] += cycles;
+
+    /* Faults in different processes may interleave. */
+    old_level = intr_disable();
+    fault_cnt[cls]++;
+    fault_hist[cls][bucket]++;
+    intr_set_level(old_level);
+}
+
+/* Brings the working set size, the count of swapped pages and
+ * the page table memory in the current process's statistics up to
+ * date.  The frame table keeps the resident counts current
+ * itself. */
+void
+fault_update_usage(void)
+{
+    struct thread *t = thread_current()->leader;
+
+    t->fault_stats.working_set = frame_working_set(t);
+    t->fault_stats.swapped = page_swapped_cnt();
+    t->fault_stats.pt_pages = pagedir_page_cnt(t->pagedir);
+}
+
+/* Prints the current process's paging activity, if -vmstats was
+ * given. */
+void
+fault_print_process(void)
+{
+    struct thread *t = thread_current()->leader;
+    const struct fault_stats *s = &t->fault_stats;
+    int i;
+
+    if (!fault_report) {
+        return;
+    }
+    fault_update_usage();
+    printf("%s: faults:", t->name);
+    for (i = 0; i < FAULT_CLASS_CNT; i++) {
+        printf(" %u %s", s->cnt[i], class_names[i]);
+        if (s->cnt[i] > 0) {
+            printf(" (%llu ns avg)",
+                   timer_cycles_to_ns(s->cycles[i]) / s->cnt[i]);
+        }
+        printf(i < FAULT_CLASS_CNT - 1 ? "," : "\n");
+    }
+    printf("%s: %u evictions, %u swap sectors in, %u out, "
+           "working set %u pages\n", t->name, s->evict_cnt,
+           s->swap_in_sectors, s->swap_out_sectors, s->working_set);
+    printf("%s: %u pages resident (%u mapped), %u swapped", t->name,
+           s->resident, s->mapped, s->swapped);
+    if (s->rss_limit != 0) {
+        printf(", limit %u", s->rss_limit);
+    }
+    printf(", %u KB of page tables\n", s->pt_pages * (PGSIZE / 1024));
+}
+
+/* Prints system-wide fault counts and, for each class that
+ * occurred, its latency histogram. */
+void
+fault_print_stats(void)
+{
+    int i, j;
+
+    printf("Faults:");
+    for (i = 0; i < FAULT_CLASS_CNT; i++) {
+        printf(" %lld %s%s", fault_cnt[i], class_names[i],
+               i < FAULT_CLASS_CNT - 1 ? "," : "\n");
+    }
+    for (i = 0; i < FAULT_CLASS_CNT; i++) {
+        if (fault_cnt[i] == 0) {
+            continue;
+        }
+        printf("Fault latency (%s):", class_names[i]);
+        for (j = 0; j < HIST_BUCKETS; j++) {
+            if (fault_hist[i][j] > 0) {
+                printf(" %s2^%d: %lld",
+                       j < HIST_BUCKETS - 1 ? "<" : ">=",
+                       j < HIST_BUCKETS - 1 ? j + HIST_SHIFT + 1
+                                            : j + HIST_SHIFT,
+                       fault_hist[i][j]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+/* Stores the number of user page faults resolved in *ST. */
+void
+fault_kstat(struct kstat *st)
+{
+    enum intr_level old_level = intr_disable();
+    int i;
+
+    st->vm_faults = 0;
+    for (i = 0; i < FAULT_CLASS_CNT; i++) {
+        if (i != FAULT_INVALID) {
+            st->vm_faults += fault_cnt[i];
+        }
+    }
+    intr_set_level(old_level);
+}
@@ -0,0 +1,44 @@
+#ifndef VM_FAULT_H
+#define VM_FAULT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct kstat;
+
+/* Kinds of user page fault, by how they were resolved. */
+enum fault_class {
+    FAULT_FILE,    /* Loaded from a file, or mapped a shared frame. */
+    FAULT_ZERO,    /* Zero-filled, or mapped the zero page. */
+    FAULT_SWAP,    /* Read back from swap. */
+    FAULT_STACK,   /* Grew the stack. */
+    FAULT_COW,     /* Copied a copy-on-write page. */
+    FAULT_INVALID, /* Not resolved; the access is an error. */
+    FAULT_CLASS_CNT
+};
+
+/* Paging activity and memory use of one process. */
+struct fault_stats {
+    unsigned cnt[FAULT_CLASS_CNT];    /* Faults of each class. */
+    uint64_t cycles[FAULT_CLASS_CNT]; /* Total CPU cycles handling them. */
+    unsigned evict_cnt;               /* Frames evicted to make room. */
+    unsigned swap_in_sectors;         /* Sectors read from swap. */
+    unsigned swap_out_sectors;        /* Sectors written to swap. */
+    unsigned working_set;             /* Pages in use, when reported. */
+    unsigned resident;                /* Pages in frames. */
+    unsigned mapped;                  /* ...of mapped files and segments. */
+    unsigned swapped;                 /* Pages in swap, when reported. */
+    unsigned rss_limit;               /* Most resident pages, or 0. */
+    unsigned pt_pages;                /* Page tables, when reported. */
+};
+
+/* -vmstats: Report each process's paging activity at exit? */
+extern bool fault_report;
+
+void fault_record(enum fault_class, uint64_t cycles);
+void fault_update_usage(void);
+void fault_print_process(void);
+void fault_print_stats(void);
+void fault_kstat(struct kstat *);
+
+#endif /* vm/fault.h */
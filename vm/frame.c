@@ -0,0 +1,1246 @@
+#include <debug.h>
+#include <kstat.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* Every frame in use, in the order the clock hand sweeps them. */
+static struct list frames;
+static size_t frame_cnt;        /* Number of frames in FRAMES. */
+
+/* Memory for frame table entries.  Only used with frame_lock
+ * held. */
+static struct kmem_cache *frame_cache;
+
+/* Shared frames, keyed by inode, offset, and length. */
+static struct hash shared_frames;
+
+/* Protects everything above and every frame's members, and the
+ * FRAME and FRAME_ELEM members of every page.  Swap and file I/O
+ * is done with the lock released, with the frame loading or
+ * evicting, so that faults on other pages go on meanwhile. */
+static struct lock frame_lock;
+
+/* Next frame the clock hand will consider, or the list tail if
+ * it should wrap around to the front. */
+static struct list_elem *clock_hand;
+
+/* Background reclaim.  Once fewer than the low watermark of user
+ * frames can be allocated without eviction, the next allocation
+ * wakes the pageout thread, which runs the clock hand until the
+ * high watermark, twice the low, is free again.  Faults then
+ * usually find a free frame instead of evicting one themselves,
+ * with the dirty page writes that may take.  The low watermark
+ * is FREE_LOW frames, but no more than 1/FREE_DIV of the frames
+ * in use, so that a small machine does not lose its working set
+ * to it.  Guarded by frame_lock. */
+#define FREE_LOW 32
+#define FREE_DIV 16
+static struct condition pageout_wakeup;
+static struct thread *pageout;  /* The pageout thread. */
+
+/* Replacement.  Each pass of the clock hand over a frame shifts
+ * its age right and sets the top bit if any of its pages was
+ * accessed since the last pass, so that the age holds the last 8
+ * passes' history.  A frame is old, and may be evicted, once it
+ * has gone unaccessed for the last two passes; the pages a
+ * process has accessed within that time are its working set.
+ * Rather than write an old frame that is modified, the hand
+ * looks up to CLEAN_SCAN frames further for an old one that can
+ * simply be dropped, as WSClock does. */
+#define AGE_REFERENCED 0x80
+#define AGE_OLD 0x40
+#define CLEAN_SCAN 16
+
+/* Statistics. */
+static long long frame_alloc_cnt; /* Frames handed out. */
+static long long share_cnt;       /* Mappings of an existing shared frame. */
+static long long evict_cnt;       /* Frames reclaimed by eviction. */
+static long long clean_cnt;       /* ...of which dropped without I/O. */
+static long long cluster_cnt;     /* Clustered swap-outs. */
+static long long writeback_cnt;   /* Shared pages written to their file. */
+static long long cow_share_cnt;   /* Private frames shared by a clone. */
+static long long cow_copy_cnt;    /* Copies made on write. */
+static long long reclaim_cnt;     /* Frames given back to the kernel. */
+static long long pageout_cnt;     /* Frames freed in the background. */
+static long long limit_cnt;       /* Taken from processes at their limit. */
+static long long cache_read_cnt;  /* File reads served from shared frames. */
+static long long cache_write_cnt; /* File writes copied into them. */
+
+static struct frame *frame_get(bool may_evict);
+
+static void frame_discard(struct frame *);
+
+static struct frame *share_find(const struct page *);
+
+static struct frame *cache_find(struct inode *, off_t ofs);
+
+static void attach(struct frame *, struct page *);
+
+static void detach(struct frame *, struct page *);
+
+static bool over_limit(const struct thread *);
+
+static void detach_all(struct frame *);
+
+static void set_idle(struct frame *);
+
+static struct frame *evict(const struct thread *owner);
+
+static struct frame *next_victim(size_t *budget, size_t clean_scan,
+                                 const struct thread *owner);
+
+static bool owned_by(struct frame *, const struct thread *);
+
+static bool modified(const struct frame *);
+
+static void count_evictions(size_t);
+
+static size_t low_watermark(void);
+
+static void pageout_thread(void *aux);
+
+static palloc_reclaim_func reclaim;
+
+static bool unmap(struct frame *);
+
+static void remap(struct frame *);
+
+static bool map_writable(struct frame *, struct page *);
+
+static void write_back(struct frame *, struct page *);
+
+static bool swap_out_shm(struct frame *, bool dirty);
+
+static size_t swap_out_cluster(struct frame *cluster[], size_t cnt);
+
+static int frame_less(const void *, const void *, void *aux);
+
+static hash_hash_func share_hash;
+
+static hash_less_func share_less;
+
+static inline unsigned share_key_hash(const struct frame *);
+
+static inline bool share_key_equal(const struct frame *,
+                                   const struct frame *);
+
+HASH_DEFINE(shared, struct frame, share_elem, share_key_hash,
+            share_key_equal)
+
+/* Initializes the frame table. */
+void
+frame_init(void)
+{
+    list_init(&frames);
+    hash_init(&shared_frames, share_hash, share_less, NULL);
+    lock_init(&frame_lock);
+    cond_init(&pageout_wakeup);
+    clock_hand = list_end(&frames);
+    frame_cache = kmem_cache_create("frame", sizeof(struct frame), 0, NULL);
+    palloc_set_reclaimer(reclaim);
+    thread_create("pageout", PRI_DEFAULT, pageout_thread, NULL);
+}
+
+/* Obtains a frame for page P and attaches P to it.  If P is a
+ * shared page whose file data is already in a frame, or a
+ * segment page already in a frame, that frame is returned and
+ * *FRESH is set to false.  Otherwise, a frame is taken from the
+ * user pool, or, if the pool is exhausted and MAY_EVICT is true,
+ * by evicting another page; *FRESH is set to true and the caller
+ * must fill it.
+ *
+ * The frame is returned pinned, so that it can't be evicted
+ * while the caller fills and maps it; the caller must call
+ * frame_unpin() once P is mapped.  If P's frame was being
+ * evicted, this waits for the eviction; should the eviction fail,
+ * P keeps the frame, which is returned with *FRESH false, already
+ * mapped again.
+ * Returns a null pointer if no frame can be had. */
+struct frame *
+frame_alloc(struct page *p, bool may_evict, bool *fresh)
+{
+    bool sharable = p->shared || p->type == PAGE_SHM;
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+
+    /* Let an eviction of P that is still writing finish first.
+     * If it had to give up, P is mapped onto its frame again. */
+    while (p->frame != NULL && p->frame->state == FRAME_EVICTING) {
+        cond_wait(&p->frame->io_done, &frame_lock);
+    }
+    if (p->frame != NULL) {
+        f = p->frame;
+        f->pin_cnt++;
+        lock_release(&frame_lock);
+        *fresh = false;
+        return f;
+    }
+
+    for (;;) {
+        if (sharable) {
+            while ((f = share_find(p)) != NULL
+                   && f->state != FRAME_RESIDENT) {
+                cond_wait(&f->io_done, &frame_lock);
+            }
+            if (f != NULL) {
+                attach(f, p);
+                f->pin_cnt++;
+                share_cnt++;
+                lock_release(&frame_lock);
+                *fresh = false;
+                return f;
+            }
+        }
+
+        /* A process at its resident limit pays for its new frame
+         * with one of its own, if it has one to spare. */
+        f = NULL;
+        if (may_evict && over_limit(p->owner)) {
+            f = evict(p->owner);
+            if (f != NULL) {
+                limit_cnt++;
+            }
+        }
+        if (f == NULL) {
+            f = frame_get(may_evict);
+        }
+        if (f == NULL || !sharable || share_find(p) == NULL) {
+            break;
+        }
+        /* Eviction released the lock, and meanwhile someone else
+         * brought the data in.  Use theirs. */
+        frame_discard(f);
+    }
+
+    if (f != NULL) {
+        f->inode = NULL;
+        if (p->shared) {
+            f->inode = file_get_inode(p->file);
+            f->ofs = p->ofs;
+            f->read_bytes = p->read_bytes;
+            shared_insert(&shared_frames, f);
+            inode_count_frames(f->inode, 1);
+        } else if (p->type == PAGE_SHM) {
+            f->shm = p->shm;
+            f->shm_page = p->shm_page;
+            p->shm->frames[p->shm_page] = f;
+        }
+        /* Others who find the frame before it is filled wait for
+         * frame_unpin(). */
+        f->state = FRAME_LOADING;
+        f->pin_cnt = 1;
+        attach(f, p);
+        frame_alloc_cnt++;
+    }
+    lock_release(&frame_lock);
+    *fresh = true;
+    return f;
+}
+
+/* Makes frame F a candidate for eviction again, once nobody else
+ * holds it pinned.  If F was freshly allocated, it is now filled,
+ * and anyone waiting to share it is woken. */
+void
+frame_unpin(struct frame *f)
+{
+    lock_acquire(&frame_lock);
+    ASSERT(f->pin_cnt > 0);
+    f->pin_cnt--;
+    if (f->state == FRAME_LOADING) {
+        set_idle(f);
+    }
+    lock_release(&frame_lock);
+}
+
+/* Pins page P on behalf of a system call about to copy to or from
+ * it, so that whatever frame holds P stays put until
+ * frame_unpin_page().  The pin goes with P: if P moves to another
+ * frame, or is loaded again after being dropped, the new frame
+ * is pinned instead.  Returns true if P is in a frame that is
+ * resident now, false if it must be brought in first; P is
+ * pinned either way. */
+bool
+frame_pin_page(struct page *p)
+{
+    bool resident;
+
+    lock_acquire(&frame_lock);
+    p->pin_cnt++;
+    if (p->frame != NULL) {
+        p->frame->pin_cnt++;
+    }
+    resident = p->frame != NULL && p->frame->state == FRAME_RESIDENT;
+    lock_release(&frame_lock);
+    return resident;
+}
+
+/* Drops a pin that frame_pin_page() put on page P. */
+void
+frame_unpin_page(struct page *p)
+{
+    lock_acquire(&frame_lock);
+    ASSERT(p->pin_cnt > 0);
+    p->pin_cnt--;
+    if (p->frame != NULL) {
+        ASSERT(p->frame->pin_cnt > 0);
+        p->frame->pin_cnt--;
+    }
+    lock_release(&frame_lock);
+}
+
+/* Unmaps page P and detaches it from its frame, if it has one.
+ * If P is shared and was modified through this mapping, its
+ * contents are written back to its file first.  A frame left
+ * with no pages returns to the user pool, unless it belongs to
+ * a segment, which keeps it until it is evicted.  Waits for any
+ * eviction of P's frame to finish instead of racing with it. */
+void
+frame_free(struct page *p)
+{
+    struct frame *f;
+    enum intr_level old_level;
+    bool dirty;
+
+    lock_acquire(&frame_lock);
+    while (p->frame != NULL && p->frame->state == FRAME_EVICTING) {
+        cond_wait(&p->frame->io_done, &frame_lock);
+    }
+    f = p->frame;
+    if (f == NULL) {
+        lock_release(&frame_lock);
+        return;
+    }
+
+    old_level = intr_disable();
+    dirty = pagedir_is_dirty(p->owner->pagedir, p->upage);
+    pagedir_clear_page(p->owner->pagedir, p->upage);
+    intr_set_level(old_level);
+
+    if (p->shared && dirty) {
+        write_back(f, p);
+    } else if (f->shm != NULL && dirty) {
+        f->dirty = true;
+    }
+    detach(f, p);
+    if (list_empty(&f->pages) && f->shm == NULL) {
+        frame_discard(f);
+    }
+    lock_release(&frame_lock);
+}
+
+/* Gives private page TO, a new page in the current process that
+ * copies page FROM of another process, the same contents as
+ * FROM.  If FROM is resident, both pages are mapped read-only
+ * onto its frame, keeping FROM's dirty bit, and whichever process
+ * writes first gets a copy of its own; otherwise TO shares FROM's
+ * swap slot, if any.  The caller must keep FROM's process from
+ * running meanwhile.
+ * Returns false if memory for TO's mapping is exhausted. */
+bool
+frame_clone(struct page *from, struct page *to)
+{
+    struct frame *f;
+    bool success = true;
+
+    ASSERT(!from->shared && !to->shared);
+
+    lock_acquire(&frame_lock);
+    while (from->frame != NULL && from->frame->state == FRAME_EVICTING) {
+        cond_wait(&from->frame->io_done, &frame_lock);
+    }
+    to->type = from->type;
+    to->swap_slot = from->swap_slot;
+    if (to->swap_slot != SWAP_NONE) {
+        swap_dup(to->swap_slot);
+    }
+
+    f = from->frame;
+    if (f != NULL) {
+        uint32_t *from_pd = from->owner->pagedir;
+        uint32_t *to_pd = to->owner->pagedir;
+        bool dirty = pagedir_is_dirty(from_pd, from->upage);
+
+        if (pagedir_set_page(to_pd, to->upage, f->kpage, false)) {
+            pagedir_set_dirty(to_pd, to->upage, dirty);
+            pagedir_clear_page(from_pd, from->upage);
+            pagedir_set_page(from_pd, from->upage, f->kpage, false);
+            pagedir_set_dirty(from_pd, from->upage, dirty);
+            attach(f, to);
+            cow_share_cnt++;
+        } else {
+            success = false;
+        }
+    }
+    lock_release(&frame_lock);
+    return success;
+}
+
+/* Handles a write fault on private page P, which is mapped
+ * read-only onto a frame it shares with copies of it in other
+ * processes: P gets a frame of its own holding a copy, mapped
+ * writable.  If the other copies have gone, P just takes the
+ * frame over.
+ * Returns false if no frame can be had for the copy. */
+bool
+frame_unshare(struct page *p)
+{
+    uint32_t *pd = p->owner->pagedir;
+    struct frame *f, *g;
+
+    lock_acquire(&frame_lock);
+    f = p->frame;
+    if (f == NULL || f->state == FRAME_EVICTING || f->inode != NULL) {
+        /* Being evicted, or not copy-on-write after all.  The
+         * retried access sorts it out. */
+        lock_release(&frame_lock);
+        return true;
+    }
+    if (map_writable(f, p)) {
+        pagedir_clear_page(pd, p->upage);
+        pagedir_set_page(pd, p->upage, f->kpage, true);
+        pagedir_set_dirty(pd, p->upage, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+
+    /* Pin F so that it stays put if getting G means eviction. */
+    f->pin_cnt++;
+    g = frame_get(true);
+    f->pin_cnt--;
+    if (g == NULL) {
+        lock_release(&frame_lock);
+        return false;
+    }
+    memcpy(g->kpage, f->kpage, PGSIZE);
+    pagedir_clear_page(pd, p->upage);
+    detach(f, p);
+    attach(g, p);
+    pagedir_set_page(pd, p->upage, g->kpage, true);
+    pagedir_set_dirty(pd, p->upage, true);
+    frame_alloc_cnt++;
+    cow_copy_cnt++;
+    lock_release(&frame_lock);
+    return true;
+}
+
+/* Frees the frames that still hold pages of shared memory
+ * segment SHM, which no process has attached any more. */
+void
+frame_free_shm(struct shm *shm)
+{
+    size_t i;
+
+    lock_acquire(&frame_lock);
+    for (i = 0; i < shm->page_cnt; i++) {
+        struct frame *f;
+
+        while ((f = shm->frames[i]) != NULL
+               && f->state == FRAME_EVICTING) {
+            cond_wait(&f->io_done, &frame_lock);
+        }
+        if (f != NULL) {
+            detach_all(f);
+            frame_discard(f);
+        }
+    }
+    lock_release(&frame_lock);
+}
+
+/* Returns true if shared page P's file data is already in a
+ * shared frame, so that loading P would need no I/O. */
+bool
+frame_is_cached(const struct page *p)
+{
+    bool cached;
+
+    ASSERT(p->shared);
+
+    lock_acquire(&frame_lock);
+    cached = share_find(p) != NULL;
+    lock_release(&frame_lock);
+    return cached;
+}
+
+/* Copies up to SIZE bytes of INODE's data at OFS, which the
+ * caller has checked lie within the file, into BUFFER from the
+ * shared frame that caches the page they start in, if any.
+ * Returns the number of bytes copied, which stop at the end of
+ * the page, or 0 if the page is not cached. */
+off_t
+frame_cache_read(struct inode *inode, void *buffer, off_t size, off_t ofs)
+{
+    struct frame *f;
+    off_t cnt = 0;
+
+    lock_acquire(&frame_lock);
+    f = cache_find(inode, ofs);
+    if (f != NULL && f->state != FRAME_LOADING) {
+        cnt = f->ofs + (off_t) f->read_bytes - ofs;
+        if (cnt > size) {
+            cnt = size;
+        }
+        if (cnt > 0) {
+            memcpy(buffer, f->kpage + (ofs - f->ofs), cnt);
+            cache_read_cnt++;
+        }
+    }
+    lock_release(&frame_lock);
+    return cnt > 0 ? cnt : 0;
+}
+
+/* Copies the SIZE bytes in BUFFER, just written to INODE at OFS,
+ * into the shared frames that cache the pages they cover, so
+ * that mappings of those pages see the write. */
+void
+frame_cache_write(struct inode *inode, const void *buffer, off_t size,
+                  off_t ofs)
+{
+    const uint8_t *src = buffer;
+    off_t end = ofs + size;
+
+    lock_acquire(&frame_lock);
+    while (ofs < end) {
+        off_t page_end = ROUND_DOWN(ofs, PGSIZE) + PGSIZE;
+        off_t chunk = (end < page_end ? end : page_end) - ofs;
+        struct frame *f = cache_find(inode, ofs);
+
+        /* A frame being evicted is the source of the write-back
+         * that may have brought us here. */
+        if (f != NULL && f->state == FRAME_RESIDENT) {
+            off_t valid = f->ofs + (off_t) f->read_bytes - ofs;
+
+            if (valid > 0) {
+                memcpy(f->kpage + (ofs - f->ofs), src,
+                       chunk < valid ? chunk : valid);
+                cache_write_cnt++;
+            }
+        }
+        src += chunk;
+        ofs += chunk;
+    }
+    lock_release(&frame_lock);
+}
+
+/* Returns an estimate of the size of process T's working set:
+ * the number of its resident pages that it accessed within the
+ * clock hand's last two passes over them, or since the last. */
+size_t
+frame_working_set(const struct thread *t)
+{
+    struct list_elem *e, *pe;
+    size_t cnt = 0;
+
+    lock_acquire(&frame_lock);
+    for (e = list_begin(&frames); e != list_end(&frames); e = list_next(e)) {
+        struct frame *f = list_entry(e, struct frame, elem);
+
+        for (pe = list_begin(&f->pages); pe != list_end(&f->pages);
+             pe = list_next(pe)) {
+            struct page *p = list_entry(pe, struct page, frame_elem);
+
+            if (p->owner == t
+                && (f->age >= AGE_OLD
+                    || pagedir_is_accessed(t->pagedir, p->upage))) {
+                cnt++;
+            }
+        }
+    }
+    lock_release(&frame_lock);
+    return cnt;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats(void)
+{
+    printf("Frames: %lld allocated, %lld shared, %lld evicted "
+           "(%lld clean), %lld clustered swap-outs, %lld written back\n",
+           frame_alloc_cnt, share_cnt, evict_cnt, clean_cnt, cluster_cnt,
+           writeback_cnt);
+    printf("Copy-on-write: %lld frames shared, %lld copied\n",
+           cow_share_cnt, cow_copy_cnt);
+    printf("Frames: %lld reclaimed by the kernel, %lld freed by pageout, "
+           "%lld evicted by processes at their limits\n",
+           reclaim_cnt, pageout_cnt, limit_cnt);
+    printf("Page cache: %lld reads from shared frames, %lld writes "
+           "copied into them\n", cache_read_cnt, cache_write_cnt);
+}
+
+/* Stores the frame allocation and eviction counts in *ST. */
+void
+frame_kstat(struct kstat *st)
+{
+    st->frame_allocs = frame_alloc_cnt;
+    st->evictions = evict_cnt;
+}
+
+/* Returns an unused frame from the user pool, or by eviction if
+ * MAY_EVICT is true, or a null pointer if neither works.
+ * The caller must hold frame_lock. */
+static struct frame *
+frame_get(bool may_evict)
+{
+    struct frame *f;
+    void *kpage;
+
+    kpage = palloc_get_page(PAL_USER);
+    if (palloc_user_free() < low_watermark()) {
+        cond_signal(&pageout_wakeup, &frame_lock);
+    }
+    if (kpage == NULL) {
+        return may_evict ? evict(NULL) : NULL;
+    }
+    f = kmem_cache_alloc(frame_cache);
+    if (f == NULL) {
+        palloc_free_page(kpage);
+        return NULL;
+    }
+    f->kpage = kpage;
+    list_init(&f->pages);
+    f->inode = NULL;
+    f->shm = NULL;
+    f->dirty = false;
+    f->pin_cnt = 0;
+    f->age = 0;
+    f->state = FRAME_RESIDENT;
+    cond_init(&f->io_done);
+    list_push_back(&frames, &f->elem);
+    frame_cnt++;
+    return f;
+}
+
+/* Removes frame F, which no page uses, from the frame table and
+ * returns its memory to the user pool.
+ * The caller must hold frame_lock. */
+static void
+frame_discard(struct frame *f)
+{
+    ASSERT(list_empty(&f->pages));
+
+    if (f->inode != NULL) {
+        shared_delete(&shared_frames, f);
+        inode_count_frames(f->inode, -1);
+    }
+    if (clock_hand == &f->elem) {
+        clock_hand = list_next(clock_hand);
+    }
+    list_remove(&f->elem);
+    frame_cnt--;
+    palloc_free_page(f->kpage);
+    kmem_cache_free(frame_cache, f);
+}
+
+/* Returns the shared frame holding shared page P's file data, or
+ * the segment frame holding segment page P, or a null pointer if
+ * there is none. */
+static struct frame *
+share_find(const struct page *p)
+{
+    struct frame key;
+
+    if (p->type == PAGE_SHM) {
+        return p->shm->frames[p->shm_page];
+    }
+    key.inode = file_get_inode(p->file);
+    key.ofs = p->ofs;
+    key.read_bytes = p->read_bytes;
+    return shared_find(&shared_frames, &key);
+}
+
+/* Returns the shared frame caching the page of INODE's data that
+ * byte OFS falls in, or a null pointer if there is none.  Frames
+ * are looked up by page, with the length that a mapping made
+ * now would give the page, a full page except at end of file;
+ * a page mapped while the file was shorter, or the partial last
+ * page of an executable's segment, is not found. */
+static struct frame *
+cache_find(struct inode *inode, off_t ofs)
+{
+    struct frame key;
+    off_t left;
+
+    key.inode = inode;
+    key.ofs = ROUND_DOWN(ofs, PGSIZE);
+    left = inode_length(inode) - key.ofs;
+    if (left <= 0) {
+        return NULL;
+    }
+    key.read_bytes = left < PGSIZE ? left : PGSIZE;
+    return shared_find(&shared_frames, &key);
+}
+
+/* Records that page P lives in frame F, which takes on P's
+ * pins, and counts P as resident in its process. */
+static void
+attach(struct frame *f, struct page *p)
+{
+    struct fault_stats *s = &p->owner->fault_stats;
+
+    list_push_back(&f->pages, &p->frame_elem);
+    p->frame = f;
+    f->pin_cnt += p->pin_cnt;
+    s->resident++;
+    if (p->shared || p->type == PAGE_SHM) {
+        s->mapped++;
+    }
+}
+
+/* Records that page P no longer lives in frame F, which gives up
+ * P's pins. */
+static void
+detach(struct frame *f, struct page *p)
+{
+    struct fault_stats *s = &p->owner->fault_stats;
+
+    ASSERT(f->pin_cnt >= p->pin_cnt);
+    list_remove(&p->frame_elem);
+    p->frame = NULL;
+    f->pin_cnt -= p->pin_cnt;
+    s->resident--;
+    if (p->shared || p->type == PAGE_SHM) {
+        s->mapped--;
+    }
+}
+
+/* Returns true if process T holds as many resident pages as its
+ * limit allows, or more. */
+static bool
+over_limit(const struct thread *t)
+{
+    const struct fault_stats *s = &t->fault_stats;
+
+    return s->rss_limit != 0 && s->resident >= s->rss_limit;
+}
+
+/* Detaches every page from frame F, which must already be
+ * unmapped from all of them, leaving F unused.  A shared frame
+ * leaves the shared frame table, and a segment frame its
+ * segment. */
+static void
+detach_all(struct frame *f)
+{
+    while (!list_empty(&f->pages)) {
+        detach(f, list_entry(list_front(&f->pages), struct page,
+                             frame_elem));
+    }
+    if (f->inode != NULL) {
+        shared_delete(&shared_frames, f);
+        inode_count_frames(f->inode, -1);
+        f->inode = NULL;
+    }
+    if (f->shm != NULL) {
+        f->shm->frames[f->shm_page] = NULL;
+        f->shm = NULL;
+        f->dirty = false;
+    }
+}
+
+/* Marks frame F resident and wakes those waiting on it. */
+static void
+set_idle(struct frame *f)
+{
+    f->state = FRAME_RESIDENT;
+    cond_broadcast(&f->io_done, &frame_lock);
+}
+
+/* Runs the clock hand until it finds a frame whose page can be
+ * evicted, evicts it, and returns the now-unused frame.  Gives up
+ * and returns a null pointer after three full sweeps, enough for
+ * any frame that is not in use to age, find nothing.
+ *
+ * An unmodified victim is simply dropped.  A modified shared
+ * frame is written back to its file, and a modified segment
+ * frame to its segment's swap slot.  A modified private frame
+ * would cost a page of swap writes on its own, so the hand keeps
+ * going a little further to collect up to SWAP_CLUSTER cold,
+ * modified private frames and writes them all to adjacent swap
+ * slots at once.  The extra frames go back to the user pool,
+ * where the next few allocations find them without evicting
+ * anything.
+ *
+ * If OWNER is non-null, only frames that OWNER's pages alone map
+ * are considered, so that a process over its resident limit
+ * makes room out of its own pages.
+ * The caller must hold frame_lock, which is released during I/O. */
+static struct frame *
+evict(const struct thread *owner)
+{
+    size_t budget = 3 * frame_cnt + 1;
+    struct frame *f;
+
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+
+    while ((f = next_victim(&budget, CLEAN_SCAN, owner)) != NULL) {
+        struct frame *cluster[SWAP_CLUSTER];
+        size_t scan = 2 * SWAP_CLUSTER;
+        size_t cnt, swapped, i;
+        struct frame *g;
+        bool dirty;
+
+        dirty = unmap(f);
+        if (f->shm != NULL) {
+            if (!swap_out_shm(f, dirty)) {
+                remap(f);
+                continue;
+            }
+            detach_all(f);
+            count_evictions(1);
+            return f;
+        }
+        if (!dirty) {
+            /* Its page can be had again from where it came from:
+             * its file, its swap slot, or zeros. */
+            detach_all(f);
+            count_evictions(1);
+            clean_cnt++;
+            return f;
+        }
+        if (f->inode != NULL) {
+            write_back(f, list_entry(list_front(&f->pages),
+                                     struct page, frame_elem));
+            detach_all(f);
+            count_evictions(1);
+            return f;
+        }
+
+        /* Mark the members evicting as they are collected, so that the
+         * hand can't pick the same frame twice if it wraps around,
+         * and so that nobody touches them while the lock is
+         * released for the writes. */
+        cluster[0] = f;
+        f->state = FRAME_EVICTING;
+        cnt = 1;
+        while (cnt < SWAP_CLUSTER
+               && (g = next_victim(&scan, 0, owner)) != NULL) {
+            struct page *q;
+
+            if (g->inode != NULL || g->shm != NULL) {
+                continue;
+            }
+            q = list_entry(list_front(&g->pages), struct page, frame_elem);
+            if (pagedir_is_dirty(q->owner->pagedir, q->upage) && unmap(g)) {
+                g->state = FRAME_EVICTING;
+                cluster[cnt++] = g;
+            }
+        }
+
+        swapped = swap_out_cluster(cluster, cnt);
+        for (i = 0; i < cnt; i++) {
+            set_idle(cluster[i]);
+        }
+        if (swapped == 0) {
+            continue;
+        }
+        for (i = 1; i < swapped; i++) {
+            frame_discard(cluster[i]);
+        }
+        count_evictions(swapped);
+        if (swapped > 1) {
+            cluster_cnt++;
+        }
+        return cluster[0];
+    }
+    return NULL;
+}
+
+/* Gives up to PAGE_CNT frames back to the page allocator, which
+ * calls this when the kernel runs out of memory.  Only frames
+ * that can be dropped without I/O are taken: clean ones that
+ * nobody has used lately.  The caller may hold any lock, even
+ * frame_lock, so nothing is done if frame_lock is not free right
+ * away.  Returns the number of frames given back. */
+static size_t
+reclaim(size_t page_cnt)
+{
+    size_t budget, freed = 0;
+    struct frame *f;
+
+    if (lock_held_by_current_thread(&frame_lock)
+        || !lock_try_acquire(&frame_lock)) {
+        return 0;
+    }
+    budget = 3 * frame_cnt + 1;
+    while (freed < page_cnt
+           && (f = next_victim(&budget, 0, NULL)) != NULL) {
+        if (unmap(f) || f->dirty) {
+            remap(f);
+            continue;
+        }
+        detach_all(f);
+        frame_discard(f);
+        freed++;
+    }
+    reclaim_cnt += freed;
+    lock_release(&frame_lock);
+    return freed;
+}
+
+/* Counts CNT evictions, charging them to the current process,
+ * or to background reclaim if the pageout thread made them. */
+static void
+count_evictions(size_t cnt)
+{
+    evict_cnt += cnt;
+    if (thread_current() == pageout) {
+        pageout_cnt += cnt;
+    } else {
+        thread_current()->leader->fault_stats.evict_cnt += cnt;
+    }
+}
+
+/* Returns the low watermark for background reclaim.  The caller
+ * must hold frame_lock. */
+static size_t
+low_watermark(void)
+{
+    size_t cap = frame_cnt / FREE_DIV;
+
+    return FREE_LOW < cap ? FREE_LOW : cap;
+}
+
+/* Pageout thread.  Sleeps until an allocation finds free frames
+ * below the low watermark, then evicts frames, in clusters where
+ * they are dirty, as evict() does for a fault, and frees them,
+ * until twice the low watermark are free or nothing more can be
+ * evicted. */
+static void
+pageout_thread(void *aux UNUSED)
+{
+    lock_acquire(&frame_lock);
+    pageout = thread_current();
+    for (;;) {
+        struct frame *f;
+
+        cond_wait(&pageout_wakeup, &frame_lock);
+        while (palloc_user_free() < 2 * low_watermark()
+               && (f = evict(NULL)) != NULL) {
+            frame_discard(f);
+        }
+    }
+}
+
+/* Advances the clock hand to the next old frame that may be
+ * evicted and returns it, or returns a null pointer once *BUDGET
+ * frames have been examined.  Each pass over a frame ages it,
+ * clearing its pages' accessed bits.  If CLEAN_SCAN is nonzero,
+ * an old frame that is modified is passed over in favor of an
+ * unmodified one found within CLEAN_SCAN frames further on, and
+ * returned only if there is none.  If OWNER is non-null, frames
+ * not owned_by() OWNER are passed over without aging. */
+static struct frame *
+next_victim(size_t *budget, size_t clean_scan, const struct thread *owner)
+{
+    struct frame *dirty = NULL;   /* First old, modified frame. */
+    size_t passed = 0;
+
+    while (*budget > 0 && (dirty == NULL || passed++ < clean_scan)) {
+        struct frame *f;
+        struct list_elem *e;
+        bool accessed = false;
+
+        --*budget;
+        if (clock_hand == list_end(&frames)) {
+            clock_hand = list_begin(&frames);
+            if (clock_hand == list_end(&frames)) {
+                return NULL;
+            }
+        }
+        f = list_entry(clock_hand, struct frame, elem);
+        clock_hand = list_next(clock_hand);
+
+        if (f->pin_cnt > 0 || f->state != FRAME_RESIDENT
+            || (owner != NULL && !owned_by(f, owner))) {
+            continue;
+        }
+        for (e = list_begin(&f->pages); e != list_end(&f->pages);
+             e = list_next(e)) {
+            struct page *p = list_entry(e, struct page, frame_elem);
+
+            if (pagedir_is_accessed(p->owner->pagedir, p->upage)) {
+                pagedir_set_accessed(p->owner->pagedir, p->upage, false);
+                accessed = true;
+            }
+        }
+        f->age = (f->age >> 1) | (accessed ? AGE_REFERENCED : 0);
+        if (f->age >= AGE_OLD) {
+            continue;
+        }
+        if (clean_scan == 0 || !modified(f)) {
+            return f;
+        }
+        if (dirty == NULL) {
+            dirty = f;
+        }
+    }
+    return dirty;
+}
+
+/* Returns true if F holds pages of process T and of no other. */
+static bool
+owned_by(struct frame *f, const struct thread *t)
+{
+    struct list_elem *e;
+
+    if (list_empty(&f->pages)) {
+        return false;
+    }
+    for (e = list_begin(&f->pages); e != list_end(&f->pages);
+         e = list_next(e)) {
+        if (list_entry(e, struct page, frame_elem)->owner != t) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns true if frame F holds data that evicting it would have
+ * to write somewhere. */
+static bool
+modified(const struct frame *f)
+{
+    struct list_elem *e;
+
+    if (f->dirty) {
+        return true;
+    }
+    for (e = list_begin((struct list *) &f->pages);
+         e != list_end((struct list *) &f->pages); e = list_next(e)) {
+        struct page *p = list_entry(e, struct page, frame_elem);
+
+        if (pagedir_is_dirty(p->owner->pagedir, p->upage)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Unmaps frame F from every page that maps it, so that no owner
+ * can modify it behind our back; an access after this point
+ * faults and waits for the eviction to finish.  The dirty bits go
+ * with the mappings, so both happen without a chance for an owner
+ * to run in between.
+ * Returns true if any mapping modified the frame. */
+static bool
+unmap(struct frame *f)
+{
+    enum intr_level old_level;
+    struct list_elem *e;
+    bool dirty = false;
+
+    old_level = intr_disable();
+    for (e = list_begin(&f->pages); e != list_end(&f->pages);
+         e = list_next(e)) {
+        struct page *p = list_entry(e, struct page, frame_elem);
+
+        dirty |= pagedir_is_dirty(p->owner->pagedir, p->upage);
+        pagedir_clear_page(p->owner->pagedir, p->upage);
+    }
+    intr_set_level(old_level);
+    return dirty;
+}
+
+/* Maps frame F's pages again, as modified, undoing unmap(). */
+static void
+remap(struct frame *f)
+{
+    struct list_elem *e;
+
+    for (e = list_begin(&f->pages); e != list_end(&f->pages);
+         e = list_next(e)) {
+        struct page *p = list_entry(e, struct page, frame_elem);
+
+        pagedir_set_page(p->owner->pagedir, p->upage, f->kpage,
+                         map_writable(f, p));
+        pagedir_set_dirty(p->owner->pagedir, p->upage, true);
+    }
+}
+
+/* Returns true if page P may be mapped writable onto frame F: it
+ * must be writable, and if F is private, nobody else may be
+ * using F. */
+static bool
+map_writable(struct frame *f, struct page *p)
+{
+    return (p->writable
+            && (f->inode != NULL || f->shm != NULL
+                || list_size(&f->pages) == 1));
+}
+
+/* Writes shared frame F's data back to its file through page P,
+ * one of its pages.  Releases frame_lock during the write, with F
+ * evicting. */
+static void
+write_back(struct frame *f, struct page *p)
+{
+    f->state = FRAME_EVICTING;
+    lock_release(&frame_lock);
+    file_write_at(p->file, f->kpage, f->read_bytes, f->ofs);
+    lock_acquire(&frame_lock);
+    writeback_cnt++;
+    set_idle(f);
+}
+
+/* Saves segment frame F, which has been unmapped, to its
+ * segment's swap slot for the page, unless it holds nothing new:
+ * if no mapping modified it, as DIRTY and F's own dirty flag
+ * say, it still matches the slot, or is all zeros if there is no
+ * slot yet.  Releases frame_lock during the write, with F
+ * evicting.  Returns false if swap is full. */
+static bool
+swap_out_shm(struct frame *f, bool dirty)
+{
+    size_t *slot = &f->shm->slots[f->shm_page];
+
+    if (!dirty && !f->dirty) {
+        return true;
+    }
+    if (*slot == SWAP_NONE) {
+        *slot = swap_alloc(1);
+        if (*slot == SWAP_NONE) {
+            return false;
+        }
+    }
+    f->state = FRAME_EVICTING;
+    lock_release(&frame_lock);
+    swap_write(*slot, f->kpage);
+    lock_acquire(&frame_lock);
+    set_idle(f);
+    return true;
+}
+
+/* Writes the modified, unmapped private pages in the CNT frames
+ * in CLUSTER to adjacent swap slots.  The frames are sorted
+ * first, so that consecutive pages of a process land in
+ * consecutive slots, where a later fault can read them back
+ * together.  If swap is too full for all of them, as many as fit
+ * are written and the rest are mapped again.  The written frames
+ * are left with no pages.  Returns the number written, which are
+ * the first ones in CLUSTER on return.
+ * Releases frame_lock during the writes. */
+static size_t
+swap_out_cluster(struct frame *cluster[], size_t cnt)
+{
+    size_t run, slot, i;
+
+    sort(cluster, cnt, sizeof *cluster, frame_less, NULL);
+
+    /* Prefer one run of slots for the whole cluster, settling for
+     * shorter ones as swap fills up. */
+    slot = SWAP_NONE;
+    for (run = cnt; run > 0; run /= 2) {
+        slot = swap_alloc(run);
+        if (slot != SWAP_NONE) {
+            break;
+        }
+    }
+    for (i = run; i < cnt; i++) {
+        remap(cluster[i]);
+    }
+    if (run == 0) {
+        return 0;
+    }
+
+    lock_release(&frame_lock);
+    for (i = 0; i < run; i++) {
+        swap_write(slot + i, cluster[i]->kpage);
+    }
+    lock_acquire(&frame_lock);
+
+    for (i = 0; i < run; i++) {
+        struct list_elem *e;
+
+        /* Copy-on-write pages sharing the frame share the slot. */
+        for (e = list_begin(&cluster[i]->pages);
+             e != list_end(&cluster[i]->pages); e = list_next(e)) {
+            struct page *p = list_entry(e, struct page, frame_elem);
+
+            if (p->swap_slot != SWAP_NONE) {
+                swap_free(p->swap_slot);
+            }
+            if (e != list_begin(&cluster[i]->pages)) {
+                swap_dup(slot + i);
+            }
+            p->swap_slot = slot + i;
+            p->type = PAGE_SWAP;
+        }
+        detach_all(cluster[i]);
+    }
+    return run;
+}
+
+/* Orders private frames by owner, then by user address. */
+static int
+frame_less(const void *a_, const void *b_, void *aux UNUSED)
+{
+    const struct frame *fa = *(struct frame *const *) a_;
+    const struct frame *fb = *(struct frame *const *) b_;
+    const struct page *a = list_entry(list_front((struct list *) &fa->pages),
+                                      struct page, frame_elem);
+    const struct page *b = list_entry(list_front((struct list *) &fb->pages),
+                                      struct page, frame_elem);
+
+    if (a->owner != b->owner) {
+        return a->owner < b->owner ? -1 : 1;
+    }
+    return a->upage < b->upage ? -1 : a->upage > b->upage;
+}
+
+/* Hashes shared frame F by inode, offset, and length. */
+static inline unsigned
+share_key_hash(const struct frame *f)
+{
+    unsigned h;
+
+    h = hash_ptr(f->inode);
+    h = h * 31 + hash_int(f->ofs);
+    return h * 31 + hash_int(f->read_bytes);
+}
+
+/* Returns true if shared frames A and B have the same inode,
+ * offset, and length. */
+static inline bool
+share_key_equal(const struct frame *a, const struct frame *b)
+{
+    return (a->inode == b->inode && a->ofs == b->ofs
+            && a->read_bytes == b->read_bytes);
+}
+
+/* Hashes a shared frame by inode, offset, and length. */
+static unsigned
+share_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    return share_key_hash(hash_entry(e, struct frame, share_elem));
+}
+/* Orders shared frames by inode, offset, and length. */
+static bool
+share_less(const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+    const struct frame *a = hash_entry(a_, struct frame, share_elem);
+    const struct frame *b = hash_entry(b_, struct frame, share_elem);
+
+    if (a->inode != b->inode) {
+        return a->inode < b->inode;
+    }
+    if (a->ofs != b->ofs) {
+        return a->ofs < b->ofs;
+    }
+    return a->read_bytes < b->read_bytes;
+}
@@ -0,0 +1,82 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct inode;
+struct kstat;
+struct page;
+struct shm;
+struct thread;
+
+/* What is happening to a frame's data.  A frame is loading from
+ * frame_alloc() until the page it was allocated for is filled
+ * and mapped, and evicting while its data is being written to
+ * swap or to its file.  Anyone who needs a frame that is loading
+ * or evicting waits on the frame's IO_DONE, so that a fault
+ * waits only for the page it wants. */
+enum frame_state {
+    FRAME_LOADING,               /* Being filled. */
+    FRAME_RESIDENT,              /* Filled and idle. */
+    FRAME_EVICTING               /* Being written out. */
+};
+
+/* A frame of physical memory from the user pool, holding one
+ * page of data.
+ *
+ * A private frame is mapped by one process, or, after a process
+ * is cloned, read-only by several copies of the same page until
+ * one of them writes to it.  A shared
+ * frame caches a page of a file and may be mapped by any number
+ * of processes at once; it is found through the file's inode and
+ * the offset and length of the data, so that every process
+ * mapping the same file page gets the same frame.  A segment
+ * frame likewise holds a page of a shared memory segment for
+ * every process that attaches it, and stays with the segment
+ * even while no process maps it, until it is evicted to the
+ * segment's swap slot for the page. */
+struct frame {
+    void *kpage;                 /* Kernel virtual address of the frame. */
+    struct list pages;           /* Pages mapped here, by frame_elem. */
+
+    /* Shared frames only. */
+    struct inode *inode;         /* File's inode; null if private. */
+    off_t ofs;                   /* Offset of the data in the file. */
+    uint32_t read_bytes;         /* Bytes of file data; the rest is zero. */
+    struct hash_elem share_elem; /* Element in the shared frame table. */
+
+    /* Segment frames only. */
+    struct shm *shm;             /* Segment; null if not a segment frame. */
+    size_t shm_page;             /* Page number within SHM. */
+    bool dirty;                  /* Modified through a mapping now gone? */
+
+    unsigned pin_cnt;            /* Nonzero: exempt from eviction. */
+    uint8_t age;                 /* Access history, latest in top bit. */
+    enum frame_state state;      /* Loading, resident, or evicting. */
+    struct condition io_done;    /* Broadcast when STATE turns resident. */
+    struct list_elem elem;       /* Element in the frame table. */
+};
+
+void frame_init(void);
+struct frame *frame_alloc(struct page *, bool may_evict, bool *fresh);
+void frame_unpin(struct frame *);
+bool frame_pin_page(struct page *);
+void frame_unpin_page(struct page *);
+void frame_free(struct page *);
+bool frame_clone(struct page *from, struct page *to);
+bool frame_unshare(struct page *);
+void frame_free_shm(struct shm *);
+bool frame_is_cached(const struct page *);
+off_t frame_cache_read(struct inode *, void *, off_t size, off_t ofs);
+void frame_cache_write(struct inode *, const void *, off_t size, off_t ofs);
+size_t frame_working_set(const struct thread *);
+void frame_print_stats(void);
+void frame_kstat(struct kstat *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,295 @@
+#include <debug.h>
+#include <round.h>
+#include <syscall-nr.h>
+
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/vdso.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+
+static struct mmap *mmap_find(mapid_t);
+
+static bool range_free(void *addr, size_t page_cnt);
+
+static void unmap_pages(void *addr, size_t page_cnt);
+
+static void mmap_destroy(struct mmap *);
+
+/* Maps FILE into the current process's address space starting at
+ * ADDR.  The pages are filled from the file when first touched,
+ * shared with any other process that maps the same file, and
+ * written back to the file, if modified, when the mapping goes
+ * away.  The mapping uses its own reopened copy of FILE, so it
+ * survives the caller closing FILE.  With MAP_POPULATE in FLAGS,
+ * every page is brought in before this returns, so that the
+ * process takes no faults on the mapping while it stays
+ * resident; a page that can't be had is left to its fault.
+ *
+ * Fails if FILE is empty, if ADDR is null or not page-aligned, or
+ * if any of the pages needed overlaps an existing page or the
+ * region reserved for the stack.
+ * Returns the new mapping's identifier, or MAP_FAILED. */
+mapid_t
+mmap_map(struct file *file, void *addr, unsigned flags)
+{
+    struct thread *t = thread_current()->leader;
+    struct mmap *m;
+    off_t length;
+    size_t i;
+
+    if (file == NULL || addr == NULL || pg_ofs(addr) != 0) {
+        return MAP_FAILED;
+    }
+    length = file_length(file);
+    if (length <= 0) {
+        return MAP_FAILED;
+    }
+
+    m = malloc(sizeof *m);
+    if (m == NULL) {
+        return MAP_FAILED;
+    }
+    m->addr = addr;
+    m->page_cnt = DIV_ROUND_UP(length, PGSIZE);
+    m->shm = NULL;
+    if (!range_free(addr, m->page_cnt)) {
+        free(m);
+        return MAP_FAILED;
+    }
+    m->file = file_reopen(file);
+    if (m->file == NULL) {
+        free(m);
+        return MAP_FAILED;
+    }
+
+    for (i = 0; i < m->page_cnt; i++) {
+        off_t ofs = i * PGSIZE;
+        uint32_t read_bytes = (length - ofs < PGSIZE ? length - ofs : PGSIZE);
+
+        if (page_add_shared((uint8_t *)addr + ofs, m->file, ofs,
+                            read_bytes, true) == NULL) {
+            unmap_pages(addr, i);
+            file_close(m->file);
+            free(m);
+            return MAP_FAILED;
+        }
+    }
+
+    m->id = t->next_mapid++;
+    list_push_back(&t->mmaps, &m->elem);
+    if (flags & MAP_POPULATE) {
+        page_populate(addr, m->page_cnt);
+    }
+    return m->id;
+}
+
+/* Attaches shared memory segment SHM to the current process's
+ * address space starting at ADDR, taking over the caller's
+ * reference to it.  Fails, leaving the reference with the
+ * caller, under the same conditions as mmap_map().
+ * Returns the new mapping's identifier, or MAP_FAILED. */
+mapid_t
+mmap_shm(struct shm *shm, void *addr)
+{
+    struct thread *t = thread_current()->leader;
+    struct mmap *m;
+    size_t i;
+
+    if (addr == NULL || pg_ofs(addr) != 0
+        || !range_free(addr, shm->page_cnt)) {
+        return MAP_FAILED;
+    }
+    m = malloc(sizeof *m);
+    if (m == NULL) {
+        return MAP_FAILED;
+    }
+    m->file = NULL;
+    m->shm = shm;
+    m->addr = addr;
+    m->page_cnt = shm->page_cnt;
+    for (i = 0; i < m->page_cnt; i++) {
+        if (page_add_shm((uint8_t *)addr + i * PGSIZE, shm, i,
+                         true) == NULL) {
+            unmap_pages(addr, i);
+            free(m);
+            return MAP_FAILED;
+        }
+    }
+
+    m->id = t->next_mapid++;
+    list_push_back(&t->mmaps, &m->elem);
+    return m->id;
+}
+
+/* Removes mapping ID from the current process, writing modified
+ * pages back to the file.  Does nothing if there is no such
+ * mapping. */
+void
+mmap_unmap(mapid_t id)
+{
+    struct mmap *m = mmap_find(id);
+
+    if (m != NULL) {
+        mmap_destroy(m);
+    }
+}
+
+/* Removes the current process's attachment of a shared memory
+ * segment at ADDR.  Returns false if there is none. */
+bool
+mmap_unmap_shm(void *addr)
+{
+    struct thread *t = thread_current()->leader;
+    struct list_elem *e;
+
+    for (e = list_begin(&t->mmaps); e != list_end(&t->mmaps);
+         e = list_next(e)) {
+        struct mmap *m = list_entry(e, struct mmap, elem);
+
+        if (m->shm != NULL && m->addr == addr) {
+            mmap_destroy(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Removes all of the current process's mappings, as on exit. */
+void
+mmap_unmap_all(void)
+{
+    struct thread *t = thread_current()->leader;
+
+    while (!list_empty(&t->mmaps)) {
+        mmap_destroy(list_entry(list_front(&t->mmaps), struct mmap, elem));
+    }
+}
+
+/* Gives the current process, which has no mappings, a copy of
+ * each of PARENT's mappings, with identifiers unchanged, each
+ * file reopened, and each segment attached again.  Only the
+ * records are copied; the pages are copied along with the rest
+ * of the page table.
+ * Returns false if memory runs out partway. */
+bool
+mmap_clone(struct thread *parent)
+{
+    struct thread *t = thread_current()->leader;
+    struct list_elem *e;
+
+    ASSERT(list_empty(&t->mmaps));
+
+    for (e = list_begin(&parent->mmaps); e != list_end(&parent->mmaps);
+         e = list_next(e)) {
+        struct mmap *from = list_entry(e, struct mmap, elem);
+        struct mmap *to = malloc(sizeof *to);
+
+        if (to == NULL) {
+            return false;
+        }
+        to->shm = from->shm;
+        if (to->shm != NULL) {
+            to->file = NULL;
+            shm_dup(to->shm);
+        } else {
+            to->file = file_reopen(from->file);
+            if (to->file == NULL) {
+                free(to);
+                return false;
+            }
+        }
+        to->id = from->id;
+        to->addr = from->addr;
+        to->page_cnt = from->page_cnt;
+        list_push_back(&t->mmaps, &to->elem);
+    }
+    t->next_mapid = parent->next_mapid;
+    return true;
+}
+
+/* Returns the current process's copy, made by mmap_clone(), of
+ * the file that PARENT has mapped as FILE. */
+struct file *
+mmap_clone_file(struct thread *parent, struct file *file)
+{
+    struct thread *t = thread_current()->leader;
+    struct list_elem *a, *b;
+
+    for (a = list_begin(&parent->mmaps), b = list_begin(&t->mmaps);
+         a != list_end(&parent->mmaps) && b != list_end(&t->mmaps);
+         a = list_next(a), b = list_next(b)) {
+        if (list_entry(a, struct mmap, elem)->file == file) {
+            return list_entry(b, struct mmap, elem)->file;
+        }
+    }
+    NOT_REACHED();
+}
+
+/* Returns the current process's mapping with identifier ID, or a
+ * null pointer if there is none. */
+static struct mmap *
+mmap_find(mapid_t id)
+{
+    struct thread *t = thread_current()->leader;
+    struct list_elem *e;
+
+    for (e = list_begin(&t->mmaps); e != list_end(&t->mmaps);
+         e = list_next(e)) {
+        struct mmap *m = list_entry(e, struct mmap, elem);
+        if (m->id == id) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/* Returns true if the PAGE_CNT pages starting at ADDR are all
+ * unused and clear of the region reserved for the stack. */
+static bool
+range_free(void *addr, size_t page_cnt)
+{
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++) {
+        uint8_t *upage = (uint8_t *)addr + i * PGSIZE;
+
+        if (upage < (uint8_t *)addr
+            || upage >= (uint8_t *)PHYS_BASE - STACK_MAX
+            || upage == VDSO_ADDR || page_lookup(upage) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Removes the PAGE_CNT pages starting at ADDR. */
+static void
+unmap_pages(void *addr, size_t page_cnt)
+{
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++) {
+        struct page *p = page_lookup((uint8_t *)addr + i * PGSIZE);
+
+        ASSERT(p != NULL);
+        page_remove(p);
+    }
+}
+
+/* Unmaps and frees mapping M. */
+static void
+mmap_destroy(struct mmap *m)
+{
+    unmap_pages(m->addr, m->page_cnt);
+    if (m->shm != NULL) {
+        shm_put(m->shm);
+    } else {
+        file_close(m->file);
+    }
+    list_remove(&m->elem);
+    free(m);
+}
@@ -0,0 +1,33 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+
+struct file;
+struct shm;
+struct thread;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t)-1)
+
+/* A file, or a shared memory segment, mapped into a process's
+ * address space. */
+struct mmap {
+    mapid_t id;             /* Identifier returned to the process. */
+    struct file *file;      /* Mapped file, reopened for the mapping. */
+    struct shm *shm;        /* Attached segment, if FILE is null. */
+    void *addr;             /* First user page of the mapping. */
+    size_t page_cnt;        /* Number of pages mapped. */
+    struct list_elem elem;  /* Element in the owner's mmaps list. */
+};
+
+mapid_t mmap_map(struct file *, void *addr, unsigned flags);
+mapid_t mmap_shm(struct shm *, void *addr);
+void mmap_unmap(mapid_t);
+bool mmap_unmap_shm(void *addr);
+void mmap_unmap_all(void);
+bool mmap_clone(struct thread *parent);
+struct file *mmap_clone_file(struct thread *parent, struct file *);
+
+#endif /* vm/mmap.h */
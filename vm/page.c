@@ -0,0 +1,819 @@
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+
+#include "devices/block.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/slab.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* A page of zeros, mapped read-only under every PAGE_ZERO page
+ * that has been read but not yet written. */
+static void *zero_page;
+static long long zero_map_cnt;  /* Mappings of the zero page. */
+
+/* Most file pages mapped by one fault, counting the faulting
+ * page, and the number mapped beyond faulting pages. */
+#define FAULT_AROUND_PAGES 16
+static long long fault_around_cnt;
+
+/* Read-ahead window, and window dropped behind, for pages the
+ * process has advised that it will read in order. */
+#define SEQUENTIAL_PAGES (2 * FAULT_AROUND_PAGES)
+
+/* Memory for supplemental page table entries. */
+static struct kmem_cache *page_cache;
+
+static bool fault_in(const void *fault_addr, bool write, const void *esp,
+                     enum fault_class *);
+
+static struct page *page_add(void *upage, bool writable);
+
+static enum fault_class page_class(const struct page *);
+
+static bool page_load(struct page *, bool may_evict);
+
+static struct file *clone_file(struct thread *parent, struct file *);
+
+static bool is_stack_access(const void *addr, const void *esp);
+
+static bool grow_stack(const void *fault_addr);
+
+static void swap_read_ahead(struct page *);
+
+static void fault_around(struct page *, size_t window);
+
+static void drop_behind(struct page *);
+
+static void prefetch(struct page *);
+
+static void page_discard(struct page *);
+
+static void page_unload(struct page *);
+
+static void page_destroy(struct page *);
+
+static ohash_action_func page_destroy_action;
+
+/* Sets up the shared zero page and the page entry cache. */
+void
+page_init(void)
+{
+    zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    page_cache = kmem_cache_create("page", sizeof(struct page), 0, NULL);
+}
+
+/* Prints page statistics. */
+void
+page_print_stats(void)
+{
+    printf("Pages: %lld zero page mappings, %lld mapped around faults\n",
+           zero_map_cnt, fault_around_cnt);
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+ * Returns false if memory allocation fails. */
+bool
+page_table_init(struct ohash *pages)
+{
+    return ohash_init(pages);
+}
+
+/* Frees every entry in supplemental page table PAGES, along with
+ * the frames of those that are resident.  Must be called before
+ * the owning page directory is destroyed. */
+void
+page_table_destroy(struct ohash *pages)
+{
+    ohash_destroy(pages, page_destroy_action, NULL);
+}
+
+/* Records that UPAGE in the current process's address space
+ * should be filled, when first touched, with READ_BYTES bytes
+ * from FILE at offset OFS followed by zeros.  The caller must
+ * keep FILE open for the life of the process.
+ * Returns the new page, or a null pointer if UPAGE is already
+ * recorded or memory allocation fails. */
+struct page *
+page_add_file(void *upage, struct file *file, off_t ofs,
+              uint32_t read_bytes, bool writable)
+{
+    struct page *p;
+
+    ASSERT(read_bytes <= PGSIZE);
+
+    p = page_add(upage, writable);
+    if (p != NULL) {
+        p->type = (read_bytes > 0 ? PAGE_FILE : PAGE_ZERO);
+        p->file = file;
+        p->ofs = ofs;
+        p->read_bytes = read_bytes;
+    }
+    return p;
+}
+
+/* Like page_add_file(), but the page is a shared view of the
+ * file: processes mapping the same data of the same file share a
+ * frame, and modifications are written back to FILE rather than
+ * to swap. */
+struct page *
+page_add_shared(void *upage, struct file *file, off_t ofs,
+                uint32_t read_bytes, bool writable)
+{
+    struct page *p;
+
+    ASSERT(read_bytes > 0);
+
+    p = page_add_file(upage, file, ofs, read_bytes, writable);
+    if (p != NULL) {
+        p->shared = true;
+    }
+    return p;
+}
+
+/* Records that UPAGE in the current process's address space
+ * should be filled with zeros when first touched.
+ * Returns the new page, or a null pointer if UPAGE is already
+ * recorded or memory allocation fails. */
+struct page *
+page_add_zero(void *upage, bool writable)
+{
+    return page_add_file(upage, NULL, 0, 0, writable);
+}
+
+/* Records that UPAGE in the current process's address space
+ * holds page SHM_PAGE of shared memory segment SHM.
+ * Returns the new page, or a null pointer if UPAGE is already
+ * recorded or memory allocation fails. */
+struct page *
+page_add_shm(void *upage, struct shm *shm, size_t shm_page, bool writable)
+{
+    struct page *p;
+
+    ASSERT(shm_page < shm->page_cnt);
+
+    p = page_add(upage, writable);
+    if (p != NULL) {
+        p->type = PAGE_SHM;
+        p->file = NULL;
+        p->shm = shm;
+        p->shm_page = shm_page;
+    }
+    return p;
+}
+
+/* Fills the current process's empty supplemental page table with
+ * a copy of PARENT's, as for fork.  PARENT must not run until
+ * this returns.  Resident private pages are shared copy-on-write
+ * rather than copied, and swapped-out pages share swap slots, so
+ * the cost is proportional to the number of pages, not to their
+ * contents.  File-backed pages refer to the current process's
+ * copies of PARENT's files, which must already be open, and
+ * shared memory pages to the same segments as PARENT's.
+ * Returns false if memory runs out partway; the pages copied so
+ * far stay in the table, to be freed with it. */
+bool
+page_table_clone(struct thread *parent)
+{
+    struct ohash_iterator i;
+    struct page *from;
+
+    ohash_first(&i, &parent->pages);
+    while ((from = ohash_next(&i)) != NULL) {
+        struct page *to = page_add(from->upage, from->writable);
+
+        if (to == NULL) {
+            return false;
+        }
+        to->shared = from->shared;
+        to->type = from->type;
+        to->advice = from->advice;
+        to->file = clone_file(parent, from->file);
+        to->ofs = from->ofs;
+        to->read_bytes = from->read_bytes;
+        to->shm = from->shm;
+        to->shm_page = from->shm_page;
+        if (!to->shared && to->type != PAGE_SHM && !frame_clone(from, to)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Removes page P from the current process's address space.  If P
+ * is shared and was modified, it is written back to its file. */
+void
+page_remove(struct page *p)
+{
+    ASSERT(p->owner == thread_current()->leader);
+
+    ohash_delete(&p->owner->pages, (uintptr_t) p->upage);
+    page_destroy(p);
+}
+
+/* Returns the current process's page that contains ADDR, or a
+ * null pointer if there is none. */
+struct page *
+page_lookup(const void *addr)
+{
+    struct thread *t = thread_current()->leader;
+
+    if (t->pagedir == NULL || !is_user_vaddr(addr)) {
+        return NULL;
+    }
+    return ohash_find(&t->pages, (uintptr_t) pg_round_down(addr));
+}
+
+/* Handles a fault on FAULT_ADDR in the current process by
+ * bringing in the page that belongs there, or by growing the
+ * stack if the address looks like a push below user stack
+ * pointer ESP.  WRITE is true if the faulting access was a write.
+ * Stores in *CLS how the fault was handled.
+ * Returns true if the access may be retried, false if it is a
+ * genuine error.
+ *
+ * Faults by threads of the same process are taken one at a time,
+ * so that two threads touching the same page do not both try to
+ * bring it in. */
+bool
+page_fault_in(const void *fault_addr, bool write, const void *esp,
+              enum fault_class *cls)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    bool handled;
+
+    lock_acquire(vm_lock);
+    handled = fault_in(fault_addr, write, esp, cls);
+    lock_release(vm_lock);
+    return handled;
+}
+
+/* Does the work of page_fault_in() with the process's VM_LOCK
+ * held. */
+static bool
+fault_in(const void *fault_addr, bool write, const void *esp,
+         enum fault_class *cls)
+{
+    struct page *p = page_lookup(fault_addr);
+    void *kpage;
+
+    *cls = FAULT_INVALID;
+    if (p == NULL) {
+        *cls = FAULT_STACK;
+        return is_stack_access(fault_addr, esp) && grow_stack(fault_addr);
+    }
+    if (write && !p->writable) {
+        return false;
+    }
+    kpage = pagedir_get_page(p->owner->pagedir, p->upage);
+    if (kpage == zero_page && write) {
+        /* First write to a page that only had the zero page under
+         * it: give it a frame of its own. */
+        pagedir_clear_page(p->owner->pagedir, p->upage);
+    } else if (kpage != NULL) {
+        /* Either a write to a copy-on-write page, or already
+         * resident, e.g. loaded for another access that raced
+         * with this one. */
+        if (write && !p->shared && p->type != PAGE_SHM) {
+            *cls = FAULT_COW;
+            return frame_unshare(p);
+        }
+        *cls = page_class(p);
+        return true;
+    } else if (p->type == PAGE_ZERO && !write) {
+        /* Reading a page nobody has written yet needs no memory of
+         * its own. */
+        zero_map_cnt++;
+        *cls = FAULT_ZERO;
+        return pagedir_set_page(p->owner->pagedir, p->upage, zero_page,
+                                false);
+    }
+    *cls = page_class(p);
+    if (!page_load(p, true)) {
+        return false;
+    }
+    if (p->advice == MADV_RANDOM) {
+        return true;
+    }
+    if (p->type == PAGE_SWAP) {
+        swap_read_ahead(p);
+    } else if (p->type == PAGE_FILE) {
+        fault_around(p, p->advice == MADV_SEQUENTIAL
+                        ? SEQUENTIAL_PAGES : FAULT_AROUND_PAGES);
+    }
+    if (p->advice == MADV_SEQUENTIAL) {
+        drop_behind(p);
+    }
+    return true;
+}
+
+/* Brings in the PAGE_CNT pages starting at ADDR in the current
+ * process, which must all be recorded, so that touching them
+ * later takes no faults.  Evicts other pages to make room if it
+ * must.  Returns false if a page could not be brought in; the
+ * pages before it stay resident. */
+bool
+page_populate(void *addr, size_t page_cnt)
+{
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++) {
+        struct page *p = page_lookup((uint8_t *)addr + i * PGSIZE);
+
+        ASSERT(p != NULL);
+        if (pagedir_get_page(p->owner->pagedir, p->upage) == NULL
+            && !page_load(p, true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Brings in the pages of the current process that hold the SIZE
+ * bytes at ADDR, ready to be written if WRITE is true, and pins
+ * them, so that a system call can copy to or from them while
+ * holding a lock without taking a page fault, and so without
+ * making everyone else who wants the lock wait for the fault's
+ * I/O.  Until page_unpin(), the pages' frames can't be evicted.
+ * Returns false, pinning nothing, if some page is not mapped or
+ * not writable, or can't be brought in.  The caller can still do
+ * the copy unpinned, to let the page fault handler sort it out,
+ * as for a stack that has yet to grow. */
+bool
+page_pin(const void *addr, size_t size, bool write)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    const uint8_t *start = pg_round_down(addr);
+    const uint8_t *end = (const uint8_t *)addr + size;
+    const uint8_t *upage;
+
+    lock_acquire(vm_lock);
+    for (upage = start; upage < end; upage += PGSIZE) {
+        struct page *p = page_lookup(upage);
+        enum fault_class cls;
+
+        for (;;) {
+            if (p == NULL || !fault_in(upage, write, NULL, &cls)) {
+                lock_release(vm_lock);
+                page_unpin(start, upage - start);
+                return false;
+            }
+            if (frame_pin_page(p)
+                || (!write && pagedir_get_page(p->owner->pagedir,
+                                               p->upage) == zero_page)) {
+                break;
+            }
+            /* Evicted again before it could be pinned. */
+            frame_unpin_page(p);
+        }
+    }
+    lock_release(vm_lock);
+    return true;
+}
+
+/* Unpins the pages that page_pin() pinned for the SIZE bytes at
+ * ADDR.  A page unmapped meanwhile took its pins with it. */
+void
+page_unpin(const void *addr, size_t size)
+{
+    struct lock *vm_lock = &thread_current()->leader->vm_lock;
+    const uint8_t *start = pg_round_down(addr);
+    const uint8_t *end = (const uint8_t *)addr + size;
+    const uint8_t *upage;
+
+    lock_acquire(vm_lock);
+    for (upage = start; upage < end; upage += PGSIZE) {
+        struct page *p = page_lookup(upage);
+
+        if (p != NULL && p->pin_cnt > 0) {
+            frame_unpin_page(p);
+        }
+    }
+    lock_release(vm_lock);
+}
+
+/* Returns the number of the current process's pages whose
+ * contents are in swap rather than in a frame. */
+size_t
+page_swapped_cnt(void)
+{
+    struct thread *t = thread_current()->leader;
+    struct ohash_iterator i;
+    struct page *p;
+    size_t cnt = 0;
+
+    lock_acquire(&t->vm_lock);
+    ohash_first(&i, &t->pages);
+    while ((p = ohash_next(&i)) != NULL) {
+        if (p->type == PAGE_SWAP && p->frame == NULL) {
+            cnt++;
+        }
+    }
+    lock_release(&t->vm_lock);
+    return cnt;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages of the
+ * current process from ADDR, which must be page-aligned, through
+ * LENGTH bytes after it:
+ *
+ *   - MADV_NORMAL, MADV_SEQUENTIAL, and MADV_RANDOM set how much
+ *     a fault on each page reads ahead.  Faults on sequential
+ *     pages map twice the usual window and mark the window
+ *     behind them as the first to evict; faults on random pages
+ *     bring in only the faulting page.
+ *
+ *   - MADV_WILLNEED starts reading the pages' data in the
+ *     background, ahead of the faults.
+ *
+ *   - MADV_DONTNEED drops the pages' contents.  A private page
+ *     reads as its file's data, or as zeros, when next touched;
+ *     a shared one reads as its file or segment still holds it.
+ *
+ * Returns false, doing nothing, if ADVICE is unknown or any page
+ * in the range is not mapped. */
+bool
+page_advise(void *addr, size_t length, int advice)
+{
+    uint8_t *start = addr;
+    uint8_t *end = start + ROUND_UP(length, PGSIZE);
+    uint8_t *upage;
+
+    if (pg_ofs(addr) != 0 || end < start
+        || advice < MADV_NORMAL || advice > MADV_DONTNEED) {
+        return false;
+    }
+    for (upage = start; upage < end; upage += PGSIZE) {
+        if (page_lookup(upage) == NULL) {
+            return false;
+        }
+    }
+
+    for (upage = start; upage < end; upage += PGSIZE) {
+        struct page *p = page_lookup(upage);
+
+        switch (advice) {
+        case MADV_WILLNEED:
+            prefetch(p);
+            break;
+        case MADV_DONTNEED:
+            page_discard(p);
+            break;
+        default:
+            p->advice = advice;
+            break;
+        }
+    }
+    return true;
+}
+
+/* Returns the class of a fault that loads P. */
+static enum fault_class
+page_class(const struct page *p)
+{
+    switch (p->type) {
+    case PAGE_FILE:
+    case PAGE_SHM:
+        return FAULT_FILE;
+    case PAGE_ZERO:
+        return FAULT_ZERO;
+    case PAGE_SWAP:
+        return FAULT_SWAP;
+    default:
+        NOT_REACHED();
+    }
+}
+
+/* Creates and inserts a page for UPAGE in the current process's
+ * page table, leaving its type to the caller. */
+static struct page *
+page_add(void *upage, bool writable)
+{
+    struct thread *t = thread_current()->leader;
+    struct page *p;
+
+    ASSERT(pg_ofs(upage) == 0);
+    ASSERT(is_user_vaddr(upage));
+
+    p = kmem_cache_alloc(page_cache);
+    if (p == NULL) {
+        return NULL;
+    }
+    p->upage = upage;
+    p->owner = t;
+    p->writable = writable;
+    p->shared = false;
+    p->advice = MADV_NORMAL;
+    p->pin_cnt = 0;
+    p->frame = NULL;
+    p->swap_slot = SWAP_NONE;
+    if (!ohash_insert(&t->pages, (uintptr_t) upage, p)) {
+        kmem_cache_free(page_cache, p);
+        return NULL;
+    }
+    return p;
+}
+
+/* Reads P's contents into a frame and maps it.  If MAY_EVICT is
+ * false, only a free frame will do.
+ * Returns true if successful, false if no frame can be had or
+ * the file can't be read. */
+static bool
+page_load(struct page *p, bool may_evict)
+{
+    /* If P is being evicted right now, this waits for the
+     * eviction to finish, so P's type is only examined after. */
+    bool fresh;
+    struct frame *f = frame_alloc(p, may_evict, &fresh);
+    uint32_t read_bytes;
+    uint8_t *kpage;
+
+    if (f == NULL) {
+        return false;
+    }
+    kpage = f->kpage;
+    if (!fresh && pagedir_get_page(p->owner->pagedir, p->upage) == kpage) {
+        /* An eviction of P gave up and mapped it again. */
+        frame_unpin(f);
+        return true;
+    }
+
+    if (!fresh) {
+        /* Another process's mapping of the same file or segment
+         * page. */
+        read_bytes = PGSIZE;
+    } else if (p->type == PAGE_SWAP) {
+        swap_read(p->swap_slot, kpage);
+        read_bytes = PGSIZE;
+    } else if (p->type == PAGE_SHM) {
+        /* The slot can't change while the frame is loading. */
+        size_t slot = p->shm->slots[p->shm_page];
+
+        if (slot != SWAP_NONE) {
+            swap_read(slot, kpage);
+            read_bytes = PGSIZE;
+        } else {
+            read_bytes = 0;
+        }
+    } else if (p->type == PAGE_FILE) {
+        read_bytes = p->read_bytes;
+    } else {
+        read_bytes = 0;
+    }
+
+    if (fresh && p->type == PAGE_FILE
+        && inode_read_page(file_get_inode(p->file), kpage, read_bytes,
+                           p->ofs) != (off_t) read_bytes) {
+        frame_unpin(f);
+        frame_free(p);
+        return false;
+    }
+    memset(kpage + read_bytes, 0, PGSIZE - read_bytes);
+
+    if (!pagedir_set_page(p->owner->pagedir, p->upage, kpage, p->writable)) {
+        frame_unpin(f);
+        frame_free(p);
+        return false;
+    }
+    frame_unpin(f);
+    return true;
+}
+
+/* Returns the current process's copy of PARENT's FILE, which is
+ * either PARENT's executable or one of its mapped files, or a
+ * null pointer if FILE is null. */
+static struct file *
+clone_file(struct thread *parent, struct file *file)
+{
+    if (file == NULL) {
+        return NULL;
+    }
+    if (file == parent->exec_file) {
+        return thread_current()->leader->exec_file;
+    }
+    return mmap_clone_file(parent, file);
+}
+
+/* Brings in the pages following P that were swapped out in the
+ * same cluster, i.e. that sit in the slots right after P's.  The
+ * slots are adjacent on disk, so this costs little more than P's
+ * own read and saves a fault per page when the process is
+ * working through the region in order.  Stops early rather than
+ * evict anything to make room. */
+static void
+swap_read_ahead(struct page *p)
+{
+    size_t i;
+
+    for (i = 1; i < SWAP_CLUSTER; i++) {
+        struct page *q = page_lookup((uint8_t *)p->upage + i * PGSIZE);
+
+        if (q == NULL || q->type != PAGE_SWAP || q->frame != NULL
+            || q->swap_slot != p->swap_slot + i || !page_load(q, false)) {
+            break;
+        }
+    }
+}
+
+/* Maps the pages after file page P, which a fault has just
+ * brought in, that hold the following pages of the same file,
+ * for as long as their data is at hand: in a shared frame, or in
+ * the buffer cache.  A process working through a mapped file or
+ * its executable in order then takes one fault per WINDOW pages
+ * instead of one per page.  At the first page whose data is
+ * still on disk, this asks the buffer cache to read the rest of
+ * the window in the background, so that the next fault finds it
+ * there, and stops.  Like swap_read_ahead(), never evicts
+ * anything to make room. */
+static void
+fault_around(struct page *p, size_t window)
+{
+    struct inode *inode = file_get_inode(p->file);
+    size_t i;
+
+    for (i = 1; i < window; i++) {
+        struct page *q = page_lookup((uint8_t *)p->upage + i * PGSIZE);
+
+        if (q == NULL || q->type != PAGE_FILE || q->file != p->file
+            || q->ofs != p->ofs + (off_t) (i * PGSIZE)
+            || q->frame != NULL
+            || pagedir_get_page(q->owner->pagedir, q->upage) != NULL) {
+            break;
+        }
+        if (!(q->shared && frame_is_cached(q))
+            && !inode_is_cached(inode, q->ofs, q->read_bytes)) {
+            inode_read_ahead(inode, q->ofs,
+                             (window - i) * PGSIZE / BLOCK_SECTOR_SIZE);
+            break;
+        }
+        if (!page_load(q, false)) {
+            break;
+        }
+        fault_around_cnt++;
+    }
+}
+
+/* Marks the SEQUENTIAL_PAGES pages before P, which a process
+ * reading in order has presumably finished with, as not recently
+ * used, so that the clock takes them before pages that may still
+ * be wanted.  Stops at the first page not advised sequential. */
+static void
+drop_behind(struct page *p)
+{
+    size_t i;
+
+    for (i = 1; i <= SEQUENTIAL_PAGES; i++) {
+        struct page *q;
+
+        if ((uintptr_t) p->upage < i * PGSIZE) {
+            break;
+        }
+        q = page_lookup((uint8_t *)p->upage - i * PGSIZE);
+        if (q == NULL || q->advice != MADV_SEQUENTIAL) {
+            break;
+        }
+        pagedir_set_accessed(q->owner->pagedir, q->upage, false);
+    }
+}
+
+/* Starts bringing in page P, which the process expects to touch
+ * soon, if it is not resident: a file page's data is read into
+ * the buffer cache in the background, and a swapped-out page is
+ * read back now if a frame is free.  Other pages cost nothing to
+ * fault in. */
+static void
+prefetch(struct page *p)
+{
+    if (p->frame != NULL
+        || pagedir_get_page(p->owner->pagedir, p->upage) != NULL) {
+        return;
+    }
+    if (p->type == PAGE_FILE) {
+        inode_read_ahead(file_get_inode(p->file), p->ofs,
+                         DIV_ROUND_UP(p->read_bytes, BLOCK_SECTOR_SIZE));
+    } else if (p->type == PAGE_SWAP) {
+        page_load(p, false);
+    }
+}
+
+/* Drops page P's contents, as for MADV_DONTNEED.  A private page
+ * gives up its frame and swap slot and goes back to being filled
+ * from its file, or with zeros; a shared file or segment page is
+ * just unmapped, its contents written back or kept by the
+ * segment. */
+static void
+page_discard(struct page *p)
+{
+    page_unload(p);
+    if (p->shared || p->type == PAGE_SHM) {
+        return;
+    }
+    if (p->swap_slot != SWAP_NONE) {
+        swap_free(p->swap_slot);
+        p->swap_slot = SWAP_NONE;
+    }
+    p->type = (p->file != NULL && p->read_bytes > 0 ? PAGE_FILE : PAGE_ZERO);
+}
+
+/* Unmaps page P and frees its frame, if it has one, keeping P. */
+static void
+page_unload(struct page *p)
+{
+    if (p->frame == NULL
+        && pagedir_get_page(p->owner->pagedir, p->upage) == zero_page) {
+        /* Not ours to free when the page directory goes. */
+        pagedir_clear_page(p->owner->pagedir, p->upage);
+    }
+    frame_free(p);
+}
+
+/* Returns true if a fault on ADDR can be taken for the process
+ * pushing onto its stack, given user stack pointer ESP.  PUSHA
+ * writes up to 32 bytes below the stack pointer before moving
+ * it, so that much slack is allowed; anything deeper is a stray
+ * pointer.  The stack may not grow past STACK_MAX. */
+static bool
+is_stack_access(const void *addr, const void *esp)
+{
+    uintptr_t a = (uintptr_t) addr;
+
+    return (a < (uintptr_t) PHYS_BASE
+            && a >= (uintptr_t) PHYS_BASE - STACK_MAX
+            && a + 32 >= (uintptr_t) esp);
+}
+
+/* Adds a zeroed stack page at FAULT_ADDR and brings it in.
+ *
+ * A fault just below a page already on the stack means the stack
+ * is growing a page at a time, as in a deep recursion.  Each such
+ * fault in a row doubles the number of pages added, up to
+ * STACK_CHUNK_MAX, so that a long descent takes a fault per chunk
+ * rather than per page.  The extra pages are only filled if a
+ * frame is free; otherwise they wait for their own fault.
+ * Returns true if the faulting page was added and brought in. */
+static bool
+grow_stack(const void *fault_addr)
+{
+    struct thread *t = thread_current()->leader;
+    uint8_t *upage = pg_round_down(fault_addr);
+    uint8_t *limit = (uint8_t *)PHYS_BASE - STACK_MAX;
+    struct page *p;
+    size_t i;
+
+    if (page_lookup(upage + PGSIZE) != NULL) {
+        t->stack_chunk = t->stack_chunk * 2;
+        if (t->stack_chunk > STACK_CHUNK_MAX) {
+            t->stack_chunk = STACK_CHUNK_MAX;
+        }
+    } else {
+        t->stack_chunk = 1;
+    }
+
+    p = page_add_zero(upage, true);
+    if (p == NULL || !page_load(p, true)) {
+        return false;
+    }
+
+    for (i = 1; i < t->stack_chunk; i++) {
+        uint8_t *below = upage - i * PGSIZE;
+
+        if (below < limit) {
+            break;
+        }
+        p = page_add_zero(below, true);
+        if (p == NULL || !page_load(p, false)) {
+            break;
+        }
+    }
+    return true;
+}
+
+/* Frees page P and its frame. */
+static void
+page_destroy(struct page *p)
+{
+    page_unload(p);
+    if (p->swap_slot != SWAP_NONE) {
+        swap_free(p->swap_slot);
+    }
+    kmem_cache_free(page_cache, p);
+}
+
+/* Frees the page VALUE of a page table being destroyed. */
+static void
+page_destroy_action(uintptr_t upage UNUSED, void *value, void *aux UNUSED)
+{
+    page_destroy(value);
+}
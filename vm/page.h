@@ -0,0 +1,82 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <list.h>
+#include <ohash.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "filesys/off_t.h"
+#include "vm/fault.h"
+
+/* Largest the user stack may grow. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+/* Most stack pages added by one fault. */
+#define STACK_CHUNK_MAX 16
+
+struct file;
+struct frame;
+struct shm;
+struct thread;
+
+/* Where a page's contents come from when it is not resident. */
+enum page_type {
+    PAGE_FILE, /* READ_BYTES from FILE at OFS, then zeros. */
+    PAGE_ZERO, /* All zeros; the shared zero page until written. */
+    PAGE_SWAP, /* SWAP_SLOT. */
+    PAGE_SHM   /* Page SHM_PAGE of shared memory segment SHM. */
+};
+
+/* A page of user virtual memory, as recorded in its process's
+ * supplemental page table.  The hardware page table says whether
+ * the page is mapped right now; this says what belongs there. */
+struct page {
+    void *upage;            /* User virtual address, page-aligned. */
+    struct thread *owner;   /* Process whose address space this is. */
+    bool writable;          /* May the process write the page? */
+    bool shared;            /* Shared view of a file page? */
+    struct frame *frame;    /* Frame holding the page, or null. */
+    struct list_elem frame_elem; /* Element in the frame's page list. */
+    enum page_type type;    /* Source of the contents. */
+    int advice;             /* MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM. */
+    unsigned pin_cnt;       /* Pins by page_pin(), under the frame lock. */
+
+    /* PAGE_FILE only. */
+    struct file *file;      /* File to read from. */
+    off_t ofs;              /* Offset in FILE. */
+    uint32_t read_bytes;    /* Bytes to read; the rest is zeroed. */
+
+    /* PAGE_SHM only. */
+    struct shm *shm;        /* Segment the page belongs to. */
+    size_t shm_page;        /* Page number within SHM. */
+
+    /* Swap slot holding a copy of the page, or SWAP_NONE.  Once
+     * a page has been swapped out it keeps its slot, so that a
+     * clean page need not be written again when next evicted. */
+    size_t swap_slot;
+};
+
+void page_init(void);
+void page_print_stats(void);
+bool page_table_init(struct ohash *);
+void page_table_destroy(struct ohash *);
+struct page *page_add_file(void *upage, struct file *, off_t,
+                           uint32_t read_bytes, bool writable);
+struct page *page_add_shared(void *upage, struct file *, off_t,
+                             uint32_t read_bytes, bool writable);
+struct page *page_add_zero(void *upage, bool writable);
+struct page *page_add_shm(void *upage, struct shm *, size_t shm_page,
+                          bool writable);
+void page_remove(struct page *);
+bool page_table_clone(struct thread *parent);
+struct page *page_lookup(const void *addr);
+bool page_fault_in(const void *fault_addr, bool write, const void *esp,
+                  enum fault_class *);
+bool page_populate(void *addr, size_t page_cnt);
+bool page_advise(void *addr, size_t length, int advice);
+bool page_pin(const void *addr, size_t size, bool write);
+void page_unpin(const void *addr, size_t size);
+size_t page_swapped_cnt(void);
+
+#endif /* vm/page.h */
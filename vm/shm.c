@@ -0,0 +1,192 @@
+#include <debug.h>
+#include <round.h>
+
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* Every live segment. */
+static struct list segments;
+
+/* Protects SEGMENTS, NEXT_ID, and every segment's REF_CNT and
+ * CREATOR. */
+static struct lock shm_lock;
+
+/* Identifier for the next segment created. */
+static int next_id;
+
+static struct shm *shm_find(int id);
+
+/* Initializes the segment list. */
+void
+shm_init(void)
+{
+    list_init(&segments);
+    lock_init(&shm_lock);
+}
+
+/* Creates a segment of SIZE bytes, rounded up to whole pages,
+ * all zero, on behalf of the current process.  The segment lives
+ * at least until the process exits, even if never attached.
+ * Returns its identifier, or -1 if SIZE is 0 or more than
+ * SHM_PAGES_MAX pages, or if memory runs out. */
+int
+shm_create(size_t size)
+{
+    struct shm *shm;
+    size_t i;
+
+    if (size == 0 || size > SHM_PAGES_MAX * PGSIZE) {
+        return -1;
+    }
+    shm = malloc(sizeof *shm);
+    if (shm == NULL) {
+        return -1;
+    }
+    shm->page_cnt = DIV_ROUND_UP(size, PGSIZE);
+    shm->frames = calloc(shm->page_cnt, sizeof *shm->frames);
+    shm->slots = malloc(shm->page_cnt * sizeof *shm->slots);
+    if (shm->frames == NULL || shm->slots == NULL) {
+        free(shm->frames);
+        free(shm->slots);
+        free(shm);
+        return -1;
+    }
+    for (i = 0; i < shm->page_cnt; i++) {
+        shm->slots[i] = SWAP_NONE;
+    }
+    shm->ref_cnt = 1;
+    shm->creator = thread_current()->leader;
+
+    lock_acquire(&shm_lock);
+    shm->id = next_id++;
+    list_push_back(&segments, &shm->elem);
+    lock_release(&shm_lock);
+    return shm->id;
+}
+
+/* Attaches segment ID to the current process at ADDR, writable.
+ * Fails if there is no such segment, or if ADDR is not suitable
+ * for mmap_shm().  Returns true if successful. */
+bool
+shm_attach(int id, void *addr)
+{
+    struct shm *shm;
+
+    lock_acquire(&shm_lock);
+    shm = shm_find(id);
+    if (shm != NULL) {
+        shm->ref_cnt++;
+    }
+    lock_release(&shm_lock);
+
+    if (shm == NULL) {
+        return false;
+    }
+    if (mmap_shm(shm, addr) == MAP_FAILED) {
+        shm_put(shm);
+        return false;
+    }
+    return true;
+}
+
+/* Detaches the segment that the current process attached at
+ * ADDR.  Returns false if none is attached there. */
+bool
+shm_detach(void *addr)
+{
+    return mmap_unmap_shm(addr);
+}
+
+/* Adds a reference to SHM, for a new attachment. */
+void
+shm_dup(struct shm *shm)
+{
+    lock_acquire(&shm_lock);
+    ASSERT(shm->ref_cnt > 0);
+    shm->ref_cnt++;
+    lock_release(&shm_lock);
+}
+
+/* Drops a reference to SHM, freeing it, along with its frames
+ * and swap slots, if that was the last. */
+void
+shm_put(struct shm *shm)
+{
+    bool dead;
+    size_t i;
+
+    lock_acquire(&shm_lock);
+    ASSERT(shm->ref_cnt > 0);
+    dead = --shm->ref_cnt == 0;
+    if (dead) {
+        list_remove(&shm->elem);
+    }
+    lock_release(&shm_lock);
+
+    if (dead) {
+        frame_free_shm(shm);
+        for (i = 0; i < shm->page_cnt; i++) {
+            if (shm->slots[i] != SWAP_NONE) {
+                swap_free(shm->slots[i]);
+            }
+        }
+        free(shm->frames);
+        free(shm->slots);
+        free(shm);
+    }
+}
+
+/* Drops the references that the current process holds as the
+ * creator of segments, as it exits.  Its attachments must
+ * already be gone. */
+void
+shm_exit(void)
+{
+    struct thread *t = thread_current()->leader;
+    struct list_elem *e;
+
+    lock_acquire(&shm_lock);
+    e = list_begin(&segments);
+    while (e != list_end(&segments)) {
+        struct shm *shm = list_entry(e, struct shm, elem);
+
+        e = list_next(e);
+        if (shm->creator == t) {
+            shm->creator = NULL;
+            if (shm->ref_cnt > 1) {
+                shm->ref_cnt--;
+            } else {
+                /* Last reference: free it outside the lock. */
+                lock_release(&shm_lock);
+                shm_put(shm);
+                lock_acquire(&shm_lock);
+                e = list_begin(&segments);
+            }
+        }
+    }
+    lock_release(&shm_lock);
+}
+
+/* Returns the segment with identifier ID, or a null pointer if
+ * there is none.  The caller must hold shm_lock. */
+static struct shm *
+shm_find(int id)
+{
+    struct list_elem *e;
+
+    for (e = list_begin(&segments); e != list_end(&segments);
+         e = list_next(e)) {
+        struct shm *shm = list_entry(e, struct shm, elem);
+
+        if (shm->id == id) {
+            return shm;
+        }
+    }
+    return NULL;
+}
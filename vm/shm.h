@@ -0,0 +1,44 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct frame;
+struct thread;
+
+/* Most pages in a shared memory segment. */
+#define SHM_PAGES_MAX 1024
+
+/* A shared memory segment: anonymous pages that any number of
+ * processes may attach, each page held by one frame that all of
+ * them map.  A page nobody has touched is zero.  Under memory
+ * pressure a page's frame is evicted like any other, its
+ * contents going to a swap slot that belongs to the segment
+ * rather than to any process, and whoever touches the page next
+ * reads it back.
+ *
+ * A segment lives while it is attached anywhere or its creator
+ * is alive. */
+struct shm {
+    int id;                  /* Identifier returned by shm_create(). */
+    size_t page_cnt;         /* Number of pages. */
+    unsigned ref_cnt;        /* Attachments, plus one for the creator. */
+    struct thread *creator;  /* Creating process, null once it exits. */
+    struct list_elem elem;   /* Element in the segment list. */
+
+    /* Guarded by the frame table's lock. */
+    struct frame **frames;   /* Frame holding each page, or null. */
+    size_t *slots;           /* Swap slot of each page, or SWAP_NONE. */
+};
+
+void shm_init(void);
+int shm_create(size_t size);
+bool shm_attach(int id, void *addr);
+bool shm_detach(void *addr);
+void shm_dup(struct shm *);
+void shm_put(struct shm *);
+void shm_exit(void);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,269 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <kstat.h>
+#include <lz.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+/* Sectors per page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+
+/* One bit per slot, true if the slot is in use, and the number
+ * of pages referring to each slot in use.  Only pages copied
+ * from one process to another share a slot. */
+static struct bitmap *swap_slots;
+static uint16_t *slot_refs;
+static struct lock swap_lock;
+
+/* Compressed swap cache.
+ *
+ * With -zswap, a page written to a slot is first compressed, and
+ * if it shrinks to half a page or less and the cache has room, it
+ * is kept in kernel memory instead of being written to the
+ * device.  Reading the slot back decompresses it.  The cache uses
+ * the device's slot numbers, so the rest of the VM system cannot
+ * tell the difference, and only pages that do not compress or do
+ * not fit reach the disk.  A workload that overflows user memory
+ * by a little then pages to RAM at memory speed: each page it
+ * gives up takes less than half a page of kernel memory, which
+ * the user pool gets back in turn.
+ *
+ * The cache holds at most SWAP_CACHE_PAGES pages' worth of
+ * compressed data, in blocks from the kernel heap, one per page
+ * stored, so that it grows and shrinks with use.  Guarded by
+ * swap_lock. */
+size_t swap_cache_pages;
+
+/* A compressed page. */
+struct zpage {
+    uint16_t size;              /* Bytes of compressed data. */
+    uint8_t data[];             /* Compressed data. */
+};
+
+static struct zpage **zpages;   /* Each slot's compressed copy, or null. */
+static size_t zbytes;           /* Bytes held by ZPAGES. */
+static uint8_t *zbuf;           /* Compressor output, a page. */
+static lz_table ztable;         /* Compressor scratch. */
+
+/* Statistics. */
+static long long swap_out_cnt; /* Pages written to swap. */
+static long long swap_in_cnt;  /* Pages read from swap. */
+static long long zstore_cnt;   /* Pages stored compressed. */
+static long long zload_cnt;    /* Pages read back from the cache. */
+static long long zreject_cnt;  /* Pages too big, or no room in the cache. */
+
+static bool zswap_store(size_t slot, const void *kpage);
+static bool zswap_load(size_t slot, void *kpage);
+static void zswap_drop(size_t slot);
+
+/* Sets up swap on the BLOCK_SWAP device, if there is one.
+ * Without one, swap_alloc() always fails. */
+void
+swap_init(void)
+{
+    lock_init(&swap_lock);
+    swap_device = block_get_role(BLOCK_SWAP);
+    if (swap_device == NULL) {
+        return;
+    }
+    swap_slots = bitmap_create_summarized(block_size(swap_device)
+                                          / SECTORS_PER_SLOT);
+    if (swap_slots != NULL) {
+        slot_refs = calloc(bitmap_size(swap_slots), sizeof *slot_refs);
+    }
+    if (swap_slots == NULL || slot_refs == NULL) {
+        PANIC("swap bitmap creation failed--swap device is too large");
+    }
+    if (swap_cache_pages > 0) {
+        zpages = calloc(bitmap_size(swap_slots), sizeof *zpages);
+        zbuf = palloc_get_page(0);
+        if (zpages == NULL || zbuf == NULL) {
+            PANIC("swap cache creation failed");
+        }
+    }
+}
+
+/* Reserves CNT adjacent free swap slots and returns the first,
+ * or SWAP_NONE if there is no such run or no swap at all.  Pages
+ * in adjacent slots are adjacent on disk, so writing or reading
+ * them in order needs no seeks. */
+size_t
+swap_alloc(size_t cnt)
+{
+    size_t slot;
+
+    if (swap_slots == NULL) {
+        return SWAP_NONE;
+    }
+    lock_acquire(&swap_lock);
+    slot = bitmap_scan_and_flip(swap_slots, 0, cnt, false);
+    if (slot != BITMAP_ERROR) {
+        size_t i;
+
+        for (i = 0; i < cnt; i++) {
+            slot_refs[slot + i] = 1;
+        }
+    }
+    lock_release(&swap_lock);
+    return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Writes the page at KPAGE to reserved swap slot SLOT, or to the
+ * compressed swap cache in its place. */
+void
+swap_write(size_t slot, const void *kpage)
+{
+    ASSERT(bitmap_test(swap_slots, slot));
+
+    if (zpages != NULL && zswap_store(slot, kpage)) {
+        return;
+    }
+    block_write_multiple(swap_device, slot * SECTORS_PER_SLOT,
+                         SECTORS_PER_SLOT, kpage);
+    swap_out_cnt++;
+    thread_current()->leader->fault_stats.swap_out_sectors += SECTORS_PER_SLOT;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE.  The slot stays
+ * reserved. */
+void
+swap_read(size_t slot, void *kpage)
+{
+    ASSERT(bitmap_test(swap_slots, slot));
+
+    if (zpages != NULL && zswap_load(slot, kpage)) {
+        return;
+    }
+    block_read_multiple(swap_device, slot * SECTORS_PER_SLOT,
+                        SECTORS_PER_SLOT, kpage);
+    swap_in_cnt++;
+    thread_current()->leader->fault_stats.swap_in_sectors += SECTORS_PER_SLOT;
+}
+
+/* Adds a reference to swap slot SLOT, for a page that is a copy
+ * of one already using it. */
+void
+swap_dup(size_t slot)
+{
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_slots, slot));
+    ASSERT(slot_refs[slot] < UINT16_MAX);
+    slot_refs[slot]++;
+    lock_release(&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT, releasing the slot when
+ * the last one goes. */
+void
+swap_free(size_t slot)
+{
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_slots, slot));
+    ASSERT(slot_refs[slot] > 0);
+    if (--slot_refs[slot] == 0) {
+        if (zpages != NULL) {
+            zswap_drop(slot);
+        }
+        bitmap_reset(swap_slots, slot);
+    }
+    lock_release(&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats(void)
+{
+    if (swap_device != NULL) {
+        printf("Swap: %lld pages out, %lld pages in, %zu of %zu slots used\n",
+               swap_out_cnt, swap_in_cnt,
+               bitmap_count(swap_slots, 0, bitmap_size(swap_slots), true),
+               bitmap_size(swap_slots));
+    }
+    if (zpages != NULL) {
+        printf("Swap cache: %lld pages stored, %lld loaded, %lld refused, "
+               "%zu bytes in use\n",
+               zstore_cnt, zload_cnt, zreject_cnt, zbytes);
+    }
+}
+
+/* Stores the swap traffic, in pages, in *ST. */
+void
+swap_kstat(struct kstat *st)
+{
+    st->swap_outs = swap_out_cnt;
+    st->swap_ins = swap_in_cnt;
+}
+
+/* Stores the page at KPAGE, compressed, in the cache as the
+ * contents of SLOT, replacing any earlier copy.  Returns false,
+ * leaving no copy in the cache, if the page does not compress to
+ * half a page, header included, or the cache is full. */
+static bool
+zswap_store(size_t slot, const void *kpage)
+{
+    struct zpage *z = NULL;
+    size_t size;
+
+    lock_acquire(&swap_lock);
+    zswap_drop(slot);
+    size = lz_compress(kpage, PGSIZE, zbuf, PGSIZE / 2 - sizeof *z, ztable);
+    if (size > 0 && zbytes + size <= swap_cache_pages * PGSIZE) {
+        z = malloc(sizeof *z + size);
+    }
+    if (z == NULL) {
+        zreject_cnt++;
+        lock_release(&swap_lock);
+        return false;
+    }
+    z->size = size;
+    memcpy(z->data, zbuf, size);
+    zpages[slot] = z;
+    zbytes += size;
+    zstore_cnt++;
+    lock_release(&swap_lock);
+    return true;
+}
+
+/* Decompresses SLOT's copy in the cache into KPAGE.  Returns
+ * false if the cache has no copy of SLOT. */
+static bool
+zswap_load(size_t slot, void *kpage)
+{
+    struct zpage *z;
+
+    lock_acquire(&swap_lock);
+    z = zpages[slot];
+    if (z != NULL) {
+        if (lz_decompress(z->data, z->size, kpage, PGSIZE) != PGSIZE) {
+            PANIC("swap cache: slot %zu is corrupt", slot);
+        }
+        zload_cnt++;
+    }
+    lock_release(&swap_lock);
+    return z != NULL;
+}
+
+/* Frees SLOT's copy in the cache, if any.  The caller must hold
+ * swap_lock. */
+static void
+zswap_drop(size_t slot)
+{
+    struct zpage *z = zpages[slot];
+
+    if (z != NULL) {
+        zbytes -= z->size;
+        free(z);
+        zpages[slot] = NULL;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+struct kstat;
+
+/* Slot number meaning "not in swap". */
+#define SWAP_NONE ((size_t) -1)
+
+/* Most pages swapped out, or read ahead, together. */
+#define SWAP_CLUSTER 8
+
+/* -zswap: Pages of memory for compressed swap, or 0 for none. */
+extern size_t swap_cache_pages;
+
+void swap_init(void);
+size_t swap_alloc(size_t cnt);
+void swap_write(size_t slot, const void *kpage);
+void swap_read(size_t slot, void *kpage);
+void swap_dup(size_t slot);
+void swap_free(size_t slot);
+void swap_print_stats(void);
+void swap_kstat(struct kstat *);
+
+#endif /* vm/swap.h */